@@ -238,6 +238,9 @@ public:
   /// by -fprofile-sample-use or -fprofile-instr-use.
   std::string ProfileRemappingFile;
 
+  /// Name of the memory profile file to use with -fmemory-profile-use.
+  std::string MemoryProfileUsePath;
+
   /// Name of the function summary index file to use for ThinLTO function
   /// importing.
   std::string ThinLTOIndexFile;
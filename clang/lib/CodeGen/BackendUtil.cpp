@@ -1383,6 +1383,11 @@ void EmitAssemblyHelper::EmitAssemblyWithNewPassManager(
       MPM.addPass(ModuleMemProfilerPass());
     }
 
+    // The allocation calls are matched to the profile by their inline call
+    // stacks, which are the most complete once the pipeline has inlined.
+    if (!CodeGenOpts.MemoryProfileUsePath.empty())
+      MPM.addPass(MemProfUsePass(CodeGenOpts.MemoryProfileUsePath));
+
     if (LangOpts.Sanitize.has(SanitizerKind::HWAddress)) {
       bool Recover = CodeGenOpts.SanitizeRecover.has(SanitizerKind::HWAddress);
       MPM.addPass(HWAddressSanitizerPass(
@@ -4227,6 +4227,7 @@ void Clang::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasFlag(options::OPT_fmemory_profile,
                    options::OPT_fno_memory_profile, false))
     Args.AddLastArg(CmdArgs, options::OPT_fmemory_profile);
+  Args.AddLastArg(CmdArgs, options::OPT_fmemory_profile_use_EQ);
 
   // Embed-bitcode option.
   // Only white-listed flags below are allowed to be embedded.
@@ -1036,6 +1036,12 @@ static bool ParseCodeGenArgs(CodeGenOptions &Opts, ArgList &Args, InputKind IK,
       std::string(Args.getLastArgValue(OPT_fthin_link_bitcode_EQ));
 
   Opts.MemProf = Args.hasArg(OPT_fmemory_profile);
+  Opts.MemoryProfileUsePath =
+      std::string(Args.getLastArgValue(OPT_fmemory_profile_use_EQ));
+  if (!Opts.MemoryProfileUsePath.empty() && !Opts.ExperimentalNewPassManager)
+    Diags.Report(diag::err_drv_argument_only_allowed_with)
+        << Args.getLastArg(OPT_fmemory_profile_use_EQ)->getAsString(Args)
+        << "-fexperimental-new-pass-manager";
 
   Opts.MSVolatile = Args.hasArg(OPT_fms_volatile);
 
@@ -0,0 +1,352 @@
+//===-- memprof_allocator.cpp --------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of MemProfiler, a memory profiler.
+//
+// Implementation of MemProf's memory allocator, which uses the allocator
+// from sanitizer_common.
+//
+// Every chunk records its allocation context, time and cpu in the allocator
+// metadata. When the chunk is freed, the access counters in its shadow are
+// summed up into a MemInfoBlock, which is merged into the table entry for its
+// allocation context.
+//===----------------------------------------------------------------------===//
+
+#include "memprof_allocator.h"
+#include "memprof_mapping.h"
+#include "memprof_stack.h"
+#include "sanitizer_common/sanitizer_allocator_checks.h"
+#include "sanitizer_common/sanitizer_allocator_interface.h"
+#include "sanitizer_common/sanitizer_allocator_report.h"
+#include "sanitizer_common/sanitizer_errno.h"
+#include "sanitizer_common/sanitizer_flags.h"
+#include "sanitizer_common/sanitizer_internal_defs.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
+
+namespace __memprof {
+
+static const uptr kMaxAllowedMallocSize = 1ULL << 40;
+
+static MemprofAllocator allocator;
+static MIBMapTy mib_map;
+static uptr max_malloc_size;
+
+static THREADLOCAL AllocatorCache allocator_cache;
+static AllocatorCache *GetAllocatorCache() { return &allocator_cache; }
+
+MIBMapTy &GetMIBMap() { return mib_map; }
+
+void InitializeAllocator() {
+  SetAllocatorMayReturnNull(common_flags()->allocator_may_return_null);
+  allocator.InitLinkerInitialized(
+      common_flags()->allocator_release_to_os_interval_ms);
+  if (common_flags()->max_allocation_size_mb)
+    max_malloc_size = Min(common_flags()->max_allocation_size_mb << 20,
+                          kMaxAllowedMallocSize);
+  else
+    max_malloc_size = kMaxAllowedMallocSize;
+  mib_map.Init();
+}
+
+static ChunkMetadata *Metadata(const void *p) {
+  return reinterpret_cast<ChunkMetadata *>(allocator.GetMetaData(p));
+}
+
+// Zeroes the access counters of [p, p + size).
+static void ClearShadow(uptr p, uptr size) {
+  uptr shadow_beg = MEM_TO_SHADOW(p);
+  uptr shadow_end = MEM_TO_SHADOW(p + size - 1) + SHADOW_ENTRY_SIZE;
+  if (shadow_end - shadow_beg < common_flags()->clear_shadow_mmap_threshold) {
+    internal_memset((void *)shadow_beg, 0, shadow_end - shadow_beg);
+    return;
+  }
+  // Give whole pages back to the OS rather than writing to them.
+  uptr page_size = GetPageSizeCached();
+  uptr page_beg = RoundUpTo(shadow_beg, page_size);
+  uptr page_end = RoundDownTo(shadow_end, page_size);
+  if (page_beg >= page_end) {
+    internal_memset((void *)shadow_beg, 0, shadow_end - shadow_beg);
+    return;
+  }
+  if (page_beg != shadow_beg)
+    internal_memset((void *)shadow_beg, 0, page_beg - shadow_beg);
+  if (page_end != shadow_end)
+    internal_memset((void *)page_end, 0, shadow_end - page_end);
+  ReleaseMemoryPagesToOS(page_beg, page_end);
+}
+
+// Sums the access counters of [p, p + size).
+static u64 GetShadowCount(uptr p, uptr size) {
+  u64 *shadow = (u64 *)MEM_TO_SHADOW(p);
+  u64 *shadow_end = (u64 *)MEM_TO_SHADOW(p + size - 1);
+  u64 count = 0;
+  for (; shadow <= shadow_end; shadow++)
+    count += *shadow;
+  return count;
+}
+
+// Folds the statistics of the chunk at p into map, as if it was freed now.
+static void RecordDeallocation(const ChunkMetadata *m, uptr p, MIBMapTy &map) {
+  u64 access_count = GetShadowCount(p, m->requested_size);
+  MemInfoBlock newMIB(m->requested_size, access_count, m->timestamp_ms,
+                      GetTimestamp(), m->cpu_id, GetCpuId());
+  map.Insert(m->alloc_context_id, newMIB);
+}
+
+static void *ReportAllocationSizeTooBig(uptr size,
+                                        const BufferedStackTrace *stack) {
+  if (AllocatorMayReturnNull()) {
+    Report("WARNING: MemProfiler failed to allocate 0x%zx bytes\n", size);
+    return nullptr;
+  }
+  ReportAllocationSizeTooBig(size, max_malloc_size, stack);
+}
+
+static void *Allocate(uptr size, uptr alignment, BufferedStackTrace *stack,
+                      bool cleared) {
+  if (size == 0)
+    size = 1;
+  if (UNLIKELY(size > max_malloc_size))
+    return ReportAllocationSizeTooBig(size, stack);
+  // Chunks own whole shadow granules.
+  alignment = Max(alignment, (uptr)MEM_GRANULARITY);
+  void *p = allocator.Allocate(GetAllocatorCache(), size, alignment);
+  if (UNLIKELY(!p)) {
+    SetAllocatorOutOfMemory();
+    if (AllocatorMayReturnNull())
+      return nullptr;
+    ReportOutOfMemory(size, stack);
+  }
+  // Do not rely on the allocator to clear the memory (it's slow).
+  if (cleared && allocator.FromPrimary(p))
+    internal_memset(p, 0, size);
+  ClearShadow((uptr)p, size);
+
+  // The first frame of the stack is in the interceptor.
+  StackTrace context(stack->trace, stack->size);
+  if (context.size > 1) {
+    context.trace++;
+    context.size--;
+  }
+  ChunkMetadata *m = Metadata(p);
+  CHECK(m);
+  m->alloc_context_id = StackDepotPut(context);
+  m->requested_size = size;
+  m->timestamp_ms = GetTimestamp();
+  m->cpu_id = GetCpuId();
+  atomic_store(&m->allocated, 1, memory_order_release);
+  if (&__sanitizer_malloc_hook)
+    __sanitizer_malloc_hook(p, size);
+  RunMallocHooks(p, size);
+  return p;
+}
+
+static void ReportDoubleFree(void *p, BufferedStackTrace *stack) {
+  ScopedErrorReportLock l;
+  Report("ERROR: MemProfiler: attempting double-free on %p\n", p);
+  stack->Print();
+  Die();
+}
+
+static void ReportFreeNotMalloced(void *p, BufferedStackTrace *stack) {
+  ScopedErrorReportLock l;
+  Report("ERROR: MemProfiler: attempting free on address which was not "
+         "malloc()-ed: %p\n",
+         p);
+  stack->Print();
+  Die();
+}
+
+// Returns the metadata of the chunk starting at p, which must have been
+// returned by Allocate.
+static ChunkMetadata *GetChunkMetadata(void *p, BufferedStackTrace *stack) {
+  if (!allocator.PointerIsMine(p) || allocator.GetBlockBegin(p) != p)
+    ReportFreeNotMalloced(p, stack);
+  ChunkMetadata *m = Metadata(p);
+  CHECK(m);
+  return m;
+}
+
+static void Deallocate(void *p, BufferedStackTrace *stack) {
+  if (!p)
+    return;
+  ChunkMetadata *m = GetChunkMetadata(p, stack);
+  // Returning the chunk to the allocator twice would corrupt its free list.
+  if (!atomic_exchange(&m->allocated, 0, memory_order_acq_rel))
+    ReportDoubleFree(p, stack);
+  if (&__sanitizer_free_hook)
+    __sanitizer_free_hook(p);
+  RunFreeHooks(p);
+  RecordDeallocation(m, (uptr)p, mib_map);
+  allocator.Deallocate(GetAllocatorCache(), p);
+}
+
+// The lifetime of the old chunk ends at a reallocation, even if the allocator
+// could grow it in place, so reallocation always moves the chunk.
+static void *Reallocate(void *old_ptr, uptr new_size,
+                        BufferedStackTrace *stack) {
+  uptr old_size = GetChunkMetadata(old_ptr, stack)->requested_size;
+  void *new_ptr = Allocate(new_size, 1, stack, false);
+  if (new_ptr) {
+    internal_memcpy(new_ptr, old_ptr, Min(new_size, old_size));
+    Deallocate(old_ptr, stack);
+  }
+  return new_ptr;
+}
+
+static void RecordLiveChunk(uptr chunk, void *arg) {
+  ChunkMetadata *m = Metadata((void *)chunk);
+  if (m && atomic_load(&m->allocated, memory_order_acquire))
+    RecordDeallocation(m, chunk, *reinterpret_cast<MIBMapTy *>(arg));
+}
+
+void RecordLiveAllocations(MIBMapTy &map) {
+  allocator.ForceLock();
+  allocator.ForEachChunk(RecordLiveChunk, &map);
+  allocator.ForceUnlock();
+}
+
+void memprof_free(void *ptr, BufferedStackTrace *stack) {
+  Deallocate(ptr, stack);
+}
+
+void *memprof_malloc(uptr size, BufferedStackTrace *stack) {
+  return SetErrnoOnNull(Allocate(size, 8, stack, false));
+}
+
+void *memprof_calloc(uptr nmemb, uptr size, BufferedStackTrace *stack) {
+  if (UNLIKELY(CheckForCallocOverflow(size, nmemb))) {
+    if (AllocatorMayReturnNull())
+      return nullptr;
+    ReportCallocOverflow(nmemb, size, stack);
+  }
+  return SetErrnoOnNull(Allocate(nmemb * size, 8, stack, true));
+}
+
+void *memprof_realloc(void *p, uptr size, BufferedStackTrace *stack) {
+  if (!p)
+    return SetErrnoOnNull(Allocate(size, 8, stack, false));
+  if (size == 0) {
+    if (flags()->allocator_frees_and_returns_null_on_realloc_zero) {
+      Deallocate(p, stack);
+      return nullptr;
+    }
+    // Allocate a size of 1 if we shouldn't free() on Realloc to 0
+    size = 1;
+  }
+  return SetErrnoOnNull(Reallocate(p, size, stack));
+}
+
+void *memprof_reallocarray(void *p, uptr nmemb, uptr size,
+                           BufferedStackTrace *stack) {
+  if (UNLIKELY(CheckForCallocOverflow(size, nmemb))) {
+    errno = errno_ENOMEM;
+    if (AllocatorMayReturnNull())
+      return nullptr;
+    ReportReallocArrayOverflow(nmemb, size, stack);
+  }
+  return memprof_realloc(p, nmemb * size, stack);
+}
+
+void *memprof_valloc(uptr size, BufferedStackTrace *stack) {
+  return SetErrnoOnNull(Allocate(size, GetPageSizeCached(), stack, false));
+}
+
+void *memprof_pvalloc(uptr size, BufferedStackTrace *stack) {
+  uptr PageSize = GetPageSizeCached();
+  if (UNLIKELY(CheckForPvallocOverflow(size, PageSize))) {
+    errno = errno_ENOMEM;
+    if (AllocatorMayReturnNull())
+      return nullptr;
+    ReportPvallocOverflow(size, stack);
+  }
+  // pvalloc(0) should allocate one page.
+  size = size ? RoundUpTo(size, PageSize) : PageSize;
+  return SetErrnoOnNull(Allocate(size, PageSize, stack, false));
+}
+
+void *memprof_memalign(uptr alignment, uptr size, BufferedStackTrace *stack) {
+  if (UNLIKELY(!IsPowerOfTwo(alignment))) {
+    errno = errno_EINVAL;
+    if (AllocatorMayReturnNull())
+      return nullptr;
+    ReportInvalidAllocationAlignment(alignment, stack);
+  }
+  return SetErrnoOnNull(Allocate(size, alignment, stack, false));
+}
+
+void *memprof_aligned_alloc(uptr alignment, uptr size,
+                            BufferedStackTrace *stack) {
+  if (UNLIKELY(!CheckAlignedAllocAlignmentAndSize(alignment, size))) {
+    errno = errno_EINVAL;
+    if (AllocatorMayReturnNull())
+      return nullptr;
+    ReportInvalidAlignedAllocAlignment(size, alignment, stack);
+  }
+  return SetErrnoOnNull(Allocate(size, alignment, stack, false));
+}
+
+int memprof_posix_memalign(void **memptr, uptr alignment, uptr size,
+                           BufferedStackTrace *stack) {
+  if (UNLIKELY(!CheckPosixMemalignAlignment(alignment))) {
+    if (AllocatorMayReturnNull())
+      return errno_EINVAL;
+    ReportInvalidPosixMemalignAlignment(alignment, stack);
+  }
+  void *ptr = Allocate(size, alignment, stack, false);
+  if (UNLIKELY(!ptr))
+    // OOM error is already taken care of by Allocate.
+    return errno_ENOMEM;
+  CHECK(IsAligned((uptr)ptr, alignment));
+  *memptr = ptr;
+  return 0;
+}
+
+uptr memprof_malloc_usable_size(const void *ptr) {
+  void *p = const_cast<void *>(ptr);
+  if (!p || !allocator.PointerIsMine(p))
+    return 0;
+  void *chunk = allocator.GetBlockBegin(p);
+  if (chunk != p)
+    return 0;
+  ChunkMetadata *m = Metadata(chunk);
+  if (!atomic_load(&m->allocated, memory_order_acquire))
+    return 0;
+  return m->requested_size;
+}
+
+} // namespace __memprof
+
+// ---------------------- Interface ---------------- {{{1
+using namespace __memprof;
+
+uptr __sanitizer_get_estimated_allocated_size(uptr size) { return size; }
+
+int __sanitizer_get_ownership(const void *p) {
+  return memprof_malloc_usable_size(p) != 0;
+}
+
+uptr __sanitizer_get_allocated_size(const void *p) {
+  return memprof_malloc_usable_size(p);
+}
+
+uptr __sanitizer_get_current_allocated_bytes() {
+  uptr stats[AllocatorStatCount];
+  allocator.GetStats(stats);
+  return stats[AllocatorStatAllocated];
+}
+
+uptr __sanitizer_get_heap_size() {
+  uptr stats[AllocatorStatCount];
+  allocator.GetStats(stats);
+  return stats[AllocatorStatMapped];
+}
+
+uptr __sanitizer_get_free_bytes() { return 1; }
+
+uptr __sanitizer_get_unmapped_bytes() { return 1; }
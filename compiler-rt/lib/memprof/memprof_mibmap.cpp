@@ -0,0 +1,61 @@
+//===-- memprof_mibmap.cpp -----------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of MemProfiler, a memory profiler.
+//
+//===----------------------------------------------------------------------===//
+
+#include "memprof_mibmap.h"
+#include "sanitizer_common/sanitizer_allocator_internal.h"
+#include "sanitizer_common/sanitizer_common.h"
+
+namespace __memprof {
+
+void MIBMapTy::Init() {
+  // The buckets are zero initialized by the mapping, which unlocks all their
+  // mutexes.
+  buckets_ = (Bucket *)MmapOrDie(kNumBuckets * sizeof(Bucket), "MIBMap");
+}
+
+void MIBMapTy::Destroy() {
+  for (uptr i = 0; i < kNumBuckets; i++) {
+    for (Entry *e = buckets_[i].head; e;) {
+      Entry *next = e->next;
+      InternalFree(e);
+      e = next;
+    }
+  }
+  UnmapOrDie(buckets_, kNumBuckets * sizeof(Bucket));
+  buckets_ = nullptr;
+}
+
+void MIBMapTy::Insert(u64 stack_id, const MemInfoBlock &newMIB) {
+  Bucket &b = buckets_[stack_id % kNumBuckets];
+  __sanitizer::SpinMutexLock l(&b.mu);
+  for (Entry *e = b.head; e; e = e->next) {
+    if (e->stack_id == stack_id) {
+      e->mib.Merge(newMIB);
+      return;
+    }
+  }
+  Entry *e = (Entry *)InternalAlloc(sizeof(Entry));
+  e->stack_id = stack_id;
+  e->mib = newMIB;
+  e->next = b.head;
+  b.head = e;
+}
+
+uptr MIBMapTy::size() const {
+  uptr n = 0;
+  for (uptr i = 0; i < kNumBuckets; i++)
+    for (Entry *e = buckets_[i].head; e; e = e->next)
+      n++;
+  return n;
+}
+
+} // namespace __memprof
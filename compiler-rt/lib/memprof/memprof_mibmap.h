@@ -0,0 +1,75 @@
+//===-- memprof_mibmap.h ---------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of MemProfiler, a memory profiler.
+//
+// MemProf-private header for the table of MemInfoBlocks, keyed by the stack
+// depot id of the allocation context.
+//===----------------------------------------------------------------------===//
+#ifndef MEMPROF_MIBMAP_H
+#define MEMPROF_MIBMAP_H
+
+#include <stdint.h>
+
+#include "profile/MemProfData.inc"
+#include "sanitizer_common/sanitizer_mutex.h"
+
+namespace __memprof {
+
+using __sanitizer::u64;
+using __sanitizer::uptr;
+using ::llvm::memprof::MemInfoBlock;
+
+// A hash table from allocation stack ids to the merged MemInfoBlock of all the
+// allocations from that stack. Entries are never removed, and each bucket has
+// its own lock, so that concurrent deallocations from different contexts do
+// not contend.
+class MIBMapTy {
+public:
+  struct Entry {
+    u64 stack_id;
+    MemInfoBlock mib;
+    Entry *next;
+  };
+
+  void Init();
+
+  // Frees all the entries and the buckets.
+  void Destroy();
+
+  // Merges newMIB into the entry for stack_id, creating it if needed.
+  void Insert(u64 stack_id, const MemInfoBlock &newMIB);
+
+  // Calls fn(const Entry &) for each entry, with the bucket of the entry
+  // locked.
+  template <typename Fn> void ForEach(Fn fn) {
+    for (uptr i = 0; i < kNumBuckets; i++) {
+      __sanitizer::SpinMutexLock l(&buckets_[i].mu);
+      for (Entry *e = buckets_[i].head; e; e = e->next)
+        fn(*e);
+    }
+  }
+
+  // The number of entries in the table. Only exact while no other thread
+  // inserts into it.
+  uptr size() const;
+
+private:
+  static const uptr kNumBuckets = 1 << 14;
+
+  struct Bucket {
+    __sanitizer::StaticSpinMutex mu;
+    Entry *head;
+  };
+
+  Bucket *buckets_;
+};
+
+} // namespace __memprof
+
+#endif // MEMPROF_MIBMAP_H
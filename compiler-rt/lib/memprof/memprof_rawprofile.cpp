@@ -0,0 +1,141 @@
+//===-- memprof_rawprofile.cpp -------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of MemProfiler, a memory profiler.
+//
+//===----------------------------------------------------------------------===//
+
+#include "memprof_rawprofile.h"
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
+#include "sanitizer_common/sanitizer_stacktrace.h"
+
+namespace __memprof {
+using ::llvm::memprof::Header;
+using ::llvm::memprof::SegmentEntry;
+
+namespace {
+
+// Appends POD values to a growing byte buffer.
+class Writer {
+public:
+  template <typename T> void Write(const T &V) {
+    Write(reinterpret_cast<const char *>(&V), sizeof(T));
+  }
+
+  void Write(const char *Data, uptr Size) {
+    uptr Offset = Bytes.size();
+    if (Offset + Size > Bytes.capacity())
+      Bytes.reserve(Max(2 * Bytes.capacity(), Offset + Size));
+    Bytes.resize(Offset + Size);
+    internal_memcpy(Bytes.data() + Offset, Data, Size);
+  }
+
+  // Writes a placeholder u64 and returns its offset, to be patched by Patch.
+  uptr Reserve() {
+    uptr Offset = Bytes.size();
+    Write<u64>(0);
+    return Offset;
+  }
+
+  void Patch(uptr Offset, u64 V) {
+    internal_memcpy(Bytes.data() + Offset, &V, sizeof(V));
+  }
+
+  // Pads the buffer with zeroes up to an 8 byte boundary, so that every
+  // section starts aligned.
+  void Align() {
+    while (Bytes.size() % 8)
+      Bytes.push_back(0);
+  }
+
+  uptr Size() const { return Bytes.size(); }
+
+  explicit Writer(InternalMmapVector<char> &Bytes) : Bytes(Bytes) {}
+  InternalMmapVector<char> &Bytes;
+};
+
+} // namespace
+
+static void SerializeSegments(Writer &W, MemoryMappingLayout &Layout) {
+  char BinaryName[kMaxPathLength];
+  ReadBinaryNameCached(BinaryName, sizeof(BinaryName));
+  InternalMmapVector<char> Name(kMaxPathLength);
+  MemoryMappedSegment Segment(Name.data(), Name.size());
+
+  uptr CountOffset = W.Reserve();
+  u64 NumSegments = 0;
+  Layout.Reset();
+  while (Layout.Next(&Segment)) {
+    if (!Segment.IsReadable() || !Segment.IsExecutable() ||
+        internal_strcmp(Segment.filename, BinaryName) != 0)
+      continue;
+    SegmentEntry Entry;
+    Entry.Start = Segment.start;
+    Entry.End = Segment.end;
+    Entry.Offset = Segment.offset;
+    W.Write(Entry);
+    NumSegments++;
+  }
+  W.Patch(CountOffset, NumSegments);
+  W.Align();
+}
+
+static void SerializeMIBs(Writer &W, MIBMapTy &MIBMap,
+                          InternalMmapVector<u64> &StackIds) {
+  uptr CountOffset = W.Reserve();
+  MIBMap.ForEach([&](const MIBMapTy::Entry &E) {
+    W.Write(E.stack_id);
+    W.Write(E.mib);
+    StackIds.push_back(E.stack_id);
+  });
+  W.Patch(CountOffset, StackIds.size());
+  W.Align();
+}
+
+static void SerializeStacks(Writer &W, const InternalMmapVector<u64> &StackIds) {
+  W.Write<u64>(StackIds.size());
+  for (u64 Id : StackIds) {
+    StackTrace St = StackDepotGet(Id);
+    W.Write(Id);
+    W.Write<u64>(St.size);
+    // The recorded PCs are return addresses; write the PCs of the calls so
+    // that they symbolize to the lines of the calls.
+    for (uptr I = 0; I < St.size; I++)
+      W.Write<u64>(StackTrace::GetPreviousInstructionPc(St.trace[I]));
+  }
+  W.Align();
+}
+
+void SerializeToRawProfile(MIBMapTy &MIBMap, MemoryMappingLayout &Layout,
+                           InternalMmapVector<char> &Buffer) {
+  Buffer.clear();
+  Writer W(Buffer);
+  W.Write(Header());
+
+  u64 SegmentOffset = W.Size();
+  SerializeSegments(W, Layout);
+
+  u64 MIBOffset = W.Size();
+  InternalMmapVector<u64> StackIds;
+  SerializeMIBs(W, MIBMap, StackIds);
+
+  u64 StackOffset = W.Size();
+  SerializeStacks(W, StackIds);
+
+  Header H;
+  H.Magic = MEMPROF_RAW_MAGIC_64;
+  H.Version = MEMPROF_RAW_VERSION;
+  H.TotalSize = W.Size();
+  H.SegmentOffset = SegmentOffset;
+  H.MIBOffset = MIBOffset;
+  H.StackOffset = StackOffset;
+  internal_memcpy(Buffer.data(), &H, sizeof(H));
+}
+
+} // namespace __memprof
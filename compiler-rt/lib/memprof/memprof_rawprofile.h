@@ -0,0 +1,30 @@
+//===-- memprof_rawprofile.h -----------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of MemProfiler, a memory profiler.
+//
+// Serialization of the memory profile into the raw format read by
+// llvm-profdata, see profile/MemProfData.inc.
+//===----------------------------------------------------------------------===//
+#ifndef MEMPROF_RAWPROFILE_H
+#define MEMPROF_RAWPROFILE_H
+
+#include "memprof_mibmap.h"
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_procmaps.h"
+
+namespace __memprof {
+
+// Serializes the profile into Buffer. Only the executable segments of the main
+// binary are listed, since those are what the profile is matched against.
+void SerializeToRawProfile(MIBMapTy &MIBMap, MemoryMappingLayout &Layout,
+                           InternalMmapVector<char> &Buffer);
+
+} // namespace __memprof
+
+#endif // MEMPROF_RAWPROFILE_H
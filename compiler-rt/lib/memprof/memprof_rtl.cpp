@@ -0,0 +1,322 @@
+//===-- memprof_rtl.cpp --------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of MemProfiler, a memory profiler.
+//
+// Main file of the MemProf run-time library.
+//===----------------------------------------------------------------------===//
+
+#include "memprof_allocator.h"
+#include "memprof_interceptors.h"
+#include "memprof_interface_internal.h"
+#include "memprof_internal.h"
+#include "memprof_mapping.h"
+#include "memprof_rawprofile.h"
+#include "memprof_stack.h"
+#include "sanitizer_common/sanitizer_atomic.h"
+#include "sanitizer_common/sanitizer_file.h"
+#include "sanitizer_common/sanitizer_flags.h"
+#include "sanitizer_common/sanitizer_libc.h"
+#include "sanitizer_common/sanitizer_procmaps.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
+#include "sanitizer_common/sanitizer_symbolizer.h"
+
+uptr __memprof_shadow_memory_dynamic_address; // Global interface symbol.
+
+namespace __memprof {
+
+static void MemprofDie() {
+  static atomic_uint32_t num_calls;
+  if (atomic_fetch_add(&num_calls, 1, memory_order_relaxed) != 0) {
+    // Don't die twice - run a busy loop.
+    while (1) {
+    }
+  }
+  if (common_flags()->print_module_map >= 1)
+    DumpProcessMap();
+  if (flags()->unmap_shadow_on_exit) {
+    if (kHighShadowEnd)
+      UnmapOrDie((void *)kLowShadowBeg, kHighShadowEnd - kLowShadowBeg);
+  }
+}
+
+static void CheckUnwind() {
+  GET_STACK_TRACE(kStackTraceMax, common_flags()->fast_unwind_on_check);
+  stack.Print();
+}
+
+static void MemprofCheckFailed(const char *file, int line, const char *cond,
+                               u64 v1, u64 v2) {
+  Report("MemProfiler CHECK failed: %s:%d \"%s\" (0x%zx, 0x%zx)\n", file,
+         line, cond, (uptr)v1, (uptr)v2);
+  // Print a stack trace the first time we come here. Otherwise, we probably
+  // failed a CHECK during symbolization.
+  static atomic_uint32_t num_calls;
+  if (atomic_fetch_add(&num_calls, 1, memory_order_relaxed) == 0)
+    CheckUnwind();
+  Die();
+}
+
+// -------------------------- Globals --------------------- {{{1
+int memprof_inited;
+bool memprof_init_is_running;
+static u64 memprof_init_time_ns;
+
+uptr kHighMemEnd;
+
+u32 GetTimestamp() {
+  return (MonotonicNanoTime() - memprof_init_time_ns) / 1000000;
+}
+
+static THREADLOCAL uptr thread_stack_top, thread_stack_bottom;
+
+void GetCurrentThreadStackBounds(uptr *stack_top, uptr *stack_bottom) {
+  // Looking up the bounds of a new thread may allocate. The allocations made
+  // while doing so are recorded without their calling context.
+  static THREADLOCAL bool in_lookup;
+  if (UNLIKELY(!thread_stack_top) && !in_lookup) {
+    in_lookup = true;
+    GetThreadStackTopAndBottom(/*at_initialization=*/false, &thread_stack_top,
+                               &thread_stack_bottom);
+    in_lookup = false;
+  }
+  *stack_top = thread_stack_top;
+  *stack_bottom = thread_stack_bottom;
+}
+
+// ---------------------- Profile output ------------------- {{{1
+
+static void PrintMIB(const MIBMapTy::Entry &E) {
+  const MemInfoBlock &M = E.mib;
+  u32 Count = M.AllocCount ? M.AllocCount : 1;
+  if (flags()->print_terse) {
+    Printf("MIB:%llu/%u/%llu/%u/%u/%llu/%llu/%llu/%llu/%u/%u/%u/%u/%u/%u\n",
+           E.stack_id, M.AllocCount, M.TotalSize / Count, M.MinSize,
+           M.MaxSize, M.TotalAccessCount / Count, M.MinAccessCount,
+           M.MaxAccessCount, M.TotalLifetime / Count, M.MinLifetime,
+           M.MaxLifetime, M.NumMigratedCpu, M.NumLifetimeOverlaps,
+           M.NumSameAllocCpu, M.NumSameDeallocCpu);
+    return;
+  }
+  Printf("Memory allocation stack id = %llu\n", E.stack_id);
+  Printf("\talloc_count %u, size (ave/min/max) %llu / %u / %u\n", M.AllocCount,
+         M.TotalSize / Count, M.MinSize, M.MaxSize);
+  Printf("\taccess_count (ave/min/max): %llu / %llu / %llu\n",
+         M.TotalAccessCount / Count, M.MinAccessCount, M.MaxAccessCount);
+  Printf("\tlifetime (ave/min/max): %llu / %u / %u\n", M.TotalLifetime / Count,
+         M.MinLifetime, M.MaxLifetime);
+  Printf("\tnum migrated: %u, num lifetime overlaps: %u, num same alloc "
+         "cpu: %u, num same dealloc_cpu: %u\n",
+         M.NumMigratedCpu, M.NumLifetimeOverlaps, M.NumSameAllocCpu,
+         M.NumSameDeallocCpu);
+  StackDepotGet(E.stack_id).Print();
+}
+
+// Expands %p in the profile_file flag to the process id.
+static void GetProfilePath(char *Path, uptr Size) {
+  uptr N = 0;
+  for (const char *P = flags()->profile_file; *P && N + 1 < Size; P++) {
+    if (P[0] == '%' && P[1] == 'p') {
+      N += internal_snprintf(Path + N, Size - N, "%zd", internal_getpid());
+      N = Min(N, Size - 1);
+      P++;
+      continue;
+    }
+    Path[N++] = *P;
+  }
+  Path[N] = '\0';
+}
+
+static bool WriteRawProfile(MIBMapTy &MIBMap) {
+  MemoryMappingLayout Layout(/*cache_enabled=*/true);
+  InternalMmapVector<char> Buffer;
+  SerializeToRawProfile(MIBMap, Layout, Buffer);
+
+  char Path[kMaxPathLength];
+  GetProfilePath(Path, sizeof(Path));
+  error_t Err;
+  fd_t Fd = OpenFile(Path, WrOnly, &Err);
+  if (Fd == kInvalidFd) {
+    Report("MemProfiler: failed to open %s for writing (reason: %d)\n", Path,
+           Err);
+    return false;
+  }
+  bool Written = WriteToFile(Fd, Buffer.data(), Buffer.size(), nullptr, &Err);
+  CloseFile(Fd);
+  if (!Written) {
+    Report("MemProfiler: failed to write %s (reason: %d)\n", Path, Err);
+    return false;
+  }
+  VReport(1, "MemProfiler: wrote the profile to %s\n", Path);
+  return true;
+}
+
+static StaticSpinMutex write_profile_mu;
+
+// Writes the profile of all the allocations so far. The allocations that are
+// still live are added to a snapshot of the table, so that they are counted
+// again with their full lifetime when they are freed later.
+static bool WriteProfile() {
+  SpinMutexLock l(&write_profile_mu);
+  MIBMapTy Snapshot;
+  Snapshot.Init();
+  GetMIBMap().ForEach(
+      [&](const MIBMapTy::Entry &E) { Snapshot.Insert(E.stack_id, E.mib); });
+  RecordLiveAllocations(Snapshot);
+
+  bool Ok = true;
+  if (flags()->print_text) {
+    Printf("Recorded MIBs (incl. live on exit):\n");
+    Snapshot.ForEach(PrintMIB);
+  } else {
+    Ok = WriteRawProfile(Snapshot);
+  }
+  Snapshot.Destroy();
+  return Ok;
+}
+
+static void MemprofAtExit() { WriteProfile(); }
+
+void PrintAddressSpaceLayout() {
+  if (kHighMemBeg) {
+    Printf("|| `[%p, %p]` || HighMem    ||\n", (void *)kHighMemBeg,
+           (void *)kHighMemEnd);
+    Printf("|| `[%p, %p]` || HighShadow ||\n", (void *)kHighShadowBeg,
+           (void *)kHighShadowEnd);
+  }
+  Printf("|| `[%p, %p]` || ShadowGap  ||\n", (void *)kShadowGapBeg,
+         (void *)kShadowGapEnd);
+  if (kLowShadowBeg) {
+    Printf("|| `[%p, %p]` || LowShadow  ||\n", (void *)kLowShadowBeg,
+           (void *)kLowShadowEnd);
+    Printf("|| `[%p, %p]` || LowMem     ||\n", (void *)kLowMemBeg,
+           (void *)kLowMemEnd);
+  }
+  Printf("MemToShadow(shadow): %p %p", (void *)MEM_TO_SHADOW(kLowShadowBeg),
+         (void *)MEM_TO_SHADOW(kLowShadowEnd));
+  if (kHighMemBeg) {
+    Printf(" %p %p", (void *)MEM_TO_SHADOW(kHighShadowBeg),
+           (void *)MEM_TO_SHADOW(kHighShadowEnd));
+  }
+  Printf("\n");
+  Printf("malloc_context_size=%zu\n",
+         (uptr)common_flags()->malloc_context_size);
+
+  Printf("SHADOW_SCALE: %d\n", (int)SHADOW_SCALE);
+  Printf("SHADOW_GRANULARITY: %d\n", (int)SHADOW_GRANULARITY);
+  Printf("SHADOW_OFFSET: 0x%zx\n", (uptr)SHADOW_OFFSET);
+  CHECK(SHADOW_SCALE >= 3 && SHADOW_SCALE <= 7);
+}
+
+static void InitializeHighMemEnd() {
+  kHighMemEnd = GetMaxUserVirtualAddress();
+  // Increase kHighMemEnd to make sure it's properly
+  // aligned together with kHighMemBeg:
+  kHighMemEnd |= (GetMmapGranularity() << SHADOW_SCALE) - 1;
+}
+
+static void MemprofInitInternal() {
+  if (LIKELY(memprof_inited))
+    return;
+  SanitizerToolName = "MemProfiler";
+  CHECK(!memprof_init_is_running && "MemProf init calls itself!");
+  memprof_init_is_running = true;
+  memprof_init_time_ns = MonotonicNanoTime();
+
+  CacheBinaryName();
+
+  // Initialize flags. This must be done early, because most of the
+  // initialization steps look at flags().
+  InitializeFlags();
+
+  SetMallocContextSize(common_flags()->malloc_context_size);
+
+  InitializeHighMemEnd();
+
+  // Install tool-specific callbacks in sanitizer_common.
+  AddDieCallback(MemprofDie);
+  SetCheckFailedCallback(MemprofCheckFailed);
+
+  __sanitizer_set_report_path(common_flags()->log_path);
+
+  __sanitizer::InitializePlatformEarly();
+
+  // The main thread may not be able to look up its stack bounds once the
+  // allocator is in use.
+  GetThreadStackTopAndBottom(/*at_initialization=*/true, &thread_stack_top,
+                             &thread_stack_bottom);
+
+  InitializeShadowMemory();
+
+  // Setup internal allocator callback.
+  SetLowLevelAllocateMinAlignment(SHADOW_GRANULARITY);
+
+  InitializeMemprofInterceptors();
+  CheckASLR();
+
+  InitializeAllocator();
+
+  // The profile of the allocations is symbolized in the process only when it
+  // is printed.
+  if (flags()->print_text)
+    Symbolizer::LateInitialize();
+
+  if (flags()->dump_at_exit)
+    Atexit(MemprofAtExit);
+
+  VReport(1, "MemProfiler Init done\n");
+
+  memprof_init_is_running = false;
+  memprof_inited = 1;
+}
+
+void MemprofInitFromRtl() { MemprofInitInternal(); }
+
+} // namespace __memprof
+
+// ---------------------- Interface ---------------- {{{1
+using namespace __memprof;
+
+// Initialize as requested from instrumented application code.
+void __memprof_init() { MemprofInitInternal(); }
+
+void __memprof_preinit() { MemprofInitInternal(); }
+
+void __memprof_version_mismatch_check_v1() {}
+
+void __memprof_record_access(void const volatile *addr) {
+  __memprof::RecordAccess((uptr)addr);
+}
+
+void __memprof_record_access_range(void const volatile *addr, uptr size) {
+  __memprof::RecordAccessRange((uptr)addr, size);
+}
+
+int __memprof_profile_dump() {
+  if (!memprof_inited)
+    return -1;
+  return WriteProfile() ? 0 : -1;
+}
+
+extern "C" SANITIZER_INTERFACE_ATTRIBUTE void __memprof_load(uptr p) {
+  __memprof::RecordAccess(p);
+}
+
+extern "C" SANITIZER_INTERFACE_ATTRIBUTE void __memprof_store(uptr p) {
+  __memprof::RecordAccess(p);
+}
+
+extern "C" SANITIZER_INTERFACE_ATTRIBUTE void __memprof_loadN(uptr p,
+                                                              uptr size) {
+  __memprof_record_access_range((void const volatile *)p, size);
+}
+
+extern "C" SANITIZER_INTERFACE_ATTRIBUTE void __memprof_storeN(uptr p,
+                                                               uptr size) {
+  __memprof_record_access_range((void const volatile *)p, size);
+}
@@ -424,6 +424,9 @@ using namespace __sanitizer;
 namespace __lsan {
 using namespace __sanitizer;
 }
+namespace __memprof {
+using namespace __sanitizer;
+}
 namespace __msan {
 using namespace __sanitizer;
 }
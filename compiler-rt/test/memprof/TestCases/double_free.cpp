@@ -0,0 +1,16 @@
+// Check that a double free is reported instead of corrupting the allocator.
+
+// RUN: %clangxx_memprof -O0 %s -o %t && not %run %t 2>&1 | FileCheck %s
+
+#include <stdlib.h>
+
+int main() {
+  char *volatile P = (char *)malloc(100);
+  P[0] = 1;
+  free(P);
+  // CHECK: ERROR: MemProfiler: attempting double-free on [[ADDR:0x[0-9a-f]+]]
+  // CHECK: #0 {{.*}} in {{.*}}free
+  // CHECK: #1 {{.*}} in main {{.*}}double_free.cpp:[[@LINE+1]]
+  free(P);
+  return 0;
+}
@@ -0,0 +1,23 @@
+// Check that freeing memory the allocator does not own is reported instead of
+// reading a chunk header from it.
+
+// RUN: %clangxx_memprof -O0 %s -o %t
+// RUN: not %run %t stack 2>&1 | FileCheck %s
+// RUN: not %run %t interior 2>&1 | FileCheck %s
+
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  char Buffer[16];
+  char *volatile P = (char *)malloc(100);
+  if (argc > 1 && !strcmp(argv[1], "interior"))
+    P += 8;
+  else
+    P = Buffer;
+  // CHECK: ERROR: MemProfiler: attempting free on address which was not malloc()-ed: [[ADDR:0x[0-9a-f]+]]
+  // CHECK: #0 {{.*}} in {{.*}}free
+  // CHECK: #1 {{.*}} in main {{.*}}free_not_malloced.cpp:[[@LINE+1]]
+  free(P);
+  return 0;
+}
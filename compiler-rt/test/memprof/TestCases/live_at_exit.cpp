@@ -0,0 +1,15 @@
+// Check that the allocations that are live at exit are in the profile.
+
+// RUN: %clangxx_memprof -O0 %s -o %t
+// RUN: %env_memprof_opts=print_text=1 %run %t 2>&1 | FileCheck %s
+
+#include <stdlib.h>
+
+int main() {
+  char *volatile P = (char *)malloc(100);
+  P[0] = 1;
+  return 0;
+}
+
+// CHECK: alloc_count 1, size (ave/min/max) 100 / 100 / 100
+// CHECK: #0 {{.*}} in main
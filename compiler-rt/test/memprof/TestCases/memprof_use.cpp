@@ -0,0 +1,51 @@
+// Check that the raw profile is symbolized and merged by llvm-profdata, and
+// that the allocation calls are marked hot or cold from the merged profile.
+
+// RUN: %clangxx_memprof -O0 -g %s -o %t
+// RUN: rm -f %t.profraw
+// RUN: %env_memprof_opts=profile_file=%t.profraw %run %t
+// RUN: llvm-profdata show --memory --profiled-binary=%t %t.profraw | FileCheck %s --check-prefix=RAW
+// RUN: llvm-profdata merge --memory --profiled-binary=%t %t.profraw -o %t.memprofdata
+// RUN: llvm-profdata show --memory --all-functions %t.memprofdata | FileCheck %s --check-prefix=INDEXED
+
+// The allocations are short lived, so the cold thresholds are raised for the
+// ones that are rarely accessed to be cold.
+// RUN: %clangxx -O0 -g -fexperimental-new-pass-manager \
+// RUN:   -fmemory-profile-use=%t.memprofdata \
+// RUN:   -mllvm -memprof-ave-lifetime-cold-threshold=0 \
+// RUN:   -mllvm -memprof-lifetime-access-density-cold-threshold=100 \
+// RUN:   -S -emit-llvm %s -o - | FileCheck %s --check-prefix=USE
+
+#include <stdlib.h>
+#include <string.h>
+
+__attribute__((noinline)) char *make_hot() { return (char *)malloc(64); }
+__attribute__((noinline)) char *make_cold() { return (char *)malloc(4096); }
+
+int main() {
+  char *Cold = make_cold();
+  memset(Cold, 0, 4096);
+  for (int I = 0; I < 10; ++I) {
+    volatile char *Hot = make_hot();
+    for (int J = 0; J < 1000; ++J)
+      Hot[J % 64] = J;
+    free((void *)Hot);
+  }
+  free(Cold);
+  return 0;
+}
+
+// RAW: MemprofProfile:
+// RAW-DAG: AllocCount: 10
+// RAW-DAG: TotalAccessCount: 10000
+// RAW-DAG: AllocCount: 1
+
+// INDEXED: Functions: 2
+// INDEXED: Allocation sites: 2
+
+// USE-LABEL: define {{.*}} @_Z8make_hotv()
+// USE: call {{.*}} @malloc(i64 {{.*}}64) #[[HOT:[0-9]+]]
+// USE-LABEL: define {{.*}} @_Z9make_coldv()
+// USE: call {{.*}} @malloc(i64 {{.*}}4096) #[[COLD:[0-9]+]]
+// USE-DAG: attributes #[[HOT]] = { {{.*}}"memprof"="hot"
+// USE-DAG: attributes #[[COLD]] = { {{.*}}"memprof"="cold"
@@ -0,0 +1,35 @@
+// Check the allocation statistics of the text profile, and that they are
+// attributed to the allocation call stacks.
+
+// RUN: %clangxx_memprof -O0 %s -o %t
+// RUN: %env_memprof_opts=print_text=1 %run %t 2>&1 | FileCheck %s
+// RUN: %env_memprof_opts=print_text=1:print_terse=1 %run %t 2>&1 | FileCheck %s --check-prefix=TERSE
+
+#include <stdlib.h>
+#include <string.h>
+
+__attribute__((noinline)) char *make_hot() { return (char *)malloc(64); }
+__attribute__((noinline)) char *make_cold() { return (char *)malloc(4096); }
+
+int main() {
+  char *Cold = make_cold();
+  memset(Cold, 0, 4096);
+  for (int I = 0; I < 10; ++I) {
+    volatile char *Hot = make_hot();
+    for (int J = 0; J < 100; ++J)
+      Hot[J % 64] = J;
+    free((void *)Hot);
+  }
+  free(Cold);
+  return 0;
+}
+
+// CHECK: Recorded MIBs (incl. live on exit):
+// CHECK-DAG: alloc_count 10, size (ave/min/max) 64 / 64 / 64
+// CHECK-DAG: access_count (ave/min/max): 100 / 100 / 100
+// CHECK-DAG: #0 {{.*}} in make_hot
+// CHECK-DAG: alloc_count 1, size (ave/min/max) 4096 / 4096 / 4096
+// CHECK-DAG: #0 {{.*}} in make_cold
+
+// TERSE-DAG: MIB:{{[0-9]+}}/10/64/64/64/100/100/100/
+// TERSE-DAG: MIB:{{[0-9]+}}/1/4096/4096/4096/
@@ -0,0 +1,24 @@
+// Check that __memprof_profile_dump writes the allocations made so far, and
+// that the profile is written again at exit.
+
+// RUN: %clangxx_memprof -O0 %s -o %t
+// RUN: %env_memprof_opts=print_text=1 %run %t 2>&1 | FileCheck %s
+
+#include <sanitizer/memprof_interface.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main() {
+  free(malloc(10));
+  fprintf(stderr, "dump: %d\n", __memprof_profile_dump());
+  free(malloc(20));
+  return 0;
+}
+
+// CHECK: Recorded MIBs (incl. live on exit):
+// CHECK: size (ave/min/max) 10 / 10 / 10
+// CHECK-NOT: size (ave/min/max) 20 / 20 / 20
+// CHECK: dump: 0
+// CHECK: Recorded MIBs (incl. live on exit):
+// CHECK-DAG: size (ave/min/max) 10 / 10 / 10
+// CHECK-DAG: size (ave/min/max) 20 / 20 / 20
@@ -154,11 +154,14 @@ std::vector<InputFile *> BitcodeCompiler::compile() {
   // native object files for ThinLTO incremental builds. If a path was
   // specified, configure LTO to use it as the cache directory.
   lto::NativeObjectCache cache;
+  lto::CacheStats cacheStats;
   if (!config->ltoCache.empty())
     cache = check(lto::localCache(
-        config->ltoCache, [&](size_t task, std::unique_ptr<MemoryBuffer> mb) {
+        config->ltoCache,
+        [&](size_t task, std::unique_ptr<MemoryBuffer> mb) {
           files[task] = std::move(mb);
-        }));
+        },
+        &cacheStats));
 
   checkError(ltoObj->run(
       [&](size_t task) {
@@ -186,8 +189,13 @@ std::vector<InputFile *> BitcodeCompiler::compile() {
     return {};
   }
 
-  if (!config->ltoCache.empty())
-    pruneCache(config->ltoCache, config->ltoCachePolicy);
+  if (!config->ltoCache.empty()) {
+    CachePruningStats pruningStats;
+    pruneCache(config->ltoCache, config->ltoCachePolicy, &pruningStats);
+    log("ThinLTO cache: " + Twine(cacheStats.Hits.load()) + " hits, " +
+        Twine(cacheStats.Misses.load()) + " misses, " +
+        Twine(pruningStats.NumEvicted) + " evicted");
+  }
 
   std::vector<InputFile *> ret;
   for (unsigned i = 0; i != maxTasks; ++i) {
@@ -0,0 +1,262 @@
+//===- BBProfileSort.cpp --------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// Profile-guided layout of basic block sections.
+///
+/// With -fbasic-block-sections, every basic block (or every group of basic
+/// blocks) of a function is emitted in its own section and starts with a
+/// symbol named after the function: "foo" for the entry block, "foo.N" for
+/// the others and "foo.cold" for the cold part. Given an edge profile
+/// between these symbols, as given by --bb-profile-file, the linker can lay
+/// out the blocks of all functions together instead of keeping the layout
+/// chosen by the compiler.
+///
+/// Definitions:
+/// * Chain
+///   * An ordered list of input sections which are laid out as a unit. At the
+///     beginning of the algorithm each input section has its own chain.
+/// * Weight
+///   * The execution count of an input section, estimated as the larger of
+///     the sum of its incoming and the sum of its outgoing edges.
+///
+/// The algorithm is the bottom-up chain merging of Pettis and Hansen:
+/// * Sort the edges by weight, heaviest first
+/// * For each edge, if it goes from the tail of a chain to the head of
+///   another one, concatenate the two chains so that the edge becomes a
+///   fallthrough.
+/// * Sort the chains by density (weight per byte), so that the hottest code
+///   is packed at the start of the ordered sections.
+///
+/// As the edges may cross functions (calls and returns), a chain can
+/// interleave the hot blocks of several functions. The blocks of profiled
+/// functions that don't appear in the profile are never executed; they are
+/// split off from the hot code and placed at the end of their output section.
+///
+//===----------------------------------------------------------------------===//
+
+#include "BBProfileSort.h"
+#include "Config.h"
+#include "InputFiles.h"
+#include "OutputSections.h"
+#include "Symbols.h"
+#include "llvm/ADT/StringExtras.h"
+
+#include <numeric>
+
+using namespace llvm;
+using namespace lld;
+using namespace lld::elf;
+
+namespace {
+struct Edge {
+  int from;
+  int to;
+  uint64_t weight;
+};
+
+struct Chain {
+  Chain(int sec, uint64_t s) : head(sec), tail(sec), size(s) {}
+
+  double getDensity() const {
+    if (size == 0)
+      return 0;
+    return double(weight) / double(size);
+  }
+
+  int head;
+  int tail;
+  uint64_t size;
+  uint64_t weight = 0;
+};
+
+class BBProfileSort {
+public:
+  BBProfileSort();
+
+  DenseMap<const InputSectionBase *, int> run();
+
+private:
+  void addColdSections(DenseMap<const InputSectionBase *, int> &orderMap);
+
+  std::vector<Chain> chains;
+  std::vector<int> next;
+  std::vector<Edge> edges;
+  std::vector<const InputSectionBase *> sections;
+};
+
+// Maximum chain size in bytes.
+constexpr uint64_t MAX_CHAIN_SIZE = 1024 * 1024;
+} // end anonymous namespace
+
+// Take the edge list in config->bbProfile and build a graph between the input
+// sections, weighting each section by its estimated execution count.
+BBProfileSort::BBProfileSort() {
+  DenseMap<const InputSectionBase *, int> secToNode;
+  std::vector<uint64_t> in, out;
+
+  auto getOrCreateNode = [&](const InputSectionBase *isec) -> int {
+    auto res = secToNode.try_emplace(isec, sections.size());
+    if (res.second) {
+      sections.push_back(isec);
+      chains.emplace_back(chains.size(), isec->getSize());
+      in.push_back(0);
+      out.push_back(0);
+    }
+    return res.first->second;
+  };
+
+  for (auto &p : config->bbProfile) {
+    const auto *fromSB = cast<InputSectionBase>(p.first.first->repl);
+    const auto *toSB = cast<InputSectionBase>(p.first.second->repl);
+
+    // Sections of different output sections can't be placed next to each
+    // other, see CallGraphSort.cpp.
+    if (fromSB->getOutputSection() != toSB->getOutputSection())
+      continue;
+
+    int from = getOrCreateNode(fromSB);
+    int to = getOrCreateNode(toSB);
+    out[from] += p.second;
+    in[to] += p.second;
+    if (from != to)
+      edges.push_back({from, to, p.second});
+  }
+
+  for (size_t i = 0, e = chains.size(); i != e; ++i)
+    chains[i].weight = std::max(in[i], out[i]);
+  next.assign(chains.size(), -1);
+}
+
+// Find the leader of V's chain, see getLeader in CallGraphSort.cpp.
+static int getLeader(std::vector<int> &leaders, int v) {
+  while (leaders[v] != v) {
+    leaders[v] = leaders[leaders[v]];
+    v = leaders[v];
+  }
+  return v;
+}
+
+DenseMap<const InputSectionBase *, int> BBProfileSort::run() {
+  std::vector<int> leaders(chains.size());
+  std::iota(leaders.begin(), leaders.end(), 0);
+
+  llvm::stable_sort(
+      edges, [](const Edge &a, const Edge &b) { return a.weight > b.weight; });
+
+  for (const Edge &e : edges) {
+    int fromL = getLeader(leaders, e.from);
+    int toL = getLeader(leaders, e.to);
+    if (fromL == toL)
+      continue;
+
+    // Only an edge from the end of a chain to the start of another one can
+    // become a fallthrough.
+    Chain &fromC = chains[fromL];
+    Chain &toC = chains[toL];
+    if (fromC.tail != e.from || toC.head != e.to)
+      continue;
+    if (fromC.size + toC.size > MAX_CHAIN_SIZE)
+      continue;
+
+    next[e.from] = e.to;
+    fromC.tail = toC.tail;
+    fromC.size += toC.size;
+    fromC.weight += toC.weight;
+    toC.size = 0;
+    toC.weight = 0;
+    leaders[toL] = fromL;
+  }
+
+  // Sort the chains by density.
+  std::vector<int> sorted;
+  for (int i = 0, e = (int)chains.size(); i != e; ++i)
+    if (leaders[i] == i)
+      sorted.push_back(i);
+  llvm::stable_sort(sorted, [&](int a, int b) {
+    return chains[a].getDensity() > chains[b].getDensity();
+  });
+
+  DenseMap<const InputSectionBase *, int> orderMap;
+  int curOrder = 1;
+  for (int leader : sorted)
+    for (int i = chains[leader].head; i != -1; i = next[i])
+      orderMap[sections[i]] = curOrder++;
+
+  addColdSections(orderMap);
+  return orderMap;
+}
+
+// Returns the name of the function that a basic block section symbol named
+// Name would belong to, or Name if it doesn't follow the naming scheme of
+// MachineBasicBlock::getSymbol: "foo.cold", "foo.eh" or "foo.N", where N is
+// a section number.
+static StringRef getParentName(StringRef name) {
+  size_t pos = name.rfind('.');
+  if (pos == StringRef::npos || pos == 0)
+    return name;
+  StringRef suffix = name.substr(pos + 1);
+  bool isNumber =
+      !suffix.empty() && suffix[0] != '0' && llvm::all_of(suffix, isDigit);
+  if (suffix == "cold" || suffix == "eh" || isNumber)
+    return name.take_front(pos);
+  return name;
+}
+
+// Mark the sections of the profiled functions that are not in the profile as
+// cold.
+void BBProfileSort::addColdSections(
+    DenseMap<const InputSectionBase *, int> &orderMap) {
+  using FunctionKey = std::pair<const InputFile *, StringRef>;
+  DenseMap<FunctionKey, bool> isProfiled;
+  std::vector<std::pair<FunctionKey, const InputSectionBase *>> candidates;
+
+  for (InputFile *file : objectFiles) {
+    // The executable sections of the file that start with a symbol.
+    std::vector<std::pair<const Defined *, const InputSectionBase *>> starts;
+    DenseMap<StringRef, const InputSectionBase *> sectionOf;
+    for (Symbol *sym : file->getSymbols()) {
+      auto *d = dyn_cast<Defined>(sym);
+      if (!d || d->isSection() || d->file != file || d->value != 0)
+        continue;
+      auto *sec = dyn_cast_or_null<InputSectionBase>(d->section);
+      if (!sec || !sec->isLive() || !(sec->flags & ELF::SHF_EXECINSTR))
+        continue;
+      sec = cast<InputSectionBase>(sec->repl);
+      starts.push_back({d, sec});
+      sectionOf.try_emplace(d->getName(), sec);
+    }
+
+    for (auto &s : starts) {
+      // A block section symbol is local, and its function starts another
+      // section of the same file. Otherwise, a function whose name merely
+      // looks like "foo.1" would be taken for a block of "foo".
+      StringRef name = s.first->getName();
+      StringRef parent = getParentName(name);
+      if (parent != name) {
+        const InputSectionBase *parentSec = sectionOf.lookup(parent);
+        if (!s.first->isLocal() || !parentSec || parentSec == s.second)
+          parent = name;
+      }
+
+      FunctionKey key{file, parent};
+      if (orderMap.count(s.second))
+        isProfiled[key] = true;
+      else
+        candidates.push_back({key, s.second});
+    }
+  }
+
+  for (auto &c : candidates)
+    if (isProfiled.lookup(c.first))
+      orderMap.try_emplace(c.second, coldSectionPriority);
+}
+
+// Sort basic block sections by the profile data provided by --bb-profile-file.
+DenseMap<const InputSectionBase *, int> elf::computeBBProfileOrder() {
+  return BBProfileSort().run();
+}
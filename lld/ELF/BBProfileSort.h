@@ -0,0 +1,28 @@
+//===- BBProfileSort.h ------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_BB_PROFILE_SORT_H
+#define LLD_ELF_BB_PROFILE_SORT_H
+
+#include "llvm/ADT/DenseMap.h"
+#include <climits>
+
+namespace lld {
+namespace elf {
+class InputSectionBase;
+
+// The priority of the never executed basic block sections of profiled
+// functions. Such sections are placed after all other sections of their
+// output section.
+constexpr int coldSectionPriority = INT_MAX;
+
+llvm::DenseMap<const InputSectionBase *, int> computeBBProfileOrder();
+} // namespace elf
+} // namespace lld
+
+#endif
@@ -771,7 +771,14 @@ static std::pair<bool, bool> getPackDynRelocs(opt::InputArgList &args) {
   return {false, false};
 }
 
-static void readCallGraph(MemoryBufferRef mb) {
+// Reads a weighted edge list between symbols. Each line is of the form
+// "from to count". It is used by both --call-graph-ordering-file and
+// --bb-profile-file.
+static void
+readCallGraph(MemoryBufferRef mb,
+              MapVector<std::pair<const InputSectionBase *,
+                                  const InputSectionBase *>,
+                        uint64_t> &profile) {
   // Build a map from symbol name to section
   DenseMap<StringRef, Symbol *> map;
   for (InputFile *file : objectFiles)
@@ -804,7 +811,7 @@ static void readCallGraph(MemoryBufferRef mb) {
 
     if (InputSectionBase *from = findSection(fields[0]))
       if (InputSectionBase *to = findSection(fields[1]))
-        config->callGraphProfile[std::make_pair(from, to)] += count;
+        profile[std::make_pair(from, to)] += count;
   }
 }
 
@@ -968,6 +975,7 @@ static void readConfigs(opt::InputArgList &args) {
   config->ltoObjPath = args.getLastArgValue(OPT_lto_obj_path_eq);
   config->ltoPartitions = args::getInteger(args, OPT_lto_partitions, 1);
   config->ltoSampleProfile = args.getLastArgValue(OPT_lto_sample_profile);
+  config->ltoSplitPreserveOrder = args.hasArg(OPT_lto_split_preserve_order);
   config->ltoBasicBlockSections =
       args.getLastArgValue(OPT_lto_basic_block_sections);
   config->ltoUniqueBasicBlockSectionNames =
@@ -1189,6 +1197,9 @@ static void readConfigs(opt::InputArgList &args) {
     if (args.hasArg(OPT_call_graph_ordering_file))
       error("--symbol-ordering-file and --call-graph-order-file "
             "may not be used together");
+    if (args.hasArg(OPT_bb_profile_file))
+      error("--symbol-ordering-file and --bb-profile-file "
+            "may not be used together");
     if (Optional<MemoryBufferRef> buffer = readFile(arg->getValue())){
       config->symbolOrderingFile = getSymbolOrderingFile(*buffer);
       // Also need to disable CallGraphProfileSort to prevent
@@ -2240,10 +2251,16 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &args) {
   if (config->callGraphProfileSort) {
     if (auto *arg = args.getLastArg(OPT_call_graph_ordering_file))
       if (Optional<MemoryBufferRef> buffer = readFile(arg->getValue()))
-        readCallGraph(*buffer);
+        readCallGraph(*buffer, config->callGraphProfile);
     readCallGraphsFromObjectFiles<ELFT>();
   }
 
+  // The basic block profile is read for the same reason. It orders the
+  // sections of the blocks of functions, so it supersedes the call graph.
+  if (auto *arg = args.getLastArg(OPT_bb_profile_file))
+    if (Optional<MemoryBufferRef> buffer = readFile(arg->getValue()))
+      readCallGraph(*buffer, config->bbProfile);
+
   // Write the result to the file.
   writeResult<ELFT>();
 }
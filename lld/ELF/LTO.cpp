@@ -151,6 +151,7 @@ static lto::Config createConfig() {
   c.DwoDir = std::string(config->dwoDir);
 
   c.HasWholeProgramVisibility = config->ltoWholeProgramVisibility;
+  c.SplitPreserveOrder = config->ltoSplitPreserveOrder;
   c.AlwaysEmitRegularLTOObj = !config->ltoObjPath.empty();
 
   for (const llvm::StringRef &name : config->thinLTOModulesToCompile)
@@ -298,12 +299,14 @@ std::vector<InputFile *> BitcodeCompiler::compile() {
   // to cache native object files for ThinLTO incremental builds. If a path was
   // specified, configure LTO to use it as the cache directory.
   lto::NativeObjectCache cache;
+  lto::CacheStats cacheStats;
   if (!config->thinLTOCacheDir.empty())
     cache = check(
         lto::localCache(config->thinLTOCacheDir,
                         [&](size_t task, std::unique_ptr<MemoryBuffer> mb) {
                           files[task] = std::move(mb);
-                        }));
+                        },
+                        &cacheStats));
 
   if (!bitcodeFiles.empty())
     checkError(ltoObj->run(
@@ -337,8 +340,14 @@ std::vector<InputFile *> BitcodeCompiler::compile() {
     return {};
   }
 
-  if (!config->thinLTOCacheDir.empty())
-    pruneCache(config->thinLTOCacheDir, config->thinLTOCachePolicy);
+  if (!config->thinLTOCacheDir.empty()) {
+    CachePruningStats pruningStats;
+    pruneCache(config->thinLTOCacheDir, config->thinLTOCachePolicy,
+               &pruningStats);
+    log("ThinLTO cache: " + Twine(cacheStats.Hits.load()) + " hits, " +
+        Twine(cacheStats.Misses.load()) + " misses, " +
+        Twine(pruningStats.NumEvicted) + " evicted");
+  }
 
   if (!config->ltoObjPath.empty()) {
     saveBuffer(buf[0], config->ltoObjPath);
@@ -9,6 +9,7 @@
 #include "Writer.h"
 #include "AArch64ErrataFix.h"
 #include "ARMErrataFix.h"
+#include "BBProfileSort.h"
 #include "CallGraphSort.h"
 #include "Config.h"
 #include "LinkerScript.h"
@@ -1301,6 +1302,11 @@ static void maybeShuffle(DenseMap<const InputSectionBase *, int> &order) {
 // Builds section order for handling --symbol-ordering-file.
 static DenseMap<const InputSectionBase *, int> buildSectionOrder() {
   DenseMap<const InputSectionBase *, int> sectionOrder;
+  // Basic block sections are sorted with --bb-profile-file. The order of the
+  // entry blocks also orders the functions.
+  if (!config->bbProfile.empty())
+    return computeBBProfileOrder();
+
   // Use the rarely used option -call-graph-ordering-file to sort sections.
   if (!config->callGraphProfile.empty())
     return computeCallGraphProfileOrder();
@@ -1366,6 +1372,7 @@ sortISDBySectionOrder(InputSectionDescription *isd,
                       const DenseMap<const InputSectionBase *, int> &order) {
   std::vector<InputSection *> unorderedSections;
   std::vector<std::pair<InputSection *, int>> orderedSections;
+  std::vector<InputSection *> coldSections;
   uint64_t unorderedSize = 0;
 
   for (InputSection *isec : isd->sections) {
@@ -1375,6 +1382,10 @@ sortISDBySectionOrder(InputSectionDescription *isd,
       unorderedSize += isec->getSize();
       continue;
     }
+    if (i->second == coldSectionPriority) {
+      coldSections.push_back(isec);
+      continue;
+    }
     orderedSections.push_back({isec, i->second});
   }
   llvm::sort(orderedSections, llvm::less_second());
@@ -1423,6 +1434,10 @@ sortISDBySectionOrder(InputSectionDescription *isd,
     isd->sections.push_back(p.first);
   for (InputSection *isec : makeArrayRef(unorderedSections).slice(insPt))
     isd->sections.push_back(isec);
+  // Never executed basic blocks of profiled functions go last, away from the
+  // hot code.
+  for (InputSection *isec : coldSections)
+    isd->sections.push_back(isec);
 }
 
 static void sortSection(OutputSection *sec,
@@ -0,0 +1,194 @@
+//===- lld/unittest/ELFTests/BBProfileSortTest.cpp ------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Tests of the layout of basic block sections by --bb-profile-file.
+///
+//===----------------------------------------------------------------------===//
+
+#include "lld/Common/Driver.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/ObjectYAML/yaml2obj.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <map>
+
+using namespace llvm;
+using namespace lld;
+
+namespace {
+// A symbol at the start of its own executable section of 16 bytes.
+struct Block {
+  const char *name;
+  bool isLocal;
+};
+
+class BBProfileSortTest : public testing::Test {
+protected:
+  SmallString<128> dir;
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("bb-profile-sort", dir));
+  }
+
+  void TearDown() override { sys::fs::remove_directories(dir); }
+
+  std::string getPath(StringRef name) {
+    SmallString<128> path(dir);
+    sys::path::append(path, name);
+    return std::string(path);
+  }
+
+  // Write an x86-64 object file with a section for each block, in the given
+  // order.
+  std::string writeObject(StringRef name, ArrayRef<Block> blocks) {
+    std::string yaml;
+    raw_string_ostream os(yaml);
+    os << "--- !ELF\n"
+       << "FileHeader:\n"
+       << "  Class:   ELFCLASS64\n"
+       << "  Data:    ELFDATA2LSB\n"
+       << "  Type:    ET_REL\n"
+       << "  Machine: EM_X86_64\n"
+       << "Sections:\n";
+    for (const Block &b : blocks)
+      os << "  - Name:  .text." << b.name << "\n"
+         << "    Type:  SHT_PROGBITS\n"
+         << "    Flags: [ SHF_ALLOC, SHF_EXECINSTR ]\n"
+         << "    Size:  16\n";
+    // The local symbols come first in the symbol table.
+    os << "Symbols:\n";
+    for (bool local : {true, false})
+      for (const Block &b : blocks)
+        if (b.isLocal == local)
+          os << "  - Name:    " << b.name << "\n"
+             << "    Type:    STT_FUNC\n"
+             << "    Section: .text." << b.name << "\n"
+             << "    Binding: " << (local ? "STB_LOCAL" : "STB_GLOBAL")
+             << "\n";
+    os.flush();
+
+    std::string path = getPath(name);
+    std::error_code ec;
+    raw_fd_ostream out(path, ec);
+    EXPECT_FALSE(ec);
+    yaml::Input input(yaml);
+    EXPECT_TRUE(yaml::convertYAML(input, out, [](const Twine &msg) {
+      ADD_FAILURE() << msg.str();
+    }));
+    return path;
+  }
+
+  // Link the object with the profile, and return the names of its blocks in
+  // the order of their addresses in the output.
+  std::vector<std::string> link(const std::string &object,
+                                StringRef profile) {
+    std::string profilePath = getPath("profile.txt");
+    {
+      std::error_code ec;
+      raw_fd_ostream out(profilePath, ec);
+      EXPECT_FALSE(ec);
+      out << profile;
+    }
+
+    std::string output = getPath("out");
+    std::string profileArg = "--bb-profile-file=" + profilePath;
+    const char *args[] = {"ld.lld", "-e",         "foo",         "-o",
+                          output.c_str(),          profileArg.c_str(),
+                          object.c_str()};
+    std::string diagnostics;
+    raw_string_ostream diagOS(diagnostics);
+    EXPECT_TRUE(elf::link(args, /*canExitEarly=*/false, outs(), diagOS))
+        << diagOS.str();
+
+    std::map<uint64_t, std::string> layout;
+    auto fileOrErr = object::ObjectFile::createObjectFile(output);
+    if (!fileOrErr) {
+      ADD_FAILURE() << toString(fileOrErr.takeError());
+      return {};
+    }
+    for (const object::SymbolRef &sym : fileOrErr->getBinary()->symbols()) {
+      Expected<object::SymbolRef::Type> type = sym.getType();
+      Expected<StringRef> name = sym.getName();
+      Expected<uint64_t> address = sym.getAddress();
+      if (!type || !name || !address) {
+        ADD_FAILURE() << "bad symbol";
+        consumeError(type.takeError());
+        consumeError(name.takeError());
+        consumeError(address.takeError());
+        continue;
+      }
+      if (*type == object::SymbolRef::ST_Function)
+        layout[*address] = std::string(*name);
+    }
+
+    std::vector<std::string> names;
+    for (auto &entry : layout)
+      names.push_back(entry.second);
+    return names;
+  }
+};
+
+// The blocks are chained along the heaviest edges, and the chains are sorted
+// by density.
+TEST_F(BBProfileSortTest, ChainMerging) {
+  std::string object = writeObject("chains.o", {{"baz", false},
+                                                {"foo", false},
+                                                {"foo.1", true},
+                                                {"foo.2", true},
+                                                {"foo.3", true},
+                                                {"bar", false},
+                                                {"qux", false},
+                                                {"qux.1", true}});
+  // bar -> foo.2 can't become a fallthrough, as foo.2 is already in the
+  // middle of the chain of foo. qux is hotter than foo, and baz is not in the
+  // profile.
+  std::vector<std::string> layout = link(object, "foo foo.2 100\n"
+                                                 "foo.2 foo.1 90\n"
+                                                 "foo.1 foo.3 80\n"
+                                                 "bar foo.2 50\n"
+                                                 "qux qux.1 1000\n");
+  std::vector<std::string> expected = {"qux",   "qux.1", "foo", "foo.2",
+                                       "foo.1", "foo.3", "bar", "baz"};
+  EXPECT_EQ(expected, layout);
+}
+
+// The blocks of profiled functions that are not in the profile are never
+// executed, and are placed after all other sections.
+TEST_F(BBProfileSortTest, ColdPlacement) {
+  std::string object = writeObject("cold.o", {{"foo", false},
+                                              {"foo.1", true},
+                                              {"foo.2", true},
+                                              {"foo.cold", true},
+                                              {"baz", false},
+                                              {"bar", false},
+                                              {"bar.1", true}});
+  // bar is not profiled, so its blocks are kept with the other unordered
+  // sections.
+  std::vector<std::string> layout = link(object, "foo foo.2 10\n");
+  std::vector<std::string> expected = {"foo", "foo.2", "baz",     "bar",
+                                       "bar.1", "foo.1", "foo.cold"};
+  EXPECT_EQ(expected, layout);
+}
+
+// A global function named like a block of another function is not one of its
+// blocks, so it is not taken for a cold block of it.
+TEST_F(BBProfileSortTest, NumberedGlobalIsNotABlock) {
+  std::string object = writeObject("global.o", {{"foo", false},
+                                                {"foo.2", true},
+                                                {"foo.3", true},
+                                                {"foo.1", false}});
+  std::vector<std::string> layout = link(object, "foo foo.2 10\n");
+  std::vector<std::string> expected = {"foo", "foo.2", "foo.1", "foo.3"};
+  EXPECT_EQ(expected, layout);
+}
+} // namespace
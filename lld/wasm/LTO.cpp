@@ -126,12 +126,14 @@ std::vector<StringRef> BitcodeCompiler::compile() {
   // to cache native object files for ThinLTO incremental builds. If a path was
   // specified, configure LTO to use it as the cache directory.
   lto::NativeObjectCache cache;
+  lto::CacheStats cacheStats;
   if (!config->thinLTOCacheDir.empty())
     cache = check(
         lto::localCache(config->thinLTOCacheDir,
                         [&](size_t task, std::unique_ptr<MemoryBuffer> mb) {
                           files[task] = std::move(mb);
-                        }));
+                        },
+                        &cacheStats));
 
   checkError(ltoObj->run(
       [&](size_t task) {
@@ -140,8 +142,14 @@ std::vector<StringRef> BitcodeCompiler::compile() {
       },
       cache));
 
-  if (!config->thinLTOCacheDir.empty())
-    pruneCache(config->thinLTOCacheDir, config->thinLTOCachePolicy);
+  if (!config->thinLTOCacheDir.empty()) {
+    CachePruningStats pruningStats;
+    pruneCache(config->thinLTOCacheDir, config->thinLTOCachePolicy,
+               &pruningStats);
+    log("ThinLTO cache: " + Twine(cacheStats.Hits.load()) + " hits, " +
+        Twine(cacheStats.Misses.load()) + " misses, " +
+        Twine(pruningStats.NumEvicted) + " evicted");
+  }
 
   std::vector<StringRef> ret;
   for (unsigned i = 0; i != maxTasks; ++i) {
@@ -0,0 +1,168 @@
+//===- HashMaps.cpp - Benchmarks for the ADT hash maps ---------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Compares FlatHashMap against DenseMap for pointer keys and against DenseMap
+// and StringMap for string keys, on insertion, successful and unsuccessful
+// lookups, erasure and iteration.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/FlatHashMap.h"
+#include "llvm/ADT/StringMap.h"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+/// Pointer keys in a random order, like the Value * keys of most maps in the
+/// optimizer. Misses use the addresses of a disjoint array.
+struct PointerKeys {
+  std::vector<int> Storage, MissStorage;
+  std::vector<int *> Keys, Misses;
+
+  explicit PointerKeys(size_t N) : Storage(N), MissStorage(N) {
+    for (size_t I = 0; I != N; ++I) {
+      Keys.push_back(&Storage[I]);
+      Misses.push_back(&MissStorage[I]);
+    }
+    std::mt19937 Rng(N);
+    std::shuffle(Keys.begin(), Keys.end(), Rng);
+    std::shuffle(Misses.begin(), Misses.end(), Rng);
+  }
+};
+
+/// Symbol-like string keys.
+struct StringKeys {
+  std::vector<std::string> Storage, MissStorage;
+  std::vector<StringRef> Keys, Misses;
+
+  explicit StringKeys(size_t N) {
+    for (size_t I = 0; I != N; ++I) {
+      Storage.push_back("_ZN4llvm6detail" + std::to_string(I * 7919) + "E");
+      MissStorage.push_back("_ZN4llvm6detail" + std::to_string(I * 7919 + 1) +
+                            "E");
+    }
+    Keys.assign(Storage.begin(), Storage.end());
+    Misses.assign(MissStorage.begin(), MissStorage.end());
+    std::mt19937 Rng(N);
+    std::shuffle(Keys.begin(), Keys.end(), Rng);
+  }
+};
+
+template <typename MapT, typename KeyT>
+void insertKey(MapT &Map, const KeyT &Key, unsigned Value) {
+  Map.try_emplace(Key, Value);
+}
+
+template <typename MapT> unsigned sumValues(const MapT &Map) {
+  unsigned Sum = 0;
+  for (const auto &KV : Map)
+    Sum += KV.second;
+  return Sum;
+}
+
+template <> unsigned sumValues(const StringMap<unsigned> &Map) {
+  unsigned Sum = 0;
+  for (const auto &KV : Map)
+    Sum += KV.getValue();
+  return Sum;
+}
+
+template <typename MapT, typename KeysT>
+void BM_Insert(benchmark::State &State) {
+  KeysT K(State.range(0));
+  for (auto _ : State) {
+    MapT Map;
+    for (unsigned I = 0, E = K.Keys.size(); I != E; ++I)
+      insertKey(Map, K.Keys[I], I);
+    benchmark::DoNotOptimize(Map);
+  }
+  State.SetItemsProcessed(State.iterations() * K.Keys.size());
+}
+
+template <typename MapT, typename KeysT>
+void BM_LookupHit(benchmark::State &State) {
+  KeysT K(State.range(0));
+  MapT Map;
+  for (unsigned I = 0, E = K.Keys.size(); I != E; ++I)
+    insertKey(Map, K.Keys[I], I);
+  for (auto _ : State)
+    for (const auto &Key : K.Keys)
+      benchmark::DoNotOptimize(Map.find(Key));
+  State.SetItemsProcessed(State.iterations() * K.Keys.size());
+}
+
+template <typename MapT, typename KeysT>
+void BM_LookupMiss(benchmark::State &State) {
+  KeysT K(State.range(0));
+  MapT Map;
+  for (unsigned I = 0, E = K.Keys.size(); I != E; ++I)
+    insertKey(Map, K.Keys[I], I);
+  for (auto _ : State)
+    for (const auto &Key : K.Misses)
+      benchmark::DoNotOptimize(Map.find(Key));
+  State.SetItemsProcessed(State.iterations() * K.Misses.size());
+}
+
+template <typename MapT, typename KeysT>
+void BM_EraseInsert(benchmark::State &State) {
+  KeysT K(State.range(0));
+  MapT Map;
+  for (unsigned I = 0, E = K.Keys.size(); I != E; ++I)
+    insertKey(Map, K.Keys[I], I);
+  // Erase and reinsert half of the keys, which leaves tombstones behind in
+  // both tables.
+  size_t Half = K.Keys.size() / 2;
+  for (auto _ : State) {
+    for (size_t I = 0; I != Half; ++I)
+      Map.erase(K.Keys[I]);
+    for (size_t I = 0; I != Half; ++I)
+      insertKey(Map, K.Keys[I], I);
+  }
+  State.SetItemsProcessed(State.iterations() * Half * 2);
+}
+
+template <typename MapT, typename KeysT>
+void BM_Iterate(benchmark::State &State) {
+  KeysT K(State.range(0));
+  MapT Map;
+  for (unsigned I = 0, E = K.Keys.size(); I != E; ++I)
+    insertKey(Map, K.Keys[I], I);
+  for (auto _ : State)
+    benchmark::DoNotOptimize(sumValues(Map));
+  State.SetItemsProcessed(State.iterations() * K.Keys.size());
+}
+
+using PtrDenseMap = DenseMap<int *, unsigned>;
+using PtrFlatHashMap = FlatHashMap<int *, unsigned>;
+using StrDenseMap = DenseMap<StringRef, unsigned>;
+using StrFlatHashMap = FlatHashMap<StringRef, unsigned>;
+using StrStringMap = StringMap<unsigned>;
+
+} // end anonymous namespace
+
+#define HASH_MAP_BENCHMARKS(MapT, KeysT)                                       \
+  BENCHMARK_TEMPLATE(BM_Insert, MapT, KeysT)->Range(16, 1 << 20);              \
+  BENCHMARK_TEMPLATE(BM_LookupHit, MapT, KeysT)->Range(16, 1 << 20);           \
+  BENCHMARK_TEMPLATE(BM_LookupMiss, MapT, KeysT)->Range(16, 1 << 20);          \
+  BENCHMARK_TEMPLATE(BM_EraseInsert, MapT, KeysT)->Range(16, 1 << 20);         \
+  BENCHMARK_TEMPLATE(BM_Iterate, MapT, KeysT)->Range(16, 1 << 20);
+
+HASH_MAP_BENCHMARKS(PtrDenseMap, PointerKeys)
+HASH_MAP_BENCHMARKS(PtrFlatHashMap, PointerKeys)
+HASH_MAP_BENCHMARKS(StrDenseMap, StringKeys)
+HASH_MAP_BENCHMARKS(StrFlatHashMap, StringKeys)
+HASH_MAP_BENCHMARKS(StrStringMap, StringKeys)
+
+BENCHMARK_MAIN();
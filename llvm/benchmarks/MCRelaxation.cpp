@@ -0,0 +1,134 @@
+//===- MCRelaxation.cpp - Benchmarks for assembler relaxation -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures how long the integrated assembler takes to assemble large x86-64
+// functions full of branches, alignment and line table entries, which is
+// dominated by the relaxation passes of the layout.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <random>
+#include <string>
+
+using namespace llvm;
+
+namespace {
+
+const char *const TripleName = "x86_64-unknown-linux-gnu";
+
+/// Build a function of \p NumBlocks basic blocks. Every block ends with a
+/// branch to a nearby block, most of them just within the reach of a short
+/// jump, so that relaxing one branch pushes others out of range in turn.
+std::string buildFunction(unsigned NumBlocks) {
+  std::string Asm;
+  raw_string_ostream OS(Asm);
+  std::mt19937 Rng(NumBlocks);
+  std::uniform_int_distribution<int> Distance(-24, 24);
+
+  OS << "\t.text\n\t.file 1 \"bench.c\"\n\t.globl f\n\t.p2align 4\nf:\n";
+  for (unsigned I = 0; I != NumBlocks; ++I) {
+    if (I % 16 == 0)
+      OS << "\t.p2align 4\n";
+    OS << ".LBB" << I << ":\n";
+    OS << "\t.loc 1 " << I + 1 << " 0\n";
+    OS << "\taddl $" << I << ", %eax\n";
+    OS << "\tcmpl %ecx, %eax\n";
+    int Target = int(I) + Distance(Rng);
+    if (Target < 0)
+      Target = 0;
+    if (Target >= int(NumBlocks))
+      Target = NumBlocks - 1;
+    OS << "\tjne .LBB" << Target << "\n";
+  }
+  OS << "\tretq\n";
+  return OS.str();
+}
+
+void BM_AssembleBranches(benchmark::State &State) {
+  std::string Error;
+  const Target *TheTarget = TargetRegistry::lookupTarget(TripleName, Error);
+  if (!TheTarget) {
+    State.SkipWithError(Error.c_str());
+    return;
+  }
+
+  Triple TheTriple(TripleName);
+  MCTargetOptions Options;
+  std::unique_ptr<MCRegisterInfo> MRI(TheTarget->createMCRegInfo(TripleName));
+  std::unique_ptr<MCAsmInfo> MAI(
+      TheTarget->createMCAsmInfo(*MRI, TripleName, Options));
+  std::unique_ptr<MCInstrInfo> MCII(TheTarget->createMCInstrInfo());
+  std::unique_ptr<MCSubtargetInfo> STI(
+      TheTarget->createMCSubtargetInfo(TripleName, "", ""));
+
+  std::string Asm = buildFunction(State.range(0));
+  for (auto _ : State) {
+    SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(MemoryBuffer::getMemBuffer(Asm), SMLoc());
+    MCObjectFileInfo MOFI;
+    MCContext Ctx(MAI.get(), MRI.get(), &MOFI, &SrcMgr, &Options);
+    MOFI.InitMCObjectFileInfo(TheTriple, /*PIC=*/false, Ctx);
+
+    SmallString<0> Object;
+    raw_svector_ostream OS(Object);
+    MCCodeEmitter *CE = TheTarget->createMCCodeEmitter(*MCII, *MRI, Ctx);
+    MCAsmBackend *MAB = TheTarget->createMCAsmBackend(*STI, *MRI, Options);
+    std::unique_ptr<MCStreamer> Str(TheTarget->createMCObjectStreamer(
+        TheTriple, Ctx, std::unique_ptr<MCAsmBackend>(MAB),
+        MAB->createObjectWriter(OS), std::unique_ptr<MCCodeEmitter>(CE), *STI,
+        Options.MCRelaxAll, Options.MCIncrementalLinkerCompatible,
+        /*DWARFMustBeAtTheEnd=*/false));
+
+    std::unique_ptr<MCAsmParser> Parser(
+        createMCAsmParser(SrcMgr, Ctx, *Str, *MAI));
+    std::unique_ptr<MCTargetAsmParser> TAP(
+        TheTarget->createMCAsmParser(*STI, *Parser, *MCII, Options));
+    Parser->setTargetParser(*TAP);
+    if (Parser->Run(/*NoInitialTextSection=*/false)) {
+      State.SkipWithError("failed to assemble the benchmark input");
+      return;
+    }
+    benchmark::DoNotOptimize(Object.data());
+  }
+  State.SetItemsProcessed(State.iterations() * State.range(0));
+}
+
+} // end anonymous namespace
+
+BENCHMARK(BM_AssembleBranches)->Range(1 << 10, 1 << 16);
+
+int main(int argc, char **argv) {
+  InitializeAllTargetInfos();
+  InitializeAllTargetMCs();
+  InitializeAllAsmParsers();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+}
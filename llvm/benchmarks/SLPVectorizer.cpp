@@ -0,0 +1,168 @@
+//===- SLPVectorizer.cpp - Benchmarks for odd-width SLP bundles -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures the run time of loops over groups of 3, 6 and 7 floats, like the
+// points and pairs of points of geometry code, after the SLP vectorizer ran
+// on them with and without -slp-vectorize-non-power-of-2. The loops are
+// compiled for the host with ORC.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/AddUniqueID.h"
+#include "llvm/Transforms/Vectorize/SLPVectorizer.h"
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+using KernelFn = void (*)(const float *, const float *, float *, int64_t);
+
+/// Build a loop that computes c = 2 * a + b over \p Width floats at a time.
+std::string buildKernel(unsigned Width) {
+  std::string IR;
+  raw_string_ostream OS(IR);
+  OS << "define void @kernel(float* noalias %a, float* noalias %b,\n"
+     << "                    float* noalias %c, i64 %n) {\n"
+     << "entry:\n"
+     << "  br label %loop\n"
+     << "loop:\n"
+     << "  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]\n"
+     << "  %base = mul i64 %i, " << Width << "\n";
+  for (unsigned K = 0; K != Width; ++K) {
+    OS << "  %idx" << K << " = add i64 %base, " << K << "\n";
+    for (char Array : {'a', 'b', 'c'})
+      OS << "  %p" << Array << K << " = getelementptr inbounds float, float* %"
+         << Array << ", i64 %idx" << K << "\n";
+    OS << "  %a" << K << " = load float, float* %pa" << K << ", align 4\n"
+       << "  %b" << K << " = load float, float* %pb" << K << ", align 4\n"
+       << "  %m" << K << " = fmul float %a" << K << ", 2.0\n"
+       << "  %s" << K << " = fadd float %m" << K << ", %b" << K << "\n"
+       << "  store float %s" << K << ", float* %pc" << K << ", align 4\n";
+  }
+  OS << "  %i.next = add nuw i64 %i, 1\n"
+     << "  %done = icmp eq i64 %i.next, %n\n"
+     << "  br i1 %done, label %exit, label %loop\n"
+     << "exit:\n"
+     << "  ret void\n"
+     << "}\n";
+  return OS.str();
+}
+
+/// Run the SLP vectorizer on \p M for the target of \p TM.
+void vectorize(Module &M, TargetMachine &TM, bool NonPowerOf2) {
+  auto *Opt = static_cast<cl::opt<bool> *>(
+      cl::getRegisteredOptions().lookup("slp-vectorize-non-power-of-2"));
+  Opt->setValue(NonPowerOf2);
+
+  PassBuilder PB(&TM);
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  // The instructions created by the vectorizer and the code generator take
+  // their IDs from the counter this sets up.
+  AddUniqueIDPass().run(M, FAM);
+  FunctionPassManager FPM;
+  FPM.addPass(SLPVectorizerPass());
+  for (llvm::Function &F : M)
+    if (!F.isDeclaration())
+      FPM.run(F, FAM);
+
+  Opt->setValue(false);
+}
+
+void BM_Kernel(benchmark::State &State) {
+  unsigned Width = State.range(0);
+  bool NonPowerOf2 = State.range(1);
+  int64_t NumGroups = State.range(2);
+
+  auto Fail = [&](Error Err) {
+    State.SkipWithError(toString(std::move(Err)).c_str());
+  };
+  auto JTMB = orc::JITTargetMachineBuilder::detectHost();
+  if (!JTMB)
+    return Fail(JTMB.takeError());
+  auto TM = JTMB->createTargetMachine();
+  if (!TM)
+    return Fail(TM.takeError());
+
+  auto Ctx = std::make_unique<LLVMContext>();
+  SMDiagnostic Diag;
+  std::unique_ptr<Module> M =
+      parseAssemblyString(buildKernel(Width), Diag, *Ctx);
+  if (!M) {
+    State.SkipWithError(Diag.getMessage().str().c_str());
+    return;
+  }
+  M->setDataLayout((*TM)->createDataLayout());
+  M->setTargetTriple(JTMB->getTargetTriple().str());
+  vectorize(*M, **TM, NonPowerOf2);
+
+  auto JIT = orc::LLJITBuilder().setJITTargetMachineBuilder(*JTMB).create();
+  if (!JIT)
+    return Fail(JIT.takeError());
+  if (Error Err = (*JIT)->addIRModule(
+          orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+    return Fail(std::move(Err));
+  auto Sym = (*JIT)->lookup("kernel");
+  if (!Sym)
+    return Fail(Sym.takeError());
+  auto Kernel = reinterpret_cast<KernelFn>(Sym->getAddress());
+
+  std::vector<float> A(NumGroups * Width, 1.0f);
+  std::vector<float> B(NumGroups * Width, 2.0f);
+  std::vector<float> C(NumGroups * Width);
+  for (auto _ : State) {
+    Kernel(A.data(), B.data(), C.data(), NumGroups);
+    benchmark::DoNotOptimize(C.data());
+    benchmark::ClobberMemory();
+  }
+  State.SetItemsProcessed(State.iterations() * NumGroups);
+}
+
+void addKernelArgs(benchmark::internal::Benchmark *B) {
+  B->ArgNames({"width", "non-power-of-2", "groups"});
+  for (int Width : {3, 6, 7})
+    for (int NonPowerOf2 : {0, 1})
+      B->Args({Width, NonPowerOf2, 1 << 12});
+}
+
+} // end anonymous namespace
+
+BENCHMARK(BM_Kernel)->Apply(addKernelArgs);
+
+int main(int argc, char **argv) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,663 @@
+//===- llvm/ADT/FlatHashMap.h - Group-probed flat hash table ----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the FlatHashMap class, an open-addressing hash table in
+// the style of the "Swiss table".
+//
+// Every bucket has a one byte control word that records whether the bucket is
+// empty, deleted, or full, and for full buckets holds seven bits of the key's
+// hash. Lookups probe a group of 16 control words at a time (with SSE2 when
+// available) and only compare keys whose hash bits match, so most probes never
+// touch the buckets themselves. Because the state of a bucket lives in its
+// control word, no key values are reserved: KeyInfoT only needs to provide
+// getHashValue() and isEqual().
+//
+// The interface follows DenseMap closely enough that the two can usually be
+// swapped by changing the type. Like DenseMap, any insertion may invalidate
+// iterators and references to elements.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_ADT_FLATHASHMAP_H
+#define LLVM_ADT_FLATHASHMAP_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/EpochTracker.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemAlloc.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LLVM_FLAT_HASH_MAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace llvm {
+
+namespace detail {
+
+/// A group of consecutive control bytes of a FlatHashMap, matched together.
+///
+/// A control byte is either one of the negative markers below, or the low
+/// seven bits of the hash of the key in a full bucket.
+class FlatHashGroup {
+public:
+  static constexpr unsigned Width = 16;
+  static constexpr int8_t Empty = -128;
+  static constexpr int8_t Deleted = -2;
+
+#ifdef LLVM_FLAT_HASH_MAP_SSE2
+  explicit FlatHashGroup(const int8_t *Pos)
+      : Ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(Pos))) {}
+
+  /// Return a bit mask of the bytes equal to \p H2.
+  unsigned match(int8_t H2) const {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(H2), Ctrl));
+  }
+
+  /// Return a bit mask of the empty bytes.
+  unsigned matchEmpty() const { return match(Empty); }
+
+  /// Return a bit mask of the empty or deleted bytes.
+  unsigned matchEmptyOrDeleted() const {
+    return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), Ctrl));
+  }
+
+  /// Return a bit mask of the full bytes.
+  unsigned matchFull() const { return ~_mm_movemask_epi8(Ctrl) & 0xFFFF; }
+
+private:
+  __m128i Ctrl;
+#else
+  explicit FlatHashGroup(const int8_t *Pos) { std::memcpy(Ctrl, Pos, Width); }
+
+  unsigned match(int8_t H2) const {
+    unsigned Mask = 0;
+    for (unsigned I = 0; I != Width; ++I)
+      Mask |= unsigned(Ctrl[I] == H2) << I;
+    return Mask;
+  }
+
+  unsigned matchEmpty() const { return match(Empty); }
+
+  unsigned matchEmptyOrDeleted() const {
+    unsigned Mask = 0;
+    for (unsigned I = 0; I != Width; ++I)
+      Mask |= unsigned(Ctrl[I] < -1) << I;
+    return Mask;
+  }
+
+  unsigned matchFull() const {
+    unsigned Mask = 0;
+    for (unsigned I = 0; I != Width; ++I)
+      Mask |= unsigned(Ctrl[I] >= 0) << I;
+    return Mask;
+  }
+
+private:
+  int8_t Ctrl[Width];
+#endif
+};
+
+} // end namespace detail
+
+template <typename KeyT, typename ValueT,
+          typename KeyInfoT = DenseMapInfo<KeyT>,
+          typename Bucket = llvm::detail::DenseMapPair<KeyT, ValueT>,
+          bool IsConst = false>
+class FlatHashMapIterator;
+
+template <typename KeyT, typename ValueT,
+          typename KeyInfoT = DenseMapInfo<KeyT>,
+          typename BucketT = llvm::detail::DenseMapPair<KeyT, ValueT>>
+class FlatHashMap : public DebugEpochBase {
+  using Group = detail::FlatHashGroup;
+
+  template <typename T>
+  using const_arg_type_t = typename const_pointer_or_const_ref<T>::type;
+
+public:
+  using size_type = unsigned;
+  using key_type = KeyT;
+  using mapped_type = ValueT;
+  using value_type = BucketT;
+
+  using iterator = FlatHashMapIterator<KeyT, ValueT, KeyInfoT, BucketT>;
+  using const_iterator =
+      FlatHashMapIterator<KeyT, ValueT, KeyInfoT, BucketT, true>;
+
+  /// Create a map that can hold \p InitialReserve entries without growing.
+  explicit FlatHashMap(unsigned InitialReserve = 0) {
+    init(getMinBucketsToReserve(InitialReserve));
+  }
+
+  FlatHashMap(const FlatHashMap &Other) { copyFrom(Other); }
+
+  FlatHashMap(FlatHashMap &&Other) {
+    init(0);
+    swap(Other);
+  }
+
+  template <typename InputIt> FlatHashMap(const InputIt &I, const InputIt &E) {
+    init(getMinBucketsToReserve(std::distance(I, E)));
+    insert(I, E);
+  }
+
+  FlatHashMap(std::initializer_list<value_type> Vals) {
+    init(getMinBucketsToReserve(Vals.size()));
+    for (const auto &KV : Vals)
+      insert(KV);
+  }
+
+  ~FlatHashMap() {
+    destroyAll();
+    deallocateStorage(Ctrl, NumBuckets);
+  }
+
+  FlatHashMap &operator=(const FlatHashMap &Other) {
+    if (&Other != this) {
+      destroyAll();
+      deallocateStorage(Ctrl, NumBuckets);
+      copyFrom(Other);
+    }
+    return *this;
+  }
+
+  FlatHashMap &operator=(FlatHashMap &&Other) {
+    destroyAll();
+    deallocateStorage(Ctrl, NumBuckets);
+    init(0);
+    swap(Other);
+    return *this;
+  }
+
+  void swap(FlatHashMap &RHS) {
+    this->incrementEpoch();
+    RHS.incrementEpoch();
+    std::swap(Ctrl, RHS.Ctrl);
+    std::swap(Buckets, RHS.Buckets);
+    std::swap(NumBuckets, RHS.NumBuckets);
+    std::swap(NumEntries, RHS.NumEntries);
+    std::swap(GrowthLeft, RHS.GrowthLeft);
+  }
+
+  inline iterator begin() {
+    if (empty())
+      return end();
+    return iterator(Ctrl, Ctrl + NumBuckets, Buckets, *this);
+  }
+  inline iterator end() {
+    return iterator(Ctrl + NumBuckets, Ctrl + NumBuckets, Buckets + NumBuckets,
+                    *this, true);
+  }
+  inline const_iterator begin() const {
+    if (empty())
+      return end();
+    return const_iterator(Ctrl, Ctrl + NumBuckets, Buckets, *this);
+  }
+  inline const_iterator end() const {
+    return const_iterator(Ctrl + NumBuckets, Ctrl + NumBuckets,
+                          Buckets + NumBuckets, *this, true);
+  }
+
+  LLVM_NODISCARD bool empty() const { return NumEntries == 0; }
+  unsigned size() const { return NumEntries; }
+
+  /// Grow the map so that it can contain at least \p NumEntries items before
+  /// resizing again.
+  void reserve(size_type NumEntries) {
+    unsigned NumBuckets = getMinBucketsToReserve(NumEntries);
+    incrementEpoch();
+    if (NumBuckets > this->NumBuckets)
+      rehash(NumBuckets);
+  }
+
+  void clear() {
+    incrementEpoch();
+    if (NumEntries == 0 && GrowthLeft == getMaxLoad(NumBuckets))
+      return;
+    destroyAll();
+    std::memset(Ctrl, Group::Empty, NumBuckets);
+    NumEntries = 0;
+    GrowthLeft = getMaxLoad(NumBuckets);
+  }
+
+  /// Return 1 if the specified key is in the map, 0 otherwise.
+  size_type count(const_arg_type_t<KeyT> Val) const {
+    return lookupBucketFor(Val) < NumBuckets ? 1 : 0;
+  }
+
+  iterator find(const_arg_type_t<KeyT> Val) { return find_as(Val); }
+  const_iterator find(const_arg_type_t<KeyT> Val) const { return find_as(Val); }
+
+  /// Alternate version of find() which allows a different, and possibly
+  /// less expensive, key type.
+  /// The DenseMapInfo is responsible for supplying methods
+  /// getHashValue(LookupKeyT) and isEqual(LookupKeyT, KeyT) for each key
+  /// type used.
+  template <class LookupKeyT> iterator find_as(const LookupKeyT &Val) {
+    unsigned I = lookupBucketFor(Val);
+    if (I >= NumBuckets)
+      return end();
+    return iterator(Ctrl + I, Ctrl + NumBuckets, Buckets + I, *this, true);
+  }
+  template <class LookupKeyT>
+  const_iterator find_as(const LookupKeyT &Val) const {
+    unsigned I = lookupBucketFor(Val);
+    if (I >= NumBuckets)
+      return end();
+    return const_iterator(Ctrl + I, Ctrl + NumBuckets, Buckets + I, *this,
+                          true);
+  }
+
+  /// lookup - Return the entry for the specified key, or a default
+  /// constructed value if no such entry exists.
+  ValueT lookup(const_arg_type_t<KeyT> Val) const {
+    unsigned I = lookupBucketFor(Val);
+    if (I < NumBuckets)
+      return Buckets[I].getSecond();
+    return ValueT();
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // If the key is already in the map, it returns false and doesn't update the
+  // value.
+  std::pair<iterator, bool> insert(const std::pair<KeyT, ValueT> &KV) {
+    return try_emplace(KV.first, KV.second);
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // If the key is already in the map, it returns false and doesn't update the
+  // value.
+  std::pair<iterator, bool> insert(std::pair<KeyT, ValueT> &&KV) {
+    return try_emplace(std::move(KV.first), std::move(KV.second));
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // The value is constructed in-place if the key is not in the map, otherwise
+  // it is not moved.
+  template <typename... Ts>
+  std::pair<iterator, bool> try_emplace(KeyT &&Key, Ts &&... Args) {
+    return tryEmplaceImpl(std::move(Key), std::forward<Ts>(Args)...);
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // The value is constructed in-place if the key is not in the map, otherwise
+  // it is not moved.
+  template <typename... Ts>
+  std::pair<iterator, bool> try_emplace(const KeyT &Key, Ts &&... Args) {
+    return tryEmplaceImpl(Key, std::forward<Ts>(Args)...);
+  }
+
+  /// insert - Range insertion of pairs.
+  template <typename InputIt> void insert(InputIt I, InputIt E) {
+    for (; I != E; ++I)
+      insert(*I);
+  }
+
+  bool erase(const KeyT &Val) {
+    unsigned I = lookupBucketFor(Val);
+    if (I >= NumBuckets)
+      return false; // not in map.
+    eraseBucket(I);
+    return true;
+  }
+
+  void erase(iterator I) {
+    assert(I != end() && "erasing end() iterator");
+    eraseBucket(&*I - Buckets);
+  }
+
+  value_type &FindAndConstruct(const KeyT &Key) {
+    return *try_emplace(Key).first;
+  }
+
+  ValueT &operator[](const KeyT &Key) {
+    return FindAndConstruct(Key).getSecond();
+  }
+
+  value_type &FindAndConstruct(KeyT &&Key) {
+    return *try_emplace(std::move(Key)).first;
+  }
+
+  ValueT &operator[](KeyT &&Key) {
+    return FindAndConstruct(std::move(Key)).getSecond();
+  }
+
+  /// Return the approximate size (in bytes) of the actual map.
+  /// This is just the raw memory used by FlatHashMap.
+  /// If entries are pointers to objects, the size of the referenced objects
+  /// are not included.
+  size_t getMemorySize() const { return getStorageSize(NumBuckets); }
+
+private:
+  /// Control bytes, followed in the same allocation by the buckets.
+  int8_t *Ctrl;
+  BucketT *Buckets;
+  unsigned NumBuckets;
+  unsigned NumEntries;
+  /// The number of empty buckets that can still be filled before growing.
+  unsigned GrowthLeft;
+
+  /// Allocations are aligned at least to the size of a group so that the
+  /// group loads never straddle an extra cache line.
+  static constexpr size_t StorageAlign =
+      alignof(BucketT) > Group::Width ? alignof(BucketT) : Group::Width;
+
+  static size_t getBucketsOffset(unsigned NumBuckets) {
+    return alignTo(NumBuckets, alignof(BucketT));
+  }
+
+  static size_t getStorageSize(unsigned NumBuckets) {
+    if (NumBuckets == 0)
+      return 0;
+    return getBucketsOffset(NumBuckets) + sizeof(BucketT) * NumBuckets;
+  }
+
+  static void deallocateStorage(int8_t *Ctrl, unsigned NumBuckets) {
+    if (NumBuckets)
+      deallocate_buffer(Ctrl, getStorageSize(NumBuckets), StorageAlign);
+  }
+
+  /// The table is kept at most 7/8 full, so that every probe sequence ends
+  /// at a group with an empty control byte.
+  static unsigned getMaxLoad(unsigned NumBuckets) {
+    return NumBuckets - NumBuckets / 8;
+  }
+
+  static unsigned getMinBucketsToReserve(unsigned NumEntries) {
+    if (NumEntries == 0)
+      return 0;
+    unsigned NumBuckets = Group::Width;
+    while (getMaxLoad(NumBuckets) < NumEntries)
+      NumBuckets *= 2;
+    return NumBuckets;
+  }
+
+  /// Mix the hash from KeyInfoT, which is frequently weak in its low bits,
+  /// before it is split between the probe position and the control byte.
+  template <typename LookupKeyT> static uint64_t getHash(const LookupKeyT &Val) {
+    uint64_t H = uint64_t(KeyInfoT::getHashValue(Val)) * 0x9E3779B97F4A7C15ULL;
+    return H ^ (H >> 32);
+  }
+  static int8_t getH2(uint64_t Hash) { return Hash & 0x7F; }
+  static unsigned getFirstGroup(uint64_t Hash, unsigned NumBuckets) {
+    return (Hash >> 7) & (NumBuckets / Group::Width - 1);
+  }
+
+  void init(unsigned InitBuckets) {
+    NumBuckets = InitBuckets;
+    NumEntries = 0;
+    GrowthLeft = getMaxLoad(NumBuckets);
+    if (NumBuckets == 0) {
+      Ctrl = nullptr;
+      Buckets = nullptr;
+      return;
+    }
+    Ctrl = static_cast<int8_t *>(
+        allocate_buffer(getStorageSize(NumBuckets), StorageAlign));
+    Buckets = reinterpret_cast<BucketT *>(
+        reinterpret_cast<char *>(Ctrl) + getBucketsOffset(NumBuckets));
+    std::memset(Ctrl, Group::Empty, NumBuckets);
+  }
+
+  void copyFrom(const FlatHashMap &Other) {
+    init(Other.NumBuckets);
+    if (NumBuckets == 0)
+      return;
+    std::memcpy(Ctrl, Other.Ctrl, NumBuckets);
+    for (unsigned I = 0; I != NumBuckets; ++I) {
+      if (Ctrl[I] < 0)
+        continue;
+      ::new (&Buckets[I].getFirst()) KeyT(Other.Buckets[I].getFirst());
+      ::new (&Buckets[I].getSecond()) ValueT(Other.Buckets[I].getSecond());
+    }
+    NumEntries = Other.NumEntries;
+    GrowthLeft = Other.GrowthLeft;
+  }
+
+  void destroyAll() {
+    if (NumEntries == 0)
+      return;
+    for (unsigned I = 0; I != NumBuckets; ++I) {
+      if (Ctrl[I] < 0)
+        continue;
+      Buckets[I].getSecond().~ValueT();
+      Buckets[I].getFirst().~KeyT();
+    }
+  }
+
+  /// Return the index of the bucket holding \p Val, or NumBuckets if there is
+  /// no such bucket.
+  template <typename LookupKeyT>
+  unsigned lookupBucketFor(const LookupKeyT &Val) const {
+    if (NumBuckets == 0)
+      return 0;
+    uint64_t Hash = getHash(Val);
+    int8_t H2 = getH2(Hash);
+    unsigned GroupMask = NumBuckets / Group::Width - 1;
+    unsigned GroupNo = getFirstGroup(Hash, NumBuckets);
+    for (unsigned ProbeAmt = 1;; ++ProbeAmt) {
+      const int8_t *GroupCtrl = Ctrl + GroupNo * Group::Width;
+      Group G(GroupCtrl);
+      for (unsigned Mask = G.match(H2); Mask; Mask &= Mask - 1) {
+        unsigned I = GroupNo * Group::Width + countTrailingZeros(Mask);
+        if (LLVM_LIKELY(KeyInfoT::isEqual(Val, Buckets[I].getFirst())))
+          return I;
+      }
+      // An empty control byte means that no probe sequence ever continued
+      // past this group.
+      if (LLVM_LIKELY(G.matchEmpty()))
+        return NumBuckets;
+      // Triangular probing over a power-of-two number of groups visits every
+      // group.
+      GroupNo = (GroupNo + ProbeAmt) & GroupMask;
+    }
+  }
+
+  /// Return the index of the first empty or deleted bucket on the probe
+  /// sequence of \p Hash.
+  unsigned findInsertBucket(uint64_t Hash) const {
+    unsigned GroupMask = NumBuckets / Group::Width - 1;
+    unsigned GroupNo = getFirstGroup(Hash, NumBuckets);
+    for (unsigned ProbeAmt = 1;; ++ProbeAmt) {
+      Group G(Ctrl + GroupNo * Group::Width);
+      if (unsigned Mask = G.matchEmptyOrDeleted())
+        return GroupNo * Group::Width + countTrailingZeros(Mask);
+      GroupNo = (GroupNo + ProbeAmt) & GroupMask;
+    }
+  }
+
+  template <typename KeyArg, typename... ValueArgs>
+  std::pair<iterator, bool> tryEmplaceImpl(KeyArg &&Key,
+                                           ValueArgs &&... Values) {
+    unsigned I = lookupBucketFor(Key);
+    if (I < NumBuckets)
+      return std::make_pair(
+          iterator(Ctrl + I, Ctrl + NumBuckets, Buckets + I, *this, true),
+          false); // Already in map.
+
+    incrementEpoch();
+    uint64_t Hash = getHash(Key);
+    if (NumBuckets == 0)
+      rehash(Group::Width);
+    I = findInsertBucket(Hash);
+    if (Ctrl[I] == Group::Empty && GrowthLeft == 0) {
+      // If enough of the used buckets are tombstones, rehashing in place is
+      // enough to make room; otherwise double the table.
+      rehash(uint64_t(NumEntries) * 32 <= uint64_t(NumBuckets) * 25
+                 ? NumBuckets
+                 : NumBuckets * 2);
+      I = findInsertBucket(Hash);
+    }
+    if (Ctrl[I] == Group::Empty)
+      --GrowthLeft;
+    Ctrl[I] = getH2(Hash);
+    ++NumEntries;
+    BucketT *TheBucket = Buckets + I;
+    ::new (&TheBucket->getFirst()) KeyT(std::forward<KeyArg>(Key));
+    ::new (&TheBucket->getSecond()) ValueT(std::forward<ValueArgs>(Values)...);
+    return std::make_pair(
+        iterator(Ctrl + I, Ctrl + NumBuckets, TheBucket, *this, true), true);
+  }
+
+  void eraseBucket(unsigned I) {
+    assert(I < NumBuckets && Ctrl[I] >= 0 && "erasing an empty bucket");
+    Buckets[I].getSecond().~ValueT();
+    Buckets[I].getFirst().~KeyT();
+    --NumEntries;
+    // If the group still has an empty byte, no lookup can have probed past
+    // it, so the bucket can become empty again instead of a tombstone.
+    Group G(Ctrl + (I & ~(Group::Width - 1)));
+    if (G.matchEmpty()) {
+      Ctrl[I] = Group::Empty;
+      ++GrowthLeft;
+    } else {
+      Ctrl[I] = Group::Deleted;
+    }
+  }
+
+  void rehash(unsigned NewNumBuckets) {
+    assert(getMaxLoad(NewNumBuckets) >= NumEntries && "table too small");
+    int8_t *OldCtrl = Ctrl;
+    BucketT *OldBuckets = Buckets;
+    unsigned OldNumBuckets = NumBuckets;
+    unsigned OldNumEntries = NumEntries;
+
+    init(NewNumBuckets);
+    for (unsigned I = 0; I != OldNumBuckets; ++I) {
+      if (OldCtrl[I] < 0)
+        continue;
+      BucketT &B = OldBuckets[I];
+      uint64_t Hash = getHash(B.getFirst());
+      unsigned NewI = findInsertBucket(Hash);
+      Ctrl[NewI] = getH2(Hash);
+      ::new (&Buckets[NewI].getFirst()) KeyT(std::move(B.getFirst()));
+      ::new (&Buckets[NewI].getSecond()) ValueT(std::move(B.getSecond()));
+      B.getSecond().~ValueT();
+      B.getFirst().~KeyT();
+    }
+    NumEntries = OldNumEntries;
+    GrowthLeft -= OldNumEntries;
+    deallocateStorage(OldCtrl, OldNumBuckets);
+  }
+};
+
+template <typename KeyT, typename ValueT, typename KeyInfoT, typename Bucket,
+          bool IsConst>
+class FlatHashMapIterator : DebugEpochBase::HandleBase {
+  friend class FlatHashMapIterator<KeyT, ValueT, KeyInfoT, Bucket, true>;
+  friend class FlatHashMapIterator<KeyT, ValueT, KeyInfoT, Bucket, false>;
+
+  using ConstIterator =
+      FlatHashMapIterator<KeyT, ValueT, KeyInfoT, Bucket, true>;
+
+public:
+  using difference_type = ptrdiff_t;
+  using value_type =
+      typename std::conditional<IsConst, const Bucket, Bucket>::type;
+  using pointer = value_type *;
+  using reference = value_type &;
+  using iterator_category = std::forward_iterator_tag;
+
+private:
+  const int8_t *Ctrl = nullptr;
+  const int8_t *End = nullptr;
+  pointer Ptr = nullptr;
+
+public:
+  FlatHashMapIterator() = default;
+
+  FlatHashMapIterator(const int8_t *Ctrl, const int8_t *End, pointer Pos,
+                      const DebugEpochBase &Epoch, bool NoAdvance = false)
+      : DebugEpochBase::HandleBase(&Epoch), Ctrl(Ctrl), End(End), Ptr(Pos) {
+    assert(isHandleInSync() && "invalid construction!");
+    if (!NoAdvance)
+      AdvancePastEmptyBuckets();
+  }
+
+  // Converting ctor from non-const iterators to const iterators. SFINAE'd out
+  // for const iterator destinations so it doesn't end up as a user defined copy
+  // constructor.
+  template <bool IsConstSrc,
+            typename = std::enable_if_t<!IsConstSrc && IsConst>>
+  FlatHashMapIterator(
+      const FlatHashMapIterator<KeyT, ValueT, KeyInfoT, Bucket, IsConstSrc> &I)
+      : DebugEpochBase::HandleBase(I), Ctrl(I.Ctrl), End(I.End), Ptr(I.Ptr) {}
+
+  reference operator*() const {
+    assert(isHandleInSync() && "invalid iterator access!");
+    assert(Ctrl != End && "dereferencing end() iterator");
+    return *Ptr;
+  }
+  pointer operator->() const {
+    assert(isHandleInSync() && "invalid iterator access!");
+    assert(Ctrl != End && "dereferencing end() iterator");
+    return Ptr;
+  }
+
+  bool operator==(const ConstIterator &RHS) const {
+    assert((!Ptr || isHandleInSync()) && "handle not in sync!");
+    assert((!RHS.Ptr || RHS.isHandleInSync()) && "handle not in sync!");
+    assert(getEpochAddress() == RHS.getEpochAddress() &&
+           "comparing incomparable iterators!");
+    return Ptr == RHS.Ptr;
+  }
+  bool operator!=(const ConstIterator &RHS) const {
+    assert((!Ptr || isHandleInSync()) && "handle not in sync!");
+    assert((!RHS.Ptr || RHS.isHandleInSync()) && "handle not in sync!");
+    assert(getEpochAddress() == RHS.getEpochAddress() &&
+           "comparing incomparable iterators!");
+    return Ptr != RHS.Ptr;
+  }
+
+  inline FlatHashMapIterator &operator++() { // Preincrement
+    assert(isHandleInSync() && "invalid iterator access!");
+    assert(Ctrl != End && "incrementing end() iterator");
+    ++Ctrl;
+    ++Ptr;
+    AdvancePastEmptyBuckets();
+    return *this;
+  }
+  FlatHashMapIterator operator++(int) { // Postincrement
+    assert(isHandleInSync() && "invalid iterator access!");
+    FlatHashMapIterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+private:
+  void AdvancePastEmptyBuckets() {
+    assert(Ctrl <= End);
+    while (Ctrl != End && *Ctrl < 0) {
+      ++Ctrl;
+      ++Ptr;
+    }
+  }
+};
+
+template <typename KeyT, typename ValueT, typename KeyInfoT, typename BucketT>
+inline size_t capacity_in_bytes(
+    const FlatHashMap<KeyT, ValueT, KeyInfoT, BucketT> &X) {
+  return X.getMemorySize();
+}
+
+} // end namespace llvm
+
+#endif // LLVM_ADT_FLATHASHMAP_H
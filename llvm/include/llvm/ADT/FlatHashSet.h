@@ -0,0 +1,41 @@
+//===- llvm/ADT/FlatHashSet.h - Group-probed flat hash set ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the FlatHashSet class.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_ADT_FLATHASHSET_H
+#define LLVM_ADT_FLATHASHSET_H
+
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/FlatHashMap.h"
+
+namespace llvm {
+
+/// Implements a set on top of FlatHashMap, with the interface of DenseSet.
+template <typename ValueT, typename ValueInfoT = DenseMapInfo<ValueT>>
+class FlatHashSet
+    : public detail::DenseSetImpl<
+          ValueT, FlatHashMap<ValueT, detail::DenseSetEmpty, ValueInfoT,
+                              detail::DenseSetPair<ValueT>>,
+          ValueInfoT> {
+  using BaseT =
+      detail::DenseSetImpl<ValueT,
+                           FlatHashMap<ValueT, detail::DenseSetEmpty,
+                                       ValueInfoT, detail::DenseSetPair<ValueT>>,
+                           ValueInfoT>;
+
+public:
+  using BaseT::BaseT;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_ADT_FLATHASHSET_H
@@ -78,6 +78,13 @@ bool isDereferenceableAndAlignedInLoop(LoadInst *LI, Loop *L,
                                        ScalarEvolution &SE,
                                        DominatorTree &DT);
 
+/// Like the above, but for the first \p TripCount iterations of the loop
+/// rather than for its constant trip count, e.g. for a vector loop that runs
+/// whole vectors past an early exit.
+bool isDereferenceableAndAlignedInLoop(LoadInst *LI, Loop *L,
+                                       ScalarEvolution &SE, DominatorTree &DT,
+                                       unsigned TripCount);
+
 /// Return true if we know that executing a load from this value cannot trap.
 ///
 /// If DT and ScanFrom are specified this method performs context-sensitive
@@ -988,6 +988,10 @@ public:
   /// \return True if prefetching should also be done for writes.
   bool enableWritePrefetching() const;
 
+  /// \return True if indirect accesses like A[B[i]] should be prefetched,
+  /// which takes an extra load of the index of a later iteration.
+  bool enableIndirectPrefetching() const;
+
   /// \return The maximum interleave factor that any transform should try to
   /// perform for this target. This number depends on the level of parallelism
   /// and the number of execution units in the CPU.
@@ -1509,6 +1513,9 @@ public:
   /// \return True if prefetching should also be done for writes.
   virtual bool enableWritePrefetching() const = 0;
 
+  /// \return True if indirect accesses should be prefetched.
+  virtual bool enableIndirectPrefetching() const = 0;
+
   virtual unsigned getMaxInterleaveFactor(unsigned VF) = 0;
   virtual unsigned getArithmeticInstrCost(
       unsigned Opcode, Type *Ty,
@@ -1929,6 +1936,11 @@ public:
     return Impl.enableWritePrefetching();
   }
 
+  /// \return True if indirect accesses should be prefetched.
+  bool enableIndirectPrefetching() const override {
+    return Impl.enableIndirectPrefetching();
+  }
+
   unsigned getMaxInterleaveFactor(unsigned VF) override {
     return Impl.getMaxInterleaveFactor(VF);
   }
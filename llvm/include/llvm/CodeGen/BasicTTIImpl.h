@@ -548,6 +548,10 @@ public:
     return getST()->enableWritePrefetching();
   }
 
+  virtual bool enableIndirectPrefetching() const {
+    return getST()->enableIndirectPrefetching();
+  }
+
   /// @}
 
   /// \name Vector TTI Implementations
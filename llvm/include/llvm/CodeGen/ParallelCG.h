@@ -33,13 +33,16 @@ class raw_pwrite_stream;
 /// Writes bitcode for individual partitions into output streams in BCOSs, if
 /// BCOSs is not empty.
 ///
+/// If PreserveOrder is set, M is split into contiguous runs of functions and
+/// OSs receive the partitions in module order (see SplitModule).
+///
 /// \returns M if OSs.size() == 1, otherwise returns std::unique_ptr<Module>().
 std::unique_ptr<Module>
 splitCodeGen(std::unique_ptr<Module> M, ArrayRef<raw_pwrite_stream *> OSs,
              ArrayRef<llvm::raw_pwrite_stream *> BCOSs,
              const std::function<std::unique_ptr<TargetMachine>()> &TMFactory,
              CodeGenFileType FileType = CGFT_ObjectFile,
-             bool PreserveLocals = false);
+             bool PreserveLocals = false, bool PreserveOrder = false);
 
 } // namespace llvm
 
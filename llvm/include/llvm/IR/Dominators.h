@@ -263,6 +263,7 @@ public:
 /// Verifier pass for the \c DominatorTree.
 struct DominatorTreeVerifierPass : PassInfoMixin<DominatorTreeVerifierPass> {
   PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+  static bool isParallelSafe() { return true; }
 };
 
 /// Legacy analysis pass which computes a \c DominatorTree.
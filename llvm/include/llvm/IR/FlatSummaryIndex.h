@@ -0,0 +1,221 @@
+//===- llvm/IR/FlatSummaryIndex.h - Flat ThinLTO summary index --*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+/// @file
+/// This file contains a flat, read-only form of a combined ModuleSummaryIndex,
+/// which the thin link analyses can run over directly from a memory mapped
+/// file.
+///
+/// Values, summaries and modules are numbered, and refer to each other by
+/// these IDs rather than by pointers. The file is a header followed by arrays
+/// of fixed-size little-endian records:
+///
+/// - the GUIDs of the values, in increasing order, so that the ID of a value
+///   is the position of its GUID;
+/// - for each value, the ID of its first summary, the summaries of a value
+///   being consecutive, and the value an indirect call to it resolves to;
+/// - the summaries, each with the ID of its first call and first reference;
+/// - the calls and the references of all the summaries, the ones of a
+///   summary being consecutive;
+/// - the offset and size of the path of each module in the string table,
+///   and the string table.
+///
+/// The records are read in place, so the index costs no memory beyond its
+/// file, and the analyses keep their results, e.g. liveness, on the side.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_IR_FLATSUMMARYINDEX_H
+#define LLVM_IR_FLATSUMMARYINDEX_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Sequence.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/iterator_range.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/ModuleSummaryIndex.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+namespace flatsummary {
+
+/// The magic number and version of the flat summary index.
+const uint64_t Magic = uint64_t('L') | uint64_t('L') << 8 |
+                       uint64_t('V') << 16 | uint64_t('M') << 24 |
+                       uint64_t('F') << 32 | uint64_t('S') << 40 |
+                       uint64_t('I') << 48 | uint64_t(1) << 56;
+const uint32_t Version = 1;
+
+/// The ID of a missing value or summary.
+const uint32_t NoID = ~0u;
+
+/// The flags of a summary.
+enum SummaryFlags : uint16_t {
+  /// The value was flagged live in the per-module summary, or found live by
+  /// the dead symbol analysis of the combined index.
+  Live = 1 << 0,
+  NotEligibleToImport = 1 << 1,
+  /// The function can't or must be inlined.
+  NoInline = 1 << 2,
+  AlwaysInline = 1 << 3,
+  /// The variable is read-only or write-only, as found by the attribute
+  /// propagation of the combined index.
+  ReadOnly = 1 << 4,
+  WriteOnly = 1 << 5,
+  /// The variable can be imported along with its references, see
+  /// ModuleSummaryIndex::canImportGlobalVar.
+  ImportableVar = 1 << 6,
+};
+
+struct Header {
+  support::ulittle64_t Magic;
+  support::ulittle32_t Version;
+  support::ulittle32_t NumModules;
+  support::ulittle32_t NumValues;
+  support::ulittle32_t NumSummaries;
+  support::ulittle32_t NumCalls;
+  support::ulittle32_t NumRefs;
+  support::ulittle32_t StringTableSize;
+};
+
+struct ValueEntry {
+  /// The ID of the first summary of the value. The summaries of the value end
+  /// at the first summary of the next value.
+  support::ulittle32_t SummaryBegin;
+  /// For a value without summaries, the ID of the value with the same
+  /// original GUID, which is the one indirect calls resolve to with SamplePGO,
+  /// or NoID.
+  support::ulittle32_t IndirectTarget;
+};
+
+struct SummaryEntry {
+  /// The ID of the value this is a summary of.
+  support::ulittle32_t Value;
+  support::ulittle32_t Module;
+  /// For an alias, the ID of the summary of the aliasee, or NoID.
+  support::ulittle32_t Aliasee;
+  support::ulittle32_t InstCount;
+  /// The IDs of the first call and the first reference of the summary, which
+  /// end at the ones of the next summary.
+  support::ulittle32_t CallBegin;
+  support::ulittle32_t RefBegin;
+  /// A GlobalValueSummary::SummaryKind.
+  uint8_t Kind;
+  /// A GlobalValue::LinkageTypes.
+  uint8_t Linkage;
+  /// The SummaryFlags.
+  support::ulittle16_t Flags;
+};
+
+struct CallEntry {
+  /// The ID of the called value.
+  support::ulittle32_t Callee;
+  /// A CalleeInfo::HotnessType.
+  support::ulittle32_t Hotness;
+};
+
+struct ModuleEntry {
+  /// The offset and size of the path of the module in the string table.
+  support::ulittle32_t NameOffset;
+  support::ulittle32_t NameSize;
+};
+
+} // end namespace flatsummary
+
+/// A flat summary index read in place from a buffer, which must outlive it.
+class FlatSummaryIndex {
+public:
+  using ValueID = uint32_t;
+  using SummaryID = uint32_t;
+  using ModuleID = uint32_t;
+
+  /// Read the index of \p Buffer, checking that all the IDs it contains are
+  /// in range.
+  static Expected<FlatSummaryIndex> create(MemoryBufferRef Buffer);
+
+  unsigned getNumModules() const { return Modules.size(); }
+  unsigned getNumValues() const { return GUIDs.size(); }
+  unsigned getNumSummaries() const { return Summaries.size(); }
+
+  GlobalValue::GUID getGUID(ValueID V) const { return GUIDs[V]; }
+  /// Return the ID of the value with GUID \p GUID, or NoID.
+  ValueID findValue(GlobalValue::GUID GUID) const;
+  /// Return the ID of the value an indirect call to \p V resolves to: \p V if
+  /// it has summaries, or the value with the same original GUID.
+  ValueID resolveIndirectCall(ValueID V) const {
+    return summaries(V).empty() ? ValueID(Values[V].IndirectTarget) : V;
+  }
+
+  /// The IDs of the summaries of the value \p V.
+  iterator_range<detail::value_sequence_iterator<SummaryID>>
+  summaries(ValueID V) const {
+    return seq<SummaryID>(Values[V].SummaryBegin,
+                          V + 1 == Values.size()
+                              ? SummaryID(Summaries.size())
+                              : SummaryID(Values[V + 1].SummaryBegin));
+  }
+  const flatsummary::SummaryEntry &getSummary(SummaryID S) const {
+    return Summaries[S];
+  }
+  /// Return the summary of the aliasee of an alias, and \p S otherwise.
+  SummaryID getBaseObject(SummaryID S) const {
+    return Summaries[S].Kind == GlobalValueSummary::AliasKind
+               ? SummaryID(Summaries[S].Aliasee)
+               : S;
+  }
+  ArrayRef<flatsummary::CallEntry> calls(SummaryID S) const;
+  /// The IDs of the values referenced by the summary \p S.
+  ArrayRef<support::ulittle32_t> refs(SummaryID S) const;
+
+  StringRef getModulePath(ModuleID M) const {
+    return StringTable.substr(Modules[M].NameOffset, Modules[M].NameSize);
+  }
+
+private:
+  FlatSummaryIndex() = default;
+
+  ArrayRef<support::ulittle64_t> GUIDs;
+  ArrayRef<flatsummary::ValueEntry> Values;
+  ArrayRef<flatsummary::SummaryEntry> Summaries;
+  ArrayRef<flatsummary::CallEntry> Calls;
+  ArrayRef<support::ulittle32_t> Refs;
+  ArrayRef<flatsummary::ModuleEntry> Modules;
+  StringRef StringTable;
+};
+
+/// Builds the flat form of a combined ModuleSummaryIndex and writes it.
+class FlatSummaryIndexBuilder {
+public:
+  /// Flatten \p Index. The flags of its variables are taken as they are, so
+  /// its attribute propagation, if any, must have run already.
+  explicit FlatSummaryIndexBuilder(const ModuleSummaryIndex &Index);
+
+  /// Write the flat index to \p OS.
+  void write(raw_ostream &OS) const;
+  /// Write the flat index to a buffer, for testing.
+  std::unique_ptr<MemoryBuffer> writeBuffer() const;
+
+private:
+  std::vector<support::ulittle64_t> GUIDs;
+  std::vector<flatsummary::ValueEntry> Values;
+  std::vector<flatsummary::SummaryEntry> Summaries;
+  std::vector<flatsummary::CallEntry> Calls;
+  std::vector<support::ulittle32_t> Refs;
+  std::vector<flatsummary::ModuleEntry> Modules;
+  std::string StringTable;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_IR_FLATSUMMARYINDEX_H
@@ -52,6 +52,8 @@
 #include "llvm/ADT/Any.h"
 #include "llvm/ADT/FunctionExtras.h"
 #include "llvm/ADT/SmallVector.h"
+#include <memory>
+#include <mutex>
 #include <type_traits>
 
 namespace llvm {
@@ -80,6 +82,7 @@ public:
   using AfterPassInvalidatedFunc = void(StringRef, const PreservedAnalyses &);
   using BeforeAnalysisFunc = void(StringRef, Any);
   using AfterAnalysisFunc = void(StringRef, Any);
+  using AnalysisInvalidatedFunc = void(StringRef, Any);
 
 public:
   PassInstrumentationCallbacks() {}
@@ -121,9 +124,33 @@ public:
     AfterAnalysisCallbacks.emplace_back(std::move(C));
   }
 
+  template <typename CallableT>
+  void registerAnalysisInvalidatedCallback(CallableT C) {
+    AnalysisInvalidatedCallbacks.emplace_back(std::move(C));
+  }
+
+  /// Serialize invocations of the registered callbacks. Callbacks need not be
+  /// thread-safe themselves, so this is enabled while passes are run on
+  /// several threads at once.
+  void setThreadSafe(bool Enable) {
+    if (!Enable)
+      Lock.reset();
+    else if (!Lock)
+      Lock = std::make_unique<std::recursive_mutex>();
+  }
+  bool isThreadSafe() const { return Lock != nullptr; }
+
 private:
   friend class PassInstrumentation;
 
+  std::unique_lock<std::recursive_mutex> lockIfThreadSafe() {
+    if (!Lock)
+      return std::unique_lock<std::recursive_mutex>();
+    return std::unique_lock<std::recursive_mutex>(*Lock);
+  }
+
+  std::unique_ptr<std::recursive_mutex> Lock;
+
   SmallVector<llvm::unique_function<BeforePassFunc>, 4> BeforePassCallbacks;
   SmallVector<llvm::unique_function<BeforeSkippedPassFunc>, 4>
       BeforeSkippedPassCallbacks;
@@ -136,6 +163,8 @@ private:
       BeforeAnalysisCallbacks;
   SmallVector<llvm::unique_function<AfterAnalysisFunc>, 4>
       AfterAnalysisCallbacks;
+  SmallVector<llvm::unique_function<AnalysisInvalidatedFunc>, 4>
+      AnalysisInvalidatedCallbacks;
 };
 
 /// This class provides instrumentation entry points for the Pass Manager,
@@ -179,6 +208,7 @@ public:
     if (!Callbacks)
       return true;
 
+    auto Guard = Callbacks->lockIfThreadSafe();
     bool ShouldRun = true;
     for (auto &C : Callbacks->BeforePassCallbacks)
       ShouldRun &= C(Pass.name(), llvm::Any(&IR));
@@ -201,9 +231,12 @@ public:
   template <typename IRUnitT, typename PassT>
   void runAfterPass(const PassT &Pass, const IRUnitT &IR,
                     const PreservedAnalyses &PA) const {
-    if (Callbacks)
-      for (auto &C : Callbacks->AfterPassCallbacks)
-        C(Pass.name(), llvm::Any(&IR), PA);
+    if (!Callbacks)
+      return;
+
+    auto Guard = Callbacks->lockIfThreadSafe();
+    for (auto &C : Callbacks->AfterPassCallbacks)
+      C(Pass.name(), llvm::Any(&IR), PA);
   }
 
   /// AfterPassInvalidated instrumentation point - takes \p Pass instance
@@ -212,27 +245,48 @@ public:
   template <typename IRUnitT, typename PassT>
   void runAfterPassInvalidated(const PassT &Pass,
                                const PreservedAnalyses &PA) const {
-    if (Callbacks)
-      for (auto &C : Callbacks->AfterPassInvalidatedCallbacks)
-        C(Pass.name(), PA);
+    if (!Callbacks)
+      return;
+
+    auto Guard = Callbacks->lockIfThreadSafe();
+    for (auto &C : Callbacks->AfterPassInvalidatedCallbacks)
+      C(Pass.name(), PA);
   }
 
   /// BeforeAnalysis instrumentation point - takes \p Analysis instance
   /// to be executed and constant reference to IR it operates on.
   template <typename IRUnitT, typename PassT>
   void runBeforeAnalysis(const PassT &Analysis, const IRUnitT &IR) const {
-    if (Callbacks)
-      for (auto &C : Callbacks->BeforeAnalysisCallbacks)
-        C(Analysis.name(), llvm::Any(&IR));
+    if (!Callbacks)
+      return;
+
+    auto Guard = Callbacks->lockIfThreadSafe();
+    for (auto &C : Callbacks->BeforeAnalysisCallbacks)
+      C(Analysis.name(), llvm::Any(&IR));
   }
 
   /// AfterAnalysis instrumentation point - takes \p Analysis instance
   /// that has just been executed and constant reference to IR it operated on.
   template <typename IRUnitT, typename PassT>
   void runAfterAnalysis(const PassT &Analysis, const IRUnitT &IR) const {
-    if (Callbacks)
-      for (auto &C : Callbacks->AfterAnalysisCallbacks)
-        C(Analysis.name(), llvm::Any(&IR));
+    if (!Callbacks)
+      return;
+
+    auto Guard = Callbacks->lockIfThreadSafe();
+    for (auto &C : Callbacks->AfterAnalysisCallbacks)
+      C(Analysis.name(), llvm::Any(&IR));
+  }
+
+  /// AnalysisInvalidated instrumentation point - takes \p Analysis instance
+  /// whose result on \p IR has just been invalidated.
+  template <typename IRUnitT, typename PassT>
+  void runAnalysisInvalidated(const PassT &Analysis, const IRUnitT &IR) const {
+    if (!Callbacks)
+      return;
+
+    auto Guard = Callbacks->lockIfThreadSafe();
+    for (auto &C : Callbacks->AnalysisInvalidatedCallbacks)
+      C(Analysis.name(), llvm::Any(&IR));
   }
 
   /// Handle invalidation from the pass manager when PassInstrumentation
@@ -255,6 +309,14 @@ public:
     if (Callbacks)
       Callbacks->BeforeNonSkippedPassCallbacks.pop_back();
   }
+
+  /// Serialize the callbacks shared by this instrumentation, see
+  /// PassInstrumentationCallbacks::setThreadSafe.
+  void setThreadSafe(bool Enable) const {
+    if (Callbacks)
+      Callbacks->setThreadSafe(Enable);
+  }
+  bool isThreadSafe() const { return Callbacks && Callbacks->isThreadSafe(); }
 };
 
 bool isSpecialPass(StringRef PassID, const std::vector<StringRef> &Specials);
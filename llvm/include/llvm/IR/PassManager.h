@@ -56,6 +56,7 @@
 #include <iterator>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -558,6 +559,14 @@ public:
 
   static bool isRequired() { return true; }
 
+  /// A pass manager may run concurrently on distinct IR units if every pass
+  /// in it may.
+  bool isParallelSafe() const {
+    return llvm::all_of(Passes, [](const std::unique_ptr<PassConceptT> &P) {
+      return P->isParallelSafe();
+    });
+  }
+
 protected:
   using PassConceptT =
       detail::PassConcept<IRUnitT, AnalysisManagerT, ExtraArgTs...>;
@@ -757,10 +766,27 @@ public:
   /// IR units itself has potentially changed, and thus we can't even look up a
   /// a result and invalidate/clear it directly.
   void clear() {
+    auto Guard = lockIfThreadSafe();
     AnalysisResults.clear();
     AnalysisResultLists.clear();
   }
 
+  /// Make this analysis manager safe to query from several threads at once.
+  ///
+  /// While enabled, every lookup, computation and invalidation of a cached
+  /// result goes through an internal recursive lock. Analyses are therefore
+  /// never computed concurrently, but callers may hold on to results for one
+  /// IR unit while other threads query results for other IR units.
+  void setThreadSafe(bool Enable) {
+    if (!Enable)
+      Lock.reset();
+    else if (!Lock)
+      Lock = std::make_unique<std::recursive_mutex>();
+  }
+
+  /// Returns true if the analysis manager may be queried concurrently.
+  bool isThreadSafe() const { return Lock != nullptr; }
+
   /// Get the result of an analysis pass for a given IR unit.
   ///
   /// Runs the analysis if a cached result is not available.
@@ -882,6 +908,7 @@ private:
 
   /// Get a cached analysis result or return null.
   ResultConceptT *getCachedResultImpl(AnalysisKey *ID, IRUnitT &IR) const {
+    auto Guard = lockIfThreadSafe();
     typename AnalysisResultMapT::const_iterator RI =
         AnalysisResults.find({ID, &IR});
     return RI == AnalysisResults.end() ? nullptr : &*RI->second->second;
@@ -889,6 +916,7 @@ private:
 
   /// Invalidate a pass result for a IR unit.
   void invalidateImpl(AnalysisKey *ID, IRUnitT &IR) {
+    auto Guard = lockIfThreadSafe();
     typename AnalysisResultMapT::iterator RI =
         AnalysisResults.find({ID, &IR});
     if (RI == AnalysisResults.end())
@@ -901,6 +929,14 @@ private:
     AnalysisResults.erase(RI);
   }
 
+  /// Acquire the lock guarding the result caches if the manager has been made
+  /// thread-safe, or return an empty guard otherwise.
+  std::unique_lock<std::recursive_mutex> lockIfThreadSafe() const {
+    if (!Lock)
+      return std::unique_lock<std::recursive_mutex>();
+    return std::unique_lock<std::recursive_mutex>(*Lock);
+  }
+
   /// Map type from analysis pass ID to pass concept pointer.
   using AnalysisPassMapT =
       DenseMap<AnalysisKey *, std::unique_ptr<PassConceptT>>;
@@ -920,6 +956,10 @@ private:
 
   /// Indicates whether we log to \c llvm::dbgs().
   bool DebugLogging;
+
+  /// Lock guarding the result caches, present only while the manager is
+  /// thread-safe.
+  std::unique_ptr<std::recursive_mutex> Lock;
 };
 
 extern template class AnalysisManager<Module>;
@@ -1280,6 +1320,112 @@ createModuleToFunctionPassAdaptor(FunctionPassT Pass) {
   return ModuleToFunctionPassAdaptor<FunctionPassT>(std::move(Pass));
 }
 
+namespace detail {
+/// Call \p Body once for every index in [0, \p NumItems), using up to
+/// \p Threads threads. Indices are handed out in increasing order, but the
+/// calls may complete in any order.
+void parallelForEachFunctionIndex(size_t NumItems, unsigned Threads,
+                                  function_ref<void(size_t)> Body);
+} // namespace detail
+
+/// Adaptor that maps from a module to its functions and runs the function
+/// pass over several functions at once.
+///
+/// Functions are only processed concurrently when the wrapped pass reports
+/// that it is parallel-safe (see \c detail::passIsParallelSafe); note that
+/// few transformations qualify, since adding or removing a use of a constant
+/// or global already modifies state shared between functions. For any other
+/// pass, or when \p Threads is at most one, this behaves exactly like
+/// \c ModuleToFunctionPassAdaptor.
+///
+/// The output does not depend on the number of threads. Each function is
+/// processed by the same pipeline, and the preserved sets are combined in
+/// module order once every function is done. While the functions run, the
+/// function analysis manager and the pass instrumentation are made
+/// thread-safe, so analyses are computed and instrumentation callbacks are
+/// invoked one at a time; callbacks for different functions may interleave.
+template <typename FunctionPassT>
+class ParallelModuleToFunctionPassAdaptor
+    : public PassInfoMixin<ParallelModuleToFunctionPassAdaptor<FunctionPassT>> {
+public:
+  ParallelModuleToFunctionPassAdaptor(FunctionPassT Pass, unsigned Threads)
+      : Pass(std::move(Pass)), Threads(Threads) {}
+
+  /// Runs the function pass across every function in the module.
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+    FunctionAnalysisManager &FAM =
+        AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    PassInstrumentation PI = AM.getResult<PassInstrumentationAnalysis>(M);
+
+    std::vector<Function *> Functions;
+    for (Function &F : M)
+      if (!F.isDeclaration())
+        Functions.push_back(&F);
+
+    // Run the pass over a single function, mirroring the loop body of
+    // ModuleToFunctionPassAdaptor. The resulting preserved set is stashed so
+    // that it can be merged in a deterministic order below.
+    std::vector<PreservedAnalyses> FunctionPAs(Functions.size(),
+                                               PreservedAnalyses::all());
+    auto RunOnFunction = [&](size_t Idx) {
+      Function &F = *Functions[Idx];
+      if (!PI.runBeforePass<Function>(Pass, F))
+        return;
+
+      PreservedAnalyses PassPA;
+      {
+        TimeTraceScope TimeScope(Pass.name(), F.getName());
+        PassPA = Pass.run(F, FAM);
+      }
+
+      PI.runAfterPass(Pass, F, PassPA);
+      FAM.invalidate(F, PassPA);
+      FunctionPAs[Idx] = std::move(PassPA);
+    };
+
+    if (Threads > 1 && Functions.size() > 1 &&
+        detail::passIsParallelSafe(Pass)) {
+      bool WasThreadSafe = FAM.isThreadSafe();
+      bool WasPIThreadSafe = PI.isThreadSafe();
+      FAM.setThreadSafe(true);
+      PI.setThreadSafe(true);
+      detail::parallelForEachFunctionIndex(Functions.size(), Threads,
+                                           RunOnFunction);
+      PI.setThreadSafe(WasPIThreadSafe);
+      FAM.setThreadSafe(WasThreadSafe);
+    } else {
+      for (size_t Idx = 0, Size = Functions.size(); Idx != Size; ++Idx)
+        RunOnFunction(Idx);
+    }
+
+    PreservedAnalyses PA = PreservedAnalyses::all();
+    for (PreservedAnalyses &PassPA : FunctionPAs)
+      PA.intersect(std::move(PassPA));
+
+    // As with ModuleToFunctionPassAdaptor, the function analyses have all
+    // been invalidated as needed above.
+    PA.preserveSet<AllAnalysesOn<Function>>();
+    PA.preserve<FunctionAnalysisManagerModuleProxy>();
+    return PA;
+  }
+
+  static bool isRequired() { return true; }
+
+private:
+  FunctionPassT Pass;
+  unsigned Threads;
+};
+
+/// A function to deduce a function pass type and wrap it in the templated
+/// parallel adaptor.
+template <typename FunctionPassT>
+ParallelModuleToFunctionPassAdaptor<FunctionPassT>
+createParallelModuleToFunctionPassAdaptor(FunctionPassT Pass,
+                                          unsigned Threads) {
+  return ParallelModuleToFunctionPassAdaptor<FunctionPassT>(std::move(Pass),
+                                                            Threads);
+}
+
 /// A utility pass template to force an analysis result to be available.
 ///
 /// If there are extra arguments at the pass's run level there may also be
@@ -1309,6 +1455,7 @@ struct RequireAnalysisPass
     return PreservedAnalyses::all();
   }
   static bool isRequired() { return true; }
+  static bool isParallelSafe() { return true; }
 };
 
 /// A no-op pass template which simply forces a specific analysis result
@@ -1328,6 +1475,7 @@ struct InvalidateAnalysisPass
     PA.abandon<AnalysisT>();
     return PA;
   }
+  static bool isParallelSafe() { return true; }
 };
 
 /// A utility pass that does nothing, but preserves no analyses.
@@ -1340,6 +1488,7 @@ struct InvalidateAllAnalysesPass : PassInfoMixin<InvalidateAllAnalysesPass> {
   PreservedAnalyses run(IRUnitT &, AnalysisManagerT &, ExtraArgTs &&...) {
     return PreservedAnalyses::none();
   }
+  static bool isParallelSafe() { return true; }
 };
 
 /// A utility pass template that simply runs another pass multiple times.
@@ -37,6 +37,7 @@ template <typename IRUnitT, typename... ExtraArgTs>
 inline void
 AnalysisManager<IRUnitT, ExtraArgTs...>::clear(IRUnitT &IR,
                                                llvm::StringRef Name) {
+  auto Guard = lockIfThreadSafe();
   if (DebugLogging)
     dbgs() << "Clearing all analysis results for: " << Name << "\n";
 
@@ -55,6 +56,7 @@ template <typename IRUnitT, typename... ExtraArgTs>
 inline typename AnalysisManager<IRUnitT, ExtraArgTs...>::ResultConceptT &
 AnalysisManager<IRUnitT, ExtraArgTs...>::getResultImpl(
     AnalysisKey *ID, IRUnitT &IR, ExtraArgTs... ExtraArgs) {
+  auto Guard = lockIfThreadSafe();
   typename AnalysisResultMapT::iterator RI;
   bool Inserted;
   std::tie(RI, Inserted) = AnalysisResults.insert(std::make_pair(
@@ -66,7 +68,8 @@ AnalysisManager<IRUnitT, ExtraArgTs...>::getResultImpl(
     auto &P = this->lookUpPass(ID);
 
     PassInstrumentation PI;
-    if (ID != PassInstrumentationAnalysis::ID()) {
+    if (ID != PassInstrumentationAnalysis::ID() &&
+        AnalysisPasses.count(PassInstrumentationAnalysis::ID())) {
       PI = getResult<PassInstrumentationAnalysis>(IR, ExtraArgs...);
       PI.runBeforeAnalysis(P, IR);
     }
@@ -94,6 +97,8 @@ inline void AnalysisManager<IRUnitT, ExtraArgTs...>::invalidate(
   if (PA.allAnalysesInSetPreserved<AllAnalysesOn<IRUnitT>>())
     return;
 
+  auto Guard = lockIfThreadSafe();
+
   // Track whether each analysis's result is invalidated in
   // IsResultInvalidated.
   SmallDenseMap<AnalysisKey *, bool, 8> IsResultInvalidated;
@@ -137,6 +142,12 @@ inline void AnalysisManager<IRUnitT, ExtraArgTs...>::invalidate(
         dbgs() << "Invalidating analysis: " << this->lookUpPass(ID).name()
                << " on " << IR.getName() << "\n";
 
+      // Analysis managers driven without a pass manager need not register
+      // the instrumentation; getCachedResult asserts on unknown analyses.
+      if (AnalysisPasses.count(PassInstrumentationAnalysis::ID()))
+        if (auto *PI = getCachedResult<PassInstrumentationAnalysis>(IR))
+          PI->runAnalysisInvalidated(this->lookUpPass(ID), IR);
+
       I = ResultsList.erase(I);
       AnalysisResults.erase({ID, &IR});
     }
@@ -54,8 +54,35 @@ struct PassConcept {
   /// To opt-in, pass should implement `static bool isRequired()`. It's no-op
   /// to have `isRequired` always return false since that is the default.
   virtual bool isRequired() const = 0;
+
+  /// Polymorphic method to query whether the pass may be run concurrently on
+  /// distinct IR units.
+  /// To opt-in, pass should implement `bool isParallelSafe()`, which may be
+  /// static. The default is false.
+  virtual bool isParallelSafe() const = 0;
 };
 
+template <typename PassT>
+using has_parallel_safe_t =
+    decltype(std::declval<const PassT &>().isParallelSafe());
+
+/// Query whether \p Pass may be run concurrently on distinct IR units.
+///
+/// A pass qualifies if its \c run method can be entered from several threads
+/// at once, it keeps no mutable state in the pass object, and it never
+/// creates, erases or rewrites anything outside of the IR unit it is given.
+/// The latter includes the use lists of constants and globals.
+template <typename PassT>
+std::enable_if_t<is_detected<has_parallel_safe_t, PassT>::value, bool>
+passIsParallelSafe(const PassT &Pass) {
+  return Pass.isParallelSafe();
+}
+template <typename PassT>
+std::enable_if_t<!is_detected<has_parallel_safe_t, PassT>::value, bool>
+passIsParallelSafe(const PassT &) {
+  return false;
+}
+
 /// A template wrapper used to implement the polymorphic API.
 ///
 /// Can be instantiated for any object which provides a \c run method accepting
@@ -103,6 +130,8 @@ struct PassModel : PassConcept<IRUnitT, AnalysisManagerT, ExtraArgTs...> {
 
   bool isRequired() const override { return passIsRequiredImpl<PassT>(); }
 
+  bool isParallelSafe() const override { return passIsParallelSafe(Pass); }
+
   PassT Pass;
 };
 
@@ -143,6 +143,7 @@ public:
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
   PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
   static bool isRequired() { return true; }
+  static bool isParallelSafe() { return true; }
 };
 
 } // end namespace llvm
@@ -15,6 +15,7 @@
 #define LLVM_LTO_CACHING_H
 
 #include "llvm/LTO/LTO.h"
+#include <atomic>
 #include <string>
 
 namespace llvm {
@@ -27,11 +28,21 @@ namespace lto {
 using AddBufferFn =
     std::function<void(unsigned Task, std::unique_ptr<MemoryBuffer> MB)>;
 
+/// Hit and miss counters of a cache, updated concurrently by the backend
+/// threads.
+struct CacheStats {
+  std::atomic<unsigned> Hits{0};
+  std::atomic<unsigned> Misses{0};
+};
+
 /// Create a local file system cache which uses the given cache directory and
 /// file callback. This function also creates the cache directory if it does not
-/// already exist.
+/// already exist. Entries are laid out as described by getCacheEntryPath() and
+/// recorded in the cache index (see addCacheIndexEntry()). If \p Stats is not
+/// null, the cache lookups are counted in it.
 Expected<NativeObjectCache> localCache(StringRef CacheDirectoryPath,
-                                       AddBufferFn AddBuffer);
+                                       AddBufferFn AddBuffer,
+                                       CacheStats *Stats = nullptr);
 
 } // namespace lto
 } // namespace llvm
@@ -37,7 +37,8 @@ namespace lto {
 /// structure and passing it to the lto::LTO constructor.
 struct Config {
   // Note: when adding fields here, consider whether they need to be added to
-  // computeCacheKey in LTO.cpp.
+  // computeCacheKey in LTO.cpp, and to the backend job settings in
+  // LTOBackend.cpp.
   std::string CPU;
   TargetOptions Options;
   std::vector<std::string> MAttrs;
@@ -71,6 +72,12 @@ struct Config {
   /// want to know a priori all possible output files.
   bool AlwaysEmitRegularLTOObj = false;
 
+  /// When splitting the regular LTO module for parallel code generation, give
+  /// each partition a contiguous run of functions and emit the partitions in
+  /// module order, so the objects linked in that order keep the function
+  /// layout. See SplitModule.
+  bool SplitPreserveOrder = false;
+
   /// If this field is set, the set of passes run in the middle-end optimizer
   /// will be the one specified by the string. Only works with the new pass
   /// manager as the old one doesn't have this ability.
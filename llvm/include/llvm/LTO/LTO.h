@@ -230,6 +230,19 @@ using ThinBackend = std::function<std::unique_ptr<ThinBackendProc>(
 /// The default value means to use one job per hardware core (not hyper-thread).
 ThinBackend createInProcessThinBackend(ThreadPoolStrategy Parallelism);
 
+/// This ThinBackend runs the individual backend jobs in worker processes. Each
+/// job is written to a self-contained file (see writeThinBackendJob()) holding
+/// the module's summary index slice, the bitcode of the module and of the
+/// modules it imports from, and the code generation settings. The worker is
+/// invoked as "WorkerPath WorkerArgs... <job file> -o <object file>" and is
+/// expected to run the job with runThinBackendJob(), like the
+/// thin-backend-worker subcommand of llvm-lto2 does. As jobs do not refer to
+/// any other file, the worker may also be a wrapper that forwards them to
+/// remote machines. Parallelism bounds the number of concurrent workers.
+ThinBackend createOutOfProcessThinBackend(ThreadPoolStrategy Parallelism,
+                                          std::string WorkerPath,
+                                          std::vector<std::string> WorkerArgs);
+
 /// This ThinBackend writes individual module indexes to files, instead of
 /// running the individual backend jobs. This backend is for distributed builds
 /// where separate processes will invoke the real backends.
@@ -65,6 +65,25 @@ bool loadReferencedModules(
     MapVector<llvm::StringRef, llvm::BitcodeModule> &ModuleMap,
     std::vector<std::unique_ptr<llvm::MemoryBuffer>>
         &OwnedImportsLifetimeManager);
+
+/// Out-of-process ThinLTO: write a self-contained backend job for \p BM to
+/// \p OS. The job holds the summary index slice for the module, the bitcode of
+/// the module and of every module in \p ImportList, the import list itself and
+/// the settings of \p C that affect code generation, including all of its
+/// TargetOptions. Profiles are recorded by path, so the worker must be able to
+/// read them. Hooks, remarks and save-temps are not recorded. Fails if \p C
+/// uses target options that a job can not carry.
+Error writeThinBackendJob(
+    raw_ostream &OS, const Config &C, unsigned Task, BitcodeModule BM,
+    const ModuleSummaryIndex &CombinedIndex,
+    const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
+    const FunctionImporter::ImportMapTy &ImportList,
+    const MapVector<StringRef, BitcodeModule> &ModuleMap);
+
+/// Out-of-process ThinLTO: run a backend job written by writeThinBackendJob()
+/// and stream the result to \p AddStream. The settings recorded in the job
+/// override those in \p C. \p Job must outlive the call.
+Error runThinBackendJob(Config &C, MemoryBufferRef Job, AddStreamFn AddStream);
 }
 }
 
@@ -78,6 +78,11 @@ public:
   /// Get the offset of the given fragment inside its containing section.
   uint64_t getFragmentOffset(const MCFragment *F) const;
 
+  /// Get the offset of the given fragment if it is already laid out, without
+  /// laying out anything.
+  /// \return True if the fragment is laid out.
+  bool getValidFragmentOffset(const MCFragment *F, uint64_t &Offset) const;
+
   /// @}
   /// \name Utility Functions
   /// @{
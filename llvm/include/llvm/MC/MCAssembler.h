@@ -10,8 +10,10 @@
 #define LLVM_MC_MCASSEMBLER_H
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/iterator.h"
 #include "llvm/ADT/iterator_range.h"
@@ -154,6 +156,18 @@ private:
 
   VersionInfoType VersionInfo;
 
+  /// The fragments whose offsets the relaxation of a fragment read, with
+  /// those offsets, the last time it did not need relaxing. Empty if the
+  /// fragment was relaxed or is not tracked.
+  using RelaxationInputs =
+      SmallVector<std::pair<const MCFragment *, uint64_t>, 2>;
+
+  /// For each section, the relaxation inputs of its fragments, indexed by
+  /// layout order. A fragment is not visited again while all of its inputs
+  /// are laid out at the same offsets.
+  DenseMap<const MCSection *, std::vector<RelaxationInputs>>
+      UnrelaxedFragments;
+
   /// Evaluate a fixup to a relocatable expression and the value which should be
   /// placed into the fixup.
   ///
@@ -190,6 +204,16 @@ private:
   /// if any offsets were adjusted.
   bool layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec);
 
+  /// Check whether the relaxation of a fragment would read the same offsets
+  /// as it did when it last did not need relaxing, without laying anything
+  /// out.
+  bool isRelaxationUpToDate(const MCAsmLayout &Layout,
+                            const RelaxationInputs &Inputs) const;
+
+  /// Record the inputs of the relaxation of \p F which just ran.
+  void recordRelaxation(const MCAsmLayout &Layout, const MCFragment &F,
+                        bool Relaxed, RelaxationInputs &Inputs) const;
+
   /// Perform relaxation on a single fragment - returns true if the fragment
   /// changes as a result of relaxation.
   bool relaxFragment(MCAsmLayout &Layout, MCFragment &F);
@@ -270,6 +270,10 @@ public:
   ///
   virtual bool enableWritePrefetching() const;
 
+  /// \return True if indirect accesses like A[B[i]] should be prefetched.
+  ///
+  virtual bool enableIndirectPrefetching() const;
+
   /// Return the minimum stride necessary to trigger software
   /// prefetching.
   ///
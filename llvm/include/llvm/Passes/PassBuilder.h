@@ -109,6 +109,12 @@ public:
   /// Tuning option to enable/disable call graph profile. Its default value is
   /// that of the flag: `-enable-npm-call-graph-profile`.
   bool CallGraphProfile;
+
+  /// Tuning option to set the number of threads used to run function pass
+  /// pipelines parsed from text directly into a module pipeline. Only
+  /// pipelines made up of parallel-safe passes are actually run concurrently.
+  /// Its default value is 1.
+  unsigned FunctionThreads;
 };
 
 /// This class provides access to building LLVM's passes.
@@ -15,6 +15,7 @@
 #ifndef LLVM_PASSES_STANDARDINSTRUMENTATIONS_H
 #define LLVM_PASSES_STANDARDINSTRUMENTATIONS_H
 
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/BasicBlock.h"
@@ -23,6 +24,8 @@
 #include "llvm/IR/ValueHandle.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <chrono>
+#include <map>
 #include <string>
 #include <utility>
 
@@ -122,6 +125,56 @@ public:
   void registerCallbacks(PassInstrumentationCallbacks &PIC);
 };
 
+/// Per-pass, per-IR-unit profile of a pipeline run: how often a pass ran on
+/// a function (or module, SCC), how long it took, how much it changed the
+/// instruction count and how many analysis results it invalidated. Enabled
+/// with -pass-profile=<file>, which receives a JSON report sorted by time
+/// when the instrumentation is destroyed.
+class PassProfileInstrumentation {
+public:
+  ~PassProfileInstrumentation();
+
+  void registerCallbacks(PassInstrumentationCallbacks &PIC);
+
+  /// Print the JSON report for the passes run so far to \p OS.
+  void print(raw_ostream &OS) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+  /// Pass name and IR unit name.
+  using EntryKey = std::pair<std::string, std::string>;
+
+  struct Entry {
+    StringRef Kind;
+    unsigned Runs = 0;
+    Clock::duration Time = Clock::duration::zero();
+    int64_t InstDelta = 0;
+    unsigned Invalidations = 0;
+  };
+
+  struct RunningPass {
+    EntryKey Key;
+    StringRef Kind;
+    unsigned InstsBefore;
+    Clock::time_point Start;
+  };
+
+  /// Passes run concurrently by the parallel function adaptor each have
+  /// their own stack; the callbacks themselves are serialized.
+  struct ThreadState {
+    SmallVector<RunningPass, 4> Running;
+    /// Pass the analysis invalidations that follow a pass are charged to.
+    Optional<EntryKey> LastFinished;
+  };
+
+  void startPass(StringRef PassID, Any IR);
+  void finishPass(Optional<Any> IR);
+  void analysisInvalidated();
+
+  std::map<EntryKey, Entry> Entries;
+  std::map<uint64_t, ThreadState> Threads;
+};
+
 /// This class provides an interface to register all the standard pass
 /// instrumentations and manages their state (if any).
 class StandardInstrumentations {
@@ -130,6 +183,7 @@ class StandardInstrumentations {
   TimePassesHandler TimePasses;
   OptNoneInstrumentation OptNone;
   PreservedCFGCheckerInstrumentation PreservedCFGChecker;
+  PassProfileInstrumentation PassProfile;
 
 public:
   StandardInstrumentations(bool DebugLogging) : PrintPass(DebugLogging) {}
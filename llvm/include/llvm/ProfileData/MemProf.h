@@ -0,0 +1,314 @@
+//===- MemProf.h - Memory profile data structures ---------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the symbolized form of a memory profile, as read from a
+// raw profile of the MemProf runtime, and its indexed on-disk format, which is
+// what the compiler consumes and llvm-profdata merges.
+//
+// The indexed profile is a header followed by an on-disk hash table, keyed by
+// the GUID of a function, of the allocation sites in that function. An
+// allocation site is described by its symbolized call stack, which starts at
+// the allocation call, and by the merged statistics of the allocations made
+// from that call stack.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PROFILEDATA_MEMPROF_H
+#define LLVM_PROFILEDATA_MEMPROF_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/ADT/iterator_range.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/OnDiskHashTable.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <memory>
+
+#include "llvm/ProfileData/MemProfData.inc"
+
+namespace llvm {
+namespace memprof {
+
+/// The statistics of a MemInfoBlock that are kept once the raw profile is
+/// symbolized. The fields and the way they merge are listed in
+/// MIBEntryDef.inc.
+struct PortableMemInfoBlock {
+#define MIBEntryDef(Name, Type, Merge) Type Name = 0;
+#include "llvm/ProfileData/MIBEntryDef.inc"
+
+  PortableMemInfoBlock() = default;
+  explicit PortableMemInfoBlock(const MemInfoBlock &Block) {
+#define MIBEntryDef(Name, Type, Merge) Name = Block.Name;
+#include "llvm/ProfileData/MIBEntryDef.inc"
+  }
+
+  /// Merge the statistics of the allocations of \p Other into this block.
+  void merge(const PortableMemInfoBlock &Other);
+
+  /// The average lifetime of the allocations, in milliseconds.
+  double getAverageLifetime() const {
+    return AllocCount ? double(TotalLifetime) / AllocCount : 0;
+  }
+  /// The average number of accesses per byte of each allocation, over its
+  /// lifetime.
+  double getAccessDensity() const {
+    return TotalSize ? double(TotalAccessCount) / TotalSize : 0;
+  }
+
+  static constexpr size_t getSerializedSize() {
+    return 0
+#define MIBEntryDef(Name, Type, Merge) +sizeof(Type)
+#include "llvm/ProfileData/MIBEntryDef.inc"
+        ;
+  }
+  void serialize(raw_ostream &OS) const;
+  static PortableMemInfoBlock deserialize(const unsigned char *&Ptr);
+
+  void printYAML(raw_ostream &OS) const;
+
+  bool operator==(const PortableMemInfoBlock &Other) const;
+  bool operator!=(const PortableMemInfoBlock &Other) const {
+    return !(*this == Other);
+  }
+};
+
+/// A symbolized frame of an allocation call stack. The line is relative to the
+/// start of the function, so that it survives unrelated edits of the source
+/// file.
+struct Frame {
+  /// The GUID of the function, computed from its linkage name.
+  uint64_t Function = 0;
+  uint32_t LineOffset = 0;
+  uint32_t Column = 0;
+  /// Whether the function was inlined into the next frame of the call stack.
+  bool IsInlineFrame = false;
+
+  Frame() = default;
+  Frame(uint64_t Function, uint32_t LineOffset, uint32_t Column,
+        bool IsInlineFrame)
+      : Function(Function), LineOffset(LineOffset), Column(Column),
+        IsInlineFrame(IsInlineFrame) {}
+
+  static constexpr size_t getSerializedSize() {
+    return sizeof(Function) + sizeof(LineOffset) + sizeof(Column) +
+           sizeof(IsInlineFrame);
+  }
+  void serialize(raw_ostream &OS) const;
+  static Frame deserialize(const unsigned char *&Ptr);
+
+  void printYAML(raw_ostream &OS) const;
+
+  bool operator==(const Frame &Other) const {
+    return Function == Other.Function && LineOffset == Other.LineOffset &&
+           Column == Other.Column && IsInlineFrame == Other.IsInlineFrame;
+  }
+  bool operator!=(const Frame &Other) const { return !(*this == Other); }
+};
+
+/// The allocations made from one call stack.
+struct AllocationInfo {
+  /// The call stack, starting with the frame of the allocation call.
+  SmallVector<Frame, 8> CallStack;
+  PortableMemInfoBlock Info;
+
+  AllocationInfo() = default;
+  AllocationInfo(ArrayRef<Frame> CallStack, const PortableMemInfoBlock &Info)
+      : CallStack(CallStack.begin(), CallStack.end()), Info(Info) {}
+
+  bool operator==(const AllocationInfo &Other) const {
+    return CallStack == Other.CallStack && Info == Other.Info;
+  }
+};
+
+/// The allocation sites of a function, which is the function of the first
+/// frame of each call stack.
+struct MemProfRecord {
+  SmallVector<AllocationInfo, 2> AllocSites;
+
+  /// Add an allocation site, merging it into the one with the same call stack
+  /// if there is one.
+  void addAllocSite(const AllocationInfo &Site);
+  /// Merge all the allocation sites of \p Other into this record.
+  void merge(const MemProfRecord &Other);
+
+  size_t getSerializedSize() const;
+  void serialize(raw_ostream &OS) const;
+  /// Read the record of the \p Size bytes at \p Ptr. Fails if the counts of
+  /// the record don't fit in them.
+  static Expected<MemProfRecord> deserialize(const unsigned char *Ptr,
+                                             uint64_t Size);
+
+  void printYAML(raw_ostream &OS) const;
+
+  bool operator==(const MemProfRecord &Other) const {
+    return AllocSites == Other.AllocSites;
+  }
+};
+
+/// The magic number and version of the indexed profile.
+const uint64_t IndexedMagic =
+    uint64_t(255) << 56 | uint64_t('m') << 48 | uint64_t('p') << 40 |
+    uint64_t('r') << 32 | uint64_t('o') << 24 | uint64_t('f') << 16 |
+    uint64_t('i') << 8 | uint64_t(129);
+const uint64_t IndexedVersion = 1;
+
+/// The header of the indexed profile. All the fields are little-endian.
+struct IndexedHeader {
+  uint64_t Magic;
+  uint64_t Version;
+  /// The offset of the buckets of the hash table from the start of the file.
+  /// The records start right after the header.
+  uint64_t TableOffset;
+};
+
+/// The trait of the on-disk hash table from function GUIDs to their records,
+/// when the table is written.
+class MemProfRecordWriterTrait {
+public:
+  using key_type = uint64_t;
+  using key_type_ref = uint64_t;
+
+  using data_type = MemProfRecord;
+  using data_type_ref = const MemProfRecord &;
+
+  using hash_value_type = uint64_t;
+  using offset_type = uint64_t;
+
+  // The GUIDs are already hashes.
+  static hash_value_type ComputeHash(key_type_ref K) { return K; }
+
+  static std::pair<offset_type, offset_type>
+  EmitKeyDataLength(raw_ostream &Out, key_type_ref K, data_type_ref V) {
+    using namespace support;
+
+    endian::Writer LE(Out, little);
+    offset_type N = sizeof(K);
+    LE.write<offset_type>(N);
+    offset_type M = V.getSerializedSize();
+    LE.write<offset_type>(M);
+    return std::make_pair(N, M);
+  }
+
+  void EmitKey(raw_ostream &Out, key_type_ref K, offset_type) {
+    using namespace support;
+
+    endian::Writer LE(Out, little);
+    LE.write<uint64_t>(K);
+  }
+
+  void EmitData(raw_ostream &Out, key_type_ref, data_type_ref V,
+                offset_type) {
+    V.serialize(Out);
+  }
+};
+
+/// The trait of the on-disk hash table from function GUIDs to their records,
+/// when the table is read.
+class MemProfRecordLookupTrait {
+public:
+  using data_type = Expected<MemProfRecord>;
+  using internal_key_type = uint64_t;
+  using external_key_type = uint64_t;
+  using hash_value_type = uint64_t;
+  using offset_type = uint64_t;
+
+  static bool EqualKey(uint64_t A, uint64_t B) { return A == B; }
+  static uint64_t GetInternalKey(uint64_t K) { return K; }
+  static uint64_t GetExternalKey(uint64_t K) { return K; }
+
+  /// \p End is the end of the buffer of the profile, which records must not
+  /// run past.
+  explicit MemProfRecordLookupTrait(const unsigned char *End) : End(End) {}
+
+  static hash_value_type ComputeHash(uint64_t K) { return K; }
+
+  static std::pair<offset_type, offset_type>
+  ReadKeyDataLength(const unsigned char *&D) {
+    using namespace support;
+
+    offset_type KeyLen = endian::readNext<offset_type, little, unaligned>(D);
+    offset_type DataLen = endian::readNext<offset_type, little, unaligned>(D);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  static uint64_t ReadKey(const unsigned char *D, offset_type) {
+    using namespace support;
+
+    return endian::readNext<uint64_t, little, unaligned>(D);
+  }
+
+  data_type ReadData(uint64_t, const unsigned char *D, offset_type N) const;
+
+private:
+  const unsigned char *End;
+};
+
+/// Collects the records of one or more profiles, and writes them as an indexed
+/// profile.
+class MemProfWriter {
+public:
+  using RecordMap = MapVector<uint64_t, MemProfRecord>;
+
+  /// Add the allocation sites of the function with GUID \p Function, merging
+  /// them into those added before.
+  void addRecord(uint64_t Function, const MemProfRecord &Record);
+  /// Add all the records of \p Records.
+  void addRecords(const RecordMap &Records);
+
+  const RecordMap &getRecords() const { return Records; }
+
+  /// Write the indexed profile to \p OS.
+  void write(raw_ostream &OS);
+  /// Write the indexed profile to a buffer, for testing.
+  std::unique_ptr<MemoryBuffer> writeBuffer();
+
+private:
+  RecordMap Records;
+};
+
+/// Reads an indexed profile.
+class IndexedMemProfReader {
+public:
+  using OnDiskHashTableType =
+      OnDiskIterableChainedHashTable<MemProfRecordLookupTrait>;
+
+  static bool hasFormat(const MemoryBuffer &Buffer);
+
+  static Expected<std::unique_ptr<IndexedMemProfReader>>
+  create(const Twine &Path);
+  static Expected<std::unique_ptr<IndexedMemProfReader>>
+  create(std::unique_ptr<MemoryBuffer> Buffer);
+
+  /// Return the allocation sites of the function with GUID \p Function.
+  Expected<MemProfRecord> getRecord(uint64_t Function) const;
+
+  /// The GUIDs of the functions of the profile.
+  iterator_range<OnDiskHashTableType::key_iterator> functions() const {
+    return make_range(Table->key_begin(), Table->key_end());
+  }
+
+private:
+  IndexedMemProfReader(std::unique_ptr<MemoryBuffer> Buffer)
+      : Buffer(std::move(Buffer)) {}
+
+  Error readHeader();
+
+  std::unique_ptr<MemoryBuffer> Buffer;
+  std::unique_ptr<OnDiskHashTableType> Table;
+};
+
+} // namespace memprof
+} // namespace llvm
+
+#endif // LLVM_PROFILEDATA_MEMPROF_H
@@ -0,0 +1,97 @@
+//===- RawMemProfReader.h - Raw memory profile reader -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the reader of the raw profiles written by the MemProf
+// runtime. The call stacks of a raw profile are PCs of the profiled process,
+// so the reader needs the profiled binary to symbolize them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PROFILEDATA_RAWMEMPROFREADER_H
+#define LLVM_PROFILEDATA_RAWMEMPROFREADER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/DebugInfo/Symbolize/SymbolizableModule.h"
+#include "llvm/Object/Binary.h"
+#include "llvm/ProfileData/MemProf.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+
+namespace llvm {
+namespace memprof {
+
+class RawMemProfReader {
+public:
+  using RecordMap = MemProfWriter::RecordMap;
+
+  /// Return true if \p Buffer starts with the magic of a raw profile.
+  static bool hasFormat(const MemoryBuffer &Buffer);
+  static bool hasFormat(const Twine &Path);
+
+  /// Read the raw profile at \p Path, and symbolize it with the debug info of
+  /// \p ProfiledBinary, which must be the ELF binary that wrote the profile.
+  static Expected<std::unique_ptr<RawMemProfReader>>
+  create(const Twine &Path, StringRef ProfiledBinary);
+
+  /// Read the raw profile in \p Buffer, and symbolize it with \p Symbolizer.
+  /// The file offsets of the profiled binary are used as the addresses of the
+  /// module, as if its segments were loaded at their file offsets.
+  static Expected<std::unique_ptr<RawMemProfReader>>
+  create(std::unique_ptr<MemoryBuffer> Buffer,
+         std::unique_ptr<symbolize::SymbolizableModule> Symbolizer);
+
+  /// The allocation sites of the profile, keyed by the GUID of the function
+  /// that makes the allocation call.
+  const RecordMap &getRecords() const { return Records; }
+
+  void printYAML(raw_ostream &OS) const;
+
+private:
+  /// A loadable segment of the profiled binary, which maps the file offsets
+  /// [Offset, Offset + Size) to the addresses starting at VAddr.
+  struct LoadSegment {
+    uint64_t Offset;
+    uint64_t Size;
+    uint64_t VAddr;
+  };
+
+  RawMemProfReader(std::unique_ptr<MemoryBuffer> Buffer,
+                   std::unique_ptr<symbolize::SymbolizableModule> Symbolizer)
+      : Buffer(std::move(Buffer)), Symbolizer(std::move(Symbolizer)) {}
+
+  /// Read and symbolize each profile of the buffer. Profiles of several runs
+  /// may be concatenated, and are merged.
+  Error readProfiles();
+  /// Read and symbolize the profile starting at \p Start, which is at most
+  /// \p Size bytes long.
+  Error readProfile(const char *Start, uint64_t Size);
+
+  /// Symbolize \p PC, appending its frames, innermost first, to \p CallStack.
+  /// PCs outside of the profiled binary are dropped.
+  void symbolizePC(uint64_t PC, ArrayRef<SegmentEntry> Segments,
+                   SmallVectorImpl<Frame> &CallStack);
+
+  std::unique_ptr<MemoryBuffer> Buffer;
+  std::unique_ptr<symbolize::SymbolizableModule> Symbolizer;
+  /// The profiled binary and its loadable segments. They are empty when the
+  /// symbolizer is given directly.
+  object::OwningBinary<object::Binary> Binary;
+  SmallVector<LoadSegment, 4> LoadSegments;
+  /// The frames of each symbolized module address.
+  DenseMap<uint64_t, SmallVector<Frame, 2>> SymbolizedFrames;
+
+  RecordMap Records;
+};
+
+} // namespace memprof
+} // namespace llvm
+
+#endif // LLVM_PROFILEDATA_RAWMEMPROFREADER_H
@@ -16,6 +16,7 @@
 
 #include "llvm/ADT/Optional.h"
 #include <chrono>
+#include <string>
 
 namespace llvm {
 
@@ -67,13 +68,37 @@ struct CachePruningPolicy {
 /// and maximum cache size of 50% of available disk space.
 Expected<CachePruningPolicy> parseCachePruningPolicy(StringRef PolicyStr);
 
+/// Statistics about a pruneCache() run.
+struct CachePruningStats {
+  /// The number of files removed from the cache.
+  uint64_t NumEvicted = 0;
+
+  /// The total size of the files removed from the cache.
+  uint64_t EvictedBytes = 0;
+};
+
 /// Peform pruning using the supplied policy, returns true if pruning
-/// occurred, i.e. if Policy.Interval was expired.
+/// occurred, i.e. if Policy.Interval was expired or if the cache index shows
+/// that the cache is over its size or file budget.
 ///
 /// As a safeguard against data loss if the user specifies the wrong directory
 /// as their cache directory, this function will ignore files not matching the
-/// pattern "llvmcache-*".
-bool pruneCache(StringRef Path, CachePruningPolicy Policy);
+/// pattern "llvmcache-*", and only descends into the shard directories created
+/// by getCacheEntryPath().
+bool pruneCache(StringRef Path, CachePruningPolicy Policy,
+                CachePruningStats *Stats = nullptr);
+
+/// Return the path of the file for the cache entry \p Key in the cache
+/// directory \p Path. Entries are spread over 256 shard subdirectories so that
+/// large caches do not end up with a single huge directory.
+std::string getCacheEntryPath(StringRef Path, StringRef Key);
+
+/// Record in the index of the cache directory \p Path that the entry \p Key,
+/// of \p Size bytes, was added to the cache. The index keeps the total size and
+/// number of entries of the cache, which lets pruneCache() check them against
+/// the policy without scanning the cache. Updates are serialized with a file
+/// lock, so the index may be shared by concurrent processes.
+void addCacheIndexEntry(StringRef Path, StringRef Key, uint64_t Size);
 
 } // namespace llvm
 
@@ -33,7 +33,11 @@
 */
 
 /* based on revision d2df04efcbef7d7f6886d345861e5dfda4edacc1 Removed
- * everything but a simple interface for computing XXh64. */
+ * everything but a simple interface for computing XXh64.
+ *
+ * The XXH3 functions implement the one-shot, unseeded XXH3_64bits and
+ * XXH3_128bits of xxHash 0.8, using the default secret. Their results match
+ * the reference implementation. */
 
 #ifndef LLVM_SUPPORT_XXHASH_H
 #define LLVM_SUPPORT_XXHASH_H
@@ -44,6 +48,31 @@
 namespace llvm {
 uint64_t xxHash64(llvm::StringRef Data);
 uint64_t xxHash64(llvm::ArrayRef<uint8_t> Data);
+
+/// XXH3 is much faster than XXH64 on all but the shortest inputs. Inputs
+/// larger than 240 bytes are hashed with SSE2 or AVX2 kernels when the host
+/// supports them; the result does not depend on the kernel.
+uint64_t xxh3_64bits(llvm::ArrayRef<uint8_t> Data);
+inline uint64_t xxh3_64bits(llvm::StringRef Data) {
+  return xxh3_64bits(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(Data.data()), Data.size()));
+}
+
+struct XXH128_hash_t {
+  uint64_t low64;
+  uint64_t high64;
+
+  bool operator==(const XXH128_hash_t &RHS) const {
+    return low64 == RHS.low64 && high64 == RHS.high64;
+  }
+  bool operator!=(const XXH128_hash_t &RHS) const { return !(*this == RHS); }
+};
+
+XXH128_hash_t xxh3_128bits(llvm::ArrayRef<uint8_t> Data);
+inline XXH128_hash_t xxh3_128bits(llvm::StringRef Data) {
+  return xxh3_128bits(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(Data.data()), Data.size()));
+}
 }
 
 #endif
@@ -0,0 +1,83 @@
+//===- Testing/Support/IRHelpers.h ------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TESTING_SUPPORT_IRHELPERS_H
+#define LLVM_TESTING_SUPPORT_IRHELPERS_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+class BasicBlock;
+
+namespace unittest {
+
+/// Parse the textual IR \p IR into a module of \p Context. Parse errors are
+/// printed to stderr, prefixed with \p ProgName.
+///
+/// Unless \p IR already defines it, the module gets the counter that the IDs
+/// of new instructions are taken from (see Module::getNewID), so tests can
+/// run transforms that create or clone instructions.
+std::unique_ptr<Module> parseModuleWithIDs(StringRef IR, LLVMContext &Context,
+                                           StringRef ProgName);
+
+/// Return the basic block of \p F named \p Name, or null if there is none.
+BasicBlock *getBasicBlockByName(Function &F, StringRef Name);
+
+/// A fixture for tests that run a pass over IR parsed from text.
+///
+/// The loop, function and module analysis managers are connected by their
+/// proxies, and have the analyses of the Analysis library registered, with
+/// BasicAA as the only alias analysis. The analyses are only computed when a
+/// pass asks for them.
+class PassTest : public testing::Test {
+protected:
+  /// Parse errors are prefixed with \p ProgName. The passes see the target
+  /// described by \p TIRA, which by default has no target specific costs.
+  explicit PassTest(StringRef ProgName,
+                    TargetIRAnalysis TIRA = TargetIRAnalysis());
+
+  std::unique_ptr<Module> parse(StringRef IR) {
+    return parseModuleWithIDs(IR, Context, ProgName);
+  }
+
+  /// Run \p P on \p F and verify \p F. \returns true if \p P changed it.
+  template <typename PassT> bool runPass(PassT &&P, Function &F) {
+    PreservedAnalyses PA = P.run(F, FAM);
+    EXPECT_FALSE(verifyFunction(F, &errs()));
+    return !PA.areAllPreserved();
+  }
+
+  /// Run \p P on \p M and verify \p M. \returns true if \p P changed it.
+  template <typename PassT> bool runPass(PassT &&P, Module &M) {
+    PreservedAnalyses PA = P.run(M, MAM);
+    EXPECT_FALSE(verifyModule(M, &errs()));
+    return !PA.areAllPreserved();
+  }
+
+  std::string ProgName;
+  LLVMContext Context;
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  ModuleAnalysisManager MAM;
+};
+
+} // namespace unittest
+} // namespace llvm
+
+#endif
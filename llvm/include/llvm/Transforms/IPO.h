@@ -162,6 +162,13 @@ Pass *createOpenMPOptLegacyPass();
 ///
 ModulePass *createIPSCCPPass();
 
+//===----------------------------------------------------------------------===//
+/// createFunctionSpecializationPass - This pass clones functions for the
+/// constant arguments that their call sites pass, when the clone is expected
+/// to be profitable.
+///
+ModulePass *createFunctionSpecializationPass();
+
 //===----------------------------------------------------------------------===//
 //
 /// createLoopExtractorPass - This pass extracts all natural loops from the
@@ -26,6 +26,8 @@
 
 namespace llvm {
 
+class BitVector;
+class FlatSummaryIndex;
 class Module;
 
 /// The function importer is automatically importing function from other modules
@@ -100,6 +102,10 @@ public:
   /// The set contains an entry for every global value the module exports.
   using ExportSetTy = DenseSet<ValueInfo>;
 
+  /// The set contains the GUID of every global value the module exports, when
+  /// computed over a FlatSummaryIndex.
+  using GUIDExportSetTy = DenseSet<GlobalValue::GUID>;
+
   /// A function of this type is used to load modules referenced by the index.
   using ModuleLoaderTy =
       std::function<Expected<std::unique_ptr<Module>>(StringRef Identifier)>;
@@ -149,6 +155,14 @@ void ComputeCrossModuleImport(
     StringMap<FunctionImporter::ImportMapTy> &ImportLists,
     StringMap<FunctionImporter::ExportSetTy> &ExportLists);
 
+/// Compute all the imports and exports for every module in the flat \p Index,
+/// as above. \p LiveValues contains the live values of the index, as computed
+/// by computeDeadSymbols over it.
+void ComputeCrossModuleImport(
+    const FlatSummaryIndex &Index, const BitVector &LiveValues,
+    StringMap<FunctionImporter::ImportMapTy> &ImportLists,
+    StringMap<FunctionImporter::GUIDExportSetTy> &ExportLists);
+
 /// Compute all the imports for the given module using the Index.
 ///
 /// \p ImportList will be populated with a map that can be passed to
@@ -181,6 +195,15 @@ void computeDeadSymbols(
     const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
     function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing);
 
+/// Compute the dead symbols of the flat \p Index, as above. The index is
+/// read-only, so \p LiveValues is set instead to the values that are live,
+/// indexed by their ID.
+void computeDeadSymbols(
+    const FlatSummaryIndex &Index,
+    const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
+    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
+    BitVector &LiveValues);
+
 /// Compute dead symbols and run constant propagation in combined index
 /// after that.
 void computeDeadSymbolsWithConstProp(
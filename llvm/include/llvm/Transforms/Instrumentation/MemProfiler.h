@@ -40,6 +40,22 @@ public:
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
 };
 
+/// Use a memory profile to mark the allocation calls that are hot or cold.
+///
+/// The allocation sites of the indexed profile are matched to the allocation
+/// calls by the inline call stack of their debug location. A call that matches
+/// allocations which are all cold, i.e. long lived and rarely accessed, or all
+/// hot, i.e. densely accessed, gets a "memprof" call site attribute with the
+/// value "cold" or "hot", which the allocator can be told about.
+class MemProfUsePass : public PassInfoMixin<MemProfUsePass> {
+public:
+  explicit MemProfUsePass(std::string MemoryProfileFile = "");
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+
+private:
+  std::string MemoryProfileFileName;
+};
+
 // Insert MemProfiler instrumentation
 FunctionPass *createMemProfilerFunctionPass();
 ModulePass *createModuleMemProfilerLegacyPassPass();
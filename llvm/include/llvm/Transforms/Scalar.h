@@ -484,6 +484,12 @@ FunctionPass *createLoopDistributePass();
 //
 FunctionPass *createLoopFusePass();
 
+//===----------------------------------------------------------------------===//
+//
+// LoopFlatten - Flatten nested counted loops into a single loop.
+//
+FunctionPass *createLoopFlattenPass();
+
 //===----------------------------------------------------------------------===//
 //
 // LoopLoadElimination - Perform loop-aware load elimination.
@@ -48,6 +48,14 @@ struct AnalysisResultsForFn {
 bool runIPSCCP(Module &M, const DataLayout &DL,
                std::function<const TargetLibraryInfo &(Function &)> GetTLI,
                function_ref<AnalysisResultsForFn(Function &)> getAnalysis);
+
+/// Solve interprocedural SCCP over \p M without changing it, and call
+/// \p Visit for every argument of a direct call in an executable block that
+/// the solver found to be a constant.
+void findIPSCCPConstantArguments(
+    Module &M, const DataLayout &DL,
+    std::function<const TargetLibraryInfo &(Function &)> GetTLI,
+    function_ref<void(CallBase &, unsigned, Constant *)> Visit);
 } // end namespace llvm
 
 #endif // LLVM_TRANSFORMS_SCALAR_SCCP_H
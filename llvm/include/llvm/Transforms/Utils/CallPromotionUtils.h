@@ -14,11 +14,15 @@
 #ifndef LLVM_TRANSFORMS_UTILS_CALLPROMOTIONUTILS_H
 #define LLVM_TRANSFORMS_UTILS_CALLPROMOTIONUTILS_H
 
+#include "llvm/ADT/ArrayRef.h"
+
 namespace llvm {
 class CallBase;
 class CastInst;
+class Constant;
 class Function;
 class MDNode;
+class Value;
 
 /// Return true if the given indirect call site can be made to call \p Callee.
 ///
@@ -50,6 +54,18 @@ CallBase &promoteCall(CallBase &CB, Function *Callee,
 CallBase &promoteCallWithIfThenElse(CallBase &CB, Function *Callee,
                                     MDNode *BranchWeights = nullptr);
 
+/// Promote the given virtual call site to conditionally call \p Callee.
+///
+/// This function is like promoteCallWithIfThenElse, but the "if" condition
+/// compares the vtable pointer \p VPtr the function pointer was loaded from to
+/// \p AddressPoints, the address points of the vtables whose slot holds
+/// \p Callee, rather than the loaded function pointer to \p Callee. The load
+/// of the function pointer is sunk into the "else" block if nothing else uses
+/// it and nothing between it and the call site writes to memory.
+CallBase &promoteCallWithVTableCmp(CallBase &CB, Value *VPtr, Function *Callee,
+                                   ArrayRef<Constant *> AddressPoints,
+                                   MDNode *BranchWeights = nullptr);
+
 /// Try to promote (devirtualize) a virtual call on an Alloca. Return true on
 /// success.
 ///
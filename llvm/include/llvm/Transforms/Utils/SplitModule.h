@@ -25,6 +25,12 @@ class Module;
 /// Splits the module M into N linkable partitions. The function ModuleCallback
 /// is called N times passing each individual partition as the MPart argument.
 ///
+/// If PreserveOrder is set, each partition holds a contiguous run of the
+/// functions of M, balanced by instruction count, and the partitions are
+/// passed to ModuleCallback in order. Linking them in that order keeps the
+/// function layout of M. Otherwise functions are distributed by a hash of
+/// their names.
+///
 /// FIXME: This function does not deal with the somewhat subtle symbol
 /// visibility issues around module splitting, including (but not limited to):
 ///
@@ -35,7 +41,7 @@ class Module;
 void SplitModule(
     std::unique_ptr<Module> M, unsigned N,
     function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback,
-    bool PreserveLocals = false);
+    bool PreserveLocals = false, bool PreserveOrder = false);
 
 } // end namespace llvm
 
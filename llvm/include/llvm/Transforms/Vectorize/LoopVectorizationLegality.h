@@ -314,6 +314,22 @@ public:
   // Returns true if the NoNaN attribute is set on the function.
   bool hasFunNoNaNAttr() const { return HasFunNoNaNAttr; }
 
+  /// Returns true if the loop has an early exit besides the latch, see
+  /// getEarlyExitingBlock.
+  bool hasEarlyExit() const { return EarlyExitingBlock != nullptr; }
+
+  /// Returns the block that exits the loop before the latch when a
+  /// data-dependent condition holds, or null if the latch is the only exiting
+  /// block. The vector loop leaves through the middle block only; the scalar
+  /// loop redoes the iteration that takes the early exit.
+  BasicBlock *getEarlyExitingBlock() const { return EarlyExitingBlock; }
+
+  /// Returns true if the loads of the loop with an early exit are
+  /// dereferenceable in every iteration of the vector loop with \p VF lanes.
+  /// That loop runs whole vectors up to the trip count of the latch, so it
+  /// reads past the iteration that takes the early exit.
+  bool canSpeculateEarlyExitLoads(unsigned VF) const;
+
   /// Returns all assume calls in predicated blocks. They need to be dropped
   /// when flattening the CFG.
   const SmallPtrSetImpl<Instruction *> &getConditionalAssumes() const {
@@ -343,6 +359,17 @@ private:
   /// If false, good old LV code.
   bool canVectorizeLoopCFG(Loop *Lp, bool UseVPlanNativePath);
 
+  /// Return true if the loop has a single early exit besides its latch, which
+  /// dominates the latch and leaves the loop on a conditional branch, and if
+  /// the latch has a computable exit count. Records the early exiting block.
+  bool findEarlyExit();
+
+  /// Return true if the loop with an early exit may execute the iterations
+  /// after the one taking the exit without changing the program behavior,
+  /// i.e. it has no side effects, only reads dereferenceable memory and has no
+  /// reductions or recurrences.
+  bool canVectorizeEarlyExit();
+
   /// Check if a single basic block loop is vectorizable.
   /// At this point we know that this is a loop with a constant trip count
   /// and we only need to check individual instructions.
@@ -455,6 +482,15 @@ private:
   /// first-order recurrences.
   DenseMap<Instruction *, Instruction *> SinkAfter;
 
+  /// The block with the early exit of the loop, if any.
+  BasicBlock *EarlyExitingBlock = nullptr;
+
+  /// The constant bound of the trip count of the latch of the loop with an
+  /// early exit, and the loads that the vector loop executes past the early
+  /// exit.
+  unsigned EarlyExitMaxTripCount = 0;
+  SmallVector<LoadInst *, 4> EarlyExitLoads;
+
   /// Holds the widest induction type encountered.
   Type *WidestIndTy = nullptr;
 
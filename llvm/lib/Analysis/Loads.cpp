@@ -195,6 +195,16 @@ static bool AreEquivalentAddressValues(const Value *A, const Value *B) {
 bool llvm::isDereferenceableAndAlignedInLoop(LoadInst *LI, Loop *L,
                                              ScalarEvolution &SE,
                                              DominatorTree &DT) {
+  // TODO: If the symbolic trip count has a small bound (max count), we might
+  // be able to prove safety.
+  return isDereferenceableAndAlignedInLoop(LI, L, SE, DT,
+                                           SE.getSmallConstantTripCount(L));
+}
+
+bool llvm::isDereferenceableAndAlignedInLoop(LoadInst *LI, Loop *L,
+                                             ScalarEvolution &SE,
+                                             DominatorTree &DT,
+                                             unsigned TripCount) {
   auto &DL = LI->getModule()->getDataLayout();
   Value *Ptr = LI->getPointerOperand();
 
@@ -222,13 +232,10 @@ bool llvm::isDereferenceableAndAlignedInLoop(LoadInst *LI, Loop *L,
   if (Step->getAPInt() != EltSize)
     return false;
 
-  // TODO: If the symbolic trip count has a small bound (max count), we might
-  // be able to prove safety.
-  auto TC = SE.getSmallConstantTripCount(L);
-  if (!TC)
+  if (!TripCount)
     return false;
 
-  const APInt AccessSize = TC * EltSize;
+  const APInt AccessSize = TripCount * EltSize;
 
   auto *StartS = dyn_cast<SCEVUnknown>(AddRec->getStart());
   if (!StartS)
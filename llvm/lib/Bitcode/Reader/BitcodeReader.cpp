@@ -70,9 +70,11 @@
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <deque>
@@ -92,12 +94,212 @@ static cl::opt<bool> PrintSummaryGUIDs(
     cl::desc(
         "Print the global id for each value when reading the module summary"));
 
+static cl::opt<unsigned> FunctionBodyDecodeThreads(
+    "bitcode-decode-threads", cl::init(1), cl::Hidden,
+    cl::desc("Number of threads used to decode function bodies ahead of "
+             "their materialization"));
+
 namespace {
 
 enum {
   SWITCH_INST_MAGIC = 0x4B5 // May 2012 => 1205 => Hex
 };
 
+/// The records of a function block, decoded from the bitstream ahead of time.
+///
+/// Decoding the abbreviated records of a function body is independent of any
+/// IR, so it can happen off the main thread. The entries are later replayed
+/// in place of the stream when the body is parsed. Nested blocks are not
+/// decoded; only their position is remembered so that they can be parsed from
+/// the stream as usual.
+class DecodedFunctionBlock {
+  struct Entry {
+    enum { Record, SubBlock, EndBlock } Kind;
+    /// The record code, or the block ID of a nested block.
+    unsigned ID;
+    /// For records, the index of the first operand in Ops. For nested blocks
+    /// and the end of the block, the bit at which the stream resumes.
+    uint64_t Pos;
+    /// For records, the number of operands.
+    unsigned NumOps;
+  };
+
+  std::vector<Entry> Entries;
+  std::vector<uint64_t> Ops;
+  size_t NextEntry = 0;
+
+public:
+  /// Decode the function block whose header starts at \p BitNo.
+  static Expected<std::unique_ptr<DecodedFunctionBlock>>
+  decode(BitstreamCursor Stream, uint64_t BitNo) {
+    auto Block = std::make_unique<DecodedFunctionBlock>();
+    if (Error Err = Stream.JumpToBit(BitNo))
+      return std::move(Err);
+    if (Error Err = Stream.EnterSubBlock(bitc::FUNCTION_BLOCK_ID))
+      return std::move(Err);
+
+    SmallVector<uint64_t, 64> Record;
+    while (true) {
+      uint64_t EntryBit = Stream.GetCurrentBitNo();
+      Expected<BitstreamEntry> MaybeEntry = Stream.advance();
+      if (!MaybeEntry)
+        return MaybeEntry.takeError();
+      BitstreamEntry Entry = MaybeEntry.get();
+
+      switch (Entry.Kind) {
+      case BitstreamEntry::Error:
+        return createStringError(std::errc::illegal_byte_sequence,
+                                 "Malformed block");
+      case BitstreamEntry::EndBlock:
+        Block->Entries.push_back({Entry::EndBlock, 0, EntryBit, 0});
+        return std::move(Block);
+      case BitstreamEntry::SubBlock:
+        Block->Entries.push_back(
+            {Entry::SubBlock, Entry.ID, Stream.GetCurrentBitNo(), 0});
+        if (Error Err = Stream.SkipBlock())
+          return std::move(Err);
+        break;
+      case BitstreamEntry::Record: {
+        Record.clear();
+        Expected<unsigned> MaybeCode = Stream.readRecord(Entry.ID, Record);
+        if (!MaybeCode)
+          return MaybeCode.takeError();
+        Block->Entries.push_back({Entry::Record, MaybeCode.get(),
+                                  Block->Ops.size(), unsigned(Record.size())});
+        Block->Ops.insert(Block->Ops.end(), Record.begin(), Record.end());
+        break;
+      }
+      }
+    }
+  }
+
+  /// Return the next entry of the block, like BitstreamCursor::advance.
+  ///
+  /// \p Stream is the cursor inside the function block; it is moved to the
+  /// start of nested blocks so that they can be read or skipped from there,
+  /// and it reads the end of the block itself to leave the block's scope.
+  Expected<BitstreamEntry> advance(BitstreamCursor &Stream) {
+    const Entry &E = Entries[NextEntry];
+    switch (E.Kind) {
+    case Entry::SubBlock:
+      ++NextEntry;
+      if (Error Err = Stream.JumpToBit(E.Pos))
+        return std::move(Err);
+      return BitstreamEntry::getSubBlock(E.ID);
+    case Entry::EndBlock:
+      if (Error Err = Stream.JumpToBit(E.Pos))
+        return std::move(Err);
+      return Stream.advance();
+    case Entry::Record:
+      // The record itself is handed out by readRecord.
+      break;
+    }
+    return BitstreamEntry::getRecord(0);
+  }
+
+  /// Return the next record of the block, like BitstreamCursor::readRecord.
+  unsigned readRecord(SmallVectorImpl<uint64_t> &Record) {
+    const Entry &E = Entries[NextEntry++];
+    assert(E.Kind == Entry::Record && "Not at a record");
+    Record.append(Ops.begin() + E.Pos, Ops.begin() + E.Pos + E.NumOps);
+    return E.ID;
+  }
+};
+
+/// Decodes function blocks on a thread pool ahead of their materialization.
+///
+/// Bodies are decoded in the order they were enqueued. At most a bounded
+/// number of them are in flight or decoded and waiting, so that decoded
+/// records never pile up far ahead of the main thread, which builds the IR
+/// one function at a time. When a body is requested that is not in the
+/// window, the window moves past it, and the decoded bodies that were skipped
+/// over are dropped and queued again behind the others.
+class FunctionBodyPrefetcher {
+  struct Job {
+    uint64_t BitNo;
+    std::shared_future<void> Done;
+    std::unique_ptr<DecodedFunctionBlock> Block;
+  };
+
+  ThreadPool Pool;
+  /// A copy of the reader's cursor in the module block scope.
+  BitstreamCursor Stream;
+  std::deque<std::pair<Function *, uint64_t>> Pending;
+  DenseMap<Function *, std::unique_ptr<Job>> Jobs;
+  unsigned MaxInFlight;
+
+  void submitPending() {
+    while (!Pending.empty() && Jobs.size() < MaxInFlight) {
+      Function *F = Pending.front().first;
+      uint64_t BitNo = Pending.front().second;
+      Pending.pop_front();
+      Job *J = (Jobs[F] = std::make_unique<Job>()).get();
+      J->BitNo = BitNo;
+      J->Done = Pool.async([this, J, BitNo] {
+        // Any malformed block is diagnosed again when the body is parsed
+        // from the stream instead.
+        Expected<std::unique_ptr<DecodedFunctionBlock>> Block =
+            DecodedFunctionBlock::decode(Stream, BitNo);
+        if (Block)
+          J->Block = std::move(Block.get());
+        else
+          consumeError(Block.takeError());
+      });
+    }
+  }
+
+  /// \p F is about to be parsed from the stream: never decode it, and
+  /// continue with the bodies that follow it.
+  void skipTo(Function *F) {
+    auto It = llvm::find_if(Pending, [F](const std::pair<Function *, uint64_t>
+                                             &P) { return P.first == F; });
+    if (It == Pending.end())
+      return;
+    std::rotate(Pending.begin(), std::next(It), Pending.end());
+    Pending.pop_back();
+
+    // Every submitted body comes before F; free the window of those already
+    // decoded. The ones still being decoded are dropped when taken over
+    // again.
+    for (auto I = Jobs.begin(), E = Jobs.end(); I != E;) {
+      auto Cur = I++;
+      Job &J = *Cur->second;
+      if (J.Done.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready)
+        continue;
+      Pending.emplace_back(Cur->first, J.BitNo);
+      Jobs.erase(Cur);
+    }
+  }
+
+public:
+  FunctionBodyPrefetcher(unsigned Threads, const BitstreamCursor &Stream,
+                         ArrayRef<std::pair<Function *, uint64_t>> Bodies)
+      : Pool(hardware_concurrency(Threads)), Stream(Stream),
+        Pending(Bodies.begin(), Bodies.end()),
+        MaxInFlight(4 * Pool.getThreadCount()) {
+    submitPending();
+  }
+
+  ~FunctionBodyPrefetcher() { Pool.wait(); }
+
+  /// Take the decoded body of \p F, waiting for it if needed. Returns null if
+  /// the body was not prefetched or could not be decoded.
+  std::unique_ptr<DecodedFunctionBlock> take(Function *F) {
+    auto It = Jobs.find(F);
+    if (It == Jobs.end()) {
+      skipTo(F);
+      submitPending();
+      return nullptr;
+    }
+    std::unique_ptr<Job> J = std::move(It->second);
+    Jobs.erase(It);
+    J->Done.wait();
+    submitPending();
+    return std::move(J->Block);
+  }
+};
+
 } // end anonymous namespace
 
 static Error error(const Twine &Message) {
@@ -559,6 +761,9 @@ class BitcodeReader : public BitcodeReaderBase, public GVMaterializer {
   /// (e.g.) blockaddress forward references.
   bool WillMaterializeAllForwardRefs = false;
 
+  /// Decodes function bodies ahead of their materialization, if enabled.
+  std::unique_ptr<FunctionBodyPrefetcher> Prefetcher;
+
   bool StripDebugInfo = false;
   TBAAVerifier TBAAVerifyHelper;
 
@@ -756,6 +961,7 @@ private:
   Error rememberAndSkipMetadata();
   Error typeCheckLoadStoreInst(Type *ValType, Type *PtrType);
   Error parseFunctionBody(Function *F);
+  Error prefetchFunctionBodies(unsigned Threads, Function *Next = nullptr);
   Error globalCleanup();
   Error resolveGlobalAndIndirectSymbolInits();
   Error parseUseLists();
@@ -3809,11 +4015,17 @@ Error BitcodeReader::parseFunctionBody(Function *F) {
 
   std::vector<OperandBundleDef> OperandBundles;
 
+  // Replay the records of this body if they have been decoded ahead of time.
+  std::unique_ptr<DecodedFunctionBlock> Decoded;
+  if (Prefetcher)
+    Decoded = Prefetcher->take(F);
+
   // Read all the records.
   SmallVector<uint64_t, 64> Record;
 
   while (true) {
-    Expected<llvm::BitstreamEntry> MaybeEntry = Stream.advance();
+    Expected<llvm::BitstreamEntry> MaybeEntry =
+        Decoded ? Decoded->advance(Stream) : Stream.advance();
     if (!MaybeEntry)
       return MaybeEntry.takeError();
     llvm::BitstreamEntry Entry = MaybeEntry.get();
@@ -3865,7 +4077,9 @@ Error BitcodeReader::parseFunctionBody(Function *F) {
     Record.clear();
     Instruction *I = nullptr;
     Type *FullTy = nullptr;
-    Expected<unsigned> MaybeBitCode = Stream.readRecord(Entry.ID, Record);
+    Expected<unsigned> MaybeBitCode = Decoded
+                                          ? Decoded->readRecord(Record)
+                                          : Stream.readRecord(Entry.ID, Record);
     if (!MaybeBitCode)
       return MaybeBitCode.takeError();
     switch (unsigned BitCode = MaybeBitCode.get()) {
@@ -5354,6 +5568,35 @@ OutOfRecordLoop:
   return Error::success();
 }
 
+/// Locate every function body still to be materialized, and start decoding
+/// them on \p Threads threads in module order. If \p Next is given, it is
+/// about to be parsed: it is left out, and decoding starts after it.
+Error BitcodeReader::prefetchFunctionBodies(unsigned Threads, Function *Next) {
+  std::vector<std::pair<Function *, uint64_t>> Bodies;
+  size_t NextIdx = 0;
+  for (Function &F : *TheModule) {
+    if (&F == Next)
+      NextIdx = Bodies.size();
+    if (!F.isMaterializable() || &F == Next)
+      continue;
+    auto DFII = DeferredFunctionInfo.find(&F);
+    if (DFII == DeferredFunctionInfo.end())
+      continue;
+    if (DFII->second == 0)
+      if (Error Err = findFunctionInStream(&F, DFII))
+        return Err;
+    Bodies.emplace_back(&F, DFII->second);
+  }
+  // Lazily materialized functions are often requested in module order, so
+  // start with the bodies that follow the one being parsed.
+  std::rotate(Bodies.begin(), Bodies.begin() + NextIdx, Bodies.end());
+
+  if (Bodies.size() > 1)
+    Prefetcher =
+        std::make_unique<FunctionBodyPrefetcher>(Threads, Stream, Bodies);
+  return Error::success();
+}
+
 /// Find the function body in the bitcode stream
 Error BitcodeReader::findFunctionInStream(
     Function *F,
@@ -5402,6 +5645,12 @@ Error BitcodeReader::materialize(GlobalValue *GV) {
   if (Error Err = materializeMetadata())
     return Err;
 
+  if (FunctionBodyDecodeThreads > 1 && !Prefetcher) {
+    if (Error Err = prefetchFunctionBodies(FunctionBodyDecodeThreads, F))
+      return Err;
+    DFII = DeferredFunctionInfo.find(F);
+  }
+
   // Move the bit stream to the saved position of the deferred function body.
   if (Error JumpFailed = Stream.JumpToBit(DFII->second))
     return JumpFailed;
@@ -5490,12 +5739,17 @@ Error BitcodeReader::materializeModule() {
   // Promise to materialize all forward references.
   WillMaterializeAllForwardRefs = true;
 
+  if (FunctionBodyDecodeThreads > 1 && !Prefetcher)
+    if (Error Err = prefetchFunctionBodies(FunctionBodyDecodeThreads))
+      return Err;
+
   // Iterate over the module, deserializing any functions that are still on
   // disk.
   for (Function &F : *TheModule) {
     if (Error Err = materialize(&F))
       return Err;
   }
+  Prefetcher.reset();
   // At this point, if there are any function bodies, parse the rest of
   // the bits in the module past the last function block we have recorded
   // through either lazy scanning or the VST.
@@ -0,0 +1,273 @@
+//===-- FlatSummaryIndex.cpp - Flat ThinLTO summary index -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the reader and the builder of the flat summary index.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/FlatSummaryIndex.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::flatsummary;
+
+static Error malformed(const Twine &Message) {
+  return createStringError(inconvertibleErrorCode(),
+                           "malformed flat summary index: " + Message);
+}
+
+// Take the next Count records of type T at Ptr.
+template <class T>
+static ArrayRef<T> takeArray(const char *&Ptr, uint64_t Count) {
+  ArrayRef<T> Array(reinterpret_cast<const T *>(Ptr), Count);
+  Ptr += Count * sizeof(T);
+  return Array;
+}
+
+Expected<FlatSummaryIndex> FlatSummaryIndex::create(MemoryBufferRef Buffer) {
+  StringRef Data = Buffer.getBuffer();
+  if (Data.size() < sizeof(Header))
+    return malformed("truncated header");
+  const auto *H = reinterpret_cast<const Header *>(Data.data());
+  if (H->Magic != Magic)
+    return malformed("bad magic");
+  if (H->Version != Version)
+    return malformed("unsupported version " + Twine(H->Version));
+
+  uint64_t NumValues = H->NumValues, NumSummaries = H->NumSummaries,
+           NumCalls = H->NumCalls, NumRefs = H->NumRefs,
+           NumModules = H->NumModules;
+  uint64_t Size =
+      sizeof(Header) +
+      NumValues * (sizeof(support::ulittle64_t) + sizeof(ValueEntry)) +
+      NumSummaries * sizeof(SummaryEntry) + NumCalls * sizeof(CallEntry) +
+      NumRefs * sizeof(support::ulittle32_t) +
+      NumModules * sizeof(ModuleEntry) + H->StringTableSize;
+  if (Size != Data.size())
+    return malformed("expected " + Twine(Size) + " bytes, got " +
+                     Twine(Data.size()));
+
+  FlatSummaryIndex Index;
+  const char *Ptr = Data.data() + sizeof(Header);
+  Index.GUIDs = takeArray<support::ulittle64_t>(Ptr, NumValues);
+  Index.Values = takeArray<ValueEntry>(Ptr, NumValues);
+  Index.Summaries = takeArray<SummaryEntry>(Ptr, NumSummaries);
+  Index.Calls = takeArray<CallEntry>(Ptr, NumCalls);
+  Index.Refs = takeArray<support::ulittle32_t>(Ptr, NumRefs);
+  Index.Modules = takeArray<ModuleEntry>(Ptr, NumModules);
+  Index.StringTable = StringRef(Ptr, H->StringTableSize);
+
+  // The analyses index the arrays with the IDs the records contain, so check
+  // every one of them once here.
+  if (NumSummaries && !NumValues)
+    return malformed("summaries without values");
+  for (ValueID V = 0; V != NumValues; ++V) {
+    if (V && Index.GUIDs[V] <= Index.GUIDs[V - 1])
+      return malformed("unsorted GUID table");
+    const ValueEntry &Val = Index.Values[V];
+    uint32_t End = V + 1 == NumValues
+                       ? uint32_t(NumSummaries)
+                       : uint32_t(Index.Values[V + 1].SummaryBegin);
+    if ((V == 0 && Val.SummaryBegin != 0) || Val.SummaryBegin > End)
+      return malformed("summaries of value " + Twine(V) + " out of range");
+    if (Val.IndirectTarget != NoID && Val.IndirectTarget >= NumValues)
+      return malformed("indirect call target of value " + Twine(V) +
+                       " out of range");
+    for (SummaryID S = Val.SummaryBegin; S != End; ++S)
+      if (Index.Summaries[S].Value != V)
+        return malformed("summary " + Twine(S) + " has the wrong value");
+  }
+
+  for (SummaryID S = 0; S != NumSummaries; ++S) {
+    const SummaryEntry &Sum = Index.Summaries[S];
+    if (Sum.Module >= NumModules)
+      return malformed("module of summary " + Twine(S) + " out of range");
+    if (Sum.Kind > GlobalValueSummary::GlobalVarKind)
+      return malformed("bad kind of summary " + Twine(S));
+    if (Sum.Linkage > GlobalValue::CommonLinkage)
+      return malformed("bad linkage of summary " + Twine(S));
+    if (Sum.Kind == GlobalValueSummary::AliasKind &&
+        Sum.Aliasee != NoID &&
+        (Sum.Aliasee >= NumSummaries ||
+         Index.Summaries[Sum.Aliasee].Kind == GlobalValueSummary::AliasKind))
+      return malformed("bad aliasee of summary " + Twine(S));
+    uint32_t CallEnd =
+        S + 1 == NumSummaries ? uint32_t(NumCalls)
+                              : uint32_t(Index.Summaries[S + 1].CallBegin);
+    uint32_t RefEnd = S + 1 == NumSummaries
+                          ? uint32_t(NumRefs)
+                          : uint32_t(Index.Summaries[S + 1].RefBegin);
+    if ((S == 0 && Sum.CallBegin != 0) || Sum.CallBegin > CallEnd)
+      return malformed("calls of summary " + Twine(S) + " out of range");
+    if ((S == 0 && Sum.RefBegin != 0) || Sum.RefBegin > RefEnd)
+      return malformed("references of summary " + Twine(S) + " out of range");
+  }
+  if ((NumCalls && !NumSummaries) || (NumRefs && !NumSummaries))
+    return malformed("edges without summaries");
+
+  for (const CallEntry &C : Index.Calls)
+    if (C.Callee >= NumValues ||
+        C.Hotness > uint32_t(CalleeInfo::HotnessType::Critical))
+      return malformed("bad call");
+  for (uint32_t Ref : Index.Refs)
+    if (Ref >= NumValues)
+      return malformed("reference out of range");
+  for (const ModuleEntry &M : Index.Modules)
+    if (M.NameOffset > Index.StringTable.size() ||
+        M.NameSize > Index.StringTable.size() - M.NameOffset)
+      return malformed("module path out of range");
+  return std::move(Index);
+}
+
+FlatSummaryIndex::ValueID
+FlatSummaryIndex::findValue(GlobalValue::GUID GUID) const {
+  auto It = llvm::partition_point(
+      GUIDs, [GUID](support::ulittle64_t G) { return G < GUID; });
+  if (It == GUIDs.end() || *It != GUID)
+    return NoID;
+  return It - GUIDs.begin();
+}
+
+ArrayRef<CallEntry> FlatSummaryIndex::calls(SummaryID S) const {
+  uint32_t End = S + 1 == Summaries.size()
+                     ? uint32_t(Calls.size())
+                     : uint32_t(Summaries[S + 1].CallBegin);
+  return Calls.slice(Summaries[S].CallBegin, End - Summaries[S].CallBegin);
+}
+
+ArrayRef<support::ulittle32_t> FlatSummaryIndex::refs(SummaryID S) const {
+  uint32_t End = S + 1 == Summaries.size()
+                     ? uint32_t(Refs.size())
+                     : uint32_t(Summaries[S + 1].RefBegin);
+  return Refs.slice(Summaries[S].RefBegin, End - Summaries[S].RefBegin);
+}
+
+FlatSummaryIndexBuilder::FlatSummaryIndexBuilder(
+    const ModuleSummaryIndex &Index) {
+  // Number the modules in the order of their paths, and the values in the
+  // order of their GUIDs, which is the one of the index.
+  std::vector<StringRef> ModulePaths;
+  for (const auto &ModulePath : Index.modulePaths())
+    ModulePaths.push_back(ModulePath.first());
+  llvm::sort(ModulePaths);
+  StringMap<uint32_t> ModuleIDs;
+  for (StringRef ModulePath : ModulePaths) {
+    ModuleIDs[ModulePath] = Modules.size();
+    ModuleEntry M;
+    M.NameOffset = StringTable.size();
+    M.NameSize = ModulePath.size();
+    Modules.push_back(M);
+    StringTable += ModulePath;
+  }
+
+  DenseMap<GlobalValue::GUID, uint32_t> ValueIDs;
+  DenseMap<const GlobalValueSummary *, uint32_t> SummaryIDs;
+  for (const auto &Entry : Index) {
+    ValueIDs[Entry.first] = GUIDs.size();
+    GUIDs.push_back(support::ulittle64_t(Entry.first));
+    for (const auto &S : Entry.second.SummaryList) {
+      uint32_t ID = SummaryIDs.size();
+      SummaryIDs[S.get()] = ID;
+    }
+  }
+
+  for (const auto &Entry : Index) {
+    ValueEntry V;
+    V.SummaryBegin = Summaries.size();
+    V.IndirectTarget = NoID;
+    if (Entry.second.SummaryList.empty())
+      if (GlobalValue::GUID GUID = Index.getGUIDFromOriginalID(Entry.first)) {
+        auto It = ValueIDs.find(GUID);
+        if (It != ValueIDs.end())
+          V.IndirectTarget = It->second;
+      }
+    Values.push_back(V);
+
+    for (const auto &S : Entry.second.SummaryList) {
+      SummaryEntry Sum;
+      Sum.Value = ValueIDs[Entry.first];
+      Sum.Module = ModuleIDs.lookup(S->modulePath());
+      Sum.Aliasee = NoID;
+      Sum.InstCount = 0;
+      Sum.CallBegin = Calls.size();
+      Sum.RefBegin = Refs.size();
+      Sum.Kind = S->getSummaryKind();
+      Sum.Linkage = S->linkage();
+      uint16_t Flags = 0;
+      if (S->isLive())
+        Flags |= Live;
+      if (S->notEligibleToImport())
+        Flags |= NotEligibleToImport;
+
+      if (auto *AS = dyn_cast<AliasSummary>(S.get())) {
+        if (AS->hasAliasee())
+          Sum.Aliasee = SummaryIDs.lookup(&AS->getAliasee());
+      } else if (auto *FS = dyn_cast<FunctionSummary>(S.get())) {
+        Sum.InstCount = FS->instCount();
+        if (FS->fflags().NoInline)
+          Flags |= NoInline;
+        if (FS->fflags().AlwaysInline)
+          Flags |= AlwaysInline;
+        for (const auto &Edge : FS->calls()) {
+          CallEntry C;
+          C.Callee = ValueIDs.lookup(Edge.first.getGUID());
+          C.Hotness = uint32_t(Edge.second.getHotness());
+          Calls.push_back(C);
+        }
+      } else {
+        auto *GVS = cast<GlobalVarSummary>(S.get());
+        if (Index.isReadOnly(GVS))
+          Flags |= ReadOnly;
+        if (Index.isWriteOnly(GVS))
+          Flags |= WriteOnly;
+        if (Index.canImportGlobalVar(const_cast<GlobalVarSummary *>(GVS),
+                                     /* AnalyzeRefs */ true))
+          Flags |= ImportableVar;
+      }
+      for (const ValueInfo &Ref : S->refs())
+        Refs.push_back(support::ulittle32_t(ValueIDs.lookup(Ref.getGUID())));
+      Sum.Flags = Flags;
+      Summaries.push_back(Sum);
+    }
+  }
+}
+
+template <class T>
+static void writeArray(raw_ostream &OS, const std::vector<T> &Array) {
+  OS.write(reinterpret_cast<const char *>(Array.data()),
+           Array.size() * sizeof(T));
+}
+
+void FlatSummaryIndexBuilder::write(raw_ostream &OS) const {
+  Header H;
+  H.Magic = Magic;
+  H.Version = Version;
+  H.NumModules = Modules.size();
+  H.NumValues = Values.size();
+  H.NumSummaries = Summaries.size();
+  H.NumCalls = Calls.size();
+  H.NumRefs = Refs.size();
+  H.StringTableSize = StringTable.size();
+  OS.write(reinterpret_cast<const char *>(&H), sizeof(H));
+  writeArray(OS, GUIDs);
+  writeArray(OS, Values);
+  writeArray(OS, Summaries);
+  writeArray(OS, Calls);
+  writeArray(OS, Refs);
+  writeArray(OS, Modules);
+  OS << StringTable;
+}
+
+std::unique_ptr<MemoryBuffer> FlatSummaryIndexBuilder::writeBuffer() const {
+  std::string Data;
+  raw_string_ostream OS(Data);
+  write(OS);
+  return MemoryBuffer::getMemBufferCopy(OS.str());
+}
@@ -104,6 +104,11 @@ ConstantAsMetadata* Module::getNewID(){
   AAA++;
   Type* T = Type::getInt64Ty(getContext());
   Constant* K = ConstantInt::get(T, AAA);
+  //A distinct counter belongs to this module only, so bump it in place
+  if (N->isDistinct()) {
+    N->replaceOperandWith(0, ConstantAsMetadata::get(K));
+    return ConstantAsMetadata::get(C);
+  }
   MDNode* New = MDNode::get(getContext(), ConstantAsMetadata::get(K));
   NMD->setOperand(0, New);
   return ConstantAsMetadata::get(C);
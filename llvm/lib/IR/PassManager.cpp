@@ -10,6 +10,8 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/PassManagerImpl.h"
+#include "llvm/Support/ThreadPool.h"
+#include <atomic>
 
 using namespace llvm;
 
@@ -91,6 +93,22 @@ bool FunctionAnalysisManagerModuleProxy::Result::invalidate(
 }
 } // namespace llvm
 
+void llvm::detail::parallelForEachFunctionIndex(
+    size_t NumItems, unsigned Threads, function_ref<void(size_t)> Body) {
+  ThreadPool Pool(hardware_concurrency(Threads));
+
+  // Functions vary wildly in size, so rather than statically partitioning the
+  // indices let each worker grab the next one as soon as it is done.
+  std::atomic<size_t> NextItem(0);
+  unsigned Workers = std::min<size_t>(Pool.getThreadCount(), NumItems);
+  for (unsigned I = 0; I != Workers; ++I)
+    Pool.async([&] {
+      for (size_t Idx = NextItem++; Idx < NumItems; Idx = NextItem++)
+        Body(Idx);
+    });
+  Pool.wait();
+}
+
 AnalysisSetKey CFGAnalyses::SetKey;
 
 AnalysisSetKey PreservedAnalyses::AllAnalysesKey;
@@ -12,6 +12,7 @@
 
 #include "llvm/LTO/Caching.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CachePruning.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
@@ -27,34 +28,49 @@
 using namespace llvm;
 using namespace llvm::lto;
 
+/// Try to add the cache entry at \p EntryPath to the link. Returns
+/// no_such_file_or_directory on a cache miss.
+static std::error_code addCacheEntry(const Twine &EntryPath,
+                                     const AddBufferFn &AddBuffer,
+                                     unsigned Task) {
+  SmallString<64> ResultPath;
+  Expected<sys::fs::file_t> FDOrErr = sys::fs::openNativeFileForRead(
+      EntryPath, sys::fs::OF_UpdateAtime, &ResultPath);
+  if (!FDOrErr)
+    return errorToErrorCode(FDOrErr.takeError());
+  ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+      MemoryBuffer::getOpenFile(*FDOrErr, EntryPath,
+                                /*FileSize=*/-1,
+                                /*RequiresNullTerminator=*/false);
+  sys::fs::closeFile(*FDOrErr);
+  if (!MBOrErr)
+    return MBOrErr.getError();
+  AddBuffer(Task, std::move(*MBOrErr));
+  return std::error_code();
+}
+
 Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
-                                            AddBufferFn AddBuffer) {
+                                            AddBufferFn AddBuffer,
+                                            CacheStats *Stats) {
   if (std::error_code EC = sys::fs::create_directories(CacheDirectoryPath))
     return errorCodeToError(EC);
 
   return [=](unsigned Task, StringRef Key) -> AddStreamFn {
     // This choice of file name allows the cache to be pruned (see pruneCache()
     // in include/llvm/Support/CachePruning.h).
-    SmallString<64> EntryPath;
-    sys::path::append(EntryPath, CacheDirectoryPath, "llvmcache-" + Key);
-    // First, see if we have a cache hit.
-    SmallString<64> ResultPath;
-    Expected<sys::fs::file_t> FDOrErr = sys::fs::openNativeFileForRead(
-        Twine(EntryPath), sys::fs::OF_UpdateAtime, &ResultPath);
-    std::error_code EC;
-    if (FDOrErr) {
-      ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
-          MemoryBuffer::getOpenFile(*FDOrErr, EntryPath,
-                                    /*FileSize=*/-1,
-                                    /*RequiresNullTerminator=*/false);
-      sys::fs::closeFile(*FDOrErr);
-      if (MBOrErr) {
-        AddBuffer(Task, std::move(*MBOrErr));
-        return AddStreamFn();
-      }
-      EC = MBOrErr.getError();
-    } else {
-      EC = errorToErrorCode(FDOrErr.takeError());
+    std::string EntryPath = getCacheEntryPath(CacheDirectoryPath, Key);
+    // First, see if we have a cache hit. Entries written before the cache was
+    // sharded live directly in the cache directory.
+    std::error_code EC = addCacheEntry(EntryPath, AddBuffer, Task);
+    if (EC == errc::no_such_file_or_directory) {
+      SmallString<64> FlatEntryPath;
+      sys::path::append(FlatEntryPath, CacheDirectoryPath, "llvmcache-" + Key);
+      EC = addCacheEntry(FlatEntryPath, AddBuffer, Task);
+    }
+    if (!EC) {
+      if (Stats)
+        ++Stats->Hits;
+      return AddStreamFn();
     }
 
     // On Windows we can fail to open a cache file with a permission denied
@@ -67,20 +83,26 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
       report_fatal_error(Twine("Failed to open cache file ") + EntryPath +
                          ": " + EC.message() + "\n");
 
+    if (Stats)
+      ++Stats->Misses;
+
     // This native object stream is responsible for commiting the resulting
     // file to the cache and calling AddBuffer to add it to the link.
     struct CacheStream : NativeObjectStream {
       AddBufferFn AddBuffer;
       sys::fs::TempFile TempFile;
+      std::string CacheDirectoryPath;
+      std::string Key;
       std::string EntryPath;
       unsigned Task;
 
       CacheStream(std::unique_ptr<raw_pwrite_stream> OS, AddBufferFn AddBuffer,
-                  sys::fs::TempFile TempFile, std::string EntryPath,
-                  unsigned Task)
+                  sys::fs::TempFile TempFile, std::string CacheDirectoryPath,
+                  std::string Key, std::string EntryPath, unsigned Task)
           : NativeObjectStream(std::move(OS)), AddBuffer(std::move(AddBuffer)),
-            TempFile(std::move(TempFile)), EntryPath(std::move(EntryPath)),
-            Task(Task) {}
+            TempFile(std::move(TempFile)),
+            CacheDirectoryPath(std::move(CacheDirectoryPath)),
+            Key(std::move(Key)), EntryPath(std::move(EntryPath)), Task(Task) {}
 
       ~CacheStream() {
         // Make sure the stream is closed before committing it.
@@ -96,6 +118,10 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
                              TempFile.TmpName + ": " +
                              MBOrErr.getError().message() + "\n");
 
+        // The shard directory is created on demand. Another process may be
+        // creating it at the same time, so errors surface when renaming.
+        sys::fs::create_directory(sys::path::parent_path(EntryPath));
+
         // On POSIX systems, this will atomically replace the destination if
         // it already exists. We try to emulate this on Windows, but this may
         // fail with a permission denied error (for example, if the destination
@@ -105,6 +131,7 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
         // AddBuffer a copy of the bytes we wrote in that case. We do this
         // instead of just using the existing file, because the pruner might
         // delete the file before we get a chance to use it.
+        bool Committed = true;
         Error E = TempFile.keep(EntryPath);
         E = handleErrors(std::move(E), [&](const ECError &E) -> Error {
           std::error_code EC = E.convertToErrorCode();
@@ -114,6 +141,7 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
           auto MBCopy = MemoryBuffer::getMemBufferCopy((*MBOrErr)->getBuffer(),
                                                        EntryPath);
           MBOrErr = std::move(MBCopy);
+          Committed = false;
 
           // FIXME: should we consume the discard error?
           consumeError(TempFile.discard());
@@ -126,6 +154,9 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
                              TempFile.TmpName + " to " + EntryPath + ": " +
                              toString(std::move(E)) + "\n");
 
+        if (Committed)
+          addCacheIndexEntry(CacheDirectoryPath, Key,
+                             (*MBOrErr)->getBufferSize());
         AddBuffer(Task, std::move(*MBOrErr));
       }
     };
@@ -144,7 +175,8 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
       // This CacheStream will move the temporary file into the cache when done.
       return std::make_unique<CacheStream>(
           std::make_unique<raw_fd_ostream>(Temp->FD, /* ShouldClose */ false),
-          AddBuffer, std::move(*Temp), std::string(EntryPath.str()), Task);
+          AddBuffer, std::move(*Temp), std::string(CacheDirectoryPath),
+          std::string(Key), EntryPath, Task);
     };
   };
 }
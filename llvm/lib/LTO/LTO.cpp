@@ -12,6 +12,7 @@
 
 #include "llvm/LTO/LTO.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Analysis/StackSafetyAnalysis.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
@@ -32,11 +33,13 @@
 #include "llvm/Linker/IRMover.h"
 #include "llvm/Object/IRObjectFile.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/FileUtilities.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
-#include "llvm/Support/SHA1.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/ThreadPool.h"
@@ -44,6 +47,7 @@
 #include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/VCSRevision.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Transforms/IPO.h"
@@ -52,6 +56,7 @@
 #include "llvm/Transforms/Utils/FunctionImportUtils.h"
 #include "llvm/Transforms/Utils/SplitModule.h"
 
+#include <array>
 #include <set>
 
 using namespace llvm;
@@ -69,6 +74,37 @@ cl::opt<bool> EnableLTOInternalization(
     "enable-lto-internalization", cl::init(true), cl::Hidden,
     cl::desc("Enable global value internalization in LTO"));
 
+namespace {
+/// Collects the inputs of a cache key, which are hashed in one go with XXH3
+/// once they are all known.
+class CacheKeyHasher {
+  SmallVector<uint8_t, 0> Data;
+
+public:
+  void update(ArrayRef<uint8_t> Bytes) {
+    Data.append(Bytes.begin(), Bytes.end());
+  }
+  void update(StringRef Str) { update(arrayRefFromStringRef(Str)); }
+
+  /// Add the hash of \p Str rather than its contents, for large inputs.
+  void updateWithHashOf(StringRef Str) {
+    XXH128_hash_t Hash = xxh3_128bits(Str);
+    uint8_t Bytes[16];
+    support::endian::write64le(Bytes, Hash.low64);
+    support::endian::write64le(Bytes + 8, Hash.high64);
+    update(Bytes);
+  }
+
+  std::array<uint8_t, 16> result() const {
+    XXH128_hash_t Hash = xxh3_128bits(Data);
+    std::array<uint8_t, 16> Bytes;
+    support::endian::write64be(Bytes.data(), Hash.high64);
+    support::endian::write64be(Bytes.data() + 8, Hash.low64);
+    return Bytes;
+  }
+};
+} // end anonymous namespace
+
 // Computes a unique hash for the Module considering the current list of
 // export/import and other global analysis results.
 // The hash is produced in \p Key.
@@ -84,7 +120,9 @@ void llvm::computeLTOCacheKey(
   // This is based on the current compiler version, the module itself, the
   // export list, the hash for every single module in the import list, the
   // list of ResolvedODR for the module, and the list of preserved symbols.
-  SHA1 Hasher;
+  // The cache is not expected to be shared with untrusted parties, so a fast
+  // non-cryptographic 128-bit hash is good enough.
+  CacheKeyHasher Hasher;
 
   // Start with the compiler revision
   Hasher.update(LLVM_VERSION_STRING);
@@ -301,12 +339,12 @@ void llvm::computeLTOCacheKey(
   if (!Conf.SampleProfile.empty()) {
     auto FileOrErr = MemoryBuffer::getFile(Conf.SampleProfile);
     if (FileOrErr) {
-      Hasher.update(FileOrErr.get()->getBuffer());
+      Hasher.updateWithHashOf(FileOrErr.get()->getBuffer());
 
       if (!Conf.ProfileRemapping.empty()) {
         FileOrErr = MemoryBuffer::getFile(Conf.ProfileRemapping);
         if (FileOrErr)
-          Hasher.update(FileOrErr.get()->getBuffer());
+          Hasher.updateWithHashOf(FileOrErr.get()->getBuffer());
       }
     }
   }
@@ -1234,6 +1272,165 @@ ThinBackend lto::createInProcessThinBackend(ThreadPoolStrategy Parallelism) {
   };
 }
 
+namespace {
+class OutOfProcessThinBackend : public ThinBackendProc {
+  // Each thread of the pool drives one worker process at a time.
+  ThreadPool WorkerThreadPool;
+  AddStreamFn AddStream;
+  NativeObjectCache Cache;
+  std::string WorkerPath;
+  std::vector<std::string> WorkerArgs;
+  std::set<GlobalValue::GUID> CfiFunctionDefs;
+  std::set<GlobalValue::GUID> CfiFunctionDecls;
+
+  Optional<Error> Err;
+  std::mutex ErrMu;
+
+public:
+  OutOfProcessThinBackend(
+      const Config &Conf, ModuleSummaryIndex &CombinedIndex,
+      ThreadPoolStrategy Parallelism,
+      const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
+      AddStreamFn AddStream, NativeObjectCache Cache, std::string WorkerPath,
+      std::vector<std::string> WorkerArgs)
+      : ThinBackendProc(Conf, CombinedIndex, ModuleToDefinedGVSummaries),
+        WorkerThreadPool(Parallelism), AddStream(std::move(AddStream)),
+        Cache(std::move(Cache)), WorkerPath(std::move(WorkerPath)),
+        WorkerArgs(std::move(WorkerArgs)) {
+    for (auto &Name : CombinedIndex.cfiFunctionDefs())
+      CfiFunctionDefs.insert(
+          GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
+    for (auto &Name : CombinedIndex.cfiFunctionDecls())
+      CfiFunctionDecls.insert(
+          GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
+  }
+
+  Error runWorker(AddStreamFn AddStream, unsigned Task, BitcodeModule BM,
+                  const FunctionImporter::ImportMapTy &ImportList,
+                  const MapVector<StringRef, BitcodeModule> &ModuleMap) {
+    StringRef ModuleID = BM.getModuleIdentifier();
+    SmallString<128> JobPath, ObjPath;
+    int JobFD;
+    if (std::error_code EC =
+            sys::fs::createTemporaryFile("thinlto-job", "bc", JobFD, JobPath))
+      return errorCodeToError(EC);
+    FileRemover JobRemover(JobPath);
+    {
+      raw_fd_ostream OS(JobFD, /*shouldClose=*/true);
+      if (Error E = writeThinBackendJob(OS, Conf, Task, BM, CombinedIndex,
+                                        ModuleToDefinedGVSummaries, ImportList,
+                                        ModuleMap))
+        return E;
+      if (OS.has_error())
+        return createFileError(JobPath, OS.error());
+    }
+
+    if (std::error_code EC =
+            sys::fs::createTemporaryFile("thinlto-obj", "o", ObjPath))
+      return errorCodeToError(EC);
+    FileRemover ObjRemover(ObjPath);
+
+    SmallVector<StringRef, 8> Args;
+    Args.push_back(WorkerPath);
+    Args.append(WorkerArgs.begin(), WorkerArgs.end());
+    Args.push_back(JobPath);
+    Args.push_back("-o");
+    Args.push_back(ObjPath);
+    std::string ErrMsg;
+    int RC = sys::ExecuteAndWait(WorkerPath, Args, /*Env=*/None,
+                                 /*Redirects=*/{}, /*SecondsToWait=*/0,
+                                 /*MemoryLimit=*/0, &ErrMsg);
+    if (RC != 0) {
+      // A negative result means that the worker could not be run or crashed.
+      if (RC > 0)
+        ErrMsg = "exited with code " + std::to_string(RC);
+      return createStringError(inconvertibleErrorCode(),
+                               "ThinLTO backend worker for '%s': %s",
+                               ModuleID.str().c_str(), ErrMsg.c_str());
+    }
+
+    ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+        MemoryBuffer::getFile(ObjPath, /*FileSize=*/-1,
+                              /*RequiresNullTerminator=*/false);
+    if (!MBOrErr)
+      return createFileError(ObjPath, MBOrErr.getError());
+    *AddStream(Task)->OS << (*MBOrErr)->getBuffer();
+    return Error::success();
+  }
+
+  Error runThinLTOBackendJob(
+      unsigned Task, BitcodeModule BM,
+      const FunctionImporter::ImportMapTy &ImportList,
+      const FunctionImporter::ExportSetTy &ExportList,
+      const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes> &ResolvedODR,
+      const GVSummaryMapTy &DefinedGlobals,
+      const MapVector<StringRef, BitcodeModule> &ModuleMap) {
+    auto ModuleID = BM.getModuleIdentifier();
+
+    if (!Cache || !CombinedIndex.modulePaths().count(ModuleID) ||
+        all_of(CombinedIndex.getModuleHash(ModuleID),
+               [](uint32_t V) { return V == 0; }))
+      return runWorker(AddStream, Task, BM, ImportList, ModuleMap);
+
+    SmallString<40> Key;
+    computeLTOCacheKey(Key, Conf, CombinedIndex, ModuleID, ImportList,
+                       ExportList, ResolvedODR, DefinedGlobals, CfiFunctionDefs,
+                       CfiFunctionDecls);
+    if (AddStreamFn CacheAddStream = Cache(Task, Key))
+      return runWorker(CacheAddStream, Task, BM, ImportList, ModuleMap);
+
+    return Error::success();
+  }
+
+  Error start(
+      unsigned Task, BitcodeModule BM,
+      const FunctionImporter::ImportMapTy &ImportList,
+      const FunctionImporter::ExportSetTy &ExportList,
+      const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes> &ResolvedODR,
+      MapVector<StringRef, BitcodeModule> &ModuleMap) override {
+    StringRef ModulePath = BM.getModuleIdentifier();
+    assert(ModuleToDefinedGVSummaries.count(ModulePath));
+    const GVSummaryMapTy &DefinedGlobals =
+        ModuleToDefinedGVSummaries.find(ModulePath)->second;
+    // The job is serialized on the pool thread as well, so that writing the
+    // jobs of large modules overlaps with running the workers.
+    WorkerThreadPool.async([=, &ImportList, &ExportList, &ResolvedODR,
+                            &DefinedGlobals, &ModuleMap]() {
+      Error E = runThinLTOBackendJob(Task, BM, ImportList, ExportList,
+                                     ResolvedODR, DefinedGlobals, ModuleMap);
+      if (E) {
+        std::unique_lock<std::mutex> L(ErrMu);
+        if (Err)
+          Err = joinErrors(std::move(*Err), std::move(E));
+        else
+          Err = std::move(E);
+      }
+    });
+    return Error::success();
+  }
+
+  Error wait() override {
+    WorkerThreadPool.wait();
+    if (Err)
+      return std::move(*Err);
+    else
+      return Error::success();
+  }
+};
+} // end anonymous namespace
+
+ThinBackend lto::createOutOfProcessThinBackend(
+    ThreadPoolStrategy Parallelism, std::string WorkerPath,
+    std::vector<std::string> WorkerArgs) {
+  return [=](const Config &Conf, ModuleSummaryIndex &CombinedIndex,
+             const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
+             AddStreamFn AddStream, NativeObjectCache Cache) {
+    return std::make_unique<OutOfProcessThinBackend>(
+        Conf, CombinedIndex, Parallelism, ModuleToDefinedGVSummaries, AddStream,
+        Cache, WorkerPath, WorkerArgs);
+  };
+}
+
 // Given the original \p Path to an output file, replace any path
 // prefix matching \p OldPrefix with \p NewPrefix. Also, create the
 // resulting directory if it does not yet exist.
@@ -14,6 +14,8 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/LTO/LTOBackend.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
 #include "llvm/Analysis/ModuleSummaryAnalysis.h"
@@ -31,6 +33,8 @@
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/DataExtractor.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -477,7 +481,7 @@ void splitCodeGen(const Config &C, TargetMachine *TM, AddStreamFn AddStream,
             // copied into the thread's context.
             std::move(BC), ThreadCount++);
       },
-      false);
+      /*PreserveLocals=*/false, C.SplitPreserveOrder);
 
   // Because the inner lambda (which runs in a worker thread) captures our local
   // variables, we need to wait for the worker threads to terminate before we
@@ -720,4 +724,384 @@ bool lto::loadReferencedModules(
     OwnedImportsLifetimeManager.push_back(std::move(*MBOrErr));
   }
   return true;
-}
\ No newline at end of file
+}
+
+// A backend job is a sequence of little-endian 64-bit integers and
+// length-prefixed strings, after a magic string:
+//   task, setting count, (name, value) settings,
+//   module identifier, module bitcode, index bitcode,
+//   import count, (module identifier, bitcode, GUID count, GUIDs) imports.
+static const char ThinBackendJobMagic[] = "LLVMTBJ3";
+
+// The fields of TargetOptions, and of its MCTargetOptions, which a job stores
+// as unsigned integers, along with their setting names.
+#define THIN_BACKEND_JOB_TARGET_OPTIONS(X)                                     \
+  X("unsafe-fp-math", UnsafeFPMath)                                            \
+  X("no-infs-fp-math", NoInfsFPMath)                                           \
+  X("no-nans-fp-math", NoNaNsFPMath)                                           \
+  X("no-trapping-fp-math", NoTrappingFPMath)                                   \
+  X("no-signed-zeros-fp-math", NoSignedZerosFPMath)                            \
+  X("honor-sign-dependent-rounding-fp-math",                                   \
+    HonorSignDependentRoundingFPMathOption)                                    \
+  X("no-zeros-in-bss", NoZerosInBSS)                                           \
+  X("guaranteed-tail-call-opt", GuaranteedTailCallOpt)                         \
+  X("stack-alignment-override", StackAlignmentOverride)                        \
+  X("stack-symbol-ordering", StackSymbolOrdering)                              \
+  X("enable-fast-isel", EnableFastISel)                                        \
+  X("enable-global-isel", EnableGlobalISel)                                    \
+  X("global-isel-abort", GlobalISelAbort)                                      \
+  X("use-init-array", UseInitArray)                                            \
+  X("disable-integrated-as", DisableIntegratedAS)                              \
+  X("compress-debug-sections", CompressDebugSections)                          \
+  X("relax-elf-relocations", RelaxELFRelocations)                              \
+  X("function-sections", FunctionSections)                                     \
+  X("data-sections", DataSections)                                             \
+  X("unique-section-names", UniqueSectionNames)                                \
+  X("unique-basic-block-section-names", UniqueBasicBlockSectionNames)          \
+  X("trap-unreachable", TrapUnreachable)                                       \
+  X("no-trap-after-noreturn", NoTrapAfterNoreturn)                             \
+  X("tls-size", TLSSize)                                                       \
+  X("emulated-tls", EmulatedTLS)                                               \
+  X("explicit-emulated-tls", ExplicitEmulatedTLS)                              \
+  X("enable-ipra", EnableIPRA)                                                 \
+  X("emit-stack-size-section", EmitStackSizeSection)                           \
+  X("enable-machine-outliner", EnableMachineOutliner)                          \
+  X("enable-machine-function-splitter", EnableMachineFunctionSplitter)         \
+  X("supports-default-outlining", SupportsDefaultOutlining)                    \
+  X("emit-addrsig", EmitAddrsig)                                               \
+  X("basic-block-sections", BBSections)                                        \
+  X("emit-call-site-info", EmitCallSiteInfo)                                   \
+  X("supports-debug-entry-values", SupportsDebugEntryValues)                   \
+  X("enable-debug-entry-values", EnableDebugEntryValues)                       \
+  X("value-tracking-variable-locations", ValueTrackingVariableLocations)       \
+  X("force-dwarf-frame-section", ForceDwarfFrameSection)                       \
+  X("xray-omit-function-index", XRayOmitFunctionIndex)                         \
+  X("float-abi", FloatABIType)                                                 \
+  X("fp-op-fusion", AllowFPOpFusion)                                           \
+  X("thread-model", ThreadModel)                                               \
+  X("eabi-version", EABIVersion)                                               \
+  X("debugger-tuning", DebuggerTuning)                                         \
+  X("exception-model", ExceptionModel)                                         \
+  X("mc-relax-all", MCOptions.MCRelaxAll)                                      \
+  X("mc-no-exec-stack", MCOptions.MCNoExecStack)                               \
+  X("mc-fatal-warnings", MCOptions.MCFatalWarnings)                            \
+  X("mc-no-warn", MCOptions.MCNoWarn)                                          \
+  X("mc-no-deprecated-warn", MCOptions.MCNoDeprecatedWarn)                     \
+  X("mc-save-temp-labels", MCOptions.MCSaveTempLabels)                         \
+  X("mc-use-dwarf-directory", MCOptions.MCUseDwarfDirectory)                   \
+  X("mc-incremental-linker-compatible",                                        \
+    MCOptions.MCIncrementalLinkerCompatible)                                   \
+  X("mc-show-encoding", MCOptions.ShowMCEncoding)                              \
+  X("mc-show-inst", MCOptions.ShowMCInst)                                      \
+  X("mc-asm-verbose", MCOptions.AsmVerbose)                                    \
+  X("mc-preserve-asm-comments", MCOptions.PreserveAsmComments)                 \
+  X("mc-dwarf64", MCOptions.Dwarf64)                                           \
+  X("mc-dwarf-version", MCOptions.DwarfVersion)
+
+namespace {
+class JobWriter {
+  raw_ostream &OS;
+
+public:
+  JobWriter(raw_ostream &OS) : OS(OS) {
+    OS << StringRef(ThinBackendJobMagic);
+  }
+
+  void writeInt(uint64_t V) {
+    support::endian::write<uint64_t>(OS, V, support::little);
+  }
+
+  void writeString(StringRef S) {
+    writeInt(S.size());
+    OS << S;
+  }
+
+  // The module's buffer only covers its identification and module blocks, so
+  // copy its string table after it to get a standalone bitcode file.
+  void writeModule(BitcodeModule BM) {
+    SmallVector<char, 0> Buffer;
+    BitcodeWriter Writer(Buffer);
+    Buffer.append(BM.getBuffer().begin(), BM.getBuffer().end());
+    Writer.copyStrtab(BM.getStrtab());
+    writeString(StringRef(Buffer.data(), Buffer.size()));
+  }
+};
+
+class JobReader {
+  DataExtractor Data;
+  DataExtractor::Cursor C;
+
+public:
+  JobReader(StringRef Job)
+      : Data(Job, /*IsLittleEndian=*/true, /*AddressSize=*/8), C(0) {}
+
+  explicit operator bool() { return bool(C); }
+
+  uint64_t readInt() { return Data.getU64(C); }
+
+  StringRef readString() {
+    uint64_t Size = readInt();
+    return Data.getBytes(C, Size);
+  }
+
+  Error takeError() { return C.takeError(); }
+};
+} // end anonymous namespace
+
+static std::vector<std::pair<StringRef, std::string>>
+getThinBackendJobSettings(const Config &C) {
+  std::vector<std::pair<StringRef, std::string>> Settings;
+  auto Add = [&](StringRef Name, std::string Value) {
+    Settings.emplace_back(Name, std::move(Value));
+  };
+  Add("cpu", C.CPU);
+  Add("mattrs", join(C.MAttrs, ","));
+  Add("reloc-model", C.RelocModel ? utostr(*C.RelocModel) : "");
+  Add("code-model", C.CodeModel ? utostr(*C.CodeModel) : "");
+  Add("cg-opt-level", utostr(C.CGOptLevel));
+  Add("cg-file-type", utostr(C.CGFileType));
+  Add("opt-level", utostr(C.OptLevel));
+  Add("use-new-pm", utostr(C.UseNewPM));
+  Add("debug-pass-manager", utostr(C.DebugPassManager));
+  Add("freestanding", utostr(C.Freestanding));
+  Add("opt-pipeline", C.OptPipeline);
+  Add("aa-pipeline", C.AAPipeline);
+  Add("override-triple", C.OverrideTriple);
+  Add("default-triple", C.DefaultTriple);
+  Add("dwo-dir", C.DwoDir);
+  Add("split-dwarf-file", C.SplitDwarfFile);
+  Add("split-dwarf-output", C.SplitDwarfOutput);
+  Add("sample-profile", C.SampleProfile);
+  Add("profile-remapping", C.ProfileRemapping);
+  Add("cs-profile", C.CSIRProfile);
+  Add("run-cs-ir-instr", utostr(C.RunCSIRInstr));
+  Add("loop-vectorization", utostr(C.PTO.LoopVectorization));
+  Add("slp-vectorization", utostr(C.PTO.SLPVectorization));
+#define ADD_TARGET_OPTION(Name, Field)                                         \
+  Add(Name, utostr(unsigned(C.Options.Field)));
+  THIN_BACKEND_JOB_TARGET_OPTIONS(ADD_TARGET_OPTION)
+#undef ADD_TARGET_OPTION
+  Add("fp-denormal-mode", C.Options.getRawFPDenormalMode().str());
+  Add("fp32-denormal-mode", C.Options.getRawFP32DenormalMode().str());
+  Add("mc-abi-name", C.Options.MCOptions.ABIName);
+  Add("mc-assembly-language", C.Options.MCOptions.AssemblyLanguage);
+  return Settings;
+}
+
+// Check that the target options of \p C which are not settings of a job are
+// left at their defaults.
+static Error checkThinBackendJobTargetOptions(const Config &C) {
+  auto Unsupported = [](StringRef Option) {
+    return createStringError(inconvertibleErrorCode(),
+                             "%s can not be passed to a ThinLTO backend job",
+                             Option.str().c_str());
+  };
+  const MCTargetOptions &MCOptions = C.Options.MCOptions;
+  if (C.Options.BBSectionsFuncListBuf)
+    return Unsupported("the basic block sections function list");
+  if (!MCOptions.IASSearchPaths.empty())
+    return Unsupported("the integrated assembler search paths");
+  if (MCOptions.Argv0 || !MCOptions.CommandLineArgs.empty())
+    return Unsupported("the command line recorded in the object");
+  return Error::success();
+}
+
+static Error applyThinBackendJobSetting(Config &C, StringRef Name,
+                                        StringRef Value) {
+  if (Name == "cpu") {
+    C.CPU = std::string(Value);
+    return Error::success();
+  }
+  if (Name == "mattrs") {
+    SmallVector<StringRef, 8> Attrs;
+    Value.split(Attrs, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    C.MAttrs.clear();
+    for (StringRef Attr : Attrs)
+      C.MAttrs.push_back(Attr.str());
+    return Error::success();
+  }
+  std::string *Str = StringSwitch<std::string *>(Name)
+                         .Case("opt-pipeline", &C.OptPipeline)
+                         .Case("aa-pipeline", &C.AAPipeline)
+                         .Case("override-triple", &C.OverrideTriple)
+                         .Case("default-triple", &C.DefaultTriple)
+                         .Case("dwo-dir", &C.DwoDir)
+                         .Case("split-dwarf-file", &C.SplitDwarfFile)
+                         .Case("split-dwarf-output", &C.SplitDwarfOutput)
+                         .Case("mc-abi-name", &C.Options.MCOptions.ABIName)
+                         .Case("mc-assembly-language",
+                               &C.Options.MCOptions.AssemblyLanguage)
+                         .Case("sample-profile", &C.SampleProfile)
+                         .Case("profile-remapping", &C.ProfileRemapping)
+                         .Case("cs-profile", &C.CSIRProfile)
+                         .Default(nullptr);
+  if (Str) {
+    *Str = std::string(Value);
+    return Error::success();
+  }
+  if (Name == "reloc-model" && Value.empty()) {
+    C.RelocModel = None;
+    return Error::success();
+  }
+  if (Name == "code-model" && Value.empty()) {
+    C.CodeModel = None;
+    return Error::success();
+  }
+  if (Name == "fp-denormal-mode") {
+    C.Options.setFPDenormalMode(parseDenormalFPAttribute(Value));
+    return Error::success();
+  }
+  if (Name == "fp32-denormal-mode") {
+    C.Options.setFP32DenormalMode(parseDenormalFPAttribute(Value));
+    return Error::success();
+  }
+
+  unsigned V;
+  if (Value.getAsInteger(10, V))
+    return createStringError(inconvertibleErrorCode(),
+                             "invalid value '%s' for backend job setting '%s'",
+                             Value.str().c_str(), Name.str().c_str());
+  if (Name == "reloc-model")
+    C.RelocModel = Reloc::Model(V);
+  else if (Name == "code-model")
+    C.CodeModel = CodeModel::Model(V);
+  else if (Name == "cg-opt-level")
+    C.CGOptLevel = CodeGenOpt::Level(V);
+  else if (Name == "cg-file-type")
+    C.CGFileType = CodeGenFileType(V);
+  else if (Name == "opt-level")
+    C.OptLevel = V;
+  else if (Name == "use-new-pm")
+    C.UseNewPM = V;
+  else if (Name == "debug-pass-manager")
+    C.DebugPassManager = V;
+  else if (Name == "freestanding")
+    C.Freestanding = V;
+  else if (Name == "run-cs-ir-instr")
+    C.RunCSIRInstr = V;
+  else if (Name == "loop-vectorization")
+    C.PTO.LoopVectorization = V;
+  else if (Name == "slp-vectorization")
+    C.PTO.SLPVectorization = V;
+#define APPLY_TARGET_OPTION(OptionName, Field)                                 \
+  else if (Name == OptionName)                                                 \
+    C.Options.Field = decltype(C.Options.Field)(V);
+  THIN_BACKEND_JOB_TARGET_OPTIONS(APPLY_TARGET_OPTION)
+#undef APPLY_TARGET_OPTION
+  else
+    return createStringError(inconvertibleErrorCode(),
+                             "unknown backend job setting '%s'",
+                             Name.str().c_str());
+  return Error::success();
+}
+
+Error lto::writeThinBackendJob(
+    raw_ostream &OS, const Config &C, unsigned Task, BitcodeModule BM,
+    const ModuleSummaryIndex &CombinedIndex,
+    const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
+    const FunctionImporter::ImportMapTy &ImportList,
+    const MapVector<StringRef, BitcodeModule> &ModuleMap) {
+  if (Error Err = checkThinBackendJobTargetOptions(C))
+    return Err;
+
+  StringRef ModulePath = BM.getModuleIdentifier();
+  JobWriter W(OS);
+  W.writeInt(Task);
+
+  std::vector<std::pair<StringRef, std::string>> Settings =
+      getThinBackendJobSettings(C);
+  W.writeInt(Settings.size());
+  for (auto &Setting : Settings) {
+    W.writeString(Setting.first);
+    W.writeString(Setting.second);
+  }
+
+  W.writeString(ModulePath);
+  W.writeModule(BM);
+
+  std::map<std::string, GVSummaryMapTy> ModuleToSummariesForIndex;
+  gatherImportedSummariesForModule(ModulePath, ModuleToDefinedGVSummaries,
+                                   ImportList, ModuleToSummariesForIndex);
+  SmallVector<char, 0> IndexBuffer;
+  raw_svector_ostream IndexOS(IndexBuffer);
+  WriteIndexToFile(CombinedIndex, IndexOS, &ModuleToSummariesForIndex);
+  W.writeString(IndexOS.str());
+
+  W.writeInt(ImportList.size());
+  for (auto &I : ImportList) {
+    auto It = ModuleMap.find(I.first());
+    if (It == ModuleMap.end())
+      return createStringError(inconvertibleErrorCode(),
+                               "no bitcode for imported module '%s'",
+                               I.first().str().c_str());
+    W.writeString(I.first());
+    W.writeModule(It->second);
+    W.writeInt(I.second.size());
+    for (GlobalValue::GUID GUID : I.second)
+      W.writeInt(GUID);
+  }
+  return Error::success();
+}
+
+Error lto::runThinBackendJob(Config &C, MemoryBufferRef Job,
+                             AddStreamFn AddStream) {
+  StringRef Data = Job.getBuffer();
+  if (!Data.consume_front(ThinBackendJobMagic))
+    return createStringError(inconvertibleErrorCode(),
+                             "'%s' is not a ThinLTO backend job",
+                             Job.getBufferIdentifier().str().c_str());
+
+  JobReader R(Data);
+  unsigned Task = R.readInt();
+  for (uint64_t I = 0, E = R.readInt(); R && I != E; ++I) {
+    StringRef Name = R.readString();
+    StringRef Value = R.readString();
+    if (!R)
+      break;
+    if (Error Err = applyThinBackendJobSetting(C, Name, Value))
+      return Err;
+  }
+
+  StringRef ModulePath = R.readString();
+  StringRef ModuleBitcode = R.readString();
+  StringRef IndexBitcode = R.readString();
+
+  FunctionImporter::ImportMapTy ImportList;
+  MapVector<StringRef, BitcodeModule> ModuleMap;
+  for (uint64_t I = 0, E = R.readInt(); R && I != E; ++I) {
+    StringRef ImportPath = R.readString();
+    StringRef ImportBitcode = R.readString();
+    FunctionImporter::FunctionsToImportTy &GUIDs = ImportList[ImportPath];
+    for (uint64_t J = 0, F = R.readInt(); R && J != F; ++J)
+      GUIDs.insert(R.readInt());
+    if (!R)
+      break;
+    Expected<BitcodeModule> BMOrErr =
+        findThinLTOModule(MemoryBufferRef(ImportBitcode, ImportPath));
+    if (!BMOrErr)
+      return BMOrErr.takeError();
+    ModuleMap.insert({ImportPath, *BMOrErr});
+  }
+  if (Error Err = R.takeError())
+    return createFileError(Job.getBufferIdentifier(), std::move(Err));
+
+  Expected<std::unique_ptr<ModuleSummaryIndex>> IndexOrErr =
+      getModuleSummaryIndex(MemoryBufferRef(IndexBitcode, ModulePath));
+  if (!IndexOrErr)
+    return IndexOrErr.takeError();
+  StringMap<GVSummaryMapTy> ModuleToDefinedGVSummaries;
+  (*IndexOrErr)->collectDefinedGVSummariesPerModule(ModuleToDefinedGVSummaries);
+
+  Expected<BitcodeModule> BMOrErr =
+      findThinLTOModule(MemoryBufferRef(ModuleBitcode, ModulePath));
+  if (!BMOrErr)
+    return BMOrErr.takeError();
+  LTOLLVMContext BackendContext(C);
+  Expected<std::unique_ptr<Module>> MOrErr =
+      BMOrErr->parseModule(BackendContext);
+  if (!MOrErr)
+    return MOrErr.takeError();
+
+  return thinBackend(C, Task, AddStream, **MOrErr, **IndexOrErr, ImportList,
+                     ModuleToDefinedGVSummaries[ModulePath], ModuleMap);
+}
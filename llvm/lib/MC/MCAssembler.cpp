@@ -32,6 +32,7 @@
 #include "llvm/MC/MCValue.h"
 #include "llvm/Support/Alignment.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -69,10 +70,17 @@ STATISTIC(FragmentLayouts, "Number of fragment layouts");
 STATISTIC(ObjectBytes, "Number of emitted object file bytes");
 STATISTIC(RelaxationSteps, "Number of assembler layout and relaxation steps");
 STATISTIC(RelaxedInstructions, "Number of relaxed instructions");
+STATISTIC(SkippedRelaxations,
+          "Number of fragments not relaxed again as their inputs are unchanged");
 
 } // end namespace stats
 } // end anonymous namespace
 
+static cl::opt<bool> SkipUnchangedRelaxations(
+    "mc-skip-unchanged-relaxations", cl::init(true), cl::Hidden,
+    cl::desc("Do not relax a fragment again while the offsets its relaxation "
+             "read are unchanged"));
+
 // FIXME FIXME FIXME: There are number of places in this file where we convert
 // what is a 64-bit assembler value used for computation into a value in the
 // object file, which may truncate it. We should detect that truncation where
@@ -107,6 +115,7 @@ void MCAssembler::reset() {
   IncrementalLinkerCompatible = false;
   ELFHeaderEFlags = 0;
   LOHContainer.reset();
+  UnrelaxedFragments.clear();
   VersionInfo.Major = 0;
   VersionInfo.SDKVersion = VersionTuple();
 
@@ -845,6 +854,7 @@ void MCAssembler::layout(MCAsmLayout &Layout) {
     for (MCSection &Sec : *this)
       Layout.invalidateFragmentsFrom(&*Sec.begin());
   }
+  UnrelaxedFragments.clear();
 
   DEBUG_WITH_TYPE("mc-dump", {
       errs() << "assembler backend - post-relaxation\n--\n";
@@ -1193,6 +1203,132 @@ bool MCAssembler::relaxFragment(MCAsmLayout &Layout, MCFragment &F) {
   }
 }
 
+using RelaxationDeps = SmallVectorImpl<const MCFragment *>;
+
+/// Record that the relaxation of a fragment may use the offset of \p F.
+static void addRelaxationDep(const MCFragment &F, RelaxationDeps &Deps) {
+  if (!is_contained(Deps, &F))
+    Deps.push_back(&F);
+}
+
+/// Collect the fragments the value of \p Expr depends on. Returns false if
+/// this is not known.
+static bool addRelaxationDeps(const MCExpr &Expr, RelaxationDeps &Deps) {
+  switch (Expr.getKind()) {
+  case MCExpr::Target:
+    return false;
+  case MCExpr::Constant:
+    return true;
+  case MCExpr::Binary: {
+    const MCBinaryExpr &BE = cast<MCBinaryExpr>(Expr);
+    return addRelaxationDeps(*BE.getLHS(), Deps) &&
+           addRelaxationDeps(*BE.getRHS(), Deps);
+  }
+  case MCExpr::Unary:
+    return addRelaxationDeps(*cast<MCUnaryExpr>(Expr).getSubExpr(), Deps);
+  case MCExpr::SymbolRef: {
+    const MCSymbol &Sym = cast<MCSymbolRefExpr>(Expr).getSymbol();
+    if (Sym.isVariable())
+      return addRelaxationDeps(*Sym.getVariableValue(/*SetUsed=*/false), Deps);
+    const MCFragment *F = Sym.getFragment(/*SetUsed=*/false);
+    if (F && !Sym.isAbsolute())
+      addRelaxationDep(*F, Deps);
+    return true;
+  }
+  }
+  llvm_unreachable("Invalid assembly expression kind!");
+}
+
+/// Collect the fragments whose offsets the relaxation of \p F may use.
+/// Returns false if this is not known, in which case \p F is visited on every
+/// relaxation pass.
+static bool getRelaxationDeps(const MCFragment &F, RelaxationDeps &Deps) {
+  switch (F.getKind()) {
+  default:
+    return false;
+  case MCFragment::FT_Relaxable:
+    // PC-relative fixups also use the offset of the instruction itself.
+    addRelaxationDep(F, Deps);
+    for (const MCFixup &Fixup : cast<MCRelaxableFragment>(F).getFixups())
+      if (!addRelaxationDeps(*Fixup.getValue(), Deps))
+        return false;
+    return true;
+  case MCFragment::FT_Dwarf:
+    return addRelaxationDeps(cast<MCDwarfLineAddrFragment>(F).getAddrDelta(),
+                             Deps);
+  case MCFragment::FT_DwarfFrame:
+    return addRelaxationDeps(cast<MCDwarfCallFrameFragment>(F).getAddrDelta(),
+                             Deps);
+  case MCFragment::FT_LEB:
+    return addRelaxationDeps(cast<MCLEBFragment>(F).getValue(), Deps);
+  }
+}
+
+/// Check whether the relaxation result of \p F can be reused, which is limited
+/// to the fragment kinds whose inputs getRelaxationDeps knows about.
+static bool isRelaxationTracked(const MCAsmBackend &Backend,
+                                const MCFragment &F) {
+  switch (F.getKind()) {
+  default:
+    return false;
+  case MCFragment::FT_Relaxable: {
+    // Instructions which can not be relaxed any further are cheap to visit.
+    const MCRelaxableFragment &RF = cast<MCRelaxableFragment>(F);
+    if (!Backend.mayNeedRelaxation(RF.getInst(), *RF.getSubtargetInfo()))
+      return false;
+    // A fixup whose PC is aligned down, like that of the Thumb ADR and LDR
+    // (literal), resolves to a different value when the instruction and its
+    // target move by the same amount, so it must always be evaluated again.
+    return llvm::none_of(RF.getFixups(), [&](const MCFixup &Fixup) {
+      return Backend.getFixupKindInfo(Fixup.getKind()).Flags &
+             MCFixupKindInfo::FKF_IsAlignedDownTo32Bits;
+    });
+  }
+  case MCFragment::FT_Dwarf:
+  case MCFragment::FT_DwarfFrame:
+  case MCFragment::FT_LEB:
+    return true;
+  }
+}
+
+bool MCAssembler::isRelaxationUpToDate(const MCAsmLayout &Layout,
+                                       const RelaxationInputs &Inputs) const {
+  if (Inputs.empty())
+    return false;
+  // The relaxation only depends on differences between these offsets, so
+  // they may all have moved by the same amount.
+  uint64_t Shift = 0;
+  for (const auto &Input : Inputs) {
+    uint64_t Offset;
+    if (!Layout.getValidFragmentOffset(Input.first, Offset))
+      return false;
+    if (&Input == &Inputs.front())
+      Shift = Offset - Input.second;
+    else if (Offset - Input.second != Shift)
+      return false;
+  }
+  return true;
+}
+
+void MCAssembler::recordRelaxation(const MCAsmLayout &Layout,
+                                   const MCFragment &F, bool Relaxed,
+                                   RelaxationInputs &Inputs) const {
+  Inputs.clear();
+  SmallVector<const MCFragment *, 2> Deps;
+  if (Relaxed || !getRelaxationDeps(F, Deps))
+    return;
+  for (const MCFragment *Dep : Deps) {
+    // The relaxation did not need this offset, so there is nothing to compare
+    // it to later.
+    uint64_t Offset;
+    if (!Layout.getValidFragmentOffset(Dep, Offset)) {
+      Inputs.clear();
+      return;
+    }
+    Inputs.push_back(std::make_pair(Dep, Offset));
+  }
+}
+
 bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec) {
   // Holds the first fragment which needed relaxing during this layout. It will
   // remain NULL if none were relaxed.
@@ -1200,10 +1336,30 @@ bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec) {
   // invalidated because their offset is going to change.
   MCFragment *FirstRelaxedFragment = nullptr;
 
+  std::vector<RelaxationInputs> &Unrelaxed = UnrelaxedFragments[&Sec];
+  if (Unrelaxed.empty())
+    Unrelaxed.resize(Sec.getFragmentList().back().getLayoutOrder() + 1);
+
   // Attempt to relax all the fragments in the section.
   for (MCFragment &Frag : Sec) {
+    // A fragment which did not need relaxing is not visited again while the
+    // offsets its relaxation reads are unchanged. Relaxing it anyway would
+    // give the same result and, as those fragments are already laid out,
+    // would not lay out anything else as a side effect, so the output is the
+    // same as if every fragment was visited on every pass.
+    bool Tracked =
+        SkipUnchangedRelaxations && isRelaxationTracked(getBackend(), Frag);
+    if (Tracked &&
+        isRelaxationUpToDate(Layout, Unrelaxed[Frag.getLayoutOrder()])) {
+      ++stats::SkippedRelaxations;
+      continue;
+    }
+
     // Check if this is a fragment that needs relaxation.
     bool RelaxedFrag = relaxFragment(Layout, Frag);
+    if (Tracked)
+      recordRelaxation(Layout, Frag, RelaxedFrag,
+                       Unrelaxed[Frag.getLayoutOrder()]);
     if (RelaxedFrag && !FirstRelaxedFragment)
       FirstRelaxedFragment = &Frag;
   }
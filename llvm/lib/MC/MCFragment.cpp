@@ -99,6 +99,14 @@ uint64_t MCAsmLayout::getFragmentOffset(const MCFragment *F) const {
   return F->Offset;
 }
 
+bool MCAsmLayout::getValidFragmentOffset(const MCFragment *F,
+                                         uint64_t &Offset) const {
+  if (!isFragmentValid(F))
+    return false;
+  Offset = F->Offset;
+  return true;
+}
+
 // Simple getSymbolOffset helper for the non-variable case.
 static bool getLabelOffset(const MCAsmLayout &Layout, const MCSymbol &S,
                            bool ReportError, uint64_t &Val) {
@@ -357,6 +357,10 @@ bool MCSubtargetInfo::enableWritePrefetching() const {
   return false;
 }
 
+bool MCSubtargetInfo::enableIndirectPrefetching() const {
+  return false;
+}
+
 unsigned MCSubtargetInfo::getMinPrefetchStride(unsigned NumMemAccesses,
                                                unsigned NumStridedMemAccesses,
                                                unsigned NumPrefetches,
@@ -89,6 +89,7 @@
 #include "llvm/Transforms/IPO/ForceFunctionAttrs.h"
 #include "llvm/Transforms/IPO/FunctionAttrs.h"
 #include "llvm/Transforms/IPO/FunctionImport.h"
+#include "llvm/Transforms/IPO/FunctionSpecialization.h"
 #include "llvm/Transforms/IPO/GlobalDCE.h"
 #include "llvm/Transforms/IPO/GlobalOpt.h"
 #include "llvm/Transforms/IPO/GlobalSplit.h"
@@ -147,6 +148,7 @@
 #include "llvm/Transforms/Scalar/LoopDataPrefetch.h"
 #include "llvm/Transforms/Scalar/LoopDeletion.h"
 #include "llvm/Transforms/Scalar/LoopDistribute.h"
+#include "llvm/Transforms/Scalar/LoopFlatten.h"
 #include "llvm/Transforms/Scalar/LoopFuse.h"
 #include "llvm/Transforms/Scalar/LoopIdiomRecognize.h"
 #include "llvm/Transforms/Scalar/LoopInstSimplify.h"
@@ -280,6 +282,19 @@ PipelineTuningOptions::PipelineTuningOptions() {
   LicmMssaOptCap = SetLicmMssaOptCap;
   LicmMssaNoAccForPromotionCap = SetLicmMssaNoAccForPromotionCap;
   CallGraphProfile = true;
+  FunctionThreads = 1;
+}
+
+/// Add \p Pass to \p MPM wrapped in a module-to-function adaptor, using the
+/// parallel adaptor when more than one thread is requested.
+template <typename FunctionPassT>
+static void addFunctionPassAdaptor(ModulePassManager &MPM, FunctionPassT Pass,
+                                   unsigned Threads) {
+  if (Threads > 1)
+    MPM.addPass(
+        createParallelModuleToFunctionPassAdaptor(std::move(Pass), Threads));
+  else
+    MPM.addPass(createModuleToFunctionPassAdaptor(std::move(Pass)));
 }
 
 extern cl::opt<bool> EnableHotColdSplit;
@@ -292,6 +307,10 @@ extern cl::opt<bool> EnableKnowledgeRetention;
 
 extern cl::opt<bool> EnableMatrix;
 
+extern cl::opt<bool> EnableFunctionSpecialization;
+
+extern cl::opt<bool> EnableLoopFlatten;
+
 const PassBuilder::OptimizationLevel PassBuilder::OptimizationLevel::O0 = {
     /*SpeedLevel*/ 0,
     /*SizeLevel*/ 0};
@@ -999,6 +1018,11 @@ ModulePassManager PassBuilder::buildModuleSimplificationPipeline(
   if (Phase == ThinLTOPhase::PostLink)
     MPM.addPass(LowerTypeTestsPass(nullptr, nullptr, true));
 
+  // Specialize functions for the constant arguments of their call sites, so
+  // that IPSCCP propagates the constants into the clones.
+  if (Level == OptimizationLevel::O3 && EnableFunctionSpecialization)
+    MPM.addPass(FunctionSpecializationPass());
+
   // Interprocedural constant propagation now that basic cleanup has occurred
   // and prior to optimizing globals.
   // FIXME: This position in the pipeline hasn't been carefully considered in
@@ -1141,6 +1165,11 @@ ModulePassManager PassBuilder::buildModuleOptimizationPipeline(
       LoopRotatePass(), EnableMSSALoopDependency,
       /*UseBlockFrequencyInfo=*/false, DebugLogging));
 
+  // Collapse nests that walk an array linearly into a single loop, giving the
+  // vectorizer one longer trip count to work with.
+  if (Level == OptimizationLevel::O3 && EnableLoopFlatten)
+    OptimizePM.addPass(LoopFlattenPass());
+
   // Distribute loops to allow partial vectorization.  I.e. isolate dependences
   // into separate loop that would otherwise inhibit vectorization.  This is
   // currently only performed for loops marked with the metadata
@@ -1439,6 +1468,8 @@ PassBuilder::buildLTODefaultPipeline(OptimizationLevel Level, bool DebugLogging,
     // Propagate constants at call sites into the functions they call.  This
     // opens opportunities for globalopt (and inlining) by substituting function
     // pointers passed as arguments to direct uses of functions.
+    if (Level == OptimizationLevel::O3 && EnableFunctionSpecialization)
+      MPM.addPass(FunctionSpecializationPass());
     MPM.addPass(IPSCCPPass());
 
     // Attach metadata to indirect call sites indicating the set of functions
@@ -2142,7 +2173,7 @@ Error PassBuilder::parseModulePass(ModulePassManager &MPM,
       if (auto Err = parseFunctionPassPipeline(FPM, InnerPipeline,
                                                VerifyEachPass, DebugLogging))
         return Err;
-      MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+      addFunctionPassAdaptor(MPM, std::move(FPM), PTO.FunctionThreads);
       return Error::success();
     }
     if (auto Count = parseRepeatPassName(Name)) {
@@ -2258,7 +2289,7 @@ Error PassBuilder::parseModulePass(ModulePassManager &MPM,
   }
 #define FUNCTION_PASS(NAME, CREATE_PASS)                                       \
   if (Name == NAME) {                                                          \
-    MPM.addPass(createModuleToFunctionPassAdaptor(CREATE_PASS));               \
+    addFunctionPassAdaptor(MPM, CREATE_PASS, PTO.FunctionThreads);             \
     return Error::success();                                                   \
   }
 #define FUNCTION_PASS_WITH_PARAMS(NAME, CREATE_PASS, PARSER)                   \
@@ -2266,7 +2297,8 @@ Error PassBuilder::parseModulePass(ModulePassManager &MPM,
     auto Params = parsePassParameters(PARSER, Name, NAME);                     \
     if (!Params)                                                               \
       return Params.takeError();                                               \
-    MPM.addPass(createModuleToFunctionPassAdaptor(CREATE_PASS(Params.get()))); \
+    addFunctionPassAdaptor(MPM, CREATE_PASS(Params.get()),                     \
+                           PTO.FunctionThreads);                               \
     return Error::success();                                                   \
   }
 #define LOOP_PASS(NAME, CREATE_PASS)                                           \
@@ -15,6 +15,7 @@
 #include "llvm/Passes/StandardInstrumentations.h"
 #include "llvm/ADT/Any.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
 #include "llvm/Analysis/LazyCallGraph.h"
 #include "llvm/Analysis/LoopInfo.h"
@@ -24,7 +25,10 @@
 #include "llvm/IR/PassInstrumentation.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
 
@@ -51,6 +55,12 @@ static cl::opt<bool>
                    cl::desc("Print all pass management debugging information. "
                             "`-debug-pass-manager` must also be specified"));
 
+static cl::opt<std::string> PassProfileFile(
+    "pass-profile", cl::Hidden, cl::value_desc("filename"),
+    cl::desc("Write a JSON profile of the time, instruction count change and "
+             "analysis invalidations of every pass on every IR unit to the "
+             "given file"));
+
 namespace {
 
 /// Extracting Module out of \p IR unit. Also fills a textual description
@@ -501,6 +511,169 @@ void PreservedCFGCheckerInstrumentation::registerCallbacks(
   });
 }
 
+namespace {
+
+/// Name, kind and instruction count of the IR unit a pass runs on. Loop passes
+/// are accounted to their function, with the instruction count of the whole
+/// function.
+struct ProfiledUnit {
+  std::string Name;
+  StringRef Kind;
+  unsigned Insts = 0;
+};
+
+Optional<ProfiledUnit> getProfiledUnit(Any IR) {
+  if (any_isa<const Module *>(IR)) {
+    const Module *M = any_cast<const Module *>(IR);
+    ProfiledUnit U{M->getName().str(), "module"};
+    for (const Function &F : *M)
+      U.Insts += F.getInstructionCount();
+    return U;
+  }
+  if (any_isa<const Function *>(IR)) {
+    const Function *F = any_cast<const Function *>(IR);
+    return ProfiledUnit{F->getName().str(), "function",
+                        F->getInstructionCount()};
+  }
+  if (any_isa<const LazyCallGraph::SCC *>(IR)) {
+    const LazyCallGraph::SCC *C = any_cast<const LazyCallGraph::SCC *>(IR);
+    ProfiledUnit U{C->getName(), "cgscc"};
+    for (const LazyCallGraph::Node &N : *C)
+      U.Insts += N.getFunction().getInstructionCount();
+    return U;
+  }
+  if (any_isa<const Loop *>(IR)) {
+    const Function *F = any_cast<const Loop *>(IR)->getHeader()->getParent();
+    return ProfiledUnit{F->getName().str(), "loop", F->getInstructionCount()};
+  }
+  return None;
+}
+
+} // namespace
+
+PassProfileInstrumentation::~PassProfileInstrumentation() {
+  if (PassProfileFile.empty() || Entries.empty())
+    return;
+
+  std::error_code EC;
+  raw_fd_ostream OS(PassProfileFile, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "warning: could not open pass profile '" << PassProfileFile
+           << "': " << EC.message() << "\n";
+    return;
+  }
+  print(OS);
+}
+
+void PassProfileInstrumentation::registerCallbacks(
+    PassInstrumentationCallbacks &PIC) {
+  if (PassProfileFile.empty())
+    return;
+
+  PIC.registerBeforeNonSkippedPassCallback(
+      [this](StringRef P, Any IR) { this->startPass(P, IR); });
+  PIC.registerAfterPassCallback(
+      [this](StringRef P, Any IR, const PreservedAnalyses &) {
+        this->finishPass(IR);
+      });
+  PIC.registerAfterPassInvalidatedCallback(
+      [this](StringRef P, const PreservedAnalyses &) {
+        this->finishPass(None);
+      });
+  PIC.registerAnalysisInvalidatedCallback(
+      [this](StringRef P, Any IR) { this->analysisInvalidated(); });
+}
+
+void PassProfileInstrumentation::startPass(StringRef PassID, Any IR) {
+  ThreadState &TS = Threads[llvm::get_threadid()];
+  TS.LastFinished = None;
+
+  // Adaptors and managers are pushed too, so that every After callback pops
+  // exactly one entry, but they get an empty key and are never reported.
+  static const std::vector<StringRef> SpecialPasses = {
+      "PassManager", "PassAdaptor", "AnalysisManagerProxy"};
+  Optional<ProfiledUnit> U;
+  if (!isSpecialPass(PassID, SpecialPasses))
+    U = getProfiledUnit(IR);
+  if (!U) {
+    TS.Running.push_back({EntryKey(), StringRef(), 0, Clock::now()});
+    return;
+  }
+  TS.Running.push_back(
+      {EntryKey(PassID.str(), std::move(U->Name)), U->Kind, U->Insts, {}});
+  // Start the clock last so that the bookkeeping above is not charged to the
+  // pass.
+  TS.Running.back().Start = Clock::now();
+}
+
+void PassProfileInstrumentation::finishPass(Optional<Any> IR) {
+  Clock::time_point End = Clock::now();
+  ThreadState &TS = Threads[llvm::get_threadid()];
+  assert(!TS.Running.empty() && "pass finished without being started");
+  RunningPass RP = std::move(TS.Running.back());
+  TS.Running.pop_back();
+  if (RP.Key.first.empty())
+    return;
+
+  Entry &E = Entries[RP.Key];
+  E.Kind = RP.Kind;
+  ++E.Runs;
+  E.Time += End - RP.Start;
+  // An IR unit the pass invalidated may no longer exist; it has no size
+  // afterwards to compare against.
+  if (IR)
+    if (Optional<ProfiledUnit> U = getProfiledUnit(*IR))
+      E.InstDelta += int64_t(U->Insts) - int64_t(RP.InstsBefore);
+  TS.LastFinished = std::move(RP.Key);
+}
+
+void PassProfileInstrumentation::analysisInvalidated() {
+  // The pass manager invalidates analyses right after the pass that did not
+  // preserve them. Invalidations seen while a pass is running come from a
+  // nested pass manager; charge them to the enclosing pass.
+  ThreadState &TS = Threads[llvm::get_threadid()];
+  const EntryKey *Key = TS.LastFinished.getPointer();
+  if (!Key) {
+    auto It = llvm::find_if(
+        llvm::reverse(TS.Running),
+        [](const RunningPass &RP) { return !RP.Key.first.empty(); });
+    if (It == TS.Running.rend())
+      return;
+    Key = &It->Key;
+  }
+  ++Entries[*Key].Invalidations;
+}
+
+void PassProfileInstrumentation::print(raw_ostream &OS) const {
+  std::vector<std::pair<const EntryKey *, const Entry *>> Sorted;
+  for (const auto &KV : Entries)
+    Sorted.emplace_back(&KV.first, &KV.second);
+  llvm::stable_sort(Sorted, [](const auto &LHS, const auto &RHS) {
+    return LHS.second->Time > RHS.second->Time;
+  });
+
+  json::OStream J(OS, 2);
+  J.object([&] {
+    J.attributeArray("passes", [&] {
+      for (const auto &P : Sorted) {
+        const Entry &E = *P.second;
+        J.object([&] {
+          J.attribute("pass", P.first->first);
+          J.attribute("ir", E.Kind);
+          J.attribute("name", P.first->second);
+          J.attribute("runs", int64_t(E.Runs));
+          J.attribute(
+              "wall_ms",
+              std::chrono::duration<double, std::milli>(E.Time).count());
+          J.attribute("inst_delta", E.InstDelta);
+          J.attribute("invalidations", int64_t(E.Invalidations));
+        });
+      }
+    });
+  });
+  OS << "\n";
+}
+
 void StandardInstrumentations::registerCallbacks(
     PassInstrumentationCallbacks &PIC) {
   PrintIR.registerCallbacks(PIC);
@@ -508,4 +681,5 @@ void StandardInstrumentations::registerCallbacks(
   TimePasses.registerCallbacks(PIC);
   OptNone.registerCallbacks(PIC);
   PreservedCFGChecker.registerCallbacks(PIC);
+  PassProfile.registerCallbacks(PIC);
 }
@@ -0,0 +1,295 @@
+//===- MemProf.cpp - Memory profile data structures -------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the symbolized memory profile records and the reader and
+// writer of the indexed memory profile.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ProfileData/MemProf.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/Support/Endian.h"
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::memprof;
+
+void PortableMemInfoBlock::merge(const PortableMemInfoBlock &Other) {
+  if (!Other.AllocCount)
+    return;
+  if (!AllocCount) {
+    *this = Other;
+    return;
+  }
+#define MIBEntryDef(Name, Type, Merge) merge##Merge(Name, Other.Name);
+  auto mergeSum = [](auto &A, auto B) { A += B; };
+  auto mergeMin = [](auto &A, auto B) { A = std::min(A, B); };
+  auto mergeMax = [](auto &A, auto B) { A = std::max(A, B); };
+#include "llvm/ProfileData/MIBEntryDef.inc"
+}
+
+void PortableMemInfoBlock::serialize(raw_ostream &OS) const {
+  using namespace support;
+
+  endian::Writer LE(OS, little);
+#define MIBEntryDef(Name, Type, Merge) LE.write<Type>(Name);
+#include "llvm/ProfileData/MIBEntryDef.inc"
+}
+
+PortableMemInfoBlock
+PortableMemInfoBlock::deserialize(const unsigned char *&Ptr) {
+  using namespace support;
+
+  PortableMemInfoBlock Block;
+#define MIBEntryDef(Name, Type, Merge)                                         \
+  Block.Name = endian::readNext<Type, little, unaligned>(Ptr);
+#include "llvm/ProfileData/MIBEntryDef.inc"
+  return Block;
+}
+
+void PortableMemInfoBlock::printYAML(raw_ostream &OS) const {
+  OS << "      MemInfoBlock:\n";
+#define MIBEntryDef(Name, Type, Merge)                                         \
+  OS << "        " #Name ": " << Name << "\n";
+#include "llvm/ProfileData/MIBEntryDef.inc"
+}
+
+bool PortableMemInfoBlock::operator==(const PortableMemInfoBlock &Other) const {
+#define MIBEntryDef(Name, Type, Merge)                                         \
+  if (Name != Other.Name)                                                      \
+    return false;
+#include "llvm/ProfileData/MIBEntryDef.inc"
+  return true;
+}
+
+void Frame::serialize(raw_ostream &OS) const {
+  using namespace support;
+
+  endian::Writer LE(OS, little);
+  LE.write<uint64_t>(Function);
+  LE.write<uint32_t>(LineOffset);
+  LE.write<uint32_t>(Column);
+  LE.write<uint8_t>(IsInlineFrame);
+}
+
+Frame Frame::deserialize(const unsigned char *&Ptr) {
+  using namespace support;
+
+  Frame F;
+  F.Function = endian::readNext<uint64_t, little, unaligned>(Ptr);
+  F.LineOffset = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  F.Column = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  F.IsInlineFrame = endian::readNext<uint8_t, little, unaligned>(Ptr);
+  return F;
+}
+
+void Frame::printYAML(raw_ostream &OS) const {
+  OS << "      -\n"
+     << "        Function: " << Function << "\n"
+     << "        LineOffset: " << LineOffset << "\n"
+     << "        Column: " << Column << "\n"
+     << "        Inline: " << IsInlineFrame << "\n";
+}
+
+void MemProfRecord::addAllocSite(const AllocationInfo &Site) {
+  for (AllocationInfo &Existing : AllocSites)
+    if (Existing.CallStack == Site.CallStack) {
+      Existing.Info.merge(Site.Info);
+      return;
+    }
+  AllocSites.push_back(Site);
+}
+
+void MemProfRecord::merge(const MemProfRecord &Other) {
+  for (const AllocationInfo &Site : Other.AllocSites)
+    addAllocSite(Site);
+}
+
+size_t MemProfRecord::getSerializedSize() const {
+  size_t Size = sizeof(uint64_t);
+  for (const AllocationInfo &Site : AllocSites)
+    Size += sizeof(uint64_t) +
+            Site.CallStack.size() * Frame::getSerializedSize() +
+            PortableMemInfoBlock::getSerializedSize();
+  return Size;
+}
+
+void MemProfRecord::serialize(raw_ostream &OS) const {
+  using namespace support;
+
+  endian::Writer LE(OS, little);
+  LE.write<uint64_t>(AllocSites.size());
+  for (const AllocationInfo &Site : AllocSites) {
+    LE.write<uint64_t>(Site.CallStack.size());
+    for (const Frame &F : Site.CallStack)
+      F.serialize(OS);
+    Site.Info.serialize(OS);
+  }
+}
+
+Expected<MemProfRecord> MemProfRecord::deserialize(const unsigned char *Ptr,
+                                                   uint64_t Size) {
+  using namespace support;
+
+  // A site is at least its number of frames and its statistics.
+  const uint64_t MinSiteSize =
+      sizeof(uint64_t) + PortableMemInfoBlock::getSerializedSize();
+  const unsigned char *End = Ptr + Size;
+  if (Size < sizeof(uint64_t))
+    return make_error<InstrProfError>(instrprof_error::truncated);
+  MemProfRecord Record;
+  uint64_t NumSites = endian::readNext<uint64_t, little, unaligned>(Ptr);
+  if (NumSites > uint64_t(End - Ptr) / MinSiteSize)
+    return make_error<InstrProfError>(instrprof_error::malformed);
+  Record.AllocSites.resize(NumSites);
+  for (AllocationInfo &Site : Record.AllocSites) {
+    if (uint64_t(End - Ptr) < MinSiteSize)
+      return make_error<InstrProfError>(instrprof_error::truncated);
+    uint64_t NumFrames = endian::readNext<uint64_t, little, unaligned>(Ptr);
+    if (NumFrames > (uint64_t(End - Ptr) -
+                     PortableMemInfoBlock::getSerializedSize()) /
+                        Frame::getSerializedSize())
+      return make_error<InstrProfError>(instrprof_error::malformed);
+    for (uint64_t I = 0; I < NumFrames; ++I)
+      Site.CallStack.push_back(Frame::deserialize(Ptr));
+    Site.Info = PortableMemInfoBlock::deserialize(Ptr);
+  }
+  return Record;
+}
+
+MemProfRecordLookupTrait::data_type
+MemProfRecordLookupTrait::ReadData(uint64_t, const unsigned char *D,
+                                   offset_type N) const {
+  if (D > End || N > uint64_t(End - D))
+    return make_error<InstrProfError>(instrprof_error::truncated);
+  return MemProfRecord::deserialize(D, N);
+}
+
+void MemProfRecord::printYAML(raw_ostream &OS) const {
+  OS << "  AllocSites:\n";
+  for (const AllocationInfo &Site : AllocSites) {
+    OS << "  -\n"
+       << "    Callstack:\n";
+    for (const Frame &F : Site.CallStack)
+      F.printYAML(OS);
+    Site.Info.printYAML(OS);
+  }
+}
+
+void MemProfWriter::addRecord(uint64_t Function, const MemProfRecord &Record) {
+  Records[Function].merge(Record);
+}
+
+void MemProfWriter::addRecords(const RecordMap &Records) {
+  for (const auto &KV : Records)
+    addRecord(KV.first, KV.second);
+}
+
+void MemProfWriter::write(raw_ostream &OS) {
+  using namespace support;
+
+  // The offset of the table is only known once the records are emitted, so
+  // the profile is built in memory and the header patched before it is
+  // written out.
+  SmallString<4096> Data;
+  raw_svector_ostream DataOS(Data);
+  endian::Writer LE(DataOS, little);
+  LE.write<uint64_t>(IndexedMagic);
+  LE.write<uint64_t>(IndexedVersion);
+  LE.write<uint64_t>(0);
+
+  OnDiskChainedHashTableGenerator<MemProfRecordWriterTrait> Generator;
+  for (auto &KV : Records)
+    Generator.insert(KV.first, KV.second);
+  MemProfRecordWriterTrait Trait;
+  uint64_t TableOffset = Generator.Emit(DataOS, Trait);
+
+  endian::write<uint64_t, little, unaligned>(
+      Data.data() + offsetof(IndexedHeader, TableOffset), TableOffset);
+  OS << Data;
+}
+
+std::unique_ptr<MemoryBuffer> MemProfWriter::writeBuffer() {
+  std::string Data;
+  raw_string_ostream OS(Data);
+  write(OS);
+  return MemoryBuffer::getMemBufferCopy(OS.str());
+}
+
+bool IndexedMemProfReader::hasFormat(const MemoryBuffer &Buffer) {
+  using namespace support;
+
+  if (Buffer.getBufferSize() < sizeof(IndexedHeader))
+    return false;
+  return endian::read<uint64_t, little, unaligned>(Buffer.getBufferStart()) ==
+         IndexedMagic;
+}
+
+Expected<std::unique_ptr<IndexedMemProfReader>>
+IndexedMemProfReader::create(const Twine &Path) {
+  auto BufferOrErr = MemoryBuffer::getFileOrSTDIN(Path);
+  if (std::error_code EC = BufferOrErr.getError())
+    return errorCodeToError(EC);
+  return create(std::move(BufferOrErr.get()));
+}
+
+Expected<std::unique_ptr<IndexedMemProfReader>>
+IndexedMemProfReader::create(std::unique_ptr<MemoryBuffer> Buffer) {
+  std::unique_ptr<IndexedMemProfReader> Reader(
+      new IndexedMemProfReader(std::move(Buffer)));
+  if (Error E = Reader->readHeader())
+    return std::move(E);
+  return std::move(Reader);
+}
+
+Error IndexedMemProfReader::readHeader() {
+  using namespace support;
+
+  if (!hasFormat(*Buffer))
+    return make_error<InstrProfError>(instrprof_error::bad_magic);
+
+  const unsigned char *Start =
+      reinterpret_cast<const unsigned char *>(Buffer->getBufferStart());
+  const unsigned char *Ptr = Start + sizeof(uint64_t);
+  uint64_t Version = endian::readNext<uint64_t, little, unaligned>(Ptr);
+  if (Version != IndexedVersion)
+    return make_error<InstrProfError>(instrprof_error::unsupported_version);
+  uint64_t TableOffset = endian::readNext<uint64_t, little, unaligned>(Ptr);
+  // The buckets start with the number of buckets and entries, followed by the
+  // offset of each bucket.
+  uint64_t Size = Buffer->getBufferSize();
+  if (TableOffset < sizeof(IndexedHeader) ||
+      TableOffset > Size - 2 * sizeof(uint64_t))
+    return make_error<InstrProfError>(instrprof_error::truncated);
+  const unsigned char *Buckets = Start + TableOffset;
+  uint64_t NumBuckets = endian::read<uint64_t, little, unaligned>(Buckets);
+  if (NumBuckets > (Size - TableOffset - 2 * sizeof(uint64_t)) /
+                       sizeof(uint64_t))
+    return make_error<InstrProfError>(instrprof_error::truncated);
+  for (uint64_t I = 0; I < NumBuckets; ++I) {
+    uint64_t Offset = endian::read<uint64_t, little, unaligned>(
+        Buckets + (2 + I) * sizeof(uint64_t));
+    if (Offset >= Size)
+      return make_error<InstrProfError>(instrprof_error::malformed);
+  }
+
+  Table.reset(OnDiskHashTableType::Create(
+      Buckets, /*Payload=*/Ptr, /*Base=*/Start,
+      MemProfRecordLookupTrait(
+          reinterpret_cast<const unsigned char *>(Buffer->getBufferEnd()))));
+  return Error::success();
+}
+
+Expected<MemProfRecord>
+IndexedMemProfReader::getRecord(uint64_t Function) const {
+  auto Iter = Table->find(Function);
+  if (Iter == Table->end())
+    return make_error<InstrProfError>(instrprof_error::unknown_function);
+  return *Iter;
+}
@@ -0,0 +1,266 @@
+//===- RawMemProfReader.cpp - Raw memory profile reader ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the reader of the raw profiles written by the MemProf
+// runtime.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ProfileData/RawMemProfReader.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/DebugInfo/Symbolize/SymbolizableObjectFile.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/Support/Endian.h"
+
+using namespace llvm;
+using namespace llvm::memprof;
+
+namespace {
+
+template <class T> T readNext(const char *&Ptr) {
+  using namespace support;
+  return endian::readNext<T, little, unaligned>(Ptr);
+}
+
+// Read the count of the section at \p Offset of the profile, checking that
+// its \p EntrySize byte entries are within \p Size.
+Expected<uint64_t> readSectionCount(const char *Start, uint64_t Size,
+                                    uint64_t Offset, uint64_t EntrySize,
+                                    const char *&Ptr) {
+  if (Offset > Size || Size - Offset < sizeof(uint64_t))
+    return make_error<InstrProfError>(instrprof_error::truncated);
+  Ptr = Start + Offset;
+  uint64_t Count = readNext<uint64_t>(Ptr);
+  if (Count > (Size - Offset - sizeof(uint64_t)) / EntrySize)
+    return make_error<InstrProfError>(instrprof_error::malformed);
+  return Count;
+}
+
+} // end anonymous namespace
+
+bool RawMemProfReader::hasFormat(const MemoryBuffer &Buffer) {
+  using namespace support;
+
+  if (Buffer.getBufferSize() < sizeof(uint64_t))
+    return false;
+  return endian::read<uint64_t, little, unaligned>(Buffer.getBufferStart()) ==
+         MEMPROF_RAW_MAGIC_64;
+}
+
+bool RawMemProfReader::hasFormat(const Twine &Path) {
+  auto BufferOrErr = MemoryBuffer::getFileOrSTDIN(Path);
+  if (!BufferOrErr)
+    return false;
+  return hasFormat(*BufferOrErr.get());
+}
+
+Expected<std::unique_ptr<RawMemProfReader>>
+RawMemProfReader::create(const Twine &Path, StringRef ProfiledBinary) {
+  auto BufferOrErr = MemoryBuffer::getFileOrSTDIN(Path);
+  if (std::error_code EC = BufferOrErr.getError())
+    return errorCodeToError(EC);
+
+  auto BinaryOrErr = object::createBinary(ProfiledBinary);
+  if (!BinaryOrErr)
+    return BinaryOrErr.takeError();
+  // The runtime only records the mappings of ELF binaries.
+  auto *ElfObject =
+      dyn_cast<object::ELF64LEObjectFile>(BinaryOrErr->getBinary());
+  if (!ElfObject)
+    return make_error<StringError>("profiled binary " + ProfiledBinary +
+                                       " is not a 64-bit little endian ELF "
+                                       "file",
+                                   inconvertibleErrorCode());
+
+  auto SymbolizerOrErr = symbolize::SymbolizableObjectFile::create(
+      ElfObject, DWARFContext::create(*ElfObject), /*UntagAddresses=*/false);
+  if (!SymbolizerOrErr)
+    return SymbolizerOrErr.takeError();
+
+  std::unique_ptr<RawMemProfReader> Reader(new RawMemProfReader(
+      std::move(BufferOrErr.get()), std::move(SymbolizerOrErr.get())));
+
+  auto PhdrsOrErr = ElfObject->getELFFile()->program_headers();
+  if (!PhdrsOrErr)
+    return PhdrsOrErr.takeError();
+  for (const auto &Phdr : *PhdrsOrErr)
+    if (Phdr.p_type == ELF::PT_LOAD)
+      Reader->LoadSegments.push_back({uint64_t(Phdr.p_offset),
+                                      uint64_t(Phdr.p_filesz),
+                                      uint64_t(Phdr.p_vaddr)});
+  Reader->Binary = std::move(BinaryOrErr.get());
+
+  if (Error E = Reader->readProfiles())
+    return std::move(E);
+  return std::move(Reader);
+}
+
+Expected<std::unique_ptr<RawMemProfReader>>
+RawMemProfReader::create(std::unique_ptr<MemoryBuffer> Buffer,
+                         std::unique_ptr<symbolize::SymbolizableModule>
+                             Symbolizer) {
+  std::unique_ptr<RawMemProfReader> Reader(
+      new RawMemProfReader(std::move(Buffer), std::move(Symbolizer)));
+  if (Error E = Reader->readProfiles())
+    return std::move(E);
+  return std::move(Reader);
+}
+
+Error RawMemProfReader::readProfiles() {
+  if (!hasFormat(*Buffer))
+    return make_error<InstrProfError>(instrprof_error::bad_magic);
+  // The MemInfoBlocks are copied as they are laid out by the runtime, which
+  // only runs on little-endian hosts.
+  if (sys::IsBigEndianHost)
+    return make_error<InstrProfError>(instrprof_error::unrecognized_format);
+
+  const char *Next = Buffer->getBufferStart();
+  const char *End = Buffer->getBufferEnd();
+  while (Next < End) {
+    if (uint64_t(End - Next) < sizeof(Header))
+      return make_error<InstrProfError>(instrprof_error::truncated);
+    const char *Ptr = Next;
+    if (readNext<uint64_t>(Ptr) != MEMPROF_RAW_MAGIC_64)
+      return make_error<InstrProfError>(instrprof_error::bad_magic);
+    if (readNext<uint64_t>(Ptr) != MEMPROF_RAW_VERSION)
+      return make_error<InstrProfError>(instrprof_error::unsupported_version);
+    uint64_t TotalSize = readNext<uint64_t>(Ptr);
+    if (TotalSize < sizeof(Header) || TotalSize > uint64_t(End - Next))
+      return make_error<InstrProfError>(instrprof_error::malformed);
+
+    if (Error E = readProfile(Next, TotalSize))
+      return E;
+    Next += TotalSize;
+  }
+  return Error::success();
+}
+
+Error RawMemProfReader::readProfile(const char *Start, uint64_t Size) {
+  const char *Ptr = Start + offsetof(Header, SegmentOffset);
+  uint64_t SegmentOffset = readNext<uint64_t>(Ptr);
+  uint64_t MIBOffset = readNext<uint64_t>(Ptr);
+  uint64_t StackOffset = readNext<uint64_t>(Ptr);
+
+  // The stacks are referenced by the MIBs, so read them first.
+  auto NumStacksOrErr = readSectionCount(Start, Size, StackOffset,
+                                         2 * sizeof(uint64_t), Ptr);
+  if (!NumStacksOrErr)
+    return NumStacksOrErr.takeError();
+  DenseMap<uint64_t, ArrayRef<uint64_t>> StackPCs;
+  SmallVector<uint64_t, 256> PCs;
+  SmallVector<std::pair<uint64_t, std::pair<size_t, size_t>>, 64> Stacks;
+  const char *SectionEnd = Start + Size;
+  for (uint64_t I = 0; I < *NumStacksOrErr; ++I) {
+    if (SectionEnd - Ptr < 2 * int64_t(sizeof(uint64_t)))
+      return make_error<InstrProfError>(instrprof_error::truncated);
+    uint64_t StackId = readNext<uint64_t>(Ptr);
+    uint64_t NumPCs = readNext<uint64_t>(Ptr);
+    if (NumPCs > uint64_t(SectionEnd - Ptr) / sizeof(uint64_t))
+      return make_error<InstrProfError>(instrprof_error::truncated);
+    Stacks.push_back({StackId, {PCs.size(), NumPCs}});
+    for (uint64_t J = 0; J < NumPCs; ++J)
+      PCs.push_back(readNext<uint64_t>(Ptr));
+  }
+  for (const auto &Stack : Stacks)
+    StackPCs[Stack.first] =
+        makeArrayRef(PCs).slice(Stack.second.first, Stack.second.second);
+
+  auto NumSegmentsOrErr = readSectionCount(Start, Size, SegmentOffset,
+                                           sizeof(SegmentEntry), Ptr);
+  if (!NumSegmentsOrErr)
+    return NumSegmentsOrErr.takeError();
+  SmallVector<SegmentEntry, 4> Segments;
+  for (uint64_t I = 0; I < *NumSegmentsOrErr; ++I) {
+    SegmentEntry Segment;
+    Segment.Start = readNext<uint64_t>(Ptr);
+    Segment.End = readNext<uint64_t>(Ptr);
+    Segment.Offset = readNext<uint64_t>(Ptr);
+    Segments.push_back(Segment);
+  }
+
+  auto NumMIBsOrErr = readSectionCount(
+      Start, Size, MIBOffset, sizeof(uint64_t) + sizeof(MemInfoBlock), Ptr);
+  if (!NumMIBsOrErr)
+    return NumMIBsOrErr.takeError();
+  for (uint64_t I = 0; I < *NumMIBsOrErr; ++I) {
+    uint64_t StackId = readNext<uint64_t>(Ptr);
+    MemInfoBlock MIB;
+    memcpy(&MIB, Ptr, sizeof(MemInfoBlock));
+    Ptr += sizeof(MemInfoBlock);
+
+    auto Stack = StackPCs.find(StackId);
+    if (Stack == StackPCs.end())
+      return make_error<InstrProfError>(instrprof_error::malformed);
+    SmallVector<Frame, 16> CallStack;
+    for (uint64_t PC : Stack->second)
+      symbolizePC(PC, Segments, CallStack);
+    // Allocations made only from outside of the binary, e.g. from a shared
+    // library, can't be attributed to its code.
+    if (CallStack.empty())
+      continue;
+
+    Records[CallStack.front().Function].addAllocSite(
+        AllocationInfo(CallStack, PortableMemInfoBlock(MIB)));
+  }
+  return Error::success();
+}
+
+void RawMemProfReader::symbolizePC(uint64_t PC,
+                                   ArrayRef<SegmentEntry> Segments,
+                                   SmallVectorImpl<Frame> &CallStack) {
+  auto Segment = llvm::find_if(Segments, [PC](const SegmentEntry &S) {
+    return S.Start <= PC && PC < S.End;
+  });
+  if (Segment == Segments.end())
+    return;
+
+  // Translate the PC to the file offset it was mapped from, then to the
+  // address of the binary the debug info refers to.
+  uint64_t Address = PC - Segment->Start + Segment->Offset;
+  if (!LoadSegments.empty()) {
+    auto Load = llvm::find_if(LoadSegments, [Address](const LoadSegment &L) {
+      return L.Offset <= Address && Address < L.Offset + L.Size;
+    });
+    if (Load == LoadSegments.end())
+      return;
+    Address = Address - Load->Offset + Load->VAddr;
+  }
+
+  auto Inserted = SymbolizedFrames.try_emplace(Address);
+  SmallVectorImpl<Frame> &Frames = Inserted.first->second;
+  if (Inserted.second) {
+    DIInliningInfo Info = Symbolizer->symbolizeInlinedCode(
+        {Address, object::SectionedAddress::UndefSection},
+        DILineInfoSpecifier(
+            DILineInfoSpecifier::FileLineInfoKind::RawValue,
+            DILineInfoSpecifier::FunctionNameKind::LinkageName),
+        /*UseSymbolTable=*/false);
+    uint32_t NumFrames = Info.getNumberOfFrames();
+    for (uint32_t I = 0; I < NumFrames; ++I) {
+      const DILineInfo &Line = Info.getFrame(I);
+      // Frames without debug info can't be matched to the code.
+      if (Line.FunctionName == DILineInfo::BadString)
+        continue;
+      Frames.emplace_back(GlobalValue::getGUID(Line.FunctionName),
+                          Line.Line - Line.StartLine, Line.Column,
+                          /*IsInlineFrame=*/I != NumFrames - 1);
+    }
+  }
+  CallStack.append(Frames.begin(), Frames.end());
+}
+
+void RawMemProfReader::printYAML(raw_ostream &OS) const {
+  OS << "MemprofProfile:\n";
+  for (const auto &KV : Records) {
+    OS << "-\n"
+       << "  Function: " << KV.first << "\n";
+    KV.second.printYAML(OS);
+  }
+}
@@ -11,16 +11,23 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/CachePruning.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
 
 #define DEBUG_TYPE "cache-pruning"
 
+#include <cstring>
 #include <set>
 #include <system_error>
 
@@ -41,6 +48,204 @@ struct FileInfo {
 };
 } // anonymous namespace
 
+// The index of a cache directory is the file "llvmcache.index". It starts with
+// a header holding the total size and number of entries of the cache, followed
+// by an append-only log of the entries added since the cache was last pruned.
+// Each log record is the size of the entry followed by its length-prefixed key.
+// The file is locked while it is read or updated, so that the accounting is
+// atomic across the processes sharing the cache. Processes racing with a
+// pruner may leave the totals slightly off; the next pruning corrects them.
+static const char CacheIndexMagic[] = "LLVMCIX1";
+static const uint64_t CacheIndexHeaderSize = 24;
+
+namespace {
+struct CacheIndexTotals {
+  uint64_t Size = 0;
+  uint64_t NumFiles = 0;
+};
+} // anonymous namespace
+
+/// Open and lock the index of the cache directory \p Path. Returns -1 if the
+/// index does not exist and \p Create is false, or on error.
+static int openCacheIndex(StringRef Path, bool Create) {
+  SmallString<128> IndexPath(Path);
+  sys::path::append(IndexPath, "llvmcache.index");
+  int FD;
+  if (sys::fs::openFileForReadWrite(IndexPath, FD,
+                                    Create ? sys::fs::CD_OpenAlways
+                                           : sys::fs::CD_OpenExisting,
+                                    sys::fs::OF_None))
+    return -1;
+  if (sys::fs::lockFile(FD)) {
+    sys::Process::SafelyCloseFileDescriptor(FD);
+    return -1;
+  }
+  return FD;
+}
+
+static void closeCacheIndex(int FD) {
+  sys::fs::unlockFile(FD);
+  sys::Process::SafelyCloseFileDescriptor(FD);
+}
+
+static Optional<CacheIndexTotals> readCacheIndexHeader(int FD) {
+  char Buf[CacheIndexHeaderSize];
+  Expected<size_t> ReadOrErr = sys::fs::readNativeFileSlice(
+      sys::fs::convertFDToNativeFile(FD), Buf, /*Offset=*/0);
+  if (!ReadOrErr) {
+    consumeError(ReadOrErr.takeError());
+    return None;
+  }
+  if (*ReadOrErr != CacheIndexHeaderSize ||
+      StringRef(Buf, 8) != CacheIndexMagic)
+    return None;
+  CacheIndexTotals Totals;
+  Totals.Size = support::endian::read64le(Buf + 8);
+  Totals.NumFiles = support::endian::read64le(Buf + 16);
+  return Totals;
+}
+
+static void writeCacheIndexHeader(raw_fd_ostream &OS,
+                                  const CacheIndexTotals &Totals) {
+  OS.seek(0);
+  OS << StringRef(CacheIndexMagic);
+  support::endian::write<uint64_t>(OS, Totals.Size, support::little);
+  support::endian::write<uint64_t>(OS, Totals.NumFiles, support::little);
+}
+
+static void writeCacheIndexRecord(raw_fd_ostream &OS, StringRef Key,
+                                  uint64_t Size) {
+  support::endian::write<uint64_t>(OS, Size, support::little);
+  support::endian::write<uint64_t>(OS, Key.size(), support::little);
+  OS << Key;
+}
+
+static uint64_t getFileSize(int FD) {
+  sys::fs::file_status Status;
+  if (sys::fs::status(FD, Status))
+    return 0;
+  return Status.getSize();
+}
+
+std::string llvm::getCacheEntryPath(StringRef Path, StringRef Key) {
+  uint8_t Shard = xxHash64(Key) & 0xff;
+  char ShardName[] = {hexdigit(Shard >> 4, /*LowerCase=*/true),
+                      hexdigit(Shard & 0xf, /*LowerCase=*/true), 0};
+  SmallString<128> EntryPath(Path);
+  sys::path::append(EntryPath, ShardName, "llvmcache-" + Key);
+  return std::string(EntryPath.str());
+}
+
+void llvm::addCacheIndexEntry(StringRef Path, StringRef Key, uint64_t Size) {
+  // The index is only used to speed up pruning, so it is fine to give up on
+  // errors.
+  int FD = openCacheIndex(Path, /*Create=*/true);
+  if (FD < 0)
+    return;
+  Optional<CacheIndexTotals> Totals = readCacheIndexHeader(FD);
+  uint64_t End = getFileSize(FD);
+  if (!Totals || End < CacheIndexHeaderSize) {
+    // A new or corrupted index; start over.
+    sys::fs::resize_file(FD, 0);
+    Totals = CacheIndexTotals();
+    End = CacheIndexHeaderSize;
+  }
+  Totals->Size += Size;
+  ++Totals->NumFiles;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/false);
+    writeCacheIndexHeader(OS, *Totals);
+    OS.seek(End);
+    writeCacheIndexRecord(OS, Key, Size);
+  }
+  closeCacheIndex(FD);
+}
+
+/// Rewrite the index of the cache directory \p Path after pruning, given the
+/// entries that survived the pruning. The entries logged after \p LogStart
+/// were added while the cache was being scanned, and are kept as well. The log
+/// itself is dropped.
+static void rewriteCacheIndex(StringRef Path, uint64_t LogStart,
+                              StringMap<uint64_t> &Entries) {
+  int FD = openCacheIndex(Path, /*Create=*/false);
+  if (FD < 0)
+    return;
+  uint64_t End = getFileSize(FD);
+  LogStart = std::max(LogStart, CacheIndexHeaderSize);
+  if (readCacheIndexHeader(FD) && LogStart < End) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+        MemoryBuffer::getOpenFileSlice(sys::fs::convertFDToNativeFile(FD),
+                                       "llvmcache.index", End - LogStart,
+                                       LogStart);
+    if (MBOrErr) {
+      StringRef Log = (*MBOrErr)->getBuffer();
+      while (Log.size() >= 16) {
+        uint64_t Size = support::endian::read64le(Log.data());
+        uint64_t KeySize = support::endian::read64le(Log.data() + 8);
+        Log = Log.drop_front(16);
+        if (KeySize > Log.size())
+          break;
+        Entries[Log.take_front(KeySize)] = Size;
+        Log = Log.drop_front(KeySize);
+      }
+    }
+  }
+
+  CacheIndexTotals Totals;
+  for (const auto &Entry : Entries) {
+    Totals.Size += Entry.getValue();
+    ++Totals.NumFiles;
+  }
+  sys::fs::resize_file(FD, 0);
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/false);
+    writeCacheIndexHeader(OS, Totals);
+  }
+  closeCacheIndex(FD);
+}
+
+/// Return the size the cache must be pruned down to, given its current size.
+static ErrorOr<uint64_t> getTotalSizeTarget(StringRef Path,
+                                            CachePruningPolicy Policy,
+                                            uint64_t TotalSize) {
+  auto ErrOrSpaceInfo = sys::fs::disk_space(Path);
+  if (!ErrOrSpaceInfo)
+    return ErrOrSpaceInfo.getError();
+  sys::fs::space_info SpaceInfo = ErrOrSpaceInfo.get();
+  auto AvailableSpace = TotalSize + SpaceInfo.free;
+
+  if (Policy.MaxSizePercentageOfAvailableSpace == 0)
+    Policy.MaxSizePercentageOfAvailableSpace = 100;
+  if (Policy.MaxSizeBytes == 0)
+    Policy.MaxSizeBytes = AvailableSpace;
+  return std::min<uint64_t>(AvailableSpace *
+                                Policy.MaxSizePercentageOfAvailableSpace /
+                                100ull,
+                            Policy.MaxSizeBytes);
+}
+
+/// Check the totals kept in the index of the cache directory \p Path against
+/// the size and file budgets of \p Policy, without scanning the cache.
+static bool isCacheOverBudget(StringRef Path,
+                              const CachePruningPolicy &Policy) {
+  int FD = openCacheIndex(Path, /*Create=*/false);
+  if (FD < 0)
+    return false;
+  Optional<CacheIndexTotals> Totals = readCacheIndexHeader(FD);
+  closeCacheIndex(FD);
+  if (!Totals)
+    return false;
+
+  if (Policy.MaxSizeFiles && Totals->NumFiles > Policy.MaxSizeFiles)
+    return true;
+  if (Policy.MaxSizePercentageOfAvailableSpace > 0 || Policy.MaxSizeBytes > 0) {
+    ErrorOr<uint64_t> Target = getTotalSizeTarget(Path, Policy, Totals->Size);
+    if (Target && Totals->Size > *Target)
+      return true;
+  }
+  return false;
+}
+
 /// Write a new timestamp file with the given path. This is used for the pruning
 /// interval option.
 static void writeTimestampFile(StringRef TimestampFile) {
@@ -141,7 +346,8 @@ llvm::parseCachePruningPolicy(StringRef PolicyStr) {
 }
 
 /// Prune the cache of files that haven't been accessed in a long time.
-bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
+bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy,
+                      CachePruningStats *Stats) {
   using namespace std::chrono;
 
   if (Path.empty())
@@ -165,6 +371,9 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
     return false;
   }
 
+  // The pruning interval is ignored if the cache is known to be over budget.
+  bool OverBudget = isCacheOverBudget(Path, Policy);
+
   // Try to stat() the timestamp file.
   SmallString<128> TimestampFile(Path);
   sys::path::append(TimestampFile, "llvmcache.timestamp");
@@ -186,7 +395,7 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
       // If not, do nothing.
       const auto TimeStampModTime = FileStatus.getLastModificationTime();
       auto TimeStampAge = CurrentTime - TimeStampModTime;
-      if (TimeStampAge <= *Policy.Interval) {
+      if (TimeStampAge <= *Policy.Interval && !OverBudget) {
         LLVM_DEBUG(dbgs() << "Timestamp file too recent ("
                           << duration_cast<seconds>(TimeStampAge).count()
                           << "s old), do not prune.\n");
@@ -199,47 +408,81 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
     writeTimestampFile(TimestampFile);
   }
 
+  // Remember where the index log ends, so that the entries added while the
+  // cache is being scanned are not lost when the index is rewritten.
+  uint64_t LogStart = 0;
+  int IndexFD = openCacheIndex(Path, /*Create=*/false);
+  if (IndexFD >= 0) {
+    LogStart = getFileSize(IndexFD);
+    closeCacheIndex(IndexFD);
+  }
+
   // Keep track of files to delete to get below the size limit.
   // Order by time of last use so that recently used files are preserved.
   std::set<FileInfo> FileInfos;
   uint64_t TotalSize = 0;
 
-  // Walk the entire directory cache, looking for unused files.
-  std::error_code EC;
-  SmallString<128> CachePathNative;
-  sys::path::native(Path, CachePathNative);
-  // Walk all of the files within this directory.
-  for (sys::fs::directory_iterator File(CachePathNative, EC), FileEnd;
-       File != FileEnd && !EC; File.increment(EC)) {
+  auto RemoveFile = [&](StringRef FilePath, uint64_t Size) {
+    if (sys::fs::remove(FilePath)) {
+      LLVM_DEBUG(dbgs() << "Can't remove " << FilePath << "\n");
+      return;
+    }
+    if (Stats) {
+      ++Stats->NumEvicted;
+      Stats->EvictedBytes += Size;
+    }
+  };
+
+  auto VisitFile = [&](const sys::fs::directory_entry &File) {
     // Ignore any files not beginning with the string "llvmcache-". This
-    // includes the timestamp file as well as any files created by the user.
-    // This acts as a safeguard against data loss if the user specifies the
-    // wrong directory as their cache directory.
-    if (!sys::path::filename(File->path()).startswith("llvmcache-"))
-      continue;
+    // includes the timestamp and index files as well as any files created by
+    // the user. This acts as a safeguard against data loss if the user
+    // specifies the wrong directory as their cache directory.
+    if (!sys::path::filename(File.path()).startswith("llvmcache-"))
+      return;
 
     // Look at this file. If we can't stat it, there's nothing interesting
     // there.
-    ErrorOr<sys::fs::basic_file_status> StatusOrErr = File->status();
+    ErrorOr<sys::fs::basic_file_status> StatusOrErr = File.status();
     if (!StatusOrErr) {
-      LLVM_DEBUG(dbgs() << "Ignore " << File->path() << " (can't stat)\n");
-      continue;
+      LLVM_DEBUG(dbgs() << "Ignore " << File.path() << " (can't stat)\n");
+      return;
     }
 
     // If the file hasn't been used recently enough, delete it
     const auto FileAccessTime = StatusOrErr->getLastAccessedTime();
     auto FileAge = CurrentTime - FileAccessTime;
     if (Policy.Expiration != seconds(0) && FileAge > Policy.Expiration) {
-      LLVM_DEBUG(dbgs() << "Remove " << File->path() << " ("
+      LLVM_DEBUG(dbgs() << "Remove " << File.path() << " ("
                         << duration_cast<seconds>(FileAge).count()
                         << "s old)\n");
-      sys::fs::remove(File->path());
-      continue;
+      RemoveFile(File.path(), StatusOrErr->getSize());
+      return;
     }
 
     // Leave it here for now, but add it to the list of size-based pruning.
     TotalSize += StatusOrErr->getSize();
-    FileInfos.insert({FileAccessTime, StatusOrErr->getSize(), File->path()});
+    FileInfos.insert({FileAccessTime, StatusOrErr->getSize(), File.path()});
+  };
+
+  // Walk the entire directory cache, looking for unused files.
+  std::error_code EC;
+  SmallString<128> CachePathNative;
+  sys::path::native(Path, CachePathNative);
+  // Walk all of the files within this directory, and within the shard
+  // directories, whose names are two hexadecimal digits.
+  for (sys::fs::directory_iterator File(CachePathNative, EC), FileEnd;
+       File != FileEnd && !EC; File.increment(EC)) {
+    StringRef Name = sys::path::filename(File->path());
+    if (Name.size() == 2 && isHexDigit(Name[0]) && isHexDigit(Name[1]) &&
+        sys::fs::is_directory(File->path())) {
+      std::error_code ShardEC;
+      for (sys::fs::directory_iterator ShardFile(File->path(), ShardEC);
+           ShardFile != FileEnd && !ShardEC; ShardFile.increment(ShardEC))
+        VisitFile(*ShardFile);
+      continue;
+    }
+    VisitFile(*File);
   }
 
   auto FileInfo = FileInfos.begin();
@@ -247,13 +490,13 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
 
   auto RemoveCacheFile = [&]() {
     // Remove the file.
-    sys::fs::remove(FileInfo->Path);
+    RemoveFile(FileInfo->Path, FileInfo->Size);
     // Update size
     TotalSize -= FileInfo->Size;
     NumFiles--;
     LLVM_DEBUG(dbgs() << " - Remove " << FileInfo->Path << " (size "
                       << FileInfo->Size << "), new occupancy is " << TotalSize
-                      << "%\n");
+                      << " bytes\n");
     ++FileInfo;
   };
 
@@ -264,29 +507,25 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
 
   // Prune for size now if needed
   if (Policy.MaxSizePercentageOfAvailableSpace > 0 || Policy.MaxSizeBytes > 0) {
-    auto ErrOrSpaceInfo = sys::fs::disk_space(Path);
-    if (!ErrOrSpaceInfo) {
+    ErrorOr<uint64_t> TotalSizeTarget =
+        getTotalSizeTarget(Path, Policy, TotalSize);
+    if (!TotalSizeTarget) {
       report_fatal_error("Can't get available size");
     }
-    sys::fs::space_info SpaceInfo = ErrOrSpaceInfo.get();
-    auto AvailableSpace = TotalSize + SpaceInfo.free;
-
-    if (Policy.MaxSizePercentageOfAvailableSpace == 0)
-      Policy.MaxSizePercentageOfAvailableSpace = 100;
-    if (Policy.MaxSizeBytes == 0)
-      Policy.MaxSizeBytes = AvailableSpace;
-    auto TotalSizeTarget = std::min<uint64_t>(
-        AvailableSpace * Policy.MaxSizePercentageOfAvailableSpace / 100ull,
-        Policy.MaxSizeBytes);
-
-    LLVM_DEBUG(dbgs() << "Occupancy: " << ((100 * TotalSize) / AvailableSpace)
-                      << "% target is: "
-                      << Policy.MaxSizePercentageOfAvailableSpace << "%, "
-                      << Policy.MaxSizeBytes << " bytes\n");
+
+    LLVM_DEBUG(dbgs() << "Occupancy: " << TotalSize << " bytes, target is: "
+                      << *TotalSizeTarget << " bytes\n");
 
     // Remove the oldest accessed files first, till we get below the threshold.
-    while (TotalSize > TotalSizeTarget && FileInfo != FileInfos.end())
+    while (TotalSize > *TotalSizeTarget && FileInfo != FileInfos.end())
       RemoveCacheFile();
   }
+
+  // Rewrite the index with the files that are left.
+  StringMap<uint64_t> Entries;
+  for (; FileInfo != FileInfos.end(); ++FileInfo)
+    Entries[sys::path::filename(FileInfo->Path).substr(strlen("llvmcache-"))] =
+        FileInfo->Size;
+  rewriteCacheIndex(Path, LogStart, Entries);
   return true;
 }
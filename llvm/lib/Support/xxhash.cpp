@@ -33,14 +33,32 @@
 */
 
 /* based on revision d2df04efcbef7d7f6886d345861e5dfda4edacc1 Removed
- * everything but a simple interface for computing XXh64. */
+ * everything but a simple interface for computing XXh64.
+ *
+ * XXH3 follows xxHash 0.8, reduced to the one-shot functions with the
+ * default secret and no seed. */
 
 #include "llvm/Support/xxhash.h"
+#include "llvm/Support/Compiler.h"
 #include "llvm/Support/Endian.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LLVM_XXH3_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// The AVX2 kernel is compiled with a target attribute and selected at run
+// time, so it does not need the whole library to be built for AVX2.
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define LLVM_XXH3_AVX2 1
+#include <immintrin.h>
+#endif
+
 using namespace llvm;
 using namespace support;
 
@@ -136,3 +154,543 @@ uint64_t llvm::xxHash64(StringRef Data) {
 uint64_t llvm::xxHash64(ArrayRef<uint8_t> Data) {
   return xxHash64({(const char *)Data.data(), Data.size()});
 }
+
+//===----------------------------------------------------------------------===//
+// XXH3
+//===----------------------------------------------------------------------===//
+
+static const uint32_t PRIME32_1 = 0x9E3779B1U;
+static const uint32_t PRIME32_2 = 0x85EBCA77U;
+static const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+static const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+static const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+// The default secret of XXH3.
+constexpr size_t SecretSize = 192;
+alignas(64) static const uint8_t Secret[SecretSize] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+constexpr size_t SecretSizeMin = 136;
+constexpr size_t StripeLen = 64;
+constexpr size_t SecretConsumeRate = 8;
+constexpr size_t AccNb = StripeLen / sizeof(uint64_t);
+constexpr size_t SecretLastAccStart = 7;
+constexpr size_t SecretMergeAccsStart = 11;
+constexpr size_t MidSizeMax = 240;
+constexpr size_t MidSizeStartOffset = 3;
+constexpr size_t MidSizeLastOffset = 17;
+
+namespace {
+struct Uint128 {
+  uint64_t Low;
+  uint64_t High;
+};
+} // namespace
+
+static Uint128 mult64to128(uint64_t LHS, uint64_t RHS) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t P = (__uint128_t)LHS * RHS;
+  return {uint64_t(P), uint64_t(P >> 64)};
+#else
+  uint64_t LoLo = (LHS & 0xFFFFFFFF) * (RHS & 0xFFFFFFFF);
+  uint64_t HiLo = (LHS >> 32) * (RHS & 0xFFFFFFFF);
+  uint64_t LoHi = (LHS & 0xFFFFFFFF) * (RHS >> 32);
+  uint64_t HiHi = (LHS >> 32) * (RHS >> 32);
+  uint64_t Cross = (LoLo >> 32) + (HiLo & 0xFFFFFFFF) + LoHi;
+  uint64_t Upper = (HiLo >> 32) + (Cross >> 32) + HiHi;
+  uint64_t Lower = (Cross << 32) | (LoLo & 0xFFFFFFFF);
+  return {Lower, Upper};
+#endif
+}
+
+static uint64_t mul128Fold64(uint64_t LHS, uint64_t RHS) {
+  Uint128 P = mult64to128(LHS, RHS);
+  return P.Low ^ P.High;
+}
+
+static uint64_t XXH64_avalanche(uint64_t Hash) {
+  Hash ^= Hash >> 33;
+  Hash *= PRIME64_2;
+  Hash ^= Hash >> 29;
+  Hash *= PRIME64_3;
+  Hash ^= Hash >> 32;
+  return Hash;
+}
+
+static uint64_t XXH3_avalanche(uint64_t Hash) {
+  Hash ^= Hash >> 37;
+  Hash *= PRIME_MX1;
+  Hash ^= Hash >> 32;
+  return Hash;
+}
+
+static uint64_t rrmxmx(uint64_t Hash, uint64_t Len) {
+  Hash ^= rotl64(Hash, 49) ^ rotl64(Hash, 24);
+  Hash *= PRIME_MX2;
+  Hash ^= (Hash >> 35) + Len;
+  Hash *= PRIME_MX2;
+  Hash ^= Hash >> 28;
+  return Hash;
+}
+
+static uint64_t mix16B(const uint8_t *Input, const uint8_t *Sec,
+                       uint64_t Seed) {
+  uint64_t Lo = endian::read64le(Input);
+  uint64_t Hi = endian::read64le(Input + 8);
+  return mul128Fold64(Lo ^ (endian::read64le(Sec) + Seed),
+                      Hi ^ (endian::read64le(Sec + 8) - Seed));
+}
+
+//===----------------------------------------------------------------------===//
+// Long inputs
+//
+// Inputs above MidSizeMax bytes are consumed in 64-byte stripes by eight
+// 64-bit accumulators. That loop dominates the cost of hashing large inputs,
+// so it has SIMD versions; all of them compute the same accumulators.
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct XXH3Kernel {
+  /// Accumulate \p NbStripes stripes, using the secret at an offset of
+  /// SecretConsumeRate bytes per stripe.
+  void (*Accumulate)(uint64_t *Acc, const uint8_t *Input, const uint8_t *Sec,
+                     size_t NbStripes);
+  /// Scramble the accumulators at the end of a block.
+  void (*Scramble)(uint64_t *Acc, const uint8_t *Sec);
+};
+} // namespace
+
+#ifndef LLVM_XXH3_SSE2
+static void accumulateScalar(uint64_t *Acc, const uint8_t *Input,
+                             const uint8_t *Sec, size_t NbStripes) {
+  for (size_t N = 0; N < NbStripes; ++N) {
+    const uint8_t *In = Input + N * StripeLen;
+    const uint8_t *Key = Sec + N * SecretConsumeRate;
+    for (size_t I = 0; I < AccNb; ++I) {
+      uint64_t DataVal = endian::read64le(In + 8 * I);
+      uint64_t DataKey = DataVal ^ endian::read64le(Key + 8 * I);
+      Acc[I ^ 1] += DataVal;
+      Acc[I] += uint32_t(DataKey) * (DataKey >> 32);
+    }
+  }
+}
+
+static void scrambleScalar(uint64_t *Acc, const uint8_t *Sec) {
+  for (size_t I = 0; I < AccNb; ++I) {
+    uint64_t A = Acc[I];
+    A ^= A >> 47;
+    A ^= endian::read64le(Sec + 8 * I);
+    A *= PRIME32_1;
+    Acc[I] = A;
+  }
+}
+#else
+static void accumulateSSE2(uint64_t *Acc, const uint8_t *Input,
+                           const uint8_t *Sec, size_t NbStripes) {
+  __m128i A[4];
+  for (size_t I = 0; I < 4; ++I)
+    A[I] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Acc) + I);
+  for (size_t N = 0; N < NbStripes; ++N) {
+    const __m128i *In =
+        reinterpret_cast<const __m128i *>(Input + N * StripeLen);
+    const __m128i *Key =
+        reinterpret_cast<const __m128i *>(Sec + N * SecretConsumeRate);
+    for (size_t I = 0; I < 4; ++I) {
+      __m128i DataVec = _mm_loadu_si128(In + I);
+      __m128i DataKey = _mm_xor_si128(DataVec, _mm_loadu_si128(Key + I));
+      // 32x32->64 multiplication of the low and high halves of each lane.
+      __m128i DataKeyHi = _mm_shuffle_epi32(DataKey, _MM_SHUFFLE(0, 3, 0, 1));
+      __m128i Product = _mm_mul_epu32(DataKey, DataKeyHi);
+      // Each lane also adds the input of the other lane.
+      __m128i DataSwap = _mm_shuffle_epi32(DataVec, _MM_SHUFFLE(1, 0, 3, 2));
+      A[I] = _mm_add_epi64(Product, _mm_add_epi64(A[I], DataSwap));
+    }
+  }
+  for (size_t I = 0; I < 4; ++I)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Acc) + I, A[I]);
+}
+
+static void scrambleSSE2(uint64_t *Acc, const uint8_t *Sec) {
+  const __m128i Prime32 = _mm_set1_epi32(int(PRIME32_1));
+  const __m128i *Key = reinterpret_cast<const __m128i *>(Sec);
+  for (size_t I = 0; I < 4; ++I) {
+    __m128i *P = reinterpret_cast<__m128i *>(Acc) + I;
+    __m128i A = _mm_loadu_si128(P);
+    A = _mm_xor_si128(A, _mm_srli_epi64(A, 47));
+    A = _mm_xor_si128(A, _mm_loadu_si128(Key + I));
+    // 64x32 multiplication, done as two 32x32->64 multiplications.
+    __m128i AHi = _mm_shuffle_epi32(A, _MM_SHUFFLE(0, 3, 0, 1));
+    __m128i ProdLo = _mm_mul_epu32(A, Prime32);
+    __m128i ProdHi = _mm_mul_epu32(AHi, Prime32);
+    _mm_storeu_si128(P, _mm_add_epi64(ProdLo, _mm_slli_epi64(ProdHi, 32)));
+  }
+}
+#endif
+
+#ifdef LLVM_XXH3_AVX2
+__attribute__((target("avx2"))) static void
+accumulateAVX2(uint64_t *Acc, const uint8_t *Input, const uint8_t *Sec,
+               size_t NbStripes) {
+  __m256i A[2];
+  for (size_t I = 0; I < 2; ++I)
+    A[I] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Acc) + I);
+  for (size_t N = 0; N < NbStripes; ++N) {
+    const __m256i *In =
+        reinterpret_cast<const __m256i *>(Input + N * StripeLen);
+    const __m256i *Key =
+        reinterpret_cast<const __m256i *>(Sec + N * SecretConsumeRate);
+    for (size_t I = 0; I < 2; ++I) {
+      __m256i DataVec = _mm256_loadu_si256(In + I);
+      __m256i DataKey =
+          _mm256_xor_si256(DataVec, _mm256_loadu_si256(Key + I));
+      __m256i DataKeyHi =
+          _mm256_shuffle_epi32(DataKey, _MM_SHUFFLE(0, 3, 0, 1));
+      __m256i Product = _mm256_mul_epu32(DataKey, DataKeyHi);
+      __m256i DataSwap =
+          _mm256_shuffle_epi32(DataVec, _MM_SHUFFLE(1, 0, 3, 2));
+      A[I] = _mm256_add_epi64(Product, _mm256_add_epi64(A[I], DataSwap));
+    }
+  }
+  for (size_t I = 0; I < 2; ++I)
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(Acc) + I, A[I]);
+}
+
+__attribute__((target("avx2"))) static void scrambleAVX2(uint64_t *Acc,
+                                                          const uint8_t *Sec) {
+  const __m256i Prime32 = _mm256_set1_epi32(int(PRIME32_1));
+  const __m256i *Key = reinterpret_cast<const __m256i *>(Sec);
+  for (size_t I = 0; I < 2; ++I) {
+    __m256i *P = reinterpret_cast<__m256i *>(Acc) + I;
+    __m256i A = _mm256_loadu_si256(P);
+    A = _mm256_xor_si256(A, _mm256_srli_epi64(A, 47));
+    A = _mm256_xor_si256(A, _mm256_loadu_si256(Key + I));
+    __m256i AHi = _mm256_shuffle_epi32(A, _MM_SHUFFLE(0, 3, 0, 1));
+    __m256i ProdLo = _mm256_mul_epu32(A, Prime32);
+    __m256i ProdHi = _mm256_mul_epu32(AHi, Prime32);
+    _mm256_storeu_si256(P,
+                        _mm256_add_epi64(ProdLo, _mm256_slli_epi64(ProdHi, 32)));
+  }
+}
+#endif
+
+static XXH3Kernel selectKernel() {
+#ifdef LLVM_XXH3_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    return {accumulateAVX2, scrambleAVX2};
+#endif
+#ifdef LLVM_XXH3_SSE2
+  return {accumulateSSE2, scrambleSSE2};
+#else
+  return {accumulateScalar, scrambleScalar};
+#endif
+}
+
+static void hashLongAccumulate(uint64_t *Acc, const uint8_t *Input,
+                               size_t Len) {
+  static const XXH3Kernel Kernel = selectKernel();
+  constexpr size_t NbStripesPerBlock =
+      (SecretSize - StripeLen) / SecretConsumeRate;
+  constexpr size_t BlockLen = StripeLen * NbStripesPerBlock;
+  const size_t NbBlocks = (Len - 1) / BlockLen;
+
+  for (size_t N = 0; N < NbBlocks; ++N) {
+    Kernel.Accumulate(Acc, Input + N * BlockLen, Secret, NbStripesPerBlock);
+    Kernel.Scramble(Acc, Secret + SecretSize - StripeLen);
+  }
+
+  // The last partial block, and then the last stripe, which may overlap it.
+  const size_t NbStripes = ((Len - 1) - BlockLen * NbBlocks) / StripeLen;
+  Kernel.Accumulate(Acc, Input + NbBlocks * BlockLen, Secret, NbStripes);
+  Kernel.Accumulate(Acc, Input + Len - StripeLen,
+                    Secret + SecretSize - StripeLen - SecretLastAccStart, 1);
+}
+
+static uint64_t mergeAccs(const uint64_t *Acc, const uint8_t *Sec,
+                          uint64_t Start) {
+  uint64_t Result = Start;
+  for (size_t I = 0; I < 4; ++I)
+    Result += mul128Fold64(Acc[2 * I] ^ endian::read64le(Sec + 16 * I),
+                           Acc[2 * I + 1] ^ endian::read64le(Sec + 16 * I + 8));
+  return XXH3_avalanche(Result);
+}
+
+static void initAccs(uint64_t *Acc) {
+  const uint64_t Init[AccNb] = {PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+                                PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1};
+  memcpy(Acc, Init, sizeof(Init));
+}
+
+//===----------------------------------------------------------------------===//
+// XXH3_64bits
+//===----------------------------------------------------------------------===//
+
+static uint64_t XXH3_len_1to3_64b(const uint8_t *Input, size_t Len,
+                                  const uint8_t *Sec, uint64_t Seed) {
+  const uint8_t C1 = Input[0];
+  const uint8_t C2 = Input[Len >> 1];
+  const uint8_t C3 = Input[Len - 1];
+  uint32_t Combined = ((uint32_t)C1 << 16) | ((uint32_t)C2 << 24) |
+                      ((uint32_t)C3 << 0) | ((uint32_t)Len << 8);
+  uint64_t Bitflip =
+      (uint64_t)(endian::read32le(Sec) ^ endian::read32le(Sec + 4)) + Seed;
+  return XXH64_avalanche(uint64_t(Combined) ^ Bitflip);
+}
+
+static uint64_t XXH3_len_4to8_64b(const uint8_t *Input, size_t Len,
+                                  const uint8_t *Sec, uint64_t Seed) {
+  Seed ^= (uint64_t)sys::getSwappedBytes(uint32_t(Seed)) << 32;
+  const uint32_t Input1 = endian::read32le(Input);
+  const uint32_t Input2 = endian::read32le(Input + Len - 4);
+  uint64_t Bitflip =
+      (endian::read64le(Sec + 8) ^ endian::read64le(Sec + 16)) - Seed;
+  uint64_t Input64 = (uint64_t)Input2 | ((uint64_t)Input1 << 32);
+  return rrmxmx(Input64 ^ Bitflip, Len);
+}
+
+static uint64_t XXH3_len_9to16_64b(const uint8_t *Input, size_t Len,
+                                   const uint8_t *Sec, uint64_t Seed) {
+  uint64_t Bitflip1 =
+      (endian::read64le(Sec + 24) ^ endian::read64le(Sec + 32)) + Seed;
+  uint64_t Bitflip2 =
+      (endian::read64le(Sec + 40) ^ endian::read64le(Sec + 48)) - Seed;
+  uint64_t InputLo = endian::read64le(Input) ^ Bitflip1;
+  uint64_t InputHi = endian::read64le(Input + Len - 8) ^ Bitflip2;
+  uint64_t Acc = Len + sys::getSwappedBytes(InputLo) + InputHi +
+                 mul128Fold64(InputLo, InputHi);
+  return XXH3_avalanche(Acc);
+}
+
+static uint64_t XXH3_len_0to16_64b(const uint8_t *Input, size_t Len,
+                                   const uint8_t *Sec, uint64_t Seed) {
+  if (LLVM_LIKELY(Len > 8))
+    return XXH3_len_9to16_64b(Input, Len, Sec, Seed);
+  if (LLVM_LIKELY(Len >= 4))
+    return XXH3_len_4to8_64b(Input, Len, Sec, Seed);
+  if (Len)
+    return XXH3_len_1to3_64b(Input, Len, Sec, Seed);
+  return XXH64_avalanche(Seed ^ endian::read64le(Sec + 56) ^
+                         endian::read64le(Sec + 64));
+}
+
+static uint64_t XXH3_len_17to128_64b(const uint8_t *Input, size_t Len,
+                                     const uint8_t *Sec, uint64_t Seed) {
+  uint64_t Acc = Len * PRIME64_1;
+  if (Len > 32) {
+    if (Len > 64) {
+      if (Len > 96) {
+        Acc += mix16B(Input + 48, Sec + 96, Seed);
+        Acc += mix16B(Input + Len - 64, Sec + 112, Seed);
+      }
+      Acc += mix16B(Input + 32, Sec + 64, Seed);
+      Acc += mix16B(Input + Len - 48, Sec + 80, Seed);
+    }
+    Acc += mix16B(Input + 16, Sec + 32, Seed);
+    Acc += mix16B(Input + Len - 32, Sec + 48, Seed);
+  }
+  Acc += mix16B(Input + 0, Sec + 0, Seed);
+  Acc += mix16B(Input + Len - 16, Sec + 16, Seed);
+  return XXH3_avalanche(Acc);
+}
+
+static uint64_t XXH3_len_129to240_64b(const uint8_t *Input, size_t Len,
+                                      const uint8_t *Sec, uint64_t Seed) {
+  uint64_t Acc = Len * PRIME64_1;
+  const unsigned NbRounds = Len / 16;
+  for (unsigned I = 0; I < 8; ++I)
+    Acc += mix16B(Input + 16 * I, Sec + 16 * I, Seed);
+  Acc = XXH3_avalanche(Acc);
+
+  for (unsigned I = 8; I < NbRounds; ++I)
+    Acc += mix16B(Input + 16 * I, Sec + 16 * (I - 8) + MidSizeStartOffset,
+                  Seed);
+  // Last 16 bytes.
+  Acc += mix16B(Input + Len - 16, Sec + SecretSizeMin - MidSizeLastOffset,
+                Seed);
+  return XXH3_avalanche(Acc);
+}
+
+uint64_t llvm::xxh3_64bits(ArrayRef<uint8_t> Data) {
+  const uint8_t *In = Data.data();
+  size_t Len = Data.size();
+  if (Len <= 16)
+    return XXH3_len_0to16_64b(In, Len, Secret, 0);
+  if (Len <= 128)
+    return XXH3_len_17to128_64b(In, Len, Secret, 0);
+  if (Len <= MidSizeMax)
+    return XXH3_len_129to240_64b(In, Len, Secret, 0);
+
+  alignas(32) uint64_t Acc[AccNb];
+  initAccs(Acc);
+  hashLongAccumulate(Acc, In, Len);
+  return mergeAccs(Acc, Secret + SecretMergeAccsStart,
+                   (uint64_t)Len * PRIME64_1);
+}
+
+//===----------------------------------------------------------------------===//
+// XXH3_128bits
+//===----------------------------------------------------------------------===//
+
+static XXH128_hash_t makeHash128(uint64_t Low, uint64_t High) {
+  XXH128_hash_t H;
+  H.low64 = Low;
+  H.high64 = High;
+  return H;
+}
+
+static XXH128_hash_t XXH3_len_1to3_128b(const uint8_t *Input, size_t Len,
+                                        const uint8_t *Sec, uint64_t Seed) {
+  const uint8_t C1 = Input[0];
+  const uint8_t C2 = Input[Len >> 1];
+  const uint8_t C3 = Input[Len - 1];
+  uint32_t CombinedL = ((uint32_t)C1 << 16) | ((uint32_t)C2 << 24) |
+                       ((uint32_t)C3 << 0) | ((uint32_t)Len << 8);
+  uint32_t Swapped = sys::getSwappedBytes(CombinedL);
+  uint32_t CombinedH = (Swapped << 13) | (Swapped >> 19);
+  uint64_t BitflipL =
+      (uint64_t)(endian::read32le(Sec) ^ endian::read32le(Sec + 4)) + Seed;
+  uint64_t BitflipH =
+      (uint64_t)(endian::read32le(Sec + 8) ^ endian::read32le(Sec + 12)) -
+      Seed;
+  return makeHash128(XXH64_avalanche(uint64_t(CombinedL) ^ BitflipL),
+                     XXH64_avalanche(uint64_t(CombinedH) ^ BitflipH));
+}
+
+static XXH128_hash_t XXH3_len_4to8_128b(const uint8_t *Input, size_t Len,
+                                        const uint8_t *Sec, uint64_t Seed) {
+  Seed ^= (uint64_t)sys::getSwappedBytes(uint32_t(Seed)) << 32;
+  uint32_t InputLo = endian::read32le(Input);
+  uint32_t InputHi = endian::read32le(Input + Len - 4);
+  uint64_t Input64 = InputLo + ((uint64_t)InputHi << 32);
+  uint64_t Bitflip =
+      (endian::read64le(Sec + 16) ^ endian::read64le(Sec + 24)) + Seed;
+  uint64_t Keyed = Input64 ^ Bitflip;
+
+  // Shift len to the left to ensure it is even, this avoids even multiplies.
+  Uint128 M = mult64to128(Keyed, PRIME64_1 + (Len << 2));
+  M.High += M.Low << 1;
+  M.Low ^= M.High >> 3;
+  M.Low ^= M.Low >> 35;
+  M.Low *= PRIME_MX2;
+  M.Low ^= M.Low >> 28;
+  M.High = XXH3_avalanche(M.High);
+  return makeHash128(M.Low, M.High);
+}
+
+static XXH128_hash_t XXH3_len_9to16_128b(const uint8_t *Input, size_t Len,
+                                         const uint8_t *Sec, uint64_t Seed) {
+  uint64_t BitflipL =
+      (endian::read64le(Sec + 32) ^ endian::read64le(Sec + 40)) - Seed;
+  uint64_t BitflipH =
+      (endian::read64le(Sec + 48) ^ endian::read64le(Sec + 56)) + Seed;
+  uint64_t InputLo = endian::read64le(Input);
+  uint64_t InputHi = endian::read64le(Input + Len - 8);
+  Uint128 M = mult64to128(InputLo ^ InputHi ^ BitflipL, PRIME64_1);
+  M.Low += (uint64_t)(Len - 1) << 54;
+  InputHi ^= BitflipH;
+  M.High += InputHi + (uint64_t)uint32_t(InputHi) * (PRIME32_2 - 1);
+  M.Low ^= sys::getSwappedBytes(M.High);
+
+  Uint128 H = mult64to128(M.Low, PRIME64_2);
+  H.High += M.High * PRIME64_2;
+  return makeHash128(XXH3_avalanche(H.Low), XXH3_avalanche(H.High));
+}
+
+static XXH128_hash_t XXH3_len_0to16_128b(const uint8_t *Input, size_t Len,
+                                         const uint8_t *Sec, uint64_t Seed) {
+  if (Len > 8)
+    return XXH3_len_9to16_128b(Input, Len, Sec, Seed);
+  if (Len >= 4)
+    return XXH3_len_4to8_128b(Input, Len, Sec, Seed);
+  if (Len)
+    return XXH3_len_1to3_128b(Input, Len, Sec, Seed);
+  uint64_t BitflipL = endian::read64le(Sec + 64) ^ endian::read64le(Sec + 72);
+  uint64_t BitflipH = endian::read64le(Sec + 80) ^ endian::read64le(Sec + 88);
+  return makeHash128(XXH64_avalanche(Seed ^ BitflipL),
+                     XXH64_avalanche(Seed ^ BitflipH));
+}
+
+static Uint128 mix32B(Uint128 Acc, const uint8_t *Input1,
+                      const uint8_t *Input2, const uint8_t *Sec,
+                      uint64_t Seed) {
+  Acc.Low += mix16B(Input1, Sec + 0, Seed);
+  Acc.Low ^= endian::read64le(Input2) + endian::read64le(Input2 + 8);
+  Acc.High += mix16B(Input2, Sec + 16, Seed);
+  Acc.High ^= endian::read64le(Input1) + endian::read64le(Input1 + 8);
+  return Acc;
+}
+
+static XXH128_hash_t finalizeMid128(Uint128 Acc, size_t Len, uint64_t Seed) {
+  uint64_t Low = Acc.Low + Acc.High;
+  uint64_t High = Acc.Low * PRIME64_1 + Acc.High * PRIME64_4 +
+                  (Len - Seed) * PRIME64_2;
+  return makeHash128(XXH3_avalanche(Low), 0 - XXH3_avalanche(High));
+}
+
+static XXH128_hash_t XXH3_len_17to128_128b(const uint8_t *Input, size_t Len,
+                                           const uint8_t *Sec, uint64_t Seed) {
+  Uint128 Acc = {Len * PRIME64_1, 0};
+  if (Len > 32) {
+    if (Len > 64) {
+      if (Len > 96)
+        Acc = mix32B(Acc, Input + 48, Input + Len - 64, Sec + 96, Seed);
+      Acc = mix32B(Acc, Input + 32, Input + Len - 48, Sec + 64, Seed);
+    }
+    Acc = mix32B(Acc, Input + 16, Input + Len - 32, Sec + 32, Seed);
+  }
+  Acc = mix32B(Acc, Input, Input + Len - 16, Sec, Seed);
+  return finalizeMid128(Acc, Len, Seed);
+}
+
+static XXH128_hash_t XXH3_len_129to240_128b(const uint8_t *Input, size_t Len,
+                                            const uint8_t *Sec, uint64_t Seed) {
+  Uint128 Acc = {Len * PRIME64_1, 0};
+  size_t I = 32;
+  for (; I < 160; I += 32)
+    Acc = mix32B(Acc, Input + I - 32, Input + I - 16, Sec + I - 32, Seed);
+  Acc.Low = XXH3_avalanche(Acc.Low);
+  Acc.High = XXH3_avalanche(Acc.High);
+  for (; I <= Len; I += 32)
+    Acc = mix32B(Acc, Input + I - 32, Input + I - 16,
+                 Sec + MidSizeStartOffset + I - 160, Seed);
+  // Last bytes.
+  Acc = mix32B(Acc, Input + Len - 16, Input + Len - 32,
+               Sec + SecretSizeMin - MidSizeLastOffset - 16, 0 - Seed);
+  return finalizeMid128(Acc, Len, Seed);
+}
+
+XXH128_hash_t llvm::xxh3_128bits(ArrayRef<uint8_t> Data) {
+  const uint8_t *In = Data.data();
+  size_t Len = Data.size();
+  if (Len <= 16)
+    return XXH3_len_0to16_128b(In, Len, Secret, 0);
+  if (Len <= 128)
+    return XXH3_len_17to128_128b(In, Len, Secret, 0);
+  if (Len <= MidSizeMax)
+    return XXH3_len_129to240_128b(In, Len, Secret, 0);
+
+  alignas(32) uint64_t Acc[AccNb];
+  initAccs(Acc);
+  hashLongAccumulate(Acc, In, Len);
+  uint64_t Low = mergeAccs(Acc, Secret + SecretMergeAccsStart,
+                           (uint64_t)Len * PRIME64_1);
+  uint64_t High =
+      mergeAccs(Acc, Secret + SecretSize - sizeof(Acc) - SecretMergeAccsStart,
+                ~((uint64_t)Len * PRIME64_2));
+  return makeHash128(Low, High);
+}
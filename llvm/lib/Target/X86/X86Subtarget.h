@@ -474,6 +474,10 @@ class X86Subtarget final : public X86GenSubtargetInfo {
   /// Use Goldmont specific floating point div/sqrt costs.
   bool UseGLMDivSqrtCosts = false;
 
+  /// How many instructions ahead LoopDataPrefetch inserts software
+  /// prefetches, or 0 to not insert any.
+  unsigned PrefetchDistance = 0;
+
   /// What processor and OS we're targeting.
   Triple TargetTriple;
 
@@ -917,6 +921,21 @@ public:
   }
 
   bool enableAdvancedRASplitCost() const override { return true; }
+
+  /// Software prefetching, used by LoopDataPrefetch.
+  unsigned getCacheLineSize() const override { return 64; }
+  unsigned getPrefetchDistance() const override { return PrefetchDistance; }
+  /// The hardware prefetchers follow constant strides within a page, so only
+  /// the larger strides are worth a software prefetch. They can't follow
+  /// indirect accesses at all.
+  unsigned getMinPrefetchStride(unsigned NumMemAccesses,
+                                unsigned NumStridedMemAccesses,
+                                unsigned NumPrefetches,
+                                bool HasCall) const override {
+    return 2048;
+  }
+  bool enableWritePrefetching() const override { return hasPrefetchW(); }
+  bool enableIndirectPrefetching() const override { return true; }
 };
 
 } // end namespace llvm
@@ -0,0 +1,96 @@
+//===- IRHelpers.cpp - Helpers for tests on LLVM IR -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Testing/Support/IRHelpers.h"
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/DemandedBits.h"
+#include "llvm/Analysis/LoopAccessAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/MemorySSA.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/PhiValues.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace llvm::unittest;
+
+std::unique_ptr<Module> llvm::unittest::parseModuleWithIDs(
+    StringRef IR, LLVMContext &Context, StringRef ProgName) {
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseAssemblyString(IR, Err, Context);
+  if (!M) {
+    Err.print(ProgName.str().c_str(), errs());
+    return nullptr;
+  }
+
+  // Start the counter the way the AddUniqueID pass does.
+  NamedMDNode *IDs = M->getOrInsertNamedMetadata("ID");
+  if (IDs->getNumOperands() == 0) {
+    Constant *Zero = ConstantInt::get(Type::getInt64Ty(Context), 0);
+    IDs->addOperand(MDNode::get(Context, ConstantAsMetadata::get(Zero)));
+  }
+  return M;
+}
+
+BasicBlock *llvm::unittest::getBasicBlockByName(Function &F, StringRef Name) {
+  for (BasicBlock &BB : F)
+    if (BB.getName() == Name)
+      return &BB;
+  return nullptr;
+}
+
+PassTest::PassTest(StringRef ProgName, TargetIRAnalysis TIRA)
+    : ProgName(ProgName) {
+  LAM.registerPass([] { return LoopAccessAnalysis(); });
+  LAM.registerPass([] { return PassInstrumentationAnalysis(); });
+  LAM.registerPass([&] { return FunctionAnalysisManagerLoopProxy(FAM); });
+
+  FAM.registerPass([] {
+    AAManager AA;
+    AA.registerFunctionAnalysis<BasicAA>();
+    return AA;
+  });
+  FAM.registerPass([] { return AssumptionAnalysis(); });
+  FAM.registerPass([] { return BasicAA(); });
+  FAM.registerPass([] { return BlockFrequencyAnalysis(); });
+  FAM.registerPass([] { return BranchProbabilityAnalysis(); });
+  FAM.registerPass([] { return DemandedBitsAnalysis(); });
+  FAM.registerPass([] { return DominatorTreeAnalysis(); });
+  FAM.registerPass([] { return LoopAnalysis(); });
+  FAM.registerPass([] { return MemorySSAAnalysis(); });
+  FAM.registerPass([] { return OptimizationRemarkEmitterAnalysis(); });
+  FAM.registerPass([] { return PassInstrumentationAnalysis(); });
+  FAM.registerPass([] { return PhiValuesAnalysis(); });
+  FAM.registerPass([] { return PostDominatorTreeAnalysis(); });
+  FAM.registerPass([] { return ScalarEvolutionAnalysis(); });
+  FAM.registerPass([&] { return std::move(TIRA); });
+  FAM.registerPass([] { return TargetLibraryAnalysis(); });
+  FAM.registerPass([&] { return LoopAnalysisManagerFunctionProxy(LAM); });
+  FAM.registerPass([&] { return ModuleAnalysisManagerFunctionProxy(MAM); });
+
+  MAM.registerPass([] { return PassInstrumentationAnalysis(); });
+  MAM.registerPass([] { return ProfileSummaryAnalysis(); });
+  MAM.registerPass([&] { return FunctionAnalysisManagerModuleProxy(FAM); });
+}
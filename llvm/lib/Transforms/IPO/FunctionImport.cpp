@@ -12,6 +12,7 @@
 
 #include "llvm/Transforms/IPO/FunctionImport.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallVector.h"
@@ -22,6 +23,7 @@
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/IR/AutoUpgrade.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/FlatSummaryIndex.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalAlias.h"
 #include "llvm/IR/GlobalObject.h"
@@ -43,11 +45,14 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/Internalize.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/FunctionImportUtils.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
+#include <atomic>
 #include <cassert>
 #include <memory>
 #include <set>
@@ -120,6 +125,11 @@ static cl::opt<bool> PrintImportFailures(
     "print-import-failures", cl::init(false), cl::Hidden,
     cl::desc("Print information for functions rejected for importing"));
 
+static cl::opt<unsigned> ImportThreads(
+    "thinlto-import-threads", cl::init(1), cl::Hidden, cl::value_desc("N"),
+    cl::desc("Compute the import lists of N modules in parallel during the "
+             "thin link (0 = all hardware threads)"));
+
 static cl::opt<bool> ComputeDead("compute-dead", cl::init(true), cl::Hidden,
                                  cl::desc("Compute dead symbols"));
 
@@ -367,7 +377,7 @@ static void computeImportForFunction(
     FunctionImporter::ImportThresholdsTy &ImportThresholds) {
   computeImportForReferencedGlobals(Summary, Index, DefinedGVSummaries,
                                     Worklist, ImportList, ExportLists);
-  static int ImportCount = 0;
+  static std::atomic<int> ImportCount(0);
   for (auto &Edge : Summary.calls()) {
     ValueInfo VI = Edge.first;
     LLVM_DEBUG(dbgs() << " edge -> " << VI << " Threshold:" << Threshold
@@ -659,13 +669,44 @@ void llvm::ComputeCrossModuleImport(
     StringMap<FunctionImporter::ImportMapTy> &ImportLists,
     StringMap<FunctionImporter::ExportSetTy> &ExportLists) {
   // For each module that has function defined, compute the import/export lists.
+  // The index is only read, so the modules are independent of each other and
+  // can be processed in parallel. Each module records the values it causes to
+  // be exported in its own map; those are merged in module order afterwards,
+  // so the result does not depend on scheduling.
+  std::vector<const StringMapEntry<GVSummaryMapTy> *> Modules;
+  std::vector<FunctionImporter::ImportMapTy *> ModuleImportLists;
   for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries) {
-    auto &ImportList = ImportLists[DefinedGVSummaries.first()];
-    LLVM_DEBUG(dbgs() << "Computing import for Module '"
-                      << DefinedGVSummaries.first() << "'\n");
-    ComputeImportForModule(DefinedGVSummaries.second, Index,
-                           DefinedGVSummaries.first(), ImportList,
-                           &ExportLists);
+    Modules.push_back(&DefinedGVSummaries);
+    ModuleImportLists.push_back(&ImportLists[DefinedGVSummaries.first()]);
+  }
+  std::vector<StringMap<FunctionImporter::ExportSetTy>> ModuleExportLists(
+      Modules.size());
+  auto ComputeForModule = [&](size_t I) {
+    LLVM_DEBUG(dbgs() << "Computing import for Module '" << Modules[I]->first()
+                      << "'\n");
+    ComputeImportForModule(Modules[I]->second, Index, Modules[I]->first(),
+                           *ModuleImportLists[I], &ModuleExportLists[I]);
+  };
+
+  // The import cutoff is a global count, and the diagnostics are printed as
+  // the lists are computed, so both require a serial run.
+  ThreadPoolStrategy Strategy = hardware_concurrency(ImportThreads);
+  if (Strategy.compute_thread_count() > 1 && Modules.size() > 1 &&
+      ImportCutoff < 0 && !PrintImportFailures && !DebugFlag) {
+    ThreadPool Pool(Strategy);
+    for (size_t I = 0; I != Modules.size(); ++I)
+      Pool.async(ComputeForModule, I);
+    Pool.wait();
+  } else {
+    for (size_t I = 0; I != Modules.size(); ++I)
+      ComputeForModule(I);
+  }
+
+  for (auto &ModuleExports : ModuleExportLists) {
+    for (auto &Exports : ModuleExports)
+      ExportLists[Exports.first()].insert(Exports.second.begin(),
+                                          Exports.second.end());
+    ModuleExports.clear();
   }
 
   // When computing imports we only added the variables and functions being
@@ -743,6 +784,310 @@ void llvm::ComputeCrossModuleImport(
 #endif
 }
 
+namespace {
+
+using FlatValueID = FlatSummaryIndex::ValueID;
+using FlatSummaryID = FlatSummaryIndex::SummaryID;
+using FlatModuleID = FlatSummaryIndex::ModuleID;
+
+/// The values defined in a module of a flat index, in increasing order, and
+/// the summary of each definition.
+using FlatDefinitionsTy = std::vector<std::pair<FlatValueID, FlatSummaryID>>;
+
+/// The state of the import computation of one module over a flat index.
+struct FlatModuleImport {
+  const FlatSummaryIndex &Index;
+  const BitVector &LiveValues;
+  const FlatDefinitionsTy &DefinedSummaries;
+  FunctionImporter::ImportMapTy &ImportList;
+  /// The values imported by the module, with the module they are exported
+  /// from.
+  std::vector<std::pair<FlatModuleID, FlatValueID>> &Exports;
+  SmallVector<std::pair<FlatSummaryID, unsigned /* Threshold */>, 128>
+      Worklist;
+  /// For each callee considered, the largest threshold it was considered with
+  /// and, if it is imported, the summary imported, or NoID.
+  DenseMap<FlatValueID, std::pair<unsigned, FlatSummaryID>> ImportThresholds;
+
+  FlatModuleImport(const FlatSummaryIndex &Index, const BitVector &LiveValues,
+                   const FlatDefinitionsTy &DefinedSummaries,
+                   FunctionImporter::ImportMapTy &ImportList,
+                   std::vector<std::pair<FlatModuleID, FlatValueID>> &Exports)
+      : Index(Index), LiveValues(LiveValues),
+        DefinedSummaries(DefinedSummaries), ImportList(ImportList),
+        Exports(Exports) {}
+
+  bool isDefined(FlatValueID V) const {
+    return findDefinition(DefinedSummaries, V) != flatsummary::NoID;
+  }
+
+  static FlatSummaryID findDefinition(const FlatDefinitionsTy &Defined,
+                                      FlatValueID V) {
+    auto It = llvm::partition_point(
+        Defined, [V](const std::pair<FlatValueID, FlatSummaryID> &D) {
+          return D.first < V;
+        });
+    if (It == Defined.end() || It->first != V)
+      return flatsummary::NoID;
+    return It->second;
+  }
+};
+
+} // anonymous namespace
+
+/// Select a summary of \p Callee to import, as the selectCallee above.
+static FlatSummaryID selectCallee(const FlatSummaryIndex &Index,
+                                  const BitVector &LiveValues,
+                                  FlatValueID Callee, unsigned Threshold,
+                                  FlatModuleID CallerModule) {
+  if (!LiveValues.test(Callee))
+    return flatsummary::NoID;
+  auto Summaries = Index.summaries(Callee);
+  bool HasOtherSummaries =
+      std::distance(Summaries.begin(), Summaries.end()) > 1;
+  for (FlatSummaryID S : Summaries) {
+    const flatsummary::SummaryEntry &GVSummary = Index.getSummary(S);
+    if (GVSummary.Kind == GlobalValueSummary::GlobalVarKind ||
+        GlobalValue::isInterposableLinkage(
+            GlobalValue::LinkageTypes(GVSummary.Linkage)))
+      continue;
+    FlatSummaryID Base = Index.getBaseObject(S);
+    if (Base == flatsummary::NoID ||
+        Index.getSummary(Base).Kind != GlobalValueSummary::FunctionKind)
+      continue;
+    const flatsummary::SummaryEntry &Summary = Index.getSummary(Base);
+    if (GlobalValue::isLocalLinkage(
+            GlobalValue::LinkageTypes(Summary.Linkage)) &&
+        HasOtherSummaries && Summary.Module != CallerModule)
+      continue;
+    if (Summary.InstCount > Threshold &&
+        !(Summary.Flags & flatsummary::AlwaysInline))
+      continue;
+    if (Summary.Flags &
+        (flatsummary::NotEligibleToImport | flatsummary::NoInline))
+      continue;
+    return S;
+  }
+  return flatsummary::NoID;
+}
+
+static void computeImportForReferencedGlobals(FlatSummaryID S,
+                                              FlatModuleImport &MI) {
+  const FlatSummaryIndex &Index = MI.Index;
+  FlatModuleID SummaryModule = Index.getSummary(S).Module;
+  for (FlatValueID Ref : Index.refs(S)) {
+    if (MI.isDefined(Ref))
+      continue;
+
+    for (FlatSummaryID RS : Index.summaries(Ref)) {
+      const flatsummary::SummaryEntry &RefSummary = Index.getSummary(RS);
+      if (RefSummary.Kind != GlobalValueSummary::GlobalVarKind ||
+          !(RefSummary.Flags & flatsummary::ImportableVar) ||
+          (GlobalValue::isLocalLinkage(
+               GlobalValue::LinkageTypes(RefSummary.Linkage)) &&
+           RefSummary.Module != SummaryModule))
+        continue;
+      auto ILI = MI.ImportList[Index.getModulePath(RefSummary.Module)].insert(
+          Index.getGUID(Ref));
+      if (!ILI.second)
+        break;
+      NumImportedGlobalVarsThinLink++;
+      MI.Exports.emplace_back(RefSummary.Module, Ref);
+      if (!(RefSummary.Flags & flatsummary::WriteOnly))
+        MI.Worklist.emplace_back(RS, 0);
+      break;
+    }
+  }
+}
+
+/// Compute the imports for the function summary \p S of a flat index, as the
+/// computeImportForFunction above.
+static void computeImportForFunction(FlatSummaryID S, const unsigned Threshold,
+                                     FlatModuleImport &MI) {
+  const FlatSummaryIndex &Index = MI.Index;
+  computeImportForReferencedGlobals(S, MI);
+  static std::atomic<int> ImportCount(0);
+  for (const flatsummary::CallEntry &Edge : Index.calls(S)) {
+    if (ImportCutoff >= 0 && ImportCount >= ImportCutoff)
+      continue;
+
+    FlatValueID Callee = Index.resolveIndirectCall(Edge.Callee);
+    if (Callee == flatsummary::NoID || MI.isDefined(Callee))
+      continue;
+
+    auto Hotness = CalleeInfo::HotnessType(uint32_t(Edge.Hotness));
+    float BonusMultiplier = 1.0;
+    if (Hotness == CalleeInfo::HotnessType::Hot)
+      BonusMultiplier = ImportHotMultiplier;
+    else if (Hotness == CalleeInfo::HotnessType::Cold)
+      BonusMultiplier = ImportColdMultiplier;
+    else if (Hotness == CalleeInfo::HotnessType::Critical)
+      BonusMultiplier = ImportCriticalMultiplier;
+    const auto NewThreshold = Threshold * BonusMultiplier;
+
+    auto IT = MI.ImportThresholds.insert(std::make_pair(
+        Callee, std::make_pair(unsigned(NewThreshold), flatsummary::NoID)));
+    bool PreviouslyVisited = !IT.second;
+    auto &ProcessedThreshold = IT.first->second.first;
+    auto &CalleeSummary = IT.first->second.second;
+
+    bool IsHotCallsite = Hotness == CalleeInfo::HotnessType::Hot;
+    bool IsCriticalCallsite = Hotness == CalleeInfo::HotnessType::Critical;
+
+    FlatSummaryID ResolvedCalleeSummary;
+    if (CalleeSummary != flatsummary::NoID) {
+      assert(PreviouslyVisited);
+      // Revisit the callee with the higher threshold, see above.
+      if (NewThreshold <= ProcessedThreshold)
+        continue;
+      ProcessedThreshold = NewThreshold;
+      ResolvedCalleeSummary = CalleeSummary;
+    } else {
+      if (PreviouslyVisited && NewThreshold <= ProcessedThreshold)
+        continue;
+
+      FlatSummaryID Selected =
+          selectCallee(Index, MI.LiveValues, Callee, NewThreshold,
+                       Index.getSummary(S).Module);
+      if (Selected == flatsummary::NoID) {
+        if (PreviouslyVisited)
+          ProcessedThreshold = NewThreshold;
+        continue;
+      }
+
+      CalleeSummary = ResolvedCalleeSummary = Index.getBaseObject(Selected);
+      FlatModuleID ExportModule =
+          Index.getSummary(ResolvedCalleeSummary).Module;
+      auto ILI = MI.ImportList[Index.getModulePath(ExportModule)].insert(
+          Index.getGUID(Callee));
+      if (ILI.second) {
+        NumImportedFunctionsThinLink++;
+        if (IsHotCallsite)
+          NumImportedHotFunctionsThinLink++;
+        if (IsCriticalCallsite)
+          NumImportedCriticalFunctionsThinLink++;
+      }
+      MI.Exports.emplace_back(ExportModule, Callee);
+    }
+
+    const auto AdjThreshold =
+        Threshold * (IsHotCallsite ? ImportHotInstrFactor : ImportInstrFactor);
+
+    ImportCount++;
+
+    MI.Worklist.emplace_back(ResolvedCalleeSummary, AdjThreshold);
+  }
+}
+
+/// Compute the imports of a module of a flat index, as the
+/// ComputeImportForModule above.
+static void ComputeImportForModule(FlatModuleImport &MI) {
+  const FlatSummaryIndex &Index = MI.Index;
+  for (auto &Definition : MI.DefinedSummaries) {
+    if (!MI.LiveValues.test(Definition.first))
+      continue;
+    FlatSummaryID FuncSummary = Index.getBaseObject(Definition.second);
+    if (FuncSummary == flatsummary::NoID ||
+        Index.getSummary(FuncSummary).Kind != GlobalValueSummary::FunctionKind)
+      continue;
+    computeImportForFunction(FuncSummary, ImportInstrLimit, MI);
+  }
+
+  while (!MI.Worklist.empty()) {
+    auto GVInfo = MI.Worklist.pop_back_val();
+    if (Index.getSummary(GVInfo.first).Kind == GlobalValueSummary::FunctionKind)
+      computeImportForFunction(GVInfo.first, GVInfo.second, MI);
+    else
+      computeImportForReferencedGlobals(GVInfo.first, MI);
+  }
+}
+
+void llvm::ComputeCrossModuleImport(
+    const FlatSummaryIndex &Index, const BitVector &LiveValues,
+    StringMap<FunctionImporter::ImportMapTy> &ImportLists,
+    StringMap<FunctionImporter::GUIDExportSetTy> &ExportLists) {
+  assert(LiveValues.size() == Index.getNumValues());
+  // The summaries are in the order of their values, so the definitions of
+  // each module are as well. As in collectDefinedGVSummariesPerModule, the
+  // last summary of a value in a module is its definition.
+  std::vector<FlatDefinitionsTy> DefinedSummaries(Index.getNumModules());
+  for (FlatSummaryID S = 0; S != Index.getNumSummaries(); ++S) {
+    const flatsummary::SummaryEntry &Summary = Index.getSummary(S);
+    FlatDefinitionsTy &Defined = DefinedSummaries[Summary.Module];
+    if (!Defined.empty() && Defined.back().first == Summary.Value)
+      Defined.back().second = S;
+    else
+      Defined.emplace_back(Summary.Value, S);
+  }
+
+  // As for a ModuleSummaryIndex, the modules are processed in parallel, each
+  // recording the values it imports in its own list.
+  std::vector<FlatModuleID> Modules;
+  std::vector<FunctionImporter::ImportMapTy *> ModuleImportLists;
+  for (FlatModuleID M = 0; M != Index.getNumModules(); ++M)
+    if (!DefinedSummaries[M].empty()) {
+      Modules.push_back(M);
+      ModuleImportLists.push_back(&ImportLists[Index.getModulePath(M)]);
+    }
+  std::vector<std::vector<std::pair<FlatModuleID, FlatValueID>>> ModuleExports(
+      Modules.size());
+  auto ComputeForModule = [&](size_t I) {
+    FlatModuleImport MI(Index, LiveValues, DefinedSummaries[Modules[I]],
+                        *ModuleImportLists[I], ModuleExports[I]);
+    ComputeImportForModule(MI);
+  };
+
+  ThreadPoolStrategy Strategy = hardware_concurrency(ImportThreads);
+  if (Strategy.compute_thread_count() > 1 && Modules.size() > 1 &&
+      ImportCutoff < 0) {
+    ThreadPool Pool(Strategy);
+    for (size_t I = 0; I != Modules.size(); ++I)
+      Pool.async(ComputeForModule, I);
+    Pool.wait();
+  } else {
+    for (size_t I = 0; I != Modules.size(); ++I)
+      ComputeForModule(I);
+  }
+
+  std::vector<DenseSet<FlatValueID>> Exports(Index.getNumModules());
+  for (auto &Imported : ModuleExports)
+    for (auto &Export : Imported)
+      Exports[Export.first].insert(Export.second);
+  ModuleExports.clear();
+
+  // Also export the values the exported values refer to, and which are
+  // defined in the exporting module, as for a ModuleSummaryIndex.
+  for (FlatModuleID M = 0; M != Index.getNumModules(); ++M) {
+    if (Exports[M].empty())
+      continue;
+    const FlatDefinitionsTy &Defined = DefinedSummaries[M];
+    DenseSet<FlatValueID> NewExports;
+    for (FlatValueID V : Exports[M]) {
+      FlatSummaryID S = FlatModuleImport::findDefinition(Defined, V);
+      assert(S != flatsummary::NoID);
+      S = Index.getBaseObject(S);
+      const flatsummary::SummaryEntry &Summary = Index.getSummary(S);
+      if (Summary.Kind == GlobalValueSummary::GlobalVarKind) {
+        if (Summary.Flags & flatsummary::WriteOnly)
+          continue;
+      } else {
+        for (const flatsummary::CallEntry &Edge : Index.calls(S))
+          NewExports.insert(Edge.Callee);
+      }
+      for (FlatValueID Ref : Index.refs(S))
+        NewExports.insert(Ref);
+    }
+
+    FunctionImporter::GUIDExportSetTy &ExportList =
+        ExportLists[Index.getModulePath(M)];
+    for (FlatValueID V : Exports[M])
+      ExportList.insert(Index.getGUID(V));
+    for (FlatValueID V : NewExports)
+      if (FlatModuleImport::findDefinition(Defined, V) != flatsummary::NoID)
+        ExportList.insert(Index.getGUID(V));
+  }
+}
+
 #ifndef NDEBUG
 static void dumpImportListForModule(const ModuleSummaryIndex &Index,
                                     StringRef ModulePath,
@@ -918,6 +1263,98 @@ void llvm::computeDeadSymbols(
   NumLiveSymbols += LiveSymbols;
 }
 
+void llvm::computeDeadSymbols(
+    const FlatSummaryIndex &Index,
+    const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
+    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
+    BitVector &LiveValues) {
+  // Without dead stripping everything is live, as for a ModuleSummaryIndex.
+  if (!ComputeDead || GUIDPreservedSymbols.empty()) {
+    LiveValues.clear();
+    LiveValues.resize(Index.getNumValues(), true);
+    return;
+  }
+  LiveValues.clear();
+  LiveValues.resize(Index.getNumValues());
+  unsigned LiveSymbols = 0;
+  SmallVector<FlatValueID, 128> Worklist;
+
+  // The roots are the preserved values and the ones flagged live in the
+  // index. Only values with summaries can be live roots.
+  for (FlatValueID V = 0; V != Index.getNumValues(); ++V) {
+    auto Summaries = Index.summaries(V);
+    if (Summaries.empty())
+      continue;
+    if (GUIDPreservedSymbols.count(Index.getGUID(V)) ||
+        llvm::any_of(Summaries, [&](FlatSummaryID S) {
+          return Index.getSummary(S).Flags & flatsummary::Live;
+        })) {
+      LiveValues.set(V);
+      Worklist.push_back(V);
+      ++LiveSymbols;
+    }
+  }
+
+  // Make value live and add it to the worklist if it was not live before, see
+  // the visit above.
+  auto visit = [&](FlatValueID V, bool IsAliasee) {
+    V = Index.resolveIndirectCall(V);
+    if (V == flatsummary::NoID || LiveValues.test(V))
+      return;
+
+    if (isPrevailing(Index.getGUID(V)) == PrevailingType::No) {
+      bool KeepAliveLinkage = false;
+      bool Interposable = false;
+      for (FlatSummaryID S : Index.summaries(V)) {
+        auto Linkage =
+            GlobalValue::LinkageTypes(Index.getSummary(S).Linkage);
+        if (Linkage == GlobalValue::AvailableExternallyLinkage ||
+            Linkage == GlobalValue::WeakODRLinkage ||
+            Linkage == GlobalValue::LinkOnceODRLinkage)
+          KeepAliveLinkage = true;
+        else if (GlobalValue::isInterposableLinkage(Linkage))
+          Interposable = true;
+      }
+
+      if (!IsAliasee) {
+        if (!KeepAliveLinkage)
+          return;
+
+        if (Interposable)
+          report_fatal_error(
+              "Interposable and available_externally/linkonce_odr/weak_odr "
+              "symbol");
+      }
+    }
+
+    LiveValues.set(V);
+    ++LiveSymbols;
+    Worklist.push_back(V);
+  };
+
+  while (!Worklist.empty()) {
+    FlatValueID V = Worklist.pop_back_val();
+    for (FlatSummaryID S : Index.summaries(V)) {
+      const flatsummary::SummaryEntry &Summary = Index.getSummary(S);
+      if (Summary.Kind == GlobalValueSummary::AliasKind) {
+        if (Summary.Aliasee != flatsummary::NoID)
+          visit(Index.getSummary(Summary.Aliasee).Value, true);
+        continue;
+      }
+      for (FlatValueID Ref : Index.refs(S))
+        visit(Ref, false);
+      for (const flatsummary::CallEntry &Call : Index.calls(S))
+        visit(Call.Callee, false);
+    }
+  }
+
+  unsigned DeadSymbols = Index.getNumValues() - LiveSymbols;
+  LLVM_DEBUG(dbgs() << LiveSymbols << " symbols Live, and " << DeadSymbols
+                    << " symbols Dead \n");
+  NumDeadSymbols += DeadSymbols;
+  NumLiveSymbols += LiveSymbols;
+}
+
 // Compute dead symbols and propagate constants in combined index.
 void llvm::computeDeadSymbolsWithConstProp(
     ModuleSummaryIndex &Index,
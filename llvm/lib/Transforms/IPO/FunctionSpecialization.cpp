@@ -0,0 +1,410 @@
+//===- FunctionSpecialization.cpp - Function Specialization ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass clones functions for constant arguments. The interprocedural SCCP
+// solver finds the arguments that call sites pass as constants; IPSCCP itself
+// can only use them when every call site agrees, so functions that are called
+// with a few different constants keep their generic body. For each function,
+// argument and constant, this pass estimates how much cheaper the body gets
+// when the argument is known, in the units of the inline cost model: the cost
+// of the instructions that use the argument, weighted by their loop depth,
+// and for calls through a function pointer argument, the benefit of inlining
+// the now direct call. The bonus is counted once per call site that passes
+// the constant, and the candidates whose bonus exceeds the cost of the clone
+// are specialized, best first, until the code growth budget of the module is
+// spent. The clone has the argument replaced with the constant and the call
+// sites that pass it are redirected to the clone; later passes (IPSCCP, the
+// inliner) then fold it in.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/IPO/FunctionSpecialization.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/CodeMetrics.h"
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Scalar/SCCP.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "function-specialization"
+
+STATISTIC(NumFuncSpecialized, "Number of functions specialized");
+STATISTIC(NumCallsRedirected,
+          "Number of call sites redirected to a specialized function");
+
+static cl::opt<unsigned> MaxClonesThreshold(
+    "func-specialization-max-clones", cl::Hidden, cl::init(3),
+    cl::desc("The maximum number of clones created for a single function"));
+
+static cl::opt<unsigned> MaxGrowth(
+    "func-specialization-max-growth", cl::Hidden, cl::init(20),
+    cl::desc("The maximum growth of the module from specialization, in "
+             "percent of its instruction count"));
+
+static cl::opt<unsigned> MinBudget(
+    "func-specialization-min-budget", cl::Hidden, cl::init(500),
+    cl::desc("The number of instructions that specialization may always add, "
+             "whatever the size of the module"));
+
+static cl::opt<unsigned> AvgLoopIterationCount(
+    "func-specialization-avg-iters-cost", cl::Hidden, cl::init(10),
+    cl::desc("The iteration count assumed for loops when weighting the "
+             "bonus of the instructions in their body"));
+
+namespace {
+
+/// A function, one of its arguments and a constant that some of its call
+/// sites pass for it.
+struct SpecializationCandidate {
+  Function *F;
+  unsigned ArgNo;
+  Constant *C;
+  SmallVector<CallBase *, 4> Calls;
+  /// The bonus of knowing the argument, per call site.
+  int64_t Bonus = 0;
+  /// The cost of the clone.
+  int64_t Cost = 0;
+
+  int64_t getGain(size_t NumCalls) const {
+    return Bonus * int64_t(NumCalls) - Cost;
+  }
+};
+
+class FunctionSpecializer {
+  const DataLayout &DL;
+  std::function<const TargetLibraryInfo &(Function &)> GetTLI;
+  std::function<TargetTransformInfo &(Function &)> GetTTI;
+  std::function<AssumptionCache &(Function &)> GetAC;
+  std::function<LoopInfo &(Function &)> GetLI;
+
+  /// The instruction count of every function that may be cloned.
+  DenseMap<Function *, unsigned> FunctionSizes;
+
+public:
+  FunctionSpecializer(
+      const DataLayout &DL,
+      std::function<const TargetLibraryInfo &(Function &)> GetTLI,
+      std::function<TargetTransformInfo &(Function &)> GetTTI,
+      std::function<AssumptionCache &(Function &)> GetAC,
+      std::function<LoopInfo &(Function &)> GetLI)
+      : DL(DL), GetTLI(std::move(GetTLI)), GetTTI(std::move(GetTTI)),
+        GetAC(std::move(GetAC)), GetLI(std::move(GetLI)) {}
+
+  bool run(Module &M);
+
+private:
+  bool isCandidateFunction(Function &F);
+  int64_t getUserBonus(Instruction &I, const TargetTransformInfo &TTI,
+                       const LoopInfo &LI);
+  int64_t getIndirectCallBonus(CallBase &CB, Constant *C);
+  int64_t getSpecializationBonus(Argument &A, Constant *C);
+  void specialize(SpecializationCandidate &Cand, ArrayRef<CallBase *> Calls);
+};
+
+} // end anonymous namespace
+
+/// Return true if \p F may be cloned, and record its size.
+bool FunctionSpecializer::isCandidateFunction(Function &F) {
+  auto It = FunctionSizes.find(&F);
+  if (It != FunctionSizes.end())
+    return It->second != 0;
+
+  unsigned &Size = FunctionSizes[&F];
+  if (F.isDeclaration() || F.isVarArg() || F.hasOptNone() ||
+      F.hasOptSize() || F.hasFnAttribute(Attribute::NoDuplicate))
+    return false;
+
+  CodeMetrics Metrics;
+  SmallPtrSet<const Value *, 32> EphValues;
+  CodeMetrics::collectEphemeralValues(&F, &GetAC(F), EphValues);
+  const TargetTransformInfo &TTI = GetTTI(F);
+  for (BasicBlock &BB : F)
+    Metrics.analyzeBasicBlock(&BB, TTI, EphValues);
+  if (Metrics.notDuplicatable)
+    return false;
+  Size = std::max(Metrics.NumInsts, 1u);
+  return true;
+}
+
+/// Return the cost of \p I, which will fold or simplify in the clone, weighted
+/// by the depth of the loops it is in.
+int64_t FunctionSpecializer::getUserBonus(Instruction &I,
+                                          const TargetTransformInfo &TTI,
+                                          const LoopInfo &LI) {
+  int64_t Bonus = TTI.getUserCost(&I, TargetTransformInfo::TCK_SizeAndLatency);
+  for (unsigned Depth = LI.getLoopDepth(I.getParent());
+       Depth && Bonus < std::numeric_limits<int>::max(); --Depth)
+    Bonus *= AvgLoopIterationCount;
+  return Bonus;
+}
+
+/// Return the benefit of turning the indirect call \p CB into a direct call
+/// to \p C, which is what inlining the callee would save.
+int64_t FunctionSpecializer::getIndirectCallBonus(CallBase &CB, Constant *C) {
+  auto *Callee = dyn_cast<Function>(C->stripPointerCasts());
+  if (!Callee || Callee->isDeclaration() ||
+      CB.getFunctionType() != Callee->getFunctionType())
+    return 0;
+
+  InlineParams Params = getInlineParams();
+  auto GetAssumptionCache = [this](Function &F) -> AssumptionCache & {
+    return GetAC(F);
+  };
+  InlineCost IC = getInlineCost(CB, Callee, Params, GetTTI(*Callee),
+                                GetAssumptionCache, GetTLI);
+  if (IC.isAlways())
+    return Params.DefaultThreshold;
+  if (IC.isVariable())
+    return std::max(IC.getCostDelta(), 0);
+  return 0;
+}
+
+/// Estimate how much cheaper the body of \p A's function gets when \p A is
+/// known to be \p C.
+int64_t FunctionSpecializer::getSpecializationBonus(Argument &A, Constant *C) {
+  Function &F = *A.getParent();
+  const TargetTransformInfo &TTI = GetTTI(F);
+  const LoopInfo &LI = GetLI(F);
+
+  int64_t Bonus = 0;
+  for (User *U : A.users()) {
+    auto *I = dyn_cast<Instruction>(U);
+    if (!I)
+      continue;
+    Bonus += getUserBonus(*I, TTI, LI);
+    if (auto *CB = dyn_cast<CallBase>(I))
+      if (CB->getCalledOperand() == &A)
+        Bonus += getIndirectCallBonus(*CB, C);
+  }
+  return Bonus;
+}
+
+/// Clone the candidate's function with its argument replaced by the constant,
+/// and redirect \p Calls to the clone.
+void FunctionSpecializer::specialize(SpecializationCandidate &Cand,
+                                     ArrayRef<CallBase *> Calls) {
+  Function *F = Cand.F;
+  ValueToValueMapTy VMap;
+  Function *Clone = CloneFunction(F, VMap);
+  Clone->setName(F->getName() + ".specialized");
+  Clone->setLinkage(GlobalValue::InternalLinkage);
+  Clone->setVisibility(GlobalValue::DefaultVisibility);
+  Clone->setDLLStorageClass(GlobalValue::DefaultStorageClass);
+  Clone->setComdat(nullptr);
+
+  Argument *A = Clone->getArg(Cand.ArgNo);
+  A->replaceAllUsesWith(Cand.C);
+
+  // Like IPSCCP, drop the attributes that only hold while the memory is
+  // reached through the arguments.
+  AttrBuilder AttributesToRemove;
+  bool ReplacedPointerArg = A->getType()->isPointerTy();
+  if (ReplacedPointerArg) {
+    AttributesToRemove.addAttribute(Attribute::ArgMemOnly);
+    AttributesToRemove.addAttribute(Attribute::InaccessibleMemOrArgMemOnly);
+    Clone->removeAttributes(AttributeList::FunctionIndex, AttributesToRemove);
+  }
+
+  auto Redirect = [&](CallBase *CB) {
+    CB->setCalledFunction(Clone);
+    if (ReplacedPointerArg)
+      CB->removeAttributes(AttributeList::FunctionIndex, AttributesToRemove);
+    ++NumCallsRedirected;
+  };
+  for (CallBase *CB : Calls)
+    Redirect(CB);
+
+  // Recursive calls that pass the same constant stay in the clone.
+  for (Instruction &I : instructions(Clone))
+    if (auto *CB = dyn_cast<CallBase>(&I))
+      if (CB->getCalledFunction() == F &&
+          CB->getArgOperand(Cand.ArgNo) == Cand.C)
+        Redirect(CB);
+
+  LLVM_DEBUG(dbgs() << "FnSpecialization: Created " << Clone->getName()
+                    << " for argument " << Cand.ArgNo << " = " << *Cand.C
+                    << "\n");
+  ++NumFuncSpecialized;
+}
+
+bool FunctionSpecializer::run(Module &M) {
+  // Group the call sites by the function, argument and constant they pass.
+  MapVector<std::tuple<Function *, unsigned, Constant *>,
+            SmallVector<CallBase *, 4>>
+      ConstantArgs;
+  findIPSCCPConstantArguments(
+      M, DL, GetTLI, [&](CallBase &CB, unsigned ArgNo, Constant *C) {
+        Function *F = CB.getCalledFunction();
+        if (CB.getFunctionType() != F->getFunctionType() ||
+            !isCandidateFunction(*F))
+          return;
+        Argument *A = F->getArg(ArgNo);
+        if (A->use_empty() || A->hasPassPointeeByValueCopyAttr())
+          return;
+        ConstantArgs[std::make_tuple(F, ArgNo, C)].push_back(&CB);
+      });
+
+  std::vector<SpecializationCandidate> Candidates;
+  for (auto &Entry : ConstantArgs) {
+    SpecializationCandidate Cand;
+    std::tie(Cand.F, Cand.ArgNo, Cand.C) = Entry.first;
+    Cand.Calls = std::move(Entry.second);
+
+    // IPSCCP already propagates a constant that every caller passes.
+    if (Cand.F->hasLocalLinkage() && Cand.Calls.size() == Cand.F->getNumUses())
+      continue;
+
+    Cand.Cost = int64_t(FunctionSizes[Cand.F]) * InlineConstants::InstrCost;
+    Cand.Bonus = getSpecializationBonus(*Cand.F->getArg(Cand.ArgNo), Cand.C);
+    if (Cand.getGain(Cand.Calls.size()) <= 0)
+      continue;
+    LLVM_DEBUG(dbgs() << "FnSpecialization: Candidate " << Cand.F->getName()
+                      << " argument " << Cand.ArgNo << " = " << *Cand.C
+                      << ", bonus " << Cand.Bonus << " x "
+                      << Cand.Calls.size() << " calls, cost " << Cand.Cost
+                      << "\n");
+    Candidates.push_back(std::move(Cand));
+  }
+  if (Candidates.empty())
+    return false;
+
+  llvm::stable_sort(Candidates, [](const SpecializationCandidate &LHS,
+                                   const SpecializationCandidate &RHS) {
+    return LHS.getGain(LHS.Calls.size()) > RHS.getGain(RHS.Calls.size());
+  });
+
+  uint64_t ModuleSize = 0;
+  for (Function &F : M)
+    ModuleSize += F.getInstructionCount();
+  uint64_t Budget =
+      std::max<uint64_t>(ModuleSize * MaxGrowth / 100, MinBudget);
+
+  DenseMap<Function *, unsigned> NumClones;
+  bool Changed = false;
+  for (SpecializationCandidate &Cand : Candidates) {
+    unsigned &Clones = NumClones[Cand.F];
+    unsigned Size = FunctionSizes[Cand.F];
+    if (Clones >= MaxClonesThreshold || Size > Budget)
+      continue;
+
+    // An earlier clone may have taken some of the call sites.
+    SmallVector<CallBase *, 4> Calls;
+    for (CallBase *CB : Cand.Calls)
+      if (CB->getCalledFunction() == Cand.F)
+        Calls.push_back(CB);
+    if (Cand.getGain(Calls.size()) <= 0)
+      continue;
+
+    specialize(Cand, Calls);
+    Budget -= Size;
+    ++Clones;
+    Changed = true;
+  }
+  return Changed;
+}
+
+PreservedAnalyses FunctionSpecializationPass::run(Module &M,
+                                                  ModuleAnalysisManager &AM) {
+  auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  auto GetTLI = [&FAM](Function &F) -> const TargetLibraryInfo & {
+    return FAM.getResult<TargetLibraryAnalysis>(F);
+  };
+  auto GetTTI = [&FAM](Function &F) -> TargetTransformInfo & {
+    return FAM.getResult<TargetIRAnalysis>(F);
+  };
+  auto GetAC = [&FAM](Function &F) -> AssumptionCache & {
+    return FAM.getResult<AssumptionAnalysis>(F);
+  };
+  auto GetLI = [&FAM](Function &F) -> LoopInfo & {
+    return FAM.getResult<LoopAnalysis>(F);
+  };
+
+  FunctionSpecializer Specializer(M.getDataLayout(), GetTLI, GetTTI, GetAC,
+                                  GetLI);
+  if (!Specializer.run(M))
+    return PreservedAnalyses::all();
+  return PreservedAnalyses::none();
+}
+
+namespace {
+
+class FunctionSpecializationLegacyPass : public ModulePass {
+public:
+  static char ID;
+
+  FunctionSpecializationLegacyPass() : ModulePass(ID) {
+    initializeFunctionSpecializationLegacyPassPass(
+        *PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override {
+    if (skipModule(M))
+      return false;
+    auto GetTLI = [this](Function &F) -> const TargetLibraryInfo & {
+      return this->getAnalysis<TargetLibraryInfoWrapperPass>().getTLI(F);
+    };
+    auto GetTTI = [this](Function &F) -> TargetTransformInfo & {
+      return this->getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+    };
+    auto GetAC = [this](Function &F) -> AssumptionCache & {
+      return this->getAnalysis<AssumptionCacheTracker>().getAssumptionCache(F);
+    };
+    auto GetLI = [this](Function &F) -> LoopInfo & {
+      return this->getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+    };
+
+    FunctionSpecializer Specializer(M.getDataLayout(), GetTLI, GetTTI, GetAC,
+                                    GetLI);
+    return Specializer.run(M);
+  }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<AssumptionCacheTracker>();
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+    AU.addRequired<TargetTransformInfoWrapperPass>();
+  }
+};
+
+} // end anonymous namespace
+
+char FunctionSpecializationLegacyPass::ID = 0;
+
+INITIALIZE_PASS_BEGIN(FunctionSpecializationLegacyPass,
+                      "function-specialization",
+                      "Function Specialization", false, false)
+INITIALIZE_PASS_DEPENDENCY(AssumptionCacheTracker)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(TargetLibraryInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
+INITIALIZE_PASS_END(FunctionSpecializationLegacyPass,
+                    "function-specialization",
+                    "Function Specialization", false, false)
+
+ModulePass *llvm::createFunctionSpecializationPass() {
+  return new FunctionSpecializationLegacyPass();
+}
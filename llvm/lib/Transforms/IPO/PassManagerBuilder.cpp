@@ -153,6 +153,14 @@ cl::opt<bool> EnableMatrix(
     "enable-matrix", cl::init(false), cl::Hidden,
     cl::desc("Enable lowering of the matrix intrinsics"));
 
+cl::opt<bool> EnableFunctionSpecialization(
+    "enable-function-specialization", cl::init(true), cl::Hidden,
+    cl::desc("Enable the function specialization pass at -O3 and in LTO"));
+
+cl::opt<bool> EnableLoopFlatten(
+    "enable-loop-flatten", cl::init(true), cl::Hidden,
+    cl::desc("Enable the loop flattening pass at -O3"));
+
 cl::opt<bool> EnableConstraintElimination(
     "enable-constraint-elimination", cl::init(false), cl::Hidden,
     cl::desc(
@@ -590,6 +598,8 @@ void PassManagerBuilder::populateModulePassManager(
   if (OptLevel > 2)
     MPM.add(createCallSiteSplittingPass());
 
+  if (OptLevel > 2 && EnableFunctionSpecialization)
+    MPM.add(createFunctionSpecializationPass());
   MPM.add(createIPSCCPPass());          // IP SCCP
   MPM.add(createCalledValuePropagationPass());
 
@@ -924,6 +934,8 @@ void PassManagerBuilder::addLTOOptimizationPasses(legacy::PassManagerBase &PM) {
     // Propagate constants at call sites into the functions they call.  This
     // opens opportunities for globalopt (and inlining) by substituting function
     // pointers passed as arguments to direct uses of functions.
+    if (OptLevel > 2 && EnableFunctionSpecialization)
+      PM.add(createFunctionSpecializationPass());
     PM.add(createIPSCCPPass());
 
     // Attach metadata to indirect call sites indicating the set of functions
@@ -79,12 +79,14 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/ModuleSummaryIndexYAML.h"
 #include "llvm/InitializePasses.h"
 #include "llvm/Pass.h"
 #include "llvm/PassRegistry.h"
+#include "llvm/ProfileData/InstrProf.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Errc.h"
@@ -94,6 +96,8 @@
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/FunctionAttrs.h"
+#include "llvm/Transforms/Instrumentation.h"
+#include "llvm/Transforms/Utils/CallPromotionUtils.h"
 #include "llvm/Transforms/Utils/Evaluator.h"
 #include <algorithm>
 #include <cstddef>
@@ -135,6 +139,28 @@ static cl::opt<unsigned>
                 cl::desc("Maximum number of call targets per "
                          "call site to enable branch funnels"));
 
+static cl::opt<bool> ClGuardedDevirt(
+    "wholeprogramdevirt-guarded", cl::Hidden, cl::init(true), cl::ZeroOrMore,
+    cl::desc("Use value profiles to promote the hot targets of virtual calls "
+             "to direct calls guarded by a vtable pointer comparison"));
+
+static cl::opt<unsigned> ClGuardedPercent(
+    "wholeprogramdevirt-guarded-percent", cl::Hidden, cl::init(30),
+    cl::ZeroOrMore,
+    cl::desc("Minimum percentage of the remaining count of a virtual call "
+             "that a target needs to get a guarded direct call"));
+
+static cl::opt<unsigned> ClGuardedMaxTargets(
+    "wholeprogramdevirt-guarded-max-targets", cl::Hidden, cl::init(2),
+    cl::ZeroOrMore,
+    cl::desc("Maximum number of guarded direct calls per virtual call"));
+
+static cl::opt<unsigned> ClGuardedMaxVTables(
+    "wholeprogramdevirt-guarded-max-vtables", cl::Hidden, cl::init(2),
+    cl::ZeroOrMore,
+    cl::desc("Maximum number of vtable pointer comparisons per guarded "
+             "direct call"));
+
 static cl::opt<bool>
     PrintSummaryDevirt("wholeprogramdevirt-print-index-based", cl::Hidden,
                        cl::init(false), cl::ZeroOrMore,
@@ -486,6 +512,18 @@ void VTableSlotInfo::addCallSite(Value *VTable, CallBase &CB,
   CSI.CallSites.push_back({VTable, CB, NumUnsafeUses});
 }
 
+// A target of guarded devirtualization: the function and the address points
+// of the vtables whose slot holds it. The vtable pointer of a call is compared
+// to the address points to decide whether to call the function directly.
+struct GuardedTarget {
+  Function *Fn = nullptr;
+  SmallVector<Constant *, 2> AddressPoints;
+};
+
+// Guarded devirtualization targets by the GUID of their PGO name, which is
+// how value profiles refer to them.
+using GuardedTargetMap = DenseMap<GlobalValue::GUID, GuardedTarget>;
+
 struct DevirtModule {
   Module &M;
   function_ref<AAResults &(Function &)> AARGetter;
@@ -560,6 +598,18 @@ struct DevirtModule {
                            VTableSlotInfo &SlotInfo,
                            WholeProgramDevirtResolution *Res);
 
+  void findGuardedTargets(ArrayRef<VirtualCallTarget> TargetsForSlot,
+                          const DenseSet<GlobalValue::GUID> &Profiled,
+                          GuardedTargetMap &Targets);
+  void importGuardedTargets(VTableSlot Slot,
+                            const DenseSet<GlobalValue::GUID> &Profiled,
+                            FunctionType *FTy, GuardedTargetMap &Targets);
+  bool tryGuardedDevirt(
+      VTableSlotInfo &SlotInfo,
+      function_ref<void(const DenseSet<GlobalValue::GUID> &, FunctionType *,
+                        GuardedTargetMap &)>
+          FindTargets);
+
   void applyICallBranchFunnel(VTableSlotInfo &SlotInfo, Constant *JT,
                               bool &IsExported);
   void tryICallBranchFunnel(MutableArrayRef<VirtualCallTarget> TargetsForSlot,
@@ -667,6 +717,9 @@ struct DevirtIndex {
                            WholeProgramDevirtResolution *Res,
                            std::set<ValueInfo> &DevirtTargets);
 
+  void exportGuardedTargets(const TypeIdCompatibleVtableInfo &TIdInfo,
+                            uint64_t ByteOffset, VTableSlotInfo &SlotInfo);
+
   void run();
 };
 
@@ -1189,6 +1242,226 @@ bool DevirtIndex::trySingleImplDevirt(MutableArrayRef<ValueInfo> TargetsForSlot,
   return true;
 }
 
+// Whether any copy of VI in the index is a local, whose name in the ThinLTO
+// backends may be a promoted one.
+static bool hasLocalSummary(ValueInfo VI) {
+  return llvm::any_of(VI.getSummaryList(), [](const auto &S) {
+    return GlobalValue::isLocalLinkage(S->linkage());
+  });
+}
+
+void DevirtIndex::exportGuardedTargets(
+    const TypeIdCompatibleVtableInfo &TIdInfo, uint64_t ByteOffset,
+    VTableSlotInfo &SlotInfo) {
+  if (!ClGuardedDevirt)
+    return;
+
+  // The value profiles of the calls are in the summaries of the callers, as
+  // call edges to the profiled targets.
+  std::vector<FunctionSummary *> Callers;
+  auto Collect = [&](CallSiteInfo &CSInfo) {
+    Callers.insert(Callers.end(), CSInfo.SummaryTypeCheckedLoadUsers.begin(),
+                   CSInfo.SummaryTypeCheckedLoadUsers.end());
+    Callers.insert(Callers.end(), CSInfo.SummaryTypeTestAssumeUsers.begin(),
+                   CSInfo.SummaryTypeTestAssumeUsers.end());
+  };
+  Collect(SlotInfo.CSInfo);
+  for (auto &P : SlotInfo.ConstCSInfo)
+    Collect(P.second);
+  DenseSet<GlobalValue::GUID> Profiled;
+  for (FunctionSummary *FS : Callers)
+    for (auto &Call : FS->calls())
+      Profiled.insert(Call.first.getGUID());
+  if (Profiled.empty())
+    return;
+
+  // The ThinLTO backends refer by name to the profiled targets and to the
+  // vtables that hold them (see DevirtModule::importGuardedTargets), so these
+  // must not be internalized if a caller is in another module.
+  auto Export = [&](ValueInfo VI) {
+    for (auto &S : VI.getSummaryList())
+      for (FunctionSummary *FS : Callers)
+        if (S->modulePath() != FS->modulePath()) {
+          ExportedGUIDs.insert(VI.getGUID());
+          return;
+        }
+  };
+  for (const TypeIdOffsetVtableInfo &P : TIdInfo) {
+    if (hasLocalSummary(P.VTableVI))
+      continue;
+    const GlobalVarSummary *VS = nullptr;
+    for (auto &S : P.VTableVI.getSummaryList())
+      if (!GlobalValue::isAvailableExternallyLinkage(S->linkage()))
+        VS = dyn_cast<GlobalVarSummary>(S->getBaseObject());
+    if (!VS || !VS->isLive())
+      continue;
+
+    for (auto VTP : VS->vTableFuncs()) {
+      if (VTP.VTableOffset != P.AddressPointOffset + ByteOffset ||
+          !Profiled.count(VTP.FuncVI.getGUID()) ||
+          hasLocalSummary(VTP.FuncVI))
+        continue;
+      Export(P.VTableVI);
+      Export(VTP.FuncVI);
+    }
+  }
+}
+
+void DevirtModule::findGuardedTargets(
+    ArrayRef<VirtualCallTarget> TargetsForSlot,
+    const DenseSet<GlobalValue::GUID> &Profiled, GuardedTargetMap &Targets) {
+  for (const VirtualCallTarget &Target : TargetsForSlot) {
+    GlobalValue::GUID GUID =
+        Function::getGUID(getPGOFuncName(*Target.Fn, /*InLTO=*/true));
+    if (!Profiled.count(GUID))
+      continue;
+    GuardedTarget &GT = Targets[GUID];
+    GT.Fn = Target.Fn;
+    GT.AddressPoints.push_back(getMemberAddr(Target.TM));
+  }
+}
+
+void DevirtModule::importGuardedTargets(
+    VTableSlot Slot, const DenseSet<GlobalValue::GUID> &Profiled,
+    FunctionType *FTy, GuardedTargetMap &Targets) {
+  auto *TypeId = dyn_cast<MDString>(Slot.TypeID);
+  if (!TypeId)
+    return;
+  Optional<TypeIdCompatibleVtableInfo> TIdInfo =
+      ImportSummary->getTypeIdCompatibleVtableSummary(TypeId->getString());
+  if (!TIdInfo)
+    return;
+
+  // Find the targets in the vtable summaries, as the vtables are usually not
+  // defined in this module. Locals are skipped since the names they may have
+  // been promoted to are not known here, and so are values without a name in
+  // the summary, e.g. in the index of a distributed backend. The thin link
+  // exported the others, see DevirtIndex::exportGuardedTargets.
+  for (const TypeIdOffsetVtableInfo &P : *TIdInfo) {
+    if (P.VTableVI.name().empty() || hasLocalSummary(P.VTableVI))
+      continue;
+    const GlobalVarSummary *VS = nullptr;
+    for (auto &S : P.VTableVI.getSummaryList())
+      if (!GlobalValue::isAvailableExternallyLinkage(S->linkage()))
+        VS = dyn_cast<GlobalVarSummary>(S->getBaseObject());
+    if (!VS || !VS->isLive())
+      continue;
+
+    for (auto VTP : VS->vTableFuncs()) {
+      if (VTP.VTableOffset != P.AddressPointOffset + Slot.ByteOffset)
+        continue;
+      ValueInfo FnVI = VTP.FuncVI;
+      if (!Profiled.count(FnVI.getGUID()) || FnVI.name().empty() ||
+          hasLocalSummary(FnVI))
+        continue;
+
+      GuardedTarget &GT = Targets[FnVI.getGUID()];
+      if (!GT.Fn)
+        GT.Fn = dyn_cast<Function>(M.getOrInsertFunction(FnVI.name(), FTy)
+                                       .getCallee()
+                                       ->stripPointerCasts());
+      Constant *VTable = M.getOrInsertGlobal(P.VTableVI.name(), Int8Arr0Ty);
+      GT.AddressPoints.push_back(ConstantExpr::getGetElementPtr(
+          Int8Ty, ConstantExpr::getBitCast(VTable, Int8PtrTy),
+          ConstantInt::get(Int64Ty, P.AddressPointOffset)));
+    }
+  }
+}
+
+bool DevirtModule::tryGuardedDevirt(
+    VTableSlotInfo &SlotInfo,
+    function_ref<void(const DenseSet<GlobalValue::GUID> &, FunctionType *,
+                      GuardedTargetMap &)>
+        FindTargets) {
+  if (!ClGuardedDevirt)
+    return false;
+
+  // Read the value profiles of the call sites that are still indirect. Only
+  // the hottest targets are read, as only those can be promoted.
+  const uint32_t MaxNumValueData = 8;
+  struct ProfiledCallSite {
+    VirtualCallSite *VCallSite;
+    SmallVector<InstrProfValueData, 8> VDs;
+    uint64_t TotalCount;
+  };
+  std::vector<ProfiledCallSite> ProfiledCallSites;
+  DenseSet<GlobalValue::GUID> Profiled;
+  auto Collect = [&](CallSiteInfo &CSInfo) {
+    if (CSInfo.AllCallSitesDevirted)
+      return;
+    for (auto &&VCallSite : CSInfo.CallSites) {
+      InstrProfValueData VDs[MaxNumValueData];
+      uint32_t NumVals;
+      uint64_t TotalCount;
+      if (!getValueProfDataFromInst(VCallSite.CB, IPVK_IndirectCallTarget,
+                                    MaxNumValueData, VDs, NumVals, TotalCount))
+        continue;
+      ProfiledCallSites.push_back(
+          {&VCallSite, {VDs, VDs + NumVals}, TotalCount});
+      for (const InstrProfValueData &VD : makeArrayRef(VDs, NumVals))
+        Profiled.insert(VD.Value);
+    }
+  };
+  Collect(SlotInfo.CSInfo);
+  for (auto &P : SlotInfo.ConstCSInfo)
+    Collect(P.second);
+  if (ProfiledCallSites.empty())
+    return false;
+
+  GuardedTargetMap Targets;
+  FindTargets(Profiled,
+              ProfiledCallSites.front().VCallSite->CB.getFunctionType(),
+              Targets);
+  if (Targets.empty())
+    return false;
+
+  bool Changed = false;
+  MDBuilder MDB(M.getContext());
+  for (ProfiledCallSite &PCS : ProfiledCallSites) {
+    VirtualCallSite &VCallSite = *PCS.VCallSite;
+    CallBase &CB = VCallSite.CB;
+    uint64_t RemainingCount = PCS.TotalCount;
+    SmallVector<InstrProfValueData, 8> Unpromoted;
+    unsigned NumPromoted = 0;
+
+    for (const InstrProfValueData &VD : PCS.VDs) {
+      auto I = Targets.find(VD.Value);
+      if (NumPromoted == ClGuardedMaxTargets || I == Targets.end() ||
+          !I->second.Fn ||
+          I->second.AddressPoints.size() > ClGuardedMaxVTables ||
+          VD.Count * 100 < ClGuardedPercent * RemainingCount ||
+          !isLegalToPromote(CB, I->second.Fn)) {
+        Unpromoted.push_back(VD);
+        continue;
+      }
+
+      uint64_t ElseCount = RemainingCount - VD.Count;
+      uint64_t Scale = calculateCountScale(std::max(VD.Count, ElseCount));
+      MDNode *BranchWeights =
+          MDB.createBranchWeights(scaleBranchCount(VD.Count, Scale),
+                                  scaleBranchCount(ElseCount, Scale));
+      promoteCallWithVTableCmp(CB, VCallSite.VTable, I->second.Fn,
+                               I->second.AddressPoints, BranchWeights);
+      if (RemarksEnabled)
+        VCallSite.emitRemark("guarded-devirt", I->second.Fn->getName(),
+                             OREGetter);
+      RemainingCount = ElseCount;
+      ++NumPromoted;
+    }
+    if (!NumPromoted)
+      continue;
+
+    // Keep the profile of the targets left to the indirect call, for indirect
+    // call promotion.
+    Changed = true;
+    CB.setMetadata(LLVMContext::MD_prof, nullptr);
+    if (RemainingCount && !Unpromoted.empty())
+      annotateValueSite(M, CB, Unpromoted, RemainingCount,
+                        IPVK_IndirectCallTarget, Unpromoted.size());
+  }
+  return Changed;
+}
+
 void DevirtModule::tryICallBranchFunnel(
     MutableArrayRef<VirtualCallTarget> TargetsForSlot, VTableSlotInfo &SlotInfo,
     WholeProgramDevirtResolution *Res, VTableSlot Slot) {
@@ -1925,6 +2198,13 @@ void DevirtModule::importResolution(VTableSlot Slot, VTableSlotInfo &SlotInfo) {
     }
   }
 
+  // The call sites left indirect may still be promoted with the help of their
+  // value profile and the vtables in the summary.
+  tryGuardedDevirt(SlotInfo, [&](const DenseSet<GlobalValue::GUID> &Profiled,
+                                 FunctionType *FTy, GuardedTargetMap &Targets) {
+    importGuardedTargets(Slot, Profiled, FTy, Targets);
+  });
+
   if (Res.TheKind == WholeProgramDevirtResolution::BranchFunnel) {
     // The type of the function is irrelevant, because it's bitcast at calls
     // anyhow.
@@ -2077,6 +2357,13 @@ bool DevirtModule::run() {
         DidVirtualConstProp |=
             tryVirtualConstProp(TargetsForSlot, S.second, Res, S.first);
 
+        tryGuardedDevirt(S.second,
+                         [&](const DenseSet<GlobalValue::GUID> &Profiled,
+                             FunctionType *, GuardedTargetMap &Targets) {
+                           findGuardedTargets(TargetsForSlot, Profiled,
+                                              Targets);
+                         });
+
         tryICallBranchFunnel(TargetsForSlot, S.second, Res, S.first);
       }
 
@@ -2195,8 +2482,10 @@ void DevirtIndex::run() {
                                   S.first.ByteOffset)) {
 
       if (!trySingleImplDevirt(TargetsForSlot, S.first, S.second, Res,
-                               DevirtTargets))
+                               DevirtTargets)) {
+        exportGuardedTargets(*TidSummary, S.first.ByteOffset, S.second);
         continue;
+      }
     }
   }
 
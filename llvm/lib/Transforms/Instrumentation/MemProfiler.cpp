@@ -12,18 +12,28 @@
 // memcpy, memset) are changed to call the memory profiling runtime version
 // instead.
 //
+// The profile of an instrumented run is used by MemProfUsePass to mark the
+// allocation calls that are hot or cold.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Instrumentation/MemProfiler.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
@@ -31,6 +41,7 @@
 #include "llvm/IR/Value.h"
 #include "llvm/InitializePasses.h"
 #include "llvm/Pass.h"
+#include "llvm/ProfileData/MemProf.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Transforms/Instrumentation.h"
@@ -610,3 +621,223 @@ bool MemProfiler::instrumentFunction(Function &F) {
 
   return FunctionModified;
 }
+
+// Profile use.
+
+static cl::opt<std::string>
+    ClMemProfProfileFile("memprof-profile-file",
+                         cl::desc("The indexed memory profile to use"),
+                         cl::Hidden, cl::init(""));
+
+static cl::opt<unsigned> ClColdMinAveLifetime(
+    "memprof-ave-lifetime-cold-threshold",
+    cl::desc("The minimum average lifetime, in ms, of cold allocations"),
+    cl::Hidden, cl::init(1000));
+
+static cl::opt<double> ClColdMaxAccessDensity(
+    "memprof-lifetime-access-density-cold-threshold",
+    cl::desc("The maximum number of accesses per byte per second of cold "
+             "allocations"),
+    cl::Hidden, cl::init(0.05));
+
+static cl::opt<double> ClHotMinAccessDensity(
+    "memprof-lifetime-access-density-hot-threshold",
+    cl::desc("The minimum number of accesses per byte per second of hot "
+             "allocations"),
+    cl::Hidden, cl::init(100));
+
+static cl::opt<bool> ClHotColdNew(
+    "memprof-hot-cold-new",
+    cl::desc("Pass the hint of hot and cold allocations to operator new, "
+             "through its __hot_cold_t overload"),
+    cl::Hidden, cl::init(false));
+
+STATISTIC(NumMatchedAllocCalls,
+          "Number of allocation calls with a memory profile");
+STATISTIC(NumColdAllocCalls, "Number of allocation calls marked cold");
+STATISTIC(NumHotAllocCalls, "Number of allocation calls marked hot");
+STATISTIC(NumMixedAllocCalls,
+          "Number of allocation calls whose contexts are not all alike");
+
+namespace {
+
+enum class AllocationType { None, Cold, Hot };
+
+/// A frame of the inline call stack of an allocation call, as it is described
+/// in the memory profile.
+struct InlineFrame {
+  uint64_t Function;
+  uint32_t LineOffset;
+  uint32_t Column;
+};
+
+} // end anonymous namespace
+
+static AllocationType getAllocType(const memprof::PortableMemInfoBlock &Info) {
+  if (!Info.AllocCount)
+    return AllocationType::None;
+  // The lifetimes are in ms, which short lived allocations round down to 0.
+  double AveLifetime = Info.getAverageLifetime();
+  double AccessesPerSecond =
+      Info.getAccessDensity() * 1000 / std::max(AveLifetime, 1.0);
+  if (AveLifetime >= ClColdMinAveLifetime &&
+      AccessesPerSecond < ClColdMaxAccessDensity)
+    return AllocationType::Cold;
+  if (AccessesPerSecond >= ClHotMinAccessDensity)
+    return AllocationType::Hot;
+  return AllocationType::None;
+}
+
+/// Return the inline call stack of \p DIL, starting with the function it is
+/// in, the way the profile symbolizes it.
+static SmallVector<InlineFrame, 4> getInlineCallStack(const DILocation *DIL) {
+  SmallVector<InlineFrame, 4> CallStack;
+  for (; DIL; DIL = DIL->getInlinedAt()) {
+    const DISubprogram *SP = DIL->getScope()->getSubprogram();
+    StringRef Name = SP->getLinkageName();
+    if (Name.empty())
+      Name = SP->getName();
+    CallStack.push_back({GlobalValue::getGUID(Name),
+                         DIL->getLine() - SP->getLine(), DIL->getColumn()});
+  }
+  return CallStack;
+}
+
+static bool matchesInlineCallStack(const memprof::AllocationInfo &Site,
+                                   ArrayRef<InlineFrame> CallStack) {
+  // The allocation contexts of the profile extend the inline call stack with
+  // the callers of the function the call ended up in.
+  if (Site.CallStack.size() < CallStack.size())
+    return false;
+  for (unsigned I = 0, E = CallStack.size(); I != E; ++I) {
+    const memprof::Frame &F = Site.CallStack[I];
+    if (F.Function != CallStack[I].Function ||
+        F.LineOffset != CallStack[I].LineOffset ||
+        F.Column != CallStack[I].Column)
+      return false;
+  }
+  return true;
+}
+
+/// Replace the call to operator new \p CI with a call to its overload that
+/// takes a hot or cold hint, as provided by e.g. tcmalloc.
+static void addHotColdHint(CallInst *CI, const TargetLibraryInfo &TLI,
+                           AllocationType Type) {
+  Function *Callee = CI->getCalledFunction();
+  LibFunc Func;
+  if (!Callee || !TLI.getLibFunc(*Callee, Func))
+    return;
+  StringRef HotColdName;
+  if (Func == LibFunc_Znwm)
+    HotColdName = "_Znwm12__hot_cold_t";
+  else if (Func == LibFunc_Znam)
+    HotColdName = "_Znam12__hot_cold_t";
+  else
+    return;
+
+  // The hint is a byte, from the coldest (0) to the hottest (255).
+  Module *M = CI->getModule();
+  IRBuilder<> IRB(CI);
+  FunctionCallee HotColdNew = M->getOrInsertFunction(
+      HotColdName, CI->getType(), CI->getArgOperand(0)->getType(),
+      IRB.getInt8Ty());
+  CallInst *NewCI = IRB.CreateCall(
+      HotColdNew, {CI->getArgOperand(0),
+                   IRB.getInt8(Type == AllocationType::Cold ? 1 : 254)});
+  NewCI->setAttributes(CI->getAttributes());
+  NewCI->setDebugLoc(CI->getDebugLoc());
+  NewCI->takeName(CI);
+  CI->replaceAllUsesWith(NewCI);
+  CI->eraseFromParent();
+}
+
+MemProfUsePass::MemProfUsePass(std::string MemoryProfileFile)
+    : MemoryProfileFileName(MemoryProfileFile.empty() ? ClMemProfProfileFile
+                                                      : MemoryProfileFile) {}
+
+PreservedAnalyses MemProfUsePass::run(Module &M, ModuleAnalysisManager &AM) {
+  LLVMContext &Ctx = M.getContext();
+  auto ReaderOrErr =
+      memprof::IndexedMemProfReader::create(MemoryProfileFileName);
+  if (Error E = ReaderOrErr.takeError()) {
+    handleAllErrors(std::move(E), [&](const ErrorInfoBase &EI) {
+      Ctx.diagnose(DiagnosticInfoPGOProfile(MemoryProfileFileName.data(),
+                                            EI.message()));
+    });
+    return PreservedAnalyses::all();
+  }
+  const memprof::IndexedMemProfReader &Reader = **ReaderOrErr;
+
+  // The records of the functions the allocation calls are in, which are
+  // looked up once.
+  DenseMap<uint64_t, Optional<memprof::MemProfRecord>> Records;
+  auto getRecord = [&](uint64_t Function) -> memprof::MemProfRecord * {
+    auto Inserted = Records.try_emplace(Function);
+    if (Inserted.second) {
+      auto RecordOrErr = Reader.getRecord(Function);
+      if (RecordOrErr)
+        Inserted.first->second = std::move(*RecordOrErr);
+      else
+        consumeError(RecordOrErr.takeError());
+    }
+    return Inserted.first->second.getPointer();
+  };
+
+  auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    const TargetLibraryInfo &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+
+    SmallVector<std::pair<CallBase *, AllocationType>, 8> AllocCalls;
+    for (Instruction &I : instructions(F)) {
+      auto *CB = dyn_cast<CallBase>(&I);
+      if (!CB || !CB->getDebugLoc() || !isAllocationFn(CB, &TLI))
+        continue;
+      SmallVector<InlineFrame, 4> CallStack =
+          getInlineCallStack(CB->getDebugLoc());
+      memprof::MemProfRecord *Record = getRecord(CallStack.front().Function);
+      if (!Record)
+        continue;
+
+      // The call is only marked when all the contexts it was profiled in
+      // agree, since a single call site can't be told which one it is in.
+      Optional<AllocationType> Type;
+      bool Mixed = false;
+      for (const memprof::AllocationInfo &Site : Record->AllocSites) {
+        if (!matchesInlineCallStack(Site, CallStack))
+          continue;
+        AllocationType SiteType = getAllocType(Site.Info);
+        Mixed |= Type && *Type != SiteType;
+        Type = SiteType;
+      }
+      if (!Type)
+        continue;
+      ++NumMatchedAllocCalls;
+      if (Mixed) {
+        ++NumMixedAllocCalls;
+        continue;
+      }
+      if (*Type != AllocationType::None)
+        AllocCalls.push_back({CB, *Type});
+    }
+
+    for (auto &AllocCall : AllocCalls) {
+      CallBase *CB = AllocCall.first;
+      bool IsCold = AllocCall.second == AllocationType::Cold;
+      if (IsCold)
+        ++NumColdAllocCalls;
+      else
+        ++NumHotAllocCalls;
+      CB->addAttribute(AttributeList::FunctionIndex,
+                       Attribute::get(Ctx, "memprof", IsCold ? "cold" : "hot"));
+      if (ClHotColdNew)
+        if (auto *CI = dyn_cast<CallInst>(CB))
+          addHotColdHint(CI, TLI, AllocCall.second);
+      Changed = true;
+    }
+  }
+
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
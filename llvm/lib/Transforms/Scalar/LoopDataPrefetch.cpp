@@ -8,6 +8,14 @@
 //
 // This file implements a Loop Data Prefetching Pass.
 //
+// Accesses with a strided address are prefetched a few iterations ahead.
+// On targets that enable it, indirect accesses like A[B[i]] are prefetched by
+// loading the index of a later iteration, B[i + N], clamped to the last
+// iteration of the loop.
+//
+// When the function has profile data, loops in cold code and loops that are
+// expected to exit before the prefetched iterations are skipped.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Scalar/LoopDataPrefetch.h"
@@ -17,9 +25,12 @@
 #include "llvm/ADT/DepthFirstIterator.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Analysis/CodeMetrics.h"
+#include "llvm/Analysis/LazyBlockFrequencyInfo.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
@@ -31,6 +42,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
 #include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 using namespace llvm;
@@ -54,7 +66,12 @@ static cl::opt<unsigned> MaxPrefetchIterationsAhead(
     "max-prefetch-iters-ahead",
     cl::desc("Max number of iterations to prefetch ahead"), cl::Hidden);
 
+static cl::opt<bool>
+    PrefetchIndirect("loop-prefetch-indirect", cl::Hidden, cl::init(false),
+                     cl::desc("Prefetch indirect accesses like A[B[i]]"));
+
 STATISTIC(NumPrefetches, "Number of prefetches inserted");
+STATISTIC(NumIndirectPrefetches, "Number of indirect prefetches inserted");
 
 namespace {
 
@@ -63,14 +80,31 @@ class LoopDataPrefetch {
 public:
   LoopDataPrefetch(AssumptionCache *AC, DominatorTree *DT, LoopInfo *LI,
                    ScalarEvolution *SE, const TargetTransformInfo *TTI,
-                   OptimizationRemarkEmitter *ORE)
-      : AC(AC), DT(DT), LI(LI), SE(SE), TTI(TTI), ORE(ORE) {}
+                   OptimizationRemarkEmitter *ORE, ProfileSummaryInfo *PSI,
+                   BlockFrequencyInfo *BFI)
+      : AC(AC), DT(DT), LI(LI), SE(SE), TTI(TTI), ORE(ORE), PSI(PSI),
+        BFI(BFI) {}
 
   bool run();
 
 private:
   bool runOnLoop(Loop *L);
 
+  /// Return true if the profile shows that prefetching \p ItersAhead
+  /// iterations ahead in \p L is not worth it.
+  bool isUnprofitableByProfile(Loop *L, unsigned ItersAhead);
+
+  /// If \p Ptr is the address of an indirect access, whose only loop variant
+  /// part is the value of a load with a strided address in \p L, return that
+  /// load.
+  LoadInst *getIndexLoad(Loop *L, const SCEV *Ptr);
+
+  /// Return the address of \p IndexLoad \p ItersAhead iterations ahead,
+  /// clamped to the last iteration of \p L, or nullptr if it can't be
+  /// computed.
+  const SCEV *getClampedIndexAddress(Loop *L, LoadInst *IndexLoad,
+                                     unsigned ItersAhead);
+
   /// Check if the stride of the accesses is large enough to
   /// warrant a prefetch.
   bool isStrideLargeEnough(const SCEVAddRecExpr *AR, unsigned TargetMinStride);
@@ -103,12 +137,20 @@ private:
     return TTI->enableWritePrefetching();
   }
 
+  bool doPrefetchIndirect() {
+    if (PrefetchIndirect.getNumOccurrences() > 0)
+      return PrefetchIndirect;
+    return TTI->enableIndirectPrefetching();
+  }
+
   AssumptionCache *AC;
   DominatorTree *DT;
   LoopInfo *LI;
   ScalarEvolution *SE;
   const TargetTransformInfo *TTI;
   OptimizationRemarkEmitter *ORE;
+  ProfileSummaryInfo *PSI;
+  BlockFrequencyInfo *BFI;
 };
 
 /// Legacy class for inserting loop data prefetches.
@@ -129,6 +171,8 @@ public:
     AU.addRequired<ScalarEvolutionWrapperPass>();
     AU.addPreserved<ScalarEvolutionWrapperPass>();
     AU.addRequired<TargetTransformInfoWrapperPass>();
+    AU.addRequired<ProfileSummaryInfoWrapperPass>();
+    LazyBlockFrequencyInfoPass::getLazyBFIAnalysisUsage(AU);
   }
 
   bool runOnFunction(Function &F) override;
@@ -143,6 +187,8 @@ INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
 INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
 INITIALIZE_PASS_DEPENDENCY(OptimizationRemarkEmitterWrapperPass)
 INITIALIZE_PASS_DEPENDENCY(ScalarEvolutionWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ProfileSummaryInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(LazyBlockFrequencyInfoPass)
 INITIALIZE_PASS_END(LoopDataPrefetchLegacyPass, "loop-data-prefetch",
                     "Loop Data Prefetch", false, false)
 
@@ -175,8 +221,14 @@ PreservedAnalyses LoopDataPrefetchPass::run(Function &F,
   OptimizationRemarkEmitter *ORE =
       &AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
   const TargetTransformInfo *TTI = &AM.getResult<TargetIRAnalysis>(F);
-
-  LoopDataPrefetch LDP(AC, DT, LI, SE, TTI, ORE);
+  auto &MAMProxy = AM.getResult<ModuleAnalysisManagerFunctionProxy>(F);
+  ProfileSummaryInfo *PSI =
+      MAMProxy.getCachedResult<ProfileSummaryAnalysis>(*F.getParent());
+  BlockFrequencyInfo *BFI = (PSI && PSI->hasProfileSummary())
+                                ? &AM.getResult<BlockFrequencyAnalysis>(F)
+                                : nullptr;
+
+  LoopDataPrefetch LDP(AC, DT, LI, SE, TTI, ORE, PSI, BFI);
   bool Changed = LDP.run();
 
   if (Changed) {
@@ -202,8 +254,14 @@ bool LoopDataPrefetchLegacyPass::runOnFunction(Function &F) {
       &getAnalysis<OptimizationRemarkEmitterWrapperPass>().getORE();
   const TargetTransformInfo *TTI =
       &getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
-
-  LoopDataPrefetch LDP(AC, DT, LI, SE, TTI, ORE);
+  ProfileSummaryInfo *PSI =
+      &getAnalysis<ProfileSummaryInfoWrapperPass>().getPSI();
+  BlockFrequencyInfo *BFI =
+      PSI->hasProfileSummary()
+          ? &getAnalysis<LazyBlockFrequencyInfoPass>().getBFI()
+          : nullptr;
+
+  LoopDataPrefetch LDP(AC, DT, LI, SE, TTI, ORE, PSI, BFI);
   return LDP.run();
 }
 
@@ -267,6 +325,98 @@ struct Prefetch {
   }
 };
 
+/// A record for a potential prefetch of an indirect access like A[B[i]], whose
+/// address depends on the value of a load with a strided address.
+struct IndirectPrefetch {
+  /// The address formula of the access, in terms of IndexLoad.
+  const SCEV *LSCEV;
+  /// The load of the index.
+  LoadInst *IndexLoad;
+  /// True if targeting a write memory access.
+  bool Writes;
+  /// The (first seen) prefetched instruction.
+  Instruction *MemI;
+
+  IndirectPrefetch(const SCEV *L, LoadInst *IndexLoad, Instruction *I)
+      : LSCEV(L), IndexLoad(IndexLoad), Writes(isa<StoreInst>(I)), MemI(I) {}
+};
+
+bool LoopDataPrefetch::isUnprofitableByProfile(Loop *L, unsigned ItersAhead) {
+  if (!PSI || !BFI)
+    return false;
+
+  // Prefetches in cold code only take issue slots and cache lines.
+  if (PSI->isColdBlock(L->getHeader(), BFI))
+    return true;
+
+  // Nor do they pay off when the loop usually exits before the prefetched
+  // iterations.
+  if (Optional<unsigned> TripCount = getLoopEstimatedTripCount(L))
+    return *TripCount < ItersAhead + 1;
+  return false;
+}
+
+LoadInst *LoopDataPrefetch::getIndexLoad(Loop *L, const SCEV *Ptr) {
+  LoadInst *IndexLoad = nullptr;
+  bool Invalid = SCEVExprContains(Ptr, [&](const SCEV *S) {
+    // The address must be evaluated for a later iteration, which is only
+    // known for the index.
+    if (isa<SCEVAddRecExpr>(S))
+      return true;
+    auto *U = dyn_cast<SCEVUnknown>(S);
+    if (!U || L->isLoopInvariant(U->getValue()))
+      return false;
+    auto *Load = dyn_cast<LoadInst>(U->getValue());
+    if (!Load || (IndexLoad && IndexLoad != Load))
+      return true;
+    IndexLoad = Load;
+    return false;
+  });
+  if (Invalid || !IndexLoad || !IndexLoad->isSimple() ||
+      !L->contains(IndexLoad))
+    return nullptr;
+
+  auto *IndexAddRec =
+      dyn_cast<SCEVAddRecExpr>(SE->getSCEV(IndexLoad->getPointerOperand()));
+  if (!IndexAddRec || IndexAddRec->getLoop() != L || !IndexAddRec->isAffine())
+    return nullptr;
+  return IndexLoad;
+}
+
+const SCEV *LoopDataPrefetch::getClampedIndexAddress(Loop *L,
+                                                     LoadInst *IndexLoad,
+                                                     unsigned ItersAhead) {
+  // The index of a later iteration is loaded unconditionally.  This is only
+  // safe if the loop loads it anyway, so the load must execute in every
+  // iteration, up to the last one.
+  SmallVector<BasicBlock *, 4> ExitingBlocks;
+  L->getExitingBlocks(ExitingBlocks);
+  if (!llvm::all_of(ExitingBlocks, [&](BasicBlock *Exiting) {
+        return DT->dominates(IndexLoad->getParent(), Exiting);
+      }))
+    return nullptr;
+
+  const SCEV *BTC = SE->getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(BTC))
+    return nullptr;
+
+  auto *IndexAddRec =
+      cast<SCEVAddRecExpr>(SE->getSCEV(IndexLoad->getPointerOperand()));
+  const SCEV *Step = IndexAddRec->getStepRecurrence(*SE);
+  Type *IterTy = BTC->getType();
+  if (SE->getTypeSizeInBits(IterTy) > SE->getTypeSizeInBits(Step->getType()))
+    return nullptr;
+
+  // umin(i + ItersAhead, BTC), where i counts the iterations from 0.
+  const SCEV *Iter = SE->getAddRecExpr(SE->getZero(IterTy), SE->getOne(IterTy),
+                                       L, SCEV::FlagNUW);
+  const SCEV *AheadIter = SE->getUMinExpr(
+      SE->getAddExpr(Iter, SE->getConstant(IterTy, ItersAhead)), BTC);
+  AheadIter = SE->getNoopOrZeroExtend(AheadIter, Step->getType());
+  return SE->getAddExpr(IndexAddRec->getStart(),
+                        SE->getMulExpr(AheadIter, Step));
+}
+
 bool LoopDataPrefetch::runOnLoop(Loop *L) {
   bool MadeChange = false;
 
@@ -312,9 +462,13 @@ bool LoopDataPrefetch::runOnLoop(Loop *L) {
   if (ConstantMaxTripCount && ConstantMaxTripCount < ItersAhead + 1)
     return MadeChange;
 
+  if (isUnprofitableByProfile(L, ItersAhead))
+    return MadeChange;
+
   unsigned NumMemAccesses = 0;
   unsigned NumStridedMemAccesses = 0;
   SmallVector<Prefetch, 16> Prefetches;
+  SmallVector<IndirectPrefetch, 4> IndirectPrefetches;
   for (const auto BB : L->blocks())
     for (auto &I : *BB) {
       Value *PtrValue;
@@ -338,8 +492,33 @@ bool LoopDataPrefetch::runOnLoop(Loop *L) {
 
       const SCEV *LSCEV = SE->getSCEV(PtrValue);
       const SCEVAddRecExpr *LSCEVAddRec = dyn_cast<SCEVAddRecExpr>(LSCEV);
-      if (!LSCEVAddRec)
+      if (!LSCEVAddRec) {
+        // The index load of an indirect access may be invalidated by a call,
+        // e.g. if it frees the index array.
+        if (!doPrefetchIndirect() || HasCall)
+          continue;
+        LoadInst *IndexLoad = getIndexLoad(L, LSCEV);
+        if (!IndexLoad)
+          continue;
+
+        // Again, don't prefetch the same cache line twice.
+        bool DupPref = false;
+        for (auto &Pref : IndirectPrefetches) {
+          const SCEV *PtrDiff = SE->getMinusSCEV(LSCEV, Pref.LSCEV);
+          auto *ConstPtrDiff = dyn_cast<SCEVConstant>(PtrDiff);
+          if (!ConstPtrDiff ||
+              std::abs(ConstPtrDiff->getValue()->getSExtValue()) >=
+                  (int64_t)TTI->getCacheLineSize())
+            continue;
+          if (isa<StoreInst>(MemI) && ConstPtrDiff->isZero())
+            Pref.Writes = true;
+          DupPref = true;
+          break;
+        }
+        if (!DupPref)
+          IndirectPrefetches.emplace_back(LSCEV, IndexLoad, MemI);
         continue;
+      }
       NumStridedMemAccesses++;
 
       // We don't want to double prefetch individual cache lines. If this
@@ -362,9 +541,11 @@ bool LoopDataPrefetch::runOnLoop(Loop *L) {
         Prefetches.push_back(Prefetch(LSCEVAddRec, MemI));
     }
 
+  // The indirect prefetches count against the limits of the target too.
+  unsigned NumPrefetches = Prefetches.size() + IndirectPrefetches.size();
   unsigned TargetMinStride =
     getMinPrefetchStride(NumMemAccesses, NumStridedMemAccesses,
-                         Prefetches.size(), HasCall);
+                         NumPrefetches, HasCall);
 
   LLVM_DEBUG(dbgs() << "Prefetching " << ItersAhead
              << " iterations ahead (loop size: " << LoopSize << ") in "
@@ -372,7 +553,7 @@ bool LoopDataPrefetch::runOnLoop(Loop *L) {
   LLVM_DEBUG(dbgs() << "Loop has: "
              << NumMemAccesses << " memory accesses, "
              << NumStridedMemAccesses << " strided memory accesses, "
-             << Prefetches.size() << " potential prefetch(es), "
+             << NumPrefetches << " potential prefetch(es), "
              << "a minimum stride of " << TargetMinStride << ", "
              << (HasCall ? "calls" : "no calls") << ".\n");
 
@@ -415,5 +596,56 @@ bool LoopDataPrefetch::runOnLoop(Loop *L) {
     MadeChange = true;
   }
 
+  for (auto &P : IndirectPrefetches) {
+    // The address of an indirect access jumps around, so it is taken to have
+    // a stride larger than any the target asks for, unless the target wants
+    // no prefetches in this loop at all.
+    if (TargetMinStride == UINT_MAX)
+      continue;
+
+    const SCEV *IndexSCEV = getClampedIndexAddress(L, P.IndexLoad, ItersAhead);
+    if (!IndexSCEV || !isSafeToExpand(IndexSCEV, *SE) ||
+        !isSafeToExpand(P.LSCEV, *SE))
+      continue;
+
+    // Load the index of the later iteration, and compute the address of the
+    // access from it.
+    BasicBlock *BB = P.MemI->getParent();
+    SCEVExpander SCEVE(*SE, BB->getModule()->getDataLayout(), "prefaddr");
+    Value *IndexPtr = SCEVE.expandCodeFor(
+        IndexSCEV, P.IndexLoad->getPointerOperandType(), P.MemI);
+    LoadInst *Index = new LoadInst(P.IndexLoad->getType(), IndexPtr,
+                                   "prefidx", /*isVolatile=*/false,
+                                   P.IndexLoad->getAlign(), P.MemI);
+    ValueToSCEVMapTy Map;
+    Map[P.IndexLoad] = SE->getSCEV(Index);
+    const SCEV *NextLSCEV = SCEVParameterRewriter::rewrite(P.LSCEV, *SE, Map);
+
+    Type *I8Ptr = Type::getInt8PtrTy(BB->getContext(), 0/*PtrAddrSpace*/);
+    Value *PrefPtrValue = SCEVE.expandCodeFor(NextLSCEV, I8Ptr, P.MemI);
+
+    IRBuilder<> Builder(P.MemI);
+    Module *M = BB->getParent()->getParent();
+    Type *I32 = Type::getInt32Ty(BB->getContext());
+    Function *PrefetchFunc = Intrinsic::getDeclaration(
+        M, Intrinsic::prefetch, PrefPtrValue->getType());
+    Builder.CreateCall(
+        PrefetchFunc,
+        {PrefPtrValue,
+         ConstantInt::get(I32, P.Writes),
+         ConstantInt::get(I32, 3), ConstantInt::get(I32, 1)});
+    ++NumPrefetches;
+    ++NumIndirectPrefetches;
+    LLVM_DEBUG(dbgs() << "  Indirect access: "
+               << *P.MemI->getOperand(isa<LoadInst>(P.MemI) ? 0 : 1)
+               << ", SCEV: " << *P.LSCEV << "\n");
+    ORE->emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "PrefetchedIndirect", P.MemI)
+          << "prefetched indirect memory access";
+      });
+
+    MadeChange = true;
+  }
+
   return MadeChange;
 }
@@ -0,0 +1,797 @@
+//===- LoopFlatten.cpp - Loop flattening pass -----------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass flattens pairs of nested loops into a single loop.
+//
+// The intention is to optimise loop nests like this, which together access an
+// array linearly:
+//   for (int i = 0; i < N; ++i)
+//     for (int j = 0; j < M; ++j)
+//       f(A[i*M+j]);
+// into one loop:
+//   for (int i = 0; i < (N*M); ++i)
+//     f(A[i]);
+//
+// It can also flatten loops where the induction variables are not used in the
+// loop. This is only worth doing if the induction variables are only used in
+// an expression like i*M+j. If they had any other uses, we would have to
+// insert a div/mod to reconstruct the original values, so this wouldn't be
+// profitable.
+//
+// The trip count of the flattened loop is N*M, which must not overflow. This
+// is either proven from the known bits or the SCEV ranges of N and M, or
+// from the linear index addressing memory in every iteration. Otherwise, and
+// when the inner loop is guarded against running zero times, the loop nest is
+// versioned, and a runtime check picks the flattened loop or the original
+// nest.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Scalar/LoopFlatten.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+
+#define DEBUG_TYPE "loop-flatten"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+STATISTIC(NumFlattened, "Number of loops flattened");
+STATISTIC(NumVersioned, "Number of loop nests versioned to be flattened");
+
+static cl::opt<unsigned> RepeatedInstructionThreshold(
+    "loop-flatten-cost-threshold", cl::Hidden, cl::init(2),
+    cl::desc("Limit on the cost of instructions that can be repeated due to "
+             "loop flattening"));
+
+static cl::opt<bool> VersionLoops(
+    "loop-flatten-version-loops", cl::Hidden, cl::init(true),
+    cl::desc("Version loop nests whose flattened trip count may overflow or "
+             "whose inner loop may run zero times"));
+
+/// Loop metadata that stops the nest from being flattened, set on the original
+/// nest kept by versioning.
+static const char *const FlattenDisableMetaData = "llvm.loop.flatten.disable";
+
+namespace {
+
+struct FlattenInfo {
+  Loop *OuterLoop;
+  Loop *InnerLoop;
+
+  PHINode *InnerInductionPHI = nullptr;
+  PHINode *OuterInductionPHI = nullptr;
+  Value *InnerLimit = nullptr;
+  Value *OuterLimit = nullptr;
+  BinaryOperator *InnerIncrement = nullptr;
+  BinaryOperator *OuterIncrement = nullptr;
+  BranchInst *InnerBranch = nullptr;
+  BranchInst *OuterBranch = nullptr;
+
+  /// Whether SCEV shows that the loops run exactly for their limit. A do-while
+  /// loop with a limit of zero still runs once.
+  bool InnerTripCountIsLimit = false;
+  bool OuterTripCountIsLimit = false;
+
+  /// The expressions i*M+j, and the products i*M that they use.
+  SmallPtrSet<Value *, 4> LinearIVUses;
+  SmallPtrSet<Value *, 4> LinearIVProducts;
+
+  /// Inner header phis of values carried through the outer loop, which lose
+  /// their inner backedge.
+  SmallVector<PHINode *, 4> InnerPHIsToTransform;
+
+  /// The phis in the outer loop which are known to be safe.
+  SmallPtrSet<PHINode *, 8> SafePHIs;
+
+  /// Phis joining a value carried through the inner loop with its value from
+  /// the outer header when the guard skips the inner loop.
+  SmallVector<PHINode *, 4> GuardMergePHIs;
+
+  /// A branch in the outer loop skipping the inner loop, and the successor
+  /// that enters it.
+  BranchInst *Guard = nullptr;
+  unsigned GuardInnerSucc = 0;
+
+  FlattenInfo(Loop *OL, Loop *IL) : OuterLoop(OL), InnerLoop(IL) {}
+};
+
+} // end anonymous namespace
+
+/// Find the canonical induction variable of \p L, the increment feeding it and
+/// the latch branch comparing the increment against the loop invariant
+/// \p Limit. All of these only serve to iterate the loop.
+static bool findLoopComponents(Loop *L, ScalarEvolution &SE,
+                               PHINode *&InductionPHI, Value *&Limit,
+                               BinaryOperator *&Increment,
+                               BranchInst *&BackBranch,
+                               bool &TripCountIsLimit) {
+  LLVM_DEBUG(dbgs() << "Finding components of loop: " << L->getName() << "\n");
+
+  if (!L->isLoopSimplifyForm()) {
+    LLVM_DEBUG(dbgs() << "Loop is not in normal form\n");
+    return false;
+  }
+
+  // There must be exactly one exiting block, and it must be the same as the
+  // latch.
+  BasicBlock *Latch = L->getLoopLatch();
+  if (L->getExitingBlock() != Latch) {
+    LLVM_DEBUG(dbgs() << "Exiting and latch block are different\n");
+    return false;
+  }
+
+  if (!SE.hasLoopInvariantBackedgeTakenCount(L)) {
+    LLVM_DEBUG(dbgs() << "Backedge-taken count is not loop-invariant\n");
+    return false;
+  }
+
+  // The induction variable must count up from zero in steps of one.
+  InductionPHI = L->getCanonicalInductionVariable();
+  if (!InductionPHI) {
+    LLVM_DEBUG(dbgs() << "Could not find canonical induction variable\n");
+    return false;
+  }
+  Increment =
+      dyn_cast<BinaryOperator>(InductionPHI->getIncomingValueForBlock(Latch));
+
+  // The latch must compare the increment against the limit, and loop back
+  // while it has not reached it.
+  BackBranch = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!BackBranch || !BackBranch->isConditional()) {
+    LLVM_DEBUG(dbgs() << "Could not find back-branch\n");
+    return false;
+  }
+  auto *Compare = dyn_cast<ICmpInst>(BackBranch->getCondition());
+  if (!Compare || !Compare->hasOneUse()) {
+    LLVM_DEBUG(dbgs() << "Could not find loop comparison\n");
+    return false;
+  }
+  ICmpInst::Predicate Pred = Compare->getPredicate();
+  Limit = Compare->getOperand(1);
+  if (Compare->getOperand(1) == Increment) {
+    Pred = Compare->getSwappedPredicate();
+    Limit = Compare->getOperand(0);
+  } else if (Compare->getOperand(0) != Increment) {
+    LLVM_DEBUG(dbgs() << "Loop comparison does not use the increment\n");
+    return false;
+  }
+  if (BackBranch->getSuccessor(1) == L->getHeader())
+    Pred = ICmpInst::getInversePredicate(Pred);
+  if (Pred != ICmpInst::ICMP_NE && Pred != ICmpInst::ICMP_ULT) {
+    LLVM_DEBUG(dbgs() << "Unsupported loop comparison\n");
+    return false;
+  }
+  if (!L->isLoopInvariant(Limit)) {
+    LLVM_DEBUG(dbgs() << "Loop limit is not invariant\n");
+    return false;
+  }
+
+  // A limit of zero wraps around in a rotated loop, so the trip count only
+  // equals the limit if that is known to be non-zero.
+  const SCEV *BackedgeTakenCount = SE.getBackedgeTakenCount(L);
+  const SCEV *LimitSCEV = SE.getSCEV(Limit);
+  const SCEV *Zero = SE.getZero(LimitSCEV->getType());
+  TripCountIsLimit =
+      SE.getAddExpr(BackedgeTakenCount,
+                    SE.getOne(BackedgeTakenCount->getType())) == LimitSCEV &&
+      (SE.isKnownNonZero(LimitSCEV) ||
+       SE.isLoopEntryGuardedByCond(L, ICmpInst::ICMP_NE, LimitSCEV, Zero));
+
+  LLVM_DEBUG(dbgs() << "Found limit: "; Limit->dump();
+             dbgs() << "Found increment: "; Increment->dump();
+             dbgs() << "Found back branch: "; BackBranch->dump();
+             dbgs() << "Successfully found all loop components\n");
+  return true;
+}
+
+/// Check that the only uses of the induction variables are their increments,
+/// and the linear expressions i*M+j that the flattened induction variable
+/// replaces.
+static bool checkIVUsers(FlattenInfo &FI) {
+  ConstantInt *ConstInnerLimit = dyn_cast<ConstantInt>(FI.InnerLimit);
+  auto IsProduct = [&](Value *V) {
+    if (match(V, m_c_Mul(m_Specific(FI.OuterInductionPHI),
+                         m_Specific(FI.InnerLimit))))
+      return true;
+    // InstCombine turns a product with a power of two into a shift.
+    const APInt *ShiftAmt;
+    return ConstInnerLimit && ConstInnerLimit->getValue().isPowerOf2() &&
+           match(V, m_Shl(m_Specific(FI.OuterInductionPHI),
+                          m_APInt(ShiftAmt))) &&
+           *ShiftAmt == ConstInnerLimit->getValue().logBase2();
+  };
+
+  for (User *U : FI.InnerInductionPHI->users()) {
+    if (U == FI.InnerIncrement)
+      continue;
+    Value *Product;
+    if (!match(U,
+               m_c_Add(m_Specific(FI.InnerInductionPHI), m_Value(Product))) ||
+        !IsProduct(Product)) {
+      LLVM_DEBUG(dbgs() << "Found use of inner induction variable: ";
+                 U->dump());
+      return false;
+    }
+    FI.LinearIVUses.insert(U);
+    FI.LinearIVProducts.insert(Product);
+  }
+
+  for (User *U : FI.OuterInductionPHI->users()) {
+    if (U == FI.OuterIncrement || FI.LinearIVProducts.count(U))
+      continue;
+    LLVM_DEBUG(dbgs() << "Found use of outer induction variable: "; U->dump());
+    return false;
+  }
+
+  // The products only make sense as part of the linear expressions.
+  for (Value *Product : FI.LinearIVProducts)
+    for (User *U : Product->users())
+      if (!FI.LinearIVUses.count(U)) {
+        LLVM_DEBUG(dbgs() << "Found use of i*M: "; U->dump());
+        return false;
+      }
+
+  // The increments only feed their phi and the latch comparison.
+  auto OnlyIterates = [](BinaryOperator *Increment, PHINode *IV,
+                         BranchInst *Br) {
+    return all_of(Increment->users(), [&](User *U) {
+      return U == IV || U == Br->getCondition();
+    });
+  };
+  if (!OnlyIterates(FI.InnerIncrement, FI.InnerInductionPHI, FI.InnerBranch) ||
+      !OnlyIterates(FI.OuterIncrement, FI.OuterInductionPHI, FI.OuterBranch)) {
+    LLVM_DEBUG(dbgs() << "Found use of loop increment\n");
+    return false;
+  }
+
+  LLVM_DEBUG(dbgs() << "Found " << FI.LinearIVUses.size()
+                    << " linear uses of the induction variables\n");
+  return true;
+}
+
+/// Check the phis of the loop nest. Besides the induction variables, the outer
+/// header may only carry values that the inner loop updates, i.e.
+///   outer.header:  %p = phi [ %init, %outer.ph ], [ %l, %outer.latch ]
+///   inner.header:  %q = phi [ %p, %inner.ph ], [ %x, %inner.latch ]
+///   inner.exit:    %l = phi [ %x, %inner.latch ]
+/// Once the inner backedge is removed, %q simply takes the value from the
+/// outer loop. When the inner loop is guarded, %l reaches the outer latch
+/// through a phi that merges it with %p.
+static bool checkPHIs(FlattenInfo &FI) {
+  BasicBlock *InnerPreheader = FI.InnerLoop->getLoopPreheader();
+  BasicBlock *InnerLatch = FI.InnerLoop->getLoopLatch();
+  BasicBlock *InnerExit = FI.InnerLoop->getExitBlock();
+  BasicBlock *OuterLatch = FI.OuterLoop->getLoopLatch();
+  if (!InnerExit)
+    return false;
+
+  auto UsedOutsideOrBy = [&](Value *V, ArrayRef<Value *> Allowed) {
+    return all_of(V->users(), [&](User *U) {
+      return is_contained(Allowed, U) ||
+             !FI.OuterLoop->contains(cast<Instruction>(U));
+    });
+  };
+
+  FI.SafePHIs.insert(FI.OuterInductionPHI);
+  for (PHINode &OuterPHI : FI.OuterLoop->getHeader()->phis()) {
+    if (&OuterPHI == FI.OuterInductionPHI)
+      continue;
+
+    Value *Carried = OuterPHI.getIncomingValueForBlock(OuterLatch);
+    PHINode *MergePHI = nullptr;
+    auto *CarriedPHI = dyn_cast<PHINode>(Carried);
+    if (CarriedPHI && CarriedPHI->getParent() != InnerExit &&
+        CarriedPHI->getNumIncomingValues() == 2 &&
+        FI.OuterLoop->contains(CarriedPHI) &&
+        !FI.InnerLoop->contains(CarriedPHI)) {
+      int SkipIdx = CarriedPHI->getIncomingValue(0) == &OuterPHI ? 0 : 1;
+      if (CarriedPHI->getIncomingValue(SkipIdx) == &OuterPHI) {
+        MergePHI = CarriedPHI;
+        Carried = MergePHI->getIncomingValue(1 - SkipIdx);
+      }
+    }
+
+    auto *LCSSAPHI = dyn_cast<PHINode>(Carried);
+    if (!LCSSAPHI || LCSSAPHI->getParent() != InnerExit ||
+        LCSSAPHI->getNumIncomingValues() != 1) {
+      LLVM_DEBUG(dbgs() << "Outer loop phi is not carried through the inner "
+                           "loop: ";
+                 OuterPHI.dump());
+      return false;
+    }
+    Value *Updated = LCSSAPHI->getIncomingValue(0);
+
+    PHINode *InnerPHI = nullptr;
+    for (PHINode &PHI : FI.InnerLoop->getHeader()->phis())
+      if (PHI.getIncomingValueForBlock(InnerPreheader) == &OuterPHI &&
+          PHI.getIncomingValueForBlock(InnerLatch) == Updated)
+        InnerPHI = &PHI;
+    if (!InnerPHI) {
+      LLVM_DEBUG(dbgs() << "Could not find the inner loop phi for: ";
+                 OuterPHI.dump());
+      return false;
+    }
+
+    // Any other use in the outer loop would see the value per outer
+    // iteration, which flattening changes.
+    if (!all_of(OuterPHI.users(),
+                [&](User *U) { return U == InnerPHI || U == MergePHI; }) ||
+        !UsedOutsideOrBy(LCSSAPHI, {&OuterPHI, MergePHI}) ||
+        (MergePHI && !UsedOutsideOrBy(MergePHI, {&OuterPHI}))) {
+      LLVM_DEBUG(dbgs() << "Found other use of carried value: ";
+                 OuterPHI.dump());
+      return false;
+    }
+
+    FI.InnerPHIsToTransform.push_back(InnerPHI);
+    FI.SafePHIs.insert(&OuterPHI);
+    FI.SafePHIs.insert(LCSSAPHI);
+    if (MergePHI) {
+      FI.SafePHIs.insert(MergePHI);
+      FI.GuardMergePHIs.push_back(MergePHI);
+    }
+  }
+
+  for (PHINode &InnerPHI : FI.InnerLoop->getHeader()->phis())
+    if (&InnerPHI != FI.InnerInductionPHI &&
+        !is_contained(FI.InnerPHIsToTransform, &InnerPHI)) {
+      LLVM_DEBUG(dbgs() << "Found unhandled inner loop phi: ";
+                 InnerPHI.dump());
+      return false;
+    }
+
+  // Values of the last inner iteration may still be used after the loop nest,
+  // which runs the same last iteration when flattened.
+  for (PHINode &PHI : InnerExit->phis()) {
+    if (FI.SafePHIs.count(&PHI))
+      continue;
+    if (PHI.getNumIncomingValues() != 1 || !UsedOutsideOrBy(&PHI, {})) {
+      LLVM_DEBUG(dbgs() << "Found unhandled inner loop exit phi: ";
+                 PHI.dump());
+      return false;
+    }
+    FI.SafePHIs.insert(&PHI);
+  }
+
+  return true;
+}
+
+/// Check the instructions of the outer loop outside of the inner loop, which
+/// will run on every iteration of the flattened loop. They must not have side
+/// effects, must be cheap, and the only control flow they may have is a guard
+/// skipping the inner loop.
+static bool checkOuterLoopInsts(FlattenInfo &FI, DominatorTree *DT,
+                                const TargetTransformInfo *TTI) {
+  BasicBlock *InnerPreheader = FI.InnerLoop->getLoopPreheader();
+  DenseSet<Instruction *> IterationInstructions = {
+      FI.OuterIncrement, cast<Instruction>(FI.OuterBranch->getCondition()),
+      FI.OuterBranch};
+  unsigned RepeatedInstrCost = 0;
+
+  for (BasicBlock *BB : FI.OuterLoop->blocks()) {
+    if (FI.InnerLoop->contains(BB))
+      continue;
+
+    for (Instruction &I : *BB) {
+      if (auto *PHI = dyn_cast<PHINode>(&I)) {
+        if (!FI.SafePHIs.count(PHI)) {
+          LLVM_DEBUG(dbgs() << "Found unsafe phi in the outer loop: ";
+                     PHI->dump());
+          return false;
+        }
+        continue;
+      }
+
+      if (IterationInstructions.count(&I) || FI.LinearIVProducts.count(&I))
+        continue;
+
+      if (auto *Br = dyn_cast<BranchInst>(&I)) {
+        if (Br->isUnconditional())
+          continue;
+        // A single conditional branch may skip the inner loop, on a condition
+        // that is the same for every outer iteration. The flattened loop is
+        // only run when it is known to enter the inner loop.
+        int InnerSucc = -1;
+        for (unsigned Idx = 0; Idx != 2; ++Idx)
+          if (DT->dominates(Br->getSuccessor(Idx), InnerPreheader))
+            InnerSucc = Idx;
+        auto *CondInst = dyn_cast<Instruction>(Br->getCondition());
+        bool InvariantCond =
+            FI.OuterLoop->isLoopInvariant(Br->getCondition()) ||
+            (isa_and_nonnull<ICmpInst>(CondInst) &&
+             FI.OuterLoop->hasLoopInvariantOperands(CondInst));
+        if (FI.Guard || InnerSucc < 0 || !InvariantCond ||
+            Br->getSuccessor(1 - InnerSucc)->getSinglePredecessor()) {
+          LLVM_DEBUG(dbgs() << "Found unsupported branch in the outer loop: ";
+                     Br->dump());
+          return false;
+        }
+        FI.Guard = Br;
+        FI.GuardInnerSucc = InnerSucc;
+        continue;
+      }
+
+      // The instruction is run for every iteration of the inner loop. It
+      // computes the same value each time, since it does not depend on the
+      // induction variables, but it must not depend on memory that the inner
+      // loop may change.
+      if (I.mayHaveSideEffects() || I.mayReadFromMemory()) {
+        LLVM_DEBUG(dbgs() << "Cannot repeat instruction: "; I.dump());
+        return false;
+      }
+      int Cost = TTI->getUserCost(&I, TargetTransformInfo::TCK_SizeAndLatency);
+      LLVM_DEBUG(dbgs() << "Cost " << Cost << ": "; I.dump());
+      RepeatedInstrCost += Cost;
+    }
+  }
+
+  LLVM_DEBUG(dbgs() << "Cost of instructions that will be repeated: "
+                    << RepeatedInstrCost << "\n");
+  // Bail out if flattening the loops would cause instructions in the outer
+  // loop but not in the inner loop to be executed extra times.
+  if (RepeatedInstrCost > RepeatedInstructionThreshold)
+    return false;
+
+  // The phis merging a carried value with its value from the outer header
+  // must do so on the edge of the guard that skips the inner loop.
+  for (PHINode *MergePHI : FI.GuardMergePHIs) {
+    BasicBlock *OuterHeader = FI.OuterLoop->getHeader();
+    if (!FI.Guard ||
+        MergePHI->getParent() !=
+            FI.Guard->getSuccessor(1 - FI.GuardInnerSucc) ||
+        MergePHI->getBasicBlockIndex(FI.Guard->getParent()) < 0 ||
+        cast<Instruction>(
+            MergePHI->getIncomingValueForBlock(FI.Guard->getParent()))
+                ->getParent() != OuterHeader) {
+      LLVM_DEBUG(dbgs() << "Merge phi does not match the guard: ";
+                 MergePHI->dump());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Return true if the flattened trip count N*M cannot overflow.
+static bool checkNoOverflow(FlattenInfo &FI, DominatorTree *DT,
+                            AssumptionCache *AC, ScalarEvolution *SE) {
+  Function *F = FI.OuterLoop->getHeader()->getParent();
+  const DataLayout &DL = F->getParent()->getDataLayout();
+
+  // Check if the multiply could not overflow due to known ranges of the input
+  // values.
+  OverflowResult OR = computeOverflowForUnsignedMul(
+      FI.InnerLimit, FI.OuterLimit, DL, AC,
+      FI.OuterLoop->getLoopPreheader()->getTerminator(), DT);
+  if (OR == OverflowResult::NeverOverflows)
+    return true;
+
+  bool Overflow;
+  APInt InnerMax = SE->getUnsignedRangeMax(SE->getSCEV(FI.InnerLimit));
+  APInt OuterMax = SE->getUnsignedRangeMax(SE->getSCEV(FI.OuterLimit));
+  (void)InnerMax.umul_ov(OuterMax, Overflow);
+  if (!Overflow)
+    return true;
+
+  // If the linear index addresses memory through an inbounds GEP on every
+  // iteration, and is at least as wide as a pointer, it would wrap around the
+  // address space before the trip count overflows, which would be undefined
+  // behavior.
+  BasicBlock *InnerLatch = FI.InnerLoop->getLoopLatch();
+  for (Value *V : FI.LinearIVUses) {
+    if (V->getType()->getScalarSizeInBits() < DL.getPointerSizeInBits())
+      continue;
+    for (User *U : V->users()) {
+      auto *GEP = dyn_cast<GetElementPtrInst>(U);
+      if (!GEP || !GEP->isInBounds() ||
+          !DT->dominates(GEP->getParent(), InnerLatch))
+        continue;
+      for (User *GEPUser : GEP->users())
+        if (getLoadStorePointerOperand(GEPUser) == GEP &&
+            DT->dominates(cast<Instruction>(GEPUser)->getParent(),
+                          InnerLatch)) {
+          LLVM_DEBUG(dbgs() << "Linear index addresses memory: ";
+                     GEPUser->dump());
+          return true;
+        }
+    }
+  }
+
+  return false;
+}
+
+/// Keep the original loop nest for when the runtime checks for the flattened
+/// loop fail, and return the trip count of the flattened loop. All checks are
+/// emitted in the old preheader of the outer loop, which then branches to one
+/// of the two versions.
+static Value *versionLoopNest(FlattenInfo &FI, bool CheckOverflow,
+                              DominatorTree *DT, LoopInfo *LI) {
+  Loop *OuterLoop = FI.OuterLoop;
+  BasicBlock *CheckBlock = OuterLoop->getLoopPreheader();
+  IRBuilder<> Builder(CheckBlock->getTerminator());
+  SmallVector<Value *, 4> Checks;
+
+  Value *NewTripCount;
+  if (CheckOverflow) {
+    Value *Mul = Builder.CreateBinaryIntrinsic(
+        Intrinsic::umul_with_overflow, FI.OuterLimit, FI.InnerLimit);
+    NewTripCount = Builder.CreateExtractValue(Mul, 0, "flatten.tripcount");
+    Checks.push_back(Builder.CreateExtractValue(Mul, 1, "flatten.overflow"));
+  } else {
+    NewTripCount =
+        Builder.CreateMul(FI.OuterLimit, FI.InnerLimit, "flatten.tripcount");
+  }
+
+  auto *Zero = ConstantInt::get(FI.InnerLimit->getType(), 0);
+  if (!FI.InnerTripCountIsLimit)
+    Checks.push_back(Builder.CreateICmpEQ(FI.InnerLimit, Zero));
+  if (!FI.OuterTripCountIsLimit)
+    Checks.push_back(Builder.CreateICmpEQ(FI.OuterLimit, Zero));
+
+  if (FI.Guard) {
+    Value *Cond = FI.Guard->getCondition();
+    if (auto *CondInst = dyn_cast<Instruction>(Cond))
+      if (OuterLoop->contains(CondInst)) {
+        Instruction *Clone = CondInst->clone();
+        Builder.Insert(Clone, CondInst->getName() + ".guard");
+        Cond = Clone;
+      }
+    Checks.push_back(FI.GuardInnerSucc == 0 ? Builder.CreateNot(Cond) : Cond);
+  }
+
+  Value *AnyCheckFails = Checks.front();
+  for (Value *Check : drop_begin(Checks, 1))
+    AnyCheckFails = Builder.CreateOr(AnyCheckFails, Check);
+  AnyCheckFails->setName("flatten.fail");
+
+  BasicBlock *Preheader =
+      SplitBlock(CheckBlock, CheckBlock->getTerminator(), DT, LI, nullptr,
+                 OuterLoop->getHeader()->getName() + ".ph");
+
+  ValueToValueMapTy VMap;
+  SmallVector<BasicBlock *, 8> FallbackBlocks;
+  Loop *Fallback =
+      cloneLoopWithPreheader(Preheader, CheckBlock, OuterLoop, VMap,
+                             ".noflatten", LI, DT, FallbackBlocks);
+  remapInstructionsInBlocks(FallbackBlocks, VMap);
+
+  // Both versions leave through the exit block of the outer loop.
+  BasicBlock *Exit = OuterLoop->getExitBlock();
+  BasicBlock *Latch = OuterLoop->getLoopLatch();
+  auto *FallbackLatch = cast<BasicBlock>(VMap[Latch]);
+  for (PHINode &PHI : Exit->phis()) {
+    Value *V = PHI.getIncomingValueForBlock(Latch);
+    if (Value *FallbackV = VMap.lookup(V))
+      V = FallbackV;
+    PHI.addIncoming(V, FallbackLatch);
+  }
+
+  Instruction *Term = CheckBlock->getTerminator();
+  BranchInst::Create(Fallback->getLoopPreheader(), Preheader, AnyCheckFails,
+                     Term);
+  Term->eraseFromParent();
+  DT->changeImmediateDominator(Exit, CheckBlock);
+
+  formDedicatedExitBlocks(OuterLoop, DT, LI, nullptr, /*PreserveLCSSA=*/true);
+  formDedicatedExitBlocks(Fallback, DT, LI, nullptr, /*PreserveLCSSA=*/true);
+  addStringMetadataToLoop(Fallback, FlattenDisableMetaData);
+
+  LLVM_DEBUG(dbgs() << "Versioned the loop nest\n");
+  ++NumVersioned;
+  return NewTripCount;
+}
+
+/// Rewrite the loop nest, now known to be legal to flatten, into one loop
+/// running for \p NewTripCount iterations.
+static void flattenLoopPair(FlattenInfo &FI, Value *NewTripCount,
+                            DominatorTree *DT, LoopInfo *LI,
+                            ScalarEvolution *SE) {
+  // The outer loop now runs for the product of the trip counts.
+  auto *OuterCompare = cast<ICmpInst>(FI.OuterBranch->getCondition());
+  OuterCompare->setOperand(OuterCompare->getOperand(0) == FI.OuterIncrement,
+                           NewTripCount);
+
+  // Replace the inner loop backedge with an unconditional branch to the exit,
+  // fixing up the phis that take values from it.
+  BasicBlock *InnerHeader = FI.InnerLoop->getHeader();
+  BasicBlock *InnerLatch = FI.InnerLoop->getLoopLatch();
+  BasicBlock *InnerExit = FI.InnerLoop->getExitBlock();
+  FI.InnerInductionPHI->removeIncomingValue(InnerLatch);
+  for (PHINode *PHI : FI.InnerPHIsToTransform)
+    PHI->removeIncomingValue(InnerLatch);
+  auto *InnerCompare = cast<Instruction>(FI.InnerBranch->getCondition());
+  BranchInst::Create(InnerExit, FI.InnerBranch);
+  FI.InnerBranch->eraseFromParent();
+  RecursivelyDeleteTriviallyDeadInstructions(InnerCompare);
+  DT->deleteEdge(InnerLatch, InnerHeader);
+
+  // The flattened loop is only run when the guard enters the inner loop.
+  if (BranchInst *Guard = FI.Guard) {
+    BasicBlock *GuardBlock = Guard->getParent();
+    BasicBlock *Skip = Guard->getSuccessor(1 - FI.GuardInnerSucc);
+    Skip->removePredecessor(GuardBlock);
+    BranchInst::Create(Guard->getSuccessor(FI.GuardInnerSucc), Guard);
+    Guard->eraseFromParent();
+    DT->deleteEdge(GuardBlock, Skip);
+  }
+
+  // Replace all uses of the linear expression with the outer induction
+  // variable, which now counts the flattened iterations.
+  for (Value *V : FI.LinearIVUses) {
+    V->replaceAllUsesWith(FI.OuterInductionPHI);
+    RecursivelyDeleteTriviallyDeadInstructions(V);
+  }
+
+  // Tell LoopInfo and SCEV that the inner loop has been deleted, and that
+  // what they know about the outer loop has changed.
+  SE->forgetLoop(FI.OuterLoop);
+  SE->forgetLoop(FI.InnerLoop);
+  LI->erase(FI.InnerLoop);
+  ++NumFlattened;
+}
+
+static bool flattenLoopPair(FlattenInfo &FI, DominatorTree *DT, LoopInfo *LI,
+                            ScalarEvolution *SE, AssumptionCache *AC,
+                            const TargetTransformInfo *TTI) {
+  LLVM_DEBUG(dbgs() << "Loop flattening running on outer loop "
+                    << FI.OuterLoop->getHeader()->getName()
+                    << " and inner loop "
+                    << FI.InnerLoop->getHeader()->getName() << " in "
+                    << FI.OuterLoop->getHeader()->getParent()->getName()
+                    << "\n");
+
+  if (hasDisableAllTransformsHint(FI.OuterLoop) ||
+      findStringMetadataForLoop(FI.OuterLoop, FlattenDisableMetaData)) {
+    LLVM_DEBUG(dbgs() << "Flattening is disabled for the loop nest\n");
+    return false;
+  }
+
+  // Only a single inner loop, without loops of its own, makes the outer loop
+  // body a single iteration of the flattened loop.
+  if (!FI.InnerLoop->isInnermost() || FI.OuterLoop->getSubLoops().size() != 1)
+    return false;
+
+  if (!findLoopComponents(FI.InnerLoop, *SE, FI.InnerInductionPHI,
+                          FI.InnerLimit, FI.InnerIncrement, FI.InnerBranch,
+                          FI.InnerTripCountIsLimit) ||
+      !findLoopComponents(FI.OuterLoop, *SE, FI.OuterInductionPHI,
+                          FI.OuterLimit, FI.OuterIncrement, FI.OuterBranch,
+                          FI.OuterTripCountIsLimit))
+    return false;
+
+  // The inner loop must run the same number of times on every outer iteration.
+  if (!FI.OuterLoop->isLoopInvariant(FI.InnerLimit) ||
+      FI.InnerLimit->getType() != FI.OuterLimit->getType()) {
+    LLVM_DEBUG(dbgs() << "Inner loop limit varies with the outer loop\n");
+    return false;
+  }
+
+  if (!checkPHIs(FI) || !checkIVUsers(FI) ||
+      !checkOuterLoopInsts(FI, DT, TTI))
+    return false;
+
+  bool NoOverflow = checkNoOverflow(FI, DT, AC, SE);
+  bool NeedsVersioning = !NoOverflow || FI.Guard || !FI.InnerTripCountIsLimit ||
+                         !FI.OuterTripCountIsLimit;
+  if (NeedsVersioning && !VersionLoops) {
+    LLVM_DEBUG(dbgs() << "Flattening needs runtime checks\n");
+    return false;
+  }
+
+  LLVM_DEBUG(dbgs() << "Checks all passed, doing the transformation\n");
+  Value *NewTripCount;
+  if (NeedsVersioning) {
+    NewTripCount = versionLoopNest(FI, !NoOverflow, DT, LI);
+  } else {
+    IRBuilder<> Builder(FI.OuterLoop->getLoopPreheader()->getTerminator());
+    NewTripCount =
+        Builder.CreateMul(FI.OuterLimit, FI.InnerLimit, "flatten.tripcount");
+  }
+  flattenLoopPair(FI, NewTripCount, DT, LI, SE);
+  return true;
+}
+
+static bool flattenLoops(LoopInfo *LI, DominatorTree *DT, ScalarEvolution *SE,
+                         AssumptionCache *AC, const TargetTransformInfo *TTI) {
+  bool Changed = false;
+  // Visit inner loops before their parents, so that a deeper nest collapses
+  // from the inside out. Flattening only deletes the loop being visited.
+  SmallVector<Loop *, 8> Worklist = LI->getLoopsInPreorder();
+  for (Loop *InnerLoop : reverse(Worklist)) {
+    Loop *OuterLoop = InnerLoop->getParentLoop();
+    if (!OuterLoop)
+      continue;
+    FlattenInfo FI(OuterLoop, InnerLoop);
+    Changed |= flattenLoopPair(FI, DT, LI, SE, AC, TTI);
+  }
+  return Changed;
+}
+
+PreservedAnalyses LoopFlattenPass::run(Function &F,
+                                       FunctionAnalysisManager &AM) {
+  auto *DT = &AM.getResult<DominatorTreeAnalysis>(F);
+  auto *LI = &AM.getResult<LoopAnalysis>(F);
+  auto *SE = &AM.getResult<ScalarEvolutionAnalysis>(F);
+  auto *AC = &AM.getResult<AssumptionAnalysis>(F);
+  auto *TTI = &AM.getResult<TargetIRAnalysis>(F);
+
+  if (!flattenLoops(LI, DT, SE, AC, TTI))
+    return PreservedAnalyses::all();
+
+  PreservedAnalyses PA;
+  PA.preserve<DominatorTreeAnalysis>();
+  PA.preserve<LoopAnalysis>();
+  PA.preserve<ScalarEvolutionAnalysis>();
+  return PA;
+}
+
+namespace {
+class LoopFlattenLegacyPass : public FunctionPass {
+public:
+  static char ID; // Pass ID, replacement for typeid
+  LoopFlattenLegacyPass() : FunctionPass(ID) {
+    initializeLoopFlattenLegacyPassPass(*PassRegistry::getPassRegistry());
+  }
+
+  // Possibly flatten loop L into its child.
+  bool runOnFunction(Function &F) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    getLoopAnalysisUsage(AU);
+    AU.addRequired<TargetTransformInfoWrapperPass>();
+    AU.addRequired<AssumptionCacheTracker>();
+  }
+};
+} // end anonymous namespace
+
+char LoopFlattenLegacyPass::ID = 0;
+INITIALIZE_PASS_BEGIN(LoopFlattenLegacyPass, "loop-flatten", "Flattens loops",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(LoopPass)
+INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(AssumptionCacheTracker)
+INITIALIZE_PASS_END(LoopFlattenLegacyPass, "loop-flatten", "Flattens loops",
+                    false, false)
+
+FunctionPass *llvm::createLoopFlattenPass() {
+  return new LoopFlattenLegacyPass();
+}
+
+bool LoopFlattenLegacyPass::runOnFunction(Function &F) {
+  if (skipFunction(F))
+    return false;
+
+  ScalarEvolution *SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  LoopInfo *LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  DominatorTree *DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  auto &TTIP = getAnalysis<TargetTransformInfoWrapperPass>();
+  auto *TTI = &TTIP.getTTI(F);
+  auto *AC = &getAnalysis<AssumptionCacheTracker>().getAssumptionCache(F);
+  return flattenLoops(LI, DT, SE, AC, TTI);
+}
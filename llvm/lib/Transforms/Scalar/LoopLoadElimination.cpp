@@ -9,9 +9,13 @@
 // This file implement a loop-aware load elimination pass.
 //
 // It uses LoopAccessAnalysis to identify loop-carried dependences with a
-// distance of one between stores and loads.  These form the candidates for the
-// transformation.  The source value of each store then propagated to the user
-// of the corresponding load.  This makes the load dead.
+// constant distance between stores and loads.  These form the candidates for
+// the transformation.  The source value of each store then propagated to the
+// user of the corresponding load.  This makes the load dead.
+//
+// When the distance is more than one iteration, e.g. in A[i] = A[i-2] + A[i-3],
+// the values stored in the last iterations are rotated through a chain of PHIs,
+// which is bounded by a register budget.
 //
 // The pass can also version the loop and add memchecks in order to prove that
 // may-aliasing stores can't change the value in memory before it's read by the
@@ -23,6 +27,7 @@
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
@@ -61,6 +66,7 @@
 #include "llvm/Transforms/Utils/SizeOpts.h"
 #include <algorithm>
 #include <cassert>
+#include <climits>
 #include <forward_list>
 #include <set>
 #include <tuple>
@@ -81,6 +87,12 @@ static cl::opt<unsigned> LoadElimSCEVCheckThreshold(
     cl::desc("The maximum number of SCEV checks allowed for Loop "
              "Load Elimination"));
 
+static cl::opt<unsigned> LoadElimRegisterBudget(
+    "loop-load-elimination-register-budget", cl::init(8), cl::Hidden,
+    cl::desc("The maximum number of extra values Loop Load Elimination keeps "
+             "in registers per loop to forward stores over more than one "
+             "iteration"));
+
 STATISTIC(NumLoopLoadEliminted, "Number of loads eliminated by LLE");
 
 namespace {
@@ -93,9 +105,10 @@ struct StoreToLoadForwardingCandidate {
   StoreToLoadForwardingCandidate(LoadInst *Load, StoreInst *Store)
       : Load(Load), Store(Store) {}
 
-  /// Return true if the dependence from the store to the load has a
-  /// distance of one.  E.g. A[i+1] = A[i]
-  bool isDependenceDistanceOfOne(PredicatedScalarEvolution &PSE,
+  /// Return the number of iterations between the store and the load reading
+  /// its value, e.g. 1 for A[i+1] = A[i] and 3 for A[i] = A[i-3], or 0 if the
+  /// load doesn't read the value stored by a previous iteration.
+  unsigned getDependenceDistance(PredicatedScalarEvolution &PSE,
                                  Loop *L) const {
     Value *LoadPtr = Load->getPointerOperand();
     Value *StorePtr = Store->getPointerOperand();
@@ -112,7 +125,7 @@ struct StoreToLoadForwardingCandidate {
     // the dependence distance.
     if (getPtrStride(PSE, LoadPtr, L) != 1 ||
         getPtrStride(PSE, StorePtr, L) != 1)
-      return false;
+      return 0;
 
     auto &DL = Load->getParent()->getModule()->getDataLayout();
     unsigned TypeByteSize = DL.getTypeAllocSize(const_cast<Type *>(LoadType));
@@ -125,7 +138,9 @@ struct StoreToLoadForwardingCandidate {
     auto *Dist = cast<SCEVConstant>(
         PSE.getSE()->getMinusSCEV(StorePtrSCEV, LoadPtrSCEV));
     const APInt &Val = Dist->getAPInt();
-    return Val == TypeByteSize;
+    if (!Val.isStrictlyPositive() || Val.urem(TypeByteSize) != 0)
+      return 0;
+    return Val.udiv(TypeByteSize).getLimitedValue(UINT_MAX);
   }
 
   Value *getLoadPtr() const { return Load->getPointerOperand(); }
@@ -277,10 +292,11 @@ public:
 
         // Handle the very basic case when the two stores are in the same block
         // so deciding which one forwards is easy.  The later one forwards as
-        // long as they both have a dependence distance of one to the load.
+        // long as they both have the same dependence distance to the load.
+        unsigned Distance = Cand.getDependenceDistance(PSE, L);
         if (Cand.Store->getParent() == OtherCand->Store->getParent() &&
-            Cand.isDependenceDistanceOfOne(PSE, L) &&
-            OtherCand->isDependenceDistanceOfOne(PSE, L)) {
+            Distance &&
+            Distance == OtherCand->getDependenceDistance(PSE, L)) {
           // They are in the same block, the later one will forward to the load.
           if (getInstrIndex(OtherCand->Store) < getInstrIndex(Cand.Store))
             OtherCand = &Cand;
@@ -367,6 +383,17 @@ public:
         PtrsWrittenOnFwdingPath.insert(S->getPointerOperand());
     };
     const auto &MemInstrs = LAI.getDepChecker().getMemoryInstructions();
+
+    // A value forwarded over more than one iteration stays live across a whole
+    // iteration, so every store of the loop is on the path.
+    if (llvm::any_of(Candidates,
+                     [&](const StoreToLoadForwardingCandidate &Cand) {
+                       return Cand.getDependenceDistance(PSE, L) > 1;
+                     })) {
+      std::for_each(MemInstrs.begin(), MemInstrs.end(), InsertStorePtr);
+      return PtrsWrittenOnFwdingPath;
+    }
+
     std::for_each(MemInstrs.begin() + getInstrIndex(FirstStore) + 1,
                   MemInstrs.end(), InsertStorePtr);
     std::for_each(MemInstrs.begin(), &MemInstrs[getInstrIndex(LastLoad)],
@@ -408,41 +435,121 @@ public:
     return Checks;
   }
 
-  /// Perform the transformation for a candidate.
-  void
-  propagateStoredValueToLoadUsers(const StoreToLoadForwardingCandidate &Cand,
-                                  SCEVExpander &SEE) {
+  /// Return true if the initial values of the first \p Distance iterations
+  /// of \p Cand's load can be loaded in the preheader.
+  ///
+  /// The load is executed by the first iteration, which is all that is needed
+  /// for a distance of one.  Otherwise the loop may exit before reaching the
+  /// iterations that read the other values, so these must be known to be
+  /// dereferenceable.
+  bool canLoadInitialValues(const StoreToLoadForwardingCandidate &Cand,
+                            unsigned Distance) {
+    if (Distance == 1)
+      return true;
+
+    ScalarEvolution *SE = PSE.getSE();
+    if (SE->getSmallConstantTripCount(L) >= Distance)
+      return true;
+
+    // Otherwise the range read by the first iterations must be within the
+    // dereferenceable bytes of the underlying object.
+    auto *PtrSCEV = cast<SCEVAddRecExpr>(PSE.getSCEV(Cand.getLoadPtr()));
+    const SCEV *Start = PtrSCEV->getStart();
+    auto *Base = dyn_cast<SCEVUnknown>(SE->getPointerBase(Start));
+    if (!Base)
+      return false;
+    auto *Offset = dyn_cast<SCEVConstant>(SE->getMinusSCEV(Start, Base));
+    if (!Offset || Offset->getAPInt().isNegative())
+      return false;
+
+    const DataLayout &DL = L->getHeader()->getModule()->getDataLayout();
+    bool CanBeNull;
+    uint64_t DerefBytes =
+        Base->getValue()->getPointerDereferenceableBytes(DL, CanBeNull);
+    uint64_t TypeByteSize = DL.getTypeAllocSize(Cand.Load->getType());
+    return !CanBeNull && Offset->getAPInt().getLimitedValue() +
+                                 Distance * TypeByteSize <=
+                             DerefBytes;
+  }
+
+  /// Create the PHIs rotating the values stored by \p Store in the last
+  /// \p Distance iterations.  The k-th PHI holds the value stored k iterations
+  /// ago, and starts with the value \p Load reads in iteration Distance - k.
+  SmallVector<PHINode *, 4> createForwardingPHIs(StoreInst *Store,
+                                                 LoadInst *Load,
+                                                 unsigned Distance,
+                                                 SCEVExpander &SEE) {
     // loop:
     //      %x = load %gep_i
     //         = ... %x
-    //      store %y, %gep_i_plus_1
+    //      store %y, %gep_i_plus_2
     //
     // =>
     //
     // ph:
-    //      %x.initial = load %gep_0
+    //      %x.initial.1 = load %gep_1
+    //      %x.initial.2 = load %gep_0
     // loop:
-    //      %x.storeforward = phi [%x.initial, %ph] [%y, %loop]
+    //      %x.storeforward.1 = phi [%x.initial.1, %ph] [%y, %loop]
+    //      %x.storeforward.2 = phi [%x.initial.2, %ph]
+    //                              [%x.storeforward.1, %loop]
     //      %x = load %gep_i            <---- now dead
-    //         = ... %x.storeforward
-    //      store %y, %gep_i_plus_1
-
-    Value *Ptr = Cand.Load->getPointerOperand();
+    //         = ... %x.storeforward.2
+    //      store %y, %gep_i_plus_2
+    ScalarEvolution *SE = PSE.getSE();
+    Value *Ptr = Load->getPointerOperand();
     auto *PtrSCEV = cast<SCEVAddRecExpr>(PSE.getSCEV(Ptr));
     auto *PH = L->getLoopPreheader();
     assert(PH && "Preheader should exist!");
-    Value *InitialPtr = SEE.expandCodeFor(PtrSCEV->getStart(), Ptr->getType(),
-                                          PH->getTerminator());
-    Value *Initial = new LoadInst(
-        Cand.Load->getType(), InitialPtr, "load_initial",
-        /* isVolatile */ false, Cand.Load->getAlign(), PH->getTerminator());
-
-    PHINode *PHI = PHINode::Create(Initial->getType(), 2, "store_forwarded",
-                                   &L->getHeader()->front());
-    PHI->addIncoming(Initial, PH);
-    PHI->addIncoming(Cand.Store->getOperand(0), L->getLoopLatch());
-
-    Cand.Load->replaceAllUsesWith(PHI);
+
+    SmallVector<PHINode *, 4> PHIs;
+    for (unsigned K = 1; K <= Distance; ++K) {
+      // The value of K iterations ago is read by the load in iteration
+      // Distance - K.
+      const SCEV *Step = PtrSCEV->getStepRecurrence(*SE);
+      const SCEV *InitialPtrSCEV = SE->getAddExpr(
+          PtrSCEV->getStart(),
+          SE->getMulExpr(Step, SE->getConstant(Step->getType(), Distance - K)));
+      Value *InitialPtr = SEE.expandCodeFor(InitialPtrSCEV, Ptr->getType(),
+                                            PH->getTerminator());
+      Value *Initial = new LoadInst(
+          Load->getType(), InitialPtr, "load_initial",
+          /* isVolatile */ false, Load->getAlign(), PH->getTerminator());
+
+      PHINode *PHI = PHINode::Create(Initial->getType(), 2, "store_forwarded",
+                                     L->getHeader()->getFirstNonPHI());
+      PHI->addIncoming(Initial, PH);
+      PHI->addIncoming(K == 1 ? Store->getOperand(0) : PHIs.back(),
+                       L->getLoopLatch());
+      PHIs.push_back(PHI);
+    }
+    return PHIs;
+  }
+
+  /// Perform the transformation for the candidates, sharing the PHIs of the
+  /// loads forwarded from the same store.
+  void propagateStoredValuesToLoadUsers(
+      const SmallVectorImpl<StoreToLoadForwardingCandidate> &Candidates,
+      SCEVExpander &SEE) {
+    // The longest distance of each store determines its PHIs.
+    MapVector<StoreInst *, const StoreToLoadForwardingCandidate *> Farthest;
+    for (const StoreToLoadForwardingCandidate &Cand : Candidates) {
+      auto &F = Farthest[Cand.Store];
+      if (!F ||
+          F->getDependenceDistance(PSE, L) < Cand.getDependenceDistance(PSE, L))
+        F = &Cand;
+    }
+
+    DenseMap<StoreInst *, SmallVector<PHINode *, 4>> ForwardingPHIs;
+    for (const auto &KV : Farthest)
+      ForwardingPHIs[KV.first] = createForwardingPHIs(
+          KV.first, KV.second->Load,
+          KV.second->getDependenceDistance(PSE, L), SEE);
+
+    for (const StoreToLoadForwardingCandidate &Cand : Candidates) {
+      unsigned Distance = Cand.getDependenceDistance(PSE, L);
+      Cand.Load->replaceAllUsesWith(ForwardingPHIs[Cand.Store][Distance - 1]);
+    }
   }
 
   /// Top-level driver for each loop: find store->load forwarding
@@ -500,9 +607,14 @@ public:
       if (isLoadConditional(Cand.Load, L))
         continue;
 
-      // Check whether the SCEV difference is the same as the induction step,
-      // thus we load the value in the next iteration.
-      if (!Cand.isDependenceDistanceOfOne(PSE, L))
+      // Check whether the SCEV difference is a multiple of the induction step,
+      // thus we load the value in a later iteration.
+      unsigned Distance = Cand.getDependenceDistance(PSE, L);
+      if (!Distance)
+        continue;
+
+      // The values of the first iterations are loaded in the preheader.
+      if (!canLoadInitialValues(Cand, Distance))
         continue;
 
       assert(isa<SCEVAddRecExpr>(PSE.getSCEV(Cand.Load->getPointerOperand())) &&
@@ -520,6 +632,38 @@ public:
     if (Candidates.empty())
       return false;
 
+    // Forwarding a store over Distance iterations keeps Distance of its values
+    // live, which is shared by the loads it forwards to.  The values beyond
+    // the first are limited by the register budget, favoring short distances.
+    SmallVector<StoreToLoadForwardingCandidate, 4> ByDistance(
+        Candidates.begin(), Candidates.end());
+    llvm::stable_sort(ByDistance, [&](const StoreToLoadForwardingCandidate &A,
+                                      const StoreToLoadForwardingCandidate &B) {
+      return A.getDependenceDistance(PSE, L) < B.getDependenceDistance(PSE, L);
+    });
+    DenseMap<StoreInst *, unsigned> LiveValues;
+    SmallPtrSet<LoadInst *, 4> OverBudget;
+    unsigned ExtraValues = 0;
+    for (const StoreToLoadForwardingCandidate &Cand : ByDistance) {
+      unsigned Distance = Cand.getDependenceDistance(PSE, L);
+      unsigned &Live = LiveValues[Cand.Store];
+      unsigned Extra = Distance > Live ? Distance - std::max(Live, 1u) : 0;
+      if (ExtraValues + Extra > LoadElimRegisterBudget) {
+        LLVM_DEBUG(dbgs() << "Forwarding over " << Distance
+                          << " iterations exceeds the register budget:\n"
+                          << Cand);
+        OverBudget.insert(Cand.Load);
+        continue;
+      }
+      ExtraValues += Extra;
+      Live = std::max(Live, Distance);
+    }
+    llvm::erase_if(Candidates, [&](const StoreToLoadForwardingCandidate &Cand) {
+      return OverBudget.count(Cand.Load);
+    });
+    if (Candidates.empty())
+      return false;
+
     // Check intervening may-alias stores.  These need runtime checks for alias
     // disambiguation.
     SmallVector<RuntimePointerCheck, 4> Checks = collectMemchecks(Candidates);
@@ -584,8 +728,7 @@ public:
     // Also for the first iteration, generate the initial value of the load.
     SCEVExpander SEE(*PSE.getSE(), L->getHeader()->getModule()->getDataLayout(),
                      "storeforward");
-    for (const auto &Cand : Candidates)
-      propagateStoredValueToLoadUsers(Cand, SEE);
+    propagateStoredValuesToLoadUsers(Candidates, SEE);
     NumLoopLoadEliminted += Candidates.size();
 
     return true;
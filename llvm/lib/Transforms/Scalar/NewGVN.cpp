@@ -76,6 +76,7 @@
 #include "llvm/Analysis/MemoryBuiltins.h"
 #include "llvm/Analysis/MemorySSA.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Argument.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constant.h"
@@ -107,6 +108,7 @@
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Scalar/GVNExpression.h"
 #include "llvm/Transforms/Utils/AssumeBundleBuilder.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Local.h"
 #include "llvm/Transforms/Utils/PredicateInfo.h"
 #include "llvm/Transforms/Utils/VNCoercion.h"
@@ -143,6 +145,10 @@ STATISTIC(NumGVNDeadStores, "Number of redundant/dead stores eliminated");
 STATISTIC(NumGVNPHIOfOpsCreated, "Number of PHI of ops created");
 STATISTIC(NumGVNPHIOfOpsEliminations,
           "Number of things eliminated using PHI of ops");
+STATISTIC(NumGVNPRE, "Number of partially redundant instructions eliminated");
+STATISTIC(NumGVNPRELoads, "Number of partially redundant loads eliminated");
+STATISTIC(NumGVNPREInserted, "Number of instructions inserted by PRE");
+STATISTIC(NumGVNPRESplitEdges, "Number of critical edges split by PRE");
 DEBUG_COUNTER(VNCounter, "newgvn-vn",
               "Controls which instructions are value numbered");
 DEBUG_COUNTER(PHIOfOpsCounter, "newgvn-phi",
@@ -157,6 +163,23 @@ static cl::opt<bool> EnableStoreRefinement("enable-store-refinement",
 static cl::opt<bool> EnablePhiOfOps("enable-phi-of-ops", cl::init(true),
                                     cl::Hidden);
 
+static cl::opt<bool> EnableNewGVNPRE("enable-newgvn-pre", cl::init(true),
+                                     cl::Hidden,
+                                     cl::desc("Enable partial redundancy "
+                                              "elimination in NewGVN"));
+
+static cl::opt<unsigned> MaxPREInsertions(
+    "newgvn-pre-max-insertions", cl::init(2), cl::Hidden,
+    cl::desc("Maximum number of predecessors that a partially redundant "
+             "instruction is inserted into"));
+
+// Bounds the searches for available values in a predecessor, which keeps PRE
+// linear in the size of the function.
+static cl::opt<unsigned> PREScanLimit(
+    "newgvn-pre-scan-limit", cl::init(100), cl::Hidden,
+    cl::desc("Maximum number of instructions or users that PRE looks at to "
+             "find an available value in a predecessor"));
+
 //===----------------------------------------------------------------------===//
 //                                GVN Pass
 //===----------------------------------------------------------------------===//
@@ -801,6 +824,13 @@ private:
   Value *findPHIOfOpsLeader(const Expression *, const Instruction *,
                             const BasicBlock *) const;
 
+  // Partial redundancy elimination.
+  bool performPRE(Function &);
+  bool performPREOnInstruction(Instruction *, bool);
+  Value *findAvailableValue(const Instruction *, ArrayRef<Value *>,
+                            BasicBlock *) const;
+  Value *findAvailableLoad(const LoadInst *, Value *, BasicBlock *) const;
+
   // New instruction creation.
   void handleNewInstruction(Instruction *) {}
 
@@ -3446,6 +3476,9 @@ bool NewGVN::runGVN() {
     Changed = true;
   }
 
+  if (EnableNewGVNPRE)
+    Changed |= performPRE(F);
+
   cleanupTables();
   return Changed;
 }
@@ -4123,6 +4156,203 @@ bool NewGVN::shouldSwapOperands(const Value *A, const Value *B) const {
   return std::make_pair(getRank(A), A) > std::make_pair(getRank(B), B);
 }
 
+// Partial redundancy elimination.
+//
+// After elimination, an instruction may still be redundant on some of the
+// paths that reach it: its value is computed in some predecessors of its
+// block, or loaded or stored there for a load, but not in the others. This is
+// the case of a load of a location that is stored on the loop backedge, or of
+// an expression of induction variables that the previous iteration computed.
+// Such an instruction is made fully redundant by inserting it in the
+// predecessors where it is not available, and replaced with a PHI of the
+// available values.
+//
+// The operands are translated through the PHIs of the block, so expressions
+// of the values of the previous iteration are found. The instruction is
+// inserted at the end of the predecessors, after splitting the edge from the
+// ones that have other successors, and only if it is executed whenever the
+// block is entered, so no path gets a computation that it didn't have before.
+
+/// Returns an instruction that computes the same value as \p I with the
+/// operands \p Ops and is available at the end of \p Pred, or null.
+Value *NewGVN::findAvailableValue(const Instruction *I, ArrayRef<Value *> Ops,
+                                  BasicBlock *Pred) const {
+  // Look for the instruction among the users of one of the operands.
+  auto SearchOp = llvm::find_if(Ops, [](Value *Op) {
+    return isa<Instruction>(Op) || isa<Argument>(Op) || isa<GlobalValue>(Op);
+  });
+  if (SearchOp == Ops.end())
+    return nullptr;
+
+  unsigned NumScanned = 0;
+  for (User *U : (*SearchOp)->users()) {
+    if (++NumScanned > PREScanLimit)
+      break;
+    // The temporary instructions of value numbering are not in a block.
+    auto *J = dyn_cast<Instruction>(U);
+    if (!J || !J->getParent() || J->getFunction() != I->getFunction() ||
+        !J->isSameOperationAs(I) ||
+        J->getRawSubclassOptionalData() != I->getRawSubclassOptionalData() ||
+        J->getNumOperands() != Ops.size() ||
+        !std::equal(Ops.begin(), Ops.end(), J->op_begin()) ||
+        !ReachableBlocks.count(J->getParent()) ||
+        !DT->dominates(J->getParent(), Pred))
+      continue;
+    return J;
+  }
+  return nullptr;
+}
+
+/// Returns the value that \p LI would load from \p Ptr at the end of
+/// \p Pred, if it is loaded or stored in \p Pred or its single predecessors
+/// and not clobbered after that, or null.
+Value *NewGVN::findAvailableLoad(const LoadInst *LI, Value *Ptr,
+                                 BasicBlock *Pred) const {
+  MemoryLocation Loc = MemoryLocation::get(LI).getWithNewPtr(Ptr);
+  SmallPtrSet<BasicBlock *, 4> Visited;
+  unsigned NumScanned = 0;
+  for (BasicBlock *BB = Pred; BB && Visited.insert(BB).second;
+       BB = BB->getSinglePredecessor()) {
+    for (Instruction &Inst : make_range(BB->rbegin(), BB->rend())) {
+      if (++NumScanned > PREScanLimit)
+        return nullptr;
+      if (auto *L = dyn_cast<LoadInst>(&Inst))
+        if (L->isSimple() && L->getPointerOperand() == Ptr &&
+            L->getType() == LI->getType())
+          return L;
+      if (auto *SI = dyn_cast<StoreInst>(&Inst))
+        if (SI->isSimple() && SI->getPointerOperand() == Ptr &&
+            SI->getValueOperand()->getType() == LI->getType())
+          return SI->getValueOperand();
+      if (Inst.mayWriteToMemory() && isModSet(AA->getModRefInfo(&Inst, Loc)))
+        return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+/// Tries to make \p I fully redundant by inserting it into the predecessors
+/// of its block where it isn't available. \p IsAnticipated tells whether \p I
+/// is executed whenever its block is entered.
+bool NewGVN::performPREOnInstruction(Instruction *I, bool IsAnticipated) {
+  auto *LI = dyn_cast<LoadInst>(I);
+  if (LI ? !LI->isSimple()
+         : !isa<BinaryOperator>(I) && !isa<CmpInst>(I) && !isa<CastInst>(I) &&
+               !isa<GetElementPtrInst>(I) && !isa<SelectInst>(I))
+    return false;
+  if (!IsAnticipated && (LI || !isSafeToSpeculativelyExecute(I)))
+    return false;
+
+  BasicBlock *BB = I->getParent();
+  // The operands defined in the block can only be translated if they are
+  // PHIs.
+  for (Value *Op : I->operands())
+    if (auto *OpI = dyn_cast<Instruction>(Op))
+      if (OpI->getParent() == BB && !isa<PHINode>(OpI))
+        return false;
+
+  // A load must not be clobbered between the start of the block and itself.
+  if (LI) {
+    MemoryLocation Loc = MemoryLocation::get(LI);
+    for (Instruction &Inst : make_range(BB->begin(), I->getIterator()))
+      if (Inst.mayWriteToMemory() && isModSet(AA->getModRefInfo(&Inst, Loc)))
+        return false;
+  }
+
+  SmallDenseMap<BasicBlock *, Value *, 4> AvailableValues;
+  SmallVector<std::pair<BasicBlock *, SmallVector<Value *, 4>>, 2> Unavailable;
+  for (BasicBlock *Pred : predecessors(BB)) {
+    if (AvailableValues.count(Pred))
+      continue;
+    SmallVector<Value *, 4> Ops;
+    for (Value *Op : I->operands()) {
+      auto *PN = dyn_cast<PHINode>(Op);
+      Ops.push_back(PN && PN->getParent() == BB
+                        ? PN->getIncomingValueForBlock(Pred)
+                        : Op);
+    }
+
+    Value *V = LI ? findAvailableLoad(LI, Ops[0], Pred)
+                  : findAvailableValue(I, Ops, Pred);
+    if (V) {
+      AvailableValues[Pred] = V;
+      continue;
+    }
+    // The instruction is inserted at the end of the predecessor, or of a new
+    // block on the edge if the predecessor has other successors. Edges that
+    // aren't from a branch or a switch can't be split, and a predecessor with
+    // several edges to the block would need the value on each of them.
+    Instruction *PredTerm = Pred->getTerminator();
+    if (Unavailable.size() == MaxPREInsertions ||
+        (!isa<BranchInst>(PredTerm) && !isa<SwitchInst>(PredTerm)) ||
+        llvm::count(successors(Pred), BB) != 1)
+      return false;
+    Unavailable.push_back({Pred, std::move(Ops)});
+  }
+  if (AvailableValues.empty())
+    return false;
+
+  for (auto &P : Unavailable) {
+    BasicBlock *InsertBB = P.first;
+    if (InsertBB->getSingleSuccessor() != BB) {
+      InsertBB =
+          SplitCriticalEdge(InsertBB, BB, CriticalEdgeSplittingOptions(DT));
+      assert(InsertBB && "Failed to split a critical edge");
+      ReachableBlocks.insert(InsertBB);
+      ++NumGVNPRESplitEdges;
+    }
+    Instruction *New = I->clone();
+    for (unsigned Op = 0, E = P.second.size(); Op != E; ++Op)
+      New->setOperand(Op, P.second[Op]);
+    New->setName(I->getName() + ".pre");
+    New->insertBefore(InsertBB->getTerminator());
+    AvailableValues[InsertBB] = New;
+    ++NumGVNPREInserted;
+  }
+
+  PHINode *PN = PHINode::Create(I->getType(), pred_size(BB),
+                                I->getName() + ".pre-phi", &BB->front());
+  PN->setDebugLoc(I->getDebugLoc());
+  for (BasicBlock *Pred : predecessors(BB))
+    PN->addIncoming(AvailableValues[Pred], Pred);
+  // An instruction that is available from its own block through a backedge is
+  // replaced with the PHI there, too.
+  I->replaceAllUsesWith(PN);
+  I->eraseFromParent();
+
+  ++NumGVNPRE;
+  if (LI)
+    ++NumGVNPRELoads;
+  LLVM_DEBUG(dbgs() << "PRE created " << *PN << "\n");
+  return true;
+}
+
+bool NewGVN::performPRE(Function &F) {
+  bool Changed = false;
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : RPOT) {
+    if (!ReachableBlocks.count(BB) || BB->isEHPad() ||
+        !BB->hasNPredecessorsOrMore(2) ||
+        llvm::any_of(predecessors(BB), [&](BasicBlock *Pred) {
+          return !ReachableBlocks.count(Pred);
+        }))
+      continue;
+
+    bool IsAnticipated = true;
+    for (Instruction &I : make_early_inc_range(*BB)) {
+      if (isa<PHINode>(I))
+        continue;
+      if (I.getType()->isVoidTy() || I.getType()->isTokenTy() ||
+          !performPREOnInstruction(&I, IsAnticipated)) {
+        IsAnticipated &= isGuaranteedToTransferExecutionToSuccessor(&I);
+        continue;
+      }
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
 namespace {
 
 class NewGVNLegacyPass : public FunctionPass {
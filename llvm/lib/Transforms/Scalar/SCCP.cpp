@@ -363,6 +363,19 @@ public:
     return nullptr;
   }
 
+  /// Return the constant \p V is known to be, or null if the solver did not
+  /// find it to be a single constant. Structs are never constant here.
+  Constant *getConstantOrNull(Value *V) const {
+    if (V->getType()->isStructTy())
+      return nullptr;
+    if (auto *C = dyn_cast<Constant>(V))
+      return C;
+    auto I = ValueState.find(V);
+    if (I == ValueState.end() || !isConstant(I->second))
+      return nullptr;
+    return getConstant(I->second);
+  }
+
 private:
   ConstantInt *getConstantInt(const ValueLatticeElement &IV) const {
     return dyn_cast_or_null<ConstantInt>(getConstant(IV));
@@ -1914,19 +1927,19 @@ static bool removeNonFeasibleEdges(const SCCPSolver &Solver, BasicBlock *BB,
   return true;
 }
 
-bool llvm::runIPSCCP(
-    Module &M, const DataLayout &DL,
-    std::function<const TargetLibraryInfo &(Function &)> GetTLI,
+/// Set up \p Solver for all the functions and globals of \p M and solve it.
+/// \p getAnalysis may be null, in which case no predicate info is used.
+static void solveIPSCCP(
+    SCCPSolver &Solver, Module &M,
     function_ref<AnalysisResultsForFn(Function &)> getAnalysis) {
-  SCCPSolver Solver(DL, GetTLI, M.getContext());
-
   // Loop over all functions, marking arguments to those with their addresses
   // taken or that are external as overdefined.
   for (Function &F : M) {
     if (F.isDeclaration())
       continue;
 
-    Solver.addAnalysis(F, getAnalysis(F));
+    if (getAnalysis)
+      Solver.addAnalysis(F, getAnalysis(F));
 
     // Determine if we can track the function's return values. If so, add the
     // function to the solver's set of return-tracked functions.
@@ -1971,6 +1984,14 @@ bool llvm::runIPSCCP(
         ResolvedUndefs = true;
       }
   }
+}
+
+bool llvm::runIPSCCP(
+    Module &M, const DataLayout &DL,
+    std::function<const TargetLibraryInfo &(Function &)> GetTLI,
+    function_ref<AnalysisResultsForFn(Function &)> getAnalysis) {
+  SCCPSolver Solver(DL, GetTLI, M.getContext());
+  solveIPSCCP(Solver, M, getAnalysis);
 
   bool MadeChanges = false;
 
@@ -2174,3 +2195,30 @@ bool llvm::runIPSCCP(
 
   return MadeChanges;
 }
+
+void llvm::findIPSCCPConstantArguments(
+    Module &M, const DataLayout &DL,
+    std::function<const TargetLibraryInfo &(Function &)> GetTLI,
+    function_ref<void(CallBase &, unsigned, Constant *)> Visit) {
+  SCCPSolver Solver(DL, GetTLI, M.getContext());
+  solveIPSCCP(Solver, M, nullptr);
+
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    for (BasicBlock &BB : F) {
+      if (!Solver.isBlockExecutable(&BB))
+        continue;
+      for (Instruction &I : BB) {
+        auto *CB = dyn_cast<CallBase>(&I);
+        if (!CB || !CB->getCalledFunction())
+          continue;
+        for (unsigned ArgNo = 0, E = CB->arg_size(); ArgNo != E; ++ArgNo) {
+          Constant *C = Solver.getConstantOrNull(CB->getArgOperand(ArgNo));
+          if (C && !isa<UndefValue>(C))
+            Visit(*CB, ArgNo, C);
+        }
+      }
+    }
+  }
+}
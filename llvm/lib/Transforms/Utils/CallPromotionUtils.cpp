@@ -191,10 +191,9 @@ static void createRetBitCast(CallBase &CB, Type *RetTy, CastInst **RetBitCast) {
 /// Predicate and clone the given call site.
 ///
 /// This function creates an if-then-else structure at the location of the call
-/// site. The "if" condition compares the call site's called value to the given
-/// callee. The original call site is moved into the "else" block, and a clone
-/// of the call site is placed in the "then" block. The cloned instruction is
-/// returned.
+/// site. The "if" condition is \p Cond, which is inserted before the call site.
+/// The original call site is moved into the "else" block, and a clone of the
+/// call site is placed in the "then" block. The cloned instruction is returned.
 ///
 /// For example, the call instruction below:
 ///
@@ -283,19 +282,13 @@ static void createRetBitCast(CallBase &CB, Type *RetTy, CastInst **RetBitCast) {
 ///     ; The original call instruction stays in its original block.
 ///     %t0 = musttail call i32 %ptr()
 ///     ret %t0
-static CallBase &versionCallSite(CallBase &CB, Value *Callee,
-                                 MDNode *BranchWeights) {
+static CallBase &versionCallSiteWithCond(CallBase &CB, Value *Cond,
+                                         MDNode *BranchWeights) {
 
   IRBuilder<> Builder(&CB);
   CallBase *OrigInst = &CB;
   BasicBlock *OrigBlock = OrigInst->getParent();
 
-  // Create the compare. The called value and callee must have the same type to
-  // be compared.
-  if (CB.getCalledOperand()->getType() != Callee->getType())
-    Callee = Builder.CreateBitCast(Callee, CB.getCalledOperand()->getType());
-  auto *Cond = Builder.CreateICmpEQ(CB.getCalledOperand(), Callee);
-
   if (OrigInst->isMustTailCall()) {
     // Create an if-then structure. The original instruction stays in its block,
     // and a clone of the original instruction is placed in the "then" block.
@@ -383,6 +376,21 @@ static CallBase &versionCallSite(CallBase &CB, Value *Callee,
   return *NewInst;
 }
 
+/// Predicate and clone the given call site, comparing the called value to
+/// \p Callee. See versionCallSiteWithCond.
+static CallBase &versionCallSite(CallBase &CB, Value *Callee,
+                                 MDNode *BranchWeights) {
+  IRBuilder<> Builder(&CB);
+
+  // Create the compare. The called value and callee must have the same type to
+  // be compared.
+  if (CB.getCalledOperand()->getType() != Callee->getType())
+    Callee = Builder.CreateBitCast(Callee, CB.getCalledOperand()->getType());
+  auto *Cond = Builder.CreateICmpEQ(CB.getCalledOperand(), Callee);
+
+  return versionCallSiteWithCond(CB, Cond, BranchWeights);
+}
+
 bool llvm::isLegalToPromote(const CallBase &CB, Function *Callee,
                             const char **FailureReason) {
   assert(!CB.getCalledFunction() && "Only indirect call sites can be promoted");
@@ -537,6 +545,56 @@ CallBase &llvm::promoteCallWithIfThenElse(CallBase &CB, Function *Callee,
   return promoteCall(NewInst, Callee);
 }
 
+CallBase &llvm::promoteCallWithVTableCmp(CallBase &CB, Value *VPtr,
+                                         Function *Callee,
+                                         ArrayRef<Constant *> AddressPoints,
+                                         MDNode *BranchWeights) {
+  assert(!AddressPoints.empty() && "Expected at least one address point");
+
+  // The call site calls Callee if the vtable pointer is one of the address
+  // points.
+  IRBuilder<> Builder(&CB);
+  SmallVector<Value *, 2> ICmps;
+  for (Constant *AddressPoint : AddressPoints)
+    ICmps.push_back(Builder.CreateICmpEQ(
+        VPtr, Builder.CreateBitCast(AddressPoint, VPtr->getType())));
+  Value *Cond = Builder.CreateOr(ICmps);
+
+  // The function pointer is only needed if the vtable doesn't match. Find its
+  // load, and the casts and address computation used only by it, to sink them
+  // to the original call site. Nothing in between may write to the memory.
+  SmallVector<Instruction *, 4> ToSink;
+  auto *Load = dyn_cast<LoadInst>(CB.getCalledOperand()->stripPointerCasts());
+  if (Load && Load->isSimple() && Load->getParent() == CB.getParent() &&
+      std::none_of(std::next(Load->getIterator()), CB.getIterator(),
+                   [](Instruction &I) { return I.mayWriteToMemory(); })) {
+    for (Value *V = CB.getCalledOperand(); V != Load;
+         V = cast<Instruction>(V)->getOperand(0))
+      ToSink.push_back(cast<Instruction>(V));
+    ToSink.push_back(Load);
+    if (auto *GEP = dyn_cast<GetElementPtrInst>(Load->getPointerOperand()))
+      ToSink.push_back(GEP);
+    if (!llvm::all_of(ToSink, [&](Instruction *I) {
+          return I->hasOneUse() && I->getParent() == CB.getParent();
+        }))
+      ToSink.clear();
+  }
+
+  // Version the indirect call site. If the vtable matches, 'NewInst' will be
+  // executed, otherwise the original call site will be executed.
+  CallBase &NewInst = versionCallSiteWithCond(CB, Cond, BranchWeights);
+
+  // Promote 'NewInst' so that it directly calls the desired function.
+  CallBase &DirectCall = promoteCall(NewInst, Callee);
+
+  Instruction *InsertPt = &CB;
+  for (Instruction *I : ToSink) {
+    I->moveBefore(InsertPt);
+    InsertPt = I;
+  }
+  return DirectCall;
+}
+
 bool llvm::tryPromoteCall(CallBase &CB) {
   assert(!CB.getCalledFunction());
   Module *M = CB.getCaller()->getParent();
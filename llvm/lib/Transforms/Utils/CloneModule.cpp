@@ -54,6 +54,16 @@ std::unique_ptr<Module> llvm::CloneModule(
   New->setTargetTriple(M.getTargetTriple());
   New->setModuleInlineAsm(M.getModuleInlineAsm());
 
+  // The cloned instructions take their IDs from the new module's ID counter,
+  // which must be there before any function body is cloned. The new module
+  // gets a counter node of its own, which starts where the counter of M is.
+  const NamedMDNode *IDs = M.getNamedMetadata("ID");
+  if (IDs && IDs->getNumOperands()) {
+    Metadata *NextID = IDs->getOperand(0)->getOperand(0);
+    New->getOrInsertNamedMetadata("ID")->addOperand(
+        MDNode::getDistinct(M.getContext(), NextID));
+  }
+
   // Loop over all of the global variables, making corresponding globals in the
   // new module.  Here we add them to the VMap and to the new Module.  We
   // don't worry about attributes or initializers, they will come later.
@@ -186,6 +196,8 @@ std::unique_ptr<Module> llvm::CloneModule(
                                              E = M.named_metadata_end();
        I != E; ++I) {
     const NamedMDNode &NMD = *I;
+    if (&NMD == IDs)
+      continue;
     NamedMDNode *NewNMD = New->getOrInsertNamedMetadata(NMD.getName());
     if (&NMD == LLVM_DBG_CU) {
       // Do not insert duplicate operands.
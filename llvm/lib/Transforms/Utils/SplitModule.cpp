@@ -23,6 +23,7 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalIFunc.h"
 #include "llvm/IR/GlobalObject.h"
 #include "llvm/IR/GlobalIndirectSymbol.h"
 #include "llvm/IR/GlobalValue.h"
@@ -91,18 +92,9 @@ static void addAllGlobalValueUsers(ClusterMapType &GVtoClusterMap,
   }
 }
 
-// Find partitions for module in the way that no locals need to be
-// globalized.
-// Try to balance pack those partitions into N files since this roughly equals
-// thread balancing for the backend codegen step.
-static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
-                           unsigned N) {
-  // At this point module should have the proper mix of globals and locals.
-  // As we attempt to partition this module, we must not change any
-  // locals to globals.
-  LLVM_DEBUG(dbgs() << "Partition module with (" << M->size()
-                    << ")functions\n");
-  ClusterMapType GVtoClusterMap;
+// Group the global values that must end up in the same partition: comdat
+// members, aliases and their aliasees, and locals and their users.
+static void buildClusters(Module *M, ClusterMapType &GVtoClusterMap) {
   ComdatMembersType ComdatMembers;
 
   auto recordGVSet = [&GVtoClusterMap, &ComdatMembers](GlobalValue &GV) {
@@ -147,6 +139,21 @@ static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
   llvm::for_each(M->functions(), recordGVSet);
   llvm::for_each(M->globals(), recordGVSet);
   llvm::for_each(M->aliases(), recordGVSet);
+}
+
+// Find partitions for module in the way that no locals need to be
+// globalized.
+// Try to balance pack those partitions into N files since this roughly equals
+// thread balancing for the backend codegen step.
+static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
+                           unsigned N) {
+  // At this point module should have the proper mix of globals and locals.
+  // As we attempt to partition this module, we must not change any
+  // locals to globals.
+  LLVM_DEBUG(dbgs() << "Partition module with (" << M->size()
+                    << ")functions\n");
+  ClusterMapType GVtoClusterMap;
+  buildClusters(M, GVtoClusterMap);
 
   // Assigned all GVs to merged clusters while balancing number of objects in
   // each.
@@ -212,6 +219,63 @@ static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
   }
 }
 
+// Find partitions for module in the way that each partition is a contiguous
+// run of the module's functions, with about the same number of instructions
+// in each, so that linking the partitions in order keeps the function layout
+// of the module. Global variables go to the partition of the first function
+// that references them. Clusters are kept together in the partition of their
+// first member.
+static void findOrderedPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
+                                  unsigned N) {
+  LLVM_DEBUG(dbgs() << "Partition module with (" << M->size()
+                    << ")functions in order\n");
+  ClusterMapType GVtoClusterMap;
+  buildClusters(M, GVtoClusterMap);
+
+  auto assignCluster = [&](const GlobalValue *GV, unsigned I) {
+    if (ClusterIDMap.count(GV))
+      return;
+    ClusterMapType::iterator It = GVtoClusterMap.findValue(GV);
+    if (It == GVtoClusterMap.end()) {
+      ClusterIDMap[GV] = I;
+      return;
+    }
+    for (ClusterMapType::member_iterator MI = GVtoClusterMap.findLeader(It);
+         MI != GVtoClusterMap.member_end(); ++MI)
+      ClusterIDMap.insert(std::make_pair(*MI, I));
+  };
+
+  uint64_t TotalSize = 0;
+  for (const Function &F : *M)
+    TotalSize += F.getInstructionCount();
+
+  uint64_t Size = 0;
+  for (const Function &F : *M) {
+    if (F.isDeclaration())
+      continue;
+    unsigned I = TotalSize ? std::min<uint64_t>(Size * N / TotalSize, N - 1)
+                           : 0;
+    Size += F.getInstructionCount();
+    assignCluster(&F, I);
+
+    // F may have been placed earlier along with its cluster.
+    unsigned FI = ClusterIDMap[&F];
+    for (const BasicBlock &BB : F)
+      for (const Instruction &Inst : BB)
+        for (const Value *Op : Inst.operands())
+          if (auto *GV = dyn_cast<GlobalVariable>(Op->stripPointerCasts()))
+            if (!GV->isDeclaration())
+              assignCluster(GV, FI);
+  }
+
+  // IFuncs are not clustered with their resolvers, which must nevertheless
+  // stay in the same partition.
+  for (const GlobalIFunc &GIF : M->ifuncs())
+    if (const GlobalObject *Base = GIF.getBaseObject())
+      if (ClusterIDMap.count(Base))
+        assignCluster(&GIF, ClusterIDMap[Base]);
+}
+
 static void externalize(GlobalValue *GV) {
   if (GV->hasLocalLinkage()) {
     GV->setLinkage(GlobalValue::ExternalLinkage);
@@ -249,7 +313,7 @@ static bool isInPartition(const GlobalValue *GV, unsigned I, unsigned N) {
 void llvm::SplitModule(
     std::unique_ptr<Module> M, unsigned N,
     function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback,
-    bool PreserveLocals) {
+    bool PreserveLocals, bool PreserveOrder) {
   if (!PreserveLocals) {
     for (Function &F : *M)
       externalize(&F);
@@ -264,7 +328,10 @@ void llvm::SplitModule(
   // This performs splitting without a need for externalization, which might not
   // always be possible.
   ClusterIDMapType ClusterIDMap;
-  findPartitions(M.get(), ClusterIDMap, N);
+  if (PreserveOrder)
+    findOrderedPartitions(M.get(), ClusterIDMap, N);
+  else
+    findPartitions(M.get(), ClusterIDMap, N);
 
   // FIXME: We should be able to reuse M as the last partition instead of
   // cloning it.
@@ -17,9 +17,11 @@
 #include "llvm/Transforms/Vectorize/LoopVectorizationLegality.h"
 #include "llvm/Analysis/Loads.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Analysis/VectorUtils.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/PatternMatch.h"
 #include "llvm/Transforms/Utils/SizeOpts.h"
@@ -37,6 +39,11 @@ static cl::opt<bool>
     EnableIfConversion("enable-if-conversion", cl::init(true), cl::Hidden,
                        cl::desc("Enable if-conversion during vectorization."));
 
+static cl::opt<bool> EnableEarlyExitVectorization(
+    "enable-early-exit-vectorization", cl::init(true), cl::Hidden,
+    cl::desc("Enable vectorization of loops with a data-dependent early "
+             "exit."));
+
 static cl::opt<unsigned> PragmaVectorizeMemoryCheckThreshold(
     "pragma-vectorize-memory-check-threshold", cl::init(128), cl::Hidden,
     cl::desc("The maximum allowed number of runtime memory checks with a "
@@ -870,6 +877,13 @@ bool LoopVectorizationLegality::canVectorizeInstrs() {
 
 bool LoopVectorizationLegality::canVectorizeMemory() {
   LAI = &(*GetLAA)(*TheLoop);
+
+  // The dependence analysis gives up on loops with several exits. An early
+  // exit loop only reads memory though (see canVectorizeEarlyExit), so there
+  // are no dependences to check.
+  if (hasEarlyExit())
+    return true;
+
   const OptimizationRemarkAnalysis *LAR = LAI->getReport();
   if (LAR) {
     ORE->emit([&]() {
@@ -1052,6 +1066,118 @@ bool LoopVectorizationLegality::canVectorizeWithIfConvert() {
   return true;
 }
 
+bool LoopVectorizationLegality::findEarlyExit() {
+  if (!EnableEarlyExitVectorization || !TheLoop->isInnermost())
+    return false;
+
+  BasicBlock *Latch = TheLoop->getLoopLatch();
+  if (!Latch || !TheLoop->isLoopExiting(Latch))
+    return false;
+
+  SmallVector<BasicBlock *, 2> ExitingBlocks;
+  TheLoop->getExitingBlocks(ExitingBlocks);
+  if (ExitingBlocks.size() != 2)
+    return false;
+  BasicBlock *EarlyExiting =
+      ExitingBlocks[0] == Latch ? ExitingBlocks[1] : ExitingBlocks[0];
+
+  // The early exit must be checked in every iteration, and leave the loop on
+  // one edge of a conditional branch only.
+  auto *Br = dyn_cast<BranchInst>(EarlyExiting->getTerminator());
+  if (!Br || !Br->isConditional() || !DT->dominates(EarlyExiting, Latch)) {
+    LLVM_DEBUG(dbgs() << "LV: Unsupported early exit in "
+                      << EarlyExiting->getName() << "\n");
+    return false;
+  }
+
+  // The vector loop runs for the iterations bounded by the latch, which must
+  // thus be countable.
+  if (isa<SCEVCouldNotCompute>(PSE.getSE()->getExitCount(TheLoop, Latch))) {
+    LLVM_DEBUG(dbgs() << "LV: Uncountable latch of an early exit loop\n");
+    return false;
+  }
+
+  LLVM_DEBUG(dbgs() << "LV: Found an early exit in "
+                    << EarlyExiting->getName() << "\n");
+  EarlyExitingBlock = EarlyExiting;
+  return true;
+}
+
+bool LoopVectorizationLegality::canVectorizeEarlyExit() {
+  // The vector loop may run past the iteration that takes the early exit, so
+  // everything that it computes must be free of side effects, and it must not
+  // carry values across iterations other than inductions.
+  if (!Reductions.empty() || !FirstOrderRecurrences.empty()) {
+    reportVectorizationFailure(
+        "Early exit loop with reduction or recurrence",
+        "loop with an early exit carries a value across iterations",
+        "EarlyExitRecurrence", ORE, TheLoop);
+    return false;
+  }
+
+  // The vector loop runs for the iterations of the latch, which the loads
+  // must be dereferenceable for, so they need a constant bound.
+  ScalarEvolution &SE = *PSE.getSE();
+  auto *MaxLatchCount = dyn_cast<SCEVConstant>(SE.getExitCount(
+      TheLoop, TheLoop->getLoopLatch(), ScalarEvolution::ConstantMaximum));
+  if (!MaxLatchCount || MaxLatchCount->getAPInt().getActiveBits() > 31) {
+    reportVectorizationFailure(
+        "Early exit loop with an unbounded latch",
+        "loop with an early exit has no constant bound on its trip count",
+        "EarlyExitUnboundedLatch", ORE, TheLoop);
+    return false;
+  }
+  EarlyExitMaxTripCount = MaxLatchCount->getAPInt().getZExtValue() + 1;
+
+  EarlyExitLoads.clear();
+  for (BasicBlock *BB : TheLoop->blocks()) {
+    for (Instruction &I : *BB) {
+      if (I.isTerminator() || isa<PHINode>(I))
+        continue;
+
+      // Loads beyond the early exit must not fault, which is known when they
+      // are dereferenceable for the number of iterations of the latch. The
+      // VF may round that up further, see canSpeculateEarlyExitLoads.
+      if (auto *LI = dyn_cast<LoadInst>(&I)) {
+        if (LI->isSimple() && !mustSuppressSpeculation(*LI) &&
+            isDereferenceableAndAlignedInLoop(LI, TheLoop, SE, *DT,
+                                              EarlyExitMaxTripCount)) {
+          EarlyExitLoads.push_back(LI);
+          continue;
+        }
+        reportVectorizationFailure(
+            "Early exit loop with a load that may fault",
+            "loop with an early exit reads memory that may not be "
+            "dereferenceable",
+            "EarlyExitUnsafeLoad", ORE, TheLoop, &I);
+        return false;
+      }
+
+      if (I.mayWriteToMemory() || I.mayThrow() ||
+          !isSafeToSpeculativelyExecute(&I)) {
+        reportVectorizationFailure(
+            "Early exit loop with side effects",
+            "loop with an early exit has an instruction that cannot be "
+            "speculated",
+            "EarlyExitSideEffects", ORE, TheLoop, &I);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool LoopVectorizationLegality::canSpeculateEarlyExitLoads(
+    unsigned VF) const {
+  assert(hasEarlyExit() && "Expected a loop with an early exit");
+  unsigned TripCount = alignTo(EarlyExitMaxTripCount, VF);
+  return all_of(EarlyExitLoads, [&](LoadInst *LI) {
+    return isDereferenceableAndAlignedInLoop(LI, TheLoop, *PSE.getSE(), *DT,
+                                             TripCount);
+  });
+}
+
 // Helper function to canVectorizeLoopNestCFG.
 bool LoopVectorizationLegality::canVectorizeLoopCFG(Loop *Lp,
                                                     bool UseVPlanNativePath) {
@@ -1091,8 +1217,13 @@ bool LoopVectorizationLegality::canVectorizeLoopCFG(Loop *Lp,
       return false;
   }
 
-  // We must have a single exiting block.
-  if (!Lp->getExitingBlock()) {
+  // We must have a single exiting block, apart from a data-dependent early
+  // exit of an innermost loop, which the vector loop checks for but leaves to
+  // the scalar loop to take.
+  BasicBlock *ExitingBlock = Lp->getExitingBlock();
+  if (!ExitingBlock && Lp == TheLoop && findEarlyExit())
+    ExitingBlock = Lp->getLoopLatch();
+  if (!ExitingBlock) {
     reportVectorizationFailure("The loop must have an exiting block",
         "loop control flow is not understood by vectorizer",
         "CFGNotUnderstood", ORE, TheLoop);
@@ -1105,7 +1236,7 @@ bool LoopVectorizationLegality::canVectorizeLoopCFG(Loop *Lp,
   // We only handle bottom-tested loops, i.e. loop in which the condition is
   // checked at the end of each iteration. With that we can assume that all
   // instructions in the loop are executed the same number of times.
-  if (Lp->getExitingBlock() != Lp->getLoopLatch()) {
+  if (ExitingBlock != Lp->getLoopLatch()) {
     reportVectorizationFailure("The exiting block is not the loop latch",
         "loop control flow is not understood by vectorizer",
         "CFGNotUnderstood", ORE, TheLoop);
@@ -1202,6 +1333,15 @@ bool LoopVectorizationLegality::canVectorize(bool UseVPlanNativePath) {
       return false;
   }
 
+  // Check that the vector loop can safely run past the early exit.
+  if (hasEarlyExit() && !canVectorizeEarlyExit()) {
+    LLVM_DEBUG(dbgs() << "LV: Can't vectorize the early exit\n");
+    if (DoExtraAnalysis)
+      Result = false;
+    else
+      return false;
+  }
+
   // Go over each instruction and look at memory deps.
   if (!canVectorizeMemory()) {
     LLVM_DEBUG(dbgs() << "LV: Can't vectorize due to memory conflicts\n");
@@ -1242,6 +1382,13 @@ bool LoopVectorizationLegality::prepareToFoldTailByMasking() {
 
   LLVM_DEBUG(dbgs() << "LV: checking if tail can be folded by masking.\n");
 
+  // The scalar loop takes the early exit, so there must be one.
+  if (hasEarlyExit()) {
+    LLVM_DEBUG(dbgs() << "LV: Cannot fold tail by masking, loop has an early "
+                         "exit.\n");
+    return false;
+  }
+
   SmallPtrSet<const Value *, 8> ReductionLiveOuts;
 
   for (auto &Reduction : getReductionVars())
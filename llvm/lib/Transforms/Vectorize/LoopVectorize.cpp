@@ -596,6 +596,11 @@ protected:
   /// Clear NSW/NUW flags from reduction instructions if necessary.
   void clearReductionWrapFlags(RecurrenceDescriptor &RdxDesc);
 
+  /// Branch from the vector loop to the scalar loop once any lane of an
+  /// iteration takes the early exit, resuming the inductions at the first
+  /// such lane.
+  void fixEarlyExit();
+
   /// The Loop exit block may have single value PHI nodes with some
   /// incoming value. While vectorizing we only handled real values
   /// that were defined inside the loop and we should have one value for
@@ -2717,7 +2722,12 @@ Value *InnerLoopVectorizer::getOrCreateTripCount(Loop *L) {
   IRBuilder<> Builder(L->getLoopPreheader()->getTerminator());
   // Find the loop boundaries.
   ScalarEvolution *SE = PSE.getSE();
-  const SCEV *BackedgeTakenCount = PSE.getBackedgeTakenCount();
+  // The vector loop of a loop with an early exit runs for the iterations
+  // bounded by the latch; the early exit is resolved by the scalar loop.
+  const SCEV *BackedgeTakenCount =
+      Legal->hasEarlyExit()
+          ? SE->getExitCount(OrigLoop, OrigLoop->getLoopLatch())
+          : PSE.getBackedgeTakenCount();
   assert(BackedgeTakenCount != SE->getCouldNotCompute() &&
          "Invalid loop count");
 
@@ -3089,7 +3099,14 @@ Value *InnerLoopVectorizer::emitTransformedIndex(
 Loop *InnerLoopVectorizer::createVectorLoopSkeleton(StringRef Prefix) {
   LoopScalarBody = OrigLoop->getHeader();
   LoopVectorPreHeader = OrigLoop->getLoopPreheader();
-  LoopExitBlock = OrigLoop->getExitBlock();
+  // The middle block continues to the exit of the latch. The early exit, if
+  // any, is only taken from the scalar loop.
+  if (Legal->hasEarlyExit()) {
+    auto *LatchBr = cast<BranchInst>(OrigLoop->getLoopLatch()->getTerminator());
+    LoopExitBlock = LatchBr->getSuccessor(
+        OrigLoop->contains(LatchBr->getSuccessor(0)) ? 1 : 0);
+  } else
+    LoopExitBlock = OrigLoop->getExitBlock();
   assert(LoopExitBlock && "Must have an exit block");
   assert(LoopVectorPreHeader && "Invalid loop structure");
 
@@ -3341,19 +3358,24 @@ void InnerLoopVectorizer::fixupIVUsers(PHINode *OrigPhi,
   // value (the value that feeds into the phi from the loop latch).
   // We allow both, but they, obviously, have different values.
 
-  assert(OrigLoop->getExitBlock() && "Expected a single exit block");
+  // The middle block only reaches the exit of the latch. Users after an early
+  // exit only see the values of the scalar loop.
+  BasicBlock *Latch = OrigLoop->getLoopLatch();
+  auto IsLatchExitUser = [&](Instruction *UI, Value *V) {
+    assert(isa<PHINode>(UI) && "Expected LCSSA form");
+    return UI->getParent() == LoopExitBlock &&
+           cast<PHINode>(UI)->getIncomingValueForBlock(Latch) == V;
+  };
 
   DenseMap<Value *, Value *> MissingVals;
 
   // An external user of the last iteration's value should see the value that
   // the remainder loop uses to initialize its own IV.
-  Value *PostInc = OrigPhi->getIncomingValueForBlock(OrigLoop->getLoopLatch());
+  Value *PostInc = OrigPhi->getIncomingValueForBlock(Latch);
   for (User *U : PostInc->users()) {
     Instruction *UI = cast<Instruction>(U);
-    if (!OrigLoop->contains(UI)) {
-      assert(isa<PHINode>(UI) && "Expected LCSSA form");
+    if (!OrigLoop->contains(UI) && IsLatchExitUser(UI, PostInc))
       MissingVals[UI] = EndValue;
-    }
   }
 
   // An external user of the penultimate value need to see EndValue - Step.
@@ -3361,10 +3383,9 @@ void InnerLoopVectorizer::fixupIVUsers(PHINode *OrigPhi,
   // that is Start + (Step * (CRD - 1)).
   for (User *U : OrigPhi->users()) {
     auto *UI = cast<Instruction>(U);
-    if (!OrigLoop->contains(UI)) {
+    if (!OrigLoop->contains(UI) && IsLatchExitUser(UI, OrigPhi)) {
       const DataLayout &DL =
           OrigLoop->getHeader()->getModule()->getDataLayout();
-      assert(isa<PHINode>(UI) && "Expected LCSSA form");
 
       IRBuilder<> B(MiddleBlock->getTerminator());
       Value *CountMinusOne = B.CreateSub(
@@ -3671,6 +3692,11 @@ void InnerLoopVectorizer::fixVectorizedLoop() {
   // This is the second stage of vectorizing recurrences.
   fixCrossIterationPHIs();
 
+  // Leave the vector loop for the scalar loop once a lane takes the early
+  // exit.
+  if (Legal->hasEarlyExit())
+    fixEarlyExit();
+
   // Forget the original basic block.
   PSE.getSE()->forgetLoop(OrigLoop);
 
@@ -4158,11 +4184,80 @@ void InnerLoopVectorizer::clearReductionWrapFlags(
   }
 }
 
+void InnerLoopVectorizer::fixEarlyExit() {
+  assert(UF == 1 && VF.isVector() && !VF.isScalable() &&
+         "Early exit loops are vectorized with fixed VF and UF 1");
+  auto *ExitBr =
+      cast<BranchInst>(Legal->getEarlyExitingBlock()->getTerminator());
+  Loop *VectorLoop = LI->getLoopFor(LoopVectorBody);
+  BasicBlock *VectorLatch = VectorLoop->getLoopLatch();
+
+  // Compute the lanes that take the early exit, and whether there are any, at
+  // the end of the vector iteration.
+  Builder.SetInsertPoint(VectorLatch->getTerminator());
+  Value *ExitMask = getOrCreateVectorValue(ExitBr->getCondition(), 0);
+  if (OrigLoop->contains(ExitBr->getSuccessor(0)))
+    ExitMask = Builder.CreateNot(ExitMask, "early.exit.mask");
+  Value *AnyExit = Builder.CreateOrReduce(ExitMask);
+
+  BasicBlock *VectorLatchCont =
+      SplitBlock(VectorLatch, VectorLatch->getTerminator(), DT, LI, nullptr,
+                 "vector.body.continue");
+  BasicBlock *EarlyExitBlock =
+      BasicBlock::Create(VectorLatch->getContext(), "vector.early.exit",
+                         VectorLatch->getParent(), LoopScalarPreHeader);
+  ReplaceInstWithInst(
+      VectorLatch->getTerminator(),
+      BranchInst::Create(EarlyExitBlock, VectorLatchCont, AnyExit));
+  if (Loop *ParentLoop = OrigLoop->getParentLoop())
+    ParentLoop->addBasicBlockToLoop(EarlyExitBlock, *LI);
+  DT->addNewBlock(EarlyExitBlock, VectorLatch);
+  DT->changeImmediateDominator(
+      LoopScalarPreHeader,
+      DT->findNearestCommonDominator(
+          DT->getNode(LoopScalarPreHeader)->getIDom()->getBlock(),
+          EarlyExitBlock));
+
+  // The scalar loop restarts at the first lane that takes the early exit, and
+  // takes it itself.
+  Builder.SetInsertPoint(EarlyExitBlock);
+  unsigned NumLanes = VF.getKnownMinValue();
+  Value *Lane = Builder.CreateIntrinsic(
+      Intrinsic::cttz, {Builder.getIntNTy(NumLanes)},
+      {Builder.CreateBitCast(ExitMask, Builder.getIntNTy(NumLanes)),
+       Builder.getTrue()});
+  Value *ExitIndex = Builder.CreateAdd(
+      Induction, Builder.CreateZExtOrTrunc(Lane, Induction->getType()),
+      "early.exit.index");
+
+  const DataLayout &DL = LoopScalarBody->getModule()->getDataLayout();
+  for (auto &InductionEntry : Legal->getInductionVars()) {
+    PHINode *OrigPhi = InductionEntry.first;
+    const InductionDescriptor &II = InductionEntry.second;
+    auto *BCResumeVal =
+        cast<PHINode>(OrigPhi->getIncomingValueForBlock(LoopScalarPreHeader));
+    Value *ResumeVal = ExitIndex;
+    if (OrigPhi != OldInduction) {
+      Type *StepType = II.getStep()->getType();
+      Instruction::CastOps CastOp =
+          CastInst::getCastOpcode(ExitIndex, true, StepType, true);
+      Value *Index = Builder.CreateCast(CastOp, ExitIndex, StepType);
+      ResumeVal = emitTransformedIndex(Builder, Index, PSE.getSE(), DL, II);
+    }
+    BCResumeVal->addIncoming(ResumeVal, EarlyExitBlock);
+  }
+  Builder.CreateBr(LoopScalarPreHeader);
+}
+
 void InnerLoopVectorizer::fixLCSSAPHIs() {
   assert(!VF.isScalable() && "the code below assumes fixed width vectors");
   for (PHINode &LCSSAPhi : LoopExitBlock->phis()) {
-    if (LCSSAPhi.getNumIncomingValues() == 1) {
-      auto *IncomingValue = LCSSAPhi.getIncomingValue(0);
+    // Inductions and reductions have already been given their value from the
+    // middle block. An early exit sharing the exit block adds a second
+    // incoming value, which is only reached from the scalar loop.
+    if (LCSSAPhi.getBasicBlockIndex(LoopMiddleBlock) == -1) {
+      auto *IncomingValue =
+          LCSSAPhi.getIncomingValueForBlock(OrigLoop->getLoopLatch());
       // Non-instruction incoming values will have only one value.
       unsigned LastLane = 0;
       if (isa<Instruction>(IncomingValue))
@@ -5226,6 +5321,16 @@ Optional<unsigned> LoopVectorizationCostModel::computeMaxVF(unsigned UserVF,
     return None;
   }
 
+  if (Legal->hasEarlyExit() && UserVF &&
+      !Legal->canSpeculateEarlyExitLoads(UserVF)) {
+    reportVectorizationFailure(
+        "Early exit loop reads past dereferenceable memory with the user VF",
+        "loop with an early exit would read memory that may not be "
+        "dereferenceable with the requested vectorization factor",
+        "EarlyExitUnsafeUserVF", ORE, TheLoop);
+    return None;
+  }
+
   switch (ScalarEpilogueStatus) {
   case CM_ScalarEpilogueAllowed:
     return UserVF ? UserVF : computeFeasibleMaxVF(TC);
@@ -5331,6 +5436,14 @@ LoopVectorizationCostModel::computeFeasibleMaxVF(unsigned ConstTripCount) {
   // Note that both WidestRegister and WidestType may not be a powers of 2.
   unsigned MaxVectorSize = PowerOf2Floor(WidestRegister / WidestType);
 
+  // The vector loop of a loop with an early exit reads whole vectors up to
+  // the trip count of the latch, which must stay dereferenceable.
+  auto IsSafeEarlyExitVF = [&](unsigned VF) {
+    return !Legal->hasEarlyExit() || Legal->canSpeculateEarlyExitLoads(VF);
+  };
+  while (MaxVectorSize > 1 && !IsSafeEarlyExitVF(MaxVectorSize))
+    MaxVectorSize /= 2;
+
   LLVM_DEBUG(dbgs() << "LV: The Smallest and Widest types: " << SmallestType
                     << " / " << WidestType << " bits.\n");
   LLVM_DEBUG(dbgs() << "LV: The Widest register safe to use is: "
@@ -5359,7 +5472,8 @@ LoopVectorizationCostModel::computeFeasibleMaxVF(unsigned ConstTripCount) {
     // (i.e. MaxVectorSize).
     SmallVector<ElementCount, 8> VFs;
     unsigned NewMaxVectorSize = WidestRegister / SmallestType;
-    for (unsigned VS = MaxVectorSize * 2; VS <= NewMaxVectorSize; VS *= 2)
+    for (unsigned VS = MaxVectorSize * 2;
+         VS <= NewMaxVectorSize && IsSafeEarlyExitVF(VS); VS *= 2)
       VFs.push_back(ElementCount::getFixed(VS));
 
     // For each VF calculate its register usage.
@@ -5380,7 +5494,7 @@ LoopVectorizationCostModel::computeFeasibleMaxVF(unsigned ConstTripCount) {
       }
     }
     if (unsigned MinVF = TTI.getMinimumVF(SmallestType)) {
-      if (MaxVF < MinVF) {
+      if (MaxVF < MinVF && IsSafeEarlyExitVF(MinVF)) {
         LLVM_DEBUG(dbgs() << "LV: Overriding calculated MaxVF(" << MaxVF
                           << ") with target's minimum: " << MinVF << '\n');
         MaxVF = MinVF;
@@ -5517,6 +5631,10 @@ unsigned LoopVectorizationCostModel::selectInterleaveCount(ElementCount VF,
   if (!isScalarEpilogueAllowed())
     return 1;
 
+  // The early exit is checked on a single vector per iteration.
+  if (Legal->hasEarlyExit())
+    return 1;
+
   // We used the distance for the interleave count.
   if (Legal->getMaxSafeDepDistBytes() != -1U)
     return 1;
@@ -6571,7 +6689,17 @@ unsigned LoopVectorizationCostModel::getInstructionCost(Instruction *I,
     } else if (I->getParent() == TheLoop->getLoopLatch() || VF.isScalar())
       // The back-edge branch will remain, as will all scalar branches.
       return TTI.getCFInstrCost(Instruction::Br, CostKind);
-    else
+    else if (I->getParent() == Legal->getEarlyExitingBlock()) {
+      // The early exit is checked once per vector iteration, by reducing the
+      // exit condition of all lanes.
+      assert(!VF.isScalable() && "scalable vectors not yet supported.");
+      auto *Vec_i1Ty =
+          VectorType::get(IntegerType::getInt1Ty(RetTy->getContext()), VF);
+      return TTI.getCFInstrCost(Instruction::Br, CostKind) +
+             TTI.getArithmeticReductionCost(Instruction::Or, Vec_i1Ty,
+                                            /*IsPairwiseForm=*/false,
+                                            CostKind);
+    } else
       // This branch will be eliminated by if-conversion.
       return 0;
     // Note: We currently assume zero cost for an unconditional branch inside
@@ -8353,8 +8481,10 @@ bool LoopVectorizePass::processLoop(Loop *L) {
   if (EnableInterleavedMemAccesses.getNumOccurrences() > 0)
     UseInterleaved = EnableInterleavedMemAccesses;
 
-  // Analyze interleaved memory accesses.
-  if (UseInterleaved) {
+  // Analyze interleaved memory accesses. The wide loads of an interleave group
+  // may read past the accesses known to be dereferenceable in an early exit
+  // loop.
+  if (UseInterleaved && !LVL.hasEarlyExit()) {
     IAI.analyzeInterleaving(useMaskedInterleavedAccesses(*TTI));
   }
 
@@ -8431,6 +8561,16 @@ bool LoopVectorizePass::processLoop(Loop *L) {
         "the cost-model indicates that interleaving is beneficial "
         "but is explicitly disabled or interleave count is set to 1");
     InterleaveLoop = false;
+  } else if (UserIC > 1 && LVL.hasEarlyExit()) {
+    // The early exit is only checked on a single vector per iteration.
+    LLVM_DEBUG(dbgs() << "LV: Ignoring UserIC, because the loop has an early "
+                         "exit.\n");
+    IntDiagMsg = std::make_pair(
+        "InterleavingEarlyExit",
+        "Ignoring UserIC, because loops with an early exit are not "
+        "interleaved");
+    InterleaveLoop = false;
+    UserIC = 1;
   }
 
   // Override IC if user provided an interleave count.
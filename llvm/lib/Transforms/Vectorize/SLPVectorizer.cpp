@@ -35,6 +35,7 @@
 #include "llvm/Analysis/CodeMetrics.h"
 #include "llvm/Analysis/DemandedBits.h"
 #include "llvm/Analysis/GlobalsModRef.h"
+#include "llvm/Analysis/Loads.h"
 #include "llvm/Analysis/LoopAccessAnalysis.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/MemoryLocation.h"
@@ -168,6 +169,21 @@ static cl::opt<bool>
     ViewSLPTree("view-slp-tree", cl::Hidden,
                 cl::desc("Display the SLP trees with Graphviz"));
 
+static cl::opt<bool> VectorizeNonPowerOf2(
+    "slp-vectorize-non-power-of-2", cl::init(false), cl::Hidden,
+    cl::desc("Try to vectorize bundles whose width is not a power of two, "
+             "padding their loads and stores to the next power of two"));
+
+/// \returns true if a bundle of \p VF lanes, which is not a power of two, may
+/// be padded to the next power of two. That is if it is one lane short of it,
+/// like the x, y and z of a point, or a quarter short of it, like two points.
+static bool isPaddableWidth(unsigned VF) {
+  if (!VectorizeNonPowerOf2 || VF < 3 || isPowerOf2_32(VF))
+    return false;
+  unsigned PaddedVF = PowerOf2Ceil(VF);
+  return VF == PaddedVF - 1 || VF == PaddedVF - PaddedVF / 4;
+}
+
 // Limit the number of alias checks. The limit is chosen so that
 // it has no negative effect on the llvm benchmarks.
 static const unsigned AliasedCheckLimit = 10;
@@ -1485,6 +1501,16 @@ private:
   /// \returns the cost of the vectorizable entry.
   int getEntryCost(TreeEntry *E);
 
+  /// Choose how the vectorized loads or stores of \p E are padded, if its
+  /// width is not a power of two. \p Front is the access to the lowest
+  /// address of the bundle.
+  void setMemoryPadding(TreeEntry *E, Instruction *Front);
+
+  /// \returns the cost of the vector load or store of \p E, padded as chosen
+  /// by setMemoryPadding. \p Front is the access to the lowest address of the
+  /// bundle.
+  int getVectorMemoryOpCost(const TreeEntry *E, Instruction *Front) const;
+
   /// This is the recursive part of buildTree.
   void buildTree_rec(ArrayRef<Value *> Roots, unsigned Depth,
                      const EdgeInfo &EI);
@@ -1562,6 +1588,13 @@ private:
     /// Does this entry require reordering?
     SmallVector<unsigned, 4> ReorderIndices;
 
+    /// How a vectorized bundle of loads or stores whose width is not a power
+    /// of two is widened to the next power of two: not at all, by loading the
+    /// padding lanes when they are known to be dereferenceable, or by masking
+    /// them off.
+    enum PaddingKind { NoPadding, PadDereferenceable, PadMasked };
+    PaddingKind Padding = NoPadding;
+
     /// Points back to the VectorizableTree.
     ///
     /// Only used for Graphviz right now.  Unfortunately GraphTrait::NodeRef has
@@ -1731,6 +1764,18 @@ private:
       for (unsigned ReorderIdx : ReorderIndices)
         dbgs() << ReorderIdx << ", ";
       dbgs() << "\n";
+      dbgs() << "Padding: ";
+      switch (Padding) {
+      case NoPadding:
+        dbgs() << "None\n";
+        break;
+      case PadDereferenceable:
+        dbgs() << "Dereferenceable\n";
+        break;
+      case PadMasked:
+        dbgs() << "Masked\n";
+        break;
+      }
       dbgs() << "UserTreeIndices: ";
       for (const auto &EInfo : UserTreeIndices)
         dbgs() << EInfo << ", ";
@@ -2828,6 +2873,7 @@ void BoUpSLP::buildTree_rec(ArrayRef<Value *> VL, unsigned Depth,
             TreeEntry *TE = newTreeEntry(VL, Bundle /*vectorized*/, S,
                                          UserTreeIdx, ReuseShuffleIndicies);
             TE->setOperandsInOrder();
+            setMemoryPadding(TE, VL0);
             LLVM_DEBUG(dbgs() << "SLP: added a vector of loads.\n");
           } else {
             // Need to reorder.
@@ -2835,6 +2881,7 @@ void BoUpSLP::buildTree_rec(ArrayRef<Value *> VL, unsigned Depth,
                 newTreeEntry(VL, Bundle /*vectorized*/, S, UserTreeIdx,
                              ReuseShuffleIndicies, CurrentOrder);
             TE->setOperandsInOrder();
+            setMemoryPadding(TE, cast<Instruction>(VL[CurrentOrder.front()]));
             LLVM_DEBUG(dbgs() << "SLP: added a vector of jumbled loads.\n");
             findRootOrder(CurrentOrder);
             ++NumOpsWantToKeepOrder[CurrentOrder];
@@ -3090,6 +3137,7 @@ void BoUpSLP::buildTree_rec(ArrayRef<Value *> VL, unsigned Depth,
             TreeEntry *TE = newTreeEntry(VL, Bundle /*vectorized*/, S,
                                          UserTreeIdx, ReuseShuffleIndicies);
             TE->setOperandsInOrder();
+            setMemoryPadding(TE, VL0);
             buildTree_rec(Operands, Depth + 1, {TE, 0});
             LLVM_DEBUG(dbgs() << "SLP: added a vector of stores.\n");
           } else {
@@ -3097,6 +3145,7 @@ void BoUpSLP::buildTree_rec(ArrayRef<Value *> VL, unsigned Depth,
                 newTreeEntry(VL, Bundle /*vectorized*/, S, UserTreeIdx,
                              ReuseShuffleIndicies, CurrentOrder);
             TE->setOperandsInOrder();
+            setMemoryPadding(TE, cast<Instruction>(VL[CurrentOrder.front()]));
             buildTree_rec(Operands, Depth + 1, {TE, 0});
             LLVM_DEBUG(dbgs() << "SLP: added a vector of jumbled stores.\n");
             findRootOrder(CurrentOrder);
@@ -3648,9 +3697,7 @@ int BoUpSLP::getEntryCost(TreeEntry *E) {
         ReuseShuffleCost -= (ReuseShuffleNumbers - VL.size()) * ScalarEltCost;
       }
       int ScalarLdCost = VecTy->getNumElements() * ScalarEltCost;
-      int VecLdCost =
-          TTI->getMemoryOpCost(Instruction::Load, VecTy, alignment, 0,
-                               CostKind, VL0);
+      int VecLdCost = getVectorMemoryOpCost(E, VL0);
       if (!E->ReorderIndices.empty()) {
         // TODO: Merge this shuffle with the ReuseShuffleCost.
         VecLdCost += TTI->getShuffleCost(
@@ -3670,8 +3717,7 @@ int BoUpSLP::getEntryCost(TreeEntry *E) {
       if (NeedToShuffleReuses)
         ReuseShuffleCost = -(ReuseShuffleNumbers - VL.size()) * ScalarEltCost;
       int ScalarStCost = VecTy->getNumElements() * ScalarEltCost;
-      int VecStCost = TTI->getMemoryOpCost(Instruction::Store,
-                                           VecTy, Alignment, 0, CostKind, VL0);
+      int VecStCost = getVectorMemoryOpCost(E, SI);
       if (IsReorder) {
         // TODO: Merge this shuffle with the ReuseShuffleCost.
         VecStCost += TTI->getShuffleCost(
@@ -4020,6 +4066,83 @@ int BoUpSLP::getTreeCost() {
   return Cost;
 }
 
+/// \returns a mask of \p PaddedVF lanes that enables the first \p VF.
+static Constant *createPaddingMask(IRBuilderBase &Builder, unsigned VF,
+                                   unsigned PaddedVF) {
+  SmallVector<Constant *, 16> Mask(VF, Builder.getTrue());
+  Mask.resize(PaddedVF, Builder.getFalse());
+  return ConstantVector::get(Mask);
+}
+
+/// \returns the type of the value loaded or stored by \p I.
+static Type *getLoadStoreValueType(Instruction *I) {
+  if (auto *SI = dyn_cast<StoreInst>(I))
+    return SI->getValueOperand()->getType();
+  return I->getType();
+}
+
+void BoUpSLP::setMemoryPadding(TreeEntry *E, Instruction *Front) {
+  unsigned VF = E->Scalars.size();
+  if (!VectorizeNonPowerOf2 || isPowerOf2_32(VF))
+    return;
+
+  // Pick the cheapest of accessing the odd-sized vector as is, which the
+  // backend splits into power of two pieces, and of padding it.
+  int BestCost = getVectorMemoryOpCost(E, Front);
+  auto TryPadding = [&](TreeEntry::PaddingKind Padding) {
+    TreeEntry::PaddingKind Prev = E->Padding;
+    E->Padding = Padding;
+    int Cost = getVectorMemoryOpCost(E, Front);
+    if (Cost < BestCost)
+      BestCost = Cost;
+    else
+      E->Padding = Prev;
+  };
+
+  auto *PaddedTy =
+      FixedVectorType::get(getLoadStoreValueType(Front), PowerOf2Ceil(VF));
+  Value *Ptr = getLoadStorePointerOperand(Front);
+  Align Alignment = getLoadStoreAlignment(Front);
+  if (isa<LoadInst>(Front)) {
+    // The padding lanes may be loaded if they are known to be dereferenceable,
+    // e.g. when the bundle reads the x, y and z of a 4-element array.
+    if (isDereferenceableAndAlignedPointer(Ptr, PaddedTy, Align(1), *DL, Front,
+                                           DT))
+      TryPadding(TreeEntry::PadDereferenceable);
+    if (TTI->isLegalMaskedLoad(PaddedTy, Alignment))
+      TryPadding(TreeEntry::PadMasked);
+  } else if (TTI->isLegalMaskedStore(PaddedTy, Alignment)) {
+    TryPadding(TreeEntry::PadMasked);
+  }
+}
+
+int BoUpSLP::getVectorMemoryOpCost(const TreeEntry *E,
+                                   Instruction *Front) const {
+  TargetTransformInfo::TargetCostKind CostKind =
+      TargetTransformInfo::TCK_RecipThroughput;
+  unsigned VF = E->Scalars.size();
+  Type *ScalarTy = getLoadStoreValueType(Front);
+  unsigned Opcode = Front->getOpcode();
+  Align Alignment = getLoadStoreAlignment(Front);
+  unsigned AS = getLoadStoreAddressSpace(Front);
+  switch (E->Padding) {
+  case TreeEntry::NoPadding:
+    return TTI->getMemoryOpCost(Opcode, FixedVectorType::get(ScalarTy, VF),
+                                Alignment, AS, CostKind, Front);
+  case TreeEntry::PadDereferenceable:
+    // Dropping the padding lanes of the loaded vector is free once the type
+    // is legalized.
+    return TTI->getMemoryOpCost(
+        Opcode, FixedVectorType::get(ScalarTy, PowerOf2Ceil(VF)), Alignment,
+        AS, CostKind, Front);
+  case TreeEntry::PadMasked:
+    return TTI->getMaskedMemoryOpCost(
+        Opcode, FixedVectorType::get(ScalarTy, PowerOf2Ceil(VF)), Alignment,
+        AS, CostKind);
+  }
+  llvm_unreachable("unknown padding kind");
+}
+
 int BoUpSLP::getGatherCost(FixedVectorType *Ty,
                            const DenseSet<unsigned> &ShuffledIndices) const {
   unsigned NumElts = Ty->getNumElements();
@@ -4473,8 +4596,12 @@ Value *BoUpSLP::vectorizeTree(TreeEntry *E) {
       LoadInst *LI = cast<LoadInst>(VL0);
       unsigned AS = LI->getPointerAddressSpace();
 
+      FixedVectorType *LoadTy = VecTy;
+      if (E->Padding != TreeEntry::NoPadding)
+        LoadTy = FixedVectorType::get(VecTy->getElementType(),
+                                      PowerOf2Ceil(VecTy->getNumElements()));
       Value *VecPtr = Builder.CreateBitCast(LI->getPointerOperand(),
-                                            VecTy->getPointerTo(AS));
+                                            LoadTy->getPointerTo(AS));
 
       // The pointer operand uses an in-tree scalar so we add the new BitCast to
       // ExternalUses list to make sure that an extract will be generated in the
@@ -4483,12 +4610,23 @@ Value *BoUpSLP::vectorizeTree(TreeEntry *E) {
       if (getTreeEntry(PO))
         ExternalUses.push_back(ExternalUser(PO, cast<User>(VecPtr), 0));
 
-      LI = Builder.CreateAlignedLoad(VecTy, VecPtr, LI->getAlign());
-      Value *V = propagateMetadata(LI, E->Scalars);
+      Instruction *NewLI;
+      if (E->Padding == TreeEntry::PadMasked)
+        NewLI = Builder.CreateMaskedLoad(
+            VecPtr, LI->getAlign(),
+            createPaddingMask(Builder, VecTy->getNumElements(),
+                              LoadTy->getNumElements()));
+      else
+        NewLI = Builder.CreateAlignedLoad(LoadTy, VecPtr, LI->getAlign());
+      Value *V = propagateMetadata(NewLI, E->Scalars);
       if (IsReorder) {
         SmallVector<int, 4> Mask;
         inversePermutation(E->ReorderIndices, Mask);
         V = Builder.CreateShuffleVector(V, Mask, "reorder_shuffle");
+      } else if (LoadTy != VecTy) {
+        // Drop the padding lanes.
+        V = Builder.CreateShuffleVector(
+            V, createSequentialMask(0, VecTy->getNumElements(), 0), "unpad");
       }
       if (NeedToShuffleReuses) {
         // TODO: Merge this shuffle with the ReorderShuffleMask.
@@ -4510,13 +4648,29 @@ Value *BoUpSLP::vectorizeTree(TreeEntry *E) {
       if (IsReorder) {
         SmallVector<int, 4> Mask(E->ReorderIndices.begin(),
                                  E->ReorderIndices.end());
+        // The padding lanes are masked off, so leave them undefined.
+        if (E->Padding != TreeEntry::NoPadding)
+          Mask.resize(PowerOf2Ceil(Mask.size()), UndefMaskElem);
         VecValue = Builder.CreateShuffleVector(VecValue, Mask, "reorder_shuf");
+      } else if (E->Padding != TreeEntry::NoPadding) {
+        VecValue = Builder.CreateShuffleVector(
+            VecValue,
+            createSequentialMask(0, VecTy->getNumElements(),
+                                 PowerOf2Ceil(VecTy->getNumElements()) -
+                                     VecTy->getNumElements()),
+            "pad");
       }
       Value *ScalarPtr = SI->getPointerOperand();
       Value *VecPtr = Builder.CreateBitCast(
           ScalarPtr, VecValue->getType()->getPointerTo(AS));
-      StoreInst *ST = Builder.CreateAlignedStore(VecValue, VecPtr,
-                                                 SI->getAlign());
+      Instruction *ST;
+      if (E->Padding == TreeEntry::PadMasked)
+        ST = Builder.CreateMaskedStore(
+            VecValue, VecPtr, SI->getAlign(),
+            createPaddingMask(Builder, VecTy->getNumElements(),
+                              PowerOf2Ceil(VecTy->getNumElements())));
+      else
+        ST = Builder.CreateAlignedStore(VecValue, VecPtr, SI->getAlign());
 
       // The pointer operand uses an in-tree scalar, so add the new BitCast to
       // ExternalUses to make sure that an extract will be generated in the
@@ -5829,7 +5983,11 @@ bool SLPVectorizerPass::vectorizeStoreChain(ArrayRef<Value *> Chain, BoUpSLP &R,
   const unsigned MinVF = R.getMinVecRegSize() / Sz;
   unsigned VF = Chain.size();
 
-  if (!isPowerOf2_32(Sz) || !isPowerOf2_32(VF) || VF < 2 || VF < MinVF)
+  // A chain whose length isn't a power of two is padded to the next one, so
+  // it is the padded vector that has to fill a register.
+  unsigned PaddedVF = VectorizeNonPowerOf2 ? PowerOf2Ceil(VF) : VF;
+  if (!isPowerOf2_32(Sz) || !isPowerOf2_32(PaddedVF) || VF < 2 ||
+      PaddedVF < MinVF)
     return false;
 
   LLVM_DEBUG(dbgs() << "SLP: Analyzing " << VF << " stores at offset " << Idx
@@ -5934,10 +6092,22 @@ bool SLPVectorizerPass::vectorizeStores(ArrayRef<StoreInst *> Stores,
       continue;
 
     unsigned MaxElts = MaxVecRegSize / EltSize;
+    // Try the power of two sizes, and if enabled, the sizes that are padded
+    // to them: one less, e.g. 3 for the x, y and z of a point, and a quarter
+    // less, e.g. 6 for two points. The latter also pick up the tail of a
+    // chain that is left once its power of two slices are vectorized.
     // FIXME: Is division-by-2 the correct step? Should we assert that the
     // register size is a power-of-2?
-    unsigned StartIdx = 0;
+    SmallVector<unsigned, 8> Sizes;
     for (unsigned Size = llvm::PowerOf2Ceil(MaxElts); Size >= 2; Size /= 2) {
+      Sizes.push_back(Size);
+      if (isPaddableWidth(Size - 1))
+        Sizes.push_back(Size - 1);
+      if (Size >= 8 && isPaddableWidth(Size - Size / 4))
+        Sizes.push_back(Size - Size / 4);
+    }
+    unsigned StartIdx = 0;
+    for (unsigned Size : Sizes) {
       for (unsigned Cnt = StartIdx, E = Operands.size(); Cnt + Size <= E;) {
         ArrayRef<Value *> Slice = makeArrayRef(Operands).slice(Cnt, Size);
         if (!VectorizedStores.count(Slice.front()) &&
@@ -6043,7 +6213,11 @@ bool SLPVectorizerPass::tryToVectorizeList(ArrayRef<Value *> VL, BoUpSLP &R,
 
   unsigned Sz = R.getVectorElementSize(I0);
   unsigned MinVF = std::max(2U, R.getMinVecRegSize() / Sz);
-  unsigned MaxVF = std::max<unsigned>(PowerOf2Floor(VL.size()), MinVF);
+  // A list that may be padded is first tried as a whole, e.g. six values are
+  // tried at VF 6 before VF 4.
+  unsigned MaxVF = std::max<unsigned>(
+      isPaddableWidth(VL.size()) ? VL.size() : PowerOf2Floor(VL.size()),
+      MinVF);
   if (MaxVF < 2) {
     R.getORE()->emit([&]() {
       return OptimizationRemarkMissed(SV_NAME, "SmallVF", I0)
@@ -6065,7 +6239,8 @@ bool SLPVectorizerPass::tryToVectorizeList(ArrayRef<Value *> VL, BoUpSLP &R,
          "Each scalar expected to have an associated InsertElement user.");
 
   unsigned NextInst = 0, MaxInst = VL.size();
-  for (unsigned VF = MaxVF; NextInst + 1 < MaxInst && VF >= MinVF; VF /= 2) {
+  for (unsigned VF = MaxVF; NextInst + 1 < MaxInst && VF >= MinVF;
+       VF = isPowerOf2_32(VF) ? VF / 2 : PowerOf2Floor(VF)) {
     // No actual vectorization should happen, if number of parts is the same as
     // provided vectorization factor (i.e. the scalar type is used for vector
     // code during codegen).
@@ -6080,7 +6255,11 @@ bool SLPVectorizerPass::tryToVectorizeList(ArrayRef<Value *> VL, BoUpSLP &R,
       else
         OpsWidth = VF;
 
-      if (!isPowerOf2_32(OpsWidth) || OpsWidth < 2)
+      // The tail of the list may still be vectorized if it is padded to a
+      // power of two that fills a register.
+      bool CanPad =
+          isPaddableWidth(OpsWidth) && PowerOf2Ceil(OpsWidth) >= MinVF;
+      if ((!isPowerOf2_32(OpsWidth) && !CanPad) || OpsWidth < 2)
         break;
 
       ArrayRef<Value *> Ops = VL.slice(I, OpsWidth);
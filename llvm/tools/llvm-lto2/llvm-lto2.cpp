@@ -20,6 +20,7 @@
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/LTO/Caching.h"
 #include "llvm/LTO/LTO.h"
+#include "llvm/LTO/LTOBackend.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
@@ -75,6 +76,17 @@ static cl::opt<bool>
 // to use all hardware threads or cores in the system.
 static cl::opt<std::string> Threads("thinlto-threads");
 
+static cl::opt<bool>
+    ThinLTOOutOfProcess("thinlto-out-of-process", cl::init(false),
+                        cl::desc("Run the ThinLTO backend jobs in worker "
+                                 "processes, -thinlto-threads at a time"));
+
+static cl::opt<std::string> ThinLTOWorker(
+    "thinlto-worker",
+    cl::desc("Program to run the out-of-process ThinLTO backend jobs with "
+             "(default: llvm-lto2 thin-backend-worker)"),
+    cl::value_desc("program"));
+
 static cl::list<std::string> SymbolResolutions(
     "r",
     cl::desc("Specify a symbol resolution: filename,symbolname,resolution\n"
@@ -137,6 +149,17 @@ static cl::opt<bool>
              cl::desc("Run LTO passes using the new pass manager"),
              cl::init(false), cl::Hidden);
 
+static cl::opt<unsigned>
+    Partitions("lto-partitions",
+               cl::desc("Number of partitions of the regular LTO codegen"),
+               cl::init(1));
+
+static cl::opt<bool> SplitPreserveOrder(
+    "lto-split-preserve-order",
+    cl::desc("Give each regular LTO codegen partition a contiguous run of "
+             "functions, keeping the function order"),
+    cl::init(false));
+
 static cl::opt<bool>
     DebugPassManager("debug-pass-manager", cl::init(false), cl::Hidden,
                      cl::desc("Print pass management debugging information"));
@@ -176,10 +199,18 @@ template <typename T> static T check(ErrorOr<T> E, std::string Msg) {
 }
 
 static int usage() {
-  errs() << "Available subcommands: dump-symtab run\n";
+  errs() << "Available subcommands: dump-symtab run thin-backend-worker\n";
   return 1;
 }
 
+static void handleDiagnostic(const DiagnosticInfo &DI) {
+  DiagnosticPrinterRawOStream DP(errs());
+  DI.print(DP);
+  errs() << '\n';
+  if (DI.getSeverity() == DS_Error)
+    exit(1);
+}
+
 static int run(int argc, char **argv) {
   cl::ParseCommandLineOptions(argc, argv, "Resolution-based LTO test harness");
 
@@ -221,13 +252,7 @@ static int run(int argc, char **argv) {
   std::vector<std::unique_ptr<MemoryBuffer>> MBs;
 
   Config Conf;
-  Conf.DiagHandler = [](const DiagnosticInfo &DI) {
-    DiagnosticPrinterRawOStream DP(errs());
-    DI.print(DP);
-    errs() << '\n';
-    if (DI.getSeverity() == DS_Error)
-      exit(1);
-  };
+  Conf.DiagHandler = handleDiagnostic;
 
   Conf.CPU = codegen::getMCPU();
   Conf.Options = codegen::InitTargetOptionsFromCodeGenFlags();
@@ -237,6 +262,7 @@ static int run(int argc, char **argv) {
   Conf.CodeModel = codegen::getExplicitCodeModel();
 
   Conf.DebugPassManager = DebugPassManager;
+  Conf.SplitPreserveOrder = SplitPreserveOrder;
 
   if (SaveTemps)
     check(Conf.addSaveTemps(OutputFilename + "."),
@@ -294,10 +320,19 @@ static int run(int argc, char **argv) {
                                             /* ShouldEmitImportsFiles */ true,
                                             /* LinkedObjectsFile */ nullptr,
                                             /* OnWrite */ {});
-  else
+  else if (ThinLTOOutOfProcess) {
+    std::string Worker = ThinLTOWorker;
+    std::vector<std::string> WorkerArgs;
+    if (Worker.empty()) {
+      Worker = sys::fs::getMainExecutable(argv[0], (void *)&usage);
+      WorkerArgs.push_back("thin-backend-worker");
+    }
+    Backend = createOutOfProcessThinBackend(
+        llvm::heavyweight_hardware_concurrency(Threads), Worker, WorkerArgs);
+  } else
     Backend = createInProcessThinBackend(
         llvm::heavyweight_hardware_concurrency(Threads));
-  LTO Lto(std::move(Conf), std::move(Backend));
+  LTO Lto(std::move(Conf), std::move(Backend), Partitions);
 
   bool HasErrors = false;
   for (std::string F : InputFilenames) {
@@ -367,6 +402,33 @@ static int run(int argc, char **argv) {
   return 0;
 }
 
+// Runs a job written by the out-of-process ThinLTO backend. The job carries
+// the code generation settings, so most options of "run" have no effect here.
+static int thinBackendWorker(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "ThinLTO backend worker");
+  if (InputFilenames.size() != 1) {
+    errs() << "llvm-lto2: thin-backend-worker expects a single job file\n";
+    return 1;
+  }
+
+  Config Conf;
+  Conf.DiagHandler = handleDiagnostic;
+
+  std::unique_ptr<MemoryBuffer> Job =
+      check(MemoryBuffer::getFile(InputFilenames[0]), InputFilenames[0]);
+  auto AddStream =
+      [&](size_t Task) -> std::unique_ptr<lto::NativeObjectStream> {
+    std::error_code EC;
+    auto S =
+        std::make_unique<raw_fd_ostream>(OutputFilename, EC, sys::fs::OF_None);
+    check(EC, OutputFilename);
+    return std::make_unique<lto::NativeObjectStream>(std::move(S));
+  };
+  check(runThinBackendJob(Conf, Job->getMemBufferRef(), AddStream),
+        InputFilenames[0]);
+  return 0;
+}
+
 static int dumpSymtab(int argc, char **argv) {
   for (StringRef F : make_range(argv + 1, argv + argc)) {
     std::unique_ptr<MemoryBuffer> MB =
@@ -466,5 +528,7 @@ int main(int argc, char **argv) {
     return dumpSymtab(argc - 1, argv + 1);
   if (Subcommand == "run")
     return run(argc - 1, argv + 1);
+  if (Subcommand == "thin-backend-worker")
+    return thinBackendWorker(argc - 1, argv + 1);
   return usage();
 }
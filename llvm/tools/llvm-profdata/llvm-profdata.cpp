@@ -13,10 +13,13 @@
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/ProfileData/InstrProfReader.h"
 #include "llvm/ProfileData/InstrProfWriter.h"
+#include "llvm/ProfileData/MemProf.h"
 #include "llvm/ProfileData/ProfileCommon.h"
+#include "llvm/ProfileData/RawMemProfReader.h"
 #include "llvm/ProfileData/SampleProfReader.h"
 #include "llvm/ProfileData/SampleProfWriter.h"
 #include "llvm/Support/CommandLine.h"
@@ -86,7 +89,7 @@ static void exitWithErrorCode(std::error_code EC, StringRef Whence = "") {
 }
 
 namespace {
-enum ProfileKinds { instr, sample };
+enum ProfileKinds { instr, sample, memory };
 enum FailureMode { failIfAnyAreInvalid, failIfAllAreInvalid };
 }
 
@@ -715,6 +718,67 @@ mergeSampleProfile(const WeightedFileVector &Inputs, SymbolRemapper *Remapper,
   Writer->write(ProfileMap);
 }
 
+/// Merge raw and indexed memory profiles into an indexed memory profile. The
+/// raw profiles are symbolized with \p ProfiledBinary.
+static void mergeMemProfile(const WeightedFileVector &Inputs,
+                            StringRef ProfiledBinary, StringRef OutputFilename,
+                            FailureMode FailMode) {
+  if (OutputFilename.compare("-") == 0)
+    exitWithError("Cannot write indexed memory profile format to stdout.");
+
+  memprof::MemProfWriter Writer;
+  for (const auto &Input : Inputs) {
+    // The statistics of an allocation site are not counts, so they are not
+    // scaled.
+    if (Input.Weight != 1)
+      warn("weight ignored for memory profiles", Input.Filename);
+
+    auto BufferOrErr = MemoryBuffer::getFileOrSTDIN(Input.Filename);
+    if (std::error_code EC = BufferOrErr.getError()) {
+      warnOrExitGivenError(FailMode, EC, Input.Filename);
+      continue;
+    }
+
+    if (memprof::RawMemProfReader::hasFormat(*BufferOrErr.get())) {
+      if (ProfiledBinary.empty())
+        exitWithError("raw memory profiles need --profiled-binary",
+                      Input.Filename);
+      auto ReaderOrErr =
+          memprof::RawMemProfReader::create(Input.Filename, ProfiledBinary);
+      if (!ReaderOrErr) {
+        if (FailMode == failIfAnyAreInvalid)
+          exitWithError(ReaderOrErr.takeError(), Input.Filename);
+        warn(toString(ReaderOrErr.takeError()), Input.Filename);
+        continue;
+      }
+      Writer.addRecords((*ReaderOrErr)->getRecords());
+      continue;
+    }
+
+    auto ReaderOrErr =
+        memprof::IndexedMemProfReader::create(std::move(BufferOrErr.get()));
+    if (!ReaderOrErr) {
+      if (FailMode == failIfAnyAreInvalid)
+        exitWithError(ReaderOrErr.takeError(), Input.Filename);
+      warn(toString(ReaderOrErr.takeError()), Input.Filename);
+      continue;
+    }
+    const memprof::IndexedMemProfReader &Reader = **ReaderOrErr;
+    for (uint64_t Function : Reader.functions()) {
+      auto RecordOrErr = Reader.getRecord(Function);
+      if (!RecordOrErr)
+        exitWithError(RecordOrErr.takeError(), Input.Filename);
+      Writer.addRecord(Function, *RecordOrErr);
+    }
+  }
+
+  std::error_code EC;
+  raw_fd_ostream Output(OutputFilename.data(), EC, sys::fs::OF_None);
+  if (EC)
+    exitWithErrorCode(EC, OutputFilename);
+  Writer.write(Output);
+}
+
 static WeightedFile parseWeightedFile(const StringRef &WeightedFilename) {
   StringRef WeightStr, FileName;
   std::tie(WeightStr, FileName) = WeightedFilename.split(',');
@@ -807,7 +871,12 @@ static int merge_main(int argc, const char *argv[]) {
   cl::opt<ProfileKinds> ProfileKind(
       cl::desc("Profile kind:"), cl::init(instr),
       cl::values(clEnumVal(instr, "Instrumentation profile (default)"),
-                 clEnumVal(sample, "Sample profile")));
+                 clEnumVal(sample, "Sample profile"),
+                 clEnumVal(memory, "Memory profile")));
+  cl::opt<std::string> ProfiledBinary(
+      "profiled-binary", cl::init(""),
+      cl::desc("Path to the binary that wrote the raw memory profiles (only "
+               "meaningful for -memory)"));
   cl::opt<ProfileFormat> OutputFormat(
       cl::desc("Format of output profile"), cl::init(PF_Binary),
       cl::values(
@@ -910,6 +979,9 @@ static int merge_main(int argc, const char *argv[]) {
   if (ProfileKind == instr)
     mergeInstrProfile(WeightedInputs, Remapper.get(), OutputFilename,
                       OutputFormat, OutputSparse, NumThreads, FailureMode);
+  else if (ProfileKind == memory)
+    mergeMemProfile(WeightedInputs, ProfiledBinary, OutputFilename,
+                    FailureMode);
   else
     mergeSampleProfile(WeightedInputs, Remapper.get(), OutputFilename,
                        OutputFormat, ProfileSymbolListFile, CompressAllSections,
@@ -2353,6 +2425,44 @@ static int showSampleProfile(const std::string &Filename, bool ShowCounts,
   return 0;
 }
 
+static int showMemProfile(const std::string &Filename,
+                          StringRef ProfiledBinary, bool ShowAllFunctions,
+                          const std::string &ShowFunction, raw_fd_ostream &OS) {
+  if (memprof::RawMemProfReader::hasFormat(Filename)) {
+    if (ProfiledBinary.empty())
+      exitWithError("raw memory profiles need --profiled-binary", Filename);
+    auto ReaderOrErr = memprof::RawMemProfReader::create(Filename,
+                                                         ProfiledBinary);
+    if (!ReaderOrErr)
+      exitWithError(ReaderOrErr.takeError(), Filename);
+    (*ReaderOrErr)->printYAML(OS);
+    return 0;
+  }
+
+  auto ReaderOrErr = memprof::IndexedMemProfReader::create(Filename);
+  if (!ReaderOrErr)
+    exitWithError(ReaderOrErr.takeError(), Filename);
+  const memprof::IndexedMemProfReader &Reader = **ReaderOrErr;
+  uint64_t ShownFunction =
+      ShowFunction.empty() ? 0 : GlobalValue::getGUID(ShowFunction);
+  size_t NumFunctions = 0, NumAllocSites = 0;
+  for (uint64_t Function : Reader.functions()) {
+    auto RecordOrErr = Reader.getRecord(Function);
+    if (!RecordOrErr)
+      exitWithError(RecordOrErr.takeError(), Filename);
+    ++NumFunctions;
+    NumAllocSites += RecordOrErr->AllocSites.size();
+    if (ShowAllFunctions || Function == ShownFunction) {
+      OS << "-\n"
+         << "  Function: " << Function << "\n";
+      RecordOrErr->printYAML(OS);
+    }
+  }
+  OS << "Functions: " << NumFunctions << "\n"
+     << "Allocation sites: " << NumAllocSites << "\n";
+  return 0;
+}
+
 static int show_main(int argc, const char *argv[]) {
   cl::opt<std::string> Filename(cl::Positional, cl::Required,
                                 cl::desc("<profdata-file>"));
@@ -2393,7 +2503,12 @@ static int show_main(int argc, const char *argv[]) {
   cl::opt<ProfileKinds> ProfileKind(
       cl::desc("Profile kind:"), cl::init(instr),
       cl::values(clEnumVal(instr, "Instrumentation profile (default)"),
-                 clEnumVal(sample, "Sample profile")));
+                 clEnumVal(sample, "Sample profile"),
+                 clEnumVal(memory, "Memory profile")));
+  cl::opt<std::string> ProfiledBinary(
+      "profiled-binary", cl::init(""),
+      cl::desc("Path to the binary that wrote the raw memory profile (only "
+               "meaningful for -memory)"));
   cl::opt<uint32_t> TopNFunctions(
       "topn", cl::init(0),
       cl::desc("Show the list of functions with the largest internal counts"));
@@ -2439,6 +2554,9 @@ static int show_main(int argc, const char *argv[]) {
                             ShowDetailedSummary, DetailedSummaryCutoffs,
                             ShowAllFunctions, ShowCS, ValueCutoff,
                             OnlyListBelow, ShowFunction, TextFormat, OS);
+  else if (ProfileKind == memory)
+    return showMemProfile(Filename, ProfiledBinary, ShowAllFunctions,
+                          ShowFunction, OS);
   else
     return showSampleProfile(Filename, ShowCounts, ShowAllFunctions,
                              ShowDetailedSummary, ShowFunction,
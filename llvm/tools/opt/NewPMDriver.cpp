@@ -119,6 +119,10 @@ static cl::opt<std::string>
 static cl::opt<bool> DebugInfoForProfiling(
     "new-pm-debug-info-for-profiling", cl::init(false), cl::Hidden,
     cl::desc("Emit special debug info to enable PGO profile generation."));
+static cl::opt<unsigned> FunctionThreads(
+    "function-threads", cl::init(1),
+    cl::desc("Number of threads used to run function pass pipelines whose "
+             "passes are all parallel-safe"));
 /// @}}
 
 template <typename PassManagerT>
@@ -273,6 +277,7 @@ bool llvm::runPassPipeline(StringRef Arg0, Module &M, TargetMachine *TM,
   // option has been enabled.
   PTO.LoopUnrolling = !DisableLoopUnrolling;
   PTO.Coroutines = Coroutines;
+  PTO.FunctionThreads = FunctionThreads;
   PassBuilder PB(TM, PTO, P, &PIC);
   registerEPCallbacks(PB, VerifyEachPass, DebugPM);
 
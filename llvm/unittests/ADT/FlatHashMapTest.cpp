@@ -0,0 +1,220 @@
+//===- llvm/unittest/ADT/FlatHashMapTest.cpp - FlatHashMap unit tests -----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/FlatHashMap.h"
+#include "gtest/gtest.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+using namespace llvm;
+
+namespace {
+
+/// Key info without any sentinel keys, and with a hash that collides a lot so
+/// that the probing is exercised.
+struct CollidingInfo {
+  static unsigned getHashValue(unsigned Val) { return Val % 7; }
+  static bool isEqual(unsigned LHS, unsigned RHS) { return LHS == RHS; }
+};
+
+/// A value that tracks how many instances are alive.
+class LiveCounter {
+  static int Live;
+  std::unique_ptr<int> Value;
+
+public:
+  LiveCounter(int V = 0) : Value(std::make_unique<int>(V)) { ++Live; }
+  LiveCounter(const LiveCounter &Other)
+      : Value(std::make_unique<int>(*Other.Value)) {
+    ++Live;
+  }
+  LiveCounter(LiveCounter &&Other) : Value(std::move(Other.Value)) { ++Live; }
+  LiveCounter &operator=(const LiveCounter &Other) {
+    Value = std::make_unique<int>(*Other.Value);
+    return *this;
+  }
+  ~LiveCounter() { --Live; }
+
+  int get() const { return *Value; }
+  static int getLive() { return Live; }
+};
+
+int LiveCounter::Live = 0;
+
+TEST(FlatHashMapTest, EmptyMap) {
+  FlatHashMap<unsigned, unsigned> Map;
+  EXPECT_TRUE(Map.empty());
+  EXPECT_EQ(0u, Map.size());
+  EXPECT_EQ(0u, Map.getMemorySize());
+  EXPECT_TRUE(Map.begin() == Map.end());
+  EXPECT_TRUE(Map.find(0) == Map.end());
+  EXPECT_EQ(0u, Map.count(0));
+  EXPECT_EQ(0u, Map.lookup(0));
+  EXPECT_FALSE(Map.erase(0));
+  Map.clear();
+  EXPECT_TRUE(Map.empty());
+}
+
+TEST(FlatHashMapTest, InsertFindErase) {
+  FlatHashMap<unsigned, unsigned> Map;
+  EXPECT_TRUE(Map.insert({1, 10}).second);
+  EXPECT_FALSE(Map.insert({1, 20}).second);
+  EXPECT_TRUE(Map.try_emplace(2, 30).second);
+  Map[3] = 40;
+  EXPECT_EQ(3u, Map.size());
+  EXPECT_EQ(10u, Map.lookup(1));
+  EXPECT_EQ(30u, Map.find(2)->second);
+  EXPECT_EQ(40u, Map[3]);
+  EXPECT_EQ(0u, Map.lookup(4));
+
+  EXPECT_TRUE(Map.erase(1));
+  EXPECT_FALSE(Map.erase(1));
+  Map.erase(Map.find(2));
+  EXPECT_EQ(1u, Map.size());
+  EXPECT_EQ(0u, Map.count(1));
+  EXPECT_EQ(0u, Map.count(2));
+  EXPECT_EQ(1u, Map.count(3));
+}
+
+// DenseMapInfo<unsigned> reserves ~0U and ~0U - 1; this map must not.
+TEST(FlatHashMapTest, NoReservedKeys) {
+  FlatHashMap<unsigned, int> Map;
+  Map[~0U] = 1;
+  Map[~0U - 1] = 2;
+  EXPECT_EQ(2u, Map.size());
+  EXPECT_EQ(1, Map.lookup(~0U));
+  EXPECT_EQ(2, Map.lookup(~0U - 1));
+}
+
+TEST(FlatHashMapTest, GrowAndIterate) {
+  FlatHashMap<unsigned, unsigned, CollidingInfo> Map;
+  std::map<unsigned, unsigned> Expected;
+  for (unsigned I = 0; I != 1000; ++I) {
+    Map[I * 3] = I;
+    Expected[I * 3] = I;
+  }
+  EXPECT_EQ(1000u, Map.size());
+
+  std::map<unsigned, unsigned> Visited;
+  for (auto &KV : Map)
+    EXPECT_TRUE(Visited.insert({KV.first, KV.second}).second);
+  EXPECT_EQ(Expected, Visited);
+}
+
+// Erasing and reinserting keys leaves deleted buckets behind; the map must
+// reclaim them instead of growing forever or losing entries.
+TEST(FlatHashMapTest, ChurnReusesDeletedBuckets) {
+  FlatHashMap<unsigned, unsigned, CollidingInfo> Map;
+  for (unsigned I = 0; I != 80; ++I)
+    Map[I] = I;
+  size_t Size = Map.getMemorySize();
+  for (unsigned Round = 1; Round != 50; ++Round) {
+    for (unsigned I = 0; I != 40; ++I)
+      EXPECT_TRUE(Map.erase(I + (Round - 1) * 40));
+    for (unsigned I = 0; I != 40; ++I)
+      Map[I + (Round + 1) * 40] = I;
+    EXPECT_EQ(80u, Map.size());
+  }
+  EXPECT_EQ(Size, Map.getMemorySize());
+  for (unsigned I = 0; I != 80; ++I)
+    EXPECT_EQ(1u, Map.count(I + 49 * 40));
+}
+
+TEST(FlatHashMapTest, Reserve) {
+  FlatHashMap<unsigned, unsigned> Map(100);
+  size_t Size = Map.getMemorySize();
+  EXPECT_NE(0u, Size);
+  for (unsigned I = 0; I != 100; ++I)
+    Map[I] = I;
+  EXPECT_EQ(Size, Map.getMemorySize());
+  Map.reserve(10);
+  EXPECT_EQ(Size, Map.getMemorySize());
+  Map.reserve(1000);
+  EXPECT_LT(Size, Map.getMemorySize());
+  for (unsigned I = 0; I != 100; ++I)
+    EXPECT_EQ(I, Map.lookup(I));
+}
+
+TEST(FlatHashMapTest, CopyAndMove) {
+  FlatHashMap<unsigned, std::string> Map;
+  for (unsigned I = 0; I != 40; ++I)
+    Map[I] = std::to_string(I);
+
+  FlatHashMap<unsigned, std::string> Copy(Map);
+  EXPECT_EQ(40u, Copy.size());
+  EXPECT_EQ("17", Copy.lookup(17));
+
+  FlatHashMap<unsigned, std::string> Moved(std::move(Map));
+  EXPECT_EQ(40u, Moved.size());
+  EXPECT_EQ("39", Moved.lookup(39));
+  EXPECT_TRUE(Map.empty());
+
+  Map = Copy;
+  EXPECT_EQ(40u, Map.size());
+  Copy.clear();
+  EXPECT_EQ("5", Map.lookup(5));
+
+  Copy = std::move(Moved);
+  EXPECT_EQ(40u, Copy.size());
+  EXPECT_EQ("0", Copy.lookup(0));
+}
+
+TEST(FlatHashMapTest, ConstructsAndDestroysValues) {
+  {
+    FlatHashMap<unsigned, LiveCounter> Map;
+    for (unsigned I = 0; I != 100; ++I)
+      Map.try_emplace(I, I);
+    EXPECT_EQ(100, LiveCounter::getLive());
+    for (unsigned I = 0; I != 100; I += 2)
+      Map.erase(I);
+    EXPECT_EQ(50, LiveCounter::getLive());
+    for (unsigned I = 0; I != 100; I += 2)
+      Map.try_emplace(I, I);
+    EXPECT_EQ(100, LiveCounter::getLive());
+    FlatHashMap<unsigned, LiveCounter> Copy(Map);
+    EXPECT_EQ(200, LiveCounter::getLive());
+    for (unsigned I = 0; I != 100; ++I)
+      EXPECT_EQ(int(I), Copy.find(I)->second.get());
+    Copy.clear();
+    EXPECT_EQ(100, LiveCounter::getLive());
+  }
+  EXPECT_EQ(0, LiveCounter::getLive());
+}
+
+TEST(FlatHashMapTest, MoveOnlyValues) {
+  FlatHashMap<unsigned, std::unique_ptr<int>> Map;
+  for (unsigned I = 0; I != 64; ++I)
+    Map.try_emplace(I, std::make_unique<int>(I));
+  for (unsigned I = 0; I != 64; ++I)
+    EXPECT_EQ(int(I), *Map[I]);
+}
+
+TEST(FlatHashMapTest, StringKeys) {
+  FlatHashMap<StringRef, int> Map;
+  Map["foo"] = 1;
+  Map["bar"] = 2;
+  EXPECT_EQ(1, Map.lookup("foo"));
+  EXPECT_EQ(2, Map.lookup("bar"));
+  EXPECT_EQ(0, Map.lookup("baz"));
+}
+
+TEST(FlatHashMapTest, ConstIterator) {
+  FlatHashMap<unsigned, unsigned> Map;
+  Map[1] = 2;
+  const FlatHashMap<unsigned, unsigned> &CMap = Map;
+  EXPECT_EQ(Map.begin(), CMap.begin());
+  EXPECT_EQ(Map.end(), CMap.end());
+  EXPECT_NE(Map.end(), CMap.begin());
+  FlatHashMap<unsigned, unsigned>::const_iterator CI = Map.find(1);
+  EXPECT_EQ(2u, CI->second);
+  EXPECT_EQ(CMap.find(1), CI);
+}
+
+} // end anonymous namespace
@@ -7,6 +7,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/AsmParser/Parser.h"
 #include "llvm/Bitcode/BitcodeReader.h"
@@ -15,6 +16,7 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -255,4 +257,52 @@ TEST(BitReaderTest, MaterializeFunctionsForBlockAddrInFunctionAfter) {
   EXPECT_FALSE(verifyModule(*M, &dbgs()));
 }
 
+// Tests that function bodies decoded ahead of time are used or dropped
+// correctly when lazily materialized functions are requested out of order.
+TEST(BitReaderTest, MaterializeFunctionsOutOfOrderWithDecodeThreads) {
+  auto *DecodeThreads = static_cast<cl::opt<unsigned> *>(
+      cl::getRegisteredOptions().lookup("bitcode-decode-threads"));
+  ASSERT_TRUE(DecodeThreads);
+  DecodeThreads->setValue(2);
+  auto ResetDecodeThreads =
+      make_scope_exit([&] { DecodeThreads->setValue(1); });
+
+  // More functions than the bodies kept in flight by two threads.
+  const unsigned NumFunctions = 32;
+  std::string Assembly;
+  raw_string_ostream OS(Assembly);
+  for (unsigned I = 0; I != NumFunctions; ++I)
+    OS << "define i32 @f" << I << "(i32 %x) {\n"
+       << "  %a = add i32 %x, " << I << "\n"
+       << "  %c = icmp eq i32 %a, 0\n"
+       << "  br i1 %c, label %t, label %e\n"
+       << "t:\n"
+       << "  ret i32 %a\n"
+       << "e:\n"
+       << "  %m = mul i32 %a, " << I + 1 << "\n"
+       << "  ret i32 %m\n"
+       << "}\n";
+  OS.flush();
+
+  LLVMContext Context;
+  std::unique_ptr<Module> RefM = parseAssembly(Context, Assembly.c_str());
+  SmallString<1024> Mem;
+  std::unique_ptr<Module> M =
+      getLazyModuleFromAssembly(Context, Mem, Assembly.c_str());
+
+  // Start in the middle, go back, skip ahead past the window, and revisit
+  // the bodies that were decoded but skipped over.
+  for (unsigned I : {10u, 11u, 3u, 30u, 12u, 4u, 5u, 20u, 0u})
+    ASSERT_FALSE(M->getFunction("f" + Twine(I).str())->materialize());
+  ASSERT_FALSE(M->materializeAll());
+
+  EXPECT_FALSE(verifyModule(*M, &dbgs()));
+  for (Function &F : *M) {
+    std::string Actual, Reference;
+    raw_string_ostream(Actual) << F;
+    raw_string_ostream(Reference) << *RefM->getFunction(F.getName());
+    EXPECT_EQ(Reference, Actual);
+  }
+}
+
 } // end namespace
@@ -0,0 +1,117 @@
+//===- llvm/unittest/CodeGen/ParallelCGTest.cpp ---------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+const unsigned NumFunctions = 12;
+
+class ParallelCGTest : public testing::Test {
+protected:
+  static void SetUpTestCase() {
+    InitializeAllTargets();
+    InitializeAllTargetMCs();
+    InitializeAllAsmPrinters();
+  }
+
+  void SetUp() override {
+    std::string Error;
+    T = TargetRegistry::lookupTarget("x86_64-unknown-linux", Error);
+  }
+
+  std::unique_ptr<Module> makeModule() {
+    std::string IR = "target triple = \"x86_64-unknown-linux\"\n";
+    for (unsigned I = 0; I != NumFunctions; ++I)
+      IR += "define i32 @f" + std::to_string(I) +
+            "(i32 %a) {\n"
+            "  %r = add i32 %a, " +
+            std::to_string(I) +
+            "\n"
+            "  ret i32 %r\n"
+            "}\n";
+    return unittest::parseModuleWithIDs(IR, Context, "ParallelCGTest");
+  }
+
+  // Generate assembly for M in N partitions, and return the names of the
+  // functions in the order they are defined in the outputs, taken in order.
+  std::vector<std::string> splitCodeGen(std::unique_ptr<Module> M, unsigned N,
+                                        bool PreserveOrder) {
+    std::vector<SmallString<0>> Outputs(N);
+    std::vector<std::unique_ptr<raw_svector_ostream>> Streams;
+    std::vector<raw_pwrite_stream *> OSs;
+    for (SmallString<0> &Output : Outputs) {
+      Streams.push_back(std::make_unique<raw_svector_ostream>(Output));
+      OSs.push_back(Streams.back().get());
+    }
+    const Target *TheTarget = T;
+    llvm::splitCodeGen(
+        std::move(M), OSs, {},
+        [TheTarget]() {
+          return std::unique_ptr<TargetMachine>(TheTarget->createTargetMachine(
+              "x86_64-unknown-linux", "", "", TargetOptions(), None));
+        },
+        CGFT_AssemblyFile, /*PreserveLocals=*/false, PreserveOrder);
+
+    std::vector<std::string> Names;
+    for (const SmallString<0> &Output : Outputs) {
+      SmallVector<StringRef, 0> Lines;
+      StringRef(Output).split(Lines, '\n');
+      for (StringRef Line : Lines)
+        if (Line.startswith("f") && Line.endswith(":"))
+          Names.push_back(std::string(Line.drop_back()));
+    }
+    return Names;
+  }
+
+  LLVMContext Context;
+  const Target *T = nullptr;
+};
+
+TEST_F(ParallelCGTest, PreserveOrder) {
+  if (!T)
+    return;
+  std::unique_ptr<Module> M = makeModule();
+  ASSERT_TRUE(M);
+
+  // Taken in order, the outputs define the functions in module order.
+  std::vector<std::string> Names =
+      splitCodeGen(std::move(M), 3, /*PreserveOrder=*/true);
+  ASSERT_EQ(NumFunctions, Names.size());
+  for (unsigned I = 0; I != NumFunctions; ++I)
+    EXPECT_EQ("f" + std::to_string(I), Names[I]);
+}
+
+TEST_F(ParallelCGTest, DefaultDefinesEveryFunctionOnce) {
+  if (!T)
+    return;
+  std::unique_ptr<Module> M = makeModule();
+  ASSERT_TRUE(M);
+
+  std::vector<std::string> Names =
+      splitCodeGen(std::move(M), 3, /*PreserveOrder=*/false);
+  llvm::sort(Names);
+  std::vector<std::string> Expected;
+  for (unsigned I = 0; I != NumFunctions; ++I)
+    Expected.push_back("f" + std::to_string(I));
+  llvm::sort(Expected);
+  EXPECT_EQ(Expected, Names);
+}
+
+} // end anonymous namespace
@@ -8,12 +8,14 @@
 
 #include "llvm/IR/PassManager.h"
 #include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManagerImpl.h"
 #include "llvm/Support/SourceMgr.h"
 #include "gtest/gtest.h"
+#include <atomic>
 
 using namespace llvm;
 
@@ -160,6 +162,26 @@ struct TestInvalidationFunctionPass
   StringRef Name;
 };
 
+// A test function pass that only reads the function analysis, and so may be
+// run concurrently on distinct functions.
+struct TestParallelSafeFunctionPass
+    : PassInfoMixin<TestParallelSafeFunctionPass> {
+  TestParallelSafeFunctionPass(std::atomic<int> &RunCount,
+                               std::atomic<int> &AnalyzedInstrCount)
+      : RunCount(RunCount), AnalyzedInstrCount(AnalyzedInstrCount) {}
+
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM) {
+    ++RunCount;
+    AnalyzedInstrCount += AM.getResult<TestFunctionAnalysis>(F).InstructionCount;
+    return PreservedAnalyses::all();
+  }
+
+  static bool isParallelSafe() { return true; }
+
+  std::atomic<int> &RunCount;
+  std::atomic<int> &AnalyzedInstrCount;
+};
+
 std::unique_ptr<Module> parseIR(LLVMContext &Context, const char *IR) {
   SMDiagnostic Err;
   return parseAssemblyString(IR, Err, Context);
@@ -538,6 +560,149 @@ TEST_F(PassManagerTest, Basic) {
   EXPECT_EQ(1, ModuleAnalysisRuns);
 }
 
+TEST_F(PassManagerTest, ParallelFunctionAdaptor) {
+  FunctionAnalysisManager FAM;
+  int FunctionAnalysisRuns = 0;
+  FAM.registerPass([&] { return TestFunctionAnalysis(FunctionAnalysisRuns); });
+
+  ModuleAnalysisManager MAM;
+  MAM.registerPass([&] { return FunctionAnalysisManagerModuleProxy(FAM); });
+  FAM.registerPass([&] { return ModuleAnalysisManagerFunctionProxy(MAM); });
+
+  // Count the passes started through the instrumentation, which is not
+  // thread-safe on its own.
+  PassInstrumentationCallbacks PIC;
+  int BeforePassCount = 0;
+  PIC.registerBeforePassCallback([&](StringRef, Any) {
+    ++BeforePassCount;
+    return true;
+  });
+  MAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+  FAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+
+  std::atomic<int> RunCount1(0), AnalyzedInstrCount1(0);
+  std::atomic<int> RunCount2(0), AnalyzedInstrCount2(0);
+  ModulePassManager MPM;
+  {
+    FunctionPassManager FPM;
+    FPM.addPass(TestParallelSafeFunctionPass(RunCount1, AnalyzedInstrCount1));
+    EXPECT_TRUE(FPM.isParallelSafe());
+    MPM.addPass(createParallelModuleToFunctionPassAdaptor(std::move(FPM), 4));
+  }
+  {
+    // This pipeline is not parallel-safe and runs one function at a time.
+    FunctionPassManager FPM;
+    FPM.addPass(TestInvalidationFunctionPass("f"));
+    FPM.addPass(TestParallelSafeFunctionPass(RunCount2, AnalyzedInstrCount2));
+    EXPECT_FALSE(FPM.isParallelSafe());
+    MPM.addPass(createParallelModuleToFunctionPassAdaptor(std::move(FPM), 4));
+  }
+  MPM.run(*M, MAM);
+
+  EXPECT_EQ(3, RunCount1);
+  EXPECT_EQ(5, AnalyzedInstrCount1);
+  EXPECT_EQ(3, RunCount2);
+  EXPECT_EQ(5, AnalyzedInstrCount2);
+
+  // Each function is analyzed once, and 'f' once more after being
+  // invalidated.
+  EXPECT_EQ(4, FunctionAnalysisRuns);
+
+  // The two adaptors, and for each of the three functions the two function
+  // pass managers and their three passes.
+  EXPECT_EQ(2 + 3 * (2 + 3), BeforePassCount);
+
+  // The analysis manager is no longer locked once the adaptor is done.
+  EXPECT_FALSE(FAM.isThreadSafe());
+}
+
+TEST_F(PassManagerTest, ParallelDominatorTreeVerifier) {
+  FunctionAnalysisManager FAM;
+  FAM.registerPass([&] { return DominatorTreeAnalysis(); });
+
+  ModuleAnalysisManager MAM;
+  MAM.registerPass([&] { return FunctionAnalysisManagerModuleProxy(FAM); });
+  FAM.registerPass([&] { return ModuleAnalysisManagerFunctionProxy(MAM); });
+
+  PassInstrumentationCallbacks PIC;
+  std::vector<std::string> Verified;
+  PIC.registerAfterPassCallback(
+      [&](StringRef P, Any IR, const PreservedAnalyses &) {
+        if (P == DominatorTreeVerifierPass::name())
+          Verified.push_back(any_cast<const Function *>(IR)->getName().str());
+      });
+  MAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+  FAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+
+  // The caller serializes the callbacks already; the adaptor must leave
+  // that in place.
+  PIC.setThreadSafe(true);
+
+  FunctionPassManager FPM;
+  FPM.addPass(DominatorTreeVerifierPass());
+  EXPECT_TRUE(FPM.isParallelSafe());
+  ModulePassManager MPM;
+  MPM.addPass(createParallelModuleToFunctionPassAdaptor(std::move(FPM), 4));
+  MPM.run(*M, MAM);
+
+  llvm::sort(Verified);
+  EXPECT_EQ((std::vector<std::string>{"f", "g", "h"}), Verified);
+  for (Function &F : *M)
+    EXPECT_TRUE(FAM.getCachedResult<DominatorTreeAnalysis>(F));
+
+  EXPECT_TRUE(PIC.isThreadSafe());
+  EXPECT_FALSE(FAM.isThreadSafe());
+}
+
+TEST_F(PassManagerTest, AnalysisInvalidatedCallback) {
+  FunctionAnalysisManager FAM;
+  int FunctionAnalysisRuns = 0;
+  FAM.registerPass([&] { return TestFunctionAnalysis(FunctionAnalysisRuns); });
+
+  ModuleAnalysisManager MAM;
+  MAM.registerPass([&] { return FunctionAnalysisManagerModuleProxy(FAM); });
+  FAM.registerPass([&] { return ModuleAnalysisManagerFunctionProxy(MAM); });
+
+  PassInstrumentationCallbacks PIC;
+  std::vector<std::string> Invalidated;
+  PIC.registerAnalysisInvalidatedCallback([&](StringRef P, Any IR) {
+    ASSERT_TRUE(any_isa<const Function *>(IR));
+    Invalidated.push_back(
+        (P + " on " + any_cast<const Function *>(IR)->getName()).str());
+  });
+  MAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+  FAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+
+  std::atomic<int> RunCount(0), AnalyzedInstrCount(0);
+  FunctionPassManager FPM;
+  FPM.addPass(TestParallelSafeFunctionPass(RunCount, AnalyzedInstrCount));
+  FPM.addPass(TestInvalidationFunctionPass("f"));
+  ModulePassManager MPM;
+  MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+  MPM.run(*M, MAM);
+
+  // Only the test analysis on 'f' is invalidated; the instrumentation itself
+  // survives every invalidation.
+  ASSERT_EQ(1u, Invalidated.size());
+  EXPECT_EQ((TestFunctionAnalysis::name() + " on f").str(), Invalidated[0]);
+}
+
+TEST_F(PassManagerTest, InvalidateWithoutInstrumentation) {
+  // Analysis managers used without a pass manager need not register the
+  // instrumentation analysis; computing and invalidating results must not
+  // query it.
+  FunctionAnalysisManager FAM;
+  int FunctionAnalysisRuns = 0;
+  FAM.registerPass([&] { return TestFunctionAnalysis(FunctionAnalysisRuns); });
+
+  Function &F = *M->getFunction("f");
+  FAM.getResult<TestFunctionAnalysis>(F);
+  FAM.invalidate(F, PreservedAnalyses::none());
+  EXPECT_FALSE(FAM.getCachedResult<TestFunctionAnalysis>(F));
+  FAM.getResult<TestFunctionAnalysis>(F);
+  EXPECT_EQ(2, FunctionAnalysisRuns);
+}
+
 // A customized pass manager that passes extra arguments through the
 // infrastructure.
 typedef AnalysisManager<Function, int> CustomizedAnalysisManager;
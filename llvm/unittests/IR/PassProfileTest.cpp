@@ -0,0 +1,174 @@
+//===- unittests/IR/PassProfileTest.cpp - PassProfileInstrumentation tests ===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+class CachedAnalysis : public AnalysisInfoMixin<CachedAnalysis> {
+public:
+  struct Result {};
+  Result run(Function &, FunctionAnalysisManager &) { return Result(); }
+
+private:
+  friend AnalysisInfoMixin<CachedAnalysis>;
+  static AnalysisKey Key;
+};
+
+AnalysisKey CachedAnalysis::Key;
+
+// Deletes the first 'add' of the function and invalidates every analysis.
+struct EraseAddPass : PassInfoMixin<EraseAddPass> {
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &) {
+    for (Instruction &I : instructions(F))
+      if (I.getOpcode() == Instruction::Add) {
+        I.replaceAllUsesWith(I.getOperand(0));
+        I.eraseFromParent();
+        return PreservedAnalyses::none();
+      }
+    return PreservedAnalyses::all();
+  }
+};
+
+class PassProfileTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  std::unique_ptr<Module> M;
+  SmallString<128> ProfilePath;
+  cl::opt<std::string> *ProfileOpt;
+
+  PassProfileTest() {
+    SMDiagnostic Err;
+    M = parseAssemblyString("define i32 @f(i32 %x) {\n"
+                            "  %a = add i32 %x, 1\n"
+                            "  %b = add i32 %a, 2\n"
+                            "  ret i32 %b\n"
+                            "}\n"
+                            "define i32 @g(i32 %x) {\n"
+                            "  ret i32 %x\n"
+                            "}\n",
+                            Err, Context);
+    EXPECT_TRUE(sys::fs::createTemporaryFile("pass-profile", "json",
+                                             ProfilePath) ==
+                std::error_code());
+    ProfileOpt = static_cast<cl::opt<std::string> *>(
+        cl::getRegisteredOptions().lookup("pass-profile"));
+    ProfileOpt->setValue(ProfilePath.str().str());
+  }
+
+  ~PassProfileTest() {
+    ProfileOpt->setValue("");
+    sys::fs::remove(ProfilePath);
+  }
+
+  const json::Object *findEntry(const json::Array &Passes, StringRef Pass,
+                                StringRef Name) {
+    for (const json::Value &V : Passes) {
+      const json::Object *E = V.getAsObject();
+      if (!E)
+        continue;
+      Optional<StringRef> P = E->getString("pass");
+      if (P && P->find(Pass) != StringRef::npos &&
+          E->getString("name") == Name)
+        return E;
+    }
+    return nullptr;
+  }
+};
+
+TEST_F(PassProfileTest, WritesJSON) {
+  {
+    PassInstrumentationCallbacks PIC;
+    PassProfileInstrumentation Profile;
+    Profile.registerCallbacks(PIC);
+
+    FunctionAnalysisManager FAM;
+    ModuleAnalysisManager MAM;
+    FAM.registerPass([&] { return CachedAnalysis(); });
+    MAM.registerPass([&] { return FunctionAnalysisManagerModuleProxy(FAM); });
+    FAM.registerPass([&] { return ModuleAnalysisManagerFunctionProxy(MAM); });
+    MAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+    FAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+
+    FunctionPassManager FPM;
+    FPM.addPass(RequireAnalysisPass<CachedAnalysis, Function>());
+    FPM.addPass(EraseAddPass());
+    ModulePassManager MPM;
+    MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+    MPM.run(*M, MAM);
+    // The report is written when the instrumentation goes away.
+  }
+
+  auto Buffer = MemoryBuffer::getFile(ProfilePath);
+  ASSERT_TRUE(bool(Buffer));
+  Expected<json::Value> Report = json::parse((*Buffer)->getBuffer());
+  ASSERT_TRUE(bool(Report)) << toString(Report.takeError());
+  ASSERT_TRUE(Report->getAsObject());
+  const json::Array *Passes = Report->getAsObject()->getArray("passes");
+  ASSERT_TRUE(Passes);
+
+  // Pass managers and adaptors are not reported.
+  for (const json::Value &V : *Passes) {
+    Optional<StringRef> P = V.getAsObject()->getString("pass");
+    ASSERT_TRUE(P.hasValue());
+    EXPECT_EQ(StringRef::npos, P->find("PassManager"));
+    EXPECT_EQ(StringRef::npos, P->find("PassAdaptor"));
+  }
+
+  const json::Object *F = findEntry(*Passes, "EraseAddPass", "f");
+  ASSERT_TRUE(F);
+  EXPECT_EQ(StringRef("function"), F->getString("ir"));
+  EXPECT_EQ(Optional<int64_t>(1), F->getInteger("runs"));
+  EXPECT_EQ(Optional<int64_t>(-1), F->getInteger("inst_delta"));
+  // The pass invalidated the cached analysis on 'f'.
+  EXPECT_EQ(Optional<int64_t>(1), F->getInteger("invalidations"));
+  ASSERT_TRUE(F->getNumber("wall_ms").hasValue());
+  EXPECT_GE(*F->getNumber("wall_ms"), 0.0);
+
+  const json::Object *G = findEntry(*Passes, "EraseAddPass", "g");
+  ASSERT_TRUE(G);
+  EXPECT_EQ(Optional<int64_t>(1), G->getInteger("runs"));
+  EXPECT_EQ(Optional<int64_t>(0), G->getInteger("inst_delta"));
+  EXPECT_EQ(Optional<int64_t>(0), G->getInteger("invalidations"));
+
+  EXPECT_TRUE(findEntry(*Passes, "RequireAnalysisPass", "f"));
+}
+
+TEST_F(PassProfileTest, NothingWrittenWithoutOption) {
+  ProfileOpt->setValue("");
+  {
+    PassInstrumentationCallbacks PIC;
+    PassProfileInstrumentation Profile;
+    Profile.registerCallbacks(PIC);
+
+    FunctionAnalysisManager FAM;
+    FAM.registerPass([&] { return PassInstrumentationAnalysis(&PIC); });
+    FunctionPassManager FPM;
+    FPM.addPass(EraseAddPass());
+    FPM.run(*M->getFunction("f"), FAM);
+  }
+  uint64_t Size;
+  ASSERT_FALSE(sys::fs::file_size(ProfilePath, Size));
+  EXPECT_EQ(0u, Size);
+}
+
+} // end anonymous namespace
@@ -0,0 +1,190 @@
+//===- ThinBackendJobTest.cpp - Out-of-process ThinLTO backend job tests --===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/LTO/LTOBackend.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace lto;
+
+namespace {
+
+const char *Triple = "x86_64-unknown-linux-gnu";
+
+class ThinBackendJobTest : public testing::Test {
+protected:
+  LLVMContext Context;
+  SmallString<0> Bitcode;
+  Optional<BitcodeModule> BM;
+  ModuleSummaryIndex CombinedIndex{/*HaveGVs=*/false};
+  StringMap<GVSummaryMapTy> ModuleToDefinedGVSummaries;
+  FunctionImporter::ImportMapTy ImportList;
+  MapVector<StringRef, BitcodeModule> ModuleMap;
+
+  void SetUp() override {
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M =
+        parseAssemblyString("target triple = \"x86_64-unknown-linux-gnu\"\n"
+                            "define i32 @f() {\n"
+                            "  ret i32 0\n"
+                            "}\n",
+                            Err, Context);
+    ASSERT_TRUE(M);
+    ProfileSummaryInfo PSI(*M);
+    ModuleSummaryIndex Index = buildModuleSummaryIndex(*M, nullptr, &PSI);
+    raw_svector_ostream OS(Bitcode);
+    WriteBitcodeToFile(*M, OS, /*ShouldPreserveUseListOrder=*/false, &Index);
+
+    MemoryBufferRef Buffer(StringRef(Bitcode.data(), Bitcode.size()), "a.o");
+    Expected<std::vector<BitcodeModule>> BMsOrErr =
+        getBitcodeModuleList(Buffer);
+    ASSERT_TRUE(bool(BMsOrErr));
+    ASSERT_EQ(1u, BMsOrErr->size());
+    BM = (*BMsOrErr)[0];
+    ASSERT_FALSE(
+        errorToBool(readModuleSummaryIndex(Buffer, CombinedIndex, 0)));
+    CombinedIndex.collectDefinedGVSummariesPerModule(
+        ModuleToDefinedGVSummaries);
+  }
+
+  Error writeJob(const Config &C, std::string &Job) {
+    raw_string_ostream OS(Job);
+    Error E = writeThinBackendJob(OS, C, /*Task=*/0, *BM, CombinedIndex,
+                                  ModuleToDefinedGVSummaries, ImportList,
+                                  ModuleMap);
+    OS.flush();
+    return E;
+  }
+
+  static void writeFile(StringRef Path, StringRef Contents) {
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC);
+    ASSERT_FALSE(EC);
+    OS << Contents;
+  }
+
+  static std::unique_ptr<NativeObjectStream> getNullStream(unsigned) {
+    return std::make_unique<NativeObjectStream>(
+        std::make_unique<raw_null_ostream>());
+  }
+};
+
+// The profiles are passed by path, and the worker reads them from there.
+TEST_F(ThinBackendJobTest, PassesProfilesByPath) {
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  std::string Error;
+  if (!TargetRegistry::lookupTarget(Triple, Error))
+    return;
+
+  SmallString<128> SamplePath, RemapPath;
+  ASSERT_FALSE(sys::fs::createTemporaryFile("sample", "prof", SamplePath));
+  FileRemover SampleRemover(SamplePath);
+  ASSERT_FALSE(sys::fs::createTemporaryFile("remap", "txt", RemapPath));
+  FileRemover RemapRemover(RemapPath);
+  writeFile(SamplePath, "f:10:1\n 1: 10\n");
+  writeFile(RemapPath, "name f g\n");
+
+  Config C;
+  C.SampleProfile = std::string(SamplePath);
+  C.ProfileRemapping = std::string(RemapPath);
+  C.RunCSIRInstr = true;
+  C.CSIRProfile = "cs.profraw";
+  std::string Job;
+  ASSERT_FALSE(errorToBool(writeJob(C, Job)));
+  // Only the paths are part of the job.
+  EXPECT_EQ(std::string::npos, Job.find("name f g"));
+
+  Config WorkerC;
+  std::string SeenSamplePath, SeenRemapPath, SeenCSProfile;
+  WorkerC.PreOptModuleHook = [&](unsigned, const Module &) {
+    SeenSamplePath = WorkerC.SampleProfile;
+    SeenRemapPath = WorkerC.ProfileRemapping;
+    SeenCSProfile = WorkerC.CSIRProfile;
+    return false;
+  };
+  ASSERT_FALSE(errorToBool(runThinBackendJob(
+      WorkerC, MemoryBufferRef(Job, "job"), getNullStream)));
+
+  EXPECT_EQ(std::string(SamplePath), SeenSamplePath);
+  EXPECT_EQ(std::string(RemapPath), SeenRemapPath);
+  EXPECT_EQ("cs.profraw", SeenCSProfile);
+}
+
+TEST_F(ThinBackendJobTest, CarriesTargetOptions) {
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  std::string Error;
+  if (!TargetRegistry::lookupTarget(Triple, Error))
+    return;
+
+  Config C;
+  C.Options.UnsafeFPMath = true;
+  C.Options.NoTrappingFPMath = false;
+  C.Options.StackAlignmentOverride = 32;
+  C.Options.EnableMachineOutliner = true;
+  C.Options.TLSSize = 24;
+  C.Options.FloatABIType = FloatABI::Hard;
+  C.Options.ExceptionModel = ExceptionHandling::DwarfCFI;
+  C.Options.setFP32DenormalMode(DenormalMode::getPreserveSign());
+  C.Options.MCOptions.MCRelaxAll = true;
+  C.Options.MCOptions.DwarfVersion = 5;
+  C.Options.MCOptions.ABIName = "lp64";
+  C.SplitDwarfFile = "a.dwo";
+  std::string Job;
+  ASSERT_FALSE(errorToBool(writeJob(C, Job)));
+
+  Config WorkerC;
+  WorkerC.PreOptModuleHook = [](unsigned, const Module &) { return false; };
+  ASSERT_FALSE(errorToBool(runThinBackendJob(
+      WorkerC, MemoryBufferRef(Job, "job"), getNullStream)));
+
+  const TargetOptions &Options = WorkerC.Options;
+  EXPECT_TRUE(Options.UnsafeFPMath);
+  EXPECT_FALSE(Options.NoTrappingFPMath);
+  EXPECT_EQ(32u, Options.StackAlignmentOverride);
+  EXPECT_TRUE(Options.EnableMachineOutliner);
+  EXPECT_EQ(24u, Options.TLSSize);
+  EXPECT_EQ(FloatABI::Hard, Options.FloatABIType);
+  EXPECT_EQ(ExceptionHandling::DwarfCFI, Options.ExceptionModel);
+  EXPECT_EQ(DenormalMode::getIEEE(), Options.getRawFPDenormalMode());
+  EXPECT_EQ(DenormalMode::getPreserveSign(), Options.getRawFP32DenormalMode());
+  EXPECT_TRUE(Options.MCOptions.MCRelaxAll);
+  EXPECT_EQ(5, Options.MCOptions.DwarfVersion);
+  EXPECT_EQ("lp64", Options.MCOptions.ABIName);
+  EXPECT_EQ("a.dwo", WorkerC.SplitDwarfFile);
+}
+
+TEST_F(ThinBackendJobTest, RejectsBasicBlockSectionsList) {
+  Config C;
+  C.Options.BBSections = BasicBlockSection::List;
+  C.Options.BBSectionsFuncListBuf = MemoryBuffer::getMemBuffer("!f\n");
+  std::string Job;
+  Error E = writeJob(C, Job);
+  ASSERT_TRUE(bool(E));
+  EXPECT_NE(std::string::npos,
+            toString(std::move(E)).find("basic block sections"));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,190 @@
+//===- llvm/unittest/MC/MCRelaxationTest.cpp ------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+// Marks the start of the code in the object file.
+const char *Marker = "  .byte 0xde, 0xad, 0xbe, 0xef\n";
+
+const Target *getTarget(StringRef TripleName) {
+  InitializeAllTargetInfos();
+  InitializeAllTargetMCs();
+  InitializeAllAsmParsers();
+  std::string Error;
+  return TargetRegistry::lookupTarget(TripleName.str(), Error);
+}
+
+// Assemble \p Asm into an ELF object for \p TripleName, with or without
+// skipping the fragments whose relaxation inputs did not change.
+std::string assemble(const Target &T, StringRef TripleName, StringRef Asm,
+                     bool SkipUnchanged) {
+  auto *Skip = static_cast<cl::opt<bool> *>(
+      cl::getRegisteredOptions().lookup("mc-skip-unchanged-relaxations"));
+  EXPECT_TRUE(Skip);
+  Skip->setValue(SkipUnchanged);
+
+  Triple TT(TripleName);
+  MCTargetOptions Options;
+  std::unique_ptr<MCRegisterInfo> MRI(T.createMCRegInfo(TripleName));
+  std::unique_ptr<MCAsmInfo> MAI(T.createMCAsmInfo(*MRI, TripleName, Options));
+  std::unique_ptr<MCInstrInfo> MCII(T.createMCInstrInfo());
+  std::unique_ptr<MCSubtargetInfo> STI(
+      T.createMCSubtargetInfo(TripleName, "", ""));
+
+  SourceMgr SrcMgr;
+  SrcMgr.AddNewSourceBuffer(MemoryBuffer::getMemBuffer(Asm), SMLoc());
+  MCObjectFileInfo MOFI;
+  MCContext Ctx(MAI.get(), MRI.get(), &MOFI, &SrcMgr, &Options);
+  MOFI.InitMCObjectFileInfo(TT, /*PIC=*/false, Ctx);
+
+  SmallString<0> Object;
+  raw_svector_ostream OS(Object);
+  MCAsmBackend *MAB = T.createMCAsmBackend(*STI, *MRI, Options);
+  std::unique_ptr<MCStreamer> Str(T.createMCObjectStreamer(
+      TT, Ctx, std::unique_ptr<MCAsmBackend>(MAB), MAB->createObjectWriter(OS),
+      std::unique_ptr<MCCodeEmitter>(T.createMCCodeEmitter(*MCII, *MRI, Ctx)),
+      *STI, /*RelaxAll=*/false, /*IncrementalLinkerCompatible=*/false,
+      /*DWARFMustBeAtTheEnd=*/false));
+  std::unique_ptr<MCAsmParser> Parser(
+      createMCAsmParser(SrcMgr, Ctx, *Str, *MAI));
+  std::unique_ptr<MCTargetAsmParser> TAP(
+      T.createMCAsmParser(*STI, *Parser, *MCII, Options));
+  Parser->setTargetParser(*TAP);
+  EXPECT_FALSE(Parser->Run(/*NoInitialTextSection=*/false));
+  Skip->setValue(true);
+  return std::string(Object.str());
+}
+
+// Return the code after the marker.
+StringRef getCode(StringRef Object) {
+  size_t Pos = Object.find("\xde\xad\xbe\xef");
+  EXPECT_NE(StringRef::npos, Pos);
+  return Object.substr(Pos + 4);
+}
+
+TEST(MCRelaxationTest, LaterRelaxationMovesTarget) {
+  const char *TripleName = "x86_64-pc-linux";
+  const Target *T = getTarget(TripleName);
+  if (!T)
+    return;
+
+  // The first jump is in range until the second one is relaxed, which only
+  // happens after the first one was visited and found not to need relaxing.
+  std::string Asm = std::string(Marker) + "  jmp .L1\n"
+                                          "  .fill 124, 1, 0x90\n"
+                                          "  jmp .L2\n"
+                                          ".L1:\n"
+                                          "  .fill 200, 1, 0x90\n"
+                                          ".L2:\n"
+                                          "  ret\n";
+  std::string Object = assemble(*T, TripleName, Asm, /*SkipUnchanged=*/true);
+  StringRef Code = getCode(Object);
+  ASSERT_GE(Code.size(), 5u + 124 + 5);
+  // Both jumps use a 32-bit displacement.
+  EXPECT_EQ('\xe9', Code[0]);
+  EXPECT_EQ(124 + 5, *reinterpret_cast<const uint8_t *>(Code.data() + 1));
+  EXPECT_EQ('\xe9', Code[5 + 124]);
+  EXPECT_EQ(Object, assemble(*T, TripleName, Asm, /*SkipUnchanged=*/false));
+}
+
+TEST(MCRelaxationTest, SameOutputAsVisitingEveryFragment) {
+  const char *TripleName = "x86_64-pc-linux";
+  const Target *T = getTarget(TripleName);
+  if (!T)
+    return;
+
+  // Branches at various distances, some of which only go out of range after
+  // others grow, along with alignment, line table entries and LEBs that
+  // depend on the layout.
+  std::string Asm;
+  raw_string_ostream OS(Asm);
+  OS << Marker << "  .file 1 \"t.c\"\n";
+  const unsigned NumBlocks = 400;
+  for (unsigned I = 0; I != NumBlocks; ++I) {
+    OS << ".Lb" << I << ":\n"
+       << "  .loc 1 " << I + 1 << "\n";
+    // Forward and backward branches over a varying number of blocks.
+    unsigned Fwd = I + 1 + (I * 7) % 23;
+    if (Fwd < NumBlocks)
+      OS << "  jne .Lb" << Fwd << "\n";
+    if (I >= 20 && I % 3 == 0)
+      OS << "  jmp .Lb" << I - 1 - (I * 5) % 19 << "\n";
+    OS << "  .fill " << 3 + (I * 11) % 17 << ", 1, 0x90\n";
+    if (I % 50 == 49)
+      OS << "  .p2align 4\n";
+  }
+  OS << "  ret\n"
+     << "  .section .data\n";
+  for (unsigned I = 0; I < NumBlocks; I += 37)
+    OS << "  .uleb128 .Lb" << I << " - .Lb0\n";
+  OS.flush();
+
+  EXPECT_EQ(assemble(*T, TripleName, Asm, /*SkipUnchanged=*/false),
+            assemble(*T, TripleName, Asm, /*SkipUnchanged=*/true));
+}
+
+TEST(MCRelaxationTest, AlignedDownPCMovesWithTarget) {
+  const char *TripleName = "thumbv7-linux-gnueabi";
+  const Target *T = getTarget(TripleName);
+  if (!T)
+    return;
+
+  // The ADR and its target both move by 2 once the second branch is relaxed,
+  // which happens after the ADR was found not to need relaxing. As the PC of
+  // the ADR is aligned down to 4, its offset is then no longer a multiple of
+  // 4, so the ADR has to be relaxed too. The first branch lays out the ADR
+  // and its target again before the ADR is visited.
+  std::string Asm = std::string("  .syntax unified\n"
+                                "  .thumb\n") +
+                    Marker +
+                    "  b .L0\n"
+                    "  b .L1\n"
+                    "  adr r0, .Ldata\n"
+                    "  .fill 2, 1, 0\n"
+                    ".Ldata:\n"
+                    "  .fill 4, 1, 0\n"
+                    ".L0:\n"
+                    "  .fill 2038, 1, 0\n"
+                    "  b .L2\n"
+                    ".L1:\n"
+                    "  .fill 3000, 1, 0\n"
+                    ".L2:\n"
+                    "  bx lr\n";
+  std::string Object = assemble(*T, TripleName, Asm, /*SkipUnchanged=*/true);
+  StringRef Code = getCode(Object);
+  ASSERT_GE(Code.size(), 10u);
+  // The second branch and the ADR use the 32-bit encodings.
+  EXPECT_EQ(0xf0, uint8_t(Code[3]) & 0xf8);
+  EXPECT_EQ(0xf2, uint8_t(Code[7]));
+  EXPECT_EQ(Object, assemble(*T, TripleName, Asm, /*SkipUnchanged=*/false));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,308 @@
+//===- unittest/ProfileData/MemProfTest.cpp ---------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ProfileData/MemProf.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/Symbolize/SymbolizableModule.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/RawMemProfReader.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Testing/Support/Error.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llvm::memprof;
+
+namespace {
+
+/// Symbolizes the addresses it is given the frames of.
+class MockSymbolizer : public symbolize::SymbolizableModule {
+public:
+  DenseMap<uint64_t, DIInliningInfo> Frames;
+
+  void addFrame(uint64_t Address, StringRef Function, uint32_t Line,
+                uint32_t StartLine, uint32_t Column) {
+    DILineInfo Info;
+    Info.FunctionName = std::string(Function);
+    Info.Line = Line;
+    Info.StartLine = StartLine;
+    Info.Column = Column;
+    Frames[Address].addFrame(Info);
+  }
+
+  DIInliningInfo symbolizeInlinedCode(object::SectionedAddress Address,
+                                      DILineInfoSpecifier,
+                                      bool) const override {
+    return Frames.lookup(Address.Address);
+  }
+
+  DILineInfo symbolizeCode(object::SectionedAddress, DILineInfoSpecifier,
+                           bool) const override {
+    llvm_unreachable("unused");
+  }
+  DIGlobal symbolizeData(object::SectionedAddress) const override {
+    llvm_unreachable("unused");
+  }
+  std::vector<DILocal> symbolizeFrame(object::SectionedAddress) const override {
+    llvm_unreachable("unused");
+  }
+  bool isWin32Module() const override { return false; }
+  uint64_t getModulePreferredBase() const override { return 0; }
+};
+
+/// Builds a raw profile the way the runtime writes it.
+struct RawProfile {
+  SmallVector<SegmentEntry, 2> Segments;
+  SmallVector<std::pair<uint64_t, MemInfoBlock>, 4> MIBs;
+  SmallVector<std::pair<uint64_t, SmallVector<uint64_t, 4>>, 4> Stacks;
+
+  std::string write() const {
+    std::string Data;
+    raw_string_ostream OS(Data);
+    support::endian::Writer LE(OS, support::little);
+    uint64_t SegmentOffset = sizeof(Header);
+    uint64_t MIBOffset =
+        SegmentOffset + sizeof(uint64_t) + Segments.size() * sizeof(SegmentEntry);
+    uint64_t StackOffset =
+        MIBOffset +
+        MIBs.size() * (sizeof(uint64_t) + sizeof(MemInfoBlock)) +
+        sizeof(uint64_t);
+    uint64_t TotalSize = StackOffset + sizeof(uint64_t);
+    for (const auto &Stack : Stacks)
+      TotalSize += (2 + Stack.second.size()) * sizeof(uint64_t);
+
+    LE.write<uint64_t>(MEMPROF_RAW_MAGIC_64);
+    LE.write<uint64_t>(MEMPROF_RAW_VERSION);
+    LE.write<uint64_t>(TotalSize);
+    LE.write<uint64_t>(SegmentOffset);
+    LE.write<uint64_t>(MIBOffset);
+    LE.write<uint64_t>(StackOffset);
+    LE.write<uint64_t>(Segments.size());
+    for (const SegmentEntry &Segment : Segments) {
+      LE.write<uint64_t>(Segment.Start);
+      LE.write<uint64_t>(Segment.End);
+      LE.write<uint64_t>(Segment.Offset);
+    }
+    LE.write<uint64_t>(MIBs.size());
+    for (const auto &MIB : MIBs) {
+      LE.write<uint64_t>(MIB.first);
+      OS.write(reinterpret_cast<const char *>(&MIB.second),
+               sizeof(MemInfoBlock));
+    }
+    LE.write<uint64_t>(Stacks.size());
+    for (const auto &Stack : Stacks) {
+      LE.write<uint64_t>(Stack.first);
+      LE.write<uint64_t>(Stack.second.size());
+      for (uint64_t PC : Stack.second)
+        LE.write<uint64_t>(PC);
+    }
+    return OS.str();
+  }
+};
+
+std::unique_ptr<RawMemProfReader> readRaw(StringRef Data,
+                                          std::unique_ptr<MockSymbolizer> S) {
+  auto ReaderOrErr = RawMemProfReader::create(
+      MemoryBuffer::getMemBufferCopy(Data), std::move(S));
+  EXPECT_THAT_EXPECTED(ReaderOrErr, Succeeded());
+  return ReaderOrErr ? std::move(*ReaderOrErr) : nullptr;
+}
+
+TEST(MemProfTest, PortableMemInfoBlockMerge) {
+  PortableMemInfoBlock A(MemInfoBlock(/*size=*/16, /*access_count=*/4,
+                                      /*alloc_timestamp=*/0,
+                                      /*dealloc_timestamp=*/10,
+                                      /*alloc_cpu=*/0, /*dealloc_cpu=*/1));
+  PortableMemInfoBlock B(MemInfoBlock(32, 2, 5, 105, 1, 1));
+  PortableMemInfoBlock Merged;
+  Merged.merge(A);
+  EXPECT_EQ(A, Merged);
+  Merged.merge(B);
+  EXPECT_EQ(2u, Merged.AllocCount);
+  EXPECT_EQ(6u, Merged.TotalAccessCount);
+  EXPECT_EQ(2u, Merged.MinAccessCount);
+  EXPECT_EQ(4u, Merged.MaxAccessCount);
+  EXPECT_EQ(48u, Merged.TotalSize);
+  EXPECT_EQ(16u, Merged.MinSize);
+  EXPECT_EQ(32u, Merged.MaxSize);
+  EXPECT_EQ(110u, Merged.TotalLifetime);
+  EXPECT_EQ(10u, Merged.MinLifetime);
+  EXPECT_EQ(100u, Merged.MaxLifetime);
+  EXPECT_EQ(1u, Merged.NumMigratedCpu);
+  EXPECT_EQ(55.0, Merged.getAverageLifetime());
+  EXPECT_EQ(6.0 / 48, Merged.getAccessDensity());
+}
+
+TEST(MemProfTest, RawProfileSymbolization) {
+  // The binary is mapped at 0x10000 from file offset 0x1000.
+  RawProfile Raw;
+  Raw.Segments.push_back({0x10000, 0x20000, 0x1000});
+  // Allocations from foo, inlined into bar, called from main, and from a
+  // library call back into main.
+  Raw.Stacks.push_back({1, {0x10010, 0x10110}});
+  Raw.Stacks.push_back({2, {0x50000, 0x10120}});
+  // Allocations from a second context of the first call, which symbolizes the
+  // same.
+  Raw.Stacks.push_back({3, {0x10010, 0x10110}});
+  Raw.MIBs.push_back({1, MemInfoBlock(8, 1, 0, 2000, 0, 0)});
+  Raw.MIBs.push_back({2, MemInfoBlock(64, 640, 0, 1, 0, 0)});
+  Raw.MIBs.push_back({3, MemInfoBlock(8, 3, 0, 1000, 0, 0)});
+
+  auto Symbolizer = std::make_unique<MockSymbolizer>();
+  Symbolizer->addFrame(0x1010, "foo", 12, 10, 5);
+  Symbolizer->addFrame(0x1010, "bar", 21, 20, 3);
+  Symbolizer->addFrame(0x1110, "main", 31, 30, 7);
+  Symbolizer->addFrame(0x1120, "main", 32, 30, 7);
+  std::unique_ptr<RawMemProfReader> Reader =
+      readRaw(Raw.write(), std::move(Symbolizer));
+  ASSERT_TRUE(Reader);
+
+  const RawMemProfReader::RecordMap &Records = Reader->getRecords();
+  ASSERT_EQ(2u, Records.size());
+  uint64_t Foo = GlobalValue::getGUID("foo");
+  uint64_t Bar = GlobalValue::getGUID("bar");
+  uint64_t Main = GlobalValue::getGUID("main");
+
+  ASSERT_EQ(1u, Records.count(Foo));
+  const MemProfRecord &FooRecord = Records.lookup(Foo);
+  ASSERT_EQ(1u, FooRecord.AllocSites.size());
+  const AllocationInfo &FooSite = FooRecord.AllocSites[0];
+  ASSERT_EQ(3u, FooSite.CallStack.size());
+  EXPECT_EQ(Frame(Foo, 2, 5, true), FooSite.CallStack[0]);
+  EXPECT_EQ(Frame(Bar, 1, 3, false), FooSite.CallStack[1]);
+  EXPECT_EQ(Frame(Main, 1, 7, false), FooSite.CallStack[2]);
+  EXPECT_EQ(2u, FooSite.Info.AllocCount);
+  EXPECT_EQ(3000u, FooSite.Info.TotalLifetime);
+
+  // The library frame is dropped.
+  ASSERT_EQ(1u, Records.count(Main));
+  const MemProfRecord &MainRecord = Records.lookup(Main);
+  ASSERT_EQ(1u, MainRecord.AllocSites.size());
+  ASSERT_EQ(1u, MainRecord.AllocSites[0].CallStack.size());
+  EXPECT_EQ(Frame(Main, 2, 7, false), MainRecord.AllocSites[0].CallStack[0]);
+  EXPECT_EQ(640u, MainRecord.AllocSites[0].Info.TotalAccessCount);
+}
+
+TEST(MemProfTest, RawProfileErrors) {
+  RawProfile Raw;
+  Raw.MIBs.push_back({1, MemInfoBlock(8, 1, 0, 1, 0, 0)});
+  std::string Data = Raw.write();
+
+  // The MIB refers to a missing stack.
+  auto ReaderOrErr =
+      RawMemProfReader::create(MemoryBuffer::getMemBufferCopy(Data),
+                               std::make_unique<MockSymbolizer>());
+  EXPECT_THAT_EXPECTED(ReaderOrErr, Failed<InstrProfError>());
+
+  Raw.Stacks.push_back({1, {0x10}});
+  Data = Raw.write();
+  ReaderOrErr = RawMemProfReader::create(
+      MemoryBuffer::getMemBufferCopy(Data.substr(0, Data.size() - 8)),
+      std::make_unique<MockSymbolizer>());
+  EXPECT_THAT_EXPECTED(ReaderOrErr, Failed<InstrProfError>());
+
+  EXPECT_FALSE(RawMemProfReader::hasFormat(
+      *MemoryBuffer::getMemBufferCopy("not a profile")));
+}
+
+TEST(MemProfTest, IndexedRoundTripAndMerge) {
+  PortableMemInfoBlock Cold(MemInfoBlock(4096, 1, 0, 5000, 0, 0));
+  PortableMemInfoBlock Hot(MemInfoBlock(64, 6400, 0, 0, 0, 0));
+  Frame Leaf(GlobalValue::getGUID("foo"), 2, 5, false);
+  Frame Caller1(GlobalValue::getGUID("main"), 1, 3, false);
+  Frame Caller2(GlobalValue::getGUID("main"), 4, 3, false);
+
+  MemProfRecord First;
+  First.AllocSites.push_back(AllocationInfo({Leaf, Caller1}, Cold));
+  MemProfRecord Second;
+  Second.AllocSites.push_back(AllocationInfo({Leaf, Caller1}, Cold));
+  Second.AllocSites.push_back(AllocationInfo({Leaf, Caller2}, Hot));
+
+  MemProfWriter Writer;
+  Writer.addRecord(Leaf.Function, First);
+  Writer.addRecord(Leaf.Function, Second);
+  auto ReaderOrErr = IndexedMemProfReader::create(Writer.writeBuffer());
+  ASSERT_THAT_EXPECTED(ReaderOrErr, Succeeded());
+  const IndexedMemProfReader &Reader = **ReaderOrErr;
+
+  auto RecordOrErr = Reader.getRecord(Leaf.Function);
+  ASSERT_THAT_EXPECTED(RecordOrErr, Succeeded());
+  ASSERT_EQ(2u, RecordOrErr->AllocSites.size());
+  const AllocationInfo &ColdSite = RecordOrErr->AllocSites[0];
+  EXPECT_EQ(2u, ColdSite.CallStack.size());
+  EXPECT_EQ(Caller1, ColdSite.CallStack[1]);
+  EXPECT_EQ(2u, ColdSite.Info.AllocCount);
+  EXPECT_EQ(10000u, ColdSite.Info.TotalLifetime);
+  EXPECT_EQ(AllocationInfo({Leaf, Caller2}, Hot), RecordOrErr->AllocSites[1]);
+
+  EXPECT_THAT_EXPECTED(Reader.getRecord(Caller1.Function),
+                       Failed<InstrProfError>());
+  SmallVector<uint64_t, 1> Functions;
+  for (uint64_t Function : Reader.functions())
+    Functions.push_back(Function);
+  ASSERT_EQ(1u, Functions.size());
+  EXPECT_EQ(Leaf.Function, Functions[0]);
+
+  EXPECT_THAT_EXPECTED(
+      IndexedMemProfReader::create(MemoryBuffer::getMemBufferCopy("bad")),
+      Failed<InstrProfError>());
+}
+
+TEST(MemProfTest, IndexedCorruptRecord) {
+  PortableMemInfoBlock Info(MemInfoBlock(64, 10, 0, 0, 0, 0));
+  Frame Leaf(GlobalValue::getGUID("foo"), 2, 5, false);
+  MemProfRecord Record;
+  Record.AllocSites.push_back(AllocationInfo({Leaf}, Info));
+  MemProfWriter Writer;
+  Writer.addRecord(Leaf.Function, Record);
+  std::string Data = std::string(Writer.writeBuffer()->getBuffer());
+
+  // The only bucket follows the header. It holds the number of its items,
+  // and the hash, key length, data length, key and data of the record.
+  const size_t DataLenOffset =
+      sizeof(IndexedHeader) + sizeof(uint16_t) + 2 * sizeof(uint64_t);
+  const size_t NumSitesOffset = DataLenOffset + 2 * sizeof(uint64_t);
+  const size_t NumFramesOffset = NumSitesOffset + sizeof(uint64_t);
+  auto getRecordWith = [&](size_t Offset, uint64_t Value) {
+    std::string Corrupt = Data;
+    support::endian::write<uint64_t, support::little, support::unaligned>(
+        &Corrupt[Offset], Value);
+    auto ReaderOrErr =
+        IndexedMemProfReader::create(MemoryBuffer::getMemBufferCopy(Corrupt));
+    EXPECT_THAT_EXPECTED(ReaderOrErr, Succeeded());
+    return (*ReaderOrErr)->getRecord(Leaf.Function);
+  };
+  EXPECT_THAT_EXPECTED(getRecordWith(NumFramesOffset, 1), Succeeded());
+  EXPECT_THAT_EXPECTED(getRecordWith(NumSitesOffset, 2),
+                       Failed<InstrProfError>());
+  EXPECT_THAT_EXPECTED(getRecordWith(NumSitesOffset, UINT64_MAX),
+                       Failed<InstrProfError>());
+  EXPECT_THAT_EXPECTED(getRecordWith(NumFramesOffset, 2),
+                       Failed<InstrProfError>());
+  EXPECT_THAT_EXPECTED(getRecordWith(NumFramesOffset, UINT64_MAX / 8),
+                       Failed<InstrProfError>());
+
+  // The data length of the record runs past the end of the profile.
+  EXPECT_THAT_EXPECTED(getRecordWith(DataLenOffset, Data.size()),
+                       Failed<InstrProfError>());
+
+  // A bucket of the table is out of the profile.
+  uint64_t TableOffset = support::endian::read<uint64_t, support::little,
+                                               support::unaligned>(
+      &Data[offsetof(IndexedHeader, TableOffset)]);
+  std::string Corrupt = Data;
+  support::endian::write<uint64_t, support::little, support::unaligned>(
+      &Corrupt[TableOffset + 2 * sizeof(uint64_t)], Data.size());
+  EXPECT_THAT_EXPECTED(
+      IndexedMemProfReader::create(MemoryBuffer::getMemBufferCopy(Corrupt)),
+      Failed<InstrProfError>());
+}
+
+} // end anonymous namespace
@@ -8,6 +8,9 @@
 
 #include "llvm/Support/CachePruning.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include "gtest/gtest.h"
 
 using namespace llvm;
@@ -94,3 +97,93 @@ TEST(CachePruningPolicyParser, Errors) {
   EXPECT_EQ("Unknown key: 'foo'",
             toString(parseCachePruningPolicy("foo=bar").takeError()));
 }
+
+TEST(CachePruning, EntryPath) {
+  std::string EntryPath = getCacheEntryPath("cache", "0123abcd");
+  EXPECT_EQ("llvmcache-0123abcd", sys::path::filename(EntryPath));
+  StringRef Shard = sys::path::filename(sys::path::parent_path(EntryPath));
+  EXPECT_EQ(2u, Shard.size());
+  EXPECT_EQ(std::string::npos, Shard.find_first_not_of("0123456789abcdef"));
+  EXPECT_EQ("cache", sys::path::parent_path(sys::path::parent_path(EntryPath)));
+  EXPECT_EQ(EntryPath, getCacheEntryPath("cache", "0123abcd"));
+}
+
+// With an index, a cache over its file budget is pruned even if the pruning
+// interval has not expired yet.
+TEST(CachePruning, IndexBudget) {
+  SmallString<128> CacheDir;
+  ASSERT_FALSE(sys::fs::createUniqueDirectory("cache-pruning", CacheDir));
+
+  CachePruningPolicy Policy;
+  Policy.Interval = std::chrono::hours(1);
+  Policy.Expiration = std::chrono::seconds(0);
+  Policy.MaxSizePercentageOfAvailableSpace = 0;
+  Policy.MaxSizeFiles = 2;
+
+  // The first call creates the timestamp file and scans the empty cache.
+  EXPECT_TRUE(pruneCache(CacheDir, Policy));
+
+  std::vector<std::string> Keys = {"a1", "b2", "c3"};
+  for (StringRef Key : Keys) {
+    std::string EntryPath = getCacheEntryPath(CacheDir, Key);
+    ASSERT_FALSE(sys::fs::create_directories(sys::path::parent_path(EntryPath)));
+    std::error_code EC;
+    raw_fd_ostream OS(EntryPath, EC);
+    ASSERT_FALSE(EC);
+    OS << "data";
+    OS.close();
+    addCacheIndexEntry(CacheDir, Key, 4);
+
+    // The index is what tells pruneCache that the cache is over budget.
+    CachePruningStats Stats;
+    EXPECT_EQ(Key == "c3", pruneCache(CacheDir, Policy, &Stats));
+    EXPECT_EQ(Key == "c3" ? 1u : 0u, Stats.NumEvicted);
+  }
+
+  unsigned NumLeft = 0;
+  for (StringRef Key : Keys)
+    NumLeft += sys::fs::exists(getCacheEntryPath(CacheDir, Key));
+  EXPECT_EQ(2u, NumLeft);
+
+  // The pruning rewrote the index, so the cache is within budget again.
+  EXPECT_FALSE(pruneCache(CacheDir, Policy));
+
+  ASSERT_FALSE(sys::fs::remove_directories(CacheDir));
+}
+
+// Files that can't be removed are not counted as evicted.
+TEST(CachePruning, FailedRemove) {
+  SmallString<128> CacheDir;
+  ASSERT_FALSE(sys::fs::createUniqueDirectory("cache-pruning", CacheDir));
+
+  CachePruningPolicy Policy;
+  Policy.Interval = std::chrono::seconds(0);
+  Policy.MaxSizePercentageOfAvailableSpace = 0;
+  Policy.MaxSizeBytes = 1;
+
+  std::string EntryPath = getCacheEntryPath(CacheDir, "a1");
+  ASSERT_FALSE(sys::fs::create_directories(sys::path::parent_path(EntryPath)));
+  std::error_code EC;
+  raw_fd_ostream OS(EntryPath, EC);
+  ASSERT_FALSE(EC);
+  OS << "data";
+  OS.close();
+
+  // A non-empty directory named like a cache entry can't be removed.
+  SmallString<128> DirPath(CacheDir);
+  sys::path::append(DirPath, "llvmcache-dir", "file");
+  ASSERT_FALSE(sys::fs::create_directories(sys::path::parent_path(DirPath)));
+  raw_fd_ostream DirOS(DirPath, EC);
+  ASSERT_FALSE(EC);
+  DirOS << "data";
+  DirOS.close();
+
+  CachePruningStats Stats;
+  EXPECT_TRUE(pruneCache(CacheDir, Policy, &Stats));
+  EXPECT_FALSE(sys::fs::exists(EntryPath));
+  EXPECT_TRUE(sys::fs::exists(DirPath));
+  EXPECT_EQ(1u, Stats.NumEvicted);
+  EXPECT_EQ(4u, Stats.EvictedBytes);
+
+  ASSERT_FALSE(sys::fs::remove_directories(CacheDir));
+}
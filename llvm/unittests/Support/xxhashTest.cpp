@@ -8,6 +8,7 @@
 
 #include "llvm/Support/xxhash.h"
 #include "gtest/gtest.h"
+#include <vector>
 
 using namespace llvm;
 
@@ -17,3 +18,42 @@ TEST(xxhashTest, Basic) {
   EXPECT_EQ(0x69196c1b3af0bff9U,
             xxHash64("0123456789abcdefghijklmnopqrstuvwxyz"));
 }
+
+TEST(xxhashTest, xxh3) {
+  EXPECT_EQ(0xab6e5f64077e7d8aU, xxh3_64bits("foo"));
+  EXPECT_EQ(0xd463c860a032d362U, xxh3_64bits("bar"));
+  EXPECT_EQ(0xffb92a87c6306d55U,
+            xxh3_64bits("0123456789abcdefghijklmnopqrstuvwxyz"));
+
+  // Cover every input size class, including inputs that take the SIMD path.
+  std::vector<uint8_t> Data(10000);
+  for (size_t I = 0; I != Data.size(); ++I)
+    Data[I] = I * 131 + 7;
+  struct {
+    size_t Len;
+    uint64_t Hash64;
+    XXH128_hash_t Hash128; // {low64, high64}
+  } Tests[] = {
+      {0, 0x2d06800538d394c2U, {0x6001c324468d497fU, 0x99aa06d3014798d8U}},
+      {1, 0x4c5cca45d0f4811fU, {0x4c5cca45d0f4811fU, 0x495b62073ef70ca4U}},
+      {3, 0x6e3e2670e61106acU, {0x6e3e2670e61106acU, 0x390cdc5b4a895dd7U}},
+      {4, 0x5c4c63133443d03fU, {0x3d668af6f2a44d77U, 0xaa6e2f274640a3f4U}},
+      {8, 0xf9fd4dd0b04d78f5U, {0x61ddbe7f31a6100dU, 0x6a86a3bda6af4e3dU}},
+      {9, 0x7c20df9712c26edfU, {0x8c7b67fd458a936bU, 0x664c7ca18afd6255U}},
+      {16, 0x86abf6baccea0858U, {0xe2ce54a7c19c730dU, 0x7f9a218b0425449aU}},
+      {17, 0xb58bf5dc5022d071U, {0x8d96ef110fcdebb4U, 0x66fc23f6439dbd77U}},
+      {128, 0x10d17f72c0ccba41U, {0xff361dec1385710aU, 0xaec730751478556cU}},
+      {129, 0x1648bdc3db49d1a2U, {0x4545b3a09738e31aU, 0x98cd36ccbb557926U}},
+      {240, 0xb6cfaf343fab81e6U, {0x3f2c53e72293711fU, 0x5293e17bf553903dU}},
+      {241, 0x956cae592c67279eU, {0x956cae592c67279eU, 0xb53840fe3fedf161U}},
+      {1024, 0x70bd377d9574f4bbU, {0x70bd377d9574f4bbU, 0xf69630613f24324dU}},
+      {1025, 0x66c4487c41e127a7U, {0x66c4487c41e127a7U, 0x621af7b8277effa4U}},
+      {4096, 0x9ddd66c14af0daffU, {0x9ddd66c14af0daffU, 0x3e0ff38fa88a55eaU}},
+      {10000, 0x9e5d23d943285455U, {0x9e5d23d943285455U, 0x97edc2800f0e8bbbU}},
+  };
+  for (const auto &T : Tests) {
+    ArrayRef<uint8_t> Input(Data.data(), T.Len);
+    EXPECT_EQ(T.Hash64, xxh3_64bits(Input)) << "length " << T.Len;
+    EXPECT_EQ(T.Hash128, xxh3_128bits(Input)) << "length " << T.Len;
+  }
+}
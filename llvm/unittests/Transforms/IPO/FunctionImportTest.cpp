@@ -0,0 +1,314 @@
+//===- FunctionImportTest.cpp - Unit tests for the ThinLTO import lists ---===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/IPO/FunctionImport.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/FlatSummaryIndex.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Testing/Support/Error.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+class FunctionImportTest : public testing::Test {
+protected:
+  static const unsigned NumModules = 8;
+
+  LLVMContext Context;
+  std::vector<SmallString<0>> Bitcode;
+  ModuleSummaryIndex CombinedIndex{/*HaveGVs=*/false};
+  StringMap<GVSummaryMapTy> ModuleToDefinedGVSummaries;
+
+  static std::string getModulePath(unsigned I) { return "m" + utostr(I); }
+
+  // Module I defines f<I>, which calls the functions of the next two modules
+  // and references the global of the next one. It also defines d<I>, which
+  // calls a<J>, an alias of e<J> in the next module.
+  void SetUp() override {
+    Bitcode.resize(NumModules);
+    for (unsigned I = 0; I != NumModules; ++I) {
+      unsigned J = (I + 1) % NumModules, K = (I + 2) % NumModules;
+      std::string Assembly;
+      raw_string_ostream OS(Assembly);
+      OS << "@g" << I << " = global i32 " << I << "\n"
+         << "@g" << J << " = external global i32\n"
+         << "@a" << I << " = alias void (), void ()* @e" << I << "\n"
+         << "declare void @f" << J << "()\n"
+         << "declare void @a" << J << "()\n";
+      if (K != I)
+        OS << "declare void @f" << K << "()\n";
+      OS << "define void @f" << I << "() {\n"
+         << "  call void @f" << J << "()\n"
+         << "  call void @f" << K << "()\n"
+         << "  store i32 0, i32* @g" << J << "\n"
+         << "  ret void\n"
+         << "}\n"
+         << "define void @e" << I << "() {\n"
+         << "  ret void\n"
+         << "}\n"
+         << "define void @d" << I << "() {\n"
+         << "  call void @a" << J << "()\n"
+         << "  ret void\n"
+         << "}\n";
+      OS.flush();
+
+      SMDiagnostic Err;
+      std::unique_ptr<Module> M =
+          parseAssemblyString(Assembly, Err, Context);
+      ASSERT_TRUE(M) << Err.getMessage().str();
+      ProfileSummaryInfo PSI(*M);
+      ModuleSummaryIndex Index = buildModuleSummaryIndex(*M, nullptr, &PSI);
+      raw_svector_ostream BOS(Bitcode[I]);
+      WriteBitcodeToFile(*M, BOS, /*ShouldPreserveUseListOrder=*/false,
+                         &Index);
+      MemoryBufferRef Buffer(
+          StringRef(Bitcode[I].data(), Bitcode[I].size()), getModulePath(I));
+      ASSERT_FALSE(
+          errorToBool(readModuleSummaryIndex(Buffer, CombinedIndex, I)));
+    }
+    CombinedIndex.collectDefinedGVSummariesPerModule(
+        ModuleToDefinedGVSummaries);
+  }
+
+  static void setImportThreads(unsigned Threads) {
+    auto *ImportThreads = static_cast<cl::opt<unsigned> *>(
+        cl::getRegisteredOptions().lookup("thinlto-import-threads"));
+    ASSERT_TRUE(ImportThreads);
+    ImportThreads->setValue(Threads);
+  }
+
+  // Compute the import and export lists with the given number of threads, in
+  // a form that does not depend on hash table order.
+  std::vector<std::string> computeImports(unsigned Threads) {
+    setImportThreads(Threads);
+    StringMap<FunctionImporter::ImportMapTy> ImportLists;
+    StringMap<FunctionImporter::ExportSetTy> ExportLists;
+    ComputeCrossModuleImport(CombinedIndex, ModuleToDefinedGVSummaries,
+                             ImportLists, ExportLists);
+    setImportThreads(1);
+    return format(ImportLists, ExportLists);
+  }
+
+  // Compute the same lists over the flat form of the index.
+  std::vector<std::string> computeImports(const FlatSummaryIndex &Index,
+                                          const BitVector &LiveValues,
+                                          unsigned Threads) {
+    setImportThreads(Threads);
+    StringMap<FunctionImporter::ImportMapTy> ImportLists;
+    StringMap<FunctionImporter::GUIDExportSetTy> ExportLists;
+    ComputeCrossModuleImport(Index, LiveValues, ImportLists, ExportLists);
+    setImportThreads(1);
+    return format(ImportLists, ExportLists);
+  }
+
+  static GlobalValue::GUID getGUID(ValueInfo VI) { return VI.getGUID(); }
+  static GlobalValue::GUID getGUID(GlobalValue::GUID GUID) { return GUID; }
+
+  template <class ExportSetTy>
+  static std::vector<std::string>
+  format(const StringMap<FunctionImporter::ImportMapTy> &ImportLists,
+         const StringMap<ExportSetTy> &ExportLists) {
+    std::vector<std::string> Result;
+    for (auto &ModuleImports : ImportLists)
+      for (auto &FromModule : ModuleImports.second)
+        for (GlobalValue::GUID GUID : FromModule.second)
+          Result.push_back((ModuleImports.first() + " imports " +
+                            Twine(GUID) + " from " + FromModule.first())
+                               .str());
+    for (auto &ModuleExports : ExportLists)
+      for (const auto &Export : ModuleExports.second)
+        Result.push_back(
+            (ModuleExports.first() + " exports " + Twine(getGUID(Export)))
+                .str());
+    llvm::sort(Result);
+    return Result;
+  }
+
+  static std::string imports(unsigned Into, StringRef Name, unsigned From) {
+    return (getModulePath(Into) + " imports " +
+            Twine(GlobalValue::getGUID(Name)) + " from " + getModulePath(From))
+        .str();
+  }
+
+  static std::string exports(unsigned From, StringRef Name) {
+    return (getModulePath(From) + " exports " +
+            Twine(GlobalValue::getGUID(Name)))
+        .str();
+  }
+
+  static PrevailingType isPrevailing(GlobalValue::GUID) {
+    return PrevailingType::Yes;
+  }
+
+  // Write the flat form of the combined index and read it back.
+  std::unique_ptr<MemoryBuffer> writeFlatIndex() {
+    return FlatSummaryIndexBuilder(CombinedIndex).writeBuffer();
+  }
+};
+
+TEST_F(FunctionImportTest, ParallelMatchesSerial) {
+  std::vector<std::string> Serial = computeImports(1);
+  for (unsigned I = 0; I != NumModules; ++I) {
+    unsigned J = (I + 1) % NumModules, K = (I + 2) % NumModules;
+    EXPECT_TRUE(is_contained(Serial, imports(I, "f" + utostr(J), J)));
+    EXPECT_TRUE(is_contained(Serial, imports(I, "f" + utostr(K), K)));
+    EXPECT_TRUE(is_contained(Serial, exports(J, "f" + utostr(J))));
+    // The importing modules reference the global of the next module.
+    EXPECT_TRUE(is_contained(Serial, exports(K, "g" + utostr(K))));
+  }
+
+  for (unsigned Threads : {2u, 4u, 0u})
+    EXPECT_EQ(Serial, computeImports(Threads)) << "with " << Threads
+                                                << " threads";
+}
+
+TEST_F(FunctionImportTest, FlatIndexRoundTrip) {
+  std::unique_ptr<MemoryBuffer> Buffer = writeFlatIndex();
+  Expected<FlatSummaryIndex> IndexOrErr =
+      FlatSummaryIndex::create(Buffer->getMemBufferRef());
+  ASSERT_THAT_EXPECTED(IndexOrErr, Succeeded());
+  FlatSummaryIndex &Index = *IndexOrErr;
+
+  ASSERT_EQ(CombinedIndex.size(), Index.getNumValues());
+  EXPECT_EQ(unsigned(NumModules), Index.getNumModules());
+  for (const auto &Entry : CombinedIndex) {
+    FlatSummaryIndex::ValueID V = Index.findValue(Entry.first);
+    ASSERT_NE(flatsummary::NoID, V);
+    EXPECT_EQ(Entry.first, Index.getGUID(V));
+    auto Summaries = Index.summaries(V);
+    ASSERT_EQ(Entry.second.SummaryList.size(),
+              size_t(std::distance(Summaries.begin(), Summaries.end())));
+    auto S = Summaries.begin();
+    for (const auto &GVS : Entry.second.SummaryList) {
+      const flatsummary::SummaryEntry &Summary = Index.getSummary(*S);
+      EXPECT_EQ(GVS->getSummaryKind(), Summary.Kind);
+      EXPECT_EQ(GVS->modulePath(), Index.getModulePath(Summary.Module));
+      std::vector<GlobalValue::GUID> Refs, FlatRefs;
+      for (const ValueInfo &Ref : GVS->refs())
+        Refs.push_back(Ref.getGUID());
+      for (FlatSummaryIndex::ValueID Ref : Index.refs(*S))
+        FlatRefs.push_back(Index.getGUID(Ref));
+      EXPECT_EQ(Refs, FlatRefs);
+      if (auto *FS = dyn_cast<FunctionSummary>(GVS.get())) {
+        EXPECT_EQ(FS->instCount(), Summary.InstCount);
+        std::vector<GlobalValue::GUID> Calls, FlatCalls;
+        for (const auto &Edge : FS->calls())
+          Calls.push_back(Edge.first.getGUID());
+        for (const flatsummary::CallEntry &Edge : Index.calls(*S))
+          FlatCalls.push_back(Index.getGUID(Edge.Callee));
+        EXPECT_EQ(Calls, FlatCalls);
+      }
+      if (auto *AS = dyn_cast<AliasSummary>(GVS.get())) {
+        FlatSummaryIndex::SummaryID Base = Index.getBaseObject(*S);
+        ASSERT_NE(flatsummary::NoID, Base);
+        EXPECT_EQ(AS->getAliaseeGUID(),
+                  Index.getGUID(Index.getSummary(Base).Value));
+      }
+      ++S;
+    }
+  }
+  EXPECT_EQ(flatsummary::NoID, Index.findValue(GlobalValue::getGUID("none")));
+}
+
+TEST_F(FunctionImportTest, FlatIndexRejectsCorruption) {
+  std::unique_ptr<MemoryBuffer> Buffer = writeFlatIndex();
+  StringRef Data = Buffer->getBuffer();
+  auto Read = [](StringRef Data) {
+    return FlatSummaryIndex::create(MemoryBufferRef(Data, "flat"));
+  };
+  ASSERT_THAT_EXPECTED(Read(Data), Succeeded());
+
+  EXPECT_THAT_EXPECTED(Read(Data.drop_back()), Failed());
+  EXPECT_THAT_EXPECTED(Read(Data.take_front(sizeof(flatsummary::Header) - 1)),
+                       Failed());
+
+  std::string BadMagic = Data.str();
+  BadMagic[0] ^= 1;
+  EXPECT_THAT_EXPECTED(Read(BadMagic), Failed());
+
+  // Make the first reference point past the last value.
+  const auto *H = reinterpret_cast<const flatsummary::Header *>(Data.data());
+  ASSERT_NE(0u, uint32_t(H->NumRefs));
+  size_t RefsOffset =
+      sizeof(flatsummary::Header) +
+      H->NumValues * (sizeof(uint64_t) + sizeof(flatsummary::ValueEntry)) +
+      H->NumSummaries * sizeof(flatsummary::SummaryEntry) +
+      H->NumCalls * sizeof(flatsummary::CallEntry);
+  std::string BadRef = Data.str();
+  support::endian::write32le(&BadRef[RefsOffset], H->NumValues);
+  EXPECT_THAT_EXPECTED(Read(BadRef), Failed());
+}
+
+TEST_F(FunctionImportTest, FlatDeadSymbolsMatch) {
+  std::unique_ptr<MemoryBuffer> Buffer = writeFlatIndex();
+  Expected<FlatSummaryIndex> IndexOrErr =
+      FlatSummaryIndex::create(Buffer->getMemBufferRef());
+  ASSERT_THAT_EXPECTED(IndexOrErr, Succeeded());
+
+  DenseSet<GlobalValue::GUID> Preserved = {GlobalValue::getGUID("d0"),
+                                           GlobalValue::getGUID("f4")};
+  BitVector LiveValues;
+  computeDeadSymbols(*IndexOrErr, Preserved, isPrevailing, LiveValues);
+  computeDeadSymbols(CombinedIndex, Preserved, isPrevailing);
+
+  for (const auto &Entry : CombinedIndex) {
+    if (Entry.second.SummaryList.empty())
+      continue;
+    bool Live = CombinedIndex.isGlobalValueLive(
+        Entry.second.SummaryList.front().get());
+    EXPECT_EQ(Live, LiveValues.test(IndexOrErr->findValue(Entry.first)))
+        << Entry.first;
+  }
+  // d0 calls e1 through its alias, and f4 reaches all the other f<I>.
+  auto IsLive = [&](StringRef Name) {
+    return LiveValues.test(IndexOrErr->findValue(GlobalValue::getGUID(Name)));
+  };
+  EXPECT_TRUE(IsLive("a1"));
+  EXPECT_TRUE(IsLive("e1"));
+  EXPECT_TRUE(IsLive("f0"));
+  EXPECT_FALSE(IsLive("d1"));
+  EXPECT_FALSE(IsLive("e2"));
+}
+
+TEST_F(FunctionImportTest, FlatImportsMatch) {
+  std::unique_ptr<MemoryBuffer> Buffer = writeFlatIndex();
+  Expected<FlatSummaryIndex> IndexOrErr =
+      FlatSummaryIndex::create(Buffer->getMemBufferRef());
+  ASSERT_THAT_EXPECTED(IndexOrErr, Succeeded());
+
+  // Without dead stripping everything is live.
+  BitVector LiveValues;
+  computeDeadSymbols(*IndexOrErr, {}, isPrevailing, LiveValues);
+  EXPECT_TRUE(LiveValues.all());
+  EXPECT_EQ(computeImports(1), computeImports(*IndexOrErr, LiveValues, 1));
+
+  // a2 is live, but its caller d1 is not, so it is not imported.
+  DenseSet<GlobalValue::GUID> Preserved = {GlobalValue::getGUID("d0"),
+                                           GlobalValue::getGUID("f4"),
+                                           GlobalValue::getGUID("a2")};
+  computeDeadSymbols(*IndexOrErr, Preserved, isPrevailing, LiveValues);
+  computeDeadSymbols(CombinedIndex, Preserved, isPrevailing);
+  std::vector<std::string> Serial = computeImports(1);
+  EXPECT_TRUE(is_contained(Serial, imports(0, "a1", 1)));
+  EXPECT_FALSE(is_contained(Serial, imports(1, "a2", 2)));
+  for (unsigned Threads : {1u, 2u, 0u})
+    EXPECT_EQ(Serial, computeImports(*IndexOrErr, LiveValues, Threads))
+        << "with " << Threads << " threads";
+}
+
+} // end anonymous namespace
@@ -0,0 +1,156 @@
+//===- FunctionSpecializationTest.cpp - Function specialization tests -----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/IPO/FunctionSpecialization.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+class FunctionSpecializationTest : public unittest::PassTest {
+protected:
+  FunctionSpecializationTest() : PassTest("FunctionSpecializationTest") {}
+
+  bool run(Module &M) { return runPass(FunctionSpecializationPass(), M); }
+};
+
+TEST_F(FunctionSpecializationTest, SpecializeFunctionPointerArgument) {
+  std::unique_ptr<Module> M = parse(R"(
+    define internal i32 @compute(i32 %x, i32 (i32)* %op) {
+    entry:
+      %r = call i32 %op(i32 %x)
+      ret i32 %r
+    }
+
+    define i32 @plus(i32 %a) {
+      %r = add i32 %a, 1
+      ret i32 %r
+    }
+
+    define i32 @minus(i32 %a) {
+      %r = sub i32 %a, 1
+      ret i32 %r
+    }
+
+    define i32 @main(i32 %n) {
+      %a = call i32 @compute(i32 %n, i32 (i32)* @plus)
+      %b = call i32 @compute(i32 %n, i32 (i32)* @minus)
+      %s = add i32 %a, %b
+      ret i32 %s
+    }
+  )");
+  ASSERT_TRUE(M);
+  ASSERT_TRUE(run(*M));
+
+  // Both call sites now call a clone whose indirect call has become a direct
+  // call to the function that the call site passed.
+  Function *Main = M->getFunction("main");
+  Function *Compute = M->getFunction("compute");
+  unsigned NumCalls = 0;
+  for (Instruction &I : Main->getEntryBlock()) {
+    auto *CB = dyn_cast<CallBase>(&I);
+    if (!CB)
+      continue;
+    Function *Clone = CB->getCalledFunction();
+    ASSERT_TRUE(Clone);
+    EXPECT_NE(Compute, Clone);
+    EXPECT_TRUE(Clone->hasInternalLinkage());
+    auto *Inner = cast<CallBase>(&Clone->getEntryBlock().front());
+    EXPECT_EQ(CB->getArgOperand(1), Inner->getCalledOperand());
+    ++NumCalls;
+  }
+  EXPECT_EQ(2u, NumCalls);
+}
+
+TEST_F(FunctionSpecializationTest, RecursiveCallsStayInClone) {
+  std::unique_ptr<Module> M = parse(R"(
+    define void @walk(i32 %n, void (i32)* %visit) {
+    entry:
+      %done = icmp eq i32 %n, 0
+      br i1 %done, label %exit, label %body
+
+    body:
+      call void %visit(i32 %n)
+      %m = sub i32 %n, 1
+      call void @walk(i32 %m, void (i32)* %visit)
+      br label %exit
+
+    exit:
+      ret void
+    }
+
+    define void @print(i32 %a) {
+      ret void
+    }
+
+    define void @count(i32 %a) {
+      ret void
+    }
+
+    define void @main(i32 %n) {
+      call void @walk(i32 %n, void (i32)* @print)
+      call void @walk(i32 %n, void (i32)* @count)
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  ASSERT_TRUE(run(*M));
+
+  Function *Walk = M->getFunction("walk");
+  for (Instruction &I : M->getFunction("main")->getEntryBlock()) {
+    auto *CB = dyn_cast<CallBase>(&I);
+    if (!CB)
+      continue;
+    Function *Clone = CB->getCalledFunction();
+    ASSERT_NE(Walk, Clone);
+    for (Instruction &CloneI : *Clone->getEntryBlock().getNextNode()) {
+      if (auto *Inner = dyn_cast<CallBase>(&CloneI)) {
+        EXPECT_TRUE(Inner->getCalledFunction() == Clone ||
+                    Inner->getCalledOperand() == CB->getArgOperand(1));
+      }
+    }
+  }
+
+  // The original is still there for other callers.
+  EXPECT_FALSE(Walk->use_empty());
+}
+
+TEST_F(FunctionSpecializationTest, NoSpecializationWithoutBenefit) {
+  std::unique_ptr<Module> M = parse(R"(
+    define internal i32 @id(i32 %x, i32 %unused) {
+      ret i32 %x
+    }
+
+    define internal void @noclone(void ()* %f) noduplicate {
+      call void %f()
+      ret void
+    }
+
+    define void @g() {
+      ret void
+    }
+
+    define i32 @main(i32 %n) {
+      %a = call i32 @id(i32 %n, i32 1)
+      %b = call i32 @id(i32 %n, i32 2)
+      call void @noclone(void ()* @g)
+      call void @noclone(void ()* null)
+      %s = add i32 %a, %b
+      ret i32 %s
+    }
+  )");
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M));
+  EXPECT_EQ(4u, M->size());
+}
+
+} // end anonymous namespace
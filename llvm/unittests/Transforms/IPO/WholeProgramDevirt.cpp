@@ -8,6 +8,19 @@
 
 #include "llvm/Transforms/IPO/WholeProgramDevirt.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSummaryIndex.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Testing/Support/IRHelpers.h"
 #include "gtest/gtest.h"
 
 using namespace llvm;
@@ -162,3 +175,134 @@ TEST(WholeProgramDevirt, setReturnValues) {
   EXPECT_EQ((std::vector<uint8_t>{0x81, 0xff, 0xff, 0xff}),
             VT2.After.BytesUsed);
 }
+
+TEST(WholeProgramDevirt, GuardedDevirt) {
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M = unittest::parseModuleWithIDs(R"(
+    @vtA = constant [1 x i8*] [i8* bitcast (void (i8*)* @A_f to i8*)], !type !1, !vcall_visibility !2
+    @vtB = constant [1 x i8*] [i8* bitcast (void (i8*)* @B_f to i8*)], !type !1, !vcall_visibility !2
+
+    define void @A_f(i8* %this) {
+      ret void
+    }
+
+    define void @B_f(i8* %this) {
+      ret void
+    }
+
+    define void @call(i8* %obj) {
+      %vtableptr = bitcast i8* %obj to [1 x i8*]**
+      %vtable = load [1 x i8*]*, [1 x i8*]** %vtableptr
+      %vtablei8 = bitcast [1 x i8*]* %vtable to i8*
+      %p = call i1 @llvm.type.test(i8* %vtablei8, metadata !"typeid")
+      call void @llvm.assume(i1 %p)
+      %fptrptr = getelementptr [1 x i8*], [1 x i8*]* %vtable, i32 0, i32 0
+      %fptr = load i8*, i8** %fptrptr
+      %fptr_casted = bitcast i8* %fptr to void (i8*)*
+      call void %fptr_casted(i8* %obj)
+      ret void
+    }
+
+    declare i1 @llvm.type.test(i8*, metadata)
+    declare void @llvm.assume(i1)
+
+    !1 = !{i32 0, !"typeid"}
+    !2 = !{i64 1}
+  )", Ctx, "WholeProgramDevirt");
+  ASSERT_TRUE(M);
+
+  // B_f is the hottest target and A_f gets most of the rest. The last target
+  // is not in the vtables of the type.
+  Function *Call = M->getFunction("call");
+  Function *AF = M->getFunction("A_f");
+  Function *BF = M->getFunction("B_f");
+  CallBase *ICall = nullptr;
+  for (Instruction &I : instructions(Call))
+    if (auto *CB = dyn_cast<CallBase>(&I))
+      if (CB->isIndirectCall())
+        ICall = CB;
+  ASSERT_TRUE(ICall);
+  InstrProfValueData VDs[] = {{Function::getGUID("B_f"), 800},
+                              {Function::getGUID("A_f"), 100},
+                              {42, 100}};
+  annotateValueSite(*M, *ICall, VDs, 1000, IPVK_IndirectCallTarget, 3);
+
+  FunctionAnalysisManager FAM;
+  ModuleAnalysisManager MAM;
+  FAM.registerPass([] { return AAManager(); });
+  FAM.registerPass([] { return DominatorTreeAnalysis(); });
+  FAM.registerPass([] { return OptimizationRemarkEmitterAnalysis(); });
+  FAM.registerPass([] { return PassInstrumentationAnalysis(); });
+  FAM.registerPass([&] { return ModuleAnalysisManagerFunctionProxy(MAM); });
+  MAM.registerPass([] { return PassInstrumentationAnalysis(); });
+  MAM.registerPass([&] { return FunctionAnalysisManagerModuleProxy(FAM); });
+  WholeProgramDevirtPass(nullptr, nullptr).run(*M, MAM);
+  EXPECT_FALSE(verifyModule(*M, &errs()));
+
+  // Each target gets a direct call that is guarded by a comparison of the
+  // vtable pointer to the address point of its vtable.
+  unsigned NumDirectCalls = 0;
+  for (Instruction &I : instructions(Call)) {
+    auto *CB = dyn_cast<CallBase>(&I);
+    if (!CB || (CB->getCalledFunction() != AF && CB->getCalledFunction() != BF))
+      continue;
+    ++NumDirectCalls;
+    auto *Br = dyn_cast<BranchInst>(
+        CB->getParent()->getSinglePredecessor()->getTerminator());
+    ASSERT_TRUE(Br && Br->isConditional());
+    auto *Cmp = dyn_cast<ICmpInst>(Br->getCondition());
+    ASSERT_TRUE(Cmp);
+    EXPECT_EQ("vtable", Cmp->getOperand(0)->stripPointerCasts()->getName());
+    EXPECT_EQ(CB->getCalledFunction() == AF ? M->getNamedValue("vtA")
+                                            : M->getNamedValue("vtB"),
+              Cmp->getOperand(1)->stripPointerCasts());
+  }
+  EXPECT_EQ(2u, NumDirectCalls);
+
+  // The function pointer is only loaded when neither vtable matches.
+  auto *FPtr =
+      dyn_cast<LoadInst>(ICall->getCalledOperand()->stripPointerCasts());
+  ASSERT_TRUE(FPtr);
+  EXPECT_EQ(ICall->getParent(), FPtr->getParent());
+
+  // The indirect call keeps the profile of the target that wasn't promoted.
+  uint32_t NumVals;
+  uint64_t TotalCount;
+  InstrProfValueData Remaining[3];
+  ASSERT_TRUE(getValueProfDataFromInst(*ICall, IPVK_IndirectCallTarget, 3,
+                                       Remaining, NumVals, TotalCount));
+  EXPECT_EQ(1u, NumVals);
+  EXPECT_EQ(42u, Remaining[0].Value);
+  EXPECT_EQ(100u, TotalCount);
+}
+
+TEST(WholeProgramDevirt, ExportGuardedTargets) {
+  // @caller in a.o makes a virtual call through the vtables of b.o and c.o,
+  // and its profile calls B_f. @vtC is in the module of the caller.
+  StringRef Summary = R"(
+    ^0 = module: (path: "a.o", hash: (0, 0, 0, 0, 0))
+    ^1 = module: (path: "b.o", hash: (0, 0, 0, 0, 0))
+    ^2 = gv: (name: "A_f", summaries: (function: (module: ^1, flags: (linkage: external, notEligibleToImport: 0, live: 1, dsoLocal: 0), insts: 1)))
+    ^3 = gv: (name: "B_f", summaries: (function: (module: ^1, flags: (linkage: external, notEligibleToImport: 0, live: 1, dsoLocal: 0), insts: 1)))
+    ^4 = gv: (name: "vtA", summaries: (variable: (module: ^1, flags: (linkage: external, notEligibleToImport: 0, live: 1, dsoLocal: 0), varFlags: (readonly: 0, writeonly: 0, constant: 1, vcall_visibility: 1), vTableFuncs: ((virtFunc: ^2, offset: 0)))))
+    ^5 = gv: (name: "vtB", summaries: (variable: (module: ^1, flags: (linkage: external, notEligibleToImport: 0, live: 1, dsoLocal: 0), varFlags: (readonly: 0, writeonly: 0, constant: 1, vcall_visibility: 1), vTableFuncs: ((virtFunc: ^3, offset: 0)))))
+    ^6 = gv: (name: "vtC", summaries: (variable: (module: ^0, flags: (linkage: external, notEligibleToImport: 0, live: 1, dsoLocal: 0), varFlags: (readonly: 0, writeonly: 0, constant: 1, vcall_visibility: 1), vTableFuncs: ((virtFunc: ^3, offset: 0)))))
+    ^7 = gv: (name: "caller", summaries: (function: (module: ^0, flags: (linkage: external, notEligibleToImport: 0, live: 1, dsoLocal: 0), insts: 4, calls: ((callee: ^3, hotness: hot)), typeIdInfo: (typeTestAssumeVCalls: (vFuncId: (^8, offset: 0))))))
+    ^8 = typeidCompatibleVTable: (name: "typeid", summary: ((offset: 0, ^4), (offset: 0, ^5), (offset: 0, ^6)))
+  )";
+  SMDiagnostic Err;
+  std::unique_ptr<ModuleSummaryIndex> Index = parseSummaryIndexAssembly(
+      MemoryBufferRef(Summary, "WholeProgramDevirt"), Err);
+  if (!Index)
+    Err.print("WholeProgramDevirt", errs());
+  ASSERT_TRUE(Index);
+
+  std::set<GlobalValue::GUID> ExportedGUIDs;
+  std::map<ValueInfo, std::vector<VTableSlotSummary>> LocalWPDTargetsMap;
+  runWholeProgramDevirtOnIndex(*Index, ExportedGUIDs, LocalWPDTargetsMap);
+
+  // The backend of a.o declares B_f and the vtable of b.o that holds it.
+  std::set<GlobalValue::GUID> Expected = {GlobalValue::getGUID("B_f"),
+                                          GlobalValue::getGUID("vtB")};
+  EXPECT_EQ(Expected, ExportedGUIDs);
+}
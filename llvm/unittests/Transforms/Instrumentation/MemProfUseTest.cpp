@@ -0,0 +1,155 @@
+//===- MemProfUseTest.cpp - Memory profile use unit tests -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/ProfileData/MemProf.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "llvm/Testing/Support/SupportHelpers.h"
+#include "llvm/Transforms/Instrumentation/MemProfiler.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llvm::memprof;
+
+namespace {
+
+class MemProfUseTest : public unittest::PassTest {
+protected:
+  MemProfUseTest() : PassTest("MemProfUseTest") {}
+
+  std::unique_ptr<Module> parse(StringRef Body) {
+    std::string Text = (Body + R"(
+      !llvm.dbg.cu = !{!1}
+      !llvm.module.flags = !{!3}
+      !1 = distinct !DICompileUnit(language: DW_LANG_C_plus_plus, file: !2,
+                                   emissionKind: FullDebug)
+      !2 = !DIFile(filename: "t.cpp", directory: "/")
+      !3 = !{i32 2, !"Debug Info Version", i32 3}
+    )").str();
+    return PassTest::parse(Text);
+  }
+
+  /// Run the pass on \p M with the indexed profile written by \p Writer.
+  void run(Module &M, MemProfWriter &Writer) {
+    unittest::TempFile Profile("memprof", "profdata", "",
+                               /*Unique=*/true);
+    {
+      std::error_code EC;
+      raw_fd_ostream OS(Profile.path(), EC);
+      ASSERT_FALSE(EC);
+      Writer.write(OS);
+    }
+    MemProfUsePass(std::string(Profile.path())).run(M, MAM);
+  }
+
+  static StringRef getHint(Function &F, StringRef Name) {
+    for (Instruction &I : instructions(F))
+      if (I.getName() == Name)
+        return cast<CallBase>(I)
+            .getAttribute(AttributeList::FunctionIndex, "memprof")
+            .getValueAsString();
+    return "<missing>";
+  }
+};
+
+TEST_F(MemProfUseTest, MarkHotAndCold) {
+  std::unique_ptr<Module> M = parse(R"(
+    declare i8* @malloc(i64)
+    declare i8* @_Znwm(i64)
+
+    define i8* @make() !dbg !10 {
+      %mixed = call i8* @malloc(i64 64), !dbg !11
+      %hot = call i8* @malloc(i64 8), !dbg !12
+      %none = call i8* @_Znwm(i64 16), !dbg !13
+      ret i8* %mixed
+    }
+
+    define i8* @caller() !dbg !20 {
+      %cold = call i8* @malloc(i64 64), !dbg !21
+      ret i8* %cold
+    }
+
+    !10 = distinct !DISubprogram(name: "make", linkageName: "_Z4makev",
+                                 scope: !2, file: !2, line: 10, unit: !1,
+                                 spFlags: DISPFlagDefinition)
+    !11 = !DILocation(line: 11, column: 3, scope: !10)
+    !12 = !DILocation(line: 12, column: 3, scope: !10)
+    !13 = !DILocation(line: 13, column: 3, scope: !10)
+    !20 = distinct !DISubprogram(name: "caller", linkageName: "_Z6callerv",
+                                 scope: !2, file: !2, line: 30, unit: !1,
+                                 spFlags: DISPFlagDefinition)
+    !21 = !DILocation(line: 11, column: 3, scope: !10, inlinedAt: !22)
+    !22 = !DILocation(line: 32, column: 5, scope: !20)
+  )");
+  ASSERT_TRUE(M);
+
+  uint64_t Make = GlobalValue::getGUID("_Z4makev");
+  uint64_t Caller = GlobalValue::getGUID("_Z6callerv");
+  uint64_t Main = GlobalValue::getGUID("main");
+  PortableMemInfoBlock Cold(MemInfoBlock(/*size=*/4096, /*access_count=*/1,
+                                         /*alloc_timestamp=*/0,
+                                         /*dealloc_timestamp=*/5000, 0, 0));
+  PortableMemInfoBlock Hot(MemInfoBlock(64, 6400, 0, 0, 0, 0));
+  PortableMemInfoBlock Neither(MemInfoBlock(64, 64, 0, 1000, 0, 0));
+
+  // The first call is cold when inlined into caller, and hot when called
+  // from main.
+  MemProfRecord Record;
+  Record.AllocSites.push_back(AllocationInfo(
+      {Frame(Make, 1, 3, true), Frame(Caller, 2, 5, false)}, Cold));
+  Record.AllocSites.push_back(AllocationInfo(
+      {Frame(Make, 1, 3, false), Frame(Main, 2, 5, false)}, Hot));
+  Record.AllocSites.push_back(AllocationInfo(
+      {Frame(Make, 2, 3, false), Frame(Main, 3, 5, false)}, Hot));
+  Record.AllocSites.push_back(AllocationInfo(
+      {Frame(Make, 3, 3, false), Frame(Main, 4, 5, false)}, Neither));
+  MemProfWriter Writer;
+  Writer.addRecord(Make, Record);
+  run(*M, Writer);
+
+  Function &MakeF = *M->getFunction("make");
+  EXPECT_EQ("", getHint(MakeF, "mixed"));
+  EXPECT_EQ("hot", getHint(MakeF, "hot"));
+  EXPECT_EQ("", getHint(MakeF, "none"));
+  EXPECT_EQ("cold", getHint(*M->getFunction("caller"), "cold"));
+}
+
+TEST_F(MemProfUseTest, NoMatchingContext) {
+  std::unique_ptr<Module> M = parse(R"(
+    declare i8* @malloc(i64)
+
+    define i8* @make() !dbg !10 {
+      %p = call i8* @malloc(i64 64), !dbg !11
+      ret i8* %p
+    }
+
+    !10 = distinct !DISubprogram(name: "make", scope: !2, file: !2, line: 10,
+                                 unit: !1, spFlags: DISPFlagDefinition)
+    !11 = !DILocation(line: 11, column: 3, scope: !10)
+  )");
+  ASSERT_TRUE(M);
+
+  // A C function is matched by its name, but the profiled call was on
+  // another line.
+  uint64_t Make = GlobalValue::getGUID("make");
+  MemProfRecord Record;
+  Record.AllocSites.push_back(AllocationInfo(
+      {Frame(Make, 2, 3, false)},
+      PortableMemInfoBlock(MemInfoBlock(64, 6400, 0, 0, 0, 0))));
+  MemProfWriter Writer;
+  Writer.addRecord(Make, Record);
+  run(*M, Writer);
+
+  EXPECT_EQ("", getHint(*M->getFunction("make"), "p"));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,232 @@
+//===- LoopDataPrefetchTest.cpp - Loop data prefetch unit tests -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Scalar/LoopDataPrefetch.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/TargetTransformInfoImpl.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+/// A target whose hardware prefetchers cover the small strides, like X86, and
+/// which gives up on loops with more than \p MaxPrefetches prefetches, like
+/// SystemZ.
+class PrefetchTTIImpl : public TargetTransformInfoImplCRTPBase<PrefetchTTIImpl> {
+  using BaseT = TargetTransformInfoImplCRTPBase<PrefetchTTIImpl>;
+  bool IndirectPrefetching;
+  unsigned MaxPrefetches;
+
+public:
+  PrefetchTTIImpl(const DataLayout &DL, bool IndirectPrefetching,
+                  unsigned MaxPrefetches)
+      : BaseT(DL), IndirectPrefetching(IndirectPrefetching),
+        MaxPrefetches(MaxPrefetches) {}
+
+  unsigned getCacheLineSize() const { return 64; }
+  unsigned getPrefetchDistance() const { return 200; }
+  unsigned getMinPrefetchStride(unsigned NumMemAccesses,
+                                unsigned NumStridedMemAccesses,
+                                unsigned NumPrefetches, bool HasCall) const {
+    return NumPrefetches > MaxPrefetches ? UINT_MAX : 2048;
+  }
+  bool enableIndirectPrefetching() const { return IndirectPrefetching; }
+};
+
+class LoopDataPrefetchTest : public unittest::PassTest {
+protected:
+  /// The target of the functions that are run next.
+  bool IndirectPrefetching = true;
+  unsigned MaxPrefetches = 16;
+
+  LoopDataPrefetchTest()
+      : PassTest("LoopDataPrefetchTest",
+                 TargetIRAnalysis([this](const Function &F) {
+                   return TargetTransformInfo(
+                       PrefetchTTIImpl(F.getParent()->getDataLayout(),
+                                       IndirectPrefetching, MaxPrefetches));
+                 })) {}
+
+  bool run(Function &F) {
+    // The pass only uses the profile summary if it is cached.
+    MAM.getResult<ProfileSummaryAnalysis>(*F.getParent());
+    return runPass(LoopDataPrefetchPass(), F);
+  }
+
+  static SmallVector<IntrinsicInst *, 2> getPrefetches(Function &F) {
+    SmallVector<IntrinsicInst *, 2> Prefetches;
+    for (Instruction &I : instructions(F))
+      if (auto *II = dyn_cast<IntrinsicInst>(&I))
+        if (II->getIntrinsicID() == Intrinsic::prefetch)
+          Prefetches.push_back(II);
+    return Prefetches;
+  }
+
+  /// \returns true if \p V is computed from the value named \p Name.
+  static bool dependsOn(Value *V, StringRef Name) {
+    SmallVector<Value *, 8> Worklist = {V};
+    SmallPtrSet<Value *, 8> Visited;
+    while (!Worklist.empty()) {
+      Value *Op = Worklist.pop_back_val();
+      if (Op->getName() == Name)
+        return true;
+      auto *I = dyn_cast<Instruction>(Op);
+      if (I && !isa<PHINode>(I) && Visited.insert(I).second)
+        Worklist.append(I->op_begin(), I->op_end());
+    }
+    return false;
+  }
+};
+
+// sum += a[b[i]], where only the access to a misses the hardware prefetchers.
+const char *Gather = R"(
+  define i32 @gather(i32* %a, i32* %b, i64 %n) {
+  entry:
+    %guard = icmp sgt i64 %n, 0
+    br i1 %guard, label %loop, label %exit
+
+  loop:
+    %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+    %sum = phi i32 [ 0, %entry ], [ %sum.next, %latch ]
+    %b.p = getelementptr inbounds i32, i32* %b, i64 %i
+    %idx = load i32, i32* %b.p, align 4
+    %idx.ext = sext i32 %idx to i64
+    %a.p = getelementptr inbounds i32, i32* %a, i64 %idx.ext
+    %v = load i32, i32* %a.p, align 4
+    %sum.next = add i32 %sum, %v
+    br label %latch
+
+  latch:
+    %i.next = add nuw nsw i64 %i, 1
+    %cond = icmp slt i64 %i.next, %n
+    br i1 %cond, label %loop, label %exit, !prof !1
+
+  exit:
+    %r = phi i32 [ 0, %entry ], [ %sum.next, %latch ]
+    ret i32 %r
+  }
+
+  !1 = !{!"branch_weights", i32 1000, i32 1}
+)";
+
+TEST_F(LoopDataPrefetchTest, IndirectAccess) {
+  std::unique_ptr<Module> M = parse(Gather);
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("gather");
+  ASSERT_TRUE(run(F));
+
+  // The index of a later iteration is loaded to compute the address of the
+  // prefetch.
+  auto Prefetches = getPrefetches(F);
+  ASSERT_EQ(1u, Prefetches.size());
+  EXPECT_TRUE(dependsOn(Prefetches[0]->getArgOperand(0), "prefidx"));
+  EXPECT_TRUE(dependsOn(Prefetches[0]->getArgOperand(0), "a"));
+  EXPECT_FALSE(dependsOn(Prefetches[0]->getArgOperand(0), "idx"));
+}
+
+TEST_F(LoopDataPrefetchTest, IndirectAccessNotEnabled) {
+  // Only the targets that enable it pay for the extra load of the index.
+  IndirectPrefetching = false;
+  std::unique_ptr<Module> M = parse(Gather);
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("gather")));
+}
+
+TEST_F(LoopDataPrefetchTest, IndirectAccessCountsAgainstLimit) {
+  // The potential prefetches of b[i] and a[b[i]] are more than the target
+  // allows.
+  MaxPrefetches = 1;
+  std::unique_ptr<Module> M = parse(Gather);
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("gather")));
+}
+
+TEST_F(LoopDataPrefetchTest, ConditionalIndex) {
+  // The index of the last iteration isn't always loaded, so it is not safe to
+  // load it ahead.
+  std::unique_ptr<Module> M = parse(R"(
+    define void @scatter(i32* %a, i32* %b, i64 %n) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+      %odd = and i64 %i, 1
+      %is.odd = icmp ne i64 %odd, 0
+      br i1 %is.odd, label %then, label %latch
+
+    then:
+      %b.p = getelementptr inbounds i32, i32* %b, i64 %i
+      %idx = load i32, i32* %b.p, align 4
+      %idx.ext = sext i32 %idx to i64
+      %a.p = getelementptr inbounds i32, i32* %a, i64 %idx.ext
+      %v = load i32, i32* %a.p, align 4
+      %v.inc = add i32 %v, 1
+      store i32 %v.inc, i32* %a.p, align 4
+      br label %latch
+
+    latch:
+      %i.next = add nuw nsw i64 %i, 1
+      %cond = icmp ult i64 %i.next, %n
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("scatter")));
+}
+
+TEST_F(LoopDataPrefetchTest, ShortEstimatedTripCount) {
+  // With a profile, the loop is expected to exit after a few iterations,
+  // before reaching the prefetched ones.
+  std::string Text = Gather;
+  Text.replace(Text.find("i32 1000, i32 1"), strlen("i32 1000, i32 1"),
+               "i32 1, i32 1");
+  Text.replace(Text.find("i64 %n) {"), strlen("i64 %n) {"),
+               "i64 %n) !prof !2 {");
+  Text += R"(
+    !2 = !{!"function_entry_count", i64 1000}
+
+    !llvm.module.flags = !{!3}
+    !3 = !{i32 1, !"ProfileSummary", !4}
+    !4 = !{!5, !6, !7, !8, !9, !10, !11, !12}
+    !5 = !{!"ProfileFormat", !"InstrProf"}
+    !6 = !{!"TotalCount", i64 10000}
+    !7 = !{!"MaxCount", i64 1000}
+    !8 = !{!"MaxInternalCount", i64 1000}
+    !9 = !{!"MaxFunctionCount", i64 1000}
+    !10 = !{!"NumCounts", i64 3}
+    !11 = !{!"NumFunctions", i64 1}
+    !12 = !{!"DetailedSummary", !13}
+    !13 = !{!14, !15}
+    !14 = !{i32 10000, i64 1000, i32 1}
+    !15 = !{i32 999999, i64 1, i32 3}
+  )";
+  std::unique_ptr<Module> M = parse(Text);
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("gather");
+  EXPECT_FALSE(run(F));
+
+  // The same loop is prefetched when it runs long enough.
+  Text.replace(Text.find("i32 1, i32 1"), strlen("i32 1, i32 1"),
+               "i32 1000, i32 1");
+  M = parse(Text);
+  ASSERT_TRUE(M);
+  MAM.clear();
+  EXPECT_TRUE(run(*M->getFunction("gather")));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,261 @@
+//===- LoopFlattenTest.cpp - Loop flattening unit tests -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Scalar/LoopFlatten.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using llvm::unittest::getBasicBlockByName;
+
+namespace {
+
+class LoopFlattenTest : public unittest::PassTest {
+protected:
+  LoopFlattenTest() : PassTest("LoopFlattenTest") {}
+
+  /// Flatten the loops of \p F, and check that the analyses it preserves are
+  /// still up to date.
+  bool run(Function &F) {
+    PreservedAnalyses PA = LoopFlattenPass().run(F, FAM);
+    EXPECT_FALSE(verifyFunction(F, &errs()));
+    if (PA.areAllPreserved())
+      return false;
+    EXPECT_TRUE(PA.getChecker<DominatorTreeAnalysis>().preserved());
+    EXPECT_TRUE(PA.getChecker<LoopAnalysis>().preserved());
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    EXPECT_TRUE(DT.verify());
+    FAM.getResult<LoopAnalysis>(F).verify(DT);
+    return true;
+  }
+};
+
+TEST_F(LoopFlattenTest, ConstantBounds) {
+  std::unique_ptr<Module> M = parse(R"(
+    define void @clear(i32* %A) {
+    entry:
+      br label %outer
+
+    outer:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+      %mul = mul i32 %i, 20
+      br label %inner
+
+    inner:
+      %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+      %idx = add i32 %mul, %j
+      %gep = getelementptr inbounds i32, i32* %A, i32 %idx
+      store i32 0, i32* %gep, align 4
+      %j.next = add nuw i32 %j, 1
+      %inner.cond = icmp ult i32 %j.next, 20
+      br i1 %inner.cond, label %inner, label %outer.latch
+
+    outer.latch:
+      %i.next = add nuw i32 %i, 1
+      %outer.cond = icmp ult i32 %i.next, 10
+      br i1 %outer.cond, label %outer, label %exit
+
+    exit:
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("clear");
+  ASSERT_TRUE(run(F));
+
+  // The trip count of 200 does not overflow, so there is a single loop and no
+  // runtime check.
+  LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+  ASSERT_EQ(1u, LI.getTopLevelLoops().size());
+  Loop *L = LI.getTopLevelLoops().front();
+  EXPECT_TRUE(L->isInnermost());
+  EXPECT_EQ(getBasicBlockByName(F, "outer"), L->getHeader());
+  EXPECT_EQ(&F.getEntryBlock(), L->getLoopPreheader());
+
+  BasicBlock *OuterLatch = getBasicBlockByName(F, "outer.latch");
+  auto *OuterCond = cast<ICmpInst>(OuterLatch->getTerminator()->getOperand(0));
+  auto *TripCount = dyn_cast<ConstantInt>(OuterCond->getOperand(1));
+  ASSERT_TRUE(TripCount);
+  EXPECT_EQ(200u, TripCount->getZExtValue());
+
+  // The store is addressed by the flattened induction variable.
+  BasicBlock *Inner = getBasicBlockByName(F, "inner");
+  auto *GEP = cast<GetElementPtrInst>(
+      cast<StoreInst>(Inner->getFirstNonPHI()->getNextNode())
+          ->getPointerOperand());
+  EXPECT_EQ(&getBasicBlockByName(F, "outer")->front(), GEP->getOperand(1));
+}
+
+TEST_F(LoopFlattenTest, RuntimeBoundsVersioned) {
+  std::unique_ptr<Module> M = parse(R"(
+    define void @clear(i32* %A, i32 %N, i32 %M) {
+    entry:
+      %n.zero = icmp eq i32 %N, 0
+      br i1 %n.zero, label %exit, label %outer.ph
+
+    outer.ph:
+      %m.zero = icmp eq i32 %M, 0
+      br label %outer
+
+    outer:
+      %i = phi i32 [ 0, %outer.ph ], [ %i.next, %outer.latch ]
+      %mul = mul i32 %i, %M
+      br i1 %m.zero, label %outer.latch, label %inner.ph
+
+    inner.ph:
+      br label %inner
+
+    inner:
+      %j = phi i32 [ 0, %inner.ph ], [ %j.next, %inner ]
+      %idx = add i32 %mul, %j
+      %gep = getelementptr inbounds i32, i32* %A, i32 %idx
+      store i32 0, i32* %gep, align 4
+      %j.next = add nuw i32 %j, 1
+      %inner.cond = icmp ne i32 %j.next, %M
+      br i1 %inner.cond, label %inner, label %inner.exit
+
+    inner.exit:
+      br label %outer.latch
+
+    outer.latch:
+      %i.next = add nuw i32 %i, 1
+      %outer.cond = icmp ne i32 %i.next, %N
+      br i1 %outer.cond, label %outer, label %exit.loopexit
+
+    exit.loopexit:
+      br label %exit
+
+    exit:
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("clear");
+  ASSERT_TRUE(run(F));
+
+  // The product of the bounds may overflow, and the inner loop may be
+  // skipped, so the original nest is kept for when either happens.
+  BasicBlock *Check = getBasicBlockByName(F, "outer.ph");
+  EXPECT_TRUE(any_of(*Check, [](Instruction &I) {
+    auto *II = dyn_cast<IntrinsicInst>(&I);
+    return II && II->getIntrinsicID() == Intrinsic::umul_with_overflow;
+  }));
+  auto *CheckBr = cast<BranchInst>(Check->getTerminator());
+  ASSERT_TRUE(CheckBr->isConditional());
+
+  LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+  ASSERT_EQ(2u, LI.getTopLevelLoops().size());
+  Loop *Flattened = LI.getLoopFor(getBasicBlockByName(F, "outer"));
+  ASSERT_TRUE(Flattened);
+  EXPECT_TRUE(Flattened->isInnermost());
+  EXPECT_EQ(CheckBr->getSuccessor(1), Flattened->getLoopPreheader());
+
+  Loop *Fallback =
+      LI.getLoopFor(CheckBr->getSuccessor(0)->getSingleSuccessor());
+  ASSERT_TRUE(Fallback);
+  EXPECT_NE(Flattened, Fallback);
+  EXPECT_EQ(1u, Fallback->getSubLoops().size());
+  EXPECT_TRUE(
+      findStringMetadataForLoop(Fallback, "llvm.loop.flatten.disable"));
+
+  // The guard is gone from the flattened loop.
+  EXPECT_TRUE(getBasicBlockByName(F, "outer")->getSingleSuccessor());
+}
+
+TEST_F(LoopFlattenTest, Reduction) {
+  std::unique_ptr<Module> M = parse(R"(
+    define i32 @sum(i32* %A) {
+    entry:
+      br label %outer
+
+    outer:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+      %s = phi i32 [ 0, %entry ], [ %s.lcssa, %outer.latch ]
+      %mul = shl i32 %i, 4
+      br label %inner
+
+    inner:
+      %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+      %acc = phi i32 [ %s, %outer ], [ %add, %inner ]
+      %idx = add i32 %j, %mul
+      %gep = getelementptr inbounds i32, i32* %A, i32 %idx
+      %v = load i32, i32* %gep, align 4
+      %add = add i32 %acc, %v
+      %j.next = add nuw i32 %j, 1
+      %inner.cond = icmp ult i32 %j.next, 16
+      br i1 %inner.cond, label %inner, label %outer.latch
+
+    outer.latch:
+      %s.lcssa = phi i32 [ %add, %inner ]
+      %i.next = add nuw i32 %i, 1
+      %outer.cond = icmp ult i32 %i.next, 8
+      br i1 %outer.cond, label %outer, label %exit
+
+    exit:
+      %r = phi i32 [ %s.lcssa, %outer.latch ]
+      ret i32 %r
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("sum");
+  ASSERT_TRUE(run(F));
+
+  LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+  ASSERT_EQ(1u, LI.getTopLevelLoops().size());
+  EXPECT_TRUE(LI.getTopLevelLoops().front()->isInnermost());
+
+  // The accumulator is carried by the outer loop phi alone, and the inner
+  // induction variable is gone.
+  auto *Acc = cast<PHINode>(&getBasicBlockByName(F, "inner")->front());
+  EXPECT_EQ("acc", Acc->getName());
+  EXPECT_EQ(1u, Acc->getNumIncomingValues());
+  EXPECT_EQ(&*std::next(getBasicBlockByName(F, "outer")->begin()),
+            Acc->getIncomingValue(0));
+}
+
+TEST_F(LoopFlattenTest, NoFlattenNonLinearUse) {
+  // Flattening would need a division to recompute %j.
+  std::unique_ptr<Module> M = parse(R"(
+    define void @fill(i32* %A) {
+    entry:
+      br label %outer
+
+    outer:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+      %mul = mul i32 %i, 20
+      br label %inner
+
+    inner:
+      %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+      %idx = add i32 %mul, %j
+      %gep = getelementptr inbounds i32, i32* %A, i32 %idx
+      store i32 %j, i32* %gep, align 4
+      %j.next = add nuw i32 %j, 1
+      %inner.cond = icmp ult i32 %j.next, 20
+      br i1 %inner.cond, label %inner, label %outer.latch
+
+    outer.latch:
+      %i.next = add nuw i32 %i, 1
+      %outer.cond = icmp ult i32 %i.next, 10
+      br i1 %outer.cond, label %outer, label %exit
+
+    exit:
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("fill")));
+}
+
+} // end anonymous namespace
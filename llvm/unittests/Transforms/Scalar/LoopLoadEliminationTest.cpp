@@ -0,0 +1,158 @@
+//===- LoopLoadEliminationTest.cpp - Loop load elimination unit tests -----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Scalar/LoopLoadElimination.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using llvm::unittest::getBasicBlockByName;
+
+namespace {
+
+class LoopLoadEliminationTest : public unittest::PassTest {
+protected:
+  cl::opt<unsigned> *RegisterBudget;
+
+  LoopLoadEliminationTest() : PassTest("LoopLoadEliminationTest") {
+    RegisterBudget = static_cast<cl::opt<unsigned> *>(
+        cl::getRegisteredOptions().lookup(
+            "loop-load-elimination-register-budget"));
+  }
+
+  ~LoopLoadEliminationTest() { RegisterBudget->setValue(8); }
+
+  bool run(Function &F) { return runPass(LoopLoadEliminationPass(), F); }
+
+  static Instruction *getInst(Function &F, StringRef Name) {
+    for (Instruction &I : instructions(F))
+      if (I.getName() == Name)
+        return &I;
+    return nullptr;
+  }
+
+  static unsigned countLoads(BasicBlock &BB) {
+    unsigned Count = 0;
+    for (Instruction &I : BB)
+      Count += isa<LoadInst>(I);
+    return Count;
+  }
+};
+
+// a[i] = a[i-2] + a[i-3], which reads the values stored two and three
+// iterations before.
+const char *Stencil = R"(
+  define void @stencil(double* %a, i64 %n) {
+  entry:
+    %guard = icmp ugt i64 %n, 3
+    br i1 %guard, label %ph, label %exit
+
+  ph:
+    br label %loop
+
+  loop:
+    %i = phi i64 [ 3, %ph ], [ %i.next, %loop ]
+    %im2 = add nsw i64 %i, -2
+    %im3 = add nsw i64 %i, -3
+    %p2 = getelementptr inbounds double, double* %a, i64 %im2
+    %p3 = getelementptr inbounds double, double* %a, i64 %im3
+    %x = load double, double* %p2, align 8
+    %y = load double, double* %p3, align 8
+    %s = fadd double %x, %y
+    %p = getelementptr inbounds double, double* %a, i64 %i
+    store double %s, double* %p, align 8
+    %i.next = add nuw nsw i64 %i, 1
+    %cond = icmp ult i64 %i.next, %n
+    br i1 %cond, label %loop, label %loop.exit
+
+  loop.exit:
+    br label %exit
+
+  exit:
+    ret void
+  }
+)";
+
+std::string withConstantTripCount() {
+  std::string Text = Stencil;
+  Text.replace(Text.find("icmp ugt i64 %n, 3"), strlen("icmp ugt i64 %n, 3"),
+               "icmp ugt i64 100, 3");
+  Text.replace(Text.find("icmp ult i64 %i.next, %n"),
+               strlen("icmp ult i64 %i.next, %n"),
+               "icmp ult i64 %i.next, 100");
+  return Text;
+}
+
+TEST_F(LoopLoadEliminationTest, MultipleIterations) {
+  std::unique_ptr<Module> M = parse(withConstantTripCount());
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("stencil");
+  ASSERT_TRUE(run(F));
+
+  // Both loads are forwarded from a chain of three PHIs, whose initial values
+  // are loaded in the preheader.
+  auto *Sum = cast<Instruction>(getInst(F, "s"));
+  auto *X = dyn_cast<PHINode>(Sum->getOperand(0));
+  auto *Y = dyn_cast<PHINode>(Sum->getOperand(1));
+  ASSERT_TRUE(X && Y);
+  BasicBlock *Loop = getBasicBlockByName(F, "loop");
+  BasicBlock *PH = getBasicBlockByName(F, "ph");
+  EXPECT_EQ(Loop, X->getParent());
+  EXPECT_EQ(Loop, Y->getParent());
+
+  auto *Last = dyn_cast<PHINode>(X->getIncomingValueForBlock(Loop));
+  ASSERT_TRUE(Last);
+  EXPECT_EQ(Sum, Last->getIncomingValueForBlock(Loop));
+  EXPECT_EQ(X, Y->getIncomingValueForBlock(Loop));
+  EXPECT_EQ(3u, countLoads(*PH));
+  EXPECT_TRUE(getInst(F, "x")->use_empty());
+  EXPECT_TRUE(getInst(F, "y")->use_empty());
+}
+
+TEST_F(LoopLoadEliminationTest, RegisterBudget) {
+  // Forwarding a[i-2] needs one more value in a register, and a[i-3] a
+  // second one.
+  RegisterBudget->setValue(1);
+  std::unique_ptr<Module> M = parse(withConstantTripCount());
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("stencil");
+  ASSERT_TRUE(run(F));
+
+  auto *Sum = cast<Instruction>(getInst(F, "s"));
+  EXPECT_TRUE(isa<PHINode>(Sum->getOperand(0)));
+  EXPECT_EQ(getInst(F, "y"), Sum->getOperand(1));
+  EXPECT_EQ(2u, countLoads(*getBasicBlockByName(F, "ph")));
+}
+
+TEST_F(LoopLoadEliminationTest, UnknownTripCount) {
+  // The loop may exit before loading a[1] and a[2], so they can't be loaded
+  // in the preheader.
+  std::unique_ptr<Module> M = parse(Stencil);
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("stencil")));
+}
+
+TEST_F(LoopLoadEliminationTest, DereferenceableInitialValues) {
+  std::string Text = Stencil;
+  Text.replace(Text.find("double* %a"), strlen("double* %a"),
+               "double* dereferenceable(24) %a");
+  std::unique_ptr<Module> M = parse(Text);
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("stencil");
+  ASSERT_TRUE(run(F));
+
+  auto *Sum = cast<Instruction>(getInst(F, "s"));
+  EXPECT_TRUE(isa<PHINode>(Sum->getOperand(0)));
+  EXPECT_TRUE(isa<PHINode>(Sum->getOperand(1)));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,252 @@
+//===- NewGVNTest.cpp - NewGVN unit tests ---------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Scalar/NewGVN.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using llvm::unittest::getBasicBlockByName;
+
+namespace {
+
+class NewGVNTest : public unittest::PassTest {
+protected:
+  NewGVNTest() : PassTest("NewGVNTest") {}
+
+  void run(Function &F) {
+    PreservedAnalyses PA = NewGVNPass().run(F, FAM);
+    FAM.invalidate(F, PA);
+    EXPECT_FALSE(verifyFunction(F, &errs()));
+    // The dominator tree is preserved, and kept up to date if edges are split.
+    EXPECT_TRUE(FAM.getResult<DominatorTreeAnalysis>(F).verify());
+  }
+
+  static Instruction *getInst(Function &F, StringRef Name) {
+    for (Instruction &I : instructions(F))
+      if (I.getName() == Name)
+        return &I;
+    return nullptr;
+  }
+
+  /// \returns the instruction of \p BB that has the opcode \p Opcode.
+  static Instruction *findInst(BasicBlock &BB, unsigned Opcode) {
+    for (Instruction &I : BB)
+      if (I.getOpcode() == Opcode)
+        return &I;
+    return nullptr;
+  }
+};
+
+// The value loaded at the start of each iteration is the one stored at the
+// end of the previous one.
+const char *LoopLoad = R"(
+  define i32 @accumulate(i32* %p, i32* %q, i64 %n) {
+  entry:
+    br label %loop
+
+  loop:
+    %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+    %v = load i32, i32* %p, align 4
+    %q.i = getelementptr inbounds i32, i32* %q, i64 %i
+    %x = load i32, i32* %q.i, align 4
+    %sum = add i32 %v, %x
+    store i32 %sum, i32* %p, align 4
+    %i.next = add nuw nsw i64 %i, 1
+    %cond = icmp ult i64 %i.next, %n
+    br i1 %cond, label %loop, label %exit
+
+  exit:
+    ret i32 %sum
+  }
+)";
+
+TEST_F(NewGVNTest, PRELoopLoad) {
+  std::unique_ptr<Module> M = parse(LoopLoad);
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("accumulate");
+  run(F);
+
+  // The load is moved to the entry block, and the loop reuses the stored
+  // value.
+  BasicBlock *Entry = getBasicBlockByName(F, "entry");
+  BasicBlock *Loop = getBasicBlockByName(F, "loop");
+  EXPECT_EQ(nullptr, getInst(F, "v"));
+  auto *Pre = dyn_cast_or_null<LoadInst>(findInst(*Entry, Instruction::Load));
+  ASSERT_TRUE(Pre);
+  EXPECT_EQ(F.getArg(0), Pre->getPointerOperand());
+
+  auto *Sum = cast<Instruction>(getInst(F, "sum"));
+  auto *Phi = dyn_cast<PHINode>(Sum->getOperand(0));
+  ASSERT_TRUE(Phi);
+  EXPECT_EQ(Loop, Phi->getParent());
+  EXPECT_EQ(Pre, Phi->getIncomingValueForBlock(Entry));
+  EXPECT_EQ(Sum, Phi->getIncomingValueForBlock(Loop));
+}
+
+TEST_F(NewGVNTest, PRELoopLoadClobbered) {
+  // The store to q[i] may overwrite the value stored to p before the next
+  // iteration.
+  std::string Text = LoopLoad;
+  Text.replace(Text.find("store i32 %sum, i32* %p, align 4"),
+               strlen("store i32 %sum, i32* %p, align 4"),
+               "store i32 %sum, i32* %p, align 4\n"
+               "    store i32 0, i32* %q.i, align 4");
+  std::unique_ptr<Module> M = parse(Text);
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("accumulate");
+  run(F);
+  EXPECT_NE(nullptr, getInst(F, "v"));
+  BasicBlock *Entry = getBasicBlockByName(F, "entry");
+  EXPECT_EQ(nullptr, findInst(*Entry, Instruction::Load));
+}
+
+// The entry block branches conditionally to the loop, so the load is inserted
+// on the edge between them.
+static std::string getConditionalEntryLoop() {
+  std::string Text = LoopLoad;
+  Text.replace(Text.find("i64 %n) {\n  entry:\n    br label %loop"),
+               strlen("i64 %n) {\n  entry:\n    br label %loop"),
+               "i64 %n, i1 %c) {\n  entry:\n"
+               "    br i1 %c, label %loop, label %exit");
+  Text.replace(Text.find("ret i32 %sum"), strlen("ret i32 %sum"),
+               "%r = phi i32 [ 0, %entry ], [ %sum, %loop ]\n    ret i32 %r");
+  return Text;
+}
+
+TEST_F(NewGVNTest, PREConditionalEntry) {
+  std::unique_ptr<Module> M = parse(getConditionalEntryLoop());
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("accumulate");
+  run(F);
+
+  // The load is in a new block between the entry block and the loop, so the
+  // path to the exit doesn't get it.
+  EXPECT_EQ(nullptr, getInst(F, "v"));
+  BasicBlock *Entry = getBasicBlockByName(F, "entry");
+  BasicBlock *Loop = getBasicBlockByName(F, "loop");
+  EXPECT_EQ(nullptr, findInst(*Entry, Instruction::Load));
+  auto *Phi = dyn_cast<PHINode>(
+      cast<Instruction>(getInst(F, "sum"))->getOperand(0));
+  ASSERT_TRUE(Phi);
+  EXPECT_EQ(Loop, Phi->getParent());
+  BasicBlock *Split = nullptr;
+  for (BasicBlock *Pred : predecessors(Loop))
+    if (Pred != Loop)
+      Split = Pred;
+  ASSERT_TRUE(Split);
+  EXPECT_EQ(Entry, Split->getSinglePredecessor());
+  auto *Pre = dyn_cast<LoadInst>(Phi->getIncomingValueForBlock(Split));
+  ASSERT_TRUE(Pre);
+  EXPECT_EQ(Split, Pre->getParent());
+}
+
+TEST_F(NewGVNTest, PREMaxInsertions) {
+  auto *MaxInsertions = static_cast<cl::opt<unsigned> *>(
+      cl::getRegisteredOptions().lookup("newgvn-pre-max-insertions"));
+  ASSERT_TRUE(MaxInsertions);
+  MaxInsertions->setValue(0);
+  std::unique_ptr<Module> M = parse(getConditionalEntryLoop());
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("accumulate");
+  run(F);
+  MaxInsertions->setValue(2);
+  EXPECT_NE(nullptr, getInst(F, "v"));
+  EXPECT_EQ(3u, F.size());
+}
+
+TEST_F(NewGVNTest, PRETriangle) {
+  // The load in the join block is only available from the "then" block. The
+  // edge from the entry block is critical.
+  std::unique_ptr<Module> M = parse(R"(
+    define i32 @triangle(i32* %p, i1 %c, i32 %x) {
+    entry:
+      br i1 %c, label %then, label %join
+
+    then:
+      store i32 %x, i32* %p, align 4
+      br label %join
+
+    join:
+      %v = load i32, i32* %p, align 4
+      ret i32 %v
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("triangle");
+  run(F);
+
+  EXPECT_EQ(nullptr, getInst(F, "v"));
+  BasicBlock *Entry = getBasicBlockByName(F, "entry");
+  BasicBlock *Then = getBasicBlockByName(F, "then");
+  BasicBlock *Join = getBasicBlockByName(F, "join");
+  EXPECT_EQ(nullptr, findInst(*Entry, Instruction::Load));
+  auto *Ret = cast<ReturnInst>(Join->getTerminator());
+  auto *Phi = dyn_cast<PHINode>(Ret->getReturnValue());
+  ASSERT_TRUE(Phi);
+  EXPECT_EQ(F.getArg(2), Phi->getIncomingValueForBlock(Then));
+  BasicBlock *Split = nullptr;
+  for (BasicBlock *Pred : predecessors(Join))
+    if (Pred != Then)
+      Split = Pred;
+  ASSERT_TRUE(Split);
+  EXPECT_EQ(Entry, Split->getSinglePredecessor());
+  auto *Pre = dyn_cast<LoadInst>(Phi->getIncomingValueForBlock(Split));
+  ASSERT_TRUE(Pre);
+  EXPECT_EQ(Split, Pre->getParent());
+}
+
+TEST_F(NewGVNTest, PREExpression) {
+  // i * i is computed for the next iteration at the end of the current one.
+  std::unique_ptr<Module> M = parse(R"(
+    define void @squares(i64* %p, i64 %start, i64 %n) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ %start, %entry ], [ %i.next, %loop ]
+      %sq = mul i64 %i, %i
+      %p.i = getelementptr inbounds i64, i64* %p, i64 %i
+      store i64 %sq, i64* %p.i, align 8
+      %i.next = add nuw nsw i64 %i, 1
+      %sq.next = mul i64 %i.next, %i.next
+      %p.next = getelementptr inbounds i64, i64* %p, i64 %i.next
+      store i64 %sq.next, i64* %p.next, align 8
+      %cond = icmp ult i64 %i.next, %n
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("squares");
+  run(F);
+
+  BasicBlock *Entry = getBasicBlockByName(F, "entry");
+  BasicBlock *Loop = getBasicBlockByName(F, "loop");
+  EXPECT_EQ(nullptr, getInst(F, "sq"));
+  Instruction *Pre = findInst(*Entry, Instruction::Mul);
+  ASSERT_TRUE(Pre);
+  EXPECT_EQ(F.getArg(1), Pre->getOperand(0));
+  EXPECT_EQ(F.getArg(1), Pre->getOperand(1));
+
+  auto *Store = cast<StoreInst>(findInst(*Loop, Instruction::Store));
+  auto *Phi = dyn_cast<PHINode>(Store->getValueOperand());
+  ASSERT_TRUE(Phi);
+  EXPECT_EQ(Pre, Phi->getIncomingValueForBlock(Entry));
+  EXPECT_EQ(getInst(F, "sq.next"), Phi->getIncomingValueForBlock(Loop));
+}
+
+} // end anonymous namespace
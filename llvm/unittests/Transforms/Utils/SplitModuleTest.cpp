@@ -0,0 +1,184 @@
+//===- SplitModuleTest.cpp - SplitModule unit tests -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+// The partitions are clones, so the module needs the instruction ID counter.
+static std::unique_ptr<Module> parseIR(LLVMContext &C, const char *IR) {
+  return unittest::parseModuleWithIDs(IR, C, "SplitModuleTests");
+}
+
+// Return the names of the functions defined in each partition, in order.
+static std::vector<std::vector<std::string>>
+split(std::unique_ptr<Module> M, unsigned N, bool PreserveOrder) {
+  std::vector<std::vector<std::string>> Parts;
+  SplitModule(
+      std::move(M), N,
+      [&](std::unique_ptr<Module> MPart) {
+        Parts.emplace_back();
+        for (Function &F : *MPart)
+          if (!F.isDeclaration())
+            Parts.back().push_back(std::string(F.getName()));
+        // Globals are listed after the functions, prefixed with '@'.
+        for (GlobalVariable &GV : MPart->globals())
+          if (!GV.isDeclaration())
+            Parts.back().push_back("@" + std::string(GV.getName()));
+      },
+      /*PreserveLocals=*/false, PreserveOrder);
+  return Parts;
+}
+
+static const char *OrderIR = R"IR(
+  @g = global i32 0
+  @h = internal global i32 0
+
+  define void @f0() {
+    fence seq_cst
+    ret void
+  }
+  define void @f1() {
+    fence seq_cst
+    ret void
+  }
+  define void @f2() {
+    fence seq_cst
+    ret void
+  }
+  define void @f3() {
+    fence seq_cst
+    ret void
+  }
+  define void @f4() {
+    fence seq_cst
+    ret void
+  }
+  define void @f5() {
+    store i32 1, i32* @g
+    ret void
+  }
+  define void @f6() {
+    store i32 1, i32* @h
+    ret void
+  }
+  define void @f7() {
+    store i32 1, i32* @g
+    ret void
+  }
+)IR";
+
+TEST(SplitModule, PreserveOrder) {
+  LLVMContext C;
+  std::unique_ptr<Module> M = parseIR(C, OrderIR);
+  ASSERT_TRUE(M);
+
+  // Each partition gets a contiguous run of functions with about the same
+  // number of instructions, and @g goes along with its first user.
+  auto Parts = split(std::move(M), 4, /*PreserveOrder=*/true);
+  ASSERT_EQ(4u, Parts.size());
+  EXPECT_EQ((std::vector<std::string>{"f0", "f1"}), Parts[0]);
+  EXPECT_EQ((std::vector<std::string>{"f2", "f3"}), Parts[1]);
+  EXPECT_EQ((std::vector<std::string>{"f4", "f5", "@g"}), Parts[2]);
+  EXPECT_EQ((std::vector<std::string>{"f6", "f7", "@h"}), Parts[3]);
+}
+
+TEST(SplitModule, PreserveOrderKeepsComdatsTogether) {
+  LLVMContext C;
+  std::unique_ptr<Module> M = parseIR(C, R"IR(
+    $c = comdat any
+
+    define void @f0() {
+      ret void
+    }
+    define void @f1() comdat($c) {
+      ret void
+    }
+    define void @f2() {
+      ret void
+    }
+    define void @f3() comdat($c) {
+      ret void
+    }
+  )IR");
+  ASSERT_TRUE(M);
+
+  // @f3 follows @f1, the first member of its comdat.
+  auto Parts = split(std::move(M), 2, /*PreserveOrder=*/true);
+  ASSERT_EQ(2u, Parts.size());
+  EXPECT_EQ((std::vector<std::string>{"f0", "f1", "f3"}), Parts[0]);
+  EXPECT_EQ((std::vector<std::string>{"f2"}), Parts[1]);
+}
+
+TEST(SplitModule, PartitionsHaveTheirOwnIDCounter) {
+  LLVMContext C;
+  std::unique_ptr<Module> M = parseIR(C, OrderIR);
+  ASSERT_TRUE(M);
+
+  std::vector<std::unique_ptr<Module>> Parts;
+  SplitModule(std::move(M), 2, [&](std::unique_ptr<Module> MPart) {
+    Parts.push_back(std::move(MPart));
+  });
+  ASSERT_EQ(2u, Parts.size());
+
+  MDNode *Counters[2];
+  for (unsigned I = 0; I != 2; ++I) {
+    NamedMDNode *IDs = Parts[I]->getNamedMetadata("ID");
+    ASSERT_TRUE(IDs);
+    ASSERT_EQ(1u, IDs->getNumOperands());
+    Counters[I] = IDs->getOperand(0);
+    EXPECT_TRUE(Counters[I]->isDistinct());
+  }
+  EXPECT_NE(Counters[0], Counters[1]);
+
+  // Taking an ID in one partition leaves the counter of the other alone.
+  Metadata *Next = Counters[1]->getOperand(0);
+  Parts[0]->getNewID();
+  EXPECT_EQ(Next, Counters[1]->getOperand(0).get());
+  EXPECT_EQ(Next, Parts[1]->getNewID());
+}
+
+TEST(SplitModule, DefaultDistributesByName) {
+  LLVMContext C;
+  std::unique_ptr<Module> M = parseIR(C, OrderIR);
+  ASSERT_TRUE(M);
+
+  // Without PreserveOrder the partitions do not depend on the order of the
+  // functions: every function ends up in the partition of its name's hash.
+  auto Parts = split(std::move(M), 4, /*PreserveOrder=*/false);
+  ASSERT_EQ(4u, Parts.size());
+
+  LLVMContext C2;
+  std::unique_ptr<Module> Reversed = parseIR(C2, OrderIR);
+  ASSERT_TRUE(Reversed);
+  std::vector<Function *> Fns;
+  for (Function &F : *Reversed)
+    Fns.push_back(&F);
+  for (Function *F : Fns) {
+    F->removeFromParent();
+    Reversed->getFunctionList().push_front(F);
+  }
+  auto ReversedParts = split(std::move(Reversed), 4, /*PreserveOrder=*/false);
+  ASSERT_EQ(4u, ReversedParts.size());
+
+  unsigned NumFunctions = 0;
+  for (unsigned I = 0; I != 4; ++I) {
+    std::vector<std::string> A = Parts[I], B = ReversedParts[I];
+    llvm::sort(A);
+    llvm::sort(B);
+    EXPECT_EQ(A, B);
+    NumFunctions += llvm::count_if(A, [](const std::string &Name) {
+      return Name[0] != '@';
+    });
+  }
+  EXPECT_EQ(8u, NumFunctions);
+}
@@ -0,0 +1,202 @@
+//===- LoopVectorizeEarlyExitTest.cpp - Early exit vectorization tests ----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Vectorize/LoopVectorize.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using llvm::unittest::getBasicBlockByName;
+
+namespace {
+
+class LoopVectorizeEarlyExitTest : public unittest::PassTest {
+protected:
+  LoopVectorizeEarlyExitTest() : PassTest("LoopVectorizeEarlyExitTest") {}
+
+  std::unique_ptr<Module> parse(StringRef Body) {
+    // The loops are forced to VF 4, as there is no target to pick one.
+    std::string Text = (Body + R"(
+      !1 = distinct !{!1, !2, !3}
+      !2 = !{!"llvm.loop.vectorize.width", i32 4}
+      !3 = !{!"llvm.loop.vectorize.enable", i1 true}
+    )").str();
+    return PassTest::parse(Text);
+  }
+
+  bool run(Function &F) { return runPass(LoopVectorizePass(), F); }
+};
+
+TEST_F(LoopVectorizeEarlyExitTest, SearchLoop) {
+  std::unique_ptr<Module> M = parse(R"(
+    define i64 @find(i8* dereferenceable(1024) %p, i8 %c) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+      %gep = getelementptr inbounds i8, i8* %p, i64 %i
+      %v = load i8, i8* %gep, align 1
+      %found = icmp eq i8 %v, %c
+      br i1 %found, label %exit, label %latch
+
+    latch:
+      %i.next = add nuw nsw i64 %i, 1
+      %done = icmp eq i64 %i.next, 1024
+      br i1 %done, label %exit, label %loop, !llvm.loop !1
+
+    exit:
+      %r = phi i64 [ %i, %loop ], [ -1, %latch ]
+      ret i64 %r
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("find");
+  ASSERT_TRUE(run(F));
+
+  // The vector loop leaves for the scalar loop from the first lane that finds
+  // the value, and for the exit of the latch otherwise.
+  BasicBlock *EarlyExit = getBasicBlockByName(F, "vector.early.exit");
+  ASSERT_TRUE(EarlyExit);
+  BasicBlock *ScalarPH = getBasicBlockByName(F, "scalar.ph");
+  EXPECT_EQ(ScalarPH, EarlyExit->getSingleSuccessor());
+  EXPECT_TRUE(any_of(*EarlyExit, [](Instruction &I) {
+    auto *II = dyn_cast<IntrinsicInst>(&I);
+    return II && II->getIntrinsicID() == Intrinsic::cttz;
+  }));
+  auto *ResumeVal = cast<PHINode>(&ScalarPH->front());
+  EXPECT_NE(-1, ResumeVal->getBasicBlockIndex(EarlyExit));
+
+  // The exit value of the latch is taken from the middle block.
+  BasicBlock *Middle = getBasicBlockByName(F, "middle.block");
+  auto *ExitPhi = cast<PHINode>(&getBasicBlockByName(F, "exit")->front());
+  EXPECT_EQ(3u, ExitPhi->getNumIncomingValues());
+  EXPECT_EQ(ExitPhi->getIncomingValueForBlock(getBasicBlockByName(F, "latch")),
+            ExitPhi->getIncomingValueForBlock(Middle));
+}
+
+TEST_F(LoopVectorizeEarlyExitTest, NoVectorizeWithStore) {
+  std::unique_ptr<Module> M = parse(R"(
+    define i64 @clear_until(i8* dereferenceable(1024) %p, i8 %c) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+      %gep = getelementptr inbounds i8, i8* %p, i64 %i
+      %v = load i8, i8* %gep, align 1
+      %found = icmp eq i8 %v, %c
+      br i1 %found, label %exit, label %latch
+
+    latch:
+      store i8 0, i8* %gep, align 1
+      %i.next = add nuw nsw i64 %i, 1
+      %done = icmp eq i64 %i.next, 1024
+      br i1 %done, label %exit, label %loop, !llvm.loop !1
+
+    exit:
+      %r = phi i64 [ %i, %loop ], [ -1, %latch ]
+      ret i64 %r
+    }
+  )");
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("clear_until")));
+}
+
+TEST_F(LoopVectorizeEarlyExitTest, NoVectorizeUnboundedLoad) {
+  // Nothing is known about the memory past the element that is found.
+  std::unique_ptr<Module> M = parse(R"(
+    define i64 @find_n(i8* %p, i8 %c, i64 %n) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+      %gep = getelementptr inbounds i8, i8* %p, i64 %i
+      %v = load i8, i8* %gep, align 1
+      %found = icmp eq i8 %v, %c
+      br i1 %found, label %exit, label %latch
+
+    latch:
+      %i.next = add nuw nsw i64 %i, 1
+      %done = icmp eq i64 %i.next, %n
+      br i1 %done, label %exit, label %loop, !llvm.loop !1
+
+    exit:
+      %r = phi i64 [ %i, %loop ], [ -1, %latch ]
+      ret i64 %r
+    }
+  )");
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("find_n")));
+}
+
+TEST_F(LoopVectorizeEarlyExitTest, NoVectorizePastCountableEarlyExit) {
+  // The loop only reads up to a[10], but the vector loop runs for the 1000
+  // iterations of the latch.
+  std::unique_ptr<Module> M = parse(R"(
+    define i64 @find_10(i8* dereferenceable(11) %p, i8 %c) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+      %gep = getelementptr inbounds i8, i8* %p, i64 %i
+      %v = load i8, i8* %gep, align 1
+      %found = icmp eq i8 %v, %c
+      %at.10 = icmp eq i64 %i, 10
+      %stop = or i1 %found, %at.10
+      br i1 %stop, label %exit, label %latch
+
+    latch:
+      %i.next = add nuw nsw i64 %i, 1
+      %done = icmp eq i64 %i.next, 1000
+      br i1 %done, label %exit, label %loop, !llvm.loop !1
+
+    exit:
+      %r = phi i64 [ %i, %loop ], [ -1, %latch ]
+      ret i64 %r
+    }
+  )");
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("find_10")));
+}
+
+TEST_F(LoopVectorizeEarlyExitTest, NoVectorizePastTripCountRoundedToVF) {
+  // The last vector iteration of VF 4 reads two bytes past the 1022 that the
+  // latch bounds.
+  std::unique_ptr<Module> M = parse(R"(
+    define i64 @find(i8* dereferenceable(1022) %p, i8 %c) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+      %gep = getelementptr inbounds i8, i8* %p, i64 %i
+      %v = load i8, i8* %gep, align 1
+      %found = icmp eq i8 %v, %c
+      br i1 %found, label %exit, label %latch
+
+    latch:
+      %i.next = add nuw nsw i64 %i, 1
+      %done = icmp eq i64 %i.next, 1022
+      br i1 %done, label %exit, label %loop, !llvm.loop !1
+
+    exit:
+      %r = phi i64 [ %i, %loop ], [ -1, %latch ]
+      ret i64 %r
+    }
+  )");
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("find")));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,312 @@
+//===- SLPVectorizerTest.cpp - SLP vectorizer unit tests ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Vectorize/SLPVectorizer.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/TargetTransformInfoImpl.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Testing/Support/IRHelpers.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+/// A target with 128-bit vector registers and masked loads and stores, which
+/// splits the vector loads and stores that aren't a power of two into
+/// scalars.
+class VectorTTIImpl : public TargetTransformInfoImplCRTPBase<VectorTTIImpl> {
+  using BaseT = TargetTransformInfoImplCRTPBase<VectorTTIImpl>;
+
+public:
+  explicit VectorTTIImpl(const DataLayout &DL) : BaseT(DL) {}
+
+  unsigned getRegisterBitWidth(bool Vector) const { return Vector ? 128 : 64; }
+
+  bool isLegalMaskedLoad(Type *DataType, Align Alignment) { return true; }
+  bool isLegalMaskedStore(Type *DataType, Align Alignment) { return true; }
+
+  unsigned getMemoryOpCost(unsigned Opcode, Type *Src, Align Alignment,
+                           unsigned AddressSpace, TTI::TargetCostKind CostKind,
+                           const Instruction *I) const {
+    auto *VecTy = dyn_cast<FixedVectorType>(Src);
+    if (VecTy && !isPowerOf2_32(VecTy->getNumElements()))
+      return VecTy->getNumElements();
+    return 1;
+  }
+};
+
+class SLPVectorizerTest : public unittest::PassTest {
+protected:
+  cl::opt<bool> *NonPowerOf2;
+
+  SLPVectorizerTest()
+      : PassTest("SLPVectorizerTest",
+                 TargetIRAnalysis([](const Function &F) {
+                   return TargetTransformInfo(
+                       VectorTTIImpl(F.getParent()->getDataLayout()));
+                 })) {
+    NonPowerOf2 = static_cast<cl::opt<bool> *>(
+        cl::getRegisteredOptions().lookup("slp-vectorize-non-power-of-2"));
+    NonPowerOf2->setValue(true);
+  }
+
+  ~SLPVectorizerTest() { NonPowerOf2->setValue(false); }
+
+  bool run(Function &F) { return runPass(SLPVectorizerPass(), F); }
+
+  /// \returns the calls to \p ID in \p F.
+  static SmallVector<IntrinsicInst *, 4> getCalls(Function &F,
+                                                  Intrinsic::ID ID) {
+    SmallVector<IntrinsicInst *, 4> Calls;
+    for (Instruction &I : instructions(F))
+      if (auto *II = dyn_cast<IntrinsicInst>(&I))
+        if (II->getIntrinsicID() == ID)
+          Calls.push_back(II);
+    return Calls;
+  }
+
+  /// \returns the number of lanes enabled by the constant \p Mask.
+  static unsigned getNumEnabledLanes(Value *Mask) {
+    auto *C = cast<Constant>(Mask);
+    unsigned NumEnabled = 0;
+    for (unsigned I = 0, E = cast<FixedVectorType>(C->getType())
+                                 ->getNumElements();
+         I != E; ++I)
+      NumEnabled += C->getAggregateElement(I)->isOneValue();
+    return NumEnabled;
+  }
+
+  static unsigned countVectorOps(Function &F, unsigned Opcode) {
+    unsigned Count = 0;
+    for (Instruction &I : instructions(F))
+      if (I.getOpcode() == Opcode && I.getType()->isVectorTy())
+        ++Count;
+    return Count;
+  }
+};
+
+// The x, y and z of a point, which only fill three lanes of a register.
+const char *AddPoints = R"(
+  define void @add(float* noalias %a, float* noalias %b, float* noalias %c) {
+    %a1.p = getelementptr inbounds float, float* %a, i64 1
+    %a2.p = getelementptr inbounds float, float* %a, i64 2
+    %b1.p = getelementptr inbounds float, float* %b, i64 1
+    %b2.p = getelementptr inbounds float, float* %b, i64 2
+    %c1.p = getelementptr inbounds float, float* %c, i64 1
+    %c2.p = getelementptr inbounds float, float* %c, i64 2
+    %a0 = load float, float* %a, align 4
+    %a1 = load float, float* %a1.p, align 4
+    %a2 = load float, float* %a2.p, align 4
+    %b0 = load float, float* %b, align 4
+    %b1 = load float, float* %b1.p, align 4
+    %b2 = load float, float* %b2.p, align 4
+    %c0 = fadd float %a0, %b0
+    %c1 = fadd float %a1, %b1
+    %c2 = fadd float %a2, %b2
+    store float %c0, float* %c, align 4
+    store float %c1, float* %c1.p, align 4
+    store float %c2, float* %c2.p, align 4
+    ret void
+  }
+)";
+
+TEST_F(SLPVectorizerTest, MaskedPoint) {
+  std::unique_ptr<Module> M = parse(AddPoints);
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("add");
+  ASSERT_TRUE(run(F));
+
+  // Nothing is known about the memory after the points, so all the accesses
+  // are masked to three lanes.
+  auto Loads = getCalls(F, Intrinsic::masked_load);
+  auto Stores = getCalls(F, Intrinsic::masked_store);
+  ASSERT_EQ(2u, Loads.size());
+  ASSERT_EQ(1u, Stores.size());
+  for (IntrinsicInst *Load : Loads) {
+    EXPECT_EQ(4u, cast<FixedVectorType>(Load->getType())->getNumElements());
+    EXPECT_EQ(3u, getNumEnabledLanes(Load->getArgOperand(2)));
+  }
+  EXPECT_EQ(3u, getNumEnabledLanes(Stores[0]->getArgOperand(3)));
+  EXPECT_EQ(1u, countVectorOps(F, Instruction::FAdd));
+}
+
+TEST_F(SLPVectorizerTest, DereferenceablePadding) {
+  // The fourth lane of %a may be loaded, as it is dereferenceable.
+  std::string Text = AddPoints;
+  Text.replace(Text.find("float* noalias %a"), strlen("float* noalias %a"),
+               "float* noalias dereferenceable(16) %a");
+  std::unique_ptr<Module> M = parse(Text);
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("add");
+  ASSERT_TRUE(run(F));
+
+  EXPECT_EQ(1u, getCalls(F, Intrinsic::masked_load).size());
+  EXPECT_EQ(1u, getCalls(F, Intrinsic::masked_store).size());
+  unsigned NumPaddedLoads = 0;
+  for (Instruction &I : instructions(F))
+    if (auto *Load = dyn_cast<LoadInst>(&I))
+      if (auto *VecTy = dyn_cast<FixedVectorType>(Load->getType())) {
+        EXPECT_EQ(4u, VecTy->getNumElements());
+        ++NumPaddedLoads;
+      }
+  EXPECT_EQ(1u, NumPaddedLoads);
+}
+
+TEST_F(SLPVectorizerTest, NoPaddingByDefault) {
+  NonPowerOf2->setValue(false);
+  std::unique_ptr<Module> M = parse(AddPoints);
+  ASSERT_TRUE(M);
+  EXPECT_FALSE(run(*M->getFunction("add")));
+}
+
+TEST_F(SLPVectorizerTest, StoreChainTail) {
+  // Seven stores are vectorized as a full vector, and a tail of three that
+  // is padded.
+  std::unique_ptr<Module> M = parse(R"(
+    define void @splat7(float* noalias %a, float %x) {
+      %a1 = getelementptr inbounds float, float* %a, i64 1
+      %a2 = getelementptr inbounds float, float* %a, i64 2
+      %a3 = getelementptr inbounds float, float* %a, i64 3
+      %a4 = getelementptr inbounds float, float* %a, i64 4
+      %a5 = getelementptr inbounds float, float* %a, i64 5
+      %a6 = getelementptr inbounds float, float* %a, i64 6
+      %v0 = fmul float %x, 1.0
+      %v1 = fmul float %x, 2.0
+      %v2 = fmul float %x, 3.0
+      %v3 = fmul float %x, 4.0
+      %v4 = fmul float %x, 5.0
+      %v5 = fmul float %x, 6.0
+      %v6 = fmul float %x, 7.0
+      store float %v0, float* %a, align 4
+      store float %v1, float* %a1, align 4
+      store float %v2, float* %a2, align 4
+      store float %v3, float* %a3, align 4
+      store float %v4, float* %a4, align 4
+      store float %v5, float* %a5, align 4
+      store float %v6, float* %a6, align 4
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("splat7");
+  ASSERT_TRUE(run(F));
+
+  EXPECT_EQ(2u, countVectorOps(F, Instruction::FMul));
+  auto MaskedStores = getCalls(F, Intrinsic::masked_store);
+  ASSERT_EQ(1u, MaskedStores.size());
+  EXPECT_EQ(3u, getNumEnabledLanes(MaskedStores[0]->getArgOperand(3)));
+  unsigned NumStores = 0;
+  for (Instruction &I : instructions(F))
+    if (auto *Store = dyn_cast<StoreInst>(&I)) {
+      EXPECT_TRUE(Store->getValueOperand()->getType()->isVectorTy());
+      ++NumStores;
+    }
+  EXPECT_EQ(1u, NumStores);
+}
+
+TEST_F(SLPVectorizerTest, TwoPoints) {
+  // The coordinates of two points fill six of the eight lanes of a register.
+  std::unique_ptr<Module> M = parse(R"(
+    define void @add2(i16* noalias %a, i16* noalias %b, i16* noalias %c) {
+      %a1.p = getelementptr inbounds i16, i16* %a, i64 1
+      %a2.p = getelementptr inbounds i16, i16* %a, i64 2
+      %a3.p = getelementptr inbounds i16, i16* %a, i64 3
+      %a4.p = getelementptr inbounds i16, i16* %a, i64 4
+      %a5.p = getelementptr inbounds i16, i16* %a, i64 5
+      %b1.p = getelementptr inbounds i16, i16* %b, i64 1
+      %b2.p = getelementptr inbounds i16, i16* %b, i64 2
+      %b3.p = getelementptr inbounds i16, i16* %b, i64 3
+      %b4.p = getelementptr inbounds i16, i16* %b, i64 4
+      %b5.p = getelementptr inbounds i16, i16* %b, i64 5
+      %c1.p = getelementptr inbounds i16, i16* %c, i64 1
+      %c2.p = getelementptr inbounds i16, i16* %c, i64 2
+      %c3.p = getelementptr inbounds i16, i16* %c, i64 3
+      %c4.p = getelementptr inbounds i16, i16* %c, i64 4
+      %c5.p = getelementptr inbounds i16, i16* %c, i64 5
+      %a0 = load i16, i16* %a, align 2
+      %a1 = load i16, i16* %a1.p, align 2
+      %a2 = load i16, i16* %a2.p, align 2
+      %a3 = load i16, i16* %a3.p, align 2
+      %a4 = load i16, i16* %a4.p, align 2
+      %a5 = load i16, i16* %a5.p, align 2
+      %b0 = load i16, i16* %b, align 2
+      %b1 = load i16, i16* %b1.p, align 2
+      %b2 = load i16, i16* %b2.p, align 2
+      %b3 = load i16, i16* %b3.p, align 2
+      %b4 = load i16, i16* %b4.p, align 2
+      %b5 = load i16, i16* %b5.p, align 2
+      %c0 = add i16 %a0, %b0
+      %c1 = add i16 %a1, %b1
+      %c2 = add i16 %a2, %b2
+      %c3 = add i16 %a3, %b3
+      %c4 = add i16 %a4, %b4
+      %c5 = add i16 %a5, %b5
+      store i16 %c0, i16* %c, align 2
+      store i16 %c1, i16* %c1.p, align 2
+      store i16 %c2, i16* %c2.p, align 2
+      store i16 %c3, i16* %c3.p, align 2
+      store i16 %c4, i16* %c4.p, align 2
+      store i16 %c5, i16* %c5.p, align 2
+      ret void
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("add2");
+  ASSERT_TRUE(run(F));
+
+  // All six lanes are added at once, and the accesses are masked to them.
+  EXPECT_EQ(1u, countVectorOps(F, Instruction::Add));
+  auto Loads = getCalls(F, Intrinsic::masked_load);
+  auto Stores = getCalls(F, Intrinsic::masked_store);
+  ASSERT_EQ(2u, Loads.size());
+  ASSERT_EQ(1u, Stores.size());
+  for (IntrinsicInst *Load : Loads) {
+    EXPECT_EQ(8u, cast<FixedVectorType>(Load->getType())->getNumElements());
+    EXPECT_EQ(6u, getNumEnabledLanes(Load->getArgOperand(2)));
+  }
+  EXPECT_EQ(6u, getNumEnabledLanes(Stores[0]->getArgOperand(3)));
+}
+
+TEST_F(SLPVectorizerTest, ListOfSix) {
+  // Six values built into a vector are tried as a whole before VF 4.
+  std::unique_ptr<Module> M = parse(R"(
+    define <8 x i16> @build(i16 %x, i16 %y) {
+      %v0 = mul i16 %x, %y
+      %v1 = add i16 %x, %y
+      %v2 = mul i16 %x, 3
+      %v3 = add i16 %x, 4
+      %v4 = mul i16 %x, 5
+      %v5 = add i16 %x, 6
+      %i0 = insertelement <8 x i16> undef, i16 %v0, i32 0
+      %i1 = insertelement <8 x i16> %i0, i16 %v1, i32 1
+      %i2 = insertelement <8 x i16> %i1, i16 %v2, i32 2
+      %i3 = insertelement <8 x i16> %i2, i16 %v3, i32 3
+      %i4 = insertelement <8 x i16> %i3, i16 %v4, i32 4
+      %i5 = insertelement <8 x i16> %i4, i16 %v5, i32 5
+      ret <8 x i16> %i5
+    }
+  )");
+  ASSERT_TRUE(M);
+  Function &F = *M->getFunction("build");
+  ASSERT_TRUE(run(F));
+
+  unsigned NumSixWide = 0;
+  for (Instruction &I : instructions(F))
+    if (auto *VecTy = dyn_cast<FixedVectorType>(I.getType()))
+      if (I.isBinaryOp()) {
+        EXPECT_EQ(6u, VecTy->getNumElements());
+        ++NumSixWide;
+      }
+  EXPECT_LE(1u, NumSixWide);
+}
+
+} // end anonymous namespace
@@ -1529,11 +1529,12 @@ typedef struct kmp_sched_flags {
   unsigned ordered : 1;
   unsigned nomerge : 1;
   unsigned contains_last : 1;
+  unsigned auto_adaptive : 1; /* schedule(auto) chosen from loop feedback */
 #if KMP_USE_HIER_SCHED
   unsigned use_hier : 1;
-  unsigned unused : 28;
+  unsigned unused : 27;
 #else
-  unsigned unused : 29;
+  unsigned unused : 28;
 #endif
 } kmp_sched_flags_t;
 
@@ -1668,6 +1669,7 @@ typedef struct KMP_ALIGN_CACHE dispatch_private_info {
   void *parent; /* hierarchical scheduling parent pointer */
 #endif
   enum cons_type pushed_ws;
+  kmp_uint64 auto_start; /* start time of an adaptive schedule(auto) loop */
 } dispatch_private_info_t;
 
 typedef struct dispatch_shared_info32 {
@@ -1699,6 +1701,13 @@ typedef struct dispatch_shared_info {
   volatile kmp_int32 doacross_buf_idx; // teamwise index
   volatile kmp_uint32 *doacross_flags; // shared array of iteration flags (0/1)
   kmp_int32 doacross_num_done; // count finished threads
+  // Adaptive schedule(auto): chunk size chosen for the loop (> 0 for static
+  // steal, < 0 for guided, 0 while not decided yet), loop site statistics and
+  // the time spent by the threads in the loop.
+  volatile kmp_int64 auto_chunk;
+  struct kmp_auto_sched_site *auto_site;
+  volatile kmp_uint64 auto_time_sum;
+  volatile kmp_uint64 auto_time_max;
 #if KMP_USE_HIER_SCHED
   void *hier;
 #endif
@@ -1788,6 +1797,7 @@ typedef enum kmp_bar_pat { /* Barrier communication patterns */
                                2, /* Hypercube-embedded tree with min branching
                                      factor 2^n */
                            bp_hierarchical_bar = 3, /* Machine hierarchy tree */
+                           bp_dist_bar = 4, /* Two-level tree of NUMA groups */
                            bp_last_bar /* Placeholder to mark the end */
 } kmp_bar_pat_e;
 
@@ -2059,6 +2069,8 @@ extern kmp_tasking_mode_t
     __kmp_tasking_mode; /* determines how/when to execute tasks */
 extern int __kmp_task_stealing_constraint;
 extern int __kmp_enable_task_throttling;
+extern int __kmp_lock_free_task_deque;
+extern int __kmp_use_task_pool;
 extern kmp_int32 __kmp_default_device; // Set via OMP_DEFAULT_DEVICE if
 // specified, defaults to 0 otherwise
 // Set via OMP_MAX_TASK_PRIORITY if specified, defaults to 0 otherwise
@@ -2121,6 +2133,54 @@ typedef struct kmp_taskgroup {
   kmp_int32 reduce_num_data; // number of data items to reduce
 } kmp_taskgroup_t;
 
+// Task graph record and replay: the first execution of a task graph region
+// records the tasks created in it and the dependences between them, later
+// executions run the recorded graph again without creating the tasks.
+typedef enum kmp_taskgraph_status {
+  KMP_TASKGRAPH_NONE = 0, // not recorded yet
+  KMP_TASKGRAPH_RECORDING, // recorded by tg_owner
+  KMP_TASKGRAPH_READY, // recorded, can be replayed
+  KMP_TASKGRAPH_REPLAYING, // replayed by tg_owner
+  KMP_TASKGRAPH_INVALID // can't be replayed, the region is always executed
+} kmp_taskgraph_status_t;
+
+typedef struct kmp_taskgraph_node {
+  struct kmp_taskgraph *tgn_graph;
+  kmp_task_t *tgn_task; // copy of the task taken when it was recorded
+  kmp_task_t *tgn_exec; // task executed by the replays, refreshed from tgn_task
+  kmp_int32 *tgn_successors; // indices of the dependent nodes
+  kmp_int32 tgn_nsuccessors;
+  kmp_int32 tgn_successors_size;
+  kmp_int32 tgn_npredecessors;
+  std::atomic<kmp_int32> tgn_npredecessors_left; // during a replay
+  std::atomic<kmp_int32> tgn_busy; // tgn_exec not freed by the last replay yet
+} kmp_taskgraph_node_t;
+
+// Last writer and readers of an address, used while a graph is recorded
+typedef struct kmp_taskgraph_dep {
+  kmp_intptr_t tgd_addr;
+  kmp_int32 tgd_last_out; // node that last wrote the address, or -1
+  kmp_int32 *tgd_ins; // nodes that read the address since tgd_last_out
+  kmp_int32 tgd_nins;
+  kmp_int32 tgd_ins_size;
+  struct kmp_taskgraph_dep *tgd_next;
+} kmp_taskgraph_dep_t;
+
+#define KMP_TASKGRAPH_DEP_BUCKETS 997
+
+typedef struct kmp_taskgraph {
+  kmp_int32 tg_id;
+  std::atomic<kmp_int32> tg_status; // kmp_taskgraph_status_t
+  bool tg_invalid; // the region being recorded can't be replayed
+  kmp_taskgraph_node_t *tg_nodes;
+  kmp_int32 tg_nnodes;
+  kmp_int32 tg_nodes_size;
+  kmp_taskdata_t *tg_owner; // task recording or replaying the graph
+  struct kmp_taskgraph *tg_outer; // graph of the enclosing region of tg_owner
+  kmp_taskgraph_dep_t **tg_deps; // hash table of addresses while recording
+  struct kmp_taskgraph *tg_next; // next graph in the hash bucket
+} kmp_taskgraph_t;
+
 // forward declarations
 typedef union kmp_depnode kmp_depnode_t;
 typedef struct kmp_depnode_list kmp_depnode_list_t;
@@ -2252,7 +2312,9 @@ typedef struct kmp_tasking_flags { /* Total struct must be exactly 32 bits */
   unsigned complete : 1; /* 1==complete, 0==not complete   */
   unsigned freed : 1; /* 1==freed, 0==allocated        */
   unsigned native : 1; /* 1==gcc-compiled task, 0==intel */
-  unsigned reserved31 : 7; /* reserved for library use */
+  unsigned taskgraph : 1; /* 1==replayed node of a recorded task graph */
+  unsigned pooled : 1; /* 1==allocated from the task pool of td_alloc_thread */
+  unsigned reserved31 : 5; /* reserved for library use */
 
 } kmp_tasking_flags_t;
 
@@ -2295,6 +2357,7 @@ struct kmp_taskdata { /* aligned during dynamic allocation       */
   void (*td_copy_func)(void *, void *);
 #endif
   kmp_event_t td_allow_completion_event;
+  kmp_taskgraph_node_t *td_taskgraph_node; // Graph node of a replayed task
 #if OMPT_SUPPORT
   ompt_task_info_t ompt_task_info;
 #endif
@@ -2303,6 +2366,14 @@ struct kmp_taskdata { /* aligned during dynamic allocation       */
 // Make sure padding above worked
 KMP_BUILD_ASSERT(sizeof(kmp_taskdata_t) % sizeof(void *) == 0);
 
+// Array of a lock-free task deque. The arrays replaced by larger ones are kept
+// until the deque is freed since thieves may still read from them.
+typedef struct kmp_task_deque_array {
+  struct kmp_task_deque_array *tda_prev; // array replaced by this one
+  kmp_int64 tda_mask; // size - 1, the size is a power of two
+  std::atomic<kmp_taskdata_t *> tda_tasks[1];
+} kmp_task_deque_array_t;
+
 // Data for task team but per thread
 typedef struct kmp_base_thread_data {
   kmp_info_p *td_thr; // Pointer back to thread info
@@ -2317,6 +2388,13 @@ typedef struct kmp_base_thread_data {
   kmp_int32 td_deque_ntasks; // Number of tasks in deque
   // GEH: shouldn't this be volatile since used in while-spin?
   kmp_int32 td_deque_last_stolen; // Thread number of last successful steal
+  kmp_int32 td_package; // Package of td_thr, -1 if unknown
+  // Lock-free deque (KMP_LOCK_FREE_TASK_DEQUE): td_thr pushes and pops its
+  // tasks at td_lf_bottom, thieves take them at td_lf_top with a CAS. td_deque
+  // then only holds the tasks given to td_thr by other threads.
+  std::atomic<kmp_task_deque_array_t *> td_lf_array;
+  std::atomic<kmp_int64> td_lf_bottom;
+  KMP_ALIGN_CACHE std::atomic<kmp_int64> td_lf_top;
 #ifdef BUILD_TIED_TASK_STACK
   kmp_task_stack_t td_susp_tied_tasks; // Stack of suspended tied tasks for task
 // scheduling constraint
@@ -2329,6 +2407,10 @@ typedef struct kmp_base_thread_data {
 #define TASK_DEQUE_SIZE(td) ((td).td_deque_size)
 #define TASK_DEQUE_MASK(td) ((td).td_deque_size - 1)
 
+// Number of random picks of a victim on another package rejected by a thief
+// before one is accepted
+#define KMP_TASK_REMOTE_VICTIM_REJECTS 2
+
 typedef union KMP_ALIGN_CACHE kmp_thread_data {
   kmp_base_thread_data_t td;
   double td_align; /* use worst case alignment */
@@ -2377,6 +2459,31 @@ typedef struct kmp_free_list {
   // sync list)
 } kmp_free_list_t;
 #endif
+
+// Task descriptor pool: free lists of the task descriptors allocated by a
+// thread, in size classes of 1 to KMP_TASK_POOL_CLASSES cache lines
+#define KMP_TASK_POOL_CLASSES 8
+#define KMP_TASK_POOL_MAX_SIZE (KMP_TASK_POOL_CLASSES * CACHE_LINE)
+#define KMP_TASK_POOL_CHUNK_SIZE (16 * 1024) // descriptors are carved from it
+#define KMP_TASK_POOL_BATCH 16 // descriptors returned to their owner at once
+#define KMP_TASK_POOL_OWNERS 4 // batches being gathered per size class
+
+// Descriptors freed by a thread other than their owner, returned together
+typedef struct kmp_task_pool_batch {
+  kmp_info_p *tpb_owner;
+  void *tpb_head;
+  void *tpb_tail;
+  kmp_int32 tpb_count;
+} kmp_task_pool_batch_t;
+
+typedef struct kmp_task_pool {
+  void *tp_free[KMP_TASK_POOL_CLASSES]; // Used by the owner only
+  void *tp_chunks; // Chunks of the owner, freed when the owner is reaped
+  kmp_int32 tp_pending; // Number of non-empty batches
+  kmp_task_pool_batch_t tp_batches[KMP_TASK_POOL_CLASSES][KMP_TASK_POOL_OWNERS];
+  // Descriptors returned by the other threads, kept away from the owner lists
+  KMP_ALIGN_CACHE std::atomic<void *> tp_returned[KMP_TASK_POOL_CLASSES];
+} kmp_task_pool_t;
 #if KMP_NESTED_HOT_TEAMS
 // Hot teams array keeps hot teams and their sizes for given thread. Hot teams
 // are not put in teams pool, and they don't put threads in threads pool.
@@ -2498,6 +2605,7 @@ typedef struct KMP_ALIGN_CACHE kmp_base_info {
   /* Tasking-related data for the thread */
   kmp_task_team_t *th_task_team; // Task team struct
   kmp_taskdata_t *th_current_task; // Innermost Task being executed
+  kmp_taskgraph_t *th_taskgraph; // Task graph recorded or replayed by thread
   kmp_uint8 th_task_state; // alternating 0/1 for task team identification
   kmp_uint8 *th_task_state_memo_stack; // Stack holding memos of th_task_state
   // at nested levels
@@ -2527,6 +2635,7 @@ typedef struct KMP_ALIGN_CACHE kmp_base_info {
   kmp_free_list_t th_free_lists[NUM_LISTS]; // Free lists for fast memory
 // allocation routines
 #endif
+  kmp_task_pool_t *th_task_pool; // Task descriptors, allocated on first use
 
 #if KMP_OS_WINDOWS
   kmp_win32_cond_t th_suspend_cv;
@@ -2649,6 +2758,16 @@ typedef struct KMP_ALIGN_CACHE kmp_base_team {
   kmp_taskdata_t
       *t_implicit_task_taskdata; // Taskdata for the thread's implicit task
   int t_level; // nested parallel level
+  // Groups of the distributed barrier. If tid leads a group, the group is the
+  // threads [tid, t_dist_groups[tid]), otherwise t_dist_groups[tid] < tid is
+  // the leader of tid's group.
+  kmp_int32 *t_dist_groups;
+  int t_dist_nproc; // team size the groups were computed for, 0 if none
+#if KMP_AFFINITY_SUPPORTED
+  int t_dist_first_place; // partition the groups were computed for
+  int t_dist_last_place;
+  kmp_proc_bind_t t_dist_proc_bind;
+#endif // KMP_AFFINITY_SUPPORTED
 
   KMP_ALIGN_CACHE int t_max_argc;
   int t_max_nproc; // max threads this team can handle (dynamically expandable)
@@ -2864,6 +2983,7 @@ extern enum sched_type __kmp_sched; /* default runtime scheduling */
 extern enum sched_type __kmp_static; /* default static scheduling method */
 extern enum sched_type __kmp_guided; /* default guided scheduling method */
 extern enum sched_type __kmp_auto; /* default auto scheduling method */
+extern int __kmp_adaptive_auto_sched; /* tune schedule(auto) loops */
 extern int __kmp_chunk; /* default runtime chunk size */
 
 extern size_t __kmp_stksize; /* stack size per thread         */
@@ -3342,6 +3462,7 @@ extern int __kmp_aux_set_affinity_mask_proc(int proc, void **mask);
 extern int __kmp_aux_unset_affinity_mask_proc(int proc, void **mask);
 extern int __kmp_aux_get_affinity_mask_proc(int proc, void **mask);
 extern void __kmp_balanced_affinity(kmp_info_t *th, int team_size);
+extern int __kmp_affinity_get_place_package(int place);
 #if KMP_OS_LINUX || KMP_OS_FREEBSD
 extern int kmp_set_thread_affinity_mask_initial(void);
 #endif
@@ -3518,6 +3639,7 @@ extern void __kmp_init_implicit_task(ident_t *loc_ref, kmp_info_t *this_thr,
                                      int set_curr_task);
 extern void __kmp_finish_implicit_task(kmp_info_t *this_thr);
 extern void __kmp_free_implicit_task(kmp_info_t *this_thr);
+extern void __kmp_free_task_pool(kmp_info_t *this_thr);
 
 extern kmp_event_t *__kmpc_task_allow_completion_event(ident_t *loc_ref,
                                                        int gtid,
@@ -3698,6 +3820,19 @@ KMP_EXPORT void __kmpc_omp_wait_deps(ident_t *loc_ref, kmp_int32 gtid,
 extern kmp_int32 __kmp_omp_task(kmp_int32 gtid, kmp_task_t *new_task,
                                 bool serialize_immediate);
 
+KMP_EXPORT kmp_int32 __kmpc_taskgraph_begin(ident_t *loc, kmp_int32 gtid,
+                                            kmp_int32 graph_id);
+KMP_EXPORT void __kmpc_taskgraph_end(ident_t *loc, kmp_int32 gtid,
+                                     kmp_int32 graph_id);
+KMP_EXPORT void __kmpc_taskgraph_reset(ident_t *loc, kmp_int32 gtid,
+                                       kmp_int32 graph_id);
+extern void __kmp_taskgraph_record(kmp_info_t *thread, kmp_task_t *task,
+                                   kmp_int32 ndeps, kmp_depend_info_t *dep_list,
+                                   kmp_int32 ndeps_noalias,
+                                   kmp_depend_info_t *noalias_dep_list);
+extern void __kmp_taskgraph_invalidate(kmp_info_t *thread);
+extern void __kmp_taskgraph_cleanup(void);
+
 KMP_EXPORT kmp_int32 __kmpc_cancel(ident_t *loc_ref, kmp_int32 gtid,
                                    kmp_int32 cncl_kind);
 KMP_EXPORT kmp_int32 __kmpc_cancellationpoint(ident_t *loc_ref, kmp_int32 gtid,
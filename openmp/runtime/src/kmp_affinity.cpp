@@ -4086,6 +4086,8 @@ static int __kmp_affinity_max_proc_per_core(const AddrUnsPair *address2os,
 static AddrUnsPair *address2os = NULL;
 static int *procarr = NULL;
 static int __kmp_aff_depth = 0;
+// Package of the processors of each place, -1 if a place spans packages.
+static int *__kmp_affinity_place_pkgs = NULL;
 
 #if KMP_USE_HIER_SCHED
 #define KMP_EXIT_AFF_NONE                                                      \
@@ -4104,6 +4106,38 @@ static int __kmp_aff_depth = 0;
   return;
 #endif
 
+// Record the package of each place, which the distributed barrier uses to
+// group the threads of a team by NUMA domain.
+static void __kmp_affinity_find_place_packages(AddrUnsPair *address2os,
+                                               int numAddrs) {
+  __kmp_affinity_place_pkgs =
+      (int *)__kmp_allocate(sizeof(int) * __kmp_affinity_num_masks);
+  for (unsigned place = 0; place < __kmp_affinity_num_masks; ++place) {
+    kmp_affin_mask_t *mask = KMP_CPU_INDEX(__kmp_affinity_masks, place);
+    int pkg = -1;
+    for (int i = 0; i < numAddrs; ++i) {
+      if (!KMP_CPU_ISSET(address2os[i].second, mask))
+        continue;
+      // The package level is removed from the addresses if there is only one.
+      int label = nPackages > 1 ? address2os[i].first.labels[0] : 0;
+      if (pkg == -1) {
+        pkg = label;
+      } else if (pkg != label) {
+        pkg = -1;
+        break;
+      }
+    }
+    __kmp_affinity_place_pkgs[place] = pkg;
+  }
+}
+
+int __kmp_affinity_get_place_package(int place) {
+  if (__kmp_affinity_place_pkgs == NULL || place < 0 ||
+      (unsigned)place >= __kmp_affinity_num_masks)
+    return -1;
+  return __kmp_affinity_place_pkgs[place];
+}
+
 // Create a one element mask array (set of places) which only contains the
 // initial process's affinity mask
 static void __kmp_create_affinity_none_places() {
@@ -4650,6 +4684,7 @@ static void __kmp_aux_affinity_initialize(void) {
   }
 
   KMP_CPU_FREE_ARRAY(osId2Mask, maxIndex + 1);
+  __kmp_affinity_find_place_packages(address2os, __kmp_avail_proc);
   machine_hierarchy.init(address2os, __kmp_avail_proc);
 }
 #undef KMP_EXIT_AFF_NONE
@@ -4700,6 +4735,10 @@ void __kmp_affinity_uninitialize(void) {
     __kmp_free(procarr);
     procarr = NULL;
   }
+  if (__kmp_affinity_place_pkgs != NULL) {
+    __kmp_free(__kmp_affinity_place_pkgs);
+    __kmp_affinity_place_pkgs = NULL;
+  }
 #if KMP_USE_HWLOC
   if (__kmp_hwloc_topology != NULL) {
     hwloc_topology_destroy(__kmp_hwloc_topology);
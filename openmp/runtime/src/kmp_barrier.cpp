@@ -1261,6 +1261,288 @@ static void __kmp_hierarchical_barrier_release(
                 gtid, team->t.t_id, tid, bt));
 }
 
+// Distributed Barrier
+
+/* The threads of a team are divided into groups of consecutive threads that
+   run in the same package, so that a group's flags are only accessed from
+   within its NUMA domain. Group leaders gather and release the threads of
+   their group, and the master thread gathers and releases the group leaders,
+   so only one flag per group crosses NUMA domains in each direction. Large
+   groups are split to about sqrt(nproc) threads so that no thread waits on
+   more than about 2*sqrt(nproc) flags. The groups of a team are computed by
+   the master thread at the fork barrier, before any thread of the team may use
+   them. */
+
+// The largest group of a team of nproc threads. Small teams are gathered by
+// the master thread alone.
+static kmp_int32 __kmp_dist_barrier_max_group(kmp_int32 nproc) {
+  kmp_int32 size = 8;
+  while (size * size < nproc)
+    ++size;
+  return size;
+}
+
+// Returns true if any barrier uses the distributed pattern.
+static bool __kmp_dist_barrier_used() {
+  for (int bt = 0; bt < bs_last_barrier; ++bt)
+    if (__kmp_barrier_gather_pattern[bt] == bp_dist_bar ||
+        __kmp_barrier_release_pattern[bt] == bp_dist_bar)
+      return true;
+  return false;
+}
+
+// Compute the groups of the distributed barrier for the threads of the team
+// and their places.
+static void __kmp_dist_barrier_setup(kmp_team_t *team) {
+  kmp_int32 nproc = team->t.t_nproc;
+  if (team->t.t_dist_nproc == nproc
+#if KMP_AFFINITY_SUPPORTED
+      && team->t.t_dist_first_place == team->t.t_first_place &&
+      team->t.t_dist_last_place == team->t.t_last_place &&
+      team->t.t_dist_proc_bind == team->t.t_proc_bind
+#endif // KMP_AFFINITY_SUPPORTED
+  )
+    return;
+
+  kmp_info_t **other_threads = team->t.t_threads;
+  kmp_int32 *groups = team->t.t_dist_groups;
+  kmp_int32 max_group = __kmp_dist_barrier_max_group(nproc);
+  kmp_int32 leader = 0;
+  int leader_pkg = -1;
+  for (kmp_int32 tid = 0; tid < nproc; ++tid) {
+    int pkg = -1;
+#if KMP_AFFINITY_SUPPORTED
+    if (KMP_AFFINITY_CAPABLE())
+      pkg = __kmp_affinity_get_place_package(
+          other_threads[tid]->th.th_new_place);
+#endif // KMP_AFFINITY_SUPPORTED
+    if (tid > 0 && tid - leader < max_group && pkg == leader_pkg) {
+      groups[tid] = leader;
+      continue;
+    }
+    if (tid > 0)
+      groups[leader] = tid;
+    leader = tid;
+    leader_pkg = pkg;
+  }
+  groups[leader] = nproc;
+
+  team->t.t_dist_nproc = nproc;
+#if KMP_AFFINITY_SUPPORTED
+  team->t.t_dist_first_place = team->t.t_first_place;
+  team->t.t_dist_last_place = team->t.t_last_place;
+  team->t.t_dist_proc_bind = team->t.t_proc_bind;
+#endif // KMP_AFFINITY_SUPPORTED
+  KA_TRACE(20, ("__kmp_dist_barrier_setup: team %d nproc %d max group %d\n",
+                team->t.t_id, nproc, max_group));
+}
+
+// Wait for the thread child_tid to arrive and combine its reduction data.
+static void __kmp_dist_barrier_gather_child(
+    enum barrier_type bt, kmp_info_t *this_thr, int gtid, int tid,
+    kmp_team_t *team, kmp_int32 child_tid, kmp_uint64 new_state,
+    void (*reduce)(void *, void *) USE_ITT_BUILD_ARG(void *itt_sync_obj)) {
+  kmp_info_t *child_thr = team->t.t_threads[child_tid];
+  kmp_bstate_t *child_bar = &child_thr->th.th_bar[bt].bb;
+  KA_TRACE(20, ("__kmp_dist_barrier_gather: T#%d(%d:%d) wait T#%d(%d:%d) "
+                "arrived(%p) == %llu\n",
+                gtid, team->t.t_id, tid, __kmp_gtid_from_tid(child_tid, team),
+                team->t.t_id, child_tid, &child_bar->b_arrived, new_state));
+  kmp_flag_64 flag(&child_bar->b_arrived, new_state);
+  flag.wait(this_thr, FALSE USE_ITT_BUILD_ARG(itt_sync_obj));
+  ANNOTATE_BARRIER_END(child_thr);
+#if USE_ITT_BUILD && USE_ITT_NOTIFY
+  // Barrier imbalance - write min of the thread time and a child time to the
+  // thread.
+  if (__kmp_forkjoin_frames_mode == 2) {
+    this_thr->th.th_bar_min_time = KMP_MIN(this_thr->th.th_bar_min_time,
+                                           child_thr->th.th_bar_min_time);
+  }
+#endif
+  if (reduce) {
+    KA_TRACE(100, ("__kmp_dist_barrier_gather: T#%d(%d:%d) += T#%d(%d:%d)\n",
+                   gtid, team->t.t_id, tid,
+                   __kmp_gtid_from_tid(child_tid, team), team->t.t_id,
+                   child_tid));
+    ANNOTATE_REDUCE_AFTER(reduce);
+    OMPT_REDUCTION_DECL(this_thr, gtid);
+    OMPT_REDUCTION_BEGIN;
+    (*reduce)(this_thr->th.th_local.reduce_data,
+              child_thr->th.th_local.reduce_data);
+    OMPT_REDUCTION_END;
+    ANNOTATE_REDUCE_BEFORE(reduce);
+    ANNOTATE_REDUCE_BEFORE(&team->t.t_bar);
+  }
+}
+
+static void __kmp_dist_barrier_gather(
+    enum barrier_type bt, kmp_info_t *this_thr, int gtid, int tid,
+    void (*reduce)(void *, void *) USE_ITT_BUILD_ARG(void *itt_sync_obj)) {
+  KMP_TIME_DEVELOPER_PARTITIONED_BLOCK(KMP_dist_gather);
+  kmp_team_t *team = this_thr->th.th_team;
+  kmp_bstate_t *thr_bar = &this_thr->th.th_bar[bt].bb;
+  kmp_int32 nproc = this_thr->th.th_team_nproc;
+  kmp_int32 *groups = team->t.t_dist_groups;
+  kmp_int32 group = groups[tid];
+  kmp_uint64 new_state = team->t.t_bar[bt].b_arrived + KMP_BARRIER_STATE_BUMP;
+
+  KA_TRACE(
+      20, ("__kmp_dist_barrier_gather: T#%d(%d:%d) enter for barrier type %d\n",
+           gtid, team->t.t_id, tid, bt));
+  KMP_DEBUG_ASSERT(this_thr == team->t.t_threads[tid]);
+  KMP_DEBUG_ASSERT(team->t.t_dist_nproc == nproc);
+
+#if USE_ITT_BUILD && USE_ITT_NOTIFY
+  // Barrier imbalance - save arrive time to the thread
+  if (__kmp_forkjoin_frames_mode == 3 || __kmp_forkjoin_frames_mode == 2) {
+    this_thr->th.th_bar_arrive_time = this_thr->th.th_bar_min_time =
+        __itt_get_timestamp();
+  }
+#endif
+  if (group > tid) {
+    // Group leaders wait for the threads of their group
+    for (kmp_int32 child_tid = tid + 1; child_tid < group; ++child_tid)
+      __kmp_dist_barrier_gather_child(bt, this_thr, gtid, tid, team, child_tid,
+                                      new_state,
+                                      reduce USE_ITT_BUILD_ARG(itt_sync_obj));
+    // and the master thread for the other group leaders
+    if (KMP_MASTER_TID(tid))
+      for (kmp_int32 child_tid = group; child_tid < nproc;
+           child_tid = groups[child_tid])
+        __kmp_dist_barrier_gather_child(
+            bt, this_thr, gtid, tid, team, child_tid, new_state,
+            reduce USE_ITT_BUILD_ARG(itt_sync_obj));
+  }
+
+  if (!KMP_MASTER_TID(tid)) { // Worker threads
+    kmp_int32 parent_tid = group > tid ? 0 : group;
+
+    KA_TRACE(20,
+             ("__kmp_dist_barrier_gather: T#%d(%d:%d) releasing T#%d(%d:%d) "
+              "arrived(%p): %llu => %llu\n",
+              gtid, team->t.t_id, tid, __kmp_gtid_from_tid(parent_tid, team),
+              team->t.t_id, parent_tid, &thr_bar->b_arrived, thr_bar->b_arrived,
+              thr_bar->b_arrived + KMP_BARRIER_STATE_BUMP));
+    // Mark arrival to the group leader or master thread. After this write, the
+    // team may be deallocated by the master thread at any time.
+    ANNOTATE_BARRIER_BEGIN(this_thr);
+    kmp_flag_64 flag(&thr_bar->b_arrived, team->t.t_threads[parent_tid]);
+    flag.release();
+  } else {
+    team->t.t_bar[bt].b_arrived = new_state;
+    KA_TRACE(20, ("__kmp_dist_barrier_gather: T#%d(%d:%d) set team %d "
+                  "arrived(%p) = %llu\n",
+                  gtid, team->t.t_id, tid, team->t.t_id,
+                  &team->t.t_bar[bt].b_arrived, team->t.t_bar[bt].b_arrived));
+  }
+  KA_TRACE(
+      20, ("__kmp_dist_barrier_gather: T#%d(%d:%d) exit for barrier type %d\n",
+           gtid, team->t.t_id, tid, bt));
+}
+
+// Release the thread child_tid from the barrier.
+static void __kmp_dist_barrier_release_child(enum barrier_type bt, int gtid,
+                                             int tid, kmp_team_t *team,
+                                             kmp_int32 child_tid,
+                                             int propagate_icvs) {
+  kmp_info_t *child_thr = team->t.t_threads[child_tid];
+  kmp_bstate_t *child_bar = &child_thr->th.th_bar[bt].bb;
+#if KMP_BARRIER_ICV_PUSH
+  {
+    KMP_TIME_DEVELOPER_PARTITIONED_BLOCK(USER_icv_copy);
+    if (propagate_icvs) {
+      __kmp_init_implicit_task(team->t.t_ident, child_thr, team, child_tid,
+                               FALSE);
+      copy_icvs(&team->t.t_implicit_task_taskdata[child_tid].td_icvs,
+                &team->t.t_implicit_task_taskdata[0].td_icvs);
+    }
+  }
+#endif // KMP_BARRIER_ICV_PUSH
+  KA_TRACE(20, ("__kmp_dist_barrier_release: T#%d(%d:%d) releasing T#%d(%d:%d)"
+                "go(%p): %u => %u\n",
+                gtid, team->t.t_id, tid, __kmp_gtid_from_tid(child_tid, team),
+                team->t.t_id, child_tid, &child_bar->b_go, child_bar->b_go,
+                child_bar->b_go + KMP_BARRIER_STATE_BUMP));
+  ANNOTATE_BARRIER_BEGIN(child_thr);
+  kmp_flag_64 flag(&child_bar->b_go, child_thr);
+  flag.release();
+}
+
+static void __kmp_dist_barrier_release(
+    enum barrier_type bt, kmp_info_t *this_thr, int gtid, int tid,
+    int propagate_icvs USE_ITT_BUILD_ARG(void *itt_sync_obj)) {
+  KMP_TIME_DEVELOPER_PARTITIONED_BLOCK(KMP_dist_release);
+  kmp_team_t *team;
+  kmp_bstate_t *thr_bar = &this_thr->th.th_bar[bt].bb;
+
+  if (!KMP_MASTER_TID(
+          tid)) { // Handle fork barrier workers who aren't part of a team yet
+    KA_TRACE(20, ("__kmp_dist_barrier_release: T#%d wait go(%p) == %u\n", gtid,
+                  &thr_bar->b_go, KMP_BARRIER_STATE_BUMP));
+    // Wait for the group leader or master thread to release us
+    kmp_flag_64 flag(&thr_bar->b_go, KMP_BARRIER_STATE_BUMP);
+    flag.wait(this_thr, TRUE USE_ITT_BUILD_ARG(itt_sync_obj));
+    ANNOTATE_BARRIER_END(this_thr);
+#if USE_ITT_BUILD && USE_ITT_NOTIFY
+    if ((__itt_sync_create_ptr && itt_sync_obj == NULL) || KMP_ITT_DEBUG) {
+      // In fork barrier where we could not get the object reliably (or
+      // ITTNOTIFY is disabled)
+      itt_sync_obj = __kmp_itt_barrier_object(gtid, bs_forkjoin_barrier, 0, -1);
+      // Cancel wait on previous parallel region...
+      __kmp_itt_task_starting(itt_sync_obj);
+
+      if (bt == bs_forkjoin_barrier && TCR_4(__kmp_global.g.g_done))
+        return;
+
+      itt_sync_obj = __kmp_itt_barrier_object(gtid, bs_forkjoin_barrier);
+      if (itt_sync_obj != NULL)
+        // Call prepare as early as possible for "new" barrier
+        __kmp_itt_task_finished(itt_sync_obj);
+    } else
+#endif /* USE_ITT_BUILD && USE_ITT_NOTIFY */
+        // Early exit for reaping threads releasing forkjoin barrier
+        if (bt == bs_forkjoin_barrier && TCR_4(__kmp_global.g.g_done))
+      return;
+
+    // The worker thread may now assume that the team is valid.
+    team = __kmp_threads[gtid]->th.th_team;
+    KMP_DEBUG_ASSERT(team != NULL);
+    tid = __kmp_tid_from_gtid(gtid);
+
+    TCW_4(thr_bar->b_go, KMP_INIT_BARRIER_STATE);
+    KA_TRACE(20,
+             ("__kmp_dist_barrier_release: T#%d(%d:%d) set go(%p) = %u\n", gtid,
+              team->t.t_id, tid, &thr_bar->b_go, KMP_INIT_BARRIER_STATE));
+    KMP_MB(); // Flush all pending memory write invalidates.
+  } else {
+    team = __kmp_threads[gtid]->th.th_team;
+    KMP_DEBUG_ASSERT(team != NULL);
+    KA_TRACE(20, ("__kmp_dist_barrier_release: T#%d(%d:%d) master enter for "
+                  "barrier type %d\n",
+                  gtid, team->t.t_id, tid, bt));
+  }
+
+  kmp_int32 nproc = this_thr->th.th_team_nproc;
+  kmp_int32 *groups = team->t.t_dist_groups;
+  kmp_int32 group = groups[tid];
+  KMP_DEBUG_ASSERT(team->t.t_dist_nproc == nproc);
+  if (group > tid) {
+    // The master thread releases the other group leaders first, so that they
+    // release their groups while it releases its own.
+    if (KMP_MASTER_TID(tid))
+      for (kmp_int32 child_tid = group; child_tid < nproc;
+           child_tid = groups[child_tid])
+        __kmp_dist_barrier_release_child(bt, gtid, tid, team, child_tid,
+                                         propagate_icvs);
+    for (kmp_int32 child_tid = tid + 1; child_tid < group; ++child_tid)
+      __kmp_dist_barrier_release_child(bt, gtid, tid, team, child_tid,
+                                       propagate_icvs);
+  }
+  KA_TRACE(
+      20, ("__kmp_dist_barrier_release: T#%d(%d:%d) exit for barrier type %d\n",
+           gtid, team->t.t_id, tid, bt));
+}
+
 // End of Barrier Algorithms
 
 // type traits for cancellable value
@@ -1406,6 +1688,11 @@ static int __kmp_barrier_template(enum barrier_type bt, int gtid, int is_split,
             bt, this_thr, gtid, tid, reduce USE_ITT_BUILD_ARG(itt_sync_obj));
         break;
       }
+      case bp_dist_bar: {
+        __kmp_dist_barrier_gather(bt, this_thr, gtid, tid,
+                                  reduce USE_ITT_BUILD_ARG(itt_sync_obj));
+        break;
+      }
       case bp_tree_bar: {
         // don't set branch bits to 0; use linear
         KMP_ASSERT(__kmp_barrier_gather_branch_bits[bt]);
@@ -1518,6 +1805,11 @@ static int __kmp_barrier_template(enum barrier_type bt, int gtid, int is_split,
               bt, this_thr, gtid, tid, FALSE USE_ITT_BUILD_ARG(itt_sync_obj));
           break;
         }
+        case bp_dist_bar: {
+          __kmp_dist_barrier_release(bt, this_thr, gtid, tid,
+                                     FALSE USE_ITT_BUILD_ARG(itt_sync_obj));
+          break;
+        }
         case bp_tree_bar: {
           KMP_ASSERT(__kmp_barrier_release_branch_bits[bt]);
           __kmp_tree_barrier_release(bt, this_thr, gtid, tid,
@@ -1648,6 +1940,11 @@ void __kmp_end_split_barrier(enum barrier_type bt, int gtid) {
                                            FALSE USE_ITT_BUILD_ARG(NULL));
         break;
       }
+      case bp_dist_bar: {
+        __kmp_dist_barrier_release(bt, this_thr, gtid, tid,
+                                   FALSE USE_ITT_BUILD_ARG(NULL));
+        break;
+      }
       case bp_tree_bar: {
         KMP_ASSERT(__kmp_barrier_release_branch_bits[bt]);
         __kmp_tree_barrier_release(bt, this_thr, gtid, tid,
@@ -1794,6 +2091,11 @@ void __kmp_join_barrier(int gtid) {
                                       NULL USE_ITT_BUILD_ARG(itt_sync_obj));
     break;
   }
+  case bp_dist_bar: {
+    __kmp_dist_barrier_gather(bs_forkjoin_barrier, this_thr, gtid, tid,
+                              NULL USE_ITT_BUILD_ARG(itt_sync_obj));
+    break;
+  }
   case bp_tree_bar: {
     KMP_ASSERT(__kmp_barrier_gather_branch_bits[bs_forkjoin_barrier]);
     __kmp_tree_barrier_gather(bs_forkjoin_barrier, this_thr, gtid, tid,
@@ -1956,6 +2258,9 @@ void __kmp_fork_barrier(int gtid, int tid) {
       __kmp_task_team_setup(this_thr, team, 0);
     }
 
+    if (__kmp_dist_barrier_used())
+      __kmp_dist_barrier_setup(team);
+
     /* The master thread may have changed its blocktime between the join barrier
        and the fork barrier. Copy the blocktime info to the thread, where
        __kmp_wait_template() can access it when the team struct is not
@@ -1986,6 +2291,11 @@ void __kmp_fork_barrier(int gtid, int tid) {
                                        TRUE USE_ITT_BUILD_ARG(itt_sync_obj));
     break;
   }
+  case bp_dist_bar: {
+    __kmp_dist_barrier_release(bs_forkjoin_barrier, this_thr, gtid, tid,
+                               TRUE USE_ITT_BUILD_ARG(itt_sync_obj));
+    break;
+  }
   case bp_tree_bar: {
     KMP_ASSERT(__kmp_barrier_release_branch_bits[bs_forkjoin_barrier]);
     __kmp_tree_barrier_release(bs_forkjoin_barrier, this_thr, gtid, tid,
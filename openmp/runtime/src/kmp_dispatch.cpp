@@ -753,6 +753,158 @@ void __kmp_dispatch_free_hierarchies(kmp_team_t *team) {
 }
 #endif
 
+// Adaptive schedule(auto).
+// A schedule(auto) loop is executed with static stealing or with guided
+// scheduling. The time the threads spend in each invocation of the loop is
+// recorded for the loop site (its ident_t), and is used to choose the schedule
+// and the chunk size of the later invocations: the number of chunks per thread
+// grows while the threads finish at different times and shrinks while they are
+// balanced, and the schedule with the lower cost per iteration is kept while
+// the other one is tried again from time to time.
+
+// Time stamp counter
+#if KMP_ARCH_X86 || KMP_ARCH_X86_64
+#define __kmp_tsc() __kmp_hardware_timestamp()
+#else
+// Use nanoseconds for other platforms
+extern kmp_uint64 __kmp_now_nsec();
+#define __kmp_tsc() __kmp_now_nsec()
+#endif
+
+#define KMP_AUTO_SCHED_SITES 256 // loop sites recorded, a power of two
+#define KMP_AUTO_SCHED_PROBES 8 // slots tried when looking for a site
+#define KMP_AUTO_SCHED_RETRY 32 // invocations before the other schedule is
+                                // tried again
+#define KMP_AUTO_SCHED_MAX_CHUNKS 256 // max number of chunks per thread
+
+enum { auto_sched_steal = 0, auto_sched_guided = 1 };
+
+// Default number of chunks per thread for each schedule. For guided
+// scheduling it sets the minimum chunk size.
+static const kmp_int32 __kmp_auto_sched_chunks[2] = {8, 32};
+
+struct kmp_auto_sched_site {
+  std::atomic<ident_t *> loc;
+  std::atomic<kmp_int32> busy; // serializes the updates of the statistics
+  volatile kmp_int32 sched; // schedule of the next invocation
+  volatile kmp_int32 chunks[2]; // chunks per thread, 0 if default
+  kmp_uint64 invocations;
+  kmp_uint64 measured[2]; // invocation of the last measurement, 0 if none
+  double cost[2]; // average loop time per iteration
+};
+
+static kmp_auto_sched_site __kmp_auto_sched_sites[KMP_AUTO_SCHED_SITES];
+
+// Find or insert the site of a loop, NULL if the table is full
+static kmp_auto_sched_site *__kmp_auto_sched_find_site(ident_t *loc) {
+  kmp_uintptr_t hash = (kmp_uintptr_t)loc;
+  hash = (hash >> 3) ^ (hash >> 11);
+  for (int i = 0; i < KMP_AUTO_SCHED_PROBES; ++i) {
+    kmp_auto_sched_site *site =
+        &__kmp_auto_sched_sites[(hash + i) & (KMP_AUTO_SCHED_SITES - 1)];
+    ident_t *cur = site->loc.load(std::memory_order_acquire);
+    if (cur == NULL && site->loc.compare_exchange_strong(cur, loc))
+      return site;
+    if (cur == loc)
+      return site;
+  }
+  return NULL;
+}
+
+// Returns TRUE if the loop is a schedule(auto) loop tuned at runtime. Sets
+// *monotonic if the monotonic modifier restricts the choice to guided.
+template <typename T>
+static inline bool
+__kmp_auto_sched_adaptive(dispatch_private_info_template<T> *pr,
+                          enum sched_type schedule, kmp_team_t *team,
+                          bool *monotonic) {
+#if KMP_USE_HIER_SCHED
+  if (pr->flags.use_hier)
+    return false;
+#endif
+  if (SCHEDULE_WITHOUT_MODIFIERS(schedule) == kmp_sch_runtime)
+    schedule = team->t.t_sched.r_sched_type;
+  if (SCHEDULE_WITHOUT_MODIFIERS(schedule) != kmp_sch_auto)
+    return false;
+  // The order of the chunks of an auto schedule is unspecified unless the
+  // monotonic modifier is given
+  *monotonic = SCHEDULE_HAS_MONOTONIC(schedule);
+  return true;
+}
+
+// Choose the schedule and the chunk size of an invocation of the loop.
+// Returns the chunk size, negated for guided scheduling.
+template <typename T>
+static kmp_int64 __kmp_auto_sched_choose(kmp_auto_sched_site *site, T lb, T ub,
+                                         typename traits_t<T>::signed_t st,
+                                         T nproc, bool monotonic) {
+  typedef typename traits_t<T>::unsigned_t UT;
+  UT tc, chunk, per_chunk;
+  int sched = monotonic ? auto_sched_guided : TCR_4(site->sched);
+  kmp_int32 chunks = TCR_4(site->chunks[sched]);
+
+  if (chunks == 0)
+    chunks = __kmp_auto_sched_chunks[sched];
+  // same trip count as __kmp_dispatch_init_algorithm
+  if (st == 1)
+    tc = ub >= lb ? ub - lb + 1 : 0;
+  else if (st < 0)
+    tc = lb >= ub ? (UT)(lb - ub) / (-st) + 1 : 0;
+  else if (st > 0)
+    tc = ub >= lb ? (UT)(ub - lb) / st + 1 : 0;
+  else
+    tc = 0; // zero increment is reported by __kmp_dispatch_init_algorithm
+  per_chunk = (UT)nproc * chunks;
+  chunk = tc / per_chunk + (tc % per_chunk ? 1 : 0);
+  if (chunk == 0)
+    chunk = 1;
+  KMP_COUNT_VALUE(OMP_loop_auto_chunk, chunk);
+  return sched == auto_sched_guided ? -(kmp_int64)chunk : (kmp_int64)chunk;
+}
+
+// Record the time spent in an invocation of the loop and choose the schedule
+// of the next invocation. Called by the last thread to finish the loop.
+static void __kmp_auto_sched_update(kmp_auto_sched_site *site, kmp_int64 chunk,
+                                    kmp_uint64 time_sum, kmp_uint64 time_max,
+                                    kmp_uint64 tc, int nproc) {
+  kmp_int32 unlocked = 0;
+  if (!site->busy.compare_exchange_strong(unlocked, 1,
+                                          std::memory_order_acquire))
+    return; // another invocation of the loop is being recorded
+  int sched = chunk > 0 ? auto_sched_steal : auto_sched_guided;
+  int other = 1 - sched;
+  kmp_uint64 invocation = ++site->invocations;
+
+  if (time_max > 0 && tc > 0) {
+    // Fraction of the loop time the threads spent waiting for the last one
+    double imbalance = 1.0 - (double)time_sum / nproc / time_max;
+    double cost = (double)time_max / tc;
+    kmp_int32 chunks = site->chunks[sched];
+
+    if (chunks == 0)
+      chunks = __kmp_auto_sched_chunks[sched];
+    if (imbalance > 0.10 && chunks < KMP_AUTO_SCHED_MAX_CHUNKS)
+      chunks *= 2;
+    else if (imbalance < 0.02 && chunks > 1)
+      chunks /= 2;
+    site->chunks[sched] = chunks;
+    site->cost[sched] =
+        site->measured[sched] ? 0.75 * site->cost[sched] + 0.25 * cost : cost;
+    site->measured[sched] = invocation;
+    KMP_COUNT_VALUE(OMP_loop_auto_imbalance, imbalance * 100);
+    KA_TRACE(20, ("__kmp_auto_sched_update: site %p sched %d imbalance %d%% "
+                  "chunks per thread %d\n",
+                  site, sched, (int)(imbalance * 100), chunks));
+  }
+  // Keep the cheaper schedule, measure the other one if it is stale
+  if (site->measured[other] == 0 ||
+      invocation - site->measured[other] >= KMP_AUTO_SCHED_RETRY)
+    site->sched = other;
+  else
+    site->sched = site->cost[other] < site->cost[sched] ? other : sched;
+  site->busy.store(0, std::memory_order_release);
+}
+
 // UT - unsigned flavor of T, ST - signed flavor of T,
 // DBL - double if sizeof(T)==4, or long double if sizeof(T)==8
 template <typename T>
@@ -868,12 +1020,55 @@ __kmp_dispatch_init(ident_t *loc, int gtid, enum sched_type schedule, T lb,
                   my_buffer_index));
   }
 
+  bool auto_adaptive = false;
+  if (active && __kmp_adaptive_auto_sched && loc != NULL) {
+    bool monotonic = false;
+    kmp_auto_sched_site *site = NULL;
+    if (__kmp_auto_sched_adaptive(pr, schedule, team, &monotonic))
+      site = __kmp_auto_sched_find_site(loc);
+    if (site != NULL) {
+      // The schedule is chosen once for the team and shared through the
+      // dispatch buffer, so the buffer must be free to use first
+      __kmp_wait<kmp_uint32>(&sh->buffer_index, my_buffer_index,
+                             __kmp_eq<kmp_uint32> USE_ITT_BUILD_ARG(NULL));
+      kmp_int64 auto_chunk = sh->auto_chunk;
+      if (auto_chunk == 0) {
+        auto_chunk = __kmp_auto_sched_choose<T>(
+            site, lb, ub, st, (T)th->th.th_team_nproc, monotonic);
+        sh->auto_site = site;
+        if (!KMP_COMPARE_AND_STORE_ACQ64(&sh->auto_chunk, 0, auto_chunk))
+          auto_chunk = sh->auto_chunk;
+      }
+      if (auto_chunk > 0) {
+        KMP_COUNT_BLOCK(OMP_LOOP_AUTO_STATIC_STEAL);
+#if KMP_STATIC_STEAL_ENABLED
+        schedule = kmp_sch_static_steal;
+#else
+        schedule = kmp_sch_dynamic_chunked;
+#endif
+      } else {
+        KMP_COUNT_BLOCK(OMP_LOOP_AUTO_GUIDED);
+        schedule = kmp_sch_guided_chunked;
+        auto_chunk = -auto_chunk;
+      }
+      chunk = (typename traits_t<T>::signed_t)auto_chunk;
+#if USE_ITT_BUILD
+      cur_chunk = chunk;
+#endif
+      auto_adaptive = true;
+      KD_TRACE(10, ("__kmp_dispatch_init: T#%d adaptive auto: schedule:%d "
+                    "chunk:%lld\n",
+                    gtid, schedule, (long long)auto_chunk));
+    }
+  }
+
   __kmp_dispatch_init_algorithm(loc, gtid, pr, schedule, lb, ub, st,
 #if USE_ITT_BUILD
                                 &cur_chunk,
 #endif
                                 chunk, (T)th->th.th_team_nproc,
                                 (T)th->th.th_info.ds.ds_tid);
+  pr->flags.auto_adaptive = auto_adaptive;
   if (active) {
     if (pr->flags.ordered == 0) {
       th->th.th_dispatch->th_deo_fcn = __kmp_dispatch_deo_error;
@@ -903,6 +1098,8 @@ __kmp_dispatch_init(ident_t *loc, int gtid, enum sched_type schedule, T lb,
     th->th.th_dispatch->th_dispatch_pr_current = (dispatch_private_info_t *)pr;
     th->th.th_dispatch->th_dispatch_sh_current =
         CCAST(dispatch_shared_info_t *, (volatile dispatch_shared_info_t *)sh);
+    if (pr->flags.auto_adaptive)
+      pr->auto_start = __kmp_tsc();
 #if USE_ITT_BUILD
     if (pr->flags.ordered) {
       __kmp_itt_ordered_init(gtid);
@@ -2052,6 +2249,17 @@ static int __kmp_dispatch_next(ident_t *loc, int gtid, kmp_int32 *p_last,
     if (status == 0) {
       UT num_done;
 
+      if (pr->flags.auto_adaptive) {
+        // Record the time this thread spent in the loop before it is counted
+        // as done, the last thread reads the totals
+        kmp_uint64 time = __kmp_tsc() - pr->auto_start;
+        kmp_uint64 time_max = sh->auto_time_max;
+        KMP_TEST_THEN_ADD64((volatile kmp_int64 *)&sh->auto_time_sum,
+                            (kmp_int64)time);
+        while (time > time_max &&
+               !KMP_COMPARE_AND_STORE_ACQ64(&sh->auto_time_max, time_max, time))
+          time_max = sh->auto_time_max;
+      }
       num_done = test_then_inc<ST>((volatile ST *)&sh->u.s.num_done);
 #ifdef KMP_DEBUG
       {
@@ -2100,6 +2308,15 @@ static int __kmp_dispatch_next(ident_t *loc, int gtid, kmp_int32 *p_last,
         if (pr->flags.ordered) {
           sh->u.s.ordered_iteration = 0;
         }
+        if (pr->flags.auto_adaptive) {
+          __kmp_auto_sched_update(sh->auto_site, sh->auto_chunk,
+                                  sh->auto_time_sum, sh->auto_time_max,
+                                  pr->u.p.tc, th->th.th_team_nproc);
+          sh->auto_chunk = 0;
+          sh->auto_site = NULL;
+          sh->auto_time_sum = 0;
+          sh->auto_time_max = 0;
+        }
 
         KMP_MB(); /* Flush all pending memory write invalidates.  */
 
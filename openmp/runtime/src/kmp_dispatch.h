@@ -147,6 +147,7 @@ template <typename T> struct KMP_ALIGN_CACHE dispatch_private_info_template {
   kmp_hier_top_unit_t<T> *get_parent() { return hier_parent; }
 #endif
   enum cons_type pushed_ws;
+  kmp_uint64 auto_start; // start time of an adaptive schedule(auto) loop
 };
 
 // replaces dispatch_shared_info{32,64} structures and
@@ -174,6 +175,10 @@ template <typename T> struct dispatch_shared_info_template {
   volatile kmp_int32 doacross_buf_idx; // teamwise index
   kmp_uint32 *doacross_flags; // array of iteration flags (0/1)
   kmp_int32 doacross_num_done; // count finished threads
+  volatile kmp_int64 auto_chunk; // > 0 static steal, < 0 guided, 0 undecided
+  kmp_auto_sched_site *auto_site; // statistics of the schedule(auto) loop
+  volatile kmp_uint64 auto_time_sum; // time spent by the threads in the loop
+  volatile kmp_uint64 auto_time_max;
 #if KMP_USE_HIER_SCHED
   kmp_hier_t<T> *hier;
 #endif
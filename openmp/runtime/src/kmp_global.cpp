@@ -107,8 +107,8 @@ char const *__kmp_barrier_type_name[bs_last_barrier] = {"plain", "forkjoin"
                                                         "reduction"
 #endif // KMP_FAST_REDUCTION_BARRIER
 };
-char const *__kmp_barrier_pattern_name[bp_last_bar] = {"linear", "tree",
-                                                       "hyper", "hierarchical"};
+char const *__kmp_barrier_pattern_name[bp_last_bar] = {
+    "linear", "tree", "hyper", "hierarchical", "dist"};
 
 int __kmp_allThreadsSpecified = 0;
 size_t __kmp_align_alloc = CACHE_LINE;
@@ -144,6 +144,7 @@ enum sched_type __kmp_guided =
     kmp_sch_guided_iterative_chunked; /* default guided scheduling method */
 enum sched_type __kmp_auto =
     kmp_sch_guided_analytical_chunked; /* default auto scheduling method */
+int __kmp_adaptive_auto_sched = TRUE; /* tune schedule(auto) loops */
 #if KMP_USE_HIER_SCHED
 int __kmp_dispatch_hand_threading = 0;
 int __kmp_hier_max_units[kmp_hier_layer_e::LAYER_LAST + 1];
@@ -329,6 +330,8 @@ KMP_BUILD_ASSERT(sizeof(kmp_tasking_flags_t) == 4);
 
 int __kmp_task_stealing_constraint = 1; /* Constrain task stealing by default */
 int __kmp_enable_task_throttling = 1;
+int __kmp_lock_free_task_deque = FALSE;
+int __kmp_use_task_pool = FALSE;
 
 #ifdef DEBUG_SUSPEND
 int __kmp_suspend_count = 0;
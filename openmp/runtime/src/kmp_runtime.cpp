@@ -3037,6 +3037,9 @@ static void __kmp_allocate_team_arrays(kmp_team_t *team, int max_nth) {
       (kmp_disp_t *)__kmp_allocate(sizeof(kmp_disp_t) * max_nth);
   team->t.t_implicit_task_taskdata =
       (kmp_taskdata_t *)__kmp_allocate(sizeof(kmp_taskdata_t) * max_nth);
+  team->t.t_dist_groups =
+      (kmp_int32 *)__kmp_allocate(sizeof(kmp_int32) * max_nth);
+  team->t.t_dist_nproc = 0;
   team->t.t_max_nproc = max_nth;
 
   /* setup dispatch buffers */
@@ -3062,10 +3065,12 @@ static void __kmp_free_team_arrays(kmp_team_t *team) {
   __kmp_free(team->t.t_disp_buffer);
   __kmp_free(team->t.t_dispatch);
   __kmp_free(team->t.t_implicit_task_taskdata);
+  __kmp_free(team->t.t_dist_groups);
   team->t.t_threads = NULL;
   team->t.t_disp_buffer = NULL;
   team->t.t_dispatch = NULL;
   team->t.t_implicit_task_taskdata = 0;
+  team->t.t_dist_groups = NULL;
 }
 
 static void __kmp_reallocate_team_arrays(kmp_team_t *team, int max_nth) {
@@ -3074,6 +3079,7 @@ static void __kmp_reallocate_team_arrays(kmp_team_t *team, int max_nth) {
   __kmp_free(team->t.t_disp_buffer);
   __kmp_free(team->t.t_dispatch);
   __kmp_free(team->t.t_implicit_task_taskdata);
+  __kmp_free(team->t.t_dist_groups);
   __kmp_allocate_team_arrays(team, max_nth);
 
   KMP_MEMCPY(team->t.t_threads, oldThreads,
@@ -4474,6 +4480,7 @@ static void __kmp_initialize_team(kmp_team_t *team, int new_nproc,
   KMP_MB();
 
   team->t.t_master_tid = 0; /* not needed */
+  team->t.t_dist_nproc = 0; /* threads may have changed */
   /* team->t.t_master_bar;        not needed */
   team->t.t_serialized = new_nproc > 1 ? 0 : 1;
   team->t.t_nproc = new_nproc;
@@ -5906,6 +5913,7 @@ static void __kmp_reap_thread(kmp_info_t *thread, int is_root) {
   }
 
   __kmp_free_implicit_task(thread);
+  __kmp_free_task_pool(thread);
 
 // Free the fast memory for tasking
 #if USE_FAST_MEMORY
@@ -7501,6 +7509,7 @@ void __kmp_cleanup(void) {
   }
 
   __kmp_cleanup_threadprivate_caches();
+  __kmp_taskgraph_cleanup();
 
   for (f = 0; f < __kmp_threads_capacity; f++) {
     if (__kmp_root[f] != NULL) {
@@ -3848,6 +3848,19 @@ static void __kmp_stg_print_omp_schedule(kmp_str_buf_t *buffer,
   }
 } // __kmp_stg_print_omp_schedule
 
+// -----------------------------------------------------------------------------
+// KMP_ADAPTIVE_AUTO_SCHEDULE
+
+static void __kmp_stg_parse_adaptive_auto_sched(char const *name,
+                                                char const *value, void *data) {
+  __kmp_stg_parse_bool(name, value, &__kmp_adaptive_auto_sched);
+} // __kmp_stg_parse_adaptive_auto_sched
+
+static void __kmp_stg_print_adaptive_auto_sched(kmp_str_buf_t *buffer,
+                                                char const *name, void *data) {
+  __kmp_stg_print_bool(buffer, name, __kmp_adaptive_auto_sched);
+} // __kmp_stg_print_adaptive_auto_sched
+
 #if KMP_USE_HIER_SCHED
 // -----------------------------------------------------------------------------
 // KMP_DISP_HAND_THREAD
@@ -4621,6 +4634,34 @@ static void __kmp_stg_print_task_throttling(kmp_str_buf_t *buffer,
   __kmp_stg_print_bool(buffer, name, __kmp_enable_task_throttling);
 } // __kmp_stg_print_task_throttling
 
+// -----------------------------------------------------------------------------
+// KMP_LOCK_FREE_TASK_DEQUE
+
+static void __kmp_stg_parse_lock_free_task_deque(char const *name,
+                                                 char const *value,
+                                                 void *data) {
+  __kmp_stg_parse_bool(name, value, &__kmp_lock_free_task_deque);
+} // __kmp_stg_parse_lock_free_task_deque
+
+static void __kmp_stg_print_lock_free_task_deque(kmp_str_buf_t *buffer,
+                                                 char const *name,
+                                                 void *data) {
+  __kmp_stg_print_bool(buffer, name, __kmp_lock_free_task_deque);
+} // __kmp_stg_print_lock_free_task_deque
+
+// -----------------------------------------------------------------------------
+// KMP_TASK_POOL
+
+static void __kmp_stg_parse_task_pool(char const *name, char const *value,
+                                      void *data) {
+  __kmp_stg_parse_bool(name, value, &__kmp_use_task_pool);
+} // __kmp_stg_parse_task_pool
+
+static void __kmp_stg_print_task_pool(kmp_str_buf_t *buffer, char const *name,
+                                      void *data) {
+  __kmp_stg_print_bool(buffer, name, __kmp_use_task_pool);
+} // __kmp_stg_print_task_pool
+
 // -----------------------------------------------------------------------------
 // OMP_DISPLAY_ENV
 
@@ -4871,6 +4912,8 @@ static kmp_setting_t __kmp_stg_table[] = {
      0, 0},
     {"OMP_SCHEDULE", __kmp_stg_parse_omp_schedule, __kmp_stg_print_omp_schedule,
      NULL, 0, 0},
+    {"KMP_ADAPTIVE_AUTO_SCHEDULE", __kmp_stg_parse_adaptive_auto_sched,
+     __kmp_stg_print_adaptive_auto_sched, NULL, 0, 0},
 #if KMP_USE_HIER_SCHED
     {"KMP_DISP_HAND_THREAD", __kmp_stg_parse_kmp_hand_thread,
      __kmp_stg_print_kmp_hand_thread, NULL, 0, 0},
@@ -4924,6 +4967,10 @@ static kmp_setting_t __kmp_stg_table[] = {
 #endif
     {"KMP_ENABLE_TASK_THROTTLING", __kmp_stg_parse_task_throttling,
      __kmp_stg_print_task_throttling, NULL, 0, 0},
+    {"KMP_LOCK_FREE_TASK_DEQUE", __kmp_stg_parse_lock_free_task_deque,
+     __kmp_stg_print_lock_free_task_deque, NULL, 0, 0},
+    {"KMP_TASK_POOL", __kmp_stg_parse_task_pool, __kmp_stg_print_task_pool,
+     NULL, 0, 0},
 
     {"OMP_DISPLAY_ENV", __kmp_stg_parse_omp_display_env,
      __kmp_stg_print_omp_display_env, NULL, 0, 0},
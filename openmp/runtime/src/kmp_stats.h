@@ -98,6 +98,8 @@ enum stats_state_e {
   macro(OMP_LOOP_STATIC, 0, arg)                                               \
   macro(OMP_LOOP_STATIC_STEAL, 0, arg)                                         \
   macro(OMP_LOOP_DYNAMIC, 0, arg)                                              \
+  macro(OMP_LOOP_AUTO_STATIC_STEAL, 0, arg)                                    \
+  macro(OMP_LOOP_AUTO_GUIDED, 0, arg)                                          \
   macro(OMP_DISTRIBUTE, 0, arg)                                                \
   macro(OMP_BARRIER, 0, arg)                                                   \
   macro(OMP_CRITICAL, 0, arg)                                                  \
@@ -176,6 +178,10 @@ enum stats_state_e {
          stats_flags_e::noUnits | stats_flags_e::noTotal, arg)                 \
   macro (OMP_distribute_iterations,                                            \
          stats_flags_e::noUnits | stats_flags_e::noTotal, arg)                 \
+  macro (OMP_loop_auto_chunk,                                                  \
+         stats_flags_e::noUnits | stats_flags_e::noTotal, arg)                 \
+  macro (OMP_loop_auto_imbalance,                                              \
+         stats_flags_e::noUnits | stats_flags_e::noTotal, arg)                 \
   KMP_FOREACH_DEVELOPER_TIMER(macro, arg)
 // clang-format on
 
@@ -226,6 +232,10 @@ enum stats_state_e {
 //                               statically scheduled loops
 // OMP_loop_dynamic_iterations -- Number of iterations thread is assigned for
 //                                dynamically scheduled loops
+// OMP_loop_auto_chunk    -- Chunk size chosen for a schedule(auto) loop (the
+//                           minimum chunk size when guided was chosen)
+// OMP_loop_auto_imbalance -- Load imbalance measured at the end of a
+//                            schedule(auto) loop, in percent
 
 #if (KMP_DEVELOPER_STATS)
 // Timers which are of interest to runtime library developers, not end users.
@@ -243,11 +253,15 @@ enum stats_state_e {
 // KMP_tree_release       -- time in __kmp_tree_barrier_release
 // KMP_hyper_gather       -- time in __kmp_hyper_barrier_gather
 // KMP_hyper_release      -- time in __kmp_hyper_barrier_release
+// KMP_dist_gather        -- time in __kmp_dist_barrier_gather
+// KMP_dist_release       -- time in __kmp_dist_barrier_release
 // clang-format off
 #define KMP_FOREACH_DEVELOPER_TIMER(macro, arg)                                \
   macro(KMP_fork_call, 0, arg)                                                 \
   macro(KMP_join_call, 0, arg)                                                 \
   macro(KMP_end_split_barrier, 0, arg)                                         \
+  macro(KMP_dist_gather, 0, arg)                                               \
+  macro(KMP_dist_release, 0, arg)                                              \
   macro(KMP_hier_gather, 0, arg)                                               \
   macro(KMP_hier_release, 0, arg)                                              \
   macro(KMP_hyper_gather, 0, arg)                                              \
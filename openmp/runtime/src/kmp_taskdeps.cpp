@@ -517,6 +517,9 @@ kmp_int32 __kmpc_omp_task_with_deps(ident_t *loc_ref, kmp_int32 gtid,
   __kmp_assert_valid_gtid(gtid);
   kmp_info_t *thread = __kmp_threads[gtid];
   kmp_taskdata_t *current_task = thread->th.th_current_task;
+  if (UNLIKELY(thread->th.th_taskgraph != NULL))
+    __kmp_taskgraph_record(thread, new_task, ndeps, dep_list, ndeps_noalias,
+                           noalias_dep_list);
 
 #if OMPT_SUPPORT
   if (ompt_enabled.enabled) {
@@ -680,6 +683,8 @@ void __kmpc_omp_wait_deps(ident_t *loc_ref, kmp_int32 gtid, kmp_int32 ndeps,
   __kmp_assert_valid_gtid(gtid);
   kmp_info_t *thread = __kmp_threads[gtid];
   kmp_taskdata_t *current_task = thread->th.th_current_task;
+  if (UNLIKELY(thread->th.th_taskgraph != NULL))
+    __kmp_taskgraph_invalidate(thread);
 
 #if OMPT_SUPPORT
   // this function represents a taskwait construct with depend clause
@@ -31,6 +31,7 @@ static void __kmp_alloc_task_deque(kmp_info_t *thread,
 static int __kmp_realloc_task_threads_data(kmp_info_t *thread,
                                            kmp_task_team_t *task_team);
 static void __kmp_bottom_half_finish_proxy(kmp_int32 gtid, kmp_task_t *ptask);
+static void __kmp_taskgraph_release(kmp_int32 gtid, kmp_taskdata_t *taskdata);
 
 #ifdef BUILD_TIED_TASK_STACK
 
@@ -321,6 +322,84 @@ static void __kmp_realloc_task_deque(kmp_info_t *thread,
   thread_data->td.td_deque_size = new_size;
 }
 
+// Lock-free task deque (KMP_LOCK_FREE_TASK_DEQUE), after Chase and Lev with
+// the memory orders of Le et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models". The owner pushes and pops at the bottom without any
+// atomic read-modify-write unless it races with a thief for the last task,
+// thieves take the tasks at the top with a CAS.
+
+// __kmp_alloc_task_deque_array: allocate an array for a lock-free deque
+static kmp_task_deque_array_t *
+__kmp_alloc_task_deque_array(kmp_int64 size, kmp_task_deque_array_t *prev) {
+  kmp_task_deque_array_t *array = (kmp_task_deque_array_t *)__kmp_allocate(
+      sizeof(kmp_task_deque_array_t) +
+      (size - 1) * sizeof(std::atomic<kmp_taskdata_t *>));
+  array->tda_prev = prev;
+  array->tda_mask = size - 1;
+  return array;
+}
+
+// __kmp_task_deque_ntasks: approximate number of tasks in the deques of a
+// thread, only meant to be used as a hint
+static inline kmp_int32 __kmp_task_deque_ntasks(kmp_thread_data_t *thread_data) {
+  kmp_int32 ntasks = TCR_4(thread_data->td.td_deque_ntasks);
+  if (__kmp_lock_free_task_deque) {
+    kmp_int64 bottom = KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_bottom);
+    kmp_int64 top = KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_top);
+    if (bottom > top)
+      ntasks += (kmp_int32)(bottom - top);
+  }
+  return ntasks;
+}
+
+// __kmp_task_deque_lf_push: push a task at the bottom of the lock-free deque.
+// Only the owner of the deque may call it, the deque grows when it is full.
+static void __kmp_task_deque_lf_push(kmp_thread_data_t *thread_data,
+                                     kmp_taskdata_t *taskdata) {
+  kmp_int64 bottom = KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_bottom);
+  kmp_int64 top = KMP_ATOMIC_LD_ACQ(&thread_data->td.td_lf_top);
+  kmp_task_deque_array_t *array = KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_array);
+  if (bottom - top > array->tda_mask) {
+    // The old array is kept since thieves may still be reading from it
+    kmp_task_deque_array_t *new_array =
+        __kmp_alloc_task_deque_array(2 * (array->tda_mask + 1), array);
+    for (kmp_int64 i = top; i < bottom; i++)
+      KMP_ATOMIC_ST_RLX(&new_array->tda_tasks[i & new_array->tda_mask],
+                        KMP_ATOMIC_LD_RLX(&array->tda_tasks[i & array->tda_mask]));
+    KMP_ATOMIC_ST_REL(&thread_data->td.td_lf_array, new_array);
+    array = new_array;
+  }
+  KMP_ATOMIC_ST_RLX(&array->tda_tasks[bottom & array->tda_mask], taskdata);
+  KMP_ATOMIC_ST_REL(&thread_data->td.td_lf_bottom, bottom + 1);
+}
+
+// __kmp_task_deque_lf_pop: pop the task at the bottom of the lock-free deque,
+// returns NULL if the deque is empty. Only the owner of the deque may call it.
+static kmp_taskdata_t *__kmp_task_deque_lf_pop(kmp_thread_data_t *thread_data) {
+  kmp_int64 bottom = KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_bottom) - 1;
+  kmp_task_deque_array_t *array = KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_array);
+  // The store of the bottom must be ordered before the load of the top, this
+  // is where the owner synchronizes with the thieves
+  KMP_ATOMIC_OP(store, &thread_data->td.td_lf_bottom, bottom, seq_cst);
+  kmp_int64 top = KMP_ATOMIC_LD(&thread_data->td.td_lf_top, seq_cst);
+  kmp_taskdata_t *taskdata = NULL;
+  if (top <= bottom) {
+    taskdata = KMP_ATOMIC_LD_RLX(&array->tda_tasks[bottom & array->tda_mask]);
+    if (top == bottom) {
+      // Last task in the deque, race with the thieves for it
+      if (!thread_data->td.td_lf_top.compare_exchange_strong(
+              top, top + 1, std::memory_order_seq_cst,
+              std::memory_order_relaxed))
+        taskdata = NULL;
+      KMP_ATOMIC_ST_RLX(&thread_data->td.td_lf_bottom, bottom + 1);
+    }
+  } else {
+    // The deque is empty
+    KMP_ATOMIC_ST_RLX(&thread_data->td.td_lf_bottom, bottom + 1);
+  }
+  return taskdata;
+}
+
 //  __kmp_push_task: Add a task to the thread's deque
 static kmp_int32 __kmp_push_task(kmp_int32 gtid, kmp_task_t *task) {
   kmp_info_t *thread = __kmp_threads[gtid];
@@ -368,6 +447,29 @@ static kmp_int32 __kmp_push_task(kmp_int32 gtid, kmp_task_t *task) {
     __kmp_alloc_task_deque(thread, thread_data);
   }
 
+  if (__kmp_lock_free_task_deque) {
+    kmp_task_deque_array_t *array =
+        KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_array);
+    kmp_int64 ntasks = KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_bottom) -
+                       KMP_ATOMIC_LD_RLX(&thread_data->td.td_lf_top);
+    // Check if deque is full, it is grown by the push otherwise
+    if (ntasks > array->tda_mask && __kmp_enable_task_throttling &&
+        __kmp_task_is_allowed(gtid, __kmp_task_stealing_constraint, taskdata,
+                              thread->th.th_current_task)) {
+      KA_TRACE(20, ("__kmp_push_task: T#%d lock-free deque is full; returning "
+                    "TASK_NOT_PUSHED for task %p\n",
+                    gtid, taskdata));
+      return TASK_NOT_PUSHED;
+    }
+    KMP_FSYNC_RELEASING(thread->th.th_current_task); // releasing self
+    KMP_FSYNC_RELEASING(taskdata); // releasing child
+    __kmp_task_deque_lf_push(thread_data, taskdata);
+    KA_TRACE(20, ("__kmp_push_task: T#%d returning TASK_SUCCESSFULLY_PUSHED: "
+                  "task=%p to lock-free deque\n",
+                  gtid, taskdata));
+    return TASK_SUCCESSFULLY_PUSHED;
+  }
+
   int locked = 0;
   // Check if deque is full
   if (TCR_4(thread_data->td.td_deque_ntasks) >=
@@ -600,12 +702,17 @@ static void __kmpc_omp_task_begin_if0_template(ident_t *loc_ref, kmp_int32 gtid,
                                                void *frame_address,
                                                void *return_address) {
   kmp_taskdata_t *taskdata = KMP_TASK_TO_TASKDATA(task);
-  kmp_taskdata_t *current_task = __kmp_threads[gtid]->th.th_current_task;
+  kmp_info_t *thread = __kmp_threads[gtid];
+  kmp_taskdata_t *current_task = thread->th.th_current_task;
 
   KA_TRACE(10, ("__kmpc_omp_task_begin_if0(enter): T#%d loc=%p task=%p "
                 "current_task=%p\n",
                 gtid, loc_ref, taskdata, current_task));
 
+  // An undeferred task would not be part of the replays of a task graph
+  if (UNLIKELY(thread->th.th_taskgraph != NULL))
+    __kmp_taskgraph_invalidate(thread);
+
   if (taskdata->td_flags.tiedness == TASK_UNTIED) {
     // untied task needs to increment counter so that the task structure is not
     // freed prematurely
@@ -694,6 +801,157 @@ void __kmpc_omp_task_begin(ident_t *loc_ref, kmp_int32 gtid, kmp_task_t *task) {
 }
 #endif // TASK_UNUSED
 
+// Task descriptor pool (KMP_TASK_POOL)
+//
+// A thread keeps the descriptors it allocated in free lists by size class,
+// carved out of chunks which stay with the thread until it is reaped. The
+// owner and the size of a descriptor are found in the descriptor itself. A
+// thread freeing the descriptor of another thread does not touch the owner's
+// lists: it gathers the descriptors of each owner in a batch, and pushes the
+// whole batch to the owner's returned list with a single CAS. The owner takes
+// back its returned list at once when its own list is empty.
+
+// __kmp_task_pool_class: size class of a descriptor of the given size
+static inline int __kmp_task_pool_class(size_t size) {
+  KMP_DEBUG_ASSERT(size > 0 && size <= KMP_TASK_POOL_MAX_SIZE);
+  return (int)((size - 1) / CACHE_LINE);
+}
+
+static kmp_task_pool_t *__kmp_get_task_pool(kmp_info_t *thread) {
+  kmp_task_pool_t *pool = thread->th.th_task_pool;
+  if (UNLIKELY(pool == NULL)) {
+    pool = (kmp_task_pool_t *)__kmp_allocate(sizeof(kmp_task_pool_t));
+    thread->th.th_task_pool = pool;
+  }
+  return pool;
+}
+
+// __kmp_task_pool_refill: carve a new chunk into descriptors of a size class,
+// returns the list of the descriptors
+static void *__kmp_task_pool_refill(kmp_task_pool_t *pool, int size_class) {
+  size_t slot_size = (size_class + 1) * CACHE_LINE;
+  char *chunk = (char *)__kmp_allocate(KMP_TASK_POOL_CHUNK_SIZE);
+  // The first cache line of a chunk links the chunks of the thread
+  *(void **)chunk = pool->tp_chunks;
+  pool->tp_chunks = chunk;
+  void *list = NULL;
+  // Link the descriptors backwards so that they are used in address order
+  for (size_t i = (KMP_TASK_POOL_CHUNK_SIZE - CACHE_LINE) / slot_size; i > 0;
+       --i) {
+    void *slot = chunk + CACHE_LINE + (i - 1) * slot_size;
+    *(void **)slot = list;
+    list = slot;
+  }
+  return list;
+}
+
+// __kmp_task_pool_allocate: allocate a descriptor from the pool of the thread
+static kmp_taskdata_t *__kmp_task_pool_allocate(kmp_info_t *thread,
+                                                size_t size) {
+  kmp_task_pool_t *pool = __kmp_get_task_pool(thread);
+  int size_class = __kmp_task_pool_class(size);
+  void *ptr = pool->tp_free[size_class];
+  if (ptr == NULL) {
+    ptr = KMP_ATOMIC_OP(exchange, &pool->tp_returned[size_class], nullptr,
+                        acquire);
+    if (ptr == NULL)
+      ptr = __kmp_task_pool_refill(pool, size_class);
+  }
+  pool->tp_free[size_class] = *(void **)ptr;
+  return (kmp_taskdata_t *)ptr;
+}
+
+// __kmp_task_pool_return: push a batch of descriptors to its owner
+static void __kmp_task_pool_return(kmp_task_pool_t *pool,
+                                   kmp_task_pool_batch_t *batch,
+                                   int size_class) {
+  KMP_DEBUG_ASSERT(batch->tpb_count > 0);
+  std::atomic<void *> *returned =
+      &batch->tpb_owner->th.th_task_pool->tp_returned[size_class];
+  void *head = KMP_ATOMIC_LD_RLX(returned);
+  do {
+    *(void **)batch->tpb_tail = head;
+  } while (!returned->compare_exchange_weak(head, batch->tpb_head,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed));
+  batch->tpb_head = batch->tpb_tail = NULL;
+  batch->tpb_count = 0;
+  pool->tp_pending--;
+}
+
+// __kmp_task_pool_free: free a descriptor allocated by __kmp_task_pool_allocate
+static void __kmp_task_pool_free(kmp_info_t *thread, kmp_taskdata_t *taskdata) {
+  kmp_info_t *owner = taskdata->td_alloc_thread;
+  int size_class = __kmp_task_pool_class(taskdata->td_size_alloc);
+  kmp_task_pool_t *pool = __kmp_get_task_pool(thread);
+  void *ptr = taskdata;
+  if (owner == thread) {
+    *(void **)ptr = pool->tp_free[size_class];
+    pool->tp_free[size_class] = ptr;
+    return;
+  }
+  kmp_task_pool_batch_t *batches = pool->tp_batches[size_class];
+  kmp_task_pool_batch_t *batch = NULL;
+  kmp_task_pool_batch_t *smallest = &batches[0];
+  for (int i = 0; i < KMP_TASK_POOL_OWNERS; ++i) {
+    if (batches[i].tpb_owner == owner) {
+      batch = &batches[i];
+      break;
+    }
+    if (batches[i].tpb_count < smallest->tpb_count)
+      smallest = &batches[i];
+  }
+  if (batch == NULL) {
+    // Make room for the new owner, returning the smallest batch early
+    batch = smallest;
+    if (batch->tpb_count > 0)
+      __kmp_task_pool_return(pool, batch, size_class);
+    batch->tpb_owner = owner;
+  }
+  *(void **)ptr = batch->tpb_head;
+  if (batch->tpb_head == NULL) {
+    batch->tpb_tail = ptr;
+    pool->tp_pending++;
+  }
+  batch->tpb_head = ptr;
+  if (++batch->tpb_count == KMP_TASK_POOL_BATCH)
+    __kmp_task_pool_return(pool, batch, size_class);
+}
+
+// __kmp_task_pool_flush: return all the batches of the thread to their
+// owners. Called before the thread is done with the tasks of a barrier, so
+// that no batch outlives the owners.
+static void __kmp_task_pool_flush(kmp_info_t *thread) {
+  kmp_task_pool_t *pool = thread->th.th_task_pool;
+  if (pool == NULL || pool->tp_pending == 0)
+    return;
+  for (int size_class = 0; size_class < KMP_TASK_POOL_CLASSES; ++size_class) {
+    for (int i = 0; i < KMP_TASK_POOL_OWNERS; ++i) {
+      kmp_task_pool_batch_t *batch = &pool->tp_batches[size_class][i];
+      if (batch->tpb_count > 0)
+        __kmp_task_pool_return(pool, batch, size_class);
+    }
+  }
+  KMP_DEBUG_ASSERT(pool->tp_pending == 0);
+}
+
+// __kmp_free_task_pool: free the task pool of a thread being reaped. The
+// descriptors of the other threads still in a batch are not returned, their
+// owners may be gone already.
+void __kmp_free_task_pool(kmp_info_t *thread) {
+  kmp_task_pool_t *pool = thread->th.th_task_pool;
+  if (pool == NULL)
+    return;
+  void *chunk = pool->tp_chunks;
+  while (chunk != NULL) {
+    void *next = *(void **)chunk;
+    __kmp_free(chunk);
+    chunk = next;
+  }
+  __kmp_free(pool);
+  thread->th.th_task_pool = NULL;
+}
+
 // __kmp_free_task: free the current task space and the space for shareds
 //
 // gtid: Global thread ID of calling thread
@@ -714,12 +972,22 @@ static void __kmp_free_task(kmp_int32 gtid, kmp_taskdata_t *taskdata,
   KMP_DEBUG_ASSERT(taskdata->td_incomplete_child_tasks == 0);
 
   taskdata->td_flags.freed = 1;
+  if (UNLIKELY(taskdata->td_flags.taskgraph)) {
+    // The task belongs to a recorded task graph, its next replay reuses it
+    KMP_ATOMIC_ST_REL(&taskdata->td_taskgraph_node->tgn_busy, 0);
+    KA_TRACE(20, ("__kmp_free_task: T#%d released task graph task %p\n",
+                  gtid, taskdata));
+    return;
+  }
   ANNOTATE_HAPPENS_BEFORE(taskdata);
 // deallocate the taskdata and shared variable blocks associated with this task
+  if (taskdata->td_flags.pooled)
+    __kmp_task_pool_free(thread, taskdata);
+  else
 #if USE_FAST_MEMORY
-  __kmp_fast_free(thread, taskdata);
+    __kmp_fast_free(thread, taskdata);
 #else /* ! USE_FAST_MEMORY */
-  __kmp_thread_free(thread, taskdata);
+    __kmp_thread_free(thread, taskdata);
 #endif
 
   KA_TRACE(20, ("__kmp_free_task: T#%d freed task %p\n", gtid, taskdata));
@@ -941,6 +1209,8 @@ static void __kmp_task_finish(kmp_int32 gtid, kmp_task_t *task,
       if (taskdata->td_taskgroup)
         KMP_ATOMIC_DEC(&taskdata->td_taskgroup->count);
       __kmp_release_deps(gtid, taskdata);
+      if (UNLIKELY(taskdata->td_flags.taskgraph))
+        __kmp_taskgraph_release(gtid, taskdata);
     } else if (task_team && task_team->tt.tt_found_proxy_tasks) {
       // if we found proxy tasks there could exist a dependency chain
       // with the proxy task as origin
@@ -1260,12 +1530,18 @@ kmp_task_t *__kmp_task_alloc(ident_t *loc_ref, kmp_int32 gtid,
                 sizeof_shareds));
 
 // Avoid double allocation here by combining shareds with taskdata
+  bool pooled = __kmp_use_task_pool &&
+                shareds_offset + sizeof_shareds <= KMP_TASK_POOL_MAX_SIZE;
+  if (pooled)
+    taskdata =
+        __kmp_task_pool_allocate(thread, shareds_offset + sizeof_shareds);
+  else
 #if USE_FAST_MEMORY
-  taskdata = (kmp_taskdata_t *)__kmp_fast_allocate(thread, shareds_offset +
-                                                               sizeof_shareds);
+    taskdata = (kmp_taskdata_t *)__kmp_fast_allocate(thread, shareds_offset +
+                                                                 sizeof_shareds);
 #else /* ! USE_FAST_MEMORY */
-  taskdata = (kmp_taskdata_t *)__kmp_thread_malloc(thread, shareds_offset +
-                                                               sizeof_shareds);
+    taskdata = (kmp_taskdata_t *)__kmp_thread_malloc(thread, shareds_offset +
+                                                                 sizeof_shareds);
 #endif /* USE_FAST_MEMORY */
   ANNOTATE_HAPPENS_AFTER(taskdata);
 
@@ -1336,6 +1612,8 @@ kmp_task_t *__kmp_task_alloc(ident_t *loc_ref, kmp_int32 gtid,
   taskdata->td_flags.freed = 0;
 
   taskdata->td_flags.native = flags->native;
+  taskdata->td_flags.taskgraph = 0;
+  taskdata->td_flags.pooled = pooled;
 
   KMP_ATOMIC_ST_RLX(&taskdata->td_incomplete_child_tasks, 0);
   // start at one because counts current task and children
@@ -1349,6 +1627,7 @@ kmp_task_t *__kmp_task_alloc(ident_t *loc_ref, kmp_int32 gtid,
   else
     taskdata->td_last_tied = taskdata;
   taskdata->td_allow_completion_event.type = KMP_EVENT_UNINITIALIZED;
+  taskdata->td_taskgraph_node = NULL;
 #if OMPT_SUPPORT
   if (UNLIKELY(ompt_enabled.enabled))
     __ompt_task_init(taskdata, gtid);
@@ -1717,6 +1996,9 @@ kmp_int32 __kmpc_omp_task(ident_t *loc_ref, kmp_int32 gtid,
   KA_TRACE(10, ("__kmpc_omp_task(enter): T#%d loc=%p task=%p\n", gtid, loc_ref,
                 new_taskdata));
   __kmp_assert_valid_gtid(gtid);
+  kmp_info_t *thread = __kmp_threads[gtid];
+  if (UNLIKELY(thread->th.th_taskgraph != NULL))
+    __kmp_taskgraph_record(thread, new_task, 0, NULL, 0, NULL);
 
 #if OMPT_SUPPORT
   kmp_taskdata_t *parent = NULL;
@@ -1830,6 +2112,8 @@ static kmp_int32 __kmpc_omp_taskwait_template(ident_t *loc_ref, kmp_int32 gtid,
   if (__kmp_tasking_mode != tskm_immediate_exec) {
     thread = __kmp_threads[gtid];
     taskdata = thread->th.th_current_task;
+    if (UNLIKELY(thread->th.th_taskgraph != NULL))
+      __kmp_taskgraph_invalidate(thread);
 
 #if OMPT_SUPPORT && OMPT_OPTIONAL
     ompt_data_t *my_task_data;
@@ -2432,6 +2716,8 @@ void __kmpc_taskgroup(ident_t *loc, int gtid) {
   __kmp_assert_valid_gtid(gtid);
   kmp_info_t *thread = __kmp_threads[gtid];
   kmp_taskdata_t *taskdata = thread->th.th_current_task;
+  if (UNLIKELY(thread->th.th_taskgraph != NULL))
+    __kmp_taskgraph_invalidate(thread);
   kmp_taskgroup_t *tg_new =
       (kmp_taskgroup_t *)__kmp_thread_malloc(thread, sizeof(kmp_taskgroup_t));
   KA_TRACE(10, ("__kmpc_taskgroup: T#%d loc=%p group=%p\n", gtid, loc, tg_new));
@@ -2603,6 +2889,513 @@ void __kmpc_end_taskgroup(ident_t *loc, int gtid) {
 #endif
 }
 
+// Task graph record and replay
+//
+// __kmpc_taskgraph_begin() and __kmpc_taskgraph_end() enclose a taskgroup that
+// is executed repeatedly with the same tasks. The first execution records a
+// copy of each task created by the encountering task and the dependences
+// between them. The following executions skip the region and run copies of
+// the recorded tasks instead, each released when its recorded predecessors
+// complete, so no task is allocated and no dependence is resolved again.
+// A region that contains an undeferred task, a taskwait, a taskloop or a
+// nested taskgroup, or a task the runtime can't copy, is never replayed.
+
+#define KMP_TASKGRAPH_HASH_SIZE 64
+
+static kmp_taskgraph_t *__kmp_taskgraphs[KMP_TASKGRAPH_HASH_SIZE];
+static KMP_BOOTSTRAP_LOCK_INIT(__kmp_taskgraph_lock);
+
+// __kmp_taskgraph_find: find the task graph graph_id, create it if needed
+static kmp_taskgraph_t *__kmp_taskgraph_find(kmp_int32 graph_id) {
+  kmp_int32 bucket = graph_id & (KMP_TASKGRAPH_HASH_SIZE - 1);
+  kmp_taskgraph_t *graph;
+
+  // Graphs are never removed from the table before __kmp_cleanup()
+  for (graph = (kmp_taskgraph_t *)TCR_PTR(__kmp_taskgraphs[bucket]); graph;
+       graph = graph->tg_next)
+    if (graph->tg_id == graph_id)
+      return graph;
+
+  __kmp_acquire_bootstrap_lock(&__kmp_taskgraph_lock);
+  for (graph = __kmp_taskgraphs[bucket]; graph; graph = graph->tg_next)
+    if (graph->tg_id == graph_id)
+      break;
+  if (graph == NULL) {
+    graph = (kmp_taskgraph_t *)__kmp_allocate(sizeof(kmp_taskgraph_t));
+    graph->tg_id = graph_id;
+    KMP_ATOMIC_ST_RLX(&graph->tg_status, (kmp_int32)KMP_TASKGRAPH_NONE);
+    graph->tg_next = __kmp_taskgraphs[bucket];
+    KMP_MB();
+    TCW_PTR(__kmp_taskgraphs[bucket], graph);
+  }
+  __kmp_release_bootstrap_lock(&__kmp_taskgraph_lock);
+  return graph;
+}
+
+// __kmp_taskgraph_push: append value to a list of node indices
+static kmp_int32 *__kmp_taskgraph_push(kmp_int32 *list, kmp_int32 *count,
+                                       kmp_int32 *size, kmp_int32 value) {
+  if (*count == *size) {
+    kmp_int32 new_size = *size ? 2 * *size : 4;
+    kmp_int32 *new_list =
+        (kmp_int32 *)__kmp_allocate(new_size * sizeof(kmp_int32));
+    if (list) {
+      KMP_MEMCPY(new_list, list, *count * sizeof(kmp_int32));
+      __kmp_free(list);
+    }
+    list = new_list;
+    *size = new_size;
+  }
+  list[(*count)++] = value;
+  return list;
+}
+
+static kmp_int32 __kmp_taskgraph_add_node(kmp_taskgraph_t *graph,
+                                          kmp_task_t *task) {
+  if (graph->tg_nnodes == graph->tg_nodes_size) {
+    kmp_int32 new_size = graph->tg_nodes_size ? 2 * graph->tg_nodes_size : 16;
+    kmp_taskgraph_node_t *new_nodes = (kmp_taskgraph_node_t *)__kmp_allocate(
+        new_size * sizeof(kmp_taskgraph_node_t));
+    if (graph->tg_nodes) {
+      KMP_MEMCPY(new_nodes, graph->tg_nodes,
+                 graph->tg_nnodes * sizeof(kmp_taskgraph_node_t));
+      __kmp_free(graph->tg_nodes);
+    }
+    graph->tg_nodes = new_nodes;
+    graph->tg_nodes_size = new_size;
+  }
+  kmp_taskgraph_node_t *node = &graph->tg_nodes[graph->tg_nnodes];
+  node->tgn_graph = graph;
+  node->tgn_task = task;
+  return graph->tg_nnodes++;
+}
+
+static void __kmp_taskgraph_add_edge(kmp_taskgraph_t *graph, kmp_int32 from,
+                                     kmp_int32 to) {
+  if (from < 0 || from == to)
+    return;
+  kmp_taskgraph_node_t *node = &graph->tg_nodes[from];
+  // All the edges to a node are added when it is recorded, so a duplicate edge
+  // is the last one added to its predecessor
+  if (node->tgn_nsuccessors > 0 &&
+      node->tgn_successors[node->tgn_nsuccessors - 1] == to)
+    return;
+  node->tgn_successors =
+      __kmp_taskgraph_push(node->tgn_successors, &node->tgn_nsuccessors,
+                           &node->tgn_successors_size, to);
+  graph->tg_nodes[to].tgn_npredecessors++;
+}
+
+static kmp_taskgraph_dep_t *__kmp_taskgraph_find_dep(kmp_taskgraph_t *graph,
+                                                     kmp_intptr_t addr) {
+  if (graph->tg_deps == NULL)
+    graph->tg_deps = (kmp_taskgraph_dep_t **)__kmp_allocate(
+        KMP_TASKGRAPH_DEP_BUCKETS * sizeof(kmp_taskgraph_dep_t *));
+  kmp_uintptr_t bucket =
+      (((kmp_uintptr_t)addr >> 6) ^ ((kmp_uintptr_t)addr >> 2)) %
+      KMP_TASKGRAPH_DEP_BUCKETS;
+  kmp_taskgraph_dep_t *dep;
+  for (dep = graph->tg_deps[bucket]; dep; dep = dep->tgd_next)
+    if (dep->tgd_addr == addr)
+      return dep;
+  dep = (kmp_taskgraph_dep_t *)__kmp_allocate(sizeof(kmp_taskgraph_dep_t));
+  dep->tgd_addr = addr;
+  dep->tgd_last_out = -1;
+  dep->tgd_next = graph->tg_deps[bucket];
+  graph->tg_deps[bucket] = dep;
+  return dep;
+}
+
+static void __kmp_taskgraph_record_deps(kmp_taskgraph_t *graph, kmp_int32 id,
+                                        kmp_int32 ndeps,
+                                        kmp_depend_info_t *dep_list) {
+  for (kmp_int32 i = 0; i < ndeps; i++) {
+    if (dep_list[i].base_addr == 0)
+      continue;
+    kmp_taskgraph_dep_t *dep =
+        __kmp_taskgraph_find_dep(graph, dep_list[i].base_addr);
+    if (dep_list[i].flags.out || dep_list[i].flags.mtx) {
+      // mutexinoutset is recorded as inout: the replays run the tasks in the
+      // order they were created
+      if (dep->tgd_nins > 0) {
+        for (kmp_int32 j = 0; j < dep->tgd_nins; j++)
+          __kmp_taskgraph_add_edge(graph, dep->tgd_ins[j], id);
+        dep->tgd_nins = 0;
+      } else {
+        __kmp_taskgraph_add_edge(graph, dep->tgd_last_out, id);
+      }
+      dep->tgd_last_out = id;
+    } else if (dep_list[i].flags.in) {
+      __kmp_taskgraph_add_edge(graph, dep->tgd_last_out, id);
+      dep->tgd_ins = __kmp_taskgraph_push(dep->tgd_ins, &dep->tgd_nins,
+                                          &dep->tgd_ins_size, id);
+    }
+  }
+}
+
+// __kmp_taskgraph_record: record a task created in a task graph region
+//
+// thread: encountering thread, recording thread->th.th_taskgraph
+// task: the new task, not scheduled yet
+// ndeps, dep_list, ndeps_noalias, noalias_dep_list: dependences of the task
+void __kmp_taskgraph_record(kmp_info_t *thread, kmp_task_t *task,
+                            kmp_int32 ndeps, kmp_depend_info_t *dep_list,
+                            kmp_int32 ndeps_noalias,
+                            kmp_depend_info_t *noalias_dep_list) {
+  kmp_taskgraph_t *graph = thread->th.th_taskgraph;
+  kmp_taskdata_t *taskdata = KMP_TASK_TO_TASKDATA(task);
+
+  // Only the tasks created by the task that recorded the graph are part of
+  // it; an untied task being rescheduled was recorded already
+  if (KMP_ATOMIC_LD_RLX(&graph->tg_status) != KMP_TASKGRAPH_RECORDING ||
+      graph->tg_invalid || thread->th.th_current_task != graph->tg_owner ||
+      taskdata->td_flags.started)
+    return;
+  if (taskdata->td_flags.proxy == TASK_PROXY ||
+      taskdata->td_flags.detachable == TASK_DETACHABLE ||
+      taskdata->td_flags.destructors_thunk) {
+    KA_TRACE(20, ("__kmp_taskgraph_record: task %p can't be replayed, graph "
+                  "%d invalid\n",
+                  taskdata, graph->tg_id));
+    graph->tg_invalid = true;
+    return;
+  }
+
+  kmp_taskdata_t *copy =
+      (kmp_taskdata_t *)__kmp_allocate(taskdata->td_size_alloc);
+  KMP_MEMCPY(copy, taskdata, taskdata->td_size_alloc);
+  kmp_task_t *copy_task = KMP_TASKDATA_TO_TASK(copy);
+  if (task->shareds != NULL)
+    copy_task->shareds =
+        (char *)copy + ((char *)task->shareds - (char *)taskdata);
+  copy->td_flags.taskgraph = 1;
+
+  kmp_int32 id = __kmp_taskgraph_add_node(graph, copy_task);
+  __kmp_taskgraph_record_deps(graph, id, ndeps, dep_list);
+  __kmp_taskgraph_record_deps(graph, id, ndeps_noalias, noalias_dep_list);
+
+  KA_TRACE(20, ("__kmp_taskgraph_record: T#%d recorded task %p as node %d of "
+                "graph %d\n",
+                __kmp_gtid_from_thread(thread), taskdata, id, graph->tg_id));
+}
+
+// __kmp_taskgraph_invalidate: the current task of thread executes a construct
+// that the replays of the task graph it records could not reproduce
+void __kmp_taskgraph_invalidate(kmp_info_t *thread) {
+  kmp_taskgraph_t *graph = thread->th.th_taskgraph;
+  if (KMP_ATOMIC_LD_RLX(&graph->tg_status) == KMP_TASKGRAPH_RECORDING &&
+      thread->th.th_current_task == graph->tg_owner && !graph->tg_invalid) {
+    KA_TRACE(20, ("__kmp_taskgraph_invalidate: T#%d graph %d invalid\n",
+                  __kmp_gtid_from_thread(thread), graph->tg_id));
+    graph->tg_invalid = true;
+  }
+}
+
+static void __kmp_taskgraph_free_deps(kmp_taskgraph_t *graph) {
+  if (graph->tg_deps == NULL)
+    return;
+  for (kmp_int32 i = 0; i < KMP_TASKGRAPH_DEP_BUCKETS; i++) {
+    kmp_taskgraph_dep_t *dep = graph->tg_deps[i];
+    while (dep) {
+      kmp_taskgraph_dep_t *next = dep->tgd_next;
+      if (dep->tgd_ins)
+        __kmp_free(dep->tgd_ins);
+      __kmp_free(dep);
+      dep = next;
+    }
+  }
+  __kmp_free(graph->tg_deps);
+  graph->tg_deps = NULL;
+}
+
+static void __kmp_taskgraph_free_nodes(kmp_taskgraph_t *graph) {
+  for (kmp_int32 i = 0; i < graph->tg_nnodes; i++) {
+    kmp_taskgraph_node_t *node = &graph->tg_nodes[i];
+    if (node->tgn_exec) {
+      while (KMP_ATOMIC_LD_ACQ(&node->tgn_busy))
+        KMP_CPU_PAUSE();
+      __kmp_free(KMP_TASK_TO_TASKDATA(node->tgn_exec));
+    }
+    __kmp_free(KMP_TASK_TO_TASKDATA(node->tgn_task));
+    if (node->tgn_successors)
+      __kmp_free(node->tgn_successors);
+  }
+  if (graph->tg_nodes)
+    __kmp_free(graph->tg_nodes);
+  graph->tg_nodes = NULL;
+  graph->tg_nnodes = 0;
+  graph->tg_nodes_size = 0;
+}
+
+// __kmp_taskgraph_init_task: set up the task a replay executes for node, as
+// __kmp_task_alloc() would for a task created by the current task of thread
+static void __kmp_taskgraph_init_task(kmp_int32 gtid, kmp_info_t *thread,
+                                      kmp_taskgraph_node_t *node) {
+  kmp_taskdata_t *parent_task = thread->th.th_current_task;
+  kmp_taskdata_t *recorded = KMP_TASK_TO_TASKDATA(node->tgn_task);
+  kmp_taskdata_t *taskdata;
+
+  if (node->tgn_exec == NULL) {
+    taskdata = (kmp_taskdata_t *)__kmp_allocate(recorded->td_size_alloc);
+    node->tgn_exec = KMP_TASKDATA_TO_TASK(taskdata);
+  } else {
+    // The thread that completed the task in the previous replay may not have
+    // left __kmp_free_task() yet
+    taskdata = KMP_TASK_TO_TASKDATA(node->tgn_exec);
+    while (KMP_ATOMIC_LD_ACQ(&node->tgn_busy))
+      KMP_CPU_PAUSE();
+  }
+  // The private variables of the task may have been changed by the last replay
+  KMP_MEMCPY(taskdata, recorded, recorded->td_size_alloc);
+  kmp_task_t *task = node->tgn_exec;
+  if (task->shareds != NULL)
+    task->shareds = (char *)taskdata + ((char *)node->tgn_task->shareds -
+                                        (char *)recorded);
+
+  taskdata->td_task_id = KMP_GEN_TASK_ID();
+  taskdata->td_team = thread->th.th_team;
+  taskdata->td_alloc_thread = thread;
+  taskdata->td_parent = parent_task;
+  taskdata->td_level = parent_task->td_level + 1;
+  copy_icvs(&taskdata->td_icvs, &parent_task->td_icvs);
+  taskdata->td_task_team = thread->th.th_task_team;
+  taskdata->td_flags.task_serial = 0;
+  taskdata->td_flags.tasking_ser = 0;
+  taskdata->td_flags.team_serial = 0;
+  taskdata->td_taskgroup = parent_task->td_taskgroup;
+  if (taskdata->td_flags.tiedness == TASK_UNTIED)
+    taskdata->td_last_tied = NULL;
+  else
+    taskdata->td_last_tied = taskdata;
+  taskdata->td_taskgraph_node = node;
+  KMP_ATOMIC_ST_RLX(&node->tgn_npredecessors_left, node->tgn_npredecessors);
+  KMP_ATOMIC_ST_RLX(&node->tgn_busy, 1);
+#if OMPT_SUPPORT
+  if (UNLIKELY(ompt_enabled.enabled))
+    __ompt_task_init(taskdata, gtid);
+#endif
+
+  KMP_ATOMIC_INC(&parent_task->td_incomplete_child_tasks);
+  if (parent_task->td_taskgroup)
+    KMP_ATOMIC_INC(&parent_task->td_taskgroup->count);
+  if (parent_task->td_flags.tasktype == TASK_EXPLICIT)
+    KMP_ATOMIC_INC(&parent_task->td_allocated_child_tasks);
+}
+
+// __kmp_taskgraph_replay: schedule the tasks of a recorded graph, those with
+// predecessors are scheduled by __kmp_taskgraph_release()
+static void __kmp_taskgraph_replay(kmp_int32 gtid, kmp_info_t *thread,
+                                   kmp_taskgraph_t *graph) {
+  KA_TRACE(20, ("__kmp_taskgraph_replay: T#%d replays graph %d, %d tasks\n",
+                gtid, graph->tg_id, graph->tg_nnodes));
+  for (kmp_int32 i = 0; i < graph->tg_nnodes; i++)
+    __kmp_taskgraph_init_task(gtid, thread, &graph->tg_nodes[i]);
+  for (kmp_int32 i = 0; i < graph->tg_nnodes; i++)
+    if (graph->tg_nodes[i].tgn_npredecessors == 0)
+      __kmp_omp_task(gtid, graph->tg_nodes[i].tgn_exec, true);
+}
+
+// __kmp_taskgraph_release: schedule the successors of a completed task of a
+// replayed graph whose predecessors have all completed
+static void __kmp_taskgraph_release(kmp_int32 gtid, kmp_taskdata_t *taskdata) {
+  kmp_taskgraph_node_t *node = taskdata->td_taskgraph_node;
+  kmp_taskgraph_t *graph = node->tgn_graph;
+  for (kmp_int32 i = 0; i < node->tgn_nsuccessors; i++) {
+    kmp_taskgraph_node_t *successor = &graph->tg_nodes[node->tgn_successors[i]];
+    if (KMP_ATOMIC_DEC(&successor->tgn_npredecessors_left) == 1)
+      __kmp_omp_task(gtid, successor->tgn_exec, true);
+  }
+}
+
+// __kmp_taskgraph_depnode_live: return true if the task of node is incomplete
+static bool __kmp_taskgraph_depnode_live(kmp_int32 gtid, kmp_depnode_t *node) {
+  if (node == NULL || TCR_PTR(node->dn.task) == NULL)
+    return false;
+  // The task is not freed before __kmp_release_deps() clears it under the lock
+  KMP_ACQUIRE_DEPNODE(gtid, node);
+  kmp_task_t *task = node->dn.task;
+  bool live = task != NULL && !KMP_TASK_TO_TASKDATA(task)->td_flags.complete;
+  KMP_RELEASE_DEPNODE(gtid, node);
+  return live;
+}
+
+// __kmp_taskgraph_deps_pending: return true if a task created by taskdata
+// before the region may still have to run before the recorded tasks. A replay
+// doesn't go through the dependence hash of taskdata, so it would not wait
+// for such a task.
+static bool __kmp_taskgraph_deps_pending(kmp_int32 gtid,
+                                         kmp_taskdata_t *taskdata) {
+  if (KMP_ATOMIC_LD_ACQ(&taskdata->td_incomplete_child_tasks) > 0)
+    return true;
+  kmp_dephash_t *h = taskdata->td_dephash;
+  if (h == NULL)
+    return false;
+  for (size_t i = 0; i < h->size; i++) {
+    for (kmp_dephash_entry_t *entry = h->buckets[i]; entry;
+         entry = entry->next_in_bucket) {
+      if (__kmp_taskgraph_depnode_live(gtid, entry->last_out))
+        return true;
+      for (kmp_depnode_list_t *p = entry->last_ins; p; p = p->next)
+        if (__kmp_taskgraph_depnode_live(gtid, p->node))
+          return true;
+      for (kmp_depnode_list_t *p = entry->last_mtxs; p; p = p->next)
+        if (__kmp_taskgraph_depnode_live(gtid, p->node))
+          return true;
+    }
+  }
+  return false;
+}
+
+/*!
+@ingroup TASKING
+@param loc source location information
+@param gtid global thread number
+@param graph_id identifier of the task graph
+@return 1 if the region must be executed, 0 if the recorded graph was
+replayed instead
+
+Start a task graph region. The region is a taskgroup; the first time it is
+executed, the tasks created in it and their dependences are recorded as task
+graph graph_id. Later, the recorded tasks are scheduled again by this call and
+the caller skips the region. In both cases, the region is closed by
+__kmpc_taskgraph_end(). The recorded tasks keep the values of their private
+variables and the addresses of their shared variables; a region that creates
+different tasks must discard the graph with __kmpc_taskgraph_reset(). The
+region is executed instead of replayed while a task created before it by the
+encountering task is incomplete.
+*/
+kmp_int32 __kmpc_taskgraph_begin(ident_t *loc, kmp_int32 gtid,
+                                 kmp_int32 graph_id) {
+  __kmp_assert_valid_gtid(gtid);
+  kmp_info_t *thread = __kmp_threads[gtid];
+  kmp_taskdata_t *taskdata = thread->th.th_current_task;
+
+  KA_TRACE(10, ("__kmpc_taskgraph_begin(enter): T#%d loc=%p graph=%d\n", gtid,
+                loc, graph_id));
+  __kmpc_taskgroup(loc, gtid);
+
+  // Serialized tasks are executed when they are created, a replay would not
+  // save anything
+  if (__kmp_tasking_mode == tskm_immediate_exec ||
+      thread->th.th_team->t.t_serialized || taskdata->td_flags.final)
+    return 1;
+
+  kmp_taskgraph_t *graph = __kmp_taskgraph_find(graph_id);
+  kmp_int32 status = KMP_ATOMIC_LD_ACQ(&graph->tg_status);
+  if (status == KMP_TASKGRAPH_READY &&
+      !__kmp_taskgraph_deps_pending(gtid, taskdata) &&
+      __kmp_atomic_compare_store_acq(&graph->tg_status,
+                                     (kmp_int32)KMP_TASKGRAPH_READY,
+                                     (kmp_int32)KMP_TASKGRAPH_REPLAYING)) {
+    graph->tg_owner = taskdata;
+    graph->tg_outer = thread->th.th_taskgraph;
+    thread->th.th_taskgraph = graph;
+    __kmp_taskgraph_replay(gtid, thread, graph);
+    KA_TRACE(10, ("__kmpc_taskgraph_begin(exit): T#%d replayed graph %d\n",
+                  gtid, graph_id));
+    return 0;
+  }
+  if (status == KMP_TASKGRAPH_NONE &&
+      __kmp_atomic_compare_store_acq(&graph->tg_status,
+                                     (kmp_int32)KMP_TASKGRAPH_NONE,
+                                     (kmp_int32)KMP_TASKGRAPH_RECORDING)) {
+    graph->tg_invalid = false;
+    graph->tg_owner = taskdata;
+    graph->tg_outer = thread->th.th_taskgraph;
+    thread->th.th_taskgraph = graph;
+    KA_TRACE(10, ("__kmpc_taskgraph_begin(exit): T#%d records graph %d\n",
+                  gtid, graph_id));
+    return 1;
+  }
+  // The graph can't be replayed, another thread records or replays it, or
+  // tasks created before the region are incomplete
+  KA_TRACE(10, ("__kmpc_taskgraph_begin(exit): T#%d executes region of graph "
+                "%d\n",
+                gtid, graph_id));
+  return 1;
+}
+
+/*!
+@ingroup TASKING
+@param loc source location information
+@param gtid global thread number
+@param graph_id identifier of the task graph
+
+End a task graph region started by __kmpc_taskgraph_begin(): wait for the tasks
+of the region, or of the replayed graph, to complete.
+*/
+void __kmpc_taskgraph_end(ident_t *loc, kmp_int32 gtid, kmp_int32 graph_id) {
+  __kmp_assert_valid_gtid(gtid);
+  kmp_info_t *thread = __kmp_threads[gtid];
+  kmp_taskdata_t *taskdata = thread->th.th_current_task;
+
+  KA_TRACE(10, ("__kmpc_taskgraph_end(enter): T#%d loc=%p graph=%d\n", gtid,
+                loc, graph_id));
+  __kmpc_end_taskgroup(loc, gtid);
+
+  kmp_taskgraph_t *graph = thread->th.th_taskgraph;
+  if (graph == NULL || graph->tg_id != graph_id || graph->tg_owner != taskdata)
+    return;
+  thread->th.th_taskgraph = graph->tg_outer;
+  graph->tg_owner = NULL;
+  graph->tg_outer = NULL;
+
+  if (KMP_ATOMIC_LD_RLX(&graph->tg_status) == KMP_TASKGRAPH_REPLAYING) {
+    KMP_ATOMIC_ST_REL(&graph->tg_status, (kmp_int32)KMP_TASKGRAPH_READY);
+    return;
+  }
+  __kmp_taskgraph_free_deps(graph);
+  if (graph->tg_invalid) {
+    __kmp_taskgraph_free_nodes(graph);
+    KMP_ATOMIC_ST_REL(&graph->tg_status, (kmp_int32)KMP_TASKGRAPH_INVALID);
+  } else {
+    KMP_ATOMIC_ST_REL(&graph->tg_status, (kmp_int32)KMP_TASKGRAPH_READY);
+  }
+  KA_TRACE(10, ("__kmpc_taskgraph_end(exit): T#%d recorded graph %d, %d "
+                "tasks%s\n",
+                gtid, graph_id, graph->tg_nnodes,
+                graph->tg_invalid ? ", invalid" : ""));
+}
+
+/*!
+@ingroup TASKING
+@param loc source location information
+@param gtid global thread number
+@param graph_id identifier of the task graph
+
+Discard the recorded task graph graph_id, the next execution of its region
+records it again. Has no effect while the graph is recorded or replayed.
+*/
+void __kmpc_taskgraph_reset(ident_t *loc, kmp_int32 gtid, kmp_int32 graph_id) {
+  __kmp_assert_valid_gtid(gtid);
+  KA_TRACE(10, ("__kmpc_taskgraph_reset: T#%d loc=%p graph=%d\n", gtid, loc,
+                graph_id));
+  kmp_taskgraph_t *graph = __kmp_taskgraph_find(graph_id);
+  kmp_int32 status = KMP_ATOMIC_LD_ACQ(&graph->tg_status);
+  // Holding the graph as RECORDING keeps other threads from using it
+  if ((status == KMP_TASKGRAPH_READY || status == KMP_TASKGRAPH_INVALID) &&
+      __kmp_atomic_compare_store_acq(&graph->tg_status, status,
+                                     (kmp_int32)KMP_TASKGRAPH_RECORDING)) {
+    __kmp_taskgraph_free_nodes(graph);
+    KMP_ATOMIC_ST_REL(&graph->tg_status, (kmp_int32)KMP_TASKGRAPH_NONE);
+  }
+}
+
+// __kmp_taskgraph_cleanup: free the task graphs at library shutdown
+void __kmp_taskgraph_cleanup(void) {
+  for (kmp_int32 i = 0; i < KMP_TASKGRAPH_HASH_SIZE; i++) {
+    kmp_taskgraph_t *graph = __kmp_taskgraphs[i];
+    while (graph) {
+      kmp_taskgraph_t *next = graph->tg_next;
+      __kmp_taskgraph_free_deps(graph);
+      __kmp_taskgraph_free_nodes(graph);
+      __kmp_free(graph);
+      graph = next;
+    }
+    __kmp_taskgraphs[i] = NULL;
+  }
+}
+
 // __kmp_remove_my_task: remove a task from my own deque
 static kmp_task_t *__kmp_remove_my_task(kmp_info_t *thread, kmp_int32 gtid,
                                         kmp_task_team_t *task_team,
@@ -2622,6 +3415,26 @@ static kmp_task_t *__kmp_remove_my_task(kmp_info_t *thread, kmp_int32 gtid,
                 gtid, thread_data->td.td_deque_ntasks,
                 thread_data->td.td_deque_head, thread_data->td.td_deque_tail));
 
+  if (__kmp_lock_free_task_deque) {
+    taskdata = __kmp_task_deque_lf_pop(thread_data);
+    if (taskdata != NULL) {
+      if (!__kmp_task_is_allowed(gtid, is_constrained, taskdata,
+                                 thread->th.th_current_task)) {
+        // The TSC does not allow to execute the task, put it back
+        __kmp_task_deque_lf_push(thread_data, taskdata);
+        KA_TRACE(10, ("__kmp_remove_my_task(exit #3): T#%d TSC blocks bottom "
+                      "task of lock-free deque\n",
+                      gtid));
+        return NULL;
+      }
+      KA_TRACE(10, ("__kmp_remove_my_task(exit #4): T#%d task %p removed "
+                    "from lock-free deque\n",
+                    gtid, taskdata));
+      return KMP_TASKDATA_TO_TASK(taskdata);
+    }
+    // Otherwise look for the tasks given by other threads in td_deque
+  }
+
   if (TCR_4(thread_data->td.td_deque_ntasks) == 0) {
     KA_TRACE(10,
              ("__kmp_remove_my_task(exit #1): T#%d No tasks to remove: "
@@ -2673,6 +3486,85 @@ static kmp_task_t *__kmp_remove_my_task(kmp_info_t *thread, kmp_int32 gtid,
   return task;
 }
 
+// __kmp_task_pick_victim: pick a random thread other than tid to steal from.
+// The threads on the package of the thief are preferred when the packages are
+// known: a few picks on remote packages are rejected before one is accepted.
+static inline kmp_int32 __kmp_task_pick_victim(kmp_info_t *thread,
+                                               kmp_thread_data_t *threads_data,
+                                               kmp_int32 nthreads,
+                                               kmp_int32 tid) {
+  kmp_int32 package = threads_data[tid].td.td_package;
+  kmp_int32 victim_tid;
+  for (int tries = 0;; ++tries) {
+    victim_tid = __kmp_get_random(thread) % (nthreads - 1);
+    if (victim_tid >= tid) {
+      ++victim_tid; // Adjusts random distribution to exclude self
+    }
+    if (package < 0 || tries == KMP_TASK_REMOTE_VICTIM_REJECTS ||
+        threads_data[victim_tid].td.td_package == package)
+      return victim_tid;
+  }
+}
+
+// __kmp_steal_task_lock_free: remove a task from the top of another thread's
+// lock-free deque
+static kmp_task_t *
+__kmp_steal_task_lock_free(kmp_thread_data_t *victim_td, kmp_int32 gtid,
+                           kmp_task_team_t *task_team,
+                           std::atomic<kmp_int32> *unfinished_threads,
+                           int *thread_finished, kmp_int32 is_constrained) {
+  kmp_int64 top = KMP_ATOMIC_LD(&victim_td->td.td_lf_top, seq_cst);
+  kmp_int64 bottom = KMP_ATOMIC_LD(&victim_td->td.td_lf_bottom, seq_cst);
+  if (top >= bottom)
+    return NULL;
+
+  int was_finished = *thread_finished;
+  if (was_finished) {
+    // We need to un-mark this thread as finished before the task can leave
+    // the victim's deque, or else the master might be prematurely released
+    // from the barrier. The increment is undone if another thread gets the
+    // task first.
+    kmp_int32 count = KMP_ATOMIC_INC(unfinished_threads);
+    KA_TRACE(20, ("__kmp_steal_task_lock_free: T#%d inc unfinished_threads to "
+                  "%d: task_team=%p\n",
+                  gtid, count + 1, task_team));
+  }
+
+  kmp_task_deque_array_t *array = KMP_ATOMIC_LD_ACQ(&victim_td->td.td_lf_array);
+  kmp_taskdata_t *taskdata =
+      KMP_ATOMIC_LD_RLX(&array->tda_tasks[top & array->tda_mask]);
+  if (!victim_td->td.td_lf_top.compare_exchange_strong(
+          top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    // Lost the race with the owner or another thief
+    if (was_finished)
+      KMP_ATOMIC_DEC(unfinished_threads);
+    return NULL;
+  }
+  *thread_finished = FALSE;
+
+  kmp_info_t *thread = __kmp_threads[gtid];
+  if (!__kmp_task_is_allowed(gtid, is_constrained, taskdata,
+                             thread->th.th_current_task)) {
+    // The TSC does not allow to execute the task; it can't be put back into
+    // the victim's deque, keep it in ours where other threads may steal it
+    kmp_thread_data_t *thread_data =
+        &task_team->tt.tt_threads_data[__kmp_tid_from_gtid(gtid)];
+    if (thread_data->td.td_deque == NULL)
+      __kmp_alloc_task_deque(thread, thread_data);
+    __kmp_task_deque_lf_push(thread_data, taskdata);
+    KA_TRACE(10, ("__kmp_steal_task_lock_free: T#%d TSC blocks stolen task "
+                  "%p, moved to own deque\n",
+                  gtid, taskdata));
+    return NULL;
+  }
+
+  KMP_COUNT_BLOCK(TASK_stolen);
+  KA_TRACE(10, ("__kmp_steal_task_lock_free: T#%d stole task %p: "
+                "task_team=%p\n",
+                gtid, taskdata, task_team));
+  return KMP_TASKDATA_TO_TASK(taskdata);
+}
+
 // __kmp_steal_task: remove a task from another thread's deque
 // Assume that calling thread has already checked existence of
 // task_team thread_data before calling this routine.
@@ -2702,6 +3594,15 @@ static kmp_task_t *__kmp_steal_task(kmp_info_t *victim_thr, kmp_int32 gtid,
                 victim_td->td.td_deque_ntasks, victim_td->td.td_deque_head,
                 victim_td->td.td_deque_tail));
 
+  if (__kmp_lock_free_task_deque) {
+    task = __kmp_steal_task_lock_free(victim_td, gtid, task_team,
+                                      unfinished_threads, thread_finished,
+                                      is_constrained);
+    if (task != NULL)
+      return task;
+    // Otherwise look for the tasks given to the victim in td_deque
+  }
+
   if (TCR_4(victim_td->td.td_deque_ntasks) == 0) {
     KA_TRACE(10, ("__kmp_steal_task(exit #1): T#%d could not steal from T#%d: "
                   "task_team=%p ntasks=%d head=%u tail=%u\n",
@@ -2872,10 +3773,8 @@ static inline int __kmp_execute_tasks_template(
             // Pick a random thread. Initial plan was to cycle through all the
             // threads, and only return if we tried to steal from every thread,
             // and failed.  Arch says that's not such a great idea.
-            victim_tid = __kmp_get_random(thread) % (nthreads - 1);
-            if (victim_tid >= tid) {
-              ++victim_tid; // Adjusts random distribution to exclude self
-            }
+            victim_tid =
+                __kmp_task_pick_victim(thread, threads_data, nthreads, tid);
             // Found a potential victim
             other_thread = threads_data[victim_tid].td.td_thr;
             // There is a slight chance that __kmp_enable_tasking() did not wake
@@ -2960,7 +3859,7 @@ static inline int __kmp_execute_tasks_template(
       KMP_YIELD(__kmp_library == library_throughput); // Yield before next task
       // If execution of a stolen task results in more tasks being placed on our
       // run queue, reset use_own_tasks
-      if (!use_own_tasks && TCR_4(threads_data[tid].td.td_deque_ntasks) != 0) {
+      if (!use_own_tasks && __kmp_task_deque_ntasks(&threads_data[tid]) != 0) {
         KA_TRACE(20, ("__kmp_execute_tasks_template: T#%d stolen task spawned "
                       "other tasks, restart\n",
                       gtid));
@@ -2980,6 +3879,9 @@ static inline int __kmp_execute_tasks_template(
       if (!*thread_finished) {
         kmp_int32 count;
 
+        // The master may pass the barrier after the decrement, the descriptors
+        // of the other threads must be returned first
+        __kmp_task_pool_flush(thread);
         count = KMP_ATOMIC_DEC(unfinished_threads) - 1;
         KA_TRACE(20, ("__kmp_execute_tasks_template: T#%d dec "
                       "unfinished_threads to %d task_team=%p\n",
@@ -3179,6 +4081,12 @@ static void __kmp_alloc_task_deque(kmp_info_t *thread,
   thread_data->td.td_deque = (kmp_taskdata_t **)__kmp_allocate(
       INITIAL_TASK_DEQUE_SIZE * sizeof(kmp_taskdata_t *));
   thread_data->td.td_deque_size = INITIAL_TASK_DEQUE_SIZE;
+  if (__kmp_lock_free_task_deque) {
+    KMP_DEBUG_ASSERT(thread_data->td.td_lf_array == NULL);
+    KMP_ATOMIC_ST_REL(
+        &thread_data->td.td_lf_array,
+        __kmp_alloc_task_deque_array(INITIAL_TASK_DEQUE_SIZE, NULL));
+  }
 }
 
 // __kmp_free_task_deque:
@@ -3192,6 +4100,13 @@ static void __kmp_free_task_deque(kmp_thread_data_t *thread_data) {
     thread_data->td.td_deque = NULL;
     __kmp_release_bootstrap_lock(&thread_data->td.td_deque_lock);
   }
+  kmp_task_deque_array_t *array = thread_data->td.td_lf_array;
+  while (array != NULL) {
+    kmp_task_deque_array_t *prev = array->tda_prev;
+    __kmp_free(array);
+    array = prev;
+  }
+  thread_data->td.td_lf_array = NULL;
 
 #ifdef BUILD_TIED_TASK_STACK
   // GEH: Figure out what to do here for td_susp_tied_tasks
@@ -3301,6 +4216,13 @@ static int __kmp_realloc_task_threads_data(kmp_info_t *thread,
         // parallel region will exhibit the same behavior as previous region.
         thread_data->td.td_deque_last_stolen = -1;
       }
+      // The package is used by the thieves to prefer nearby victims
+      thread_data->td.td_package = -1;
+#if KMP_AFFINITY_SUPPORTED
+      if (KMP_AFFINITY_CAPABLE())
+        thread_data->td.td_package = __kmp_affinity_get_place_package(
+            thread_data->td.td_thr->th.th_new_place);
+#endif // KMP_AFFINITY_SUPPORTED
     }
 
     KMP_MB();
@@ -3960,12 +4882,17 @@ kmp_task_t *__kmp_task_dup_alloc(kmp_info_t *thread, kmp_task_t *task_src) {
   // Allocate a kmp_taskdata_t block and a kmp_task_t block.
   KA_TRACE(30, ("__kmp_task_dup_alloc: Th %p, malloc size %ld\n", thread,
                 task_size));
+  bool pooled = __kmp_use_task_pool && task_size <= KMP_TASK_POOL_MAX_SIZE;
+  if (pooled)
+    taskdata = __kmp_task_pool_allocate(thread, task_size);
+  else
 #if USE_FAST_MEMORY
-  taskdata = (kmp_taskdata_t *)__kmp_fast_allocate(thread, task_size);
+    taskdata = (kmp_taskdata_t *)__kmp_fast_allocate(thread, task_size);
 #else
-  taskdata = (kmp_taskdata_t *)__kmp_thread_malloc(thread, task_size);
+    taskdata = (kmp_taskdata_t *)__kmp_thread_malloc(thread, task_size);
 #endif /* USE_FAST_MEMORY */
   KMP_MEMCPY(taskdata, taskdata_src, task_size);
+  taskdata->td_flags.pooled = pooled;
 
   task = KMP_TASKDATA_TO_TASK(taskdata);
 
@@ -4448,6 +5375,8 @@ void __kmpc_taskloop(ident_t *loc, int gtid, kmp_task_t *task, int if_val,
   kmp_taskdata_t *taskdata = KMP_TASK_TO_TASKDATA(task);
   KMP_DEBUG_ASSERT(task != NULL);
   __kmp_assert_valid_gtid(gtid);
+  if (UNLIKELY(__kmp_threads[gtid]->th.th_taskgraph != NULL))
+    __kmp_taskgraph_invalidate(__kmp_threads[gtid]);
   if (nogroup == 0) {
 #if OMPT_SUPPORT && OMPT_OPTIONAL
     OMPT_STORE_RETURN_ADDRESS(gtid);
@@ -0,0 +1,100 @@
+// RUN: %libomp-compile
+// RUN: env OMP_NUM_THREADS=20 KMP_PLAIN_BARRIER_PATTERN=dist,dist KMP_FORKJOIN_BARRIER_PATTERN=dist,dist KMP_REDUCTION_BARRIER_PATTERN=dist,dist %libomp-run
+// RUN: env OMP_NUM_THREADS=20 KMP_PLAIN_BARRIER_PATTERN=dist,dist KMP_FORKJOIN_BARRIER_PATTERN=dist,dist KMP_BLOCKTIME=0 %libomp-run
+// RUN: env OMP_NUM_THREADS=20 KMP_PLAIN_BARRIER_PATTERN=hyper,hyper KMP_FORKJOIN_BARRIER_PATTERN=hyper,hyper %libomp-run
+
+// Fork/join and barrier overheads, measured as in the EPCC syncbench: the
+// time of a loop of delays with the construct, minus that of the same loop
+// without it, divided by the number of iterations. The program also checks
+// that no thread leaves a barrier before all threads have reached it. The
+// tests use 20 threads, so that the dist pattern splits them into groups of
+// at most 8 and the group leaders gather and release their groups.
+//
+// As a benchmark, run it with the number of repetitions, e.g.
+//   env KMP_PLAIN_BARRIER_PATTERN=dist,dist \
+//       KMP_FORKJOIN_BARRIER_PATTERN=dist,dist ./omp_barrier_latency 100000
+// to print the overheads in microseconds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "omp_testsuite.h"
+
+#define DELAY_LENGTH 100
+
+static void delay(int length) {
+  volatile int a = 0;
+  int i;
+  for (i = 0; i < length; i++)
+    a += i;
+}
+
+static double reference(int reps) {
+  double start = omp_get_wtime();
+  int i;
+  for (i = 0; i < reps; i++)
+    delay(DELAY_LENGTH);
+  return omp_get_wtime() - start;
+}
+
+static double test_parallel(int reps) {
+  double start = omp_get_wtime();
+  int i;
+  for (i = 0; i < reps; i++) {
+    #pragma omp parallel
+    delay(DELAY_LENGTH);
+  }
+  return omp_get_wtime() - start;
+}
+
+// Returns the time of the loop, or -1 if a thread left a barrier early.
+static double test_barrier(int reps) {
+  int arrived = 0;
+  int errors = 0;
+  double start = omp_get_wtime();
+  #pragma omp parallel shared(arrived, errors)
+  {
+    int nthreads = omp_get_num_threads();
+    int i, count;
+    for (i = 0; i < reps; i++) {
+      delay(DELAY_LENGTH);
+      #pragma omp atomic
+      arrived++;
+      #pragma omp barrier
+      // The other threads may have arrived at the next barrier already.
+      #pragma omp atomic read
+      count = arrived;
+      if (count < nthreads * (i + 1) || count > nthreads * (i + 2)) {
+        #pragma omp atomic
+        errors++;
+      }
+    }
+  }
+  double time = omp_get_wtime() - start;
+  return errors ? -1 : time;
+}
+
+int main(int argc, char **argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 1000;
+  int verbose = argc > 1;
+  double ref, par, bar;
+
+  if (reps <= 0)
+    return EXIT_FAILURE;
+  // Warm up the thread pool.
+  test_parallel(10);
+
+  ref = reference(reps);
+  par = test_parallel(reps);
+  bar = test_barrier(reps);
+  if (bar < 0) {
+    printf("failed: a thread left the barrier early\n");
+    return EXIT_FAILURE;
+  }
+
+  if (verbose) {
+    printf("threads: %d\n", omp_get_max_threads());
+    printf("PARALLEL overhead: %.3f us\n", (par - ref) * 1e6 / reps);
+    printf("BARRIER overhead: %.3f us\n", (bar - ref) * 1e6 / reps);
+  }
+  return EXIT_SUCCESS;
+}
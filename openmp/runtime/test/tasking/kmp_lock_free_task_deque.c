@@ -0,0 +1,89 @@
+// RUN: %libomp-compile
+// RUN: env KMP_LOCK_FREE_TASK_DEQUE=1 OMP_NUM_THREADS=4 %libomp-run
+// RUN: env KMP_LOCK_FREE_TASK_DEQUE=1 KMP_ENABLE_TASK_THROTTLING=0 \
+// RUN:     OMP_NUM_THREADS=4 %libomp-run
+// RUN: env KMP_LOCK_FREE_TASK_DEQUE=1 OMP_NUM_THREADS=1 %libomp-run
+// RUN: env KMP_LOCK_FREE_TASK_DEQUE=0 OMP_NUM_THREADS=4 %libomp-run
+
+// Many fine-grained tasks: every task must be executed exactly once whether
+// the owner pops it, a thief steals it, or the deque had to grow for it.
+
+#include <stdio.h>
+#include <omp.h>
+
+#define NTASKS 10000
+#define DEPTH 16
+
+int counts[NTASKS];
+int nested;
+
+static int fib(int n) {
+  int x, y;
+  if (n < 2)
+    return n;
+  #pragma omp task shared(x) firstprivate(n)
+  x = fib(n - 1);
+  #pragma omp task shared(y) firstprivate(n)
+  y = fib(n - 2);
+  #pragma omp taskwait
+  return x + y;
+}
+
+int main() {
+  int errors = 0;
+  int i, result = 0;
+
+  #pragma omp parallel
+  {
+    // Flat tasks from a single producer, most of them are stolen
+    #pragma omp single
+    {
+      for (i = 0; i < NTASKS; i++) {
+        #pragma omp task firstprivate(i)
+        {
+          #pragma omp atomic
+          counts[i]++;
+        }
+      }
+    }
+
+    // Nested tasks with taskwaits, the tied task scheduling constraint blocks
+    // some of the tasks found in the deques
+    #pragma omp single
+    result = fib(DEPTH);
+
+    // Tasks created by every thread at once
+    int j;
+    for (j = 0; j < NTASKS / 100; j++) {
+      #pragma omp task
+      {
+        #pragma omp atomic
+        nested++;
+      }
+    }
+  }
+
+  for (i = 0; i < NTASKS; i++) {
+    if (counts[i] != 1) {
+      printf("task %d executed %d times\n", i, counts[i]);
+      errors++;
+      break;
+    }
+  }
+  if (result != 987) {
+    printf("fib(%d) = %d, expected 987\n", DEPTH, result);
+    errors++;
+  }
+  if (nested != omp_get_max_threads() * (NTASKS / 100)) {
+    printf("%d tasks executed, expected %d\n", nested,
+           omp_get_max_threads() * (NTASKS / 100));
+    errors++;
+  }
+
+  if (errors) {
+    printf("failed\n");
+    return 1;
+  }
+  printf("passed\n");
+  return 0;
+}
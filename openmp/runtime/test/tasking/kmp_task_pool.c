@@ -0,0 +1,77 @@
+// RUN: %libomp-compile
+// RUN: env KMP_TASK_POOL=1 OMP_NUM_THREADS=4 %libomp-run
+// RUN: env KMP_TASK_POOL=1 OMP_NUM_THREADS=1 %libomp-run
+// RUN: env KMP_TASK_POOL=0 OMP_NUM_THREADS=4 %libomp-run
+
+// Task descriptors of several sizes, created by one thread and mostly freed
+// by the others: the private data of a task must not be clobbered by the
+// reuse of the descriptors.
+
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+
+#define NTASKS 20000
+#define ITERS 4
+
+int errors;
+
+#define DEFINE_PAYLOAD(N)                                                      \
+  typedef struct {                                                             \
+    int data[N];                                                               \
+  } payload##N;                                                                \
+  static void spawn##N(int seed) {                                             \
+    payload##N p;                                                              \
+    int k;                                                                     \
+    for (k = 0; k < N; k++)                                                    \
+      p.data[k] = seed + k;                                                    \
+    _Pragma("omp task firstprivate(p, seed)") {                                \
+      for (k = 0; k < N; k++) {                                                \
+        if (p.data[k] != seed + k) {                                           \
+          _Pragma("omp atomic") errors++;                                      \
+          break;                                                               \
+        }                                                                      \
+      }                                                                        \
+      memset(&p, 0xff, sizeof(p));                                             \
+    }                                                                          \
+  }
+
+// From the smallest size class to descriptors too large for the pool
+DEFINE_PAYLOAD(1)
+DEFINE_PAYLOAD(40)
+DEFINE_PAYLOAD(100)
+DEFINE_PAYLOAD(1000)
+
+int main() {
+  int iter;
+  for (iter = 0; iter < ITERS; iter++) {
+    #pragma omp parallel
+    {
+      // One producer: the descriptors are freed by the consumers
+      #pragma omp single
+      {
+        int i;
+        for (i = 0; i < NTASKS; i++) {
+          switch (i % 4) {
+          case 0: spawn1(i); break;
+          case 1: spawn40(i); break;
+          case 2: spawn100(i); break;
+          case 3: spawn1000(i); break;
+          }
+        }
+      }
+
+      // Every thread produces
+      int j;
+      for (j = 0; j < NTASKS / 100; j++)
+        spawn40(j * omp_get_thread_num());
+    }
+  }
+
+  if (errors) {
+    printf("failed: %d tasks found corrupted private data\n", errors);
+    return 1;
+  }
+  printf("passed\n");
+  return 0;
+}
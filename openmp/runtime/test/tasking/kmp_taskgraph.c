@@ -0,0 +1,172 @@
+// RUN: %libomp-compile && env OMP_NUM_THREADS=4 %libomp-run
+// RUN: %libomp-compile && env OMP_NUM_THREADS=1 %libomp-run
+
+// Task graph record and replay: the region is executed once to record the
+// graph, later iterations replay the recorded tasks with their dependences.
+
+#include <stdio.h>
+#include <omp.h>
+
+// OpenMP RTL interfaces
+typedef struct ident {
+  void *dummy; // not used in the library
+} ident_t;
+
+extern int __kmpc_global_thread_num(ident_t *);
+extern int __kmpc_taskgraph_begin(ident_t *, int gtid, int graph_id);
+extern void __kmpc_taskgraph_end(ident_t *, int gtid, int graph_id);
+extern void __kmpc_taskgraph_reset(ident_t *, int gtid, int graph_id);
+
+#define ITERS 20
+#define NTASKS 64
+#define NSLOTS 4
+
+long slots[NSLOTS];
+int executed;
+int recorded;
+int before, current, stale;
+
+// Each task updates a slot in an order dependent way, the dependences on the
+// slot must be kept by the replays.
+static void create_tasks() {
+  int i;
+  for (i = 0; i < NTASKS; i++) {
+    int step = i;
+    #pragma omp task firstprivate(i, step) depend(inout: slots[i % NSLOTS])
+    {
+      slots[i % NSLOTS] = (slots[i % NSLOTS] * 3 + step) % 1000003;
+      // The replays start again from the recorded private values
+      step = -1;
+      #pragma omp atomic
+      executed++;
+    }
+  }
+  // The tasks reading all the slots run after the writers
+  for (i = 0; i < NSLOTS; i++) {
+    #pragma omp task depend(in: slots[0], slots[1], slots[2], slots[3])
+    {
+      if (slots[0] < 0 || slots[1] < 0 || slots[2] < 0 || slots[3] < 0)
+        printf("negative slot\n");
+      #pragma omp atomic
+      executed++;
+    }
+  }
+}
+
+static int check(long *expected, int iter) {
+  int i, j;
+  for (i = 0; i < NTASKS; i++)
+    expected[i % NSLOTS] = (expected[i % NSLOTS] * 3 + i) % 1000003;
+  for (j = 0; j < NSLOTS; j++) {
+    if (slots[j] != expected[j]) {
+      printf("iteration %d: slot %d is %ld, expected %ld\n", iter, j, slots[j],
+             expected[j]);
+      return 1;
+    }
+  }
+  if (executed != (iter + 1) * (NTASKS + NSLOTS)) {
+    printf("iteration %d: %d tasks executed, expected %d\n", iter, executed,
+           (iter + 1) * (NTASKS + NSLOTS));
+    return 1;
+  }
+  return 0;
+}
+
+int main() {
+  long expected[NSLOTS] = {1, 2, 3, 4};
+  int errors = 0, nthreads = 1;
+  int i, iter;
+
+  for (i = 0; i < NSLOTS; i++)
+    slots[i] = expected[i];
+
+  #pragma omp parallel
+  #pragma omp single
+  {
+    int gtid = __kmpc_global_thread_num(NULL);
+    nthreads = omp_get_num_threads();
+    for (iter = 0; iter < ITERS && !errors; iter++) {
+      if (__kmpc_taskgraph_begin(NULL, gtid, 1)) {
+        recorded++;
+        create_tasks();
+      }
+      __kmpc_taskgraph_end(NULL, gtid, 1);
+      errors += check(expected, iter);
+    }
+    // The region is recorded only once, unless the tasks are serialized
+    if (recorded != (nthreads > 1 ? 1 : ITERS)) {
+      printf("graph 1 recorded %d times\n", recorded);
+      errors++;
+    }
+
+    // After a reset, the graph is recorded again
+    __kmpc_taskgraph_reset(NULL, gtid, 1);
+    recorded = 0;
+    for (; iter < 2 * ITERS && !errors; iter++) {
+      if (__kmpc_taskgraph_begin(NULL, gtid, 1)) {
+        recorded++;
+        create_tasks();
+      }
+      __kmpc_taskgraph_end(NULL, gtid, 1);
+      errors += check(expected, iter);
+    }
+    if (recorded != (nthreads > 1 ? 1 : ITERS)) {
+      printf("graph 1 recorded %d times after reset\n", recorded);
+      errors++;
+    }
+
+    // A region with a taskwait can't be replayed, it is always executed
+    recorded = 0;
+    for (i = 0; i < ITERS; i++) {
+      if (__kmpc_taskgraph_begin(NULL, gtid, 2)) {
+        recorded++;
+        #pragma omp task
+        {
+          #pragma omp atomic
+          executed++;
+        }
+        #pragma omp taskwait
+      }
+      __kmpc_taskgraph_end(NULL, gtid, 2);
+    }
+    if (recorded != ITERS) {
+      printf("graph 2 executed %d times\n", recorded);
+      errors++;
+    }
+
+    // A task created before the region may still be running when the region
+    // starts, the tasks of the region that depend on it must wait for it
+    for (i = 0; i < ITERS; i++) {
+      current = i;
+      #pragma omp task depend(out: before)
+      {
+        double start = omp_get_wtime();
+        while (omp_get_wtime() - start < 0.001)
+          ;
+        before = current + 1;
+      }
+      if (__kmpc_taskgraph_begin(NULL, gtid, 3)) {
+        #pragma omp task depend(in: before)
+        {
+          if (before != current + 1) {
+            #pragma omp atomic
+            stale++;
+          }
+        }
+      }
+      __kmpc_taskgraph_end(NULL, gtid, 3);
+      #pragma omp taskwait
+    }
+    if (stale) {
+      printf("graph 3 ran %d tasks before their predecessor\n", stale);
+      errors++;
+    }
+  }
+
+  if (errors) {
+    printf("failed\n");
+    return 1;
+  }
+  printf("passed\n");
+  return 0;
+}
@@ -0,0 +1,147 @@
+// RUN: %libomp-compile
+// RUN: env OMP_NUM_THREADS=4 %libomp-run
+// RUN: env OMP_NUM_THREADS=4 KMP_ADAPTIVE_AUTO_SCHEDULE=0 %libomp-run
+// RUN: env OMP_NUM_THREADS=4 OMP_SCHEDULE=auto %libomp-run runtime
+// RUN: env OMP_NUM_THREADS=1 %libomp-run
+/*
+  Test for the adaptive 'schedule(auto)': the schedule and the chunk size
+  change between the invocations of a loop, every iteration must still be
+  executed exactly once. Loops with the monotonic modifier must hand out
+  increasing chunks to each thread.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+
+// ---------------------------------------------------------------------------
+// Various definitions copied from OpenMP RTL
+enum sched {
+  kmp_sch_runtime = 37,
+  kmp_sch_auto = 38,
+};
+#define SCHEDULE_MONOTONIC (1 << 29)
+#define SCHEDULE_NONMONOTONIC (1 << 30)
+typedef long long i64;
+typedef struct {
+  int reserved_1;
+  int flags;
+  int reserved_2;
+  int reserved_3;
+  char *psource;
+} id;
+
+extern int __kmpc_global_thread_num(id*);
+extern void __kmpc_barrier(id*, int gtid);
+extern void __kmpc_dispatch_init_4(id*, int, enum sched, int, int, int, int);
+extern void __kmpc_dispatch_init_8(id*, int, enum sched, i64, i64, i64, i64);
+extern int __kmpc_dispatch_next_4(id*, int, void*, void*, void*, void*);
+extern int __kmpc_dispatch_next_8(id*, int, void*, void*, void*, void*);
+// End of definitions copied from OpenMP RTL.
+// ---------------------------------------------------------------------------
+static id loc1 = {0, 2, 0, 0, ";file;func;1;0;;"};
+static id loc2 = {0, 2, 0, 0, ";file;func;2;0;;"};
+static id loc3 = {0, 2, 0, 0, ";file;func;3;0;;"};
+
+#define N 5000
+#define INVOCATIONS 100
+
+int counts[N];
+volatile double sink;
+
+// Irregular work: the cost of an iteration grows with its index
+static void work(int i) {
+  double x = 0;
+  int k;
+  for (k = 0; k < i % 97 + (i > N / 2 ? 200 : 0); k++)
+    x += k * 0.5;
+  sink = x;
+}
+
+static int check_counts(const char *name, int inv, int expected) {
+  int i;
+  for (i = 0; i < N; i++) {
+    if (counts[i] != expected) {
+      printf("%s, invocation %d: iteration %d executed %d times\n", name, inv,
+             i, counts[i] - expected + 1);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int err = 0;
+  int inv = 0;
+  int runtime = argc > 1 && !strcmp(argv[1], "runtime");
+  enum sched nonmonotonic =
+      runtime ? kmp_sch_runtime : kmp_sch_auto | SCHEDULE_NONMONOTONIC;
+
+  #pragma omp parallel
+  {
+    int gtid = __kmpc_global_thread_num(&loc1);
+    int lb, ub, st, last;
+    i64 lb8, ub8, st8;
+    while (inv < INVOCATIONS && !err) {
+      // Ascending 32-bit loop
+      __kmpc_dispatch_init_4(&loc1, gtid, nonmonotonic, 0, N - 1, 1, 1);
+      while (__kmpc_dispatch_next_4(&loc1, gtid, &last, &lb, &ub, &st)) {
+        int i;
+        for (i = lb; i <= ub; i++) {
+          work(i);
+          #pragma omp atomic
+          counts[i]++;
+        }
+      }
+      // No barrier: the next loop may start while this one is finishing
+
+      // Descending 64-bit loop with a stride
+      __kmpc_dispatch_init_8(&loc2, gtid, nonmonotonic, 2 * N - 2, 0, -2, 1);
+      while (__kmpc_dispatch_next_8(&loc2, gtid, &last, &lb8, &ub8, &st8)) {
+        i64 i;
+        for (i = lb8; i >= ub8; i -= 2) {
+          work((int)(i / 2));
+          #pragma omp atomic
+          counts[i / 2]++;
+        }
+      }
+      __kmpc_barrier(&loc1, gtid);
+
+      // Monotonic loop: each thread must get increasing chunks
+      {
+        int prev = -1;
+        __kmpc_dispatch_init_4(&loc3, gtid, kmp_sch_auto | SCHEDULE_MONOTONIC,
+                               0, N - 1, 1, 1);
+        while (__kmpc_dispatch_next_4(&loc3, gtid, &last, &lb, &ub, &st)) {
+          int i;
+          if (lb <= prev) {
+            printf("monotonic, invocation %d: chunk %d-%d after %d\n", inv,
+                   lb, ub, prev);
+            #pragma omp atomic write
+            err = 1;
+          }
+          prev = ub;
+          for (i = lb; i <= ub; i++) {
+            work(i);
+            #pragma omp atomic
+            counts[i]++;
+          }
+        }
+      }
+      __kmpc_barrier(&loc1, gtid);
+
+      #pragma omp master
+      {
+        err |= check_counts("loops", inv, 3 * (inv + 1));
+        inv++;
+      }
+      __kmpc_barrier(&loc1, gtid);
+    }
+  }
+
+  if (err) {
+    printf("failed\n");
+    return 1;
+  }
+  printf("passed\n");
+  return 0;
+}